@@ -191,6 +191,7 @@ StdApp::~StdApp()
 
     if ( uses ( FeatInitPacketDataStore ) )
     {
+        PacketDataStore::disableThreadCache();
         PacketDataStore::shutdown();
     }
 }
@@ -413,6 +414,10 @@ int StdApp::initFeatures ( bool exitOnError )
     if ( !doExit && uses ( FeatInitPacketDataStore ) )
     {
         PacketDataStore::init();
+
+        // The main event loop gets and releases more packets than any other thread,
+        // so it shouldn't lock the data store every time it does that.
+        PacketDataStore::enableThreadCache();
     }
 
     if ( !doExit && uses ( FeatInitEventManager ) )
@@ -70,7 +70,8 @@ class StdApp: public NoCopy, protected EventManager::SignalHandler
         /// @brief If enabled, initFeatures() will make sure that AppDataPath is set.
         static const uint32_t FeatEnsureAppDataPath = ( 1 << 11 );
 
-        /// @brief If enabled, initFeatures() will initialize the PacketDataStore.
+        /// @brief If enabled, initFeatures() will initialize the PacketDataStore,
+        /// and enable its per-thread caches in the main thread.
         /// It also means that PacketDataStore::shutdown() will be called when StdApp is destroyed.
         static const uint32_t FeatInitPacketDataStore = ( 1 << 12 );
 
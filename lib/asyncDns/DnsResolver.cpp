@@ -14,34 +14,47 @@
  *  limitations under the License.
  */
 
-extern "C"
-{
-#include <net/if.h>
-#include <pthread.h>
-
-#include "dns/DnsInternal.h"
-}
-
-#include <cerrno>
-
-#ifdef PLATFORM_ANDROID
-#include "sys/os/Android/AndroidSocketApi.hpp"
-#endif
-
 #include "basic/Random.hpp"
-#include "sys/SocketApi.hpp"
 
 #include "DnsResolver.hpp"
-
-// This should be before including SimpleLog.h
-#define SIMPLE_LOG_TAG    "DNS/AsyncResolver"
-
-#include "simplelog/SimpleLog.h"
+#include "internal/DnsResolverPool.hpp"
 
 using namespace Pravala;
 
 TextLog DnsResolver::_log ( "dns_resolver" );
 
+uint32_t DnsResolver::_lastId ( 0 );
+
+ConfigLimitedNumber<uint16_t> DnsResolver::optNumWorkers (
+        0,
+        "dns_resolver.workers",
+        "The max number of threads performing DNS requests",
+        1, 1024, 8 );
+
+ConfigLimitedNumber<uint32_t> DnsResolver::optQueueSize (
+        0,
+        "dns_resolver.queue_size",
+        "The max number of DNS requests that can wait for a thread; Lookups started when the queue is full fail",
+        1, 1024 * 1024, 4096 );
+
+ConfigLimitedNumber<uint32_t> DnsResolver::optCacheSize (
+        0,
+        "dns_resolver.cache_size",
+        "The max number of entries in the DNS cache; 0 disables caching",
+        0, 1024 * 1024, 1024 );
+
+ConfigLimitedNumber<uint32_t> DnsResolver::optMaxCacheTtl (
+        0,
+        "dns_resolver.max_cache_ttl",
+        "The max time (in seconds) for which DNS results are cached; Results with lower TTLs are cached shorter",
+        0, 7 * 24 * 3600, 3600 );
+
+ConfigLimitedNumber<uint32_t> DnsResolver::optNegativeCacheTtl (
+        0,
+        "dns_resolver.negative_cache_ttl",
+        "The time (in seconds) for which empty DNS results are cached; Errors are never cached",
+        0, 24 * 3600, 30 );
+
 String DnsResolver::SrvRecord::toString() const
 {
     return String ( "priority: %1; weight: %2; port: %3; target: %4" )
@@ -51,83 +64,18 @@ String DnsResolver::SrvRecord::toString() const
            .arg ( target );
 }
 
-DnsResolver::LookupCompleteTask::LookupCompleteTask (
-        DnsResolver * resolver, uint32_t lookupId, enum DnsRecordType qType,
-        struct DnsRecord * results, int numResults ):
-    Task ( resolver ),
-    _resolver ( resolver ),
-    _results ( results ),
-    _lookupId ( lookupId ),
-    _numResults ( numResults ),
-    _type ( qType )
-{
-}
-
-DnsResolver::LookupCompleteTask::~LookupCompleteTask()
-{
-    if ( _results != 0 )
-    {
-        free ( _results );
-    }
-}
-
-void DnsResolver::LookupCompleteTask::runTask()
-{
-    if ( _resolver != 0 )
-    {
-        LOG ( L_DEBUG, "Lookup " << _lookupId << " completed; Type: " << _type << "; NumResults: " << _numResults );
-
-        _resolver->lookupComplete ( _lookupId, _type, _results, _numResults );
-    }
-}
-
-DnsResolver::DnsResolver ( Owner & owner ): _owner ( owner ), _currentId ( 0 ), _lastId ( 0 )
+DnsResolver::DnsResolver ( Owner & owner ): _owner ( owner ), _currentId ( 0 ), _reqType ( 0 )
 {
     Random::init();
 
-    AsyncQueue::get().registerReceiver ( this );
+    DnsResolverPool::get().registerResolver ( this );
 }
 
 DnsResolver::~DnsResolver()
 {
-    AsyncQueue::get().unregisterReceiver ( this );
+    DnsResolverPool::get().unregisterResolver ( this );
 }
 
-/// @brief Contains configuration for the DNS lookup thread.
-struct ThreadConfig: public NoCopy
-{
-    /// @brief The resolver running the query.
-    DnsResolver * resolver;
-
-    /// @brief Contains the list of DNS servers.
-    /// config->dnsServers points to this.
-    /// We use a SimpleArray, because it will create a memory copy of the original array, to avoid threading issues.
-    SimpleArray<struct sockaddr_in6> servers;
-
-    /// @brief The name to query.
-    String name;
-
-    /// @brief Interface configuration.
-    DnsResolver::IfaceConfig ifaceConfig;
-
-    /// @brief The ID of the lookup.
-    uint32_t id;
-
-    /// @brief The type of the query to perform.
-    enum DnsRecordType queryType;
-
-    /// @brief The timeout for the operation (in seconds).
-    uint16_t timeout;
-
-    /// @brief A bitmask of ReqFlag* values.
-    uint8_t flags;
-
-    /// @brief Default constructor.
-    ThreadConfig(): resolver ( 0 ), id ( 0 ), queryType ( DnsRTypeInvalid ), timeout ( 0 ), flags ( 0 )
-    {
-    }
-};
-
 ERRCODE DnsResolver::start (
         const HashSet<SockAddr> & dnsServers,
         uint8_t reqType, const String & name, uint8_t flags,
@@ -174,265 +122,46 @@ ERRCODE DnsResolver::start (
     // Every time we create a request type, we unset it in reqType.
     while ( reqType != 0 )
     {
-        ThreadConfig * const tCfg = new ThreadConfig();
-
-        tCfg->resolver = this;
-        tCfg->id = _currentId;
-        tCfg->timeout = timeout;
-        tCfg->flags = flags;
-
-        // We use c_str() to perform a deep copy, to avoid threading issues.
-        tCfg->name = _currentName.c_str();
-
-        // This also creates a memory copy:
-        tCfg->servers = servers;
-
-        if ( ifaceConfig != 0 && ifaceConfig->isUsed() )
-        {
-            tCfg->ifaceConfig.bindToNetwork = ifaceConfig->bindToNetwork;
-
-            // We use c_str() to perform a deep copy, to avoid threading issues.
-            tCfg->ifaceConfig.bindToIfaceV4 = ifaceConfig->bindToIfaceV4.c_str();
-            tCfg->ifaceConfig.bindToIfaceV6 = ifaceConfig->bindToIfaceV6.c_str();
-        }
+        enum DnsRecordType qType = DnsRTypeInvalid;
 
         if ( reqType & ReqTypeA )
         {
             reqType &= ~ReqTypeA;
-            tCfg->queryType = DnsRTypeA;
+            qType = DnsRTypeA;
         }
         else if ( reqType & ReqTypeAAAA )
         {
             reqType &= ~ReqTypeAAAA;
-            tCfg->queryType = DnsRTypeAAAA;
+            qType = DnsRTypeAAAA;
         }
         else if ( reqType & ReqTypeSRV )
         {
             reqType &= ~ReqTypeSRV;
-            tCfg->queryType = DnsRTypeSRV;
+            qType = DnsRTypeSRV;
         }
         else
         {
             assert ( false );
 
-            delete tCfg;
-
             stop();
             return Error::InternalError;
         }
 
-        pthread_attr_t attrs;
-
-        pthread_attr_init ( &attrs );
+        const ERRCODE eCode = DnsResolverPool::get().lookup (
+            this, _currentId, qType, _currentName, servers, flags, ifaceConfig, timeout );
 
-        // This way we won't need to join it:
-        pthread_attr_setdetachstate ( &attrs, PTHREAD_CREATE_DETACHED );
-
-        pthread_t t;
-        const int ret = pthread_create ( &t, &attrs, threadMain, tCfg );
-
-        if ( ret != 0 )
+        if ( NOT_OK ( eCode ) )
         {
-            LOG ( L_WARN, "Error starting a thread: " << strerror ( errno ) );
-
-            delete tCfg;
+            LOG_ERR ( L_WARN, eCode, "Error starting a lookup of '" << _currentName << "'; Type: " << qType );
 
             stop();
-            return Error::InternalError;
+            return eCode;
         }
     }
 
     return Error::Success;
 }
 
-/// @brief A socket() function to be used by the underlying dns.c resolver.
-/// It expects a DnsApiUserData object with vPtr pointed at IfaceConfig object.
-/// That object's configuration is used for binding sockets to interfaces and/or networks.
-/// @note This function is copied from NativeDns.c.
-///       The difference is, this version supports binding to Android networks.
-/// @param [in] family family for socket() call.
-/// @param [in] type type for socket() call.
-/// @param [in] protocol protocol for socket() call.
-/// @param [in] userData DNS user data pointer. If invalid, or with invalid vPtr, no binding will be performed.
-/// @return Result of socket() call.
-static int dnsBoundSocket ( int family, int type, int protocol, union DnsApiUserData * userData )
-{
-    int sockFd = socket ( family, type, protocol );
-
-    if ( sockFd < 0 || !userData )
-    {
-        return sockFd;
-    }
-
-    const DnsResolver::IfaceConfig * ifCfg = ( const DnsResolver::IfaceConfig * ) userData->vPtr;
-
-    if ( !ifCfg )
-    {
-        return sockFd;
-    }
-
-#ifdef PLATFORM_ANDROID
-    if ( ifCfg->bindToNetwork >= 0
-         && NOT_OK ( AndroidSocketApi::bindSocketToNetwork ( sockFd, ifCfg->bindToNetwork ) ) )
-    {
-        SocketApi::close ( sockFd );
-        return -1;
-    }
-#endif
-
-    const char * ifaceName = 0;
-
-    if ( family == AF_INET )
-    {
-        ifaceName = ifCfg->bindToIfaceV4.c_str();
-    }
-    else if ( family == AF_INET6 )
-    {
-        ifaceName = ifCfg->bindToIfaceV6.c_str();
-    }
-
-    if ( !ifaceName || ifaceName[ 0 ] == 0 )
-    {
-        return sockFd;
-    }
-
-#if defined( IP_BOUND_IF ) || defined( IPV6_BOUND_IF )
-    int ifIndex = -1;
-
-    if ( family != AF_INET && family != AF_INET6 )
-    {
-        SIMPLE_LOG_ERR ( "Unsupported socket family for binding: %d; IfaceName: '%s'", family, ifaceName );
-    }
-    else if ( ( ifIndex = if_nametoindex ( ifaceName ) ) < 1 )
-    {
-        SIMPLE_LOG_ERR ( "Failed to find interface index for IfaceName: '%s'; Error: [%d] %s",
-                         ifaceName, errno, strerror ( errno ) );
-    }
-#if defined( IP_BOUND_IF )
-    else if ( family == AF_INET
-              && 0 != setsockopt ( sockFd, IPPROTO_IP, IP_BOUND_IF, &ifIndex, sizeof ( ifIndex ) ) )
-    {
-        SIMPLE_LOG_ERR ( "Error binding socket with FD %d; Family: %d; IfaceName: '%s'; IfaceIndex: %d; Error: [%d] %s",
-                         sockFd, family, ifaceName, ifIndex, errno, strerror ( errno ) );
-    }
-#else
-    else if ( family == AF_INET )
-    {
-        SIMPLE_LOG_ERR ( "IP_BOUND_IF not defined; Unsupported socket family for binding: %d; IfaceName: '%s'",
-                         family, ifaceName );
-    }
-#endif
-#if defined( IPV6_BOUND_IF )
-    else if ( family == AF_INET6
-              && 0 != setsockopt ( sockFd, IPPROTO_IPV6, IPV6_BOUND_IF, &ifIndex, sizeof ( ifIndex ) ) )
-    {
-        SIMPLE_LOG_ERR ( "Error binding socket with FD %d; Family: %d; IfaceName: '%s'; IfaceIndex: %d; Error: [%d] %s",
-                         sockFd, family, ifaceName, ifIndex, errno, strerror ( errno ) );
-    }
-#else
-    else if ( family == AF_INET6 )
-    {
-        SIMPLE_LOG_ERR ( "IPV6_BOUND_IF not defined; Unsupported socket family for binding: %d; IfaceName: '%s'",
-                         family, ifaceName );
-    }
-#endif
-    else
-    {
-        return sockFd;
-    }
-#elif defined( SO_BINDTODEVICE )
-    const socklen_t ifaceNameLen = strlen ( ifaceName );
-
-    if ( ifaceNameLen + 1 > IFNAMSIZ )
-    {
-        // +1, because NULL needs to fit as well.
-
-        SIMPLE_LOG_ERR ( "Interface name '%s' is too long; Max length is %u characters",
-                         ifaceName, IFNAMSIZ - 1 );
-    }
-    else if ( 0 != setsockopt ( sockFd, SOL_SOCKET, SO_BINDTODEVICE, ifaceName, ifaceNameLen + 1 ) )
-    {
-        SIMPLE_LOG_ERR ( "Error setting socket option SO_BINDTODEVICE for socket with FD %d"
-                         " using IfaceName: '%s'; Error: [%d] %s",
-                         sockFd, ifaceName, errno, strerror ( errno ) );
-    }
-    else
-    {
-        return sockFd;
-    }
-#else
-    SIMPLE_LOG_ERR ( "Could not bind to iface '%s': Binding to interfaces is not supported on this platform",
-                     bindToIface );
-#endif
-
-    close ( sockFd );
-
-    errno = EINVAL;
-    return -1;
-}
-
-void * DnsResolver::threadMain ( void * ptr )
-{
-    ThreadConfig * const cfg = ( ThreadConfig * ) ptr;
-
-    if ( !cfg )
-    {
-        return 0;
-    }
-
-    if ( !cfg->resolver || cfg->servers.size() < 1 )
-    {
-        delete cfg;
-        return 0;
-    }
-
-    unsigned int tout = cfg->timeout;
-
-    if ( tout > MaxTimeout || tout < 1 )
-    {
-        tout = MaxTimeout;
-    }
-
-    DnsSocketFuncType socketFunc = 0;
-    DnsServerConfig * srvCfg = new DnsServerConfig[ cfg->servers.size() ];
-
-    for ( size_t i = 0; i < cfg->servers.size(); ++i )
-    {
-        // We store both v4 and v6 addresses as sockaddr_in6, because it's bigger.
-        srvCfg[ i ].address.v6 = cfg->servers[ i ];
-
-        if ( cfg->ifaceConfig.isUsed() )
-        {
-            socketFunc = dnsBoundSocket;
-            srvCfg[ i ].userData.vPtr = &( cfg->ifaceConfig );
-        }
-
-        if ( cfg->flags & ReqFlagUseTcp )
-        {
-            srvCfg[ i ].flags |= DNS_SERVER_FLAG_USE_TCP;
-        }
-
-        if ( cfg->flags & ReqFlagDontUseTcp )
-        {
-            srvCfg[ i ].flags |= DNS_SERVER_FLAG_DONT_USE_TCP;
-        }
-    }
-
-    struct DnsRecord * results = 0;
-
-    const int numResults
-        = dns_resolve_ext (
-        cfg->name.c_str(), cfg->queryType, srvCfg, cfg->servers.size(), socketFunc, tout, &results );
-
-    AsyncQueue::get().blockingRunTask (
-        new LookupCompleteTask ( cfg->resolver, cfg->id, cfg->queryType, results, numResults ) );
-
-    delete cfg;
-    delete[] srvCfg;
-
-    return 0;
-}
-
 void DnsResolver::stop()
 {
     _reqType = 0;
@@ -24,6 +24,7 @@ extern "C"
 #include "basic/NoCopy.hpp"
 #include "basic/String.hpp"
 #include "basic/IpAddress.hpp"
+#include "config/ConfigNumber.hpp"
 #include "event/AsyncQueue.hpp"
 #include "log/TextLog.hpp"
 
@@ -32,9 +33,26 @@ namespace Pravala
 /// @brief Abstract class that performs a DNS lookup on a thread.
 /// This class should only be created and used on MasClient's thread,
 /// with the exception of notifyLookupComplete() which will be called on a different thread.
+/// Lookups are performed by a shared pool of worker threads, which also caches results (honoring their TTLs)
+/// and coalesces concurrent lookups of the same names (using the same DNS servers and configuration).
 class DnsResolver: public NoCopy
 {
     public:
+        /// @brief The max number of threads performing DNS requests.
+        static ConfigLimitedNumber<uint16_t> optNumWorkers;
+
+        /// @brief The max number of DNS requests that can wait for a worker thread.
+        static ConfigLimitedNumber<uint32_t> optQueueSize;
+
+        /// @brief The max number of entries in the DNS cache (0 disables caching).
+        static ConfigLimitedNumber<uint32_t> optCacheSize;
+
+        /// @brief The max time (in seconds) for which successful DNS results are cached.
+        static ConfigLimitedNumber<uint32_t> optMaxCacheTtl;
+
+        /// @brief The time (in seconds) for which empty DNS results are cached.
+        static ConfigLimitedNumber<uint32_t> optNegativeCacheTtl;
+
         /// @brief DNS lookup for A (IPv4) records.
         static const uint8_t ReqTypeA = ( 1 << 0 );
 
@@ -161,6 +179,11 @@ class DnsResolver: public NoCopy
         /// @param [in] ifaceConfig The interface configuration for binding requests to interfaces.
         /// @param [in] timeout Timeout for the operation, in seconds.
         ///                     If 0 or larger than MaxTimeout, then MaxTimeout value will be used instead.
+        /// @return Standard error code:
+        ///          - Success if the lookup has been started.
+        ///          - InvalidParameter if any of the parameters is invalid.
+        ///          - SoftFail if there are too many DNS requests waiting (see optQueueSize).
+        ///          - ThreadCreateFailed if no thread that could perform DNS requests could be started.
         ERRCODE start (
             const HashSet<SockAddr> & dnsServers,
             uint8_t reqType,
@@ -199,44 +222,14 @@ class DnsResolver: public NoCopy
         static TextLog _log; ///< Log stream.
 
     private:
-        /// @brief A helper class to deliver results of a lookup on the main thread.
-        class LookupCompleteTask: public AsyncQueue::Task
-        {
-            public:
-                /// @brief Constructor.
-                /// @param [in] resolver Pointer to the DnsResolver instance.
-                /// @param [in] lookupId The ID of the lookup.
-                /// @param [in] qType The type of DNS lookup that completed.
-                /// @param [in] results The pointer to the results. Deallocated when this is destroyed.
-                /// @param [in] numResults The number of results from the lookup (can be 0); -1 if there was an error.
-                LookupCompleteTask (
-                    DnsResolver * resolver, uint32_t lookupId, enum DnsRecordType qType,
-                    struct DnsRecord * results, int numResults );
-
-                /// @brief Destructor
-                virtual ~LookupCompleteTask();
-
-            protected:
-                virtual void runTask();
-
-            private:
-                DnsResolver * const _resolver; ///< Pointer to the DnsResolver instance.
-
-                /// @brief The pointer to the results.
-                /// This is a continuous memory segment that will be deallocated using free().
-                struct DnsRecord * const _results;
-
-                const uint32_t _lookupId; ///< The ID of the DNS lookup.
-                const int _numResults; ///< The number of results from the lookup (can be 0); -1 if there was an error.
-
-                enum DnsRecordType _type; ///< The type of DNS lookup.
-        };
-
         Owner & _owner; ///< The owner that will receive the callbacks.
 
         String _currentName; ///< The name currently being looked up.
         uint32_t _currentId; ///< The ID of currently running lookup.
-        uint32_t _lastId;    ///< The last lookup ID used.
+
+        /// @brief The last lookup ID used.
+        /// It is shared by all resolvers, so that results of old lookups are never mistaken for the current ones.
+        static uint32_t _lastId;
 
         /// @brief A bitmask of request types being performed.
         /// When performing multiple requests, it is used to determine what else is still running.
@@ -246,18 +239,15 @@ class DnsResolver: public NoCopy
         /// It is used when both A and AAAA lookups are performed at the same time.
         HashSet<IpAddress> _pendingResults;
 
-        /// @brief Called by LookupCompleteTask on the main thread.
+        /// @brief Called by DnsResolverPool on the main thread.
         /// @param [in] id The ID of the lookup.
         /// @param [in] qType The type of DNS lookup that completed.
         /// @param [in] results The pointer to the results.
-        ///                     This will be deallocated by LookupCompleteTask after this call.
+        ///                     This will be deallocated by DnsResolverPool after this call.
         /// @param [in] numResults The number of results from the lookup (can be 0); -1 if there was an error.
         void lookupComplete ( uint32_t id, enum DnsRecordType qType, struct DnsRecord * results, int numResults );
 
-        /// @brief The function to be run by DNS lookup threads.
-        /// @param [in] ptr A pointer to user data. Should be pointing to internal ThreadConfig object.
-        /// @return NULL.
-        static void * threadMain ( void * ptr );
+        friend class DnsResolverPool;
 };
 
 /// @brief Generates a string with the list of SrvRecord objects.
@@ -0,0 +1,779 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+extern "C"
+{
+#include <net/if.h>
+#include <pthread.h>
+
+#include "dns/DnsInternal.h"
+}
+
+#include <cerrno>
+#include <cstdlib>
+
+#ifdef PLATFORM_ANDROID
+#include "sys/os/Android/AndroidSocketApi.hpp"
+#endif
+
+#include "basic/Math.hpp"
+#include "basic/SockAddr.hpp"
+#include "sys/SocketApi.hpp"
+
+#include "DnsResolverPool.hpp"
+
+// This should be before including SimpleLog.h
+#define SIMPLE_LOG_TAG    "DNS/AsyncResolver"
+
+#include "simplelog/SimpleLog.h"
+
+using namespace Pravala;
+
+TextLog DnsResolverPool::_log ( "dns_resolver_pool" );
+
+DnsResolverPool::Query::Query():
+    results ( 0 ), numResults ( -1 ), queryType ( DnsRTypeInvalid ), timeout ( 0 ), flags ( 0 )
+{
+}
+
+DnsResolverPool::Query::~Query()
+{
+    if ( results != 0 )
+    {
+        free ( results );
+        results = 0;
+    }
+}
+
+DnsResolverPool::CacheEntry::CacheEntry(): results ( 0 ), numResults ( 0 )
+{
+}
+
+DnsResolverPool::CacheEntry::~CacheEntry()
+{
+    if ( results != 0 )
+    {
+        free ( results );
+        results = 0;
+    }
+}
+
+DnsResolverPool::QueryCompleteTask::QueryCompleteTask ( DnsResolverPool * pool, Query * query ):
+    Task ( pool ),
+    _pool ( pool ),
+    _query ( query )
+{
+}
+
+DnsResolverPool::QueryCompleteTask::~QueryCompleteTask()
+{
+    delete _query;
+    _query = 0;
+}
+
+void DnsResolverPool::QueryCompleteTask::runTask()
+{
+    Query * const query = _query;
+
+    _query = 0;
+
+    if ( _pool != 0 && query != 0 )
+    {
+        _pool->queryComplete ( query );
+    }
+    else
+    {
+        delete query;
+    }
+}
+
+DnsResolverPool & DnsResolverPool::get()
+{
+    static DnsResolverPool * global = 0;
+
+    if ( !global )
+    {
+        global = new DnsResolverPool();
+    }
+
+    return *global;
+}
+
+DnsResolverPool::DnsResolverPool():
+    _mutex ( "DnsResolverPool", true ),
+    _queueSem ( "DnsResolverPool" ),
+    _numIdle ( 0 ),
+    _numWorkers ( 0 ),
+    _numRequests ( 0 ),
+    _isDelivering ( false )
+{
+    if ( _queueSem.init ( 0 ) != 0 )
+    {
+        LOG ( L_FATAL_ERROR, "Error initializing the semaphore: " << strerror ( errno ) );
+    }
+
+    AsyncQueue::get().registerReceiver ( this );
+}
+
+void DnsResolverPool::registerResolver ( DnsResolver * resolver )
+{
+    if ( resolver != 0 )
+    {
+        _resolvers.insert ( resolver );
+    }
+}
+
+void DnsResolverPool::unregisterResolver ( DnsResolver * resolver )
+{
+    // Pending queries may still keep waiters for this resolver; they are skipped when results are delivered.
+    _resolvers.remove ( resolver );
+
+    for ( size_t i = 0; i < _deliveries.size(); ++i )
+    {
+        if ( _deliveries[ i ].resolver == resolver )
+        {
+            _deliveries[ i ].resolver = 0;
+        }
+    }
+}
+
+void DnsResolverPool::clearCache()
+{
+    for ( HashMap<String, CacheEntry *>::Iterator it ( _cache ); it.isValid(); it.next() )
+    {
+        delete it.value();
+    }
+
+    _cache.clear();
+}
+
+String DnsResolverPool::getQueryKey (
+        enum DnsRecordType qType, const String & name,
+        const SimpleArray<struct sockaddr_in6> & servers, uint8_t flags,
+        const DnsResolver::IfaceConfig * ifaceConfig )
+{
+    // The order of servers doesn't matter (they are all queried in parallel), so we sort them:
+    StringList srvList;
+
+    for ( size_t i = 0; i < servers.size(); ++i )
+    {
+        // Both v4 and v6 addresses are stored as sockaddr_in6:
+        srvList.append ( SockAddr ( ( const struct sockaddr * ) &servers[ i ], sizeof ( servers[ i ] ) ).toString() );
+    }
+
+    srvList.sortAscending();
+
+    String iface;
+
+    if ( ifaceConfig != 0 && ifaceConfig->isUsed() )
+    {
+        iface = String ( "%1/%2/%3" )
+                .arg ( ifaceConfig->bindToIfaceV4 )
+                .arg ( ifaceConfig->bindToIfaceV6 )
+                .arg ( ifaceConfig->bindToNetwork );
+    }
+
+    // Names are case-insensitive.
+    return String ( "%1|%2|%3|%4|%5" )
+           .arg ( ( int ) qType )
+           .arg ( flags )
+           .arg ( name.toLower() )
+           .arg ( String::join ( srvList ) )
+           .arg ( iface );
+}
+
+struct DnsRecord * DnsResolverPool::copyRecords (
+        const struct DnsRecord * records, int numRecords, uint32_t maxTtl )
+{
+    if ( !records || numRecords < 1 )
+    {
+        return 0;
+    }
+
+    // Just like dns_resolve_ext() does, we put everything (including SRV targets) in a single memory segment.
+    size_t size = sizeof ( struct DnsRecord ) * numRecords;
+
+    for ( int i = 0; i < numRecords; ++i )
+    {
+        if ( records[ i ].recordType == DnsRTypeSRV && records[ i ].data.srv.target != 0 )
+        {
+            size += strlen ( records[ i ].data.srv.target ) + 1;
+        }
+    }
+
+    struct DnsRecord * const ret = ( struct DnsRecord * ) malloc ( size );
+
+    if ( !ret )
+    {
+        return 0;
+    }
+
+    memcpy ( ret, records, sizeof ( struct DnsRecord ) * numRecords );
+
+    char * strData = ( char * ) ( ret + numRecords );
+
+    for ( int i = 0; i < numRecords; ++i )
+    {
+        ret[ i ].ttl = min ( ret[ i ].ttl, maxTtl );
+
+        if ( ret[ i ].recordType == DnsRTypeSRV && ret[ i ].data.srv.target != 0 )
+        {
+            const size_t len = strlen ( ret[ i ].data.srv.target ) + 1;
+
+            memcpy ( strData, ret[ i ].data.srv.target, len );
+
+            ret[ i ].data.srv.target = strData;
+            strData += len;
+        }
+    }
+
+    return ret;
+}
+
+ERRCODE DnsResolverPool::lookup (
+        DnsResolver * resolver, uint32_t lookupId, enum DnsRecordType qType, const String & name,
+        const SimpleArray<struct sockaddr_in6> & servers, uint8_t flags,
+        const DnsResolver::IfaceConfig * ifaceConfig, uint16_t timeout )
+{
+    if ( !resolver || name.isEmpty() || servers.size() < 1 )
+    {
+        return Error::InvalidParameter;
+    }
+
+    const String key ( getQueryKey ( qType, name, servers, flags, ifaceConfig ) );
+
+    Waiter waiter;
+    waiter.resolver = resolver;
+    waiter.lookupId = lookupId;
+
+    CacheEntry * cEntry = 0;
+
+    if ( _cache.find ( key, cEntry ) )
+    {
+        assert ( cEntry != 0 );
+
+        const Time & now = EventManager::getCurrentTime();
+
+        if ( cEntry->expiresAt > now )
+        {
+            LOG ( L_DEBUG2, "Lookup " << lookupId << " of '" << name << "' (type " << qType
+                  << ") served from the cache; NumResults: " << cEntry->numResults );
+
+            addDelivery ( resolver, lookupId, qType, cEntry->results, cEntry->numResults,
+                          cEntry->expiresAt.getDiffInSeconds ( now ) );
+
+            // We never call the resolver from within lookup(), so we deliver the results at the end of the loop:
+            EventManager::loopEndSubscribe ( this );
+
+            return Error::Success;
+        }
+
+        _cache.remove ( key );
+        delete cEntry;
+    }
+
+    Query * query = 0;
+
+    if ( _pending.find ( key, query ) )
+    {
+        assert ( query != 0 );
+
+        LOG ( L_DEBUG2, "Lookup " << lookupId << " of '" << name << "' (type " << qType
+              << ") coalesced with a pending query" );
+
+        query->waiters.append ( waiter );
+
+        return Error::Success;
+    }
+
+    query = new Query();
+    query->key = key;
+    query->waiters.append ( waiter );
+    query->queryType = qType;
+    query->timeout = timeout;
+    query->flags = flags;
+
+    // We use c_str() to perform deep copies, to avoid threading issues.
+    query->name = name.c_str();
+
+    if ( ifaceConfig != 0 && ifaceConfig->isUsed() )
+    {
+        query->ifaceConfig.bindToNetwork = ifaceConfig->bindToNetwork;
+        query->ifaceConfig.bindToIfaceV4 = ifaceConfig->bindToIfaceV4.c_str();
+        query->ifaceConfig.bindToIfaceV6 = ifaceConfig->bindToIfaceV6.c_str();
+    }
+
+    // This also creates a memory copy:
+    query->servers = servers;
+
+    bool needWorker = false;
+
+    {
+        MutexLock lock ( _mutex );
+
+        if ( _queue.size() >= DnsResolver::optQueueSize.value() )
+        {
+            LOG ( L_WARN, "Too many DNS requests waiting (" << _queue.size()
+                  << "); Not starting a lookup of '" << name << "' (type " << qType << ")" );
+
+            delete query;
+            return Error::SoftFail;
+        }
+
+        _queue.append ( query );
+
+        needWorker = ( _queue.size() > _numIdle && _numWorkers < DnsResolver::optNumWorkers.value() );
+    }
+
+    if ( needWorker && !startWorker() && _numWorkers < 1 )
+    {
+        // There are no workers that could run it...
+
+        MutexLock lock ( _mutex );
+
+        _queue.removeValue ( query );
+        delete query;
+
+        return Error::ThreadCreateFailed;
+    }
+
+    _pending.insert ( key, query );
+    ++_numRequests;
+
+    LOG ( L_DEBUG2, "Lookup " << lookupId << " of '" << name << "' (type " << qType << ") queued" );
+
+    _queueSem.post();
+
+    return Error::Success;
+}
+
+bool DnsResolverPool::startWorker()
+{
+    pthread_attr_t attrs;
+
+    pthread_attr_init ( &attrs );
+
+    // This way we won't need to join it:
+    pthread_attr_setdetachstate ( &attrs, PTHREAD_CREATE_DETACHED );
+
+    pthread_t t;
+    const int ret = pthread_create ( &t, &attrs, threadMain, this );
+
+    pthread_attr_destroy ( &attrs );
+
+    if ( ret != 0 )
+    {
+        LOG ( L_WARN, "Error starting a DNS worker thread: " << strerror ( ret ) );
+        return false;
+    }
+
+    ++_numWorkers;
+
+    LOG ( L_DEBUG, "Started a DNS worker thread; Number of workers: " << _numWorkers );
+
+    return true;
+}
+
+void * DnsResolverPool::threadMain ( void * arg )
+{
+    if ( arg != 0 )
+    {
+        ( ( DnsResolverPool * ) arg )->runWorker();
+    }
+
+    return 0;
+}
+
+void DnsResolverPool::runWorker()
+{
+    while ( true )
+    {
+        _mutex.lock();
+        ++_numIdle;
+        _mutex.unlock();
+
+        while ( _queueSem.wait() != 0 )
+        {
+            // EINTR
+        }
+
+        _mutex.lock();
+
+        assert ( _numIdle > 0 );
+        --_numIdle;
+
+        Query * query = 0;
+
+        if ( !_queue.isEmpty() )
+        {
+            query = _queue.first();
+            _queue.removeFirst();
+        }
+
+        _mutex.unlock();
+
+        if ( !query )
+        {
+            continue;
+        }
+
+        performQuery ( *query );
+
+        AsyncQueue::get().blockingRunTask ( new QueryCompleteTask ( this, query ) );
+    }
+}
+
+/// @brief A socket() function to be used by the underlying dns.c resolver.
+/// It expects a DnsApiUserData object with vPtr pointed at IfaceConfig object.
+/// That object's configuration is used for binding sockets to interfaces and/or networks.
+/// @note This function is copied from NativeDns.c.
+///       The difference is, this version supports binding to Android networks.
+/// @param [in] family family for socket() call.
+/// @param [in] type type for socket() call.
+/// @param [in] protocol protocol for socket() call.
+/// @param [in] userData DNS user data pointer. If invalid, or with invalid vPtr, no binding will be performed.
+/// @return Result of socket() call.
+static int dnsBoundSocket ( int family, int type, int protocol, union DnsApiUserData * userData )
+{
+    int sockFd = socket ( family, type, protocol );
+
+    if ( sockFd < 0 || !userData )
+    {
+        return sockFd;
+    }
+
+    const DnsResolver::IfaceConfig * ifCfg = ( const DnsResolver::IfaceConfig * ) userData->vPtr;
+
+    if ( !ifCfg )
+    {
+        return sockFd;
+    }
+
+#ifdef PLATFORM_ANDROID
+    if ( ifCfg->bindToNetwork >= 0
+         && NOT_OK ( AndroidSocketApi::bindSocketToNetwork ( sockFd, ifCfg->bindToNetwork ) ) )
+    {
+        SocketApi::close ( sockFd );
+        return -1;
+    }
+#endif
+
+    const char * ifaceName = 0;
+
+    if ( family == AF_INET )
+    {
+        ifaceName = ifCfg->bindToIfaceV4.c_str();
+    }
+    else if ( family == AF_INET6 )
+    {
+        ifaceName = ifCfg->bindToIfaceV6.c_str();
+    }
+
+    if ( !ifaceName || ifaceName[ 0 ] == 0 )
+    {
+        return sockFd;
+    }
+
+#if defined( IP_BOUND_IF ) || defined( IPV6_BOUND_IF )
+    int ifIndex = -1;
+
+    if ( family != AF_INET && family != AF_INET6 )
+    {
+        SIMPLE_LOG_ERR ( "Unsupported socket family for binding: %d; IfaceName: '%s'", family, ifaceName );
+    }
+    else if ( ( ifIndex = if_nametoindex ( ifaceName ) ) < 1 )
+    {
+        SIMPLE_LOG_ERR ( "Failed to find interface index for IfaceName: '%s'; Error: [%d] %s",
+                         ifaceName, errno, strerror ( errno ) );
+    }
+#if defined( IP_BOUND_IF )
+    else if ( family == AF_INET
+              && 0 != setsockopt ( sockFd, IPPROTO_IP, IP_BOUND_IF, &ifIndex, sizeof ( ifIndex ) ) )
+    {
+        SIMPLE_LOG_ERR ( "Error binding socket with FD %d; Family: %d; IfaceName: '%s'; IfaceIndex: %d; Error: [%d] %s",
+                         sockFd, family, ifaceName, ifIndex, errno, strerror ( errno ) );
+    }
+#else
+    else if ( family == AF_INET )
+    {
+        SIMPLE_LOG_ERR ( "IP_BOUND_IF not defined; Unsupported socket family for binding: %d; IfaceName: '%s'",
+                         family, ifaceName );
+    }
+#endif
+#if defined( IPV6_BOUND_IF )
+    else if ( family == AF_INET6
+              && 0 != setsockopt ( sockFd, IPPROTO_IPV6, IPV6_BOUND_IF, &ifIndex, sizeof ( ifIndex ) ) )
+    {
+        SIMPLE_LOG_ERR ( "Error binding socket with FD %d; Family: %d; IfaceName: '%s'; IfaceIndex: %d; Error: [%d] %s",
+                         sockFd, family, ifaceName, ifIndex, errno, strerror ( errno ) );
+    }
+#else
+    else if ( family == AF_INET6 )
+    {
+        SIMPLE_LOG_ERR ( "IPV6_BOUND_IF not defined; Unsupported socket family for binding: %d; IfaceName: '%s'",
+                         family, ifaceName );
+    }
+#endif
+    else
+    {
+        return sockFd;
+    }
+#elif defined( SO_BINDTODEVICE )
+    const socklen_t ifaceNameLen = strlen ( ifaceName );
+
+    if ( ifaceNameLen + 1 > IFNAMSIZ )
+    {
+        // +1, because NULL needs to fit as well.
+
+        SIMPLE_LOG_ERR ( "Interface name '%s' is too long; Max length is %u characters",
+                         ifaceName, IFNAMSIZ - 1 );
+    }
+    else if ( 0 != setsockopt ( sockFd, SOL_SOCKET, SO_BINDTODEVICE, ifaceName, ifaceNameLen + 1 ) )
+    {
+        SIMPLE_LOG_ERR ( "Error setting socket option SO_BINDTODEVICE for socket with FD %d"
+                         " using IfaceName: '%s'; Error: [%d] %s",
+                         sockFd, ifaceName, errno, strerror ( errno ) );
+    }
+    else
+    {
+        return sockFd;
+    }
+#else
+    SIMPLE_LOG_ERR ( "Could not bind to iface '%s': Binding to interfaces is not supported on this platform",
+                     bindToIface );
+#endif
+
+    close ( sockFd );
+
+    errno = EINVAL;
+    return -1;
+}
+
+void DnsResolverPool::performQuery ( Query & query )
+{
+    if ( query.servers.size() < 1 )
+    {
+        query.numResults = -1;
+        return;
+    }
+
+    unsigned int tout = query.timeout;
+
+    if ( tout > DnsResolver::MaxTimeout || tout < 1 )
+    {
+        tout = DnsResolver::MaxTimeout;
+    }
+
+    DnsSocketFuncType socketFunc = 0;
+    DnsServerConfig * srvCfg = new DnsServerConfig[ query.servers.size() ];
+
+    for ( size_t i = 0; i < query.servers.size(); ++i )
+    {
+        // We store both v4 and v6 addresses as sockaddr_in6, because it's bigger.
+        srvCfg[ i ].address.v6 = query.servers[ i ];
+
+        if ( query.ifaceConfig.isUsed() )
+        {
+            socketFunc = dnsBoundSocket;
+            srvCfg[ i ].userData.vPtr = &( query.ifaceConfig );
+        }
+
+        if ( query.flags & DnsResolver::ReqFlagUseTcp )
+        {
+            srvCfg[ i ].flags |= DNS_SERVER_FLAG_USE_TCP;
+        }
+
+        if ( query.flags & DnsResolver::ReqFlagDontUseTcp )
+        {
+            srvCfg[ i ].flags |= DNS_SERVER_FLAG_DONT_USE_TCP;
+        }
+    }
+
+    query.numResults = dns_resolve_ext (
+        query.name.c_str(), query.queryType, srvCfg, query.servers.size(), socketFunc, tout, &query.results );
+
+    delete[] srvCfg;
+}
+
+void DnsResolverPool::queryComplete ( Query * query )
+{
+    assert ( query != 0 );
+
+    if ( query->numResults > 0 && !query->results )
+    {
+        assert ( false );
+
+        query->numResults = -1;
+    }
+
+    LOG ( L_DEBUG, "DNS query '" << query->name << "' (type " << query->queryType << ") completed; NumResults: "
+          << query->numResults << "; NumWaiting: " << query->waiters.size() );
+
+    _pending.remove ( query->key );
+
+    cacheResults ( *query );
+
+    for ( size_t i = 0; i < query->waiters.size(); ++i )
+    {
+        const Waiter & w = query->waiters.at ( i );
+
+        if ( _resolvers.contains ( w.resolver ) )
+        {
+            addDelivery ( w.resolver, w.lookupId, query->queryType, query->results, query->numResults, 0xFFFFFFFFU );
+        }
+    }
+
+    delete query;
+
+    deliverResults();
+}
+
+void DnsResolverPool::cacheResults ( const Query & query )
+{
+    const uint32_t maxEntries = DnsResolver::optCacheSize.value();
+
+    if ( query.numResults < 0 || maxEntries < 1 )
+    {
+        // We don't cache errors.
+        return;
+    }
+
+    uint32_t ttl = DnsResolver::optMaxCacheTtl.value();
+
+    if ( query.numResults < 1 )
+    {
+        ttl = min ( ttl, DnsResolver::optNegativeCacheTtl.value() );
+    }
+
+    for ( int i = 0; i < query.numResults; ++i )
+    {
+        ttl = min ( ttl, query.results[ i ].ttl );
+    }
+
+    if ( ttl < 1 )
+    {
+        return;
+    }
+
+    const Time & now = EventManager::getCurrentTime();
+
+    if ( _cache.size() >= maxEntries )
+    {
+        // First, let's remove expired entries. If that's not enough, we remove the one that expires first.
+        String firstKey;
+        Time firstExpiry;
+
+        for ( HashMap<String, CacheEntry *>::MutableIterator it ( _cache ); it.isValid(); )
+        {
+            if ( it.value()->expiresAt <= now )
+            {
+                delete it.value();
+                it.remove();
+                continue;
+            }
+
+            if ( firstKey.isEmpty() || it.value()->expiresAt < firstExpiry )
+            {
+                firstKey = it.key();
+                firstExpiry = it.value()->expiresAt;
+            }
+
+            it.next();
+        }
+
+        CacheEntry * cEntry = 0;
+
+        if ( _cache.size() >= maxEntries && _cache.findAndRemove ( firstKey, cEntry ) )
+        {
+            delete cEntry;
+        }
+    }
+
+    CacheEntry * const cEntry = new CacheEntry();
+
+    cEntry->results = copyRecords ( query.results, query.numResults, ttl );
+    cEntry->numResults = ( cEntry->results != 0 ) ? query.numResults : 0;
+    cEntry->expiresAt = now;
+    cEntry->expiresAt.increaseSeconds ( ttl );
+
+    CacheEntry * oldEntry = 0;
+
+    if ( _cache.findAndRemove ( query.key, oldEntry ) )
+    {
+        delete oldEntry;
+    }
+
+    _cache.insert ( query.key, cEntry );
+}
+
+void DnsResolverPool::addDelivery (
+        DnsResolver * resolver, uint32_t lookupId, enum DnsRecordType qType,
+        const struct DnsRecord * results, int numResults, uint32_t maxTtl )
+{
+    Delivery d;
+
+    d.resolver = resolver;
+    d.lookupId = lookupId;
+    d.queryType = qType;
+    d.numResults = numResults;
+    d.results = copyRecords ( results, numResults, maxTtl );
+
+    if ( numResults > 0 && !d.results )
+    {
+        LOG ( L_ERROR, "Could not copy DNS results; Reporting an error" );
+
+        d.numResults = -1;
+    }
+
+    _deliveries.append ( d );
+}
+
+void DnsResolverPool::receiveLoopEndEvent()
+{
+    deliverResults();
+}
+
+void DnsResolverPool::deliverResults()
+{
+    if ( _isDelivering )
+    {
+        // We are called from one of the callbacks, it will be handled by the outer call.
+        return;
+    }
+
+    _isDelivering = true;
+
+    while ( !_deliveries.isEmpty() )
+    {
+        const Delivery d = _deliveries.first();
+
+        _deliveries.removeFirst();
+
+        // Resolvers may be unregistered (and even destroyed) by the callbacks, in which case the resolver pointers
+        // in the remaining deliveries are cleared.
+        if ( d.resolver != 0 && _resolvers.contains ( d.resolver ) )
+        {
+            d.resolver->lookupComplete ( d.lookupId, d.queryType, d.results, d.numResults );
+        }
+
+        if ( d.results != 0 )
+        {
+            free ( d.results );
+        }
+    }
+
+    _isDelivering = false;
+}
@@ -0,0 +1,312 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#pragma once
+
+extern "C"
+{
+#include <netinet/in.h>
+}
+
+#include "basic/HashMap.hpp"
+#include "basic/HashSet.hpp"
+#include "basic/Mutex.hpp"
+#include "basic/SimpleArray.hpp"
+#include "sys/Semaphore.hpp"
+#include "sys/Time.hpp"
+
+#include "../DnsResolver.hpp"
+
+namespace Pravala
+{
+/// @brief Performs DNS lookups on behalf of all DnsResolver objects.
+/// Lookups are performed by a fixed number of worker threads (started as needed), that take queries from a bounded
+/// queue. Positive and negative results are cached (honoring their TTLs), and concurrent lookups of the same
+/// query (name, type, servers, flags and interface configuration) are coalesced into a single DNS request.
+/// All the bookkeeping (cache, pending queries and delivering the results) happens on the main thread;
+/// worker threads only perform the actual DNS requests, and pass the results back using AsyncQueue.
+class DnsResolverPool: public NoCopy, public EventManager::LoopEndEventHandler
+{
+    public:
+        /// @brief Returns the global DnsResolverPool.
+        /// @warning The first time it is called it registers the pool with the AsyncQueue.
+        /// It should happen on the main thread!
+        /// @return A reference to the global DnsResolverPool.
+        static DnsResolverPool & get();
+
+        /// @brief Registers a resolver.
+        /// Results are only delivered to registered resolvers.
+        /// @param [in] resolver The resolver to register.
+        void registerResolver ( DnsResolver * resolver );
+
+        /// @brief Unregisters a resolver.
+        /// Results of its pending lookups will be dropped.
+        /// @param [in] resolver The resolver to unregister.
+        void unregisterResolver ( DnsResolver * resolver );
+
+        /// @brief Starts a single lookup.
+        /// Once it completes (or is served from the cache), DnsResolver::lookupComplete() will be called.
+        /// It is never called from within this function.
+        /// @param [in] resolver The resolver that requests the lookup. It should be registered.
+        /// @param [in] lookupId The ID of the lookup, passed back to the resolver.
+        /// @param [in] qType The type of the query.
+        /// @param [in] name The name to look up.
+        /// @param [in] servers The DNS servers to use. It should not be empty.
+        /// @param [in] flags A bitmask of DnsResolver::ReqFlag* values.
+        /// @param [in] ifaceConfig The interface configuration for binding requests to interfaces. Can be 0.
+        /// @param [in] timeout Timeout for the operation, in seconds.
+        /// @return Standard error code:
+        ///          - Success if the lookup has been started (or will be served from the cache).
+        ///          - SoftFail if the queue of pending DNS requests is full.
+        ///          - ThreadCreateFailed if no worker thread could be started.
+        ERRCODE lookup (
+            DnsResolver * resolver, uint32_t lookupId, enum DnsRecordType qType, const String & name,
+            const SimpleArray<struct sockaddr_in6> & servers, uint8_t flags,
+            const DnsResolver::IfaceConfig * ifaceConfig, uint16_t timeout );
+
+        /// @brief Removes all the entries from the cache.
+        void clearCache();
+
+        /// @brief Returns the number of worker threads started.
+        /// @return The number of worker threads started.
+        inline uint16_t getNumWorkers() const
+        {
+            return _numWorkers;
+        }
+
+        /// @brief Returns the number of DNS requests performed by worker threads.
+        /// Lookups that were served from the cache, or coalesced with another lookup, are not included.
+        /// @return The number of DNS requests performed by worker threads.
+        inline uint32_t getNumRequests() const
+        {
+            return _numRequests;
+        }
+
+        /// @brief Returns the number of entries in the cache (including expired ones not removed yet).
+        /// @return The number of entries in the cache.
+        inline size_t getCacheSize() const
+        {
+            return _cache.size();
+        }
+
+    protected:
+        virtual void receiveLoopEndEvent();
+
+    private:
+        /// @brief A lookup waiting for the results of a query.
+        struct Waiter
+        {
+            DnsResolver * resolver; ///< The resolver that requested the lookup.
+            uint32_t lookupId; ///< The ID of the lookup.
+        };
+
+        /// @brief A single DNS query, performed by one of the worker threads.
+        /// Fields marked as "worker" are set before the query is queued, and then only accessed by the worker
+        /// (until the query is passed back to the main thread).
+        /// Fields marked as "main" are only used by the main thread.
+        struct Query: public NoCopy
+        {
+            /// @brief [main] The key of this query in the map of pending queries (and the cache).
+            String key;
+
+            /// @brief [main] Lookups waiting for the results of this query.
+            List<Waiter> waiters;
+
+            /// @brief [worker] The name to query.
+            String name;
+
+            /// @brief [worker] The list of DNS servers.
+            SimpleArray<struct sockaddr_in6> servers;
+
+            /// @brief [worker] Interface configuration.
+            DnsResolver::IfaceConfig ifaceConfig;
+
+            /// @brief [worker] The results, set by the worker.
+            /// This is a continuous memory segment that should be deallocated using free().
+            struct DnsRecord * results;
+
+            /// @brief [worker] The number of results (can be 0); -1 if there was an error. Set by the worker.
+            int numResults;
+
+            /// @brief [worker] The type of the query to perform.
+            enum DnsRecordType queryType;
+
+            /// @brief [worker] The timeout for the operation (in seconds).
+            uint16_t timeout;
+
+            /// @brief [worker] A bitmask of DnsResolver::ReqFlag* values.
+            uint8_t flags;
+
+            /// @brief Default constructor.
+            Query();
+
+            /// @brief Destructor.
+            ~Query();
+        };
+
+        /// @brief A helper class to pass completed queries back to the main thread.
+        class QueryCompleteTask: public AsyncQueue::Task
+        {
+            public:
+                /// @brief Constructor.
+                /// @param [in] pool Pointer to the DnsResolverPool.
+                /// @param [in] query The query that completed. It will be deleted if the task is not run.
+                QueryCompleteTask ( DnsResolverPool * pool, Query * query );
+
+                /// @brief Destructor.
+                virtual ~QueryCompleteTask();
+
+            protected:
+                virtual void runTask();
+
+            private:
+                DnsResolverPool * const _pool; ///< Pointer to the DnsResolverPool.
+                Query * _query; ///< The query that completed.
+        };
+
+        /// @brief A single entry in the cache.
+        struct CacheEntry: public NoCopy
+        {
+            /// @brief The cached results; A continuous memory segment that should be deallocated using free().
+            struct DnsRecord * results;
+
+            /// @brief The number of cached results. 0 for negative entries.
+            int numResults;
+
+            /// @brief When this entry expires.
+            Time expiresAt;
+
+            /// @brief Default constructor.
+            CacheEntry();
+
+            /// @brief Destructor.
+            ~CacheEntry();
+        };
+
+        /// @brief A single result waiting to be delivered to a resolver.
+        struct Delivery
+        {
+            DnsResolver * resolver; ///< The resolver to deliver the result to.
+
+            /// @brief The results; A continuous memory segment that should be deallocated using free().
+            struct DnsRecord * results;
+
+            uint32_t lookupId; ///< The ID of the lookup.
+            int numResults; ///< The number of results (can be 0); -1 if there was an error.
+
+            enum DnsRecordType queryType; ///< The type of the query.
+        };
+
+        static TextLog _log; ///< Log stream.
+
+        /// @brief Synchronizes access to _queue and _numIdle (shared with worker threads).
+        Mutex _mutex;
+
+        /// @brief Posted every time a query is added to _queue; Worker threads wait on it.
+        Semaphore _queueSem;
+
+        /// @brief Queries waiting for a worker thread. Protected by _mutex.
+        List<Query *> _queue;
+
+        /// @brief The number of worker threads waiting for queries. Protected by _mutex.
+        uint16_t _numIdle;
+
+        /// @brief [main] The number of worker threads started.
+        uint16_t _numWorkers;
+
+        /// @brief [main] The number of DNS requests passed to worker threads.
+        uint32_t _numRequests;
+
+        /// @brief [main] Queries that are waiting for, or being performed by, worker threads; By their key.
+        HashMap<String, Query *> _pending;
+
+        /// @brief [main] Cached results; By the key of the query.
+        HashMap<String, CacheEntry *> _cache;
+
+        /// @brief [main] Registered resolvers.
+        HashSet<DnsResolver *> _resolvers;
+
+        /// @brief [main] Results waiting to be delivered.
+        List<Delivery> _deliveries;
+
+        /// @brief [main] Set while results are being delivered, to avoid doing that recursively.
+        bool _isDelivering;
+
+        /// @brief Constructor.
+        DnsResolverPool();
+
+        /// @brief Called on the main thread when a query has been performed by a worker thread.
+        /// @param [in] query The query that completed. It is deleted by this function.
+        void queryComplete ( Query * query );
+
+        /// @brief Adds a result to be delivered.
+        /// @param [in] resolver The resolver to deliver the result to.
+        /// @param [in] lookupId The ID of the lookup.
+        /// @param [in] qType The type of the query.
+        /// @param [in] results The results to deliver. They are copied.
+        /// @param [in] numResults The number of results (can be 0); -1 if there was an error.
+        /// @param [in] maxTtl The max TTL value to report in copied records.
+        void addDelivery (
+            DnsResolver * resolver, uint32_t lookupId, enum DnsRecordType qType,
+            const struct DnsRecord * results, int numResults, uint32_t maxTtl );
+
+        /// @brief Delivers all the results waiting to be delivered.
+        void deliverResults();
+
+        /// @brief Adds results of a query to the cache.
+        /// Errors are not cached, empty results are cached using the negative TTL.
+        /// @param [in] query The query whose results to cache.
+        void cacheResults ( const Query & query );
+
+        /// @brief Starts a new worker thread.
+        /// @return True if the thread has been started; False otherwise.
+        bool startWorker();
+
+        /// @brief Runs a worker thread.
+        void runWorker();
+
+        /// @brief Generates the key of a query.
+        /// Queries with the same keys are coalesced, and share cache entries.
+        /// @param [in] qType The type of the query.
+        /// @param [in] name The name to look up.
+        /// @param [in] servers The DNS servers to use.
+        /// @param [in] flags A bitmask of DnsResolver::ReqFlag* values.
+        /// @param [in] ifaceConfig The interface configuration. Can be 0.
+        /// @return The key of the query.
+        static String getQueryKey (
+            enum DnsRecordType qType, const String & name,
+            const SimpleArray<struct sockaddr_in6> & servers, uint8_t flags,
+            const DnsResolver::IfaceConfig * ifaceConfig );
+
+        /// @brief Creates a copy of DNS records.
+        /// @param [in] records The records to copy.
+        /// @param [in] numRecords The number of records to copy.
+        /// @param [in] maxTtl The max TTL value to set in copied records.
+        /// @return A continuous memory segment with the copy, that should be deallocated using free().
+        ///         0 if there are no records, or the memory could not be allocated.
+        static struct DnsRecord * copyRecords ( const struct DnsRecord * records, int numRecords, uint32_t maxTtl );
+
+        /// @brief Performs a query.
+        /// It is called on a worker thread.
+        /// @param [in,out] query The query to perform. Its results are set by this function.
+        static void performQuery ( Query & query );
+
+        /// @brief The function that runs in worker threads.
+        /// @param [in] arg A pointer to the DnsResolverPool object.
+        /// @return Always 0.
+        static void * threadMain ( void * arg );
+};
+}
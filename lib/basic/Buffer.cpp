@@ -552,6 +552,56 @@ void Buffer::append ( const String & str )
     appendData ( str.c_str(), str.length() );
 }
 
+void Buffer::appendNumber ( uint64_t value )
+{
+    // Pairs of digits for all values between 00 and 99.
+    static const char digitPairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+
+    // The max uint64 value has 20 digits:
+    char str[ 20 ];
+    char * ptr = str + sizeof ( str );
+
+    // We generate the digits starting from the end, two at a time:
+    while ( value >= 100 )
+    {
+        const size_t idx = ( size_t ) ( value % 100 ) * 2;
+
+        value /= 100;
+
+        *--ptr = digitPairs[ idx + 1 ];
+        *--ptr = digitPairs[ idx ];
+    }
+
+    if ( value >= 10 )
+    {
+        *--ptr = digitPairs[ value * 2 + 1 ];
+        *--ptr = digitPairs[ value * 2 ];
+    }
+    else
+    {
+        *--ptr = ( char ) ( '0' + value );
+    }
+
+    appendData ( ptr, ( str + sizeof ( str ) ) - ptr );
+}
+
+void Buffer::appendNumber ( int64_t value )
+{
+    if ( value >= 0 )
+    {
+        appendNumber ( ( uint64_t ) value );
+        return;
+    }
+
+    appendData ( "-", 1 );
+
+    // This works for the min int64 value as well:
+    appendNumber ( ( ( uint64_t ) -( value + 1 ) ) + 1 );
+}
+
 void Buffer::append ( const MemHandle & memHandle )
 {
     const MemData & mData = memHandle.getMemData();
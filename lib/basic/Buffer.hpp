@@ -167,6 +167,16 @@ class Buffer
         /// @param [in] str String to be appended
         void append ( const String & str );
 
+        /// @brief Appends the decimal representation of an unsigned number to the buffer
+        /// It is much faster than appending String::number(), since it doesn't create any temporary strings.
+        /// @param [in] value The value to append
+        void appendNumber ( uint64_t value );
+
+        /// @brief Appends the decimal representation of a signed number to the buffer
+        /// It is much faster than appending String::number(), since it doesn't create any temporary strings.
+        /// @param [in] value The value to append
+        void appendNumber ( int64_t value );
+
         /// @brief Appends the content of another buffer to this one
         /// @param [in] memHandle The data to be appended. If this buffer is still empty, and that MemHandle
         ///                        has the right offset and size, the data is simply referenced.
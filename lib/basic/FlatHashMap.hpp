@@ -0,0 +1,1003 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdlib>
+
+#include "HashMap.hpp"
+
+namespace Pravala
+{
+/// @brief FlatHashMap class.
+/// Offers hash-based dictionary, with the same API as HashMap (including implicit sharing and iterators).
+///
+/// Unlike HashMap, which keeps lists of keys and values in each bucket, it uses open addressing:
+/// keys and values are stored next to each other in a single array, and there is one control byte per slot.
+/// That control byte is either "empty", "deleted", or it contains 7 bits of the key's hash.
+/// Lookups check control bytes of consecutive slots (starting with the one selected by the hash),
+/// and only compare keys in the slots whose control bytes match.
+/// So a typical lookup only touches a single control byte and a single entry.
+///
+/// Removed entries leave "deleted" markers behind (unless the next slot is empty), so the entries
+/// never move until the table needs to be resized. That table is rehashed once more than 7/8 of slots are used.
+///
+/// It should be preferred over HashMap for maps used on hot paths, where lookups are much more common
+/// than modifications. Keys use the same getHash() functions as HashMap. Their results are mixed
+/// before use, so simple hash functions (like the ones used for integers) are fine.
+///
+/// @tparam K The type of keys. It needs getHash(), operator== and a copy constructor.
+/// @tparam V The type of values. It needs a default constructor, operator= and a copy constructor.
+template<typename K, typename V> class FlatHashMap
+{
+    private:
+        /// @brief A single key/value pair stored in the table.
+        struct Entry
+        {
+            K key; ///< The key.
+            V value; ///< The value.
+
+            /// @brief Constructor.
+            /// @param [in] k The key.
+            /// @param [in] v The value.
+            inline Entry ( const K & k, const V & v ): key ( k ), value ( v )
+            {
+            }
+        };
+
+        /// @brief Private data of the FlatHashMap.
+        /// It is NOT thread safe!
+        struct Priv
+        {
+            SharedMemory::RefCounter ref; ///< Reference counter for this data segment.
+
+            uint8_t * ctrl; ///< Control bytes, one for each slot.
+            Entry * entries; ///< Entries. Only the ones in slots whose control bytes are 'full' are constructed.
+
+            size_t capacity; ///< The number of slots. It is always a power of 2.
+            size_t elementCount; ///< The number of elements stored in this FlatHashMap.
+            size_t usedCount; ///< The number of slots that are not empty (elements and 'deleted' markers).
+        };
+
+        /// @brief Control byte values and other constants.
+        /// Control bytes of slots that store elements contain 7 bits of the hash (so the top bit is not set).
+        enum
+        {
+            CtrlEmpty = 0x80, ///< The slot is empty.
+            CtrlDeleted = 0xFE, ///< The slot used to store an element that has been removed.
+            MinCapacity = 8 ///< The min number of slots.
+        };
+
+        /// @brief Functionality shared between constant and mutable iterator classes.
+        class IteratorCore
+        {
+            protected:
+                /// @brief Current index in the table.
+                size_t _idx;
+
+                /// @brief Whether the iterator is valid.
+                /// If this is set to false, iterator is not valid even if the index is.
+                bool _isValid;
+
+                /// @brief Default constructor.
+                IteratorCore(): _idx ( 0 ), _isValid ( false )
+                {
+                }
+
+                /// @brief Checks if this iterator is pointing to an existing value in the FlatHashMap.
+                /// @param [in] hMap The FlatHashMap object to use.
+                /// @return true if key/value can be retrieved; false otherwise.
+                inline bool isValid ( const FlatHashMap<K, V> & hMap ) const
+                {
+                    return ( _isValid
+                             && hMap._priv != 0
+                             && _idx < hMap._priv->capacity
+                             && isFull ( hMap._priv->ctrl[ _idx ] ) );
+                }
+
+                /// @brief Sets the iterator to the first entry of the map.
+                /// If the map is empty, this iterator will be invalid.
+                /// @param [in] hMap The FlatHashMap object to use.
+                /// @return True if the iterator is valid after this operation; False otherwise.
+                inline bool findBeginning ( const FlatHashMap<K, V> & hMap )
+                {
+                    _idx = 0;
+                    return findValid ( hMap );
+                }
+
+                /// @brief Advances the iterator.
+                /// It is safe to call this function on invalid iterator.
+                /// It returns true if the new current key and value can be retrieved.
+                /// It returns false otherwise, but 'false' doesn't mean that the iterator
+                /// has not been advanced, it only means that the new current value
+                /// is illegal. So it's the same as a result of following function:
+                /// bool func(){ iterator.next(); return iterator.isValid(); }
+                /// @param [in] hMap The FlatHashMap object to use.
+                /// @return True if the current key/value can be retrieved, false otherwise.
+                bool next ( const FlatHashMap<K, V> & hMap );
+
+                /// @brief Returns current key
+                /// Calling this function in iterator that is not valid is illegal
+                /// (and crashes the program).
+                /// @param [in] hMap The FlatHashMap object to use.
+                /// @return Key of current element.
+                const K & key ( const FlatHashMap<K, V> & hMap ) const;
+
+                /// @brief Returns current value
+                /// Calling this function in iterator that is not valid is illegal
+                /// (and crashes the program).
+                /// @param [in] hMap The FlatHashMap object to use.
+                /// @return Value of current element.
+                const V & value ( const FlatHashMap<K, V> & hMap ) const;
+
+                /// @brief Returns a writable reference to the current value
+                /// Calling this function in iterator that is not valid is illegal
+                /// (and crashes the program).
+                /// There is no similar function that would return a writable key
+                /// of the current element, because it's not possible to modify
+                /// the key this way.
+                /// @param [in] hMap The FlatHashMap object to use.
+                /// @return Writable reference to the value of current element.
+                V & value ( FlatHashMap<K, V> & hMap );
+
+                /// @brief Removes current value and advances the iterator.
+                /// This function is similar to the next(), but instead of
+                /// skipping the current value, it removes it.
+                /// Calling it on the iterator that is not valid is legal.
+                /// It returns true if the new value is legal, false otherwise.
+                /// Even if it returns false, it doesn't mean that element
+                /// has not been removed. It was removed (unless the iterator was
+                /// already invalid), but that value was the last one.
+                /// @param [in] hMap The FlatHashMap object to use.
+                /// @return True if the new value is valid, false otherwise.
+                bool remove ( FlatHashMap<K, V> & hMap );
+
+            private:
+                /// @brief Moves the iterator to the first element at, or after, the current index.
+                /// @param [in] hMap The FlatHashMap object to use.
+                /// @return True if the iterator is valid after this operation; False otherwise.
+                bool findValid ( const FlatHashMap<K, V> & hMap );
+        };
+
+    public:
+        /// @brief Constant iterator over all hash map's elements.
+        /// It operates over a copy of the map. Thanks to implicit sharing,
+        /// the data is not actually copied, unless the original map is modified.
+        /// If that happens, iterator will keep iterating over the elements
+        /// that were in the map when the iterator was created.
+        class Iterator: public FlatHashMap<K, V>::IteratorCore
+        {
+            public:
+                /// @brief Creates a constant iterator over given FlatHashMap
+                /// @param [in] hMap FlatHashMap to iterate over.
+                Iterator ( const FlatHashMap<K, V> & hMap ): _myMap ( hMap )
+                {
+                    IteratorCore::findBeginning ( _myMap );
+                }
+
+                /// @brief Resets this iterator to the beginning of the map.
+                /// @return True if the iterator is valid after this operation; False otherwise.
+                inline bool reset()
+                {
+                    return IteratorCore::findBeginning ( _myMap );
+                }
+
+                /// @brief Checks if this iterator is pointing to an existing value in the FlatHashMap.
+                /// @return true if key/value can be retrieved; false otherwise.
+                inline bool isValid() const
+                {
+                    return IteratorCore::isValid ( _myMap );
+                }
+
+                /// @brief Advances the iterator.
+                /// It is safe to call this function on invalid iterator.
+                /// @return True if the current key/value can be retrieved, false otherwise.
+                inline bool next()
+                {
+                    return IteratorCore::next ( _myMap );
+                }
+
+                /// @brief Returns current key
+                /// Calling this function in iterator that is not valid is illegal
+                /// (and crashes the program).
+                /// @return Key of current element.
+                inline const K & key() const
+                {
+                    return IteratorCore::key ( _myMap );
+                }
+
+                /// @brief Returns current value
+                /// Calling this function in iterator that is not valid is illegal
+                /// (and crashes the program).
+                /// @return Value of current element.
+                inline const V & value() const
+                {
+                    return IteratorCore::value ( _myMap );
+                }
+
+            private:
+                /// @brief A copy of the FlatHashMap (we iterate over a copy)
+                FlatHashMap<K, V> _myMap;
+        };
+
+        /// @brief MutableIterator over all hash map's elements.
+        /// Similar to Iterator, but allows FlatHashMap and values to be modified.
+        /// @note Unlike Iterator, MutableIterator does not create a copy of the map, but iterates over the original.
+        /// Modifying the map while this iterator is running by inserting or removing elements
+        /// (other than by calling MutableIterator::remove()) may have unexpected consequences.
+        /// It could result in iterator skipping some elements, returning elements already returned,
+        /// or becoming invalid.
+        class MutableIterator: public FlatHashMap<K, V>::IteratorCore
+        {
+            public:
+                /// @brief Creates a mutable iterator over given FlatHashMap
+                /// @param [in] hMap FlatHashMap to iterate over. It CANNOT be a temporary object!
+                MutableIterator ( FlatHashMap<K, V> & hMap ): _myMap ( hMap )
+                {
+                    IteratorCore::findBeginning ( _myMap );
+                }
+
+                /// @brief Resets this iterator to the beginning of the map.
+                /// @return True if the iterator is valid after this operation; False otherwise.
+                inline bool reset()
+                {
+                    return IteratorCore::findBeginning ( _myMap );
+                }
+
+                /// @brief Checks if this iterator is pointing to an existing value in the FlatHashMap.
+                /// @return true if key/value can be retrieved; false otherwise.
+                inline bool isValid() const
+                {
+                    return IteratorCore::isValid ( _myMap );
+                }
+
+                /// @brief Advances the iterator.
+                /// It is safe to call this function on invalid iterator.
+                /// @return True if the current key/value can be retrieved, false otherwise.
+                inline bool next()
+                {
+                    return IteratorCore::next ( _myMap );
+                }
+
+                /// @brief Returns current key
+                /// Calling this function in iterator that is not valid is illegal
+                /// (and crashes the program).
+                /// @return Key of current element.
+                inline const K & key() const
+                {
+                    return IteratorCore::key ( _myMap );
+                }
+
+                /// @brief Returns current value
+                /// Calling this function in iterator that is not valid is illegal
+                /// (and crashes the program).
+                /// @return Value of current element.
+                inline const V & value() const
+                {
+                    return IteratorCore::value ( _myMap );
+                }
+
+                /// @brief Returns a writable reference to the current value
+                /// Calling this function in iterator that is not valid is illegal
+                /// (and crashes the program).
+                /// @return Writable reference to the value of current element.
+                inline V & value()
+                {
+                    return IteratorCore::value ( _myMap );
+                }
+
+                /// @brief Removes current value and advances the iterator.
+                /// Calling it on the iterator that is not valid is legal.
+                /// Even if it returns false, it doesn't mean that element has not been removed.
+                /// @return True if the new value is valid, false otherwise.
+                inline bool remove()
+                {
+                    return IteratorCore::remove ( _myMap );
+                }
+
+            private:
+                /// @brief Writable reference to the FlatHashMap
+                FlatHashMap<K, V> & _myMap;
+        };
+
+        /// @brief Default constructor.
+        /// Creates an empty FlatHashMap.
+        inline FlatHashMap(): _priv ( 0 )
+        {
+        }
+
+        /// @brief Copy constructor.
+        /// The FlatHashMap uses implicit sharing, so the actual data
+        /// is not really copied, unless one of the FlatHashMap objects sharing
+        /// data needs to modify it.
+        /// @param [in] other FlatHashMap object to copy.
+        inline FlatHashMap ( const FlatHashMap & other ): _priv ( other._priv )
+        {
+            if ( _priv != 0 )
+            {
+                _priv->ref.ref();
+            }
+        }
+
+        /// @brief Assignment operator.
+        /// The FlatHashMap uses implicit sharing, so the actual data
+        /// is not really copied, unless one of the FlatHashMap objects sharing
+        /// data needs to modify it.
+        /// @param [in] other FlatHashMap object to copy.
+        /// @return Reference to this FlatHashMap.
+        FlatHashMap & operator= ( const FlatHashMap & other );
+
+        /// @brief Destructor.
+        inline ~FlatHashMap()
+        {
+            unrefPriv();
+        }
+
+        /// @brief Returns number of objects stored in the FlatHashMap.
+        /// @return Number of objects stored in the FlatHashMap.
+        inline size_t size() const
+        {
+            return ( _priv != 0 ) ? _priv->elementCount : 0;
+        }
+
+        /// @brief Returns true if the FlatHashMap is empty
+        /// @return True if the FlatHashMap is empty
+        inline bool isEmpty() const
+        {
+            return ( size() == 0 );
+        }
+
+        /// @brief Compares two FlatHashMaps to determine equality.
+        /// Two maps are equal if they contain the same elements.
+        /// @param [in] other The second map to compare
+        /// @return A value indicating whether the two maps are equal
+        bool operator== ( const FlatHashMap & other ) const;
+
+        /// @brief Compares two FlatHashMaps to determine inequality.
+        /// Two maps are equal if they contain the same elements.
+        /// @param [in] other The second map to compare
+        /// @return A value indicating whether the two maps are inequal.
+        inline bool operator!= ( const FlatHashMap & other ) const
+        {
+            return !( *this == other );
+        }
+
+        /// @brief Returns a value associated with a given key.
+        /// If this FlatHashMap doesn't include any value for the given key,
+        /// the value constructed using default constructor is returned.
+        /// @param [in] hKey Key for which the value should be returned.
+        /// @return The value.
+        inline V value ( const K & hKey ) const
+        {
+            const size_t idx = findIndex ( hKey, mixHash ( hKey ) );
+
+            return ( idx != NotFound ) ? _priv->entries[ idx ].value : V();
+        }
+
+        /// @brief Returns a reference to the value associated with a given key.
+        /// If the FlatHashMap doesn't contain the requested key, the new element
+        /// is created using its default constructor,
+        /// and a reference to it is returned.
+        /// @param [in] hKey Key for which the value should be returned.
+        /// @return Reference to the value.
+        inline V & operator[] ( const K & hKey )
+        {
+            return internalInsert ( hKey, V(), false );
+        }
+
+        /// @brief Inserts the given key:value pair.
+        /// If there already is a value associated with the given key,
+        /// it is overwritten with the new one.
+        /// @param [in] hKey Key to use.
+        /// @param [in] hVal Value to insert.
+        /// @return Reference to this object.
+        inline FlatHashMap & insert ( const K & hKey, const V & hVal )
+        {
+            internalInsert ( hKey, hVal, true );
+            return *this;
+        }
+
+        /// @brief Inserts all entries from the other hash map into this hash map.
+        /// If there already is a value associated with the given key,
+        /// it is overwritten with the new one.
+        /// @param [in] other The other FlatHashMap from which entries should be added.
+        /// @return Reference to this object.
+        FlatHashMap & insertAll ( const FlatHashMap & other );
+
+        /// @brief Checks if a given key exists in the FlatHashMap.
+        /// @param [in] hKey Key to look for.
+        /// @return true if the given key has been found; false otherwise.
+        inline bool contains ( const K & hKey ) const
+        {
+            return ( findIndex ( hKey, mixHash ( hKey ) ) != NotFound );
+        }
+
+        /// @brief Finds an entry with the given key.
+        /// If is similar to contains(), but if the key is found, the value associated with it is copied to value.
+        /// @param [in] hKey Key to look for.
+        /// @param [out] value A reference to the value to be set if the entry is found.
+        /// @return True if the entry with the given key was found; False otherwise.
+        inline bool find ( const K & hKey, V & value ) const
+        {
+            const size_t idx = findIndex ( hKey, mixHash ( hKey ) );
+
+            if ( idx == NotFound )
+            {
+                return false;
+            }
+
+            value = _priv->entries[ idx ].value;
+            return true;
+        }
+
+        /// @brief Finds and removes an entry with the given key.
+        /// It works like find(), but it also removes the entry from the map.
+        /// @param [in] hKey Key to look for.
+        /// @param [out] value A reference to the value to be set if the entry is found.
+        /// @return True if the entry with the given key was found; False otherwise.
+        bool findAndRemove ( const K & hKey, V & value );
+
+        /// @brief Removes all values associated with the given key.
+        /// @param [in] hKey Key to remove.
+        /// @return Number of values removed (either 1 or 0).
+        size_t remove ( const K & hKey );
+
+        /// @brief Removes from this hash map all the entries whose keys are found (as keys) in the other FlatHashMap.
+        /// @param [in] other The FlatHashMap whose keys should be removed from this one.
+        /// @return Number of values removed.
+        template<typename T> size_t removeAll ( const FlatHashMap<K, T> & other )
+        {
+            size_t cnt = 0;
+
+            for ( typename FlatHashMap<K, T>::Iterator it ( other ); it.isValid(); it.next() )
+            {
+                cnt += remove ( it.key() );
+            }
+
+            return cnt;
+        }
+
+        /// @brief Clears the FlatHashMap.
+        /// Removes all the elements from the FlatHashMap.
+        inline void clear()
+        {
+            unrefPriv();
+        }
+
+        /// @brief Returns a value of reference counter.
+        /// This is probably useful only for debugging.
+        /// @return Value of reference counter associated with shared data.
+        inline uint32_t getRefCount() const
+        {
+            return ( _priv != 0 ) ? _priv->ref.count() : 1;
+        }
+
+    private:
+        /// @brief The index returned by findIndex() when the key is not found.
+        static const size_t NotFound = ~( ( size_t ) 0 );
+
+        /// @brief Pointer to internal FlatHashMap's data.
+        /// It is 0 when the map is empty (and has never been modified since it was cleared).
+        Priv * _priv;
+
+        /// @brief Checks whether the control byte describes a slot with an element.
+        /// @param [in] ctrl The control byte to check.
+        /// @return True if the slot with this control byte stores an element; False otherwise.
+        static inline bool isFull ( uint8_t ctrl )
+        {
+            return ( ( ctrl & 0x80 ) == 0 );
+        }
+
+        /// @brief Returns the max number of used slots (elements and 'deleted' markers) for the given capacity.
+        /// @param [in] capacity The capacity of the table.
+        /// @return The max number of used slots.
+        static inline size_t maxUsed ( size_t capacity )
+        {
+            return capacity - capacity / 8;
+        }
+
+        /// @brief Returns the hash of the key, mixed with Fibonacci hashing.
+        /// This spreads even the simplest hashes over all the bits.
+        /// The lowest 7 bits are stored in the control bytes, the rest is used to select the slot.
+        /// @param [in] hKey The key to hash.
+        /// @return The mixed hash of the key.
+        static inline size_t mixHash ( const K & hKey )
+        {
+            const uint64_t h = ( ( uint64_t ) getHash ( hKey ) ) * 0x9E3779B97F4A7C15ULL;
+
+            return ( size_t ) ( h ^ ( h >> 32 ) );
+        }
+
+        /// @brief Finds the slot with the given key.
+        /// @param [in] hKey The key to look for.
+        /// @param [in] hash The mixed hash of the key.
+        /// @return The index of the slot with the key, or NotFound if it is not in the map.
+        size_t findIndex ( const K & hKey, size_t hash ) const;
+
+        /// @brief Inserts the key, or finds the existing one.
+        /// @param [in] hKey The key to insert.
+        /// @param [in] hVal The value to insert.
+        /// @param [in] overwrite Whether the value of an existing element should be overwritten with hVal.
+        /// @return The reference to the element just inserted (or found).
+        V & internalInsert ( const K & hKey, const V & hVal, bool overwrite );
+
+        /// @brief Removes the element from the given slot.
+        /// The data must not be shared, and the slot must store an element.
+        /// @param [in] idx The index of the slot.
+        void removeIndex ( size_t idx );
+
+        /// @brief Ensures that the private data of this FlatHashMap exists and is not shared.
+        /// If the internal data is shared with some other FlatHashMap, its copy is created.
+        /// That copy uses the same layout, so indexes of all the elements remain the same.
+        void ensureOwnCopy();
+
+        /// @brief Moves all the elements to a new table.
+        /// It also removes all 'deleted' markers. The data must not be shared.
+        /// @param [in] capacity The number of slots in the new table. Must be a power of 2.
+        void rehash ( size_t capacity );
+
+        /// @brief Unreferences current shared data
+        /// Deletes the elements if needed (this map was the only user of this data)
+        void unrefPriv();
+
+        /// @brief Allocates new private data with no elements.
+        /// @param [in] capacity The number of slots. Must be a power of 2.
+        /// @return New private data, with reference count set to 1.
+        static Priv * createPriv ( size_t capacity );
+
+        /// @brief Destroys all elements in the private data and releases it.
+        /// @param [in] priv The private data to destroy.
+        static void destroyPriv ( Priv * priv );
+};
+
+template<typename K, typename V> const size_t FlatHashMap<K, V>::NotFound;
+
+template<typename K, typename V> FlatHashMap<K, V> & FlatHashMap<K, V>::operator= ( const FlatHashMap<K, V> & other )
+{
+    if ( &other == this || _priv == other._priv )
+        return *this;
+
+    unrefPriv();
+
+    assert ( !_priv );
+
+    if ( other._priv != 0 )
+    {
+        _priv = other._priv;
+        _priv->ref.ref();
+    }
+
+    return *this;
+}
+
+template<typename K, typename V> bool FlatHashMap<K, V>::operator== ( const FlatHashMap<K, V> & other ) const
+{
+    if ( &other == this || _priv == other._priv )
+    {
+        return true;
+    }
+
+    if ( size() != other.size() )
+    {
+        return false;
+    }
+
+    for ( Iterator it ( other ); it.isValid(); it.next() )
+    {
+        const size_t idx = findIndex ( it.key(), mixHash ( it.key() ) );
+
+        if ( idx == NotFound || _priv->entries[ idx ].value != it.value() )
+            return false;
+    }
+
+    return true;
+}
+
+template<typename K, typename V> FlatHashMap<K, V> & FlatHashMap<K, V>::insertAll ( const FlatHashMap<K, V> & other )
+{
+    if ( &other == this || _priv == other._priv )
+        return *this;
+
+    for ( Iterator it ( other ); it.isValid(); it.next() )
+    {
+        insert ( it.key(), it.value() );
+    }
+
+    return *this;
+}
+
+template<typename K, typename V> size_t FlatHashMap<K, V>::findIndex ( const K & hKey, size_t hash ) const
+{
+    if ( !_priv || _priv->elementCount < 1 )
+    {
+        return NotFound;
+    }
+
+    const uint8_t h7 = ( uint8_t ) ( hash & 0x7F );
+    const size_t mask = _priv->capacity - 1;
+
+    // There is always at least one empty slot, so this loop ends.
+
+    for ( size_t idx = ( hash >> 7 ) & mask; true; idx = ( idx + 1 ) & mask )
+    {
+        const uint8_t ctrl = _priv->ctrl[ idx ];
+
+        if ( ctrl == h7 && _priv->entries[ idx ].key == hKey )
+        {
+            return idx;
+        }
+        else if ( ctrl == CtrlEmpty )
+        {
+            return NotFound;
+        }
+    }
+}
+
+template<typename K, typename V> V & FlatHashMap<K, V>::internalInsert (
+        const K & hKey, const V & hVal, bool overwrite )
+{
+    const size_t hash = mixHash ( hKey );
+    size_t idx = findIndex ( hKey, hash );
+
+    // If the data is shared, the copy will have the same layout, so the index remains valid.
+    ensureOwnCopy();
+
+    assert ( _priv != 0 );
+    assert ( _priv->ref.count() == 1 );
+
+    if ( idx != NotFound )
+    {
+        V & ret = _priv->entries[ idx ].value;
+
+        if ( overwrite )
+        {
+            ret = hVal;
+        }
+
+        return ret;
+    }
+
+    if ( _priv->usedCount + 1 > maxUsed ( _priv->capacity ) )
+    {
+        // We need more slots. But if lots of them are taken by 'deleted' markers,
+        // getting rid of them is enough.
+
+        rehash ( ( _priv->elementCount + 1 > maxUsed ( _priv->capacity ) / 2 )
+                 ? ( _priv->capacity * 2 ) : _priv->capacity );
+    }
+
+    const size_t mask = _priv->capacity - 1;
+
+    // We know that the key is not there, so we just need the first slot that doesn't store an element.
+    // The 'deleted' markers can be reused.
+
+    idx = ( hash >> 7 ) & mask;
+
+    while ( isFull ( _priv->ctrl[ idx ] ) )
+    {
+        idx = ( idx + 1 ) & mask;
+    }
+
+    if ( _priv->ctrl[ idx ] == CtrlEmpty )
+    {
+        ++( _priv->usedCount );
+    }
+
+    _priv->ctrl[ idx ] = ( uint8_t ) ( hash & 0x7F );
+
+    new ( &( _priv->entries[ idx ] ) ) Entry ( hKey, hVal );
+
+    ++( _priv->elementCount );
+
+    assert ( _priv->usedCount < _priv->capacity );
+
+    return _priv->entries[ idx ].value;
+}
+
+template<typename K, typename V> bool FlatHashMap<K, V>::findAndRemove ( const K & hKey, V & value )
+{
+    const size_t idx = findIndex ( hKey, mixHash ( hKey ) );
+
+    if ( idx == NotFound )
+    {
+        return false;
+    }
+
+    value = _priv->entries[ idx ].value;
+
+    ensureOwnCopy();
+    removeIndex ( idx );
+
+    return true;
+}
+
+template<typename K, typename V> size_t FlatHashMap<K, V>::remove ( const K & hKey )
+{
+    const size_t idx = findIndex ( hKey, mixHash ( hKey ) );
+
+    if ( idx == NotFound )
+    {
+        return 0;
+    }
+
+    ensureOwnCopy();
+    removeIndex ( idx );
+
+    return 1;
+}
+
+template<typename K, typename V> void FlatHashMap<K, V>::removeIndex ( size_t idx )
+{
+    assert ( _priv != 0 );
+    assert ( _priv->ref.count() == 1 );
+    assert ( idx < _priv->capacity );
+    assert ( isFull ( _priv->ctrl[ idx ] ) );
+    assert ( _priv->elementCount > 0 );
+
+    _priv->entries[ idx ].~Entry();
+
+    --( _priv->elementCount );
+
+    if ( _priv->elementCount < 1 )
+    {
+        // That was the last element, we can get rid of all the 'deleted' markers.
+        memset ( _priv->ctrl, CtrlEmpty, _priv->capacity );
+        _priv->usedCount = 0;
+    }
+    else if ( _priv->ctrl[ ( idx + 1 ) & ( _priv->capacity - 1 ) ] == CtrlEmpty )
+    {
+        // If the next slot is empty, lookups never need to go past this slot, so it can be empty as well.
+        _priv->ctrl[ idx ] = CtrlEmpty;
+        --( _priv->usedCount );
+    }
+    else
+    {
+        _priv->ctrl[ idx ] = CtrlDeleted;
+    }
+}
+
+template<typename K, typename V> void FlatHashMap<K, V>::ensureOwnCopy()
+{
+    if ( !_priv )
+    {
+        _priv = createPriv ( MinCapacity );
+        return;
+    }
+
+    if ( _priv->ref.count() < 2 )
+    {
+        return;
+    }
+
+    Priv * const newPriv = createPriv ( _priv->capacity );
+
+    memcpy ( newPriv->ctrl, _priv->ctrl, _priv->capacity );
+
+    for ( size_t i = 0; i < _priv->capacity; ++i )
+    {
+        if ( isFull ( _priv->ctrl[ i ] ) )
+        {
+            new ( &( newPriv->entries[ i ] ) ) Entry ( _priv->entries[ i ] );
+        }
+    }
+
+    newPriv->elementCount = _priv->elementCount;
+    newPriv->usedCount = _priv->usedCount;
+
+    // Something else still uses that priv, so no delete:
+    _priv->ref.unref();
+
+    assert ( _priv->ref.count() > 0 );
+
+    _priv = newPriv;
+}
+
+template<typename K, typename V> void FlatHashMap<K, V>::rehash ( size_t capacity )
+{
+    assert ( _priv != 0 );
+    assert ( _priv->ref.count() == 1 );
+    assert ( capacity >= MinCapacity );
+    assert ( ( capacity & ( capacity - 1 ) ) == 0 );
+    assert ( _priv->elementCount < maxUsed ( capacity ) );
+
+    Priv * const newPriv = createPriv ( capacity );
+    const size_t mask = capacity - 1;
+
+    for ( size_t i = 0; i < _priv->capacity; ++i )
+    {
+        if ( !isFull ( _priv->ctrl[ i ] ) )
+        {
+            continue;
+        }
+
+        Entry & entry = _priv->entries[ i ];
+        const size_t hash = mixHash ( entry.key );
+        size_t idx = ( hash >> 7 ) & mask;
+
+        // There are no 'deleted' markers in the new table, and all the keys are different:
+        while ( newPriv->ctrl[ idx ] != CtrlEmpty )
+        {
+            idx = ( idx + 1 ) & mask;
+        }
+
+        newPriv->ctrl[ idx ] = ( uint8_t ) ( hash & 0x7F );
+
+        new ( &( newPriv->entries[ idx ] ) ) Entry ( entry );
+
+        entry.~Entry();
+
+        // So destroyPriv() doesn't destroy it again:
+        _priv->ctrl[ i ] = CtrlEmpty;
+
+        ++( newPriv->elementCount );
+    }
+
+    newPriv->usedCount = newPriv->elementCount;
+
+    assert ( newPriv->elementCount == _priv->elementCount );
+
+    _priv->ref.unref();
+    destroyPriv ( _priv );
+
+    _priv = newPriv;
+}
+
+template<typename K, typename V> void FlatHashMap<K, V>::unrefPriv()
+{
+    if ( !_priv )
+        return;
+
+    // Unlink from that data. If we were the only user of it - delete it
+
+    if ( _priv->ref.unref() )
+    {
+        assert ( _priv->ref.count() == 0 );
+
+        destroyPriv ( _priv );
+    }
+
+    _priv = 0;
+}
+
+template<typename K, typename V> typename FlatHashMap<K, V>::Priv * FlatHashMap<K, V>::createPriv ( size_t capacity )
+{
+    assert ( capacity >= MinCapacity );
+    assert ( ( capacity & ( capacity - 1 ) ) == 0 );
+
+    Priv * const priv = new Priv;
+
+    assert ( priv->ref.count() == 1 );
+
+    priv->ctrl = static_cast<uint8_t *> ( malloc ( capacity ) );
+    priv->entries = static_cast<Entry *> ( malloc ( capacity * sizeof ( Entry ) ) );
+    priv->capacity = capacity;
+    priv->elementCount = 0;
+    priv->usedCount = 0;
+
+    memset ( priv->ctrl, CtrlEmpty, capacity );
+
+    return priv;
+}
+
+template<typename K, typename V> void FlatHashMap<K, V>::destroyPriv ( Priv * priv )
+{
+    assert ( priv != 0 );
+    assert ( priv->ref.count() == 0 );
+
+    for ( size_t i = 0; i < priv->capacity; ++i )
+    {
+        if ( isFull ( priv->ctrl[ i ] ) )
+        {
+            priv->entries[ i ].~Entry();
+        }
+    }
+
+    free ( priv->ctrl );
+    free ( priv->entries );
+
+    delete priv;
+}
+
+template<typename K, typename V> bool FlatHashMap<K, V>::IteratorCore::findValid ( const FlatHashMap<K, V> & hMap )
+{
+    if ( hMap._priv != 0 && hMap._priv->elementCount > 0 )
+    {
+        for ( ; _idx < hMap._priv->capacity; ++_idx )
+        {
+            if ( isFull ( hMap._priv->ctrl[ _idx ] ) )
+            {
+                _isValid = true;
+                return true;
+            }
+        }
+    }
+
+    _idx = 0;
+    _isValid = false;
+    return false;
+}
+
+template<typename K, typename V> bool FlatHashMap<K, V>::IteratorCore::next ( const FlatHashMap<K, V> & hMap )
+{
+    if ( !isValid ( hMap ) )
+    {
+        _idx = 0;
+        _isValid = false;
+        return false;
+    }
+
+    ++_idx;
+    return findValid ( hMap );
+}
+
+template<typename K, typename V> const K & FlatHashMap<K, V>::IteratorCore::key (
+    const FlatHashMap<K, V> & hMap ) const
+{
+    if ( isValid ( hMap ) )
+    {
+        return hMap._priv->entries[ _idx ].key;
+    }
+
+    assert ( false );
+
+    abort();
+}
+
+template<typename K, typename V> const V & FlatHashMap<K, V>::IteratorCore::value (
+    const FlatHashMap<K, V> & hMap ) const
+{
+    if ( isValid ( hMap ) )
+    {
+        return hMap._priv->entries[ _idx ].value;
+    }
+
+    assert ( false );
+
+    abort();
+}
+
+template<typename K, typename V> V & FlatHashMap<K, V>::IteratorCore::value ( FlatHashMap<K, V> & hMap )
+{
+    if ( isValid ( hMap ) )
+    {
+        // The copy (if it's needed) has the same layout, so our index remains valid.
+        hMap.ensureOwnCopy();
+        return hMap._priv->entries[ _idx ].value;
+    }
+
+    assert ( false );
+
+    abort();
+}
+
+template<typename K, typename V> bool FlatHashMap<K, V>::IteratorCore::remove ( FlatHashMap<K, V> & hMap )
+{
+    if ( !isValid ( hMap ) )
+    {
+        _idx = 0;
+        _isValid = false;
+        return false;
+    }
+
+    hMap.ensureOwnCopy();
+    hMap.removeIndex ( _idx );
+
+    // Elements never move when others are removed, so the next one is somewhere after the current index:
+    return findValid ( hMap );
+}
+
+DECLARE_EMBEDDED_2TEMPLATE_TYPE_INFO ( FlatHashMap, TYPE_CONF_STD_SHARED );
+}
@@ -0,0 +1,231 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#pragma once
+
+#include "FlatHashMap.hpp"
+
+namespace Pravala
+{
+/// @brief FlatHashSet class.
+/// Offers hash-based set, with the same API as HashSet, but based on FlatHashMap (see its description).
+template<typename T> class FlatHashSet: protected FlatHashMap<T, bool>
+{
+    public:
+        /// @brief Constant iterator over all hash set's elements.
+        /// It operates over a copy of the set. Thanks to implicit sharing,
+        /// the data is not actually copied, unless the original set is modified.
+        /// If that happens, iterator will keep iterating over the elements
+        /// that were in the set when the iterator was created.
+        class Iterator: protected FlatHashMap<T, bool>::Iterator
+        {
+            public:
+                /// @brief Creates a constant iterator over given FlatHashSet
+                /// @param [in] hSet FlatHashSet to iterate over.
+                inline Iterator ( const FlatHashSet<T> & hSet ): FlatHashMap<T, bool>::Iterator ( hSet )
+                {
+                }
+
+                /// @brief Returns current value
+                /// Calling this function in iterator that is not valid is illegal
+                /// (and crashes the program).
+                /// @return Value of current element.
+                inline const T & value() const
+                {
+                    return FlatHashMap<T, bool>::Iterator::key();
+                }
+
+                using FlatHashMap<T, bool>::Iterator::isValid;
+                using FlatHashMap<T, bool>::Iterator::next;
+                using FlatHashMap<T, bool>::Iterator::reset;
+        };
+
+        /// @brief Mutable iterator over FlatHashSet.
+        /// Similar to Iterator, but allows FlatHashSet to be modified.
+        /// @note Unlike Iterator, MutableIterator does not create a copy of the set, but iterates over the original.
+        /// Modifying the set while this iterator is running by inserting or removing elements
+        /// (other than by calling MutableIterator::remove()) may have unexpected consequences.
+        /// It could result in iterator skipping some elements, or returning elements already returned.
+        class MutableIterator: protected FlatHashMap<T, bool>::MutableIterator
+        {
+            public:
+                /// @brief Creates a mutable iterator over given FlatHashSet
+                /// @param [in] hSet FlatHashSet to iterate over. It CANNOT be a temporary object!
+                inline MutableIterator ( FlatHashSet<T> & hSet ): FlatHashMap<T, bool>::MutableIterator ( hSet )
+                {
+                }
+
+                /// @brief Returns current value
+                /// Calling this function in iterator that is not valid is illegal
+                /// (and crashes the program).
+                /// @return Value of current element.
+                inline const T & value() const
+                {
+                    // This should NOT be a writable reference!
+                    // We can't modify keys (or in this case, values) this way!
+                    return FlatHashMap<T, bool>::MutableIterator::key();
+                }
+
+                using FlatHashMap<T, bool>::MutableIterator::isValid;
+                using FlatHashMap<T, bool>::MutableIterator::next;
+                using FlatHashMap<T, bool>::MutableIterator::reset;
+                using FlatHashMap<T, bool>::MutableIterator::remove;
+        };
+
+        /// @brief Default constructor.
+        /// Creates an empty FlatHashSet.
+        inline FlatHashSet()
+        {
+        }
+
+        /// @brief Copy constructor.
+        /// The FlatHashSet uses implicit sharing, so the actual data
+        /// is not really copied, unless one of the FlatHashSet objects sharing
+        /// data needs to modify it.
+        /// @param [in] other FlatHashSet object to copy.
+        inline FlatHashSet ( const FlatHashSet & other ): FlatHashMap<T, bool>::FlatHashMap ( other )
+        {
+        }
+
+        /// @brief Constructor that converts a list of elements to FlatHashSet
+        /// @param [in] list A List to use for initializing the hash set
+        inline FlatHashSet ( const List<T> & list )
+        {
+            insertAll ( list );
+        }
+
+        /// @brief Assignment operator.
+        /// The FlatHashSet uses implicit sharing, so the actual data
+        /// is not really copied, unless one of the FlatHashSet objects sharing
+        /// data needs to modify it.
+        /// @param [in] other FlatHashSet object to copy.
+        /// @return Reference to this FlatHashSet.
+        inline FlatHashSet & operator= ( const FlatHashSet & other )
+        {
+            FlatHashMap<T, bool>::operator= ( other );
+            return *this;
+        }
+
+        /// @brief Assignment operator.
+        /// Converts a list of elements to FlatHashSet
+        /// @param [in] list A List to use for initializing the hash set
+        /// @return Reference to this FlatHashSet.
+        inline FlatHashSet & operator= ( const List<T> & list )
+        {
+            clear();
+            insertAll ( list );
+            return *this;
+        }
+
+        /// @brief Cast to a List operator.
+        /// @return A list that includes all elements of this FlatHashSet.
+        inline operator List<T> ( ) const
+        {
+            List<T> list;
+
+            for ( Iterator it ( *this ); it.isValid(); it.next() )
+            {
+                list.append ( it.value() );
+            }
+
+            return list;
+        }
+
+        /// @brief Compares two FlatHashSets to determine equality.
+        /// Two sets are equal if they contain the same elements.
+        /// @param [in] other The second set to compare
+        /// @return A value indicating whether the two sets are equal
+        inline bool operator== ( const FlatHashSet & other ) const
+        {
+            return FlatHashMap<T, bool>::operator== ( other );
+        }
+
+        /// @brief Compares two FlatHashSets to determine inequality.
+        /// Two sets are equal if they contain the same elements.
+        /// @param [in] other The second set to compare
+        /// @return A value indicating whether the two sets are inequal.
+        inline bool operator!= ( const FlatHashSet & other ) const
+        {
+            return !( *this == other );
+        }
+
+        /// @brief Inserts the given value to the set.
+        /// @param [in] val Value to insert.
+        /// @return Reference to this object.
+        inline FlatHashSet & insert ( const T & val )
+        {
+            FlatHashMap<T, bool>::insert ( val, true );
+            return *this;
+        }
+
+        /// @brief Inserts all elements of another FlatHashSet to this set.
+        /// @param [in] other The FlatHashSet whose elements to add to this one.
+        /// @return Reference to this object.
+        inline FlatHashSet & insertAll ( const FlatHashSet<T> & other )
+        {
+            FlatHashMap<T, bool>::insertAll ( other );
+            return *this;
+        }
+
+        /// @brief Inserts all elements from the list provided to this set.
+        /// @param [in] list The List from which elements to add to this set.
+        /// @return Reference to this object.
+        inline FlatHashSet & insertAll ( const List<T> & list )
+        {
+            const List<T> tmpCopy ( list );
+
+            for ( size_t idx = 0; idx < tmpCopy.size(); ++idx )
+            {
+                insert ( tmpCopy.at ( idx ) );
+            }
+
+            return *this;
+        }
+
+        /// @brief Removes all elements of another FlatHashSet from this set.
+        /// @param [in] other The FlatHashSet whose elements to remove from this one.
+        /// @return Number of values removed.
+        inline size_t removeAll ( const FlatHashSet<T> & other )
+        {
+            return FlatHashMap<T, bool>::removeAll ( other );
+        }
+
+        /// @brief Removes all elements from the list provided from this set.
+        /// @param [in] list The List from which elements to remove from this set.
+        /// @return Number of values removed.
+        inline size_t removeAll ( const List<T> & list )
+        {
+            size_t cnt = 0;
+            const List<T> tmpCopy ( list );
+
+            for ( size_t idx = 0; idx < tmpCopy.size(); ++idx )
+            {
+                cnt += remove ( tmpCopy.at ( idx ) );
+            }
+
+            return cnt;
+        }
+
+        using FlatHashMap<T, bool>::size;
+        using FlatHashMap<T, bool>::isEmpty;
+        using FlatHashMap<T, bool>::contains;
+        using FlatHashMap<T, bool>::remove;
+        using FlatHashMap<T, bool>::clear;
+        using FlatHashMap<T, bool>::getRefCount;
+};
+
+DECLARE_EMBEDDED_TEMPLATE_TYPE_INFO ( FlatHashSet, TYPE_CONF_STD_SHARED );
+}
@@ -16,6 +16,11 @@
 
 #include <cassert>
 
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#define MEM_HASH_CRC32C    1
+#include <nmmintrin.h>
+#endif
+
 #include "HashMap.hpp"
 
 #define NEW_BUF_SIZE( n )    ( ( n ) * 2 )
@@ -86,3 +91,105 @@ HashMapPriv::HashMapPriv ( HashMapPriv * other, bool increaseSize ):
 
     memset ( buffer, 0, sizeof ( PointerPair ) * bufSize );
 }
+
+#ifdef MEM_HASH_CRC32C
+/// @brief A helper function that detects whether SSE 4.2 is supported or not.
+/// @return True if SSE 4.2 instructions are supported; False otherwise.
+static bool detectSse42()
+{
+    __builtin_cpu_init();
+
+    return __builtin_cpu_supports ( "sse4.2" );
+}
+
+/// @brief Calculates CRC32C of the memory, using SSE 4.2 instructions.
+/// It is compiled for SSE 4.2 even if the rest of the code isn't, so it should only be used
+/// if detectSse42() returns true.
+/// @param [in] data The memory to hash. Does NOT need to be aligned in any specific way.
+/// @param [in] size The size of the memory (in bytes).
+/// @return CRC32C of the memory, seeded with its size.
+__attribute__ ( ( target ( "sse4.2" ) ) ) static uint32_t crc32cHash ( const char * data, size_t size )
+{
+    // memcpy is used to perform unaligned loads - compilers turn it into a single (unaligned) load instruction.
+
+#ifdef __x86_64__
+    uint64_t crc64 = size;
+
+    for ( ; size >= 8; data += 8, size -= 8 )
+    {
+        uint64_t v;
+
+        memcpy ( &v, data, 8 );
+
+        crc64 = _mm_crc32_u64 ( crc64, v );
+    }
+
+    uint32_t crc = ( uint32_t ) ( crc64 & 0xFFFFFFFFUL );
+#else
+    uint32_t crc = ( uint32_t ) size;
+#endif
+
+    for ( ; size >= 4; data += 4, size -= 4 )
+    {
+        uint32_t v;
+
+        memcpy ( &v, data, 4 );
+
+        crc = _mm_crc32_u32 ( crc, v );
+    }
+
+    for ( ; size > 0; ++data, --size )
+    {
+        crc = _mm_crc32_u8 ( crc, ( uint8_t ) *data );
+    }
+
+    return crc;
+}
+#endif
+
+/// @brief Mixes a 64-bit word into the hash.
+/// @param [in] hash The current hash value.
+/// @param [in] v The word to mix in.
+/// @return The new hash value.
+static inline uint64_t mixHashWord ( uint64_t hash, uint64_t v )
+{
+    hash = ( hash ^ v ) * 0x9E3779B97F4A7C15ULL;
+
+    return hash ^ ( hash >> 29 );
+}
+
+size_t Pravala::getMemHash ( const char * data, size_t size )
+{
+    assert ( data != 0 || size == 0 );
+
+#ifdef MEM_HASH_CRC32C
+    static const bool hasSse42 ( detectSse42() );
+
+    if ( hasSse42 )
+    {
+        return crc32cHash ( data, size );
+    }
+#endif
+
+    uint64_t hash = size;
+
+    for ( ; size >= 8; data += 8, size -= 8 )
+    {
+        uint64_t v;
+
+        memcpy ( &v, data, 8 );
+
+        hash = mixHashWord ( hash, v );
+    }
+
+    if ( size > 0 )
+    {
+        uint64_t v = 0;
+
+        memcpy ( &v, data, size );
+
+        hash = mixHashWord ( hash, v );
+    }
+
+    return ( size_t ) hash;
+}
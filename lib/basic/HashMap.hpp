@@ -133,6 +133,17 @@ template<class T> inline size_t getHash ( const T * hKey )
     return getHash ( ( ptr_cast_t ) hKey );
 }
 
+/// @brief Returns the hashing code for a memory block.
+/// If support for SSE 4.2 is compiled in and available on this machine, CRC32C is used
+/// (just like in FlowDesc::getHash()), 8 bytes at a time.
+/// Otherwise 64-bit words of the data are mixed using multiplication.
+/// It is meant to be used by getHash() functions of types that are (or contain) short memory blocks.
+/// The result is only meant to be used within a single process - it may be different on different machines.
+/// @param [in] data The memory to hash. Does NOT need to be aligned in any specific way.
+/// @param [in] size The size of the memory (in bytes).
+/// @return The hashing code for the memory provided.
+size_t getMemHash ( const char * data, size_t size );
+
 /// @brief Private data of the HashMap.
 /// Common for all HashMap objects, no matter what type they use.
 /// It is NOT thread safe!
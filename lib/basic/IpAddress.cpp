@@ -18,6 +18,7 @@
 #include <cstdio>
 
 #include "String.hpp"
+#include "HashMap.hpp"
 #include "IpAddress.hpp"
 
 #ifdef SYSTEM_WINDOWS
@@ -1277,13 +1278,11 @@ size_t Pravala::getHash ( const IpAddress & key )
 {
     if ( key.isIPv4() )
     {
-        return ( unsigned int ) key.getV4().s_addr;
+        return getMemHash ( ( const char * ) &( key.getV4() ), sizeof ( key.getV4() ) );
     }
     else if ( key.isIPv6() )
     {
-        const uint32_t * v6 = ( const uint32_t * ) ( &( key.getV6() ) );
-
-        return v6[ 0 ] ^ v6[ 1 ] ^ v6[ 2 ] ^ v6[ 3 ];
+        return getMemHash ( ( const char * ) &( key.getV6() ), sizeof ( key.getV6() ) );
     }
 
     return 0;
@@ -16,6 +16,7 @@
 
 #include "Math.hpp"
 #include "SockAddr.hpp"
+#include "HashMap.hpp"
 #include "IpAddress.hpp"
 
 using namespace Pravala;
@@ -322,16 +323,23 @@ String SockAddr::toString() const
 
 size_t Pravala::getHash ( const SockAddr & key )
 {
+    // We only hash the fields that operator== compares.
+
     if ( key.isIPv4() )
     {
-        return ( ( ( unsigned int ) key.sa_in.sin_addr.s_addr )
-                 ^ ( ( unsigned int ) key.sa_in.sin_port ) );
+        // Both the address and the port fit in a single 64-bit word:
+        const uint64_t v = ( ( ( uint64_t ) key.sa_in.sin_addr.s_addr ) << 16 ) | key.sa_in.sin_port;
+
+        return getMemHash ( ( const char * ) &v, sizeof ( v ) );
     }
     else if ( key.isIPv6() )
     {
-        const uint32_t * v6 = ( const uint32_t * ) ( &key.sa_in6.sin6_addr );
+        char buf[ sizeof ( key.sa_in6.sin6_addr ) + sizeof ( key.sa_in6.sin6_port ) ];
+
+        memcpy ( buf, &key.sa_in6.sin6_addr, sizeof ( key.sa_in6.sin6_addr ) );
+        memcpy ( buf + sizeof ( key.sa_in6.sin6_addr ), &key.sa_in6.sin6_port, sizeof ( key.sa_in6.sin6_port ) );
 
-        return v6[ 0 ] ^ v6[ 1 ] ^ v6[ 2 ] ^ v6[ 3 ] ^ ( ( unsigned int ) key.sa_in6.sin6_port );
+        return getMemHash ( buf, sizeof ( buf ) );
     }
 
     return 0;
@@ -20,11 +20,14 @@
 #include <cerrno>
 #include <climits>
 #include <cctype>
+#include <cfloat>
+#include <cmath>
 
 #include "NoCopy.hpp"
 
 #include "String.hpp"
 #include "Buffer.hpp"
+#include "HashMap.hpp"
 #include "IpAddress.hpp"
 #include "MsvcSupport.hpp"
 
@@ -45,6 +48,10 @@ using std::strtof;
 // so we use 35 here, which results in 36 bytes allocated (at least)
 #define MIN_BUF_SIZE    35
 
+// The size of the buffer stored inside of StringPriv (not including the NULL character at the end).
+// Strings that fit in it don't allocate any memory other than the StringPriv object itself.
+#define INLINE_BUF_SIZE    MIN_BUF_SIZE
+
 using namespace Pravala;
 
 const String String::EmptyString;
@@ -140,8 +147,16 @@ class StringPriv: public NoCopy
         }
 
         /// @brief Reallocates memory so only the amount needed is used.
+        /// Data that fits in the inline buffer is moved there.
         void squeeze();
 
+        /// @brief Checks whether the data is stored in the inline buffer.
+        /// @return True if the data is stored in the inline buffer; False if it uses memory allocated separately.
+        inline bool isInline() const
+        {
+            return ( buffer == inlineBuffer );
+        }
+
         /// @brief Pointer to allocated memory.
         char * buffer;
 
@@ -156,8 +171,35 @@ class StringPriv: public NoCopy
         SharedMemory::RefCounter ref;
 
     private:
+        /// @brief The buffer used for short strings.
+        /// It is used instead of memory allocated separately whenever the data fits in it,
+        /// so short strings only need a single allocation.
+        char inlineBuffer[ INLINE_BUF_SIZE + 1 ];
+
         /// @brief Doesn't exist.
         StringPriv();
+
+        /// @brief Returns a buffer that can store the given number of characters.
+        /// @param [in] size The number of characters (not including the NULL character at the end).
+        /// @return The inline buffer if the data fits in it; Memory allocated using malloc() otherwise.
+        inline char * allocBuffer ( int size )
+        {
+            return ( size <= INLINE_BUF_SIZE ) ? inlineBuffer : static_cast<char *> ( malloc ( size + 1 ) );
+        }
+
+        /// @brief Releases a buffer returned by allocBuffer().
+        /// @param [in] buf The buffer to release.
+        inline void freeBuffer ( char * buf )
+        {
+            if ( buf != inlineBuffer )
+                free ( buf );
+        }
+
+        /// @brief Changes the size of the buffer, preserving its content.
+        /// Like realloc(), it may move the data to a different memory.
+        /// @param [in] size The new size of the buffer (not including the NULL character at the end).
+        ///                  It has to be at least equal to the current length.
+        void resizeBuffer ( int size );
 };
 }
 
@@ -172,7 +214,7 @@ StringPriv::StringPriv ( int initialSize ):
 
     length = 0;
 
-    buffer = static_cast<char *> ( malloc ( bufSize + 1 ) );
+    buffer = allocBuffer ( bufSize );
 
     assert ( buffer != 0 );
 
@@ -200,7 +242,7 @@ StringPriv::StringPriv ( StringPriv * other, int additionalSize ):
 
     length = 0;
 
-    buffer = static_cast<char *> ( malloc ( bufSize + 1 ) );
+    buffer = allocBuffer ( bufSize );
 
     assert ( buffer != 0 );
 
@@ -224,7 +266,7 @@ StringPriv::~StringPriv()
     {
         assert ( ref.count() == 0 );
 
-        free ( buffer );
+        freeBuffer ( buffer );
         buffer = 0;
         length = bufSize = 0;
     }
@@ -241,7 +283,7 @@ void StringPriv::squeeze()
         if ( buffer != 0 )
         {
             length = bufSize = 0;
-            free ( buffer );
+            freeBuffer ( buffer );
             buffer = 0;
         }
 
@@ -251,24 +293,51 @@ void StringPriv::squeeze()
     }
     else if ( length < bufSize )
     {
-        bufSize = length;
+        resizeBuffer ( length );
 
-        char * const newBuffer = static_cast<char *> ( realloc ( buffer, bufSize + 1 ) );
+        assert ( buffer != 0 );
+        assert ( length > 0 );
+        assert ( bufSize == length );
+    }
+}
 
-        if ( newBuffer != 0 )
-        {
-            buffer = newBuffer;
-        }
-        else
+void StringPriv::resizeBuffer ( int size )
+{
+    assert ( size >= length );
+
+    char * newBuffer = 0;
+
+    if ( buffer != 0 && !isInline() && size > INLINE_BUF_SIZE )
+    {
+        newBuffer = static_cast<char *> ( realloc ( buffer, size + 1 ) );
+    }
+    else
+    {
+        // We can't use realloc() with the inline buffer, and we also want to move short strings into it.
+
+        newBuffer = allocBuffer ( size );
+
+        if ( newBuffer != 0 && newBuffer != buffer )
         {
-            abort();
-        }
+            if ( length > 0 )
+            {
+                assert ( buffer != 0 );
 
-        assert ( buffer != 0 );
-        assert ( length > 0 );
+                memcpy ( newBuffer, buffer, length );
+            }
 
-        buffer[ length ] = 0;
+            freeBuffer ( buffer );
+        }
     }
+
+    if ( !newBuffer )
+    {
+        abort();
+    }
+
+    buffer = newBuffer;
+    bufSize = size;
+    buffer[ length ] = 0;
 }
 
 void StringPriv::reserve ( int size )
@@ -282,29 +351,19 @@ void StringPriv::reserve ( int size )
 
     if ( length + size > bufSize )
     {
-        bufSize = NEW_BUF_SIZE ( bufSize );
+        int newBufSize = NEW_BUF_SIZE ( bufSize );
 
-        if ( bufSize < MIN_BUF_SIZE )
-            bufSize = MIN_BUF_SIZE;
+        if ( newBufSize < MIN_BUF_SIZE )
+            newBufSize = MIN_BUF_SIZE;
 
-        if ( bufSize < length + size )
-            bufSize = length + size;
+        if ( newBufSize < length + size )
+            newBufSize = length + size;
 
-        char * const newBuffer = static_cast<char *> ( realloc ( buffer, bufSize + 1 ) );
+        resizeBuffer ( newBufSize );
 
-        if ( newBuffer != 0 )
-        {
-            buffer = newBuffer;
-        }
-        else
-        {
-            abort();
-        }
         assert ( buffer != 0 );
         assert ( length + size <= bufSize );
         assert ( length <= bufSize );
-
-        buffer[ length ] = 0;
     }
 }
 
@@ -336,38 +395,42 @@ void StringPriv::append ( const char * data, int size )
 
     if ( length + size > bufSize )
     {
-        bufSize = NEW_BUF_SIZE ( bufSize );
+        int newBufSize = NEW_BUF_SIZE ( bufSize );
 
-        if ( bufSize < MIN_BUF_SIZE )
-            bufSize = MIN_BUF_SIZE;
+        if ( newBufSize < MIN_BUF_SIZE )
+            newBufSize = MIN_BUF_SIZE;
 
-        if ( bufSize < length + size )
-            bufSize = length + size;
+        if ( newBufSize < length + size )
+            newBufSize = length + size;
 
         char * orgBuf = buffer;
 
         if ( memOverlap )
         {
-            buffer = static_cast<char *> ( malloc ( bufSize + 1 ) );
+            // If both are the inline buffer, the data doesn't move, and we don't need to copy anything.
+            buffer = allocBuffer ( newBufSize );
 
             assert ( buffer != 0 );
 
             if ( !buffer )
             {
+                buffer = orgBuf;
                 return;
             }
 
-            if ( length > 0 )
+            if ( length > 0 && buffer != orgBuf )
             {
                 assert ( orgBuf != 0 );
-                assert ( bufSize > 0 );
+                assert ( newBufSize > 0 );
 
                 memcpy ( buffer, orgBuf, length );
             }
+
+            bufSize = newBufSize;
         }
         else
         {
-            buffer = static_cast<char *> ( realloc ( buffer, bufSize + 1 ) );
+            resizeBuffer ( newBufSize );
         }
 
         assert ( length < bufSize );
@@ -384,14 +447,14 @@ void StringPriv::append ( const char * data, int size )
 
         buffer[ length ] = 0;
 
-        if ( memOverlap )
+        if ( memOverlap && buffer != orgBuf )
         {
             assert ( orgBuf != 0 );
 
             // In case one string is appended to itself we have to free
             // this buffer AFTER copying the data!
             // Also, this is the reason why we can't use realloc here!
-            free ( orgBuf );
+            freeBuffer ( orgBuf );
         }
     }
     else
@@ -937,27 +1000,9 @@ String & String::replaceArgs (
     assert ( numValues > 0 );
     assert ( numValues <= 9 );
 
-    StringList strList;
-
-    if ( numValues > 0 ) strList.append ( a1 );
-
-    if ( numValues > 1 ) strList.append ( a2 );
-
-    if ( numValues > 2 ) strList.append ( a3 );
-
-    if ( numValues > 3 ) strList.append ( a4 );
-
-    if ( numValues > 4 ) strList.append ( a5 );
-
-    if ( numValues > 5 ) strList.append ( a6 );
-
-    if ( numValues > 6 ) strList.append ( a7 );
+    const String * const values[ 9 ] = { &a1, &a2, &a3, &a4, &a5, &a6, &a7, &a8, &a9 };
 
-    if ( numValues > 7 ) strList.append ( a8 );
-
-    if ( numValues > 8 ) strList.append ( a9 );
-
-    return replaceArgs ( strList );
+    return replaceArgs ( values, ( numValues <= 9 ) ? numValues : 9 );
 }
 
 String & String::replaceArgs ( const StringList & strList )
@@ -965,16 +1010,26 @@ String & String::replaceArgs ( const StringList & strList )
     assert ( strList.size() > 0 );
     assert ( strList.size() <= 99 );
 
-    if ( isEmpty() || strList.isEmpty() )
-        return *this;
-
-    const int sz = length();
     const int lSize = ( int ) ( ( strList.size() <= 99 ) ? ( strList.size() ) : 99 );
+    const String * values[ 99 ];
+
+    for ( int i = 0; i < lSize; ++i )
+    {
+        values[ i ] = &strList.at ( i );
+    }
 
-    Buffer buf;
+    return replaceArgs ( values, lSize );
+}
 
-    buf.getAppendable ( sz + 1 );
+String & String::replaceArgs ( const String * const * values, int numValues )
+{
+    assert ( numValues > 0 );
+    assert ( numValues <= 99 );
+
+    if ( isEmpty() || numValues < 1 )
+        return *this;
 
+    const int sz = length();
     const char * c = c_str();
 
     if ( !c )
@@ -983,22 +1038,30 @@ String & String::replaceArgs ( const StringList & strList )
         return *this;
     }
 
-    for ( int i = 0; i < sz; ++i )
+    int resultSize = sz;
+
+    for ( int i = 0; i < numValues; ++i )
     {
-        if ( i + 1 >= sz
-             || c[ i ] != '%'
-             || c[ i + 1 ] < '1'
-             || c[ i + 1 ] > '9' )
+        resultSize += values[ i ]->length();
+    }
+
+    String ret;
+
+    ret.reserve ( resultSize );
+
+    // The beginning of the text that has not been appended yet:
+    int textStart = 0;
+
+    for ( int i = 0; i + 1 < sz; ++i )
+    {
+        if ( c[ i ] != '%' || c[ i + 1 ] < '1' || c[ i + 1 ] > '9' )
         {
-            // It is one of:
-            // - last character
-            // - not '%'
-            // - not follow by a digit between 1 and 9
-            // Append, skip
-            buf.appendData ( c + i, 1 );
+            // Not '%' followed by a digit between 1 and 9.
             continue;
         }
 
+        ret.append ( c + textStart, i - textStart );
+
         // We have '%N'. We can work with that!
         // c[i] is '%', so we need to skip it first.
         int numValue = c[ ++i ] - '0';
@@ -1010,26 +1073,27 @@ String & String::replaceArgs ( const StringList & strList )
             numValue = ( numValue * 10 ) + c[ ++i ] - '0';
         }
 
+        textStart = i + 1;
+
         assert ( numValue > 0 );
         assert ( numValue <= 99 );
 
-        if ( numValue > lSize )
+        if ( numValue > numValues )
         {
             // We don't want to replace it yet, just decrement the argument number
 
-            buf.append ( "%" );
-            buf.append ( String::number ( numValue - lSize ) );
+            ret.append ( '%' );
+            ret.append ( String::number ( numValue - numValues ) );
         }
         else
         {
-            buf.append ( strList.at ( numValue - 1 ) );
+            ret.append ( *values[ numValue - 1 ] );
         }
     }
 
-    clear();
-    append ( buf.get(), ( int ) buf.size() );
+    ret.append ( c + textStart, sz - textStart );
 
-    return *this;
+    return ( *this = ret );
 }
 
 bool String::matches ( const char * pattern, const char * str )
@@ -1959,101 +2023,473 @@ double String::toDouble ( bool * ok ) const
 
 size_t Pravala::getHash ( const String & key )
 {
-    unsigned int hash = 5381;
-    const char * str = key.c_str();
-    int c;
+    // We know the length, so there is no need to look for the terminating 0, or to hash one byte at a time:
+    return getMemHash ( key.c_str(), key.length() );
+}
 
-    // http://www.cse.yorku.ca/~oz/hash.html
+#define CONV_BUF_SIZE           32
+#define CONV_FORMAT_BUF_SIZE    20
+
+/// @brief The default precision of floating point conversions (the same as used by printf).
+#define CONV_DEFAULT_PRECISION    6
+
+/// @brief The max precision of floating point conversions that don't use snprintf().
+/// 10^15 still fits (with some room for rounding checks) in the 53 bit mantissa of a double.
+#define CONV_MAX_FAST_PRECISION    15
+
+/// @brief The max power of 10 that can be represented exactly as a double.
+#define CONV_MAX_EXACT_POW10       22
+
+/// @brief Decimal representations of all numbers between 0 and 99, two digits each.
+static const char DecDigitPairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/// @brief Powers of 10 that can be represented exactly as doubles.
+static const double ExactPow10[ CONV_MAX_EXACT_POW10 + 1 ] =
+{
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
 
-    while ( ( c = *( str++ ) ) != 0 )
+/// @brief Limits the width and precision of a conversion, so the result fits in CONV_BUF_SIZE.
+/// @param [in,out] width Width of the field. 0 is no fixed width.
+/// @param [in,out] prec Precision of the conversion. 0 for default.
+inline static void limitConvSizes ( int & width, int & prec )
+{
+    if ( width >= CONV_BUF_SIZE )
+        width = CONV_BUF_SIZE - 1;
+
+    if ( prec >= CONV_BUF_SIZE )
+        prec = CONV_BUF_SIZE - 1;
+
+    if ( width > 0 && prec > 0 && width + prec >= CONV_BUF_SIZE )
     {
-        hash = ( ( hash << 5 ) + hash ) + c; /* hash * 33 + c */
+        width = ( CONV_BUF_SIZE - 1 ) / 2;
+        prec = ( CONV_BUF_SIZE - 1 ) / 2;
     }
+}
 
-    return hash;
+/// @brief Writes the digits of a number, backwards.
+/// @param [in] end The end of the buffer to write to. Digits are written in front of it.
+/// @param [in] value The value to write.
+/// @param [in] style The style of conversion.
+/// @return The pointer to the first digit written.
+template<typename T> inline static char * writeDigits ( char * end, T value, String::IntStyle style )
+{
+    if ( style == String::Int_Oct )
+    {
+        do
+        {
+            *--end = '0' + ( char ) ( value & 7 );
+            value >>= 3;
+        }
+        while ( value != 0 );
+
+        return end;
+    }
+
+    if ( style == String::Int_Hex || style == String::Int_HEX )
+    {
+        const char * const digits = ( style == String::Int_Hex ) ? "0123456789abcdef" : "0123456789ABCDEF";
+
+        do
+        {
+            *--end = digits[ value & 0xF ];
+            value >>= 4;
+        }
+        while ( value != 0 );
+
+        return end;
+    }
+
+    while ( value >= 100 )
+    {
+        const char * const pair = DecDigitPairs + ( value % 100 ) * 2;
+
+        value /= 100;
+
+        *--end = pair[ 1 ];
+        *--end = pair[ 0 ];
+    }
+
+    if ( value >= 10 )
+    {
+        *--end = DecDigitPairs[ value * 2 + 1 ];
+        *--end = DecDigitPairs[ value * 2 ];
+    }
+    else
+    {
+        *--end = '0' + ( char ) value;
+    }
+
+    return end;
 }
 
-#define CONV_BUF_SIZE           32
-#define CONV_FORMAT_BUF_SIZE    20
+/// @brief Creates a string with a converted number, padded the same way printf does it.
+/// @param [in] data The converted number, without the sign.
+/// @param [in] size The size of the data. Together with the sign it has to be smaller than CONV_BUF_SIZE.
+/// @param [in] negative Whether the number is negative.
+/// @param [in] width Width of the field. 0 is no fixed width.
+/// @param [in] zeroFill If true, the field is filled with '0' characters (after the sign).
+/// @return The string with the number.
+static String padNumber ( const char * data, int size, bool negative, int width, bool zeroFill )
+{
+    assert ( size > 0 );
+    assert ( size + ( negative ? 1 : 0 ) < CONV_BUF_SIZE );
 
-template<typename T> inline static String doConv (
-        T num, const char * lenModif, char format, int width,
-        bool zeroFill, int prec )
+    if ( width >= CONV_BUF_SIZE )
+        width = CONV_BUF_SIZE - 1;
+
+    int padSize = width - size - ( negative ? 1 : 0 );
+
+    if ( padSize < 0 )
+        padSize = 0;
+
+    char buf[ CONV_BUF_SIZE ];
+    char * w = buf;
+
+    if ( !zeroFill )
+    {
+        memset ( w, ' ', padSize );
+        w += padSize;
+    }
+
+    if ( negative )
+        *w++ = '-';
+
+    if ( zeroFill )
+    {
+        memset ( w, '0', padSize );
+        w += padSize;
+    }
+
+    memcpy ( w, data, size );
+    w += size;
+
+    return String ( buf, ( int ) ( w - buf ) );
+}
+
+/// @brief Converts an integer to a string.
+/// @param [in] num Number to convert.
+/// @param [in] style Style of representation.
+/// @param [in] width Width of the field. 0 is no fixed width.
+/// @param [in] zeroFill If true, the field is filled with '0' characters.
+/// @tparam S The type of the number.
+/// @tparam U The unsigned version of S. Like printf, octal and hexadecimal conversions treat negative
+///           numbers as unsigned values.
+/// @return String representation of the number.
+template<typename S, typename U> inline static String convInt (
+        S num, String::IntStyle style, int width, bool zeroFill )
 {
-    char convFmtBuf[ CONV_FORMAT_BUF_SIZE + 1 ];
+    const bool negative = ( style == String::Int_Dec && num < 0 );
+
+    // We can't negate the smallest value of signed types, but we can negate the unsigned one:
+    const U value = negative ? ( U ) ( ( U ) 0 - ( U ) num ) : ( U ) num;
 
-    if ( width > 0 && prec > 0 )
+    if ( !negative && width <= 0 && style == String::Int_Dec && value < 10 )
     {
-        if ( width >= CONV_BUF_SIZE )
-            width = CONV_BUF_SIZE - 1;
+        const char c = '0' + ( char ) value;
+
+        return String ( &c, 1 );
+    }
+
+    char buf[ CONV_BUF_SIZE ];
+    char * const end = buf + sizeof ( buf );
+    const char * const start = writeDigits ( end, value, style );
+
+    return padNumber ( start, ( int ) ( end - start ), negative, width, zeroFill );
+}
+
+/// @brief Rounds a scaled floating point value to the nearest integer.
+/// The value has been scaled using a single multiplication or division by an exact power of 10,
+/// so it differs from the exact result by at most one ulp. If that difference could affect the rounding,
+/// the result cannot be determined without exact arithmetic.
+/// @param [in] value The value to round. It should be smaller than 2^53.
+/// @param [out] result The rounded value.
+/// @return True if the value has been rounded; False if the rounding could not be determined.
+inline static bool roundScaled ( double value, uint64_t & result )
+{
+    const double intPart = floor ( value );
+    const double frac = value - intPart;
+    const double diff = frac - 0.5;
+
+    if ( ( diff < 0 ? -diff : diff ) <= value * DBL_EPSILON * 2 )
+        return false;
+
+    result = ( uint64_t ) intPart;
 
-        if ( prec >= CONV_BUF_SIZE )
-            prec = CONV_BUF_SIZE - 1;
+    if ( frac > 0.5 )
+        ++result;
 
-        if ( width + prec >= CONV_BUF_SIZE )
+    return true;
+}
+
+/// @brief Converts a double to a string, using 'f', 'F', 'g' or 'G' style, the same way printf does.
+/// Only numbers whose rounding can be determined using double arithmetic are converted.
+/// @param [in] num Number to convert.
+/// @param [in] style Style of representation. One of Double_f, Double_F, Double_g or Double_G.
+/// @param [in] width Width of the field. 0 is no fixed width.
+/// @param [in] zeroFill If true, the field is filled with '0' characters.
+/// @param [in] precision Precision of the conversion. 0 for default.
+/// @param [out] result The string representation of the number.
+/// @return True if the number has been converted; False if snprintf should be used instead.
+static bool convDouble (
+        double num, String::DoubleStyle style, int width, bool zeroFill, int precision, String & result )
+{
+    limitConvSizes ( width, precision );
+
+    if ( precision <= 0 )
+        precision = CONV_DEFAULT_PRECISION;
+
+    if ( precision > CONV_MAX_FAST_PRECISION || num != num )
+        return false;
+
+    // -0.0 is printed with the sign. Division by zero is fine, it gives -inf:
+    const bool negative = ( num < 0 || ( num == 0 && 1.0 / num < 0 ) );
+    const double absNum = negative ? -num : num;
+
+    if ( absNum > DBL_MAX )
+        return false;
+
+    // The digits of the number, and the (decimal) exponent of the first one.
+    char digits[ CONV_BUF_SIZE ];
+    int numDigits = 0;
+    int exponent = 0;
+    uint64_t mantissa = 0;
+
+    char buf[ CONV_BUF_SIZE ];
+    char * w = buf;
+
+    if ( style == String::Double_f || style == String::Double_F )
+    {
+        if ( absNum * ExactPow10[ precision ] >= ExactPow10[ CONV_MAX_FAST_PRECISION ] )
+            return false;
+
+        if ( !roundScaled ( absNum * ExactPow10[ precision ], mantissa ) )
+            return false;
+
+        char * const end = digits + sizeof ( digits );
+        const char * start = writeDigits ( end, mantissa, String::Int_Dec );
+
+        numDigits = ( int ) ( end - start );
+
+        // Integer part:
+        if ( numDigits <= precision )
         {
-            width = ( CONV_BUF_SIZE - 1 ) / 2;
-            prec = ( CONV_BUF_SIZE - 1 ) / 2;
+            *w++ = '0';
         }
+        else
+        {
+            memcpy ( w, start, numDigits - precision );
+            w += numDigits - precision;
+            start += numDigits - precision;
+            numDigits = precision;
+        }
+
+        *w++ = '.';
+
+        memset ( w, '0', precision - numDigits );
+        w += precision - numDigits;
+
+        memcpy ( w, start, numDigits );
+        w += numDigits;
 
-        snprintf ( convFmtBuf, CONV_FORMAT_BUF_SIZE, "%%%s%d.%d%s%c",
-                   zeroFill ? "0" : "", width, prec, lenModif, format );
+        result = padNumber ( buf, ( int ) ( w - buf ), negative, width, zeroFill );
+        return true;
     }
-    else if ( width > 0 )
+
+    if ( style != String::Double_g && style != String::Double_G )
+        return false;
+
+    if ( absNum == 0 )
     {
-        if ( width >= CONV_BUF_SIZE )
-            width = CONV_BUF_SIZE - 1;
+        result = padNumber ( "0", 1, negative, width, zeroFill );
+        return true;
+    }
+
+    exponent = ( int ) floor ( log10 ( absNum ) );
+
+    // We scale the number so it has 'precision' digits before the decimal point.
+    // log10 may be off by one, in which case we adjust the exponent and try again.
 
-        snprintf ( convFmtBuf, CONV_FORMAT_BUF_SIZE, "%%%s%d%s%c",
-                   zeroFill ? "0" : "", width, lenModif, format );
+    for ( int i = 0; i < 2; ++i )
+    {
+        const int scale = precision - 1 - exponent;
+
+        if ( scale > CONV_MAX_EXACT_POW10 || scale < -CONV_MAX_EXACT_POW10 )
+            return false;
+
+        const double scaled = ( scale >= 0 ) ? ( absNum * ExactPow10[ scale ] ) : ( absNum / ExactPow10[ -scale ] );
+
+        if ( scaled < ExactPow10[ precision - 1 ] )
+        {
+            --exponent;
+            continue;
+        }
+
+        if ( scaled >= ExactPow10[ precision ] )
+        {
+            ++exponent;
+            continue;
+        }
+
+        if ( !roundScaled ( scaled, mantissa ) )
+            return false;
+
+        numDigits = precision;
+        break;
     }
-    else if ( prec > 0 )
+
+    if ( numDigits < 1 )
+        return false;
+
+    if ( mantissa >= ( uint64_t ) ExactPow10[ precision ] )
     {
-        if ( prec >= CONV_BUF_SIZE )
-            prec = CONV_BUF_SIZE - 1;
+        // It was rounded up to the next power of 10:
+        mantissa /= 10;
+        ++exponent;
+    }
 
-        snprintf ( convFmtBuf, CONV_FORMAT_BUF_SIZE, "%%%s.%d%s%c",
-                   zeroFill ? "0" : "", prec, lenModif, format );
+    writeDigits ( digits + numDigits, mantissa, String::Int_Dec );
+
+    // Trailing zeros are not included in 'g' style:
+    while ( numDigits > 1 && digits[ numDigits - 1 ] == '0' )
+    {
+        --numDigits;
+    }
+
+    if ( exponent < -4 || exponent >= precision )
+    {
+        *w++ = digits[ 0 ];
+
+        if ( numDigits > 1 )
+        {
+            *w++ = '.';
+
+            memcpy ( w, digits + 1, numDigits - 1 );
+            w += numDigits - 1;
+        }
+
+        *w++ = ( style == String::Double_G ) ? 'E' : 'e';
+        *w++ = ( exponent < 0 ) ? '-' : '+';
+
+        char expBuf[ 8 ];
+        char * const expEnd = expBuf + sizeof ( expBuf );
+        const char * expStart = writeDigits ( expEnd, ( unsigned int ) ( ( exponent < 0 ) ? -exponent : exponent ),
+                                              String::Int_Dec );
+
+        if ( expEnd - expStart < 2 )
+            *w++ = '0';
+
+        memcpy ( w, expStart, expEnd - expStart );
+        w += expEnd - expStart;
+    }
+    else if ( exponent < 0 )
+    {
+        *w++ = '0';
+        *w++ = '.';
+
+        memset ( w, '0', -exponent - 1 );
+        w += -exponent - 1;
+
+        memcpy ( w, digits, numDigits );
+        w += numDigits;
     }
     else
     {
-        snprintf ( convFmtBuf, CONV_FORMAT_BUF_SIZE, "%%%s%s%c",
-                   zeroFill ? "0" : "", lenModif, format );
+        const int intDigits = exponent + 1;
+
+        if ( numDigits <= intDigits )
+        {
+            memcpy ( w, digits, numDigits );
+            w += numDigits;
+
+            memset ( w, '0', intDigits - numDigits );
+            w += intDigits - numDigits;
+        }
+        else
+        {
+            memcpy ( w, digits, intDigits );
+            w += intDigits;
+
+            *w++ = '.';
+
+            memcpy ( w, digits + intDigits, numDigits - intDigits );
+            w += numDigits - intDigits;
+        }
     }
 
-    convFmtBuf[ CONV_FORMAT_BUF_SIZE ] = 0;
+    result = padNumber ( buf, ( int ) ( w - buf ), negative, width, zeroFill );
+    return true;
+}
 
-    char convBuf[ CONV_BUF_SIZE + 1 ];
+/// @brief Appends a decimal representation of a small, non-negative number.
+/// @param [in] w The position to write to.
+/// @param [in] value The value to write. It has to be smaller than 100.
+/// @return The position after the last character written.
+inline static char * appendFormatNumber ( char * w, int value )
+{
+    assert ( value >= 0 );
+    assert ( value < 100 );
 
-    snprintf ( convBuf, CONV_BUF_SIZE, convFmtBuf, num );
-    convBuf[ CONV_BUF_SIZE ] = 0;
+    if ( value >= 10 )
+        *w++ = '0' + ( char ) ( value / 10 );
 
-    return String ( convBuf );
+    *w++ = '0' + ( char ) ( value % 10 );
+
+    return w;
 }
 
-inline static char intFormat ( String::IntStyle style, char defFormat )
+template<typename T> inline static String doConv (
+        T num, const char * lenModif, char format, int width,
+        bool zeroFill, int prec )
 {
-    switch ( style )
-    {
-        case String::Int_Dec:
-            // We return 'defFormat', because it depends on the type (unlike octal and hex styles).
-            return defFormat;
-            break;
+    limitConvSizes ( width, prec );
 
-        case String::Int_Oct:
-            return 'o';
-            break;
+    // It generates "%[0][width][.prec][lenModif]format":
 
-        case String::Int_Hex:
-            return 'x';
-            break;
+    char convFmtBuf[ CONV_FORMAT_BUF_SIZE + 1 ];
+    char * w = convFmtBuf;
 
-        case String::Int_HEX:
-            return 'X';
-            break;
+    *w++ = '%';
+
+    if ( zeroFill )
+        *w++ = '0';
+
+    if ( width > 0 )
+        w = appendFormatNumber ( w, width );
+
+    if ( prec > 0 )
+    {
+        *w++ = '.';
+        w = appendFormatNumber ( w, prec );
+    }
+
+    while ( *lenModif != 0 )
+    {
+        *w++ = *lenModif++;
     }
 
-    return defFormat;
+    *w++ = format;
+    *w = 0;
+
+    assert ( w <= convFmtBuf + CONV_FORMAT_BUF_SIZE );
+
+    char convBuf[ CONV_BUF_SIZE + 1 ];
+
+    snprintf ( convBuf, CONV_BUF_SIZE, convFmtBuf, num );
+    convBuf[ CONV_BUF_SIZE ] = 0;
+
+    return String ( convBuf );
 }
 
 inline static char doubleFormat ( String::DoubleStyle style )
@@ -2100,76 +2536,81 @@ String String::number (
         char num, String::IntStyle style,
         int width, bool zeroFill )
 {
-    return doConv ( ( int ) num, "", intFormat ( style, 'd' ), width, zeroFill, 0 );
+    return convInt<int, unsigned int> ( num, style, width, zeroFill );
 }
 
 String String::number (
         short num, String::IntStyle style,
         int width, bool zeroFill )
 {
-    return doConv ( ( int ) num, "", intFormat ( style, 'd' ), width, zeroFill, 0 );
+    return convInt<int, unsigned int> ( num, style, width, zeroFill );
 }
 
 String String::number (
         int num, String::IntStyle style,
         int width, bool zeroFill )
 {
-    return doConv ( num, "", intFormat ( style, 'd' ), width, zeroFill, 0 );
+    return convInt<int, unsigned int> ( num, style, width, zeroFill );
 }
 
 String String::number (
         long int num, String::IntStyle style,
         int width, bool zeroFill )
 {
-    return doConv ( num, "l", intFormat ( style, 'd' ), width, zeroFill, 0 );
+    return convInt<long int, unsigned long int> ( num, style, width, zeroFill );
 }
 
 String String::number (
         long long int num, String::IntStyle style,
         int width, bool zeroFill )
 {
-    return doConv ( num, "ll", intFormat ( style, 'd' ), width, zeroFill, 0 );
+    return convInt<long long int, unsigned long long int> ( num, style, width, zeroFill );
 }
 
 String String::number (
         unsigned char num, String::IntStyle style,
         int width, bool zeroFill )
 {
-    return doConv ( ( unsigned int ) num, "", intFormat ( style, 'u' ), width, zeroFill, 0 );
+    return convInt<unsigned int, unsigned int> ( num, style, width, zeroFill );
 }
 
 String String::number (
         unsigned short int num, String::IntStyle style,
         int width, bool zeroFill )
 {
-    return doConv ( ( unsigned int ) num, "", intFormat ( style, 'u' ), width, zeroFill, 0 );
+    return convInt<unsigned int, unsigned int> ( num, style, width, zeroFill );
 }
 
 String String::number (
         unsigned int num, String::IntStyle style,
         int width, bool zeroFill )
 {
-    return doConv ( num, "", intFormat ( style, 'u' ), width, zeroFill, 0 );
+    return convInt<unsigned int, unsigned int> ( num, style, width, zeroFill );
 }
 
 String String::number (
         unsigned long int num, String::IntStyle style,
         int width, bool zeroFill )
 {
-    return doConv ( num, "l", intFormat ( style, 'u' ), width, zeroFill, 0 );
+    return convInt<unsigned long int, unsigned long int> ( num, style, width, zeroFill );
 }
 
 String String::number (
         unsigned long long int num, String::IntStyle style,
         int width, bool zeroFill )
 {
-    return doConv ( num, "ll", intFormat ( style, 'u' ), width, zeroFill, 0 );
+    return convInt<unsigned long long int, unsigned long long int> ( num, style, width, zeroFill );
 }
 
 String String::number (
         double num, String::DoubleStyle style,
         int width, bool zeroFill, int precision )
 {
+    String ret;
+
+    if ( convDouble ( num, style, width, zeroFill, precision, ret ) )
+        return ret;
+
     return doConv ( num, "", doubleFormat ( style ), width, zeroFill, precision );
 }
 
@@ -1210,6 +1210,15 @@ class String
         /// @return Reference to this object (for chaining)
         String & replaceArgs ( const StringList & strList );
 
+        /// @brief Replaces occurrences of %1 %2 %3 ... %99 in the string with appropriate values.
+        /// If there are not enough values, argument numbers that cannot be replaced will be decremented
+        /// (by the number of values).
+        /// @warning If there is a third digit after %, the behaviour is undefined.
+        /// @param [in] values Pointers to the replacements.
+        /// @param [in] numValues The number of values. It should be between 1 and 99.
+        /// @return Reference to this object (for chaining)
+        String & replaceArgs ( const String * const * values, int numValues );
+
         /// @brief Returns a copy of this string that has all occurrences of one string replaced with the other one.
         ///
         /// Returns a copy of this string, that has each occurrence of 'what' string
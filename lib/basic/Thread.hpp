@@ -26,6 +26,9 @@
 // and not supported on iOS.
 #define THREAD_LOCAL
 
+// Code that cannot work correctly with THREAD_LOCAL variables being global should check for this:
+#define THREAD_LOCAL_UNSUPPORTED    1
+
 #else
 
 #define THREAD_LOCAL    __thread
@@ -14,10 +14,27 @@
  *  limitations under the License.
  */
 
+#include <cstring>
+
+#include "../Thread.hpp"
 #include "MemPool.hpp"
 
 using namespace Pravala;
 
+// MSVC doesn't like static const integrals defined in implementation files.
+// It doesn't follow C++ spec (9.4.2/4), but there is not much we can do about it...
+#ifndef _MSC_VER
+const size_t MemPool::MaxThreadCaches;
+#endif
+
+#ifndef THREAD_LOCAL_UNSUPPORTED
+/// @brief Set to true when the calling thread uses thread caches.
+static THREAD_LOCAL bool tlCacheEnabled ( false );
+
+/// @brief Thread caches of the calling thread.
+static THREAD_LOCAL MemPoolThreadCache tlCaches[ MemPool::MaxThreadCaches ];
+#endif
+
 MemPool::MemPool ( size_t payloadSize, size_t payloadOffset ):
     PayloadSize ( payloadSize ),
     PayloadOffset ( payloadOffset ),
@@ -25,6 +42,7 @@ MemPool::MemPool ( size_t payloadSize, size_t payloadOffset ):
     _poolHead ( 0 ),
     _freeBlocksCount ( 0 ),
     _allocatedBlocksCount ( 0 ),
+    _threadCacheSize ( 0 ),
     _isShuttingDown ( false )
 {
     assert ( PayloadSize > 0 );
@@ -44,6 +62,18 @@ void MemPool::shutdown()
     {
         _isShuttingDown = true;
 
+        MemPoolThreadCache * const cache = getThreadCache ( false );
+
+        if ( cache != 0 && cache->count > 0 )
+        {
+            _mutex.unlock();
+
+            // This returns blocks cached by this thread to the pool,
+            // and destroys the pool if there are no used blocks left:
+            flushThreadCache ( cache );
+            return;
+        }
+
         if ( _freeBlocksCount >= _allocatedBlocksCount )
         {
             _mutex.unlock();
@@ -58,3 +88,269 @@ void MemPool::shutdown()
 void MemPool::addMoreBlocks()
 {
 }
+
+void MemPool::setThreadCacheSize ( size_t threadCacheSize )
+{
+    _threadCacheSize = threadCacheSize;
+}
+
+size_t MemPool::getThreadCacheHits() const
+{
+    const MemPoolThreadCache * const cache = getThreadCache ( false );
+
+    return ( cache != 0 ) ? cache->hits : 0;
+}
+
+size_t MemPool::getThreadCacheMisses() const
+{
+    const MemPoolThreadCache * const cache = getThreadCache ( false );
+
+    return ( cache != 0 ) ? cache->misses : 0;
+}
+
+void MemPool::enableThreadCache()
+{
+#ifndef THREAD_LOCAL_UNSUPPORTED
+    tlCacheEnabled = true;
+#endif
+}
+
+void MemPool::disableThreadCache()
+{
+#ifndef THREAD_LOCAL_UNSUPPORTED
+    tlCacheEnabled = false;
+
+    for ( size_t i = 0; i < MaxThreadCaches; ++i )
+    {
+        flushThreadCache ( &tlCaches[ i ] );
+    }
+#endif
+}
+
+MemPoolThreadCache * MemPool::getThreadCache ( bool create ) const
+{
+#ifdef THREAD_LOCAL_UNSUPPORTED
+    ( void ) create;
+
+    return 0;
+#else
+    if ( !tlCacheEnabled )
+    {
+        return 0;
+    }
+
+    MemPoolThreadCache * unused = 0;
+
+    for ( size_t i = 0; i < MaxThreadCaches; ++i )
+    {
+        if ( tlCaches[ i ].pool == this )
+        {
+            return &tlCaches[ i ];
+        }
+
+        // We prefer caches that were never used, but we can also reuse a cache of another pool,
+        // as long as it's empty (that pool could have been removed since):
+        if ( create && tlCaches[ i ].count < 1 && ( !unused || !tlCaches[ i ].pool ) )
+        {
+            unused = &tlCaches[ i ];
+        }
+    }
+
+    if ( unused != 0 )
+    {
+        memset ( unused, 0, sizeof ( *unused ) );
+
+        unused->pool = const_cast<MemPool *> ( this );
+    }
+
+    return unused;
+#endif
+}
+
+void MemPool::flushThreadCache ( MemPoolThreadCache * cache )
+{
+    assert ( cache != 0 );
+
+    MemPool * const pool = cache->pool;
+    PoolMemBlock * const head = cache->head;
+    const size_t count = cache->count;
+
+    // We clear the cache first, releasing the blocks could remove the pool:
+    memset ( cache, 0, sizeof ( *cache ) );
+
+    if ( !pool || !head )
+    {
+        return;
+    }
+
+    PoolMemBlock * tail = head;
+
+    while ( tail->u.next != 0 )
+    {
+        tail = tail->u.next;
+    }
+
+    pool->releaseBlocks ( head, tail, count );
+}
+
+void MemPool::releaseBlocks ( PoolMemBlock * head, PoolMemBlock * tail, size_t count )
+{
+    assert ( head != 0 );
+    assert ( tail != 0 );
+    assert ( count > 0 );
+
+    _mutex.lock();
+
+    tail->u.next = _poolHead;
+    _poolHead = head;
+
+    _freeBlocksCount += count;
+
+    if ( _isShuttingDown && _freeBlocksCount >= _allocatedBlocksCount )
+    {
+        _mutex.unlock();
+        delete this;
+        return;
+    }
+
+    _mutex.unlock();
+}
+
+bool MemPool::getCachedBlock ( PoolMemBlock * & block )
+{
+    MemPoolThreadCache * const cache = getThreadCache ( true );
+
+    if ( !cache )
+    {
+        return false;
+    }
+
+    block = 0;
+
+    if ( _isShuttingDown )
+    {
+        // This is not synchronized, but once set, that flag never changes back.
+        // The pool is not generating any blocks anymore, so let's give back everything we have.
+        // This could remove the pool, so we cannot use it afterwards!
+        flushThreadCache ( cache );
+        return true;
+    }
+
+    if ( !cache->head )
+    {
+        assert ( cache->count == 0 );
+
+        ++cache->misses;
+
+        _mutex.lock();
+
+        if ( _isShuttingDown )
+        {
+            _mutex.unlock();
+            return true;
+        }
+
+        if ( !_poolHead )
+        {
+            addMoreBlocks();
+        }
+
+        while ( _poolHead != 0 && cache->count < _threadCacheSize )
+        {
+            PoolMemBlock * const b = _poolHead;
+            _poolHead = b->u.next;
+
+            b->u.next = cache->head;
+            cache->head = b;
+
+            ++cache->count;
+        }
+
+        assert ( _freeBlocksCount >= cache->count );
+
+        _freeBlocksCount -= cache->count;
+
+        _mutex.unlock();
+
+        if ( !cache->head )
+        {
+            // The pool is empty.
+            return true;
+        }
+    }
+    else
+    {
+        ++cache->hits;
+    }
+
+    assert ( cache->count > 0 );
+
+    block = cache->head;
+    cache->head = block->u.next;
+
+    --cache->count;
+
+    assert ( block->getRefCount() > 0 );
+
+    block->u.memPool = this;
+
+    return true;
+}
+
+bool MemPool::releaseCachedBlock ( PoolMemBlock * block )
+{
+    assert ( block != 0 );
+
+    MemPoolThreadCache * const cache = getThreadCache ( true );
+
+    if ( !cache )
+    {
+        return false;
+    }
+
+    block->u.next = cache->head;
+    cache->head = block;
+
+    ++cache->count;
+
+    if ( _isShuttingDown )
+    {
+        // This could remove the pool, so we cannot use it afterwards!
+        flushThreadCache ( cache );
+        return true;
+    }
+
+    if ( cache->count < 2 * _threadCacheSize )
+    {
+        return true;
+    }
+
+    // The cache is too big. We keep the most recently released blocks (they are more likely to still be
+    // in CPU caches) and return the rest of them to the shared list, all at once.
+
+    PoolMemBlock * last = cache->head;
+
+    for ( size_t i = 1; i < _threadCacheSize; ++i )
+    {
+        last = last->u.next;
+    }
+
+    PoolMemBlock * const head = last->u.next;
+    PoolMemBlock * tail = head;
+
+    last->u.next = 0;
+
+    assert ( head != 0 );
+
+    while ( tail->u.next != 0 )
+    {
+        tail = tail->u.next;
+    }
+
+    const size_t count = cache->count - _threadCacheSize;
+
+    cache->count = _threadCacheSize;
+
+    releaseBlocks ( head, tail, count );
+    return true;
+}
@@ -30,6 +30,19 @@ extern "C"
 
 namespace Pravala
 {
+class MemPool;
+
+/// @brief A per-thread cache of free blocks ("magazine") that belong to a single memory pool.
+/// Each thread that enables thread caches has a small, fixed number of those.
+struct MemPoolThreadCache
+{
+    MemPool * pool; ///< The pool whose blocks are cached. 0 if this cache is not used.
+    PoolMemBlock * head; ///< The first cached block. Other blocks are linked using 'u.next'.
+    size_t count; ///< The number of cached blocks.
+    size_t hits; ///< The number of blocks served from the cache.
+    size_t misses; ///< The number of times the cache was empty and had to be refilled from the pool.
+};
+
 /// @brief Base class for memory pools.
 class MemPool
 {
@@ -37,6 +50,9 @@ class MemPool
         /// @brief The default payload offset used by the MemPool.
         static const size_t DefaultPayloadOffset = sizeof ( PoolMemBlock );
 
+        /// @brief The max number of different pools that can be cached by a single thread.
+        static const size_t MaxThreadCaches = 4;
+
         /// @brief The size (in bytes) of payload in each block that is a part of this pool.
         /// @note This does NOT include the block header.
         const size_t PayloadSize;
@@ -61,6 +77,43 @@ class MemPool
             return _allocatedBlocksCount;
         }
 
+        /// @brief Returns the number of blocks moved between per-thread caches and the shared list at once.
+        /// @return The thread cache batch size; 0 if thread caches are not used by this pool.
+        inline size_t getThreadCacheSize() const
+        {
+            return _threadCacheSize;
+        }
+
+        /// @brief Configures the use of per-thread caches by this pool.
+        /// When enabled, threads that called enableThreadCache() get and release blocks using their local cache
+        /// (without locking), and only access the shared list of free blocks (moving threadCacheSize blocks at a time)
+        /// when their cache runs empty, or when it holds twice as many blocks as configured.
+        /// @warning This should be called right after the pool is created, before it is used by any thread.
+        /// @note Blocks stored in thread caches are NOT included in the free blocks count.
+        /// @param [in] threadCacheSize The number of blocks to move between the cache and the pool at once.
+        ///                             0 disables thread caches for this pool.
+        void setThreadCacheSize ( size_t threadCacheSize );
+
+        /// @brief Returns the number of blocks that were served from the calling thread's cache of this pool.
+        /// @return The number of thread cache hits in the calling thread.
+        size_t getThreadCacheHits() const;
+
+        /// @brief Returns the number of times the calling thread's cache of this pool had to be refilled.
+        /// @return The number of thread cache misses in the calling thread.
+        size_t getThreadCacheMisses() const;
+
+        /// @brief Enables per-thread caches in the calling thread.
+        /// It only affects pools that have thread caches configured (see setThreadCacheSize()).
+        /// @warning Each thread that enables its cache MUST call disableThreadCache() before it exits.
+        ///          Otherwise the blocks stored in its cache will leak.
+        /// @note Thread caches are not supported on all platforms. There this function doesn't do anything.
+        static void enableThreadCache();
+
+        /// @brief Disables per-thread caches in the calling thread.
+        /// All blocks cached by the calling thread are returned to their pools,
+        /// and the thread's hit/miss counters are cleared.
+        static void disableThreadCache();
+
     protected:
 
         Mutex _mutex; ///< Mutex protecting this memory pool.
@@ -75,6 +128,10 @@ class MemPool
         /// @brief The number of allocated blocks.
         size_t _allocatedBlocksCount;
 
+        /// @brief The number of blocks moved between per-thread caches and the shared list at once.
+        /// 0 if thread caches are not used by this pool.
+        size_t _threadCacheSize;
+
         /// @brief Set to 'true' when the memory pool is shutting down.
         /// This will cause it to be destroyed when the 'free' count reaches 'allocated' count.
         bool _isShuttingDown;
@@ -104,6 +161,13 @@ class MemPool
         ///         Returned block will have a reference counter set to 1.
         inline PoolMemBlock * getBlock()
         {
+            PoolMemBlock * block = 0;
+
+            if ( _threadCacheSize > 0 && getCachedBlock ( block ) )
+            {
+                return block;
+            }
+
             _mutex.lock();
 
             if ( _isShuttingDown )
@@ -125,7 +189,7 @@ class MemPool
 
             assert ( _poolHead != 0 );
 
-            PoolMemBlock * const block = _poolHead;
+            block = _poolHead;
             _poolHead = block->u.next;
 
             assert ( _freeBlocksCount > 0 );
@@ -164,6 +228,11 @@ class MemPool
                 return;
             }
 
+            if ( _threadCacheSize > 0 && releaseCachedBlock ( block ) )
+            {
+                return;
+            }
+
             _mutex.lock();
 
             block->u.next = _poolHead;
@@ -187,6 +256,39 @@ class MemPool
         ///          be locked after it returns, but it may be unlocked and re-locked inside.
         virtual void addMoreBlocks();
 
+    private:
+        /// @brief Gets a memory block using the calling thread's cache.
+        /// @param [out] block Memory block to use, or 0 if the pool is empty.
+        ///                    Returned block will have a reference counter set to 1.
+        /// @return True if the calling thread uses a cache of this pool (and 'block' was set);
+        ///         False if the block should be taken directly from the shared list instead.
+        bool getCachedBlock ( PoolMemBlock * & block );
+
+        /// @brief Returns given block to the calling thread's cache.
+        /// @note This could destroy the pool (if it's shutting down and the block released was the last used one).
+        /// @param [in] block The block to release. It must be valid, belong to this pool and have a single reference.
+        /// @return True if the block was taken care of;
+        ///         False if the calling thread doesn't use caches and the block should be returned to the shared list.
+        bool releaseCachedBlock ( PoolMemBlock * block );
+
+        /// @brief Moves a list of blocks to the shared list of free blocks.
+        /// @note This could destroy the pool (if it's shutting down and there are no more used blocks).
+        /// @param [in] head The first block of the list.
+        /// @param [in] tail The last block of the list.
+        /// @param [in] count The number of blocks in the list.
+        void releaseBlocks ( PoolMemBlock * head, PoolMemBlock * tail, size_t count );
+
+        /// @brief Returns the calling thread's cache of this pool.
+        /// @param [in] create If true and the thread doesn't have a cache of this pool yet,
+        ///                    an unused thread cache will be assigned to this pool (if there is one).
+        /// @return The calling thread's cache of this pool, or 0 if it is not available.
+        MemPoolThreadCache * getThreadCache ( bool create ) const;
+
+        /// @brief Returns all blocks stored in given thread cache to their pool, and clears the cache.
+        /// @note This could destroy the pool the blocks belong to.
+        /// @param [in] cache The cache to flush.
+        static void flushThreadCache ( MemPoolThreadCache * cache );
+
         friend struct MemBlock;
         friend struct MemData;
 };
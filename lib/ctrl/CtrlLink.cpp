@@ -27,6 +27,7 @@ extern "C"
 #endif
 }
 
+#include "basic/AutoPtr.hpp"
 #include "config/ConfigCore.hpp"
 #include "log/LogManager.hpp"
 #include "log/Diagnostics.hpp"
@@ -55,6 +56,40 @@ using namespace Pravala;
 
 TextLog CtrlLink::_log ( "ctrl_link" );
 
+ConfigLimitedNumber<uint16_t> CtrlLink::optMaxWriteBatch (
+        0,
+        "ctrl.link.max_write_batch",
+        "The max number of queued packets written to a control link using a single write operation",
+        1, 256, 64
+);
+
+ConfigLimitedNumber<uint32_t> CtrlLink::optMaxLogQueueSize (
+        0,
+        "ctrl.link.max_log_queue_size",
+        "The max amount of data (in kilobytes) queued on a control link, above which log messages are no longer "
+        "queued (see ctrl.link.log_overflow_disconnect); 0 means no limit",
+        0, 1024 * 1024, 4096
+);
+
+ConfigNumber<bool> CtrlLink::optLogOverflowDisconnect (
+        0,
+        "ctrl.link.log_overflow_disconnect",
+        "Set to true to close control links whose write queue is too long to accept log messages; "
+        "By default those log messages are dropped",
+        false
+);
+
+CtrlLink::WriteStats::WriteStats()
+{
+    clear();
+}
+
+void CtrlLink::WriteStats::clear()
+{
+    writeCalls = writtenPackets = writtenBytes = droppedLogMessages = droppedLogBytes = 0;
+    peakQueueBytes = 0;
+}
+
 CtrlLink::Owner::~Owner()
 {
     // The Iterator will create a copy and iterate over it.
@@ -138,7 +173,14 @@ ERRCODE CtrlLink::Owner::ctrlSubscriptionResponseReceived (
 }
 
 CtrlLink::CtrlLink ( CtrlLink::Owner & owner, int linkId ):
-    LinkId ( linkId ), _linkFd ( -1 ), _owner ( owner ), _fdCleanupTimer ( *this ), _localPort ( 0 ), _remotePort ( 0 )
+    LinkId ( linkId ),
+    _linkFd ( -1 ),
+    _owner ( owner ),
+    _fdCleanupTimer ( *this ),
+    _queuedBytes ( 0 ),
+    _localPort ( 0 ),
+    _remotePort ( 0 ),
+    _closeAtLoopEnd ( false )
 {
 }
 
@@ -289,6 +331,13 @@ void CtrlLink::sendData ( Ctrl::Message & packet, MemHandle & data, bool atLoopE
         return;
     }
 
+    _queuedBytes += data.size();
+
+    if ( _queuedBytes > _writeStats.peakQueueBytes )
+    {
+        _writeStats.peakQueueBytes = _queuedBytes;
+    }
+
     if ( atLoopEnd )
     {
         _loopEndWriteQueue.append ( data );
@@ -338,6 +387,21 @@ void CtrlLink::linkClosed()
 
 void CtrlLink::receiveLoopEndEvent()
 {
+    if ( _closeAtLoopEnd )
+    {
+        _closeAtLoopEnd = false;
+
+        if ( _linkFd >= 0 )
+        {
+            LOG ( L_ERROR, "Closing control link with ID " << LinkId << "; Its write queue is too long ("
+                  << _queuedBytes << " bytes) to accept log messages" );
+
+            // No operations after this!
+            linkClosed();
+            return;
+        }
+    }
+
     if ( _linkFd < 0 )
     {
         LOG ( L_ERROR, "CtrlLink with ID " << LinkId
@@ -400,20 +464,19 @@ void CtrlLink::receiveFdEvent ( int fd, short int events )
             return;
         }
 
-        MemHandle packet = _writeQueue.first();
-
-        LOG ( L_DEBUG3, "Writing the first packet from the queue; Data size: " << packet.size()
-              << "; Current queue size: " << _writeQueue.size() );
-
-        _writeQueue.removeFirst();
+        bool nonFatal = false;
+        const ssize_t ret = osInternalWrite ( nonFatal );
 
-        const ssize_t ret = send ( _linkFd, packet.get(), packet.size(), 0 );
+        ++_writeStats.writeCalls;
 
-        LOG ( L_DEBUG4, "Writing " << packet.size() << " bytes over link with FD " << _linkFd
-              << "; Wrote (result): " << ret << "; New queue size: " << _writeQueue.size() );
+        LOG ( L_DEBUG4, "Writing up to " << optMaxWriteBatch.value() << " packets over link with FD " << _linkFd
+              << "; Wrote (result): " << ret << "; Queue size: " << _writeQueue.size() );
 
         if ( ret < 0 )
         {
+            if ( nonFatal )
+                return;
+
 #ifdef SYSTEM_WINDOWS
             LOG ( L_ERROR, "Error writing to control link: ["
                   << WSAGetLastError() << "]; Closing the link" );
@@ -427,14 +490,39 @@ void CtrlLink::receiveFdEvent ( int fd, short int events )
             return;
         }
 
-        if ( ( size_t ) ret < packet.size() )
+        consumeWriteQueue ( ret );
+    }
+}
+
+void CtrlLink::consumeWriteQueue ( size_t size )
+{
+    assert ( size <= _queuedBytes );
+
+    _writeStats.writtenBytes += size;
+    _queuedBytes -= size;
+
+    while ( size > 0 && !_writeQueue.isEmpty() )
+    {
+        const MemHandle & packet = _writeQueue.first();
+
+        if ( size < packet.size() )
         {
-            MemHandle remData = packet.getHandle ( ret );
+            MemHandle remData = packet.getHandle ( size );
+
+            _writeQueue.removeFirst();
             _writeQueue.prepend ( remData );
 
             LOG ( L_DEBUG4, "Not all data written. Reinserting a packet with " << remData.size()
                   << " bytes into the queue; New queue size: " << _writeQueue.size() );
+
+            return;
         }
+
+        size -= packet.size();
+
+        _writeQueue.removeFirst();
+
+        ++_writeStats.writtenPackets;
     }
 }
 
@@ -527,10 +615,19 @@ bool CtrlLink::internalRead()
 
         LOG ( L_DEBUG4, "Trying to deserialize " << dataToRead.size() << " bytes" );
 
-        Ctrl::Message msgData;
+        // This only decodes the fields used for selecting the message type (skipping everything else),
+        // and then deserializes the data once, as the most specific message type that matches it (if there is one).
+        // Messages of other types are deserialized into baseMsg.
+        // Handlers that deserialize that object again (as the same, or less specific type) simply copy it,
+        // and getFromBase() of that type doesn't even copy it.
+        Ctrl::Message baseMsg;
+        Ctrl::Message * specificPtr = 0;
 
         extError.clear();
-        eCode = msgData.deserializeWithLength ( dataToRead, offset, 0, &extError );
+        eCode = Ctrl::Message::TypeRegistry::deserializeWithLength (
+            dataToRead, offset, baseMsg, specificPtr, 0, &extError );
+
+        AutoPtr<Ctrl::Message> specificMsg ( specificPtr );
 
         if ( NOT_OK ( eCode ) )
         {
@@ -553,6 +650,8 @@ bool CtrlLink::internalRead()
             return true;
         }
 
+        Ctrl::Message & msgData = ( specificMsg.get() != 0 ) ? *specificMsg : baseMsg;
+
         if ( !msgData.hasType() )
         {
             // This should not happen, as 'type' is marked as required.
@@ -570,11 +669,15 @@ bool CtrlLink::internalRead()
         if ( msgData.getIsSubRequest() )
         {
             extError.clear();
-            Ctrl::SubscriptionRequest subReq;
+            Ctrl::SubscriptionRequest tmpSubReq;
+            ProtoError protoErr;
 
-            ret = subReq.deserialize ( msgData, &extError );
+            const Ctrl::SubscriptionRequest * const subReq
+                = Ctrl::SubscriptionRequest::getFromBase ( msgData, tmpSubReq, protoErr, &extError );
 
-            if ( NOT_OK ( ret ) )
+            ret = protoErr;
+
+            if ( !subReq )
             {
                 LOG_ERR ( L_ERROR, eCode, "Error deserializing message (type " << msgData.getType()
                           << ") as a SubscriptionRequest: '" << extError.toString() << "'" );
@@ -585,7 +688,7 @@ bool CtrlLink::internalRead()
 
                 if ( _owner._subHandlers.find ( msgData.getType(), handler ) && handler != 0 )
                 {
-                    ret = handler->ctrlProcessSubRequest ( this, subReq );
+                    ret = handler->ctrlProcessSubRequest ( this, *subReq );
 
                     LOG_ERR ( L_DEBUG2, ret, "Called processSubRequest in CtrlSubHandler for a message type "
                               << msgData.getType() );
@@ -596,7 +699,7 @@ bool CtrlLink::internalRead()
                           << "), but no CtrlSubHandler is registered for this type; "
                           "Calling generic ctrlPacketReceived() instead" );
 
-                    ret = _owner.ctrlPacketReceived ( LinkId, subReq, _readFds );
+                    ret = _owner.ctrlPacketReceived ( LinkId, msgData, _readFds );
 
                     LOG_ERR ( L_DEBUG2, ret, "Called owner's ctrlPacketReceived() with a "
                               << msgData.getType() << " message" );
@@ -751,10 +854,14 @@ ERRCODE CtrlLink::sendPing ( const String & payload )
 
 void CtrlLink::sendBinLog ( Log::LogMessage & logMessage )
 {
+    if ( _linkFd < 0 || _closeAtLoopEnd )
+        return;
+
     Ctrl::LogMessage ctrlMsg;
     ctrlMsg.setLogMessage ( logMessage );
 
-    ERRCODE eCode = sendPacket ( ctrlMsg );
+    MemHandle mem;
+    ERRCODE eCode = serializePacket ( ctrlMsg, mem );
 
     if ( NOT_OK ( eCode ) )
     {
@@ -762,9 +869,30 @@ void CtrlLink::sendBinLog ( Log::LogMessage & logMessage )
                   << logMessage.getType().toString() << ")" );
         return;
     }
+
+    if ( optMaxLogQueueSize.value() > 0
+         && _queuedBytes + mem.size() > ( size_t ) optMaxLogQueueSize.value() * 1024 )
+    {
+        // We are inside of the logging code, so we can't close the link right away.
+
+        if ( optLogOverflowDisconnect.value() )
+        {
+            _closeAtLoopEnd = true;
+            EventManager::loopEndSubscribe ( this );
+        }
+        else
+        {
+            ++_writeStats.droppedLogMessages;
+            _writeStats.droppedLogBytes += mem.size();
+        }
+
+        return;
+    }
+
+    sendData ( ctrlMsg, mem );
 }
 
-ERRCODE CtrlLink::processBuiltInMessage ( const Ctrl::Message & msg, List<int> & receivedFds )
+ERRCODE CtrlLink::processBuiltInMessage ( Ctrl::Message & msg, List<int> & receivedFds )
 {
     if ( !msg.hasType() )
         return Error::InvalidParameter;
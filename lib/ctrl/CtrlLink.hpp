@@ -23,6 +23,8 @@
 
 #include "proto/ExtProtoError.hpp"
 
+#include "config/ConfigNumber.hpp"
+
 #include "event/Timer.hpp"
 #include "log/TextLog.hpp"
 #include "event/EventManager.hpp"
@@ -38,20 +40,23 @@
 /// case Ctrl::SetupSsl::DEF_TYPE:
 ///   {
 ///     ExtProtoError eErr;
+///     ProtoError tmpProtoErr;
 ///     Ctrl::SetupSsl tmpMsg;
 ///
-///     ERRCODE tmpErrCode = tmpMsg.deserialize ( msg, &eErr );
+///     Ctrl::SetupSsl * const tmpMsgPtr = Ctrl::SetupSsl::getFromBase ( msg, tmpMsg, tmpProtoErr, &eErr );
+///
+///     ERRCODE tmpErrCode = tmpProtoErr;
 ///
 ///     LOG_ERR (L_DEBUG2, tmpErrCode, "Received Ctrl::SetupSsl packet. Trying to deserialize");
 ///
-///     if ( NOT_OK ( tmpErrCode) )
+///     if ( !tmpMsgPtr )
 ///     {
 ///         LOG_ERR (L_ERROR, tmpErrCode, "Received Ctrl::SetupSsl packet. Deserializing FAILED: '"
 ///                  << EXT_ERROR_DESC ( eErr ) << "'" );
 ///         return tmpErrCode;
 ///     }
 ///
-///     tmpErrCode = handleCtrlMessage ( linkId, tmpMsg );
+///     tmpErrCode = handleCtrlMessage ( linkId, *tmpMsgPtr );
 ///
 ///     LOG_ERR (IS_OK(tmpErrCode)||tmpErrCode==Error::ResponseSent)?L_DEBUG2:L_ERROR, tmpErrCode,
 ///              "Called handleCtrlMessage ( Ctrl::SetupSsl ) method" );
@@ -62,18 +67,24 @@
 ///
 /// This way we have WAY less to write!
 ///
+/// If 'msg' already is a Ctrl::SetupSsl object (CtrlLink creates messages of known types as the most specific
+/// type, see Ctrl::Message::TypeRegistry), it is passed to the handler as it is, without copying or parsing it.
+/// Otherwise it is deserialized as Ctrl::SetupSsl first.
+///
 /// Note that it uses the SAME argument names as the ctrlPacketReceived() callback: linkId and msg
 ///
 #define CASE_CTRL_MSG_TYPE( msg_type )  \
     case Ctrl::msg_type::DEF_TYPE: \
         { \
-            ExtProtoError eErr; Ctrl::msg_type tmpMsg; ERRCODE tmpErrCode = tmpMsg.deserialize ( msg, &eErr ); \
+            ExtProtoError eErr; ProtoError tmpProtoErr; Ctrl::msg_type tmpMsg; \
+            Ctrl::msg_type * const tmpMsgPtr = Ctrl::msg_type::getFromBase ( msg, tmpMsg, tmpProtoErr, &eErr ); \
+            ERRCODE tmpErrCode = tmpProtoErr; \
             LOG_ERR ( L_DEBUG2, tmpErrCode, "Received Ctrl::" #msg_type " packet. Trying to deserialize" ); \
-            if ( NOT_OK ( tmpErrCode ) ) { \
+            if ( !tmpMsgPtr ) { \
                 LOG_ERR ( L_ERROR, tmpErrCode, "Received Ctrl::" #msg_type " packet. Deserializing FAILED: '" \
                           << eErr.toString() << "'" ); \
                 return tmpErrCode; } \
-            tmpErrCode = handleCtrlMessage ( linkId, tmpMsg ); \
+            tmpErrCode = handleCtrlMessage ( linkId, *tmpMsgPtr ); \
             LOG_ERR ( ( IS_OK ( tmpErrCode ) \
                         || tmpErrCode == Error::ResponseSent \
                         || tmpErrCode == Error::ResponsePending \
@@ -87,14 +98,16 @@
 #define CASE_CTRL_MSG_TYPE_FDS( msg_type )  \
     case Ctrl::msg_type::DEF_TYPE: \
         { \
-            ExtProtoError eErr; Ctrl::msg_type tmpMsg; ERRCODE tmpErrCode = tmpMsg.deserialize ( msg, &eErr ); \
+            ExtProtoError eErr; ProtoError tmpProtoErr; Ctrl::msg_type tmpMsg; \
+            Ctrl::msg_type * const tmpMsgPtr = Ctrl::msg_type::getFromBase ( msg, tmpMsg, tmpProtoErr, &eErr ); \
+            ERRCODE tmpErrCode = tmpProtoErr; \
             LOG_ERR ( L_DEBUG2, tmpErrCode, "Received Ctrl::" #msg_type " packet (and " \
                       << receivedFds.size() << " FDs). Trying to deserialize" ); \
-            if ( NOT_OK ( tmpErrCode ) ) { \
+            if ( !tmpMsgPtr ) { \
                 LOG_ERR ( L_ERROR, tmpErrCode, "Received Ctrl::" #msg_type " packet. Deserializing FAILED: '" \
                           << eErr.toString() << "'" ); \
                 return tmpErrCode; } \
-            tmpErrCode = handleCtrlMessage ( linkId, tmpMsg, receivedFds ); \
+            tmpErrCode = handleCtrlMessage ( linkId, *tmpMsgPtr, receivedFds ); \
             LOG_ERR ( ( IS_OK ( tmpErrCode ) \
                         || tmpErrCode == Error::ResponseSent \
                         || tmpErrCode == Error::ResponsePending \
@@ -134,7 +147,10 @@ class CtrlLink:
             protected:
                 /// @brief Callback for notifying the owner on incoming control packets
                 /// @param [in] linkId The ID of the link that generated the callback
-                /// @param [in] msg The base control message received
+                /// @param [in] msg The base control message received. If the message type is known
+                ///                  (see Ctrl::Message::TypeRegistry), it is an object of the most specific type,
+                ///                  so it can be accessed using castTo() or getFromBase() of that type
+                ///                  (which is what CASE_CTRL_MSG_TYPE uses), without parsing it again.
                 /// @param [in] receivedFds The list of file descriptors received. If the owner "consumes" the
                 ///                          descriptor in some way, it should remove it from the list, or set to -1.
                 ///                          Otherwise it will be automatically closed after this callback.
@@ -201,6 +217,32 @@ class CtrlLink:
                 friend class CtrlSubHandler;
         };
 
+        /// @brief Write queue counters.
+        struct WriteStats
+        {
+            uint64_t writeCalls; ///< The number of write operations performed.
+            uint64_t writtenPackets; ///< The number of packets that have been written completely.
+            uint64_t writtenBytes; ///< The number of bytes written.
+            uint64_t droppedLogMessages; ///< The number of log messages dropped because the queue was too long.
+            uint64_t droppedLogBytes; ///< The number of bytes in log messages dropped.
+            size_t peakQueueBytes; ///< The highest number of bytes queued at the same time.
+
+            /// @brief Default constructor.
+            WriteStats();
+
+            /// @brief Clears all the counters.
+            void clear();
+        };
+
+        /// @brief The max number of queued packets written using a single write operation.
+        static ConfigLimitedNumber<uint16_t> optMaxWriteBatch;
+
+        /// @brief The max amount of queued data (in kilobytes) above which log messages are no longer queued.
+        static ConfigLimitedNumber<uint32_t> optMaxLogQueueSize;
+
+        /// @brief Whether the link should be closed (instead of dropping log messages) when the log queue limit is hit.
+        static ConfigNumber<bool> optLogOverflowDisconnect;
+
         const int LinkId; ///< The ID of the link
 
         /// @brief Constructor
@@ -259,6 +301,27 @@ class CtrlLink:
             return _localSockName;
         }
 
+        /// @brief Returns the number of packets waiting to be written (including partially written ones).
+        /// @return The number of packets waiting to be written.
+        inline size_t getWriteQueueSize() const
+        {
+            return _writeQueue.size() + _loopEndWriteQueue.size();
+        }
+
+        /// @brief Returns the number of bytes waiting to be written.
+        /// @return The number of bytes waiting to be written.
+        inline size_t getWriteQueueBytes() const
+        {
+            return _queuedBytes;
+        }
+
+        /// @brief Returns write queue counters.
+        /// @return Write queue counters.
+        inline const WriteStats & getWriteStats() const
+        {
+            return _writeStats;
+        }
+
         /// @brief Returns the internal file descriptor and unsets it in the link object.
         /// After this it is caller's responsibility to close that descriptor.
         /// It will also remove this link from all control subscription handlers
@@ -360,6 +423,9 @@ class CtrlLink:
         Buffer _readBuffer; ///< The data that has been read, but not yet consumed
         List<int> _readFds; ///< The FDs read so far
 
+        WriteStats _writeStats; ///< Write queue counters.
+        size_t _queuedBytes; ///< The number of bytes in both write queues.
+
         IpAddress _localAddr; ///< Local address of the underlying TCP connection, or invalid if it's a local socket.
         IpAddress _remoteAddr; ///< Remote address of the underlying TCP connection, or invalid if it's a local socket.
 
@@ -368,6 +434,10 @@ class CtrlLink:
         uint16_t _localPort; ///< Local port number of the underlying TCP connection, or 0 if it's a local socket.
         uint16_t _remotePort; ///< Remote port number of the underlying TCP connection, or 0 if it's a local socket.
 
+        /// @brief Set when the link should be closed at the end of the event loop.
+        /// Used when the log queue limit is hit, since the link cannot be closed from inside of the logging code.
+        bool _closeAtLoopEnd;
+
         virtual void timerExpired ( Timer * timer );
         virtual void receiveFdEvent ( int fd, short int events );
         virtual void receiveLoopEndEvent();
@@ -387,6 +457,17 @@ class CtrlLink:
         /// @return Returns the number of bytes read.
         ssize_t osInternalRead ( int & rcvdFds, bool & nonFatal );
 
+        /// @brief Performs the OS-specific write operations
+        /// It writes (at most optMaxWriteBatch) packets from the beginning of the write queue,
+        /// but it does not modify the queue.
+        /// @param [out] nonFatal Set to true if despite returning < 0 it is not an error (write would block)
+        /// @return Returns the number of bytes written.
+        ssize_t osInternalWrite ( bool & nonFatal );
+
+        /// @brief Removes data that has been written from the write queue
+        /// @param [in] size The number of bytes written.
+        void consumeWriteQueue ( size_t size );
+
         /// @brief Adds data to internal list of packets to write to the specific client
         ///
         /// @param [in] packet The original packet that was serialized to 'data'. Not actually
@@ -407,7 +488,7 @@ class CtrlLink:
         /// @param [in] msg Ctrl message to process
         /// @param [in] receivedFds The list of file descriptors received with the message
         /// @return Standard error code
-        ERRCODE processBuiltInMessage ( const Ctrl::Message & msg, List<int> & receivedFds );
+        ERRCODE processBuiltInMessage ( Ctrl::Message & msg, List<int> & receivedFds );
 
         /// @brief Processes a 'Ping' message
         ///
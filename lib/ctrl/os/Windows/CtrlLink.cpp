@@ -23,6 +23,7 @@ extern "C"
 #include "../../CtrlLink.hpp"
 
 #define MAX_RCV_DATA    2048
+#define MAX_SND_BUFS    256
 
 using namespace Pravala;
 
@@ -44,3 +45,39 @@ ssize_t CtrlLink::osInternalRead ( int & rcvdFds, bool & nonFatal )
 
     return readRet;
 }
+
+ssize_t CtrlLink::osInternalWrite ( bool & nonFatal )
+{
+    nonFatal = false;
+
+    WSABUF bufs[ MAX_SND_BUFS ];
+
+    const List<MemHandle> & queue = _writeQueue;
+    size_t numBufs = queue.size();
+
+    if ( numBufs > optMaxWriteBatch.value() )
+        numBufs = optMaxWriteBatch.value();
+
+    if ( numBufs > MAX_SND_BUFS )
+        numBufs = MAX_SND_BUFS;
+
+    for ( size_t i = 0; i < numBufs; ++i )
+    {
+        bufs[ i ].buf = const_cast<char *> ( queue[ i ].get() );
+        bufs[ i ].len = ( ULONG ) queue[ i ].size();
+    }
+
+    DWORD written = 0;
+
+    if ( WSASend ( _linkFd, bufs, ( DWORD ) numBufs, &written, 0, 0, 0 ) != 0 )
+    {
+        const int err = WSAGetLastError();
+
+        // Not really an error, we just can't write at this time...
+        nonFatal = ( err == WSAEWOULDBLOCK || err == WSAEINTR );
+
+        return -1;
+    }
+
+    return ( ssize_t ) written;
+}
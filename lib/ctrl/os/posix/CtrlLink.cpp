@@ -26,6 +26,7 @@ extern "C"
 
 #define MAX_RCV_DATA       2048
 #define MAX_RCV_CONTROL    1024
+#define MAX_SND_IOVS       256
 
 using namespace Pravala;
 
@@ -104,3 +105,41 @@ ssize_t CtrlLink::osInternalRead ( int & rcvdFds, bool & nonFatal )
 
     return readRet;
 }
+
+ssize_t CtrlLink::osInternalWrite ( bool & nonFatal )
+{
+    nonFatal = false;
+
+    struct iovec iov[ MAX_SND_IOVS ];
+
+    const List<MemHandle> & queue = _writeQueue;
+    size_t numIov = queue.size();
+
+    if ( numIov > optMaxWriteBatch.value() )
+        numIov = optMaxWriteBatch.value();
+
+    if ( numIov > MAX_SND_IOVS )
+        numIov = MAX_SND_IOVS;
+
+    for ( size_t i = 0; i < numIov; ++i )
+    {
+        iov[ i ].iov_base = const_cast<char *> ( queue[ i ].get() );
+        iov[ i ].iov_len = queue[ i ].size();
+    }
+
+    struct msghdr msg;
+    memset ( &msg, 0, sizeof ( msg ) );
+
+    msg.msg_iov = iov;
+    msg.msg_iovlen = numIov;
+
+    const ssize_t writeRet = sendmsg ( _linkFd, &msg, 0 );
+
+    if ( writeRet < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ) )
+    {
+        // Not really an error, we just can't write at this time...
+        nonFatal = true;
+    }
+
+    return writeRet;
+}
@@ -19,7 +19,17 @@
 
 extern "C"
 {
+#if defined( SYSTEM_WINDOWS ) && defined( _MSC_VER )
+// We need winsock2 before windows.h, otherwise some things are defined wrong.
+#include <winsock2.h>
+#include <windows.h>
+#endif
+
 #include <unistd.h>
+
+#ifdef SYSTEM_LINUX
+#include <sys/eventfd.h>
+#endif
 }
 
 // This should be before including SimpleLog.h
@@ -39,7 +49,52 @@ extern "C"
 
 using namespace Pravala;
 
-AsyncQueue::Task::Task ( NoCopy * receiver ): _receiver ( receiver )
+// MSVC doesn't like static const integrals defined in implementation files.
+// It doesn't follow C++ spec (9.4.2/4), but there is not much we can do about it...
+#ifndef _MSC_VER
+const uint32_t AsyncQueue::MaxQueuedTasks;
+#endif
+
+/// @brief Atomically replaces the value of the task pointer, if it still has the expected value.
+/// @param [in] ptr The pointer to modify.
+/// @param [in] oldVal The value the pointer is expected to have.
+/// @param [in] newVal The value to set.
+/// @return True if the pointer was modified; False if its value was different than oldVal.
+static inline bool casTask ( AsyncQueue::Task * volatile * ptr, AsyncQueue::Task * oldVal, AsyncQueue::Task * newVal )
+{
+#if defined( SYSTEM_WINDOWS ) && defined( _MSC_VER )
+    return ( InterlockedCompareExchangePointer ( ( PVOID volatile * ) ptr, newVal, oldVal ) == oldVal );
+#else
+    return __sync_bool_compare_and_swap ( ptr, oldVal, newVal );
+#endif
+}
+
+/// @brief Atomically adds a value to the counter.
+/// @param [in] counter The counter to modify.
+/// @param [in] value The value to add.
+/// @return The new value of the counter.
+static inline uint32_t addToCounter ( volatile uint32_t * counter, uint32_t value )
+{
+#if defined( SYSTEM_WINDOWS ) && defined( _MSC_VER )
+    return ( uint32_t ) InterlockedExchangeAdd ( ( volatile LONG * ) counter, ( LONG ) value ) + value;
+#else
+    return __sync_add_and_fetch ( counter, value );
+#endif
+}
+
+/// @brief Atomically subtracts a value from the counter.
+/// @param [in] counter The counter to modify.
+/// @param [in] value The value to subtract.
+static inline void subFromCounter ( volatile uint32_t * counter, uint32_t value )
+{
+#if defined( SYSTEM_WINDOWS ) && defined( _MSC_VER )
+    InterlockedExchangeAdd ( ( volatile LONG * ) counter, -( LONG ) value );
+#else
+    __sync_sub_and_fetch ( counter, value );
+#endif
+}
+
+AsyncQueue::Task::Task ( NoCopy * receiver ): _receiver ( receiver ), _next ( 0 )
 {
 }
 
@@ -60,22 +115,56 @@ void AsyncQueue::Task::deleteOnError ( DeletePolicy deletePolicy )
     }
 }
 
+/// @brief The global AsyncQueue. It is created by the first get() call, and never destroyed.
+/// It is only modified by the main thread, but it can be read by other threads (see getIfInitialized()).
+static AsyncQueue * volatile globalQueue = 0;
+
 AsyncQueue & AsyncQueue::get()
 {
-    static AsyncQueue * global = 0;
-
-    if ( !global )
+    if ( !globalQueue )
     {
-        global = new AsyncQueue();
+        AsyncQueue * const queue = new AsyncQueue();
+
+        // The queue needs to be fully initialized before other threads can see it.
+#if defined( SYSTEM_WINDOWS ) && defined( _MSC_VER )
+        MemoryBarrier();
+#else
+        __sync_synchronize();
+#endif
+
+        globalQueue = queue;
     }
 
-    return *global;
+    return *globalQueue;
 }
 
-AsyncQueue::AsyncQueue(): _mutex ( "AsyncQueue" ), _offset ( 0 ), _isBroken ( false )
+AsyncQueue * AsyncQueue::getIfInitialized()
+{
+    return globalQueue;
+}
+
+AsyncQueue::AsyncQueue():
+    _mutex ( "AsyncQueue" ),
+#ifdef SYSTEM_LINUX
+    _eventFd ( -1 ),
+#endif
+    _tasks ( 0 ),
+    _queuedTasks ( 0 ),
+    _isBroken ( false )
 {
     assert ( EventManager::isInitialized() );
 
+#ifdef SYSTEM_LINUX
+    _eventFd = eventfd ( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+
+    if ( _eventFd < 0 )
+    {
+        SIMPLE_LOG_DEBUG ( "Error creating the eventfd: %s [%d]", strerror ( errno ), errno );
+        return;
+    }
+
+    EventManager::setFdHandler ( _eventFd, this, EventManager::EventRead );
+#else
     ERRCODE eCode = _socks.init();
 
     if ( NOT_OK ( eCode ) )
@@ -86,8 +175,34 @@ AsyncQueue::AsyncQueue(): _mutex ( "AsyncQueue" ), _offset ( 0 ), _isBroken ( fa
 
     EventManager::setFdHandler ( _socks.getSockA(), this, EventManager::EventRead );
 
-    // We use a non-blocking socket to send the task so AsyncQueue can treat EAGAIN/EWOULDBLOCK as soft-fails.
+    // Both sockets are non-blocking. The writing side treats EAGAIN/EWOULDBLOCK as success
+    // (the main thread will wake up anyway), and the reading side reads until there is nothing left.
+    SocketApi::setNonBlocking ( _socks.getSockA(), true );
     SocketApi::setNonBlocking ( _socks.getSockB(), true );
+#endif
+}
+
+AsyncQueue::~AsyncQueue()
+{
+#ifdef SYSTEM_LINUX
+    if ( _eventFd >= 0 )
+    {
+        EventManager::closeFd ( _eventFd );
+        _eventFd = -1;
+    }
+#else
+    _socks.close();
+#endif
+
+    Task * task = takeTasks();
+
+    while ( task != 0 )
+    {
+        Task * const next = task->_next;
+
+        delete task;
+        task = next;
+    }
 }
 
 void AsyncQueue::registerReceiver ( NoCopy * receiver )
@@ -106,6 +221,82 @@ void AsyncQueue::unregisterReceiver ( NoCopy * receiver )
     _receivers.remove ( receiver );
 }
 
+int AsyncQueue::getWakeupFd() const
+{
+#ifdef SYSTEM_LINUX
+    return _eventFd;
+#else
+    return _socks.getSockB();
+#endif
+}
+
+bool AsyncQueue::wakeup()
+{
+#ifdef SYSTEM_LINUX
+    const uint64_t value = 1;
+
+    errno = 0;
+
+    // The only way this could fail with EAGAIN is if the counter was about to overflow,
+    // which means that the main thread has a pending read event anyway.
+    return ( write ( _eventFd, &value, sizeof ( value ) ) == sizeof ( value ) || errno == EAGAIN );
+#else
+    const char value = 0;
+
+    errno = 0;
+
+    // If the socket is full, the main thread has a pending read event anyway.
+    return ( send ( _socks.getSockB(), &value, sizeof ( value ), 0 ) == sizeof ( value )
+             || errno == EAGAIN
+#ifdef EWOULDBLOCK
+             || errno == EWOULDBLOCK
+#endif
+    );
+#endif
+}
+
+bool AsyncQueue::pushTask ( AsyncQueue::Task * task )
+{
+    assert ( task != 0 );
+
+    Task * head;
+
+    do
+    {
+        head = _tasks;
+        task->_next = head;
+    }
+    while ( !casTask ( &_tasks, head, task ) );
+
+    return ( !head );
+}
+
+AsyncQueue::Task * AsyncQueue::takeTasks()
+{
+    Task * head;
+
+    do
+    {
+        head = _tasks;
+    }
+    while ( head != 0 && !casTask ( &_tasks, head, 0 ) );
+
+    // Tasks are linked from the newest to the oldest. We want to run them in the order they were added:
+
+    Task * ordered = 0;
+
+    while ( head != 0 )
+    {
+        Task * const next = head->_next;
+
+        head->_next = ordered;
+        ordered = head;
+        head = next;
+    }
+
+    return ordered;
+}
+
 ERRCODE AsyncQueue::runTask ( AsyncQueue::Task * task, DeletePolicy deletePolicy )
 {
     if ( !task )
@@ -121,13 +312,6 @@ ERRCODE AsyncQueue::runTask ( AsyncQueue::Task * task, DeletePolicy deletePolicy
         return Error::InvalidParameter;
     }
 
-    char buf[ sizeof ( Task * ) ];
-
-    memcpy ( buf, &task, sizeof ( buf ) );
-
-    // This will lock the mutex and unlock it when this function exits
-    MutexLock m ( _mutex );
-
     if ( _isBroken )
     {
         // We can't use log streams in a different thread :(
@@ -138,51 +322,47 @@ ERRCODE AsyncQueue::runTask ( AsyncQueue::Task * task, DeletePolicy deletePolicy
         return Error::Closed;
     }
 
-    const int fd = _socks.getSockB();
-
-    if ( fd < 0 )
+    if ( getWakeupFd() < 0 )
     {
         // We can't use log streams in a different thread :(
-        SIMPLE_LOG_DEBUG ( "Writing socket is missing; DeletePolicy: %d; Not scheduling the task!", deletePolicy );
+        SIMPLE_LOG_DEBUG ( "Wakeup descriptor is missing; DeletePolicy: %d; Not scheduling the task!",
+                           deletePolicy );
 
         task->deleteOnError ( deletePolicy );
 
         return Error::NotInitialized;
     }
 
-    errno = 0;
-    const int ret = send ( fd, buf, sizeof ( buf ), 0 );
-
-    if ( ret < 0 && (
-             errno == EAGAIN
-#ifdef EWOULDBLOCK
-             || errno == EWOULDBLOCK
-#endif
-         ) )
+    if ( addToCounter ( &_queuedTasks, 1 ) > MaxQueuedTasks )
     {
+        subFromCounter ( &_queuedTasks, 1 );
+
         // We can't use log streams in a different thread :(
-        SIMPLE_LOG_DEBUG ( "Send would block; DeletePolicy: %d; Not scheduling the task!", deletePolicy );
+        SIMPLE_LOG_DEBUG ( "The queue is full; DeletePolicy: %d; Not scheduling the task!", deletePolicy );
 
         task->deleteOnError ( deletePolicy );
 
         return Error::SoftFail;
     }
 
-    if ( ret == sizeof ( buf ) )
+    if ( !pushTask ( task ) )
     {
+        // The queue was not empty, so the main thread has already been woken up.
         return Error::Success;
     }
 
-    // We can't use log streams in a different thread :(
-    SIMPLE_LOG_DEBUG ( "Error writing to the socket, or a partial write (%d vs %d): %s [%d]"
-                       "; DeletePolicy: %d; Closing the queue!",
-                       ret, ( int ) sizeof ( buf ), strerror ( errno ), errno, deletePolicy );
+    if ( !wakeup() )
+    {
+        // The task is already in the queue, and it may still be run if the main thread wakes up for any reason.
+        // We can't remove it, so we treat it as success. But further tasks will be rejected.
 
-    _isBroken = true;
+        // We can't use log streams in a different thread :(
+        SIMPLE_LOG_DEBUG ( "Error waking up the main thread: %s [%d]; Closing the queue!", strerror ( errno ), errno );
 
-    task->deleteOnError ( deletePolicy );
+        _isBroken = true;
+    }
 
-    return Error::Closed;
+    return Error::Success;
 }
 
 ERRCODE AsyncQueue::blockingRunTask ( AsyncQueue::Task * task, uint32_t timeoutMs, DeletePolicy deletePolicy )
@@ -254,68 +434,71 @@ ERRCODE AsyncQueue::blockingRunTask ( AsyncQueue::Task * task, uint32_t timeoutM
 
 void AsyncQueue::receiveFdEvent ( int fd, short int events )
 {
-    assert ( _socks.getSockA() == fd );
-    assert ( _offset < sizeof ( _readBuf ) );
+    assert ( getWakeupFd() >= 0 );
 
     if ( ( events & EventManager::EventRead ) == 0 )
         return;
 
-    int ret = recv ( fd, _readBuf + _offset, sizeof ( _readBuf ) - _offset, 0 );
+    // We need to clear the wakeup event BEFORE taking the tasks.
+    // Otherwise a task added after we take the list, but before we clear the event, would not wake us up.
 
-    if ( ret < 1 )
-    {
-        SIMPLE_LOG_DEBUG ( "Error reading from the socket: %s [%d]; recv returned: %ld",
-                           strerror ( errno ), errno, ( long int ) ret );
+#ifdef SYSTEM_LINUX
+    assert ( _eventFd == fd );
 
-        return;
-    }
+    uint64_t value = 0;
 
-    _offset += ret;
+    if ( read ( fd, &value, sizeof ( value ) ) != sizeof ( value ) && errno != EAGAIN )
+    {
+        SIMPLE_LOG_DEBUG ( "Error reading from the eventfd: %s [%d]", strerror ( errno ), errno );
+    }
+#else
+    assert ( _socks.getSockA() == fd );
 
-    assert ( _offset <= sizeof ( _readBuf ) );
+    char buf[ 64 ];
 
-    if ( _offset < sizeof ( _readBuf ) )
+    while ( recv ( fd, buf, sizeof ( buf ), 0 ) == sizeof ( buf ) )
     {
-        return;
     }
+#endif
+
+    Task * task = takeTasks();
+    uint32_t numTasks = 0;
 
-    _offset = 0;
+    while ( task != 0 )
+    {
+        Task * const next = task->_next;
 
-    Task * task = 0;
+        task->_next = 0;
+        ++numTasks;
 
-    memcpy ( &task, _readBuf, sizeof ( _readBuf ) );
+        // We also protect the '_receivers' set:
 
-    if ( !task )
-    {
-        SIMPLE_LOG_DEBUG_NP ( "Received an empty task pointer; Ignoring" );
-        return;
-    }
+        _mutex.lock();
 
-    // Memory barrier - to make sure that the task's memory, if it was created on a different cpu, is updated:
-    // We also protect the '_receivers' set:
+        NoCopy * receiver = task->getReceiver();
 
-    _mutex.lock();
+        if ( !receiver || _receivers.contains ( receiver ) )
+        {
+            _mutex.unlock();
 
-    NoCopy * receiver = task->getReceiver();
+            // LOG ( L_DEBUG3, "Running a task: " << ( ( size_t ) task ) );
 
-    if ( !receiver || _receivers.contains ( receiver ) )
-    {
-        _mutex.unlock();
+            task->runTask();
+        }
+        else
+        {
+            _mutex.unlock();
 
-        // LOG ( L_DEBUG3, "Running a task: " << ( ( size_t ) task ) );
+            SIMPLE_LOG_DEBUG ( "Task's receiver is not registered; Not running the task (%lx); Receiver: %lx",
+                               ( long unsigned ) task, ( long unsigned ) receiver );
+        }
 
-        task->runTask();
+        delete task;
+        task = next;
     }
-    else
-    {
-        _mutex.unlock();
 
-        SIMPLE_LOG_DEBUG ( "Task's receiver is not registered; Not running the task (%lx); Receiver: %lx",
-                           ( long unsigned ) task, ( long unsigned ) receiver );
+    if ( numTasks > 0 )
+    {
+        subFromCounter ( &_queuedTasks, numTasks );
     }
-
-    delete task;
-    task = 0;
-
-    return;
 }
@@ -27,9 +27,20 @@
 namespace Pravala
 {
 /// @brief Class that allows to run tasks on the main thread
+///
+/// There is a single, global queue that runs tasks on the main thread (see get()).
+/// Other threads that run their own EventManager can create their own queues, which run tasks on those threads.
+///
+/// Tasks are added to a lock-free, multiple-producer/single-consumer queue.
+/// The main thread is only woken up (using eventfd on Linux, or a SocketPair elsewhere)
+/// when a task is added to an empty queue, and it runs all pending tasks each time it wakes up.
 class AsyncQueue: public EventManager::FdEventHandler
 {
     public:
+        /// @brief The max number of tasks that can be waiting in the queue.
+        /// Once there are this many tasks waiting, runTask() will fail with SoftFail.
+        static const uint32_t MaxQueuedTasks = 64 * 1024;
+
         /// @brief Policy for deleting tasks that are passed to the queue.
         enum DeletePolicy
         {
@@ -44,6 +55,12 @@ class AsyncQueue: public EventManager::FdEventHandler
         /// @brief A class that should be inherited by all tasks
         class Task
         {
+            public:
+                /// @brief Deletes this task on error, if the policy is DeleteOnError.
+                /// It can be used by code that passes tasks to the queue, and fails before doing that.
+                /// @param [in] deletePolicy The deletion policy.
+                void deleteOnError ( DeletePolicy deletePolicy );
+
             protected:
                 /// @brief Called to run the task.
                 virtual void runTask() = 0;
@@ -71,12 +88,9 @@ class AsyncQueue: public EventManager::FdEventHandler
                 /// @brief Virtual destructor.
                 virtual ~Task();
 
-                /// @brief Deletes this task on error, if the policy is DeleteOnError.
-                /// @param [in] deletePolicy The deletion policy.
-                void deleteOnError ( DeletePolicy deletePolicy );
-
             private:
                 NoCopy * const _receiver; ///< Pointer to the receiver
+                Task * _next; ///< The next task in the queue. Only used while the task is queued.
 
                 friend class AsyncQueue;
         };
@@ -87,6 +101,25 @@ class AsyncQueue: public EventManager::FdEventHandler
         /// @return A reference to the global AsyncQueue.
         static AsyncQueue & get();
 
+        /// @brief Returns a pointer to the global AsyncQueue, if it has been initialized already.
+        /// Unlike get(), it never initializes the queue, so it can be used by any thread.
+        /// @return A pointer to the global AsyncQueue, or 0 if it has not been initialized yet.
+        static AsyncQueue * getIfInitialized();
+
+        /// @brief Constructor.
+        /// Creates a queue that runs tasks on the thread that creates it.
+        /// This actually initializes the wakeup descriptor(s).
+        /// @note Most code should use the global queue (see get()) instead.
+        /// @warning The calling thread must have its EventManager initialized.
+        AsyncQueue();
+
+        /// @brief Destructor.
+        /// Tasks that are still in the queue are deleted without being run.
+        /// @warning It must be called on the thread that created the queue, before that thread's EventManager
+        ///          is shut down, and only once no other thread can use this queue anymore.
+        ///          The global queue is never destroyed.
+        ~AsyncQueue();
+
         /// @brief Registers an object in the list of valid receivers.
         /// @note Although this class does not care about the actual object types,
         ///       objects registered with it should typically not be copyable.
@@ -119,7 +152,7 @@ class AsyncQueue: public EventManager::FdEventHandler
         ///          - InvalidParameter if the task pointer is 0, or if deletePolicy is invalid, in which case the task
         ///            will not be deleted.
         ///          - Closed if the queue is broken and can no longer be used.
-        ///          - SoftFail if the queue is blocked and should be tried later.
+        ///          - SoftFail if the queue is full and should be tried later.
         ERRCODE runTask ( Task * task, DeletePolicy deletePolicy = DeleteOnError );
 
         /// @brief Schedules the task to be run on main thread, blocking up to a given amount of time.
@@ -151,15 +184,42 @@ class AsyncQueue: public EventManager::FdEventHandler
         virtual void receiveFdEvent ( int fd, short int events );
 
     private:
-        Mutex _mutex; ///< A mutex used for synchronizing write operations
+        Mutex _mutex; ///< A mutex used for synchronizing access to the receivers.
         HashSet<NoCopy *> _receivers; ///< Registered receivers
-        SocketPair _socks; ///< SocketPair used for passing data between threads
-        char _readBuf[ sizeof ( Task * ) ]; ///< Buffer for reading the data on the main thread
-        size_t _offset; ///< Offset in the buffer
-        bool _isBroken; ///< Set when a partial write or write error occurs, to prevent sending invalid data.
 
-        /// @brief Default constructor
-        /// This actually initializes the SocketPair
-        AsyncQueue();
+#ifdef SYSTEM_LINUX
+        int _eventFd; ///< The eventfd used for waking up the main thread.
+#else
+        SocketPair _socks; ///< SocketPair used for waking up the main thread.
+#endif
+
+        /// @brief The most recently added task.
+        /// Tasks are linked using their '_next' pointers, from the newest to the oldest.
+        /// It is modified atomically by other threads (when adding tasks),
+        /// and the main thread takes over all the tasks at once (by setting it to 0).
+        Task * volatile _tasks;
+
+        /// @brief The number of tasks that are in the queue. Modified atomically.
+        volatile uint32_t _queuedTasks;
+
+        volatile bool _isBroken; ///< Set when waking up the main thread fails.
+
+        /// @brief Returns the descriptor that should be used for waking up the main thread.
+        /// @return The descriptor that should be used for waking up the main thread; -1 if it is not available.
+        int getWakeupFd() const;
+
+        /// @brief Wakes up the main thread.
+        /// @return True on success; False if the main thread could not be woken up.
+        bool wakeup();
+
+        /// @brief Adds a task to the queue.
+        /// @param [in] task The task to add.
+        /// @return True if the queue was empty before adding this task (and the main thread needs to be woken up);
+        ///         False otherwise.
+        bool pushTask ( Task * task );
+
+        /// @brief Removes all tasks from the queue.
+        /// @return The list of removed tasks, in the order they were added (linked using their '_next' pointers).
+        Task * takeTasks();
 };
 }
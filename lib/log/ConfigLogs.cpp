@@ -20,6 +20,7 @@
 #include "ConfigLogs.hpp"
 #include "LogManager.hpp"
 #include "TextLogFileOutput.hpp"
+#include "TextLogAsyncOutput.hpp"
 
 #if defined( PLATFORM_ANDROID )
 #include "os/Android/TextLogAndroidOutput.hpp"
@@ -36,6 +37,36 @@
 
 using namespace Pravala;
 
+/// @brief A helper function that creates a file output (asynchronous, if enabled) using a file descriptor.
+/// @param [in] fd File descriptor to use
+/// @return New output object.
+static TextLogFileOutput * createFileOutput ( int fd )
+{
+#ifndef SYSTEM_WINDOWS
+    if ( TextLogAsyncOutput::optEnabled.value() )
+    {
+        return new TextLogAsyncOutput ( fd );
+    }
+#endif
+
+    return new TextLogFileOutput ( fd );
+}
+
+/// @brief A helper function that creates a file output (asynchronous, if enabled) using a file name.
+/// @param [in] fileName name of the file to use
+/// @return New output object.
+static TextLogFileOutput * createFileOutput ( const String & fileName )
+{
+#ifndef SYSTEM_WINDOWS
+    if ( TextLogAsyncOutput::optEnabled.value() )
+    {
+        return new TextLogAsyncOutput ( fileName );
+    }
+#endif
+
+    return new TextLogFileOutput ( fileName );
+}
+
 /// @brief A helper function that makes sure that the log prefix is sane
 /// @param [in] prefix The prefix to use
 /// @return log prefix
@@ -542,7 +573,7 @@ ERRCODE ConfigLogs::addLogSubscription ( const String & outputName, const Config
     {
         if ( outName == OUTPUT_STD )
         {
-            TextLogFileOutput * out = new TextLogFileOutput ( STDOUT_FILENO );
+            TextLogFileOutput * out = createFileOutput ( STDOUT_FILENO );
 
             if ( out != 0 && !out->isOpen() )
             {
@@ -556,7 +587,7 @@ ERRCODE ConfigLogs::addLogSubscription ( const String & outputName, const Config
         }
         else if ( outName == OUTPUT_ERR )
         {
-            TextLogFileOutput * out = new TextLogFileOutput ( STDERR_FILENO );
+            TextLogFileOutput * out = createFileOutput ( STDERR_FILENO );
 
             if ( out != 0 && !out->isOpen() )
             {
@@ -586,7 +617,7 @@ ERRCODE ConfigLogs::addLogSubscription ( const String & outputName, const Config
         }
         else
         {
-            TextLogFileOutput * out = new TextLogFileOutput ( outName );
+            TextLogFileOutput * out = createFileOutput ( outName );
 
             if ( out != 0 && !out->isOpen() )
             {
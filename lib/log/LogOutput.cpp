@@ -54,6 +54,16 @@ void BinLogOutput::sendTextLog ( Log::TextMessage & logMessage, String & )
     sendBinLog ( logMessage );
 }
 
+bool TextLogOutput::isThreadSafe() const
+{
+    return true;
+}
+
+bool BinLogOutput::isThreadSafe() const
+{
+    return false;
+}
+
 void TextLogOutput::formatMessage ( Log::TextMessage & logMessage, String & strMessage )
 {
     formatMessage ( logMessage,
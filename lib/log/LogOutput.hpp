@@ -81,6 +81,15 @@ class TextLogOutput
         ///                         serialize it using the formatMessage() functions.
         virtual void sendTextLog ( Log::TextMessage & logMessage, String & strMessage ) = 0;
 
+        /// @brief Checks whether this output can be used by threads other than the main one.
+        /// TextLog only uses its outputs under a process-wide lock, which is enough for outputs that simply
+        /// write the messages somewhere. Outputs that also use the main thread's state (like its EventManager)
+        /// cannot be used by other threads, even with that lock held. Messages logged by other threads
+        /// are passed to the main thread before they are sent to such outputs.
+        /// The default implementation returns true.
+        /// @return True if this output can be used by any thread; False if it can only be used by the main thread.
+        virtual bool isThreadSafe() const;
+
         friend class TextLog;
 };
 
@@ -100,6 +109,12 @@ class BinLogOutput: public TextLogOutput
         /// @param [in,out] strMessage The string with text version of the message. This output ignores it.
         virtual void sendTextLog ( Log::TextMessage & logMessage, String & strMessage );
 
+        /// @brief Checks whether this output can be used by threads other than the main one.
+        /// Binary log outputs typically send messages using the main thread's event loop (for example CtrlLink),
+        /// so this implementation returns false.
+        /// @return Always false.
+        virtual bool isThreadSafe() const;
+
         /// @brief Sends log data to the receiver.
         /// @param [in] logMessage The log message object
         virtual void sendBinLog ( Log::LogMessage & logMessage ) = 0;
@@ -14,23 +14,76 @@
  *  limitations under the License.
  */
 
+#include "basic/Mutex.hpp"
 #include "sys/CalendarTime.hpp"
+#include "event/AsyncQueue.hpp"
 #include "event/EventManager.hpp"
 #include "TextLog.hpp"
 #include "LogManager.hpp"
 
 using namespace Pravala;
 
+/// @brief Returns the mutex that synchronizes access to text log outputs (and to the lists of them).
+/// Log streams can be used by multiple threads (for example by ServerApp's reactors),
+/// and outputs are not thread-safe.
+/// @return The mutex that synchronizes access to text log outputs.
+static Mutex & getOutputMutex()
+{
+    static Mutex mutex ( "TextLog outputs" );
+
+    return mutex;
+}
+
+/// @brief Checks whether the calling thread is the main thread.
+/// The main thread is the one that runs the primary EventManager. If there are no EventManagers at all,
+/// there is nothing that other threads could be running, so the calling thread is treated as the main one.
+/// @return True if the calling thread is the main thread; False otherwise.
+static inline bool isMainThread()
+{
+    return ( EventManager::isPrimaryManager() || EventManager::getNumManagers() < 1 );
+}
+
+namespace Pravala
+{
+/// @brief A task that passes a message logged by another thread to the main thread.
+class TextLog::MainThreadTask: public AsyncQueue::Task
+{
+    public:
+        /// @brief Constructor.
+        /// @param [in] log The log the message was sent to.
+        /// @param [in] logMessage The message to pass. It is copied.
+        MainThreadTask ( TextLog * log, const Log::TextMessage & logMessage ):
+            AsyncQueue::Task ( 0 ), _log ( log ), _logMessage ( logMessage )
+        {
+        }
+
+    protected:
+        virtual void runTask()
+        {
+            TextLog::sendOnMainThread ( _log, _logMessage );
+        }
+
+    private:
+        TextLog * const _log; ///< The log the message was sent to.
+        Log::TextMessage _logMessage; ///< The message to send.
+};
+}
+
 TextLog::TextLog ( const char * logName ):
     LogName ( logName ), _minLogLevel ( Log::LogLevel::FatalError ), _isActive ( false )
 {
     assert ( LogName.find ( '.' ) < 0 );
 
+    // The list of logs is also read by sendOnMainThread() (with the lock held).
+    MutexLock lock ( getOutputMutex() );
+
     LogManager::get().registerLog ( this );
 }
 
 TextLog::~TextLog()
 {
+    MutexLock lock ( getOutputMutex() );
+
     LogManager::get().unregisterLog ( this );
 }
 
@@ -48,6 +101,8 @@ void TextLog::unsubscribeOutput ( TextLogOutput * output )
     if ( !output )
         return;
 
+    MutexLock lock ( getOutputMutex() );
+
     for ( size_t i = 0; i < _outputs.size(); ++i )
     {
         if ( _outputs[ i ].output == output )
@@ -71,6 +126,15 @@ void TextLog::subscribeOutput ( TextLogOutput * output, Log::LogLevel logLevel )
     if ( !output )
         return;
 
+    if ( !output->isThreadSafe() && EventManager::isPrimaryManager() )
+    {
+        // Messages logged by other threads are passed to this output using the global queue.
+        // Let's make sure it exists, it can only be initialized on the main thread.
+        AsyncQueue::get();
+    }
+
+    MutexLock lock ( getOutputMutex() );
+
     for ( size_t i = 0; i < _outputs.size(); ++i )
     {
         if ( _outputs[ i ].output == output )
@@ -110,11 +174,58 @@ void TextLog::send ( TextMessage & logMessage )
 
     String str;
 
+    const bool onMainThread = isMainThread();
+    bool passToMainThread = false;
+
+    MutexLock lock ( getOutputMutex() );
+
     for ( size_t i = 0; i < _outputs.size(); ++i )
     {
         if ( _outputs[ i ].logLevel.value() <= logMessage.getLevel().value() )
         {
-            _outputs[ i ].output->sendTextLog ( logMessage, str );
+            if ( onMainThread || _outputs[ i ].output->isThreadSafe() )
+            {
+                _outputs[ i ].output->sendTextLog ( logMessage, str );
+            }
+            else
+            {
+                passToMainThread = true;
+            }
+        }
+    }
+
+    if ( !passToMainThread )
+        return;
+
+    AsyncQueue * const queue = AsyncQueue::getIfInitialized();
+
+    if ( queue != 0 )
+    {
+        // If this fails (for example because the queue is full), the message is dropped.
+        // AsyncQueue doesn't use text logs, so this cannot recurse.
+        queue->runTask ( new MainThreadTask ( this, logMessage ) );
+    }
+}
+
+void TextLog::sendOnMainThread ( TextLog * log, Log::TextMessage & logMessage )
+{
+    assert ( isMainThread() );
+
+    String str;
+
+    MutexLock lock ( getOutputMutex() );
+
+    // The log could have been destroyed since the message was queued (if it wasn't a static object).
+    if ( !log || !LogManager::get()._textLogs.findValue ( log ) )
+        return;
+
+    for ( size_t i = 0; i < log->_outputs.size(); ++i )
+    {
+        // Outputs that can be used by any thread have received this message already.
+        if ( log->_outputs[ i ].logLevel.value() <= logMessage.getLevel().value()
+             && !log->_outputs[ i ].output->isThreadSafe() )
+        {
+            log->_outputs[ i ].output->sendTextLog ( logMessage, str );
         }
     }
 }
@@ -170,6 +281,8 @@ bool TextLogLimited::shouldLog ( const Log::LogLevel::_EnumType & logLevel, uint
     if ( !TextLog::shouldLog ( logLevel ) )
         return false;
 
+    MutexLock lock ( getOutputMutex() );
+
     const Time & now = EventManager::getCurrentTime();
 
     if ( now.isGreaterEqualThan ( _logPeriodStart, TimeInterval ) )
@@ -185,6 +298,8 @@ bool TextLogLimited::shouldLog ( const Log::LogLevel::_EnumType & logLevel, uint
 
 void TextLogLimited::send ( TextMessage & logMessage, uint16_t & counter )
 {
+    MutexLock lock ( getOutputMutex() );
+
     if ( counter < MaxLogs && ++counter >= MaxLogs )
     {
         logMessage << " [throttling log message]";
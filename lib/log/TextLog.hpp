@@ -191,6 +191,10 @@ class TextLog
         }
 
         /// @brief Sends given text log message to its outputs
+        /// Outputs are used under a process-wide lock, so log streams can be used by multiple threads.
+        /// Outputs that can only be used by the main thread (see TextLogOutput::isThreadSafe()) receive messages
+        /// logged by other threads on the main thread, once it runs the global AsyncQueue.
+        /// Until that queue is initialized, such messages are not sent to those outputs.
         /// @param [in] logMessage The message to send. This method sets 'name' 'time' and 'content' fields
         ///                         and will overwrite existing values
         void send ( TextMessage & logMessage );
@@ -236,12 +240,22 @@ class TextLog
         Log::LogLevel::_EnumType _minLogLevel; ///< The lowest log level used by the outputs
         bool _isActive; ///< Set to true if there is at least one subscriber
 
+        class MainThreadTask;
+
         /// @brief No default constructor
         TextLog();
 
         /// @brief Finds the minimum log level used by the outputs
         void findMinLevel();
 
+        /// @brief Sends a message logged by another thread to the outputs that can only be used by the main thread.
+        /// It should only be called on the main thread.
+        /// @param [in] log The log the message was sent to. If it no longer exists, nothing happens.
+        /// @param [in] logMessage The message to send. It already has 'name' 'time' and 'content' fields set.
+        static void sendOnMainThread ( TextLog * log, Log::TextMessage & logMessage );
+
+        friend class MainThreadTask;
+
         friend class LogManager;
 };
 
@@ -0,0 +1,625 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef SYSTEM_WINDOWS
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+
+extern "C"
+{
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/uio.h>
+}
+
+#include "sys/CalendarTime.hpp"
+
+#include "LogManager.hpp"
+#include "TextLogAsyncOutput.hpp"
+
+#include "auto/log/Log/TextMessage.hpp"
+
+/// @brief The max number of messages written using a single writev() call.
+#define MAX_BATCH_SIZE              64
+
+/// @brief The size of the memory in each slot that can be used for the content of the message.
+/// Messages that don't fit use memory allocated on the heap.
+#define SLOT_INLINE_DATA_SIZE       448
+
+/// @brief How often (in milliseconds) the writing thread checks for new messages, even when not woken up.
+#define MAX_SLEEP_TIME_MS           100
+
+using namespace Pravala;
+
+ConfigNumber<bool> TextLogAsyncOutput::optEnabled (
+        0,
+        "log-async", 0,
+        "text_log_output.async",
+        "Write text logs to files (and standard outputs) asynchronously, using a separate thread. "
+        "Messages are dropped (and the number of dropped messages is logged) if the writing thread falls behind.",
+        false );
+
+ConfigLimitedNumber<uint32_t> TextLogAsyncOutput::optQueueSize (
+        0,
+        "text_log_output.async_queue_size",
+        "The number of messages that can wait to be written by each asynchronous text log output",
+        16, 1024 * 1024, 4096 );
+
+/// @brief The number of times this process has been forked (as seen by the child).
+/// Writing threads are not copied by fork(), so they need to be restarted if this value changes.
+static volatile uint32_t forkGeneration = 0;
+
+/// @brief Used for registering the fork handler only once.
+static pthread_once_t forkHandlerOnce = PTHREAD_ONCE_INIT;
+
+/// @brief Called in the child process after a fork.
+static void forkChild()
+{
+    ++forkGeneration;
+}
+
+/// @brief Registers the fork handler.
+static void registerForkHandler()
+{
+    pthread_atfork ( 0, 0, forkChild );
+}
+
+/// @brief A single entry in the ring buffer.
+/// It contains the copy of all the fields of the message.
+struct TextLogAsyncOutput::Slot
+{
+    /// @brief Flags that describe which fields are set.
+    enum
+    {
+        HasName = ( 1 << 0 ),      ///< The name is set.
+        HasLevel = ( 1 << 1 ),     ///< The level is set.
+        HasFuncName = ( 1 << 2 ),  ///< The function name is set.
+        HasErrorCode = ( 1 << 3 ), ///< The error code is set.
+        HasContent = ( 1 << 4 )    ///< The content is set.
+    };
+
+    /// @brief The sequence number of the slot.
+    /// It determines whether the slot can be written (it is equal to the write index),
+    /// or read (it is equal to the read index + 1).
+    volatile uint32_t seq;
+
+    uint32_t flags; ///< Flags that describe which fields are set.
+    uint64_t time; ///< The time of the message.
+    Log::LogLevel level; ///< The level of the message.
+    ErrorCode errorCode; ///< The error code of the message.
+
+    uint32_t nameLen; ///< The length of the name.
+    uint32_t funcNameLen; ///< The length of the function name.
+    uint32_t contentLen; ///< The length of the content.
+
+    /// @brief The memory allocated for the message that didn't fit in inlineData (or 0).
+    char * extData;
+
+    /// @brief The memory for the name, function name and the content (in this order).
+    char inlineData[ SLOT_INLINE_DATA_SIZE ];
+
+    /// @brief Returns the memory with the data of the message.
+    /// @return The memory with the data of the message.
+    inline const char * getData() const
+    {
+        return ( extData != 0 ) ? extData : inlineData;
+    }
+};
+
+TextLogAsyncOutput::TextLogAsyncOutput ( int fd, bool autoClose ):
+    TextLogFileOutput ( fd, autoClose ),
+    _slots ( 0 ),
+    _mask ( getRingMask() )
+{
+    init();
+}
+
+TextLogAsyncOutput::TextLogAsyncOutput ( const String & fileName ):
+    TextLogFileOutput ( fileName ),
+    _slots ( 0 ),
+    _mask ( getRingMask() )
+{
+    init();
+}
+
+uint32_t TextLogAsyncOutput::getRingMask()
+{
+    uint32_t size = 1;
+
+    while ( size < optQueueSize.value() )
+    {
+        size <<= 1;
+    }
+
+    return size - 1;
+}
+
+void TextLogAsyncOutput::init()
+{
+    _writeIdx = _readIdx = 0;
+    _numDropped = _totalDropped = 0;
+    _isSleeping = 0;
+    _wakeFds[ 0 ] = _wakeFds[ 1 ] = -1;
+    _threadGeneration = forkGeneration;
+    _threadState = ThreadNotStarted;
+
+    memset ( &_thread, 0, sizeof ( _thread ) );
+
+    pthread_once ( &forkHandlerOnce, registerForkHandler );
+
+    _slots = new Slot[ _mask + 1 ];
+
+    for ( uint32_t i = 0; i <= _mask; ++i )
+    {
+        _slots[ i ].seq = i;
+        _slots[ i ].extData = 0;
+    }
+}
+
+TextLogAsyncOutput::~TextLogAsyncOutput()
+{
+    // We need to unsubscribe before stopping the thread, so nothing is sent to us anymore.
+    // TextLogOutput's destructor would do that after this destructor.
+    LogManager::get().unsubscribe ( this );
+
+    if ( _threadState == ThreadRunning && _threadGeneration == forkGeneration )
+    {
+        _threadState = ThreadStopping;
+        __sync_synchronize();
+
+        wakeUp ( true );
+
+        pthread_join ( _thread, 0 );
+    }
+
+    for ( uint32_t i = 0; i <= _mask; ++i )
+    {
+        free ( _slots[ i ].extData );
+    }
+
+    delete[] _slots;
+    _slots = 0;
+
+    for ( int i = 0; i < 2; ++i )
+    {
+        if ( _wakeFds[ i ] >= 0 )
+        {
+            ::close ( _wakeFds[ i ] );
+            _wakeFds[ i ] = -1;
+        }
+    }
+}
+
+bool TextLogAsyncOutput::startThread()
+{
+    const uint32_t gen = forkGeneration;
+    const uint32_t oldGen = _threadGeneration;
+
+    if ( oldGen != gen )
+    {
+        // We are in a child process after a fork. The writing thread doesn't exist here.
+        // Messages still in the ring buffer will be written by the parent, so we discard them.
+        // This should happen right after the fork, when the child still has only one thread.
+
+        if ( !__sync_bool_compare_and_swap ( &_threadGeneration, oldGen, gen ) )
+        {
+            return false;
+        }
+
+        for ( uint32_t i = 0; i <= _mask; ++i )
+        {
+            free ( _slots[ i ].extData );
+
+            _slots[ i ].extData = 0;
+            _slots[ i ].seq = i;
+        }
+
+        _writeIdx = _readIdx = 0;
+        _numDropped = 0;
+        _isSleeping = 0;
+
+        // The pipe is shared with the parent, we need our own.
+        for ( int i = 0; i < 2; ++i )
+        {
+            if ( _wakeFds[ i ] >= 0 )
+            {
+                ::close ( _wakeFds[ i ] );
+                _wakeFds[ i ] = -1;
+            }
+        }
+
+        __sync_synchronize();
+
+        _threadState = ThreadNotStarted;
+    }
+
+    if ( _threadState == ThreadRunning )
+    {
+        return true;
+    }
+
+    if ( !__sync_bool_compare_and_swap ( &_threadState, ThreadNotStarted, ThreadStarting ) )
+    {
+        // Failed, or being started by another thread.
+        return false;
+    }
+
+    int ret = pipe ( _wakeFds );
+
+    if ( ret == 0 )
+    {
+        for ( int i = 0; i < 2; ++i )
+        {
+            fcntl ( _wakeFds[ i ], F_SETFL, fcntl ( _wakeFds[ i ], F_GETFL ) | O_NONBLOCK );
+            fcntl ( _wakeFds[ i ], F_SETFD, FD_CLOEXEC );
+        }
+
+        ret = pthread_create ( &_thread, 0, threadMain, this );
+    }
+    else
+    {
+        ret = errno;
+        _wakeFds[ 0 ] = _wakeFds[ 1 ] = -1;
+    }
+
+    if ( ret != 0 )
+    {
+        fprintf ( stderr, "TextLogAsyncOutput: Error starting the writing thread: %s; "
+                  "Messages will be written synchronously\n", strerror ( ret ) );
+
+        _threadState = ThreadFailed;
+        return false;
+    }
+
+    __sync_synchronize();
+
+    _threadState = ThreadRunning;
+    return true;
+}
+
+void TextLogAsyncOutput::wakeUp ( bool force )
+{
+    if ( force || ( _isSleeping != 0 && __sync_bool_compare_and_swap ( &_isSleeping, 1, 0 ) ) )
+    {
+        const char c = 0;
+
+        if ( ::write ( _wakeFds[ 1 ], &c, 1 ) < 0 )
+        {
+            // It is non-blocking, so it can fail if the pipe is full - but then the thread will wake up anyway.
+        }
+    }
+}
+
+void TextLogAsyncOutput::sendTextLog ( Log::TextMessage & logMessage, String & strMessage )
+{
+    if ( _myFd < 0 )
+        return;
+
+    if ( ( _threadState != ThreadRunning || _threadGeneration != forkGeneration ) && !startThread() )
+    {
+        TextLogFileOutput::sendTextLog ( logMessage, strMessage );
+        return;
+    }
+
+    uint32_t pos = _writeIdx;
+    Slot * slot = 0;
+
+    while ( true )
+    {
+        slot = &_slots[ pos & _mask ];
+
+        const int32_t diff = ( int32_t ) ( slot->seq - pos );
+
+        if ( diff == 0 )
+        {
+            if ( __sync_bool_compare_and_swap ( &_writeIdx, pos, pos + 1 ) )
+            {
+                break;
+            }
+        }
+        else if ( diff < 0 )
+        {
+            // The ring buffer is full.
+            __sync_add_and_fetch ( &_numDropped, 1 );
+            __sync_add_and_fetch ( &_totalDropped, 1 );
+            return;
+        }
+
+        pos = _writeIdx;
+    }
+
+    // The slot is ours now.
+
+    slot->flags = 0;
+    slot->time = logMessage.hasTime() ? logMessage.getTime() : CalendarTime::getUTCEpochTimeMs();
+    slot->nameLen = slot->funcNameLen = slot->contentLen = 0;
+
+    if ( logMessage.hasName() )
+    {
+        slot->flags |= Slot::HasName;
+        slot->nameLen = logMessage.getName().length();
+    }
+
+    if ( logMessage.hasLevel() )
+    {
+        slot->flags |= Slot::HasLevel;
+        slot->level = logMessage.getLevel();
+    }
+
+    if ( logMessage.hasFuncName() )
+    {
+        slot->flags |= Slot::HasFuncName;
+        slot->funcNameLen = logMessage.getFuncName().length();
+    }
+
+    if ( logMessage.hasErrorCode() )
+    {
+        slot->flags |= Slot::HasErrorCode;
+        slot->errorCode = logMessage.getErrorCode();
+    }
+
+    if ( logMessage.hasContent() )
+    {
+        slot->flags |= Slot::HasContent;
+        slot->contentLen = logMessage.getContent().length();
+    }
+
+    size_t dataSize = slot->nameLen + slot->funcNameLen + slot->contentLen;
+    char * data = slot->inlineData;
+
+    assert ( !slot->extData );
+
+    if ( dataSize > SLOT_INLINE_DATA_SIZE )
+    {
+        slot->extData = ( char * ) malloc ( dataSize );
+
+        if ( slot->extData != 0 )
+        {
+            data = slot->extData;
+        }
+        else
+        {
+            // We are out of memory; let's just truncate the content.
+            // Name and function names are short, so they should always fit.
+            assert ( slot->nameLen + slot->funcNameLen <= SLOT_INLINE_DATA_SIZE );
+
+            slot->contentLen = SLOT_INLINE_DATA_SIZE - slot->nameLen - slot->funcNameLen;
+        }
+    }
+
+    memcpy ( data, logMessage.getName().c_str(), slot->nameLen );
+    data += slot->nameLen;
+
+    memcpy ( data, logMessage.getFuncName().c_str(), slot->funcNameLen );
+    data += slot->funcNameLen;
+
+    memcpy ( data, logMessage.getContent().c_str(), slot->contentLen );
+
+    // Make sure the content of the slot is visible before the slot is marked as ready to be read:
+    __sync_synchronize();
+
+    slot->seq = pos + 1;
+
+    wakeUp();
+}
+
+void * TextLogAsyncOutput::threadMain ( void * arg )
+{
+    assert ( arg != 0 );
+
+    ( ( TextLogAsyncOutput * ) arg )->run();
+
+    return 0;
+}
+
+void TextLogAsyncOutput::run()
+{
+    String messages[ MAX_BATCH_SIZE ];
+
+    while ( true )
+    {
+        // We need to check it before reading the messages - if we're stopping and there is nothing to read,
+        // it means that everything has been written already.
+        const bool isStopping = ( _threadState == ThreadStopping );
+
+        const size_t numMessages = readMessages ( messages, MAX_BATCH_SIZE );
+
+        if ( numMessages > 0 )
+        {
+            writeMessages ( messages, numMessages );
+            continue;
+        }
+
+        if ( isStopping )
+        {
+            return;
+        }
+
+        _isSleeping = 1;
+        __sync_synchronize();
+
+        // Something could have been added before we set the flag:
+        if ( _threadState != ThreadStopping
+             && ( int32_t ) ( _slots[ _readIdx & _mask ].seq - ( _readIdx + 1 ) ) < 0
+             && _numDropped == 0 )
+        {
+            struct pollfd pfd;
+
+            pfd.fd = _wakeFds[ 0 ];
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+
+            poll ( &pfd, 1, MAX_SLEEP_TIME_MS );
+
+            char buf[ 64 ];
+
+            while ( ::read ( _wakeFds[ 0 ], buf, sizeof ( buf ) ) > 0 )
+            {
+            }
+        }
+
+        _isSleeping = 0;
+    }
+}
+
+size_t TextLogAsyncOutput::readMessages ( String * messages, size_t maxMessages )
+{
+    assert ( messages != 0 );
+    assert ( maxMessages > 0 );
+
+    size_t numMessages = 0;
+
+    const uint32_t numDropped = __sync_lock_test_and_set ( &_numDropped, 0 );
+
+    if ( numDropped > 0 )
+    {
+        Log::TextMessage msg;
+
+        msg.setName ( "log" );
+        msg.setLevel ( Log::LogLevel::Warning );
+        msg.setContent ( String ( "Asynchronous log output dropped %1 message(s), its queue was full" )
+                         .arg ( numDropped ) );
+
+        formatMessage ( msg, messages[ numMessages++ ] );
+    }
+
+    Log::TextMessage msg;
+
+    while ( numMessages < maxMessages )
+    {
+        Slot & slot = _slots[ _readIdx & _mask ];
+
+        if ( ( int32_t ) ( slot.seq - ( _readIdx + 1 ) ) < 0 )
+        {
+            // Nothing more to read.
+            break;
+        }
+
+        // Make sure we see the content of the slot written by the sender:
+        __sync_synchronize();
+
+        const char * data = slot.getData();
+
+        msg.clear();
+        msg.setTime ( slot.time );
+
+        if ( ( slot.flags & Slot::HasName ) != 0 )
+        {
+            msg.setName ( String ( data, slot.nameLen ) );
+        }
+
+        data += slot.nameLen;
+
+        if ( ( slot.flags & Slot::HasLevel ) != 0 )
+        {
+            msg.setLevel ( slot.level );
+        }
+
+        if ( ( slot.flags & Slot::HasFuncName ) != 0 )
+        {
+            msg.setFuncName ( String ( data, slot.funcNameLen ) );
+        }
+
+        data += slot.funcNameLen;
+
+        if ( ( slot.flags & Slot::HasErrorCode ) != 0 )
+        {
+            msg.setErrorCode ( slot.errorCode );
+        }
+
+        if ( ( slot.flags & Slot::HasContent ) != 0 )
+        {
+            msg.setContent ( String ( data, slot.contentLen ) );
+        }
+
+        free ( slot.extData );
+        slot.extData = 0;
+
+        // Make sure we are done with the slot before it is marked as ready to be written:
+        __sync_synchronize();
+
+        slot.seq = _readIdx + _mask + 1;
+        ++_readIdx;
+
+        formatMessage ( msg, messages[ numMessages ] );
+
+        if ( !messages[ numMessages ].isEmpty() )
+        {
+            ++numMessages;
+        }
+    }
+
+    return numMessages;
+}
+
+void TextLogAsyncOutput::writeMessages ( const String * messages, size_t numMessages )
+{
+    assert ( messages != 0 );
+    assert ( numMessages <= MAX_BATCH_SIZE );
+
+    struct iovec iov[ MAX_BATCH_SIZE ];
+
+    for ( size_t i = 0; i < numMessages; ++i )
+    {
+        iov[ i ].iov_base = const_cast<char *> ( messages[ i ].c_str() );
+        iov[ i ].iov_len = messages[ i ].length();
+    }
+
+    struct iovec * curIov = iov;
+    size_t numIov = numMessages;
+
+    while ( numIov > 0 )
+    {
+        ssize_t ret = writev ( _myFd, curIov, numIov );
+
+        if ( ret < 0 )
+        {
+            if ( errno == EINTR )
+                continue;
+
+            if ( errno != EPIPE )
+            {
+                // If the output is piped to another process (like grep) we will get PIPE errors
+                // if user presses Ctrl-C; Let's not print that...
+
+                perror ( "TextLogAsyncOutput: writev()" );
+            }
+
+            return;
+        }
+
+        // Skip everything that has been written:
+        while ( numIov > 0 && ( size_t ) ret >= curIov->iov_len )
+        {
+            ret -= curIov->iov_len;
+            ++curIov;
+            --numIov;
+        }
+
+        if ( numIov > 0 )
+        {
+            curIov->iov_base = ( char * ) curIov->iov_base + ret;
+            curIov->iov_len -= ret;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,158 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#pragma once
+
+#ifndef SYSTEM_WINDOWS
+
+extern "C"
+{
+#include <pthread.h>
+}
+
+#include "TextLogFileOutput.hpp"
+
+namespace Pravala
+{
+/// @brief Class for logging text messages to files asynchronously.
+/// Instead of formatting and writing each message on the thread that generates it, it copies the fields
+/// of the message into a lock-free ring buffer. Messages are formatted and written (in batches) by a dedicated thread.
+/// Sending a message never blocks. If the ring buffer is full, the message is dropped, and the number
+/// of dropped messages is reported in the log once there is space for it again.
+/// The thread is started when the first message is sent. If the process forks, the child process
+/// starts its own thread (and discards messages that were still waiting to be written by its parent).
+/// If the thread cannot be started, messages are written synchronously.
+/// @note It is not available on Windows.
+class TextLogAsyncOutput: public TextLogFileOutput
+{
+    public:
+        /// @brief If set, file (and standard) log outputs will be asynchronous.
+        static ConfigNumber<bool> optEnabled;
+
+        /// @brief The number of messages that can wait to be written.
+        static ConfigLimitedNumber<uint32_t> optQueueSize;
+
+        /// @brief Constructor.
+        /// Creates a new TextLogAsyncOutput logging data to specified file descriptor
+        /// @param [in] fd File descriptor to use
+        /// @param [in] autoClose If set to true this file descriptor will be automatically closed
+        ///                        when the TextLogAsyncOutput is destroyed
+        TextLogAsyncOutput ( int fd, bool autoClose = false );
+
+        /// @brief Constructor.
+        /// Creates a new TextLogAsyncOutput logging data to a file specified with its file name.
+        /// The file is automatically closed when the TextLogAsyncOutput is destroyed
+        /// @param [in] fileName name of the file to use
+        TextLogAsyncOutput ( const String & fileName );
+
+        /// @brief Destructor.
+        /// Writes all the messages that are still waiting, and stops the writing thread.
+        ~TextLogAsyncOutput();
+
+        /// @brief Returns the number of messages that were dropped because the ring buffer was full.
+        /// @return The total number of messages dropped by this output.
+        inline uint32_t getNumDropped() const
+        {
+            return _totalDropped;
+        }
+
+    protected:
+        virtual void sendTextLog ( Log::TextMessage & logMessage, String & strMessage );
+
+    private:
+        struct Slot;
+
+        /// @brief The state of the writing thread.
+        enum ThreadState
+        {
+            ThreadNotStarted, ///< The thread has not been started yet (or it needs to be restarted after a fork).
+            ThreadStarting,   ///< The thread is being started.
+            ThreadRunning,    ///< The thread is running.
+            ThreadStopping,   ///< The thread should write all the remaining messages and exit.
+            ThreadFailed      ///< The thread could not be started; Messages are written synchronously.
+        };
+
+        Slot * _slots; ///< The ring buffer.
+        const uint32_t _mask; ///< The mask to apply to indexes to get slot positions (the size of the ring - 1).
+
+        /// @brief The index of the next slot to be written by senders.
+        /// Modified atomically.
+        volatile uint32_t _writeIdx;
+
+        /// @brief The index of the next slot to be read by the writing thread.
+        /// Only used by the writing thread.
+        uint32_t _readIdx;
+
+        /// @brief The number of messages dropped since the last report.
+        /// Modified atomically.
+        volatile uint32_t _numDropped;
+
+        /// @brief The total number of messages dropped.
+        /// Modified atomically.
+        volatile uint32_t _totalDropped;
+
+        /// @brief Set by the writing thread when it is about to sleep, waiting for more messages.
+        /// Modified atomically.
+        volatile uint32_t _isSleeping;
+
+        /// @brief The pipe used for waking up the writing thread. [0] is read by the thread.
+        int _wakeFds[ 2 ];
+
+        /// @brief The fork generation in which the writing thread was started.
+        volatile uint32_t _threadGeneration;
+
+        volatile uint32_t _threadState; ///< The state of the writing thread (one of ThreadState values).
+
+        pthread_t _thread; ///< The writing thread.
+
+        /// @brief Initializes the ring buffer.
+        void init();
+
+        /// @brief Returns the mask to use with the ring buffer, based on the configured queue size.
+        /// @return The mask to use (the size of the ring buffer, rounded up to a power of 2, minus 1).
+        static uint32_t getRingMask();
+
+        /// @brief Starts the writing thread, if it is not running.
+        /// It is called when a message is sent (and the thread has not been started yet).
+        /// @return True if the thread is running; False if messages should be written synchronously.
+        bool startThread();
+
+        /// @brief Wakes up the writing thread.
+        /// @param [in] force If set, the thread is woken up even if it's not sleeping (yet).
+        void wakeUp ( bool force = false );
+
+        /// @brief Runs the writing thread.
+        void run();
+
+        /// @brief Reads up to the given number of messages from the ring buffer, and formats them.
+        /// @param [out] messages The array to store formatted messages in.
+        /// @param [in] maxMessages The max number of messages to read (the size of the array).
+        /// @return The number of messages read.
+        size_t readMessages ( String * messages, size_t maxMessages );
+
+        /// @brief Writes the messages to the file.
+        /// @param [in] messages The array with formatted messages.
+        /// @param [in] numMessages The number of messages in the array.
+        void writeMessages ( const String * messages, size_t numMessages );
+
+        /// @brief The function that runs in the writing thread.
+        /// @param [in] arg A pointer to the TextLogAsyncOutput object.
+        /// @return Always 0.
+        static void * threadMain ( void * arg );
+};
+}
+
+#endif
@@ -56,10 +56,10 @@ class TextLogFileOutput: public TextLogOutput
         ///                         generates the string version, it can be reused by subsequent outputs.
         virtual void sendTextLog ( Log::TextMessage & logMessage, String & strMessage );
 
-    private:
         /// @brief Internal file descriptor.
         int _myFd;
 
+    private:
         /// @brief If set to true, the file is closed in the destructor.
         bool _autoClose;
 
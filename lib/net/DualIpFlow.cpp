@@ -49,8 +49,7 @@ DualIpFlow::~DualIpFlow()
 void DualIpFlow::setSecondaryFlowDesc ( const FlowDesc & flowDesc )
 {
     // We must NOT be a part of a map.
-    // We cannot check that for sure, but if _next is set, we are a part of a map...
-    assert ( !getNext() );
+    assert ( !isInMap() );
 
     _secondaryDesc = flowDesc;
 }
@@ -95,38 +94,11 @@ bool DualIpFlow::mapInsert ( IpFlowMap & flowMap )
 
 void DualIpFlow::mapRemove ( IpFlowMap & flowMap )
 {
-    if ( !_secondaryDesc.isValid() )
-    {
-        IpFlow::mapRemove ( flowMap );
-        return;
-    }
-
-    // Regular remove simply replaces the 'next' pointer in previous
-    // object with the 'next' value fro mthe object being removed.
-    // This object has two "incoming" pointers, one for each of the descriptors.
-    // Each object after this one in the list is there beacause it should "follow" one of those pointers.
-    // We don't know which one, so we have to re-insert all of them.
-    // To do that, we take over the remainder of the list, and then re-insert all objects in it,
-    // one by one.
-
-    IpFlow * next = stealNext();
-
-    assert ( !getNext() );
-
     IpFlow::mapRemove ( flowMap );
 
-    flowMap.flowRemove ( this, _secondaryDesc );
-
-    while ( next != 0 )
+    if ( _secondaryDesc.isValid() )
     {
-        IpFlow * const ptr = next;
-        next = ptr->stealNext();
-
-        const bool ret = ptr->mapInsert ( flowMap );
-
-        // Re-inserting really should work, since all those objects were in the flow map already!
-
-        ( void ) ret;
-        assert ( ret );
+        // The map uses a separate entry for each descriptor:
+        flowMap.flowRemove ( this, _secondaryDesc );
     }
 }
@@ -0,0 +1,310 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <cstring>
+
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#define IP_CHECKSUM_X86    1
+#include <immintrin.h>
+#endif
+
+#include "IpChecksum.hpp"
+
+/// @brief The max number of bytes passed to a sum function at once.
+/// Sum functions add 32-bit words to 64-bit accumulators. Limiting the size of the data
+/// guarantees that those accumulators (and their sum) never overflow.
+/// It has to be an even number.
+#define MAX_SUM_BLOCK_SIZE    ( 1U << 30 )
+
+using namespace Pravala;
+
+/// @brief Portable sum function.
+/// It adds 32-bit halves of 64-bit words to a 64-bit accumulator, which removes the need to handle carries.
+/// @param [in] data The data to sum up. Does NOT need to be aligned in any specific way.
+/// @param [in] size The size of the data; It has to be an even number.
+/// @return The 64-bit sum of the data. Reducing it to 16 bits gives the sum of all 16-bit words.
+static uint64_t sumPortable ( const char * data, size_t size )
+{
+    assert ( size % 2 == 0 );
+
+    uint64_t sumA = 0;
+    uint64_t sumB = 0;
+
+    // Let's add the data, 16 bytes at a time, using two accumulators that can be updated in parallel.
+    // memcpy is used to perform unaligned loads - compilers turn it into a single (unaligned) load instruction.
+    while ( size >= 16 )
+    {
+        uint64_t v[ 2 ];
+
+        memcpy ( v, data, 16 );
+
+        sumA += ( v[ 0 ] & 0xFFFFFFFFU ) + ( v[ 0 ] >> 32 );
+        sumB += ( v[ 1 ] & 0xFFFFFFFFU ) + ( v[ 1 ] >> 32 );
+
+        data += 16;
+        size -= 16;
+    }
+
+    // Now we may have between 0 and 14 bytes left.
+    // We don't modify the size anymore, just check individual bits.
+    // We still need to modify the data pointer.
+
+    if ( size & 8 )
+    {
+        uint64_t v;
+
+        memcpy ( &v, data, 8 );
+
+        sumA += ( v & 0xFFFFFFFFU ) + ( v >> 32 );
+        data += 8;
+    }
+
+    if ( size & 4 )
+    {
+        uint32_t v;
+
+        memcpy ( &v, data, 4 );
+
+        sumB += v;
+        data += 4;
+    }
+
+    if ( size & 2 )
+    {
+        uint16_t v;
+
+        memcpy ( &v, data, 2 );
+
+        sumA += v;
+    }
+
+    return sumA + sumB;
+}
+
+#ifdef IP_CHECKSUM_X86
+
+/// @brief SSE2 sum function.
+/// It interleaves 32-bit words with zeros, and adds them to 64-bit lanes of the accumulators.
+/// @param [in] data The data to sum up. Does NOT need to be aligned in any specific way.
+/// @param [in] size The size of the data; It has to be an even number.
+/// @return The 64-bit sum of the data. Reducing it to 16 bits gives the sum of all 16-bit words.
+__attribute__ ( ( target ( "sse2" ) ) ) static uint64_t sumSse2 ( const char * data, size_t size )
+{
+    assert ( size % 2 == 0 );
+
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sumA = zero;
+    __m128i sumB = zero;
+
+    while ( size >= 32 )
+    {
+        const __m128i vA = _mm_loadu_si128 ( ( const __m128i * ) data );
+        const __m128i vB = _mm_loadu_si128 ( ( const __m128i * ) ( data + 16 ) );
+
+        sumA = _mm_add_epi64 ( sumA, _mm_unpacklo_epi32 ( vA, zero ) );
+        sumB = _mm_add_epi64 ( sumB, _mm_unpackhi_epi32 ( vA, zero ) );
+        sumA = _mm_add_epi64 ( sumA, _mm_unpacklo_epi32 ( vB, zero ) );
+        sumB = _mm_add_epi64 ( sumB, _mm_unpackhi_epi32 ( vB, zero ) );
+
+        data += 32;
+        size -= 32;
+    }
+
+    uint64_t lanes[ 2 ];
+
+    _mm_storeu_si128 ( ( __m128i * ) lanes, _mm_add_epi64 ( sumA, sumB ) );
+
+    // There are at most 30 bytes left:
+    return lanes[ 0 ] + lanes[ 1 ] + sumPortable ( data, size );
+}
+
+/// @brief AVX2 sum function.
+/// It interleaves 32-bit words with zeros, and adds them to 64-bit lanes of the accumulators.
+/// @param [in] data The data to sum up. Does NOT need to be aligned in any specific way.
+/// @param [in] size The size of the data; It has to be an even number.
+/// @return The 64-bit sum of the data. Reducing it to 16 bits gives the sum of all 16-bit words.
+__attribute__ ( ( target ( "avx2" ) ) ) static uint64_t sumAvx2 ( const char * data, size_t size )
+{
+    assert ( size % 2 == 0 );
+
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i sumA = zero;
+    __m256i sumB = zero;
+
+    while ( size >= 64 )
+    {
+        const __m256i vA = _mm256_loadu_si256 ( ( const __m256i * ) data );
+        const __m256i vB = _mm256_loadu_si256 ( ( const __m256i * ) ( data + 32 ) );
+
+        // Those unpack within 128-bit lanes, which doesn't matter, since everything gets added together anyway.
+        sumA = _mm256_add_epi64 ( sumA, _mm256_unpacklo_epi32 ( vA, zero ) );
+        sumB = _mm256_add_epi64 ( sumB, _mm256_unpackhi_epi32 ( vA, zero ) );
+        sumA = _mm256_add_epi64 ( sumA, _mm256_unpacklo_epi32 ( vB, zero ) );
+        sumB = _mm256_add_epi64 ( sumB, _mm256_unpackhi_epi32 ( vB, zero ) );
+
+        data += 64;
+        size -= 64;
+    }
+
+    uint64_t lanes[ 4 ];
+
+    _mm256_storeu_si256 ( ( __m256i * ) lanes, _mm256_add_epi64 ( sumA, sumB ) );
+
+    // There are at most 62 bytes left:
+    return lanes[ 0 ] + lanes[ 1 ] + lanes[ 2 ] + lanes[ 3 ] + sumPortable ( data, size );
+}
+
+#endif
+
+IpChecksum::SumFunc IpChecksum::_sumFunc ( 0 );
+IpChecksum::Implementation IpChecksum::_sumFuncImpl ( IpChecksum::ImplAuto );
+
+bool IpChecksum::setImplementation ( IpChecksum::Implementation impl )
+{
+#ifdef IP_CHECKSUM_X86
+    __builtin_cpu_init();
+
+    const bool hasSse2 = __builtin_cpu_supports ( "sse2" );
+    const bool hasAvx2 = __builtin_cpu_supports ( "avx2" );
+#endif
+
+    switch ( impl )
+    {
+        case ImplAuto:
+#ifdef IP_CHECKSUM_X86
+            if ( hasAvx2 )
+            {
+                return setImplementation ( ImplAvx2 );
+            }
+            else if ( hasSse2 )
+            {
+                return setImplementation ( ImplSse2 );
+            }
+#endif
+            return setImplementation ( ImplPortable );
+
+        case ImplPortable:
+            _sumFunc = sumPortable;
+            _sumFuncImpl = impl;
+            return true;
+
+        case ImplSse2:
+#ifdef IP_CHECKSUM_X86
+            if ( hasSse2 )
+            {
+                _sumFunc = sumSse2;
+                _sumFuncImpl = impl;
+                return true;
+            }
+#endif
+            break;
+
+        case ImplAvx2:
+#ifdef IP_CHECKSUM_X86
+            if ( hasAvx2 )
+            {
+                _sumFunc = sumAvx2;
+                _sumFuncImpl = impl;
+                return true;
+            }
+#endif
+            break;
+    }
+
+    return false;
+}
+
+IpChecksum::Implementation IpChecksum::getImplementation()
+{
+    if ( !_sumFunc )
+    {
+        setImplementation ( ImplAuto );
+    }
+
+    return _sumFuncImpl;
+}
+
+void IpChecksum::addMemory ( const char * data, size_t size )
+{
+    if ( !data || size < 1 )
+    {
+        return;
+    }
+
+    if ( !_sumFunc )
+    {
+        setImplementation ( ImplAuto );
+    }
+
+    assert ( _sumFunc != 0 );
+
+    // NOTE: Sum functions only deal with complete 16-bit words.
+    //       If there is an odd byte at the end, it should be padded with 0, and modify _nextIdx.
+    //       Because of that we simply add that single byte at the end (after changing the checksum),
+    //       using addMemory ( char ) version.
+
+    const size_t evenSize = size & ~( ( size_t ) 1 );
+
+    for ( size_t offset = 0; offset < evenSize; )
+    {
+        const size_t blockSize = ( evenSize - offset < MAX_SUM_BLOCK_SIZE ) ? ( evenSize - offset ) : MAX_SUM_BLOCK_SIZE;
+        const uint64_t sum64 = _sumFunc ( data + offset, blockSize );
+
+        offset += blockSize;
+
+        // Now we have a 64-bit checksum.
+        // First, we need to reduce it to 16 bits, by adding halves of it to each other (twice):
+
+        ChecksumValue sum16;
+
+        {
+            uint32_t sum32 = ( uint32_t ) ( sum64 & 0xFFFFFFFFUL );
+            const uint32_t tmp32 = ( uint32_t ) ( sum64 >> 32 );
+
+            ( ( sum32 += tmp32 ) < tmp32 ) && ++sum32;
+
+            sum16.u16 = ( uint16_t ) ( sum32 & 0xFFFFU );
+            const uint16_t tmp16 = ( uint16_t ) ( sum32 >> 16 );
+
+            ( ( sum16.u16 += tmp16 ) < tmp16 ) && ++sum16.u16;
+        }
+
+        if ( _nextIdx != 0 )
+        {
+            // We are misaligned, which means that the last modification of the checksum
+            // did not end at a 2 byte boundary. We have to switch the bytes:
+
+            ChecksumValue v;
+
+            v.s8[ 0 ] = sum16.s8[ 1 ];
+            v.s8[ 1 ] = sum16.s8[ 0 ];
+
+            ( ( _sum.u16 += v.u16 ) < v.u16 ) && ++_sum.u16;
+        }
+        else if ( ( _sum.u16 += sum16.u16 ) < sum16.u16 )
+        {
+            ++_sum.u16;
+        }
+    }
+
+    if ( size & 1 )
+    {
+        // We have one additional byte to add!
+        // Because it's an odd byte it will affect _nextIdx.
+        // Let's just use the regular addMemory(char):
+        addMemory ( data[ size - 1 ] );
+    }
+}
@@ -27,10 +27,6 @@ namespace Pravala
 /// It calculates the checksum properly whether the memory is passed using a single call, or in several calls,
 /// one chunk at a time. The IP checksum is stored in 2 bytes.
 /// It is "16-bit one's complement of the one's complement sum of all 16-bit words".
-/// To speed things up, instead of dealing with 2B values, this algorithm uses 64-bit words to compute a 64-bit sum,
-/// which is later reduced to 16-bit value. However, to perform 64-bit operations the memory has to be aligned properly.
-/// Also, if the individual chunks are not sized properly, the later segments, even if they start at aligned
-/// addresses, may follow a segment that ended not at the end of a 64-bit word.
 /// The idea behind this algorithm is based on the observation, that the 16-bit sum can be calculated by adding up
 /// all bytes in the memory by storing them in two columns - one for all even bytes, and one for all odd bytes.
 /// "even" and "odd" are about the byte position in the memory, so bytes at 0,2,4,6, etc. offset are "even",
@@ -39,12 +35,12 @@ namespace Pravala
 /// Whenever addition of one of them causes data overflow, the opposite column is incremented by one.
 /// To be able to update checksum with chunks of different sizes, it supports updating it with only a single byte.
 /// That operation updates the checksum, and flips a flag that determines how the next byte should be treated
-/// (either as an "even" or "odd" byte). When adding another chunk to the calculation, first all bytes
-/// that are not aligned properly are appended - one at a time. Once we get to the position which is aligned properly,
-/// we calculate the checksum for the remaining data - 8 bytes at a time - to obtain a 64-bit sum of that value.
-/// Once 8 byte operations are no longer possible, we update it with 4B and 2B words at the end (if any),
-/// ignoring the last byte (if present) for now.
-/// Then this sum is reduced to 16-bit value, by adding halves of it to each other (twice), while following
+/// (either as an "even" or "odd" byte).
+/// When adding another chunk to the calculation, all complete 16-bit words of that chunk are summed up
+/// by one of the "sum engines" (see Implementation), ignoring the last byte (if present) for now.
+/// Engines do not care about memory alignment. They add 32-bit words (using 64-bit, SSE2 or AVX2 registers)
+/// to 64-bit accumulators, which are wide enough to never overflow, so there are no carries to deal with.
+/// The 64-bit sum is then reduced to 16-bit value, by adding halves of it to each other (twice), while following
 /// the overflow rules. That 64-bit sum consists of 8 bytes, each one contains the sum of all bytes of the original
 /// memory if we divided it into 8 columns. That reduction means we are just adding up values in bytes 0,2,4,6
 /// to each other, and we do the same for bytes 1,3,5,7. We just do that in two steps, first going from 8 to 4 columns,
@@ -59,7 +55,7 @@ namespace Pravala
 /// Note that for this to be possible, the checksum is stored in not-negated version, as a basic sum.
 /// The 'getChecksum()' method returns negated value (without modifying the sum itself).
 /// This algorithm is able to deal with unaligned memory of "weird" sizes properly, while still performing
-/// fast 64-bit operations on most of the data in larger chunks.
+/// fast wide operations on most of the data in larger chunks.
 class IpChecksum
 {
     public:
@@ -130,119 +126,7 @@ class IpChecksum
         /// @brief Appends more data to be checksummed.
         /// @param [in] data The data to be checksummed. Does NOT need to be aligned in any specific way.
         /// @param [in] size The size of the data passed.
-        inline void addMemory ( const char * data, size_t size )
-        {
-            if ( !data || size < 1 )
-            {
-                return;
-            }
-
-            // If the memory is not aligned, we want to add the bytes at the beginning one by one,
-            // until 'data' pointer is aligned properly. The number of bytes that need to be treated this
-            // way is between 0 (if the data is aligned properly), and 3 (if data % 4 == 1):
-            for ( size_t i = 4U - ( ( ( size_t ) data ) % 4U ); i > 0; --i )
-            {
-                addMemory ( *( data++ ) );
-
-                // We are done if we ever run out of data:
-                if ( --size < 1 )
-                    return;
-            }
-
-            // Now the memory should be aligned properly:
-            assert ( ( ( size_t ) data ) % 4U == 0 );
-            assert ( size > 0 );
-
-            uint64_t sum64 = 0;
-
-            // Let's add the data, 8 bytes at a time.
-            while ( size >= 8 )
-            {
-                assert ( ( ( size_t ) data ) % 4 == 0 );
-
-                const uint64_t v = *( ( const uint64_t * ) data );
-
-                ( ( sum64 += v ) < v ) && ++sum64;
-
-                data += 8;
-                size -= 8;
-            }
-
-            assert ( size <= 7 );
-
-            // Now we may have between 0 and 7 bytes left.
-            // We don't modify the size anymore, just check individual bits.
-            // We still need to modify the data pointer.
-
-            if ( size & 4 )
-            {
-                // 4-7 bytes left; Let's add 4:
-
-                const uint32_t v = *( ( const uint32_t * ) data );
-
-                ( ( sum64 += v ) < v ) && ++sum64;
-
-                data += 4;
-            }
-
-            if ( size & 2 )
-            {
-                // 2-3 bytes left; Let's add 2:
-
-                const uint16_t v = *( ( const uint16_t * ) data );
-
-                ( ( sum64 += v ) < v ) && ++sum64;
-
-                data += 2;
-            }
-
-            // NOTE: There could still be a single byte to deal with here!
-            //       But if there is, it means it's an odd byte, should be padded with 0, and modify _nextIdx.
-            //       Because of that we simply add that single byte at the end (after changing the checksum),
-            //       using addMemory ( char ) version.
-
-            // Now we have a 64-bit checksum.
-            // First, we need to reduce it to 16 bits, by adding halves of it to each other (twice):
-
-            ChecksumValue sum16;
-
-            {
-                uint32_t sum32 = ( uint32_t ) ( sum64 & 0xFFFFFFFFUL );
-                const uint32_t tmp32 = ( uint32_t ) ( sum64 >> 32 );
-
-                ( ( sum32 += tmp32 ) < tmp32 ) && ++sum32;
-
-                sum16.u16 = ( uint16_t ) ( sum32 & 0xFFFFU );
-                const uint16_t tmp16 = ( uint16_t ) ( sum32 >> 16 );
-
-                ( ( sum16.u16 += tmp16 ) < tmp16 ) && ++sum16.u16;
-            }
-
-            if ( _nextIdx != 0 )
-            {
-                // We are misaligned, which means that the last modification of the checksum
-                // did not end at a 2 byte boundary. We have to switch the bytes:
-
-                ChecksumValue v;
-
-                v.s8[ 0 ] = sum16.s8[ 1 ];
-                v.s8[ 1 ] = sum16.s8[ 0 ];
-
-                ( ( _sum.u16 += v.u16 ) < v.u16 ) && ++_sum.u16;
-            }
-            else if ( ( _sum.u16 += sum16.u16 ) < sum16.u16 )
-            {
-                ++_sum.u16;
-            }
-
-            if ( size & 1 )
-            {
-                // We have one additional byte to add!
-                // Because it's an odd byte it will affect _nextIdx.
-                // Let's just use the regular addMemory(char):
-                addMemory ( *data );
-            }
-        }
+        void addMemory ( const char * data, size_t size );
 
         /// @brief Convenience wrapper around IpChecksum object.
         /// It calculates a checksum for provided memory segment.
@@ -256,6 +140,25 @@ class IpChecksum
             return cSum.getChecksum();
         }
 
+        /// @brief The implementations of the engine that sums up the data.
+        enum Implementation
+        {
+            ImplAuto,     ///< The fastest implementation supported by the CPU.
+            ImplPortable, ///< Portable implementation that uses 64-bit words.
+            ImplSse2,     ///< Implementation that uses SSE2 instructions (x86 only).
+            ImplAvx2      ///< Implementation that uses AVX2 instructions (x86 only).
+        };
+
+        /// @brief Selects the implementation of the sum engine to use.
+        /// It is used by all IpChecksum objects, and should only be changed for testing and benchmarking.
+        /// @param [in] impl The implementation to use. ImplAuto selects the best one available.
+        /// @return True if the implementation was selected; False if it is not supported by this CPU or build.
+        static bool setImplementation ( Implementation impl );
+
+        /// @brief Returns the implementation of the sum engine currently in use.
+        /// @return The implementation of the sum engine currently in use (never ImplAuto).
+        static Implementation getImplementation();
+
     private:
         /// @brief Storage type for the checksum.
         /// It is stored in this way to simplify the code.
@@ -265,6 +168,15 @@ class IpChecksum
             uint16_t u16; ///< The checksum as a single uint16 value.
         };
 
+        /// @brief Type of the function that sums up the memory.
+        /// @param [in] data The data to sum up. Does NOT need to be aligned in any specific way.
+        /// @param [in] size The size of the data; It has to be an even number.
+        /// @return The 64-bit sum of the data. Reducing it to 16 bits gives the sum of all 16-bit words.
+        typedef uint64_t (* SumFunc)( const char * data, size_t size );
+
+        static SumFunc _sumFunc;            ///< The function used for summing up the memory.
+        static Implementation _sumFuncImpl; ///< The implementation of _sumFunc.
+
         ChecksumValue _sum; ///< The checksum so far (it is NOT negated).
 
         /// @brief The index in _sum.s8[] where the next byte of memory should go (either 1 or 0).
@@ -25,25 +25,24 @@ using namespace Pravala;
 const uint8_t IpFlow::DefaultDescType;
 #endif
 
-IpFlow::IpFlow(): _next ( 0 )
+IpFlow::IpFlow(): _mapEntries ( 0 )
 {
     _flowDesc.clear();
 }
 
-IpFlow::IpFlow ( const FlowDesc & flowDesc ): _flowDesc ( flowDesc ), _next ( 0 )
+IpFlow::IpFlow ( const FlowDesc & flowDesc ): _flowDesc ( flowDesc ), _mapEntries ( 0 )
 {
 }
 
 IpFlow::~IpFlow()
 {
-    assert ( !_next );
+    assert ( !isInMap() );
 }
 
 void IpFlow::setDefaultFlowDesc ( const FlowDesc & flowDesc )
 {
     // We must NOT be a part of a map.
-    // We cannot check that for sure, but if _next is set, we are a part of a map...
-    assert ( !_next );
+    assert ( !isInMap() );
 
     _flowDesc = flowDesc;
 }
@@ -75,7 +74,4 @@ bool IpFlow::mapInsert ( IpFlowMap & flowMap )
 void IpFlow::mapRemove ( IpFlowMap & flowMap )
 {
     flowMap.flowRemove ( this, _flowDesc );
-
-    // It should have been cleared, or never set:
-    assert ( !_next );
 }
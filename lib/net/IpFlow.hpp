@@ -68,11 +68,11 @@ class IpFlow
         /// @brief Destructor.
         virtual ~IpFlow();
 
-        /// @brief Returns the next IP flow object in the list.
-        /// @return The next IP flow object in the list.
-        inline const IpFlow * getNext() const
+        /// @brief Checks whether this flow is a part of an IpFlowMap.
+        /// @return True if this flow is a part of an IpFlowMap; False otherwise.
+        inline bool isInMap() const
         {
-            return _next;
+            return ( _mapEntries > 0 );
         }
 
         /// @brief Configures flow's default descriptor.
@@ -118,40 +118,10 @@ class IpFlow
 
     private:
         FlowDesc _flowDesc; ///< The flow descriptor for this object.
-        IpFlow * _next; ///< Pointer to the next IpFlow object in the same hash bucket.
 
-        /// @brief Returns the next IP flow object in the list.
-        /// @return The next IP flow object in the list.
-        inline IpFlow * getNext()
-        {
-            return _next;
-        }
-
-        /// @brief Clears the "next" pointer in this object, and returns its previous content.
-        /// @return The next IP flow object in the list (which is no longer stored in this object).
-        inline IpFlow * stealNext()
-        {
-            IpFlow * const next = _next;
-            _next = 0;
-
-            return next;
-        }
-
-        /// @brief Sets the 'next' pointer.
-        /// It only works if current 'next' pointer is unset.
-        /// @param [in] next The pointer to set.
-        /// @return True if the next has been modified (even if set to 0);
-        ///         False if this object already has a valid 'next' pointer (which was not modified).
-        inline bool setNext ( IpFlow * next )
-        {
-            if ( !_next )
-            {
-                _next = next;
-                return true;
-            }
-
-            return false;
-        }
+        /// @brief The number of IpFlowMap entries that point to this object.
+        /// Flows with more than one descriptor can have one entry for each of them.
+        uint8_t _mapEntries;
 
         friend class DualIpFlow;
         friend class IpFlowMap;
@@ -14,289 +14,518 @@
  *  limitations under the License.
  */
 
+#include <cstring>
+
 #include "IpFlowMap.hpp"
 
+/// @brief The max size of the map in bits.
+#define MAX_BIT_SIZE              30
+
+/// @brief The number of slots of the table being resized that are moved during every operation.
+/// Tables grow when they are 3/4 full, and after resizing they are at most 3/8 full, so even if only inserts
+/// were performed, resizing would be completed long before the new table needs to grow again.
+#define RESIZE_SLOTS_PER_STEP     8
+
+/// @brief The number of slots checked for expired flows during every look-up (in ExpireFlows mode).
+#define CLEANUP_SLOTS_PER_LOOKUP  1
+
 using namespace Pravala;
 
 IpFlowMap::IpFlowMap ( uint8_t bitSize ):
-    _bitSize ( bitSize ),
-    _mapSize ( 1 << _bitSize ),
-    _bitMask ( _mapSize - 1 ),
-    _flows ( new IpFlow *[ _mapSize ] ),
-    _usedBuckets ( 0 )
+    _minBitSize ( bitSize ),
+    _resizeIdx ( 0 ),
+    _resizeSlotsLeft ( 0 ),
+    _cleanupIdx ( 0 ),
+    _numLookups ( 0 ),
+    _numSlotsChecked ( 0 ),
+    _numFlowsChecked ( 0 ),
+    _numResizes ( 0 )
 {
-    assert ( _bitSize >= 8 );
-    assert ( _bitSize <= 30 );
-    assert ( _bitMask < _mapSize );
-    assert ( _bitMask + 1 == _mapSize );
+    assert ( _minBitSize >= 8 );
+    assert ( _minBitSize <= MAX_BIT_SIZE );
+
+    memset ( &_oldTable, 0, sizeof ( _oldTable ) );
 
-    memset ( _flows, 0, sizeof ( IpFlow * ) * _mapSize );
+    allocTable ( _table, _minBitSize );
 }
 
 IpFlowMap::~IpFlowMap()
 {
     clearMap();
 
+    assert ( isEmpty() );
+
+    freeTable ( _table );
+    freeTable ( _oldTable );
+}
+
+void IpFlowMap::allocTable ( Table & table, uint8_t bitSize )
+{
+    table.size = ( 1U << bitSize );
+    table.mask = table.size - 1;
+    table.bitSize = bitSize;
+    table.numEntries = 0;
+    table.tags = new uint32_t[ table.size ];
+    table.flows = new IpFlow *[ table.size ];
+
+    memset ( table.tags, 0, sizeof ( uint32_t ) * table.size );
+    memset ( table.flows, 0, sizeof ( IpFlow * ) * table.size );
+}
+
+void IpFlowMap::freeTable ( Table & table )
+{
 #ifndef NDEBUG
-    for ( size_t i = 0; i < _mapSize; ++i )
+    for ( uint32_t i = 0; i < table.size; ++i )
     {
-        assert ( !_flows[ i ] );
+        assert ( table.tags[ i ] == 0 );
+        assert ( !table.flows[ i ] );
     }
-    assert ( _usedBuckets == 0 );
 #endif
 
-    delete[] _flows;
+    assert ( table.numEntries == 0 );
+
+    delete[] table.tags;
+    delete[] table.flows;
+
+    memset ( &table, 0, sizeof ( table ) );
 }
 
-bool IpFlowMap::flowInsert ( IpFlow * flow, const FlowDesc & flowDesc )
+void IpFlowMap::tableInsert ( Table & table, uint32_t tag, IpFlow * flow )
 {
-    if ( !flow || !flowDesc.isValid() )
+    assert ( tag != 0 );
+    assert ( flow != 0 );
+    assert ( table.numEntries + 1 < table.size );
+
+    uint32_t idx = getIndex ( table, tag );
+
+    while ( table.tags[ idx ] != 0 )
     {
-        return false;
+        idx = ( idx + 1 ) & table.mask;
     }
 
-    const uint32_t index = getIndex ( flowDesc );
+    table.tags[ idx ] = tag;
+    table.flows[ idx ] = flow;
 
-    assert ( index < _mapSize );
+    ++table.numEntries;
+}
 
-    IpFlow * ptr = _flows[ index ];
+uint32_t IpFlowMap::tableFind ( const Table & table, uint32_t tag, const IpFlow * flow )
+{
+    if ( table.numEntries < 1 )
+    {
+        return table.size;
+    }
 
-    if ( !ptr )
+    for ( uint32_t idx = getIndex ( table, tag ); table.tags[ idx ] != 0; idx = ( idx + 1 ) & table.mask )
     {
-        _flows[ index ] = flow;
+        if ( table.tags[ idx ] == tag && table.flows[ idx ] == flow )
+        {
+            return idx;
+        }
+    }
+
+    return table.size;
+}
+
+void IpFlowMap::tableRemove ( Table & table, uint32_t idx )
+{
+    assert ( idx < table.size );
+    assert ( table.tags[ idx ] != 0 );
+    assert ( table.numEntries > 0 );
+
+    // We use linear probing, so we cannot simply clear the slot - entries that follow it may only be reachable
+    // through it. Instead, we move back entries that can be moved (the ones whose probe sequences start
+    // at, or before, the slot being cleared), and clear the last slot moved.
+
+    for ( uint32_t next = ( idx + 1 ) & table.mask; table.tags[ next ] != 0; next = ( next + 1 ) & table.mask )
+    {
+        const uint32_t nextDist = ( next - getIndex ( table, table.tags[ next ] ) ) & table.mask;
+
+        if ( nextDist >= ( ( next - idx ) & table.mask ) )
+        {
+            table.tags[ idx ] = table.tags[ next ];
+            table.flows[ idx ] = table.flows[ next ];
+            idx = next;
+        }
+    }
 
-        // This bucket was empty. Now it isn't.
-        assert ( _flows[ index ] != 0 );
+    table.tags[ idx ] = 0;
+    table.flows[ idx ] = 0;
 
-        ++_usedBuckets;
+    --table.numEntries;
+}
 
-        return true;
+IpFlow * IpFlowMap::tableLookup (
+        const Table & table, uint32_t tag, const FlowDesc & flowDesc, uint8_t descType,
+        uint64_t & slotsChecked, uint64_t & flowsChecked )
+{
+    if ( table.numEntries < 1 )
+    {
+        return 0;
     }
 
-    while ( true )
+    for ( uint32_t idx = getIndex ( table, tag ); table.tags[ idx ] != 0; idx = ( idx + 1 ) & table.mask )
     {
-        if ( ptr == flow )
+        ++slotsChecked;
+
+        if ( table.tags[ idx ] == tag )
         {
-            // This object is already in the list...
-            return true;
+            ++flowsChecked;
+
+            assert ( table.flows[ idx ] != 0 );
+
+            if ( table.flows[ idx ]->matchFlow ( flowDesc, descType ) )
+            {
+                return table.flows[ idx ];
+            }
         }
+    }
+
+    return 0;
+}
 
-        if ( ptr->conflictsWith ( flow ) || flow->conflictsWith ( ptr ) )
+void IpFlowMap::checkSize ( uint32_t numNewEntries )
+{
+    if ( _oldTable.size > 0 )
+    {
+        // We are still resizing. If we are about to fill the new table (which really shouldn't happen),
+        // we need to finish resizing now, so we can start another one.
+
+        if ( ( _table.numEntries + numNewEntries ) * 4 <= _table.size * 3 )
         {
-            // These two flows conflict with each other.
-            // They cannot be in the map at the same time.
-            return false;
+            return;
         }
 
-        if ( ptr->setNext ( flow ) )
+        resizeStep ( _resizeSlotsLeft );
+    }
+
+    assert ( _oldTable.size == 0 );
+
+    const uint32_t numEntries = _table.numEntries + numNewEntries;
+    uint8_t newBitSize = _table.bitSize;
+
+    if ( numEntries * 4 > _table.size * 3 )
+    {
+        if ( _table.bitSize >= MAX_BIT_SIZE )
         {
-            return true;
+            // The max size - we can't grow anymore.
+            return;
         }
 
-        ptr = ptr->getNext();
+        ++newBitSize;
+    }
+    else if ( numEntries * 16 < _table.size && _table.bitSize > _minBitSize )
+    {
+        --newBitSize;
+    }
+    else
+    {
+        return;
+    }
+
+    _oldTable = _table;
+
+    allocTable ( _table, newBitSize );
+
+    // We need to start moving entries at an empty slot (see _resizeIdx).
+    // There always is one, since the table is never full.
 
-        // Otherwise 'setNext' would have worked:
-        assert ( ptr != 0 );
+    _resizeIdx = 0;
+
+    while ( _oldTable.tags[ _resizeIdx ] != 0 )
+    {
+        ++_resizeIdx;
     }
 
-    assert ( false );
+    _resizeSlotsLeft = _oldTable.size;
+    _cleanupIdx = 0;
 
-    return false;
+    ++_numResizes;
 }
 
-void IpFlowMap::flowRemove ( IpFlow * flow, const FlowDesc & flowDesc )
+void IpFlowMap::resizeStep ( uint32_t numSlots )
 {
-    if ( !flow || !flowDesc.isValid() )
+    if ( _oldTable.size < 1 )
     {
         return;
     }
 
-    const uint32_t index = getIndex ( flowDesc );
+    for ( ; numSlots > 0 && _resizeSlotsLeft > 0; --numSlots, --_resizeSlotsLeft )
+    {
+        _resizeIdx = ( _resizeIdx - 1 ) & _oldTable.mask;
+
+        if ( _oldTable.tags[ _resizeIdx ] == 0 )
+        {
+            continue;
+        }
+
+        // The next slot is empty (or has just been moved), so nothing needs to be moved back
+        // after clearing this one.
+        assert ( _oldTable.tags[ ( _resizeIdx + 1 ) & _oldTable.mask ] == 0 );
+
+        tableInsert ( _table, _oldTable.tags[ _resizeIdx ], _oldTable.flows[ _resizeIdx ] );
+
+        _oldTable.tags[ _resizeIdx ] = 0;
+        _oldTable.flows[ _resizeIdx ] = 0;
+
+        assert ( _oldTable.numEntries > 0 );
+
+        --_oldTable.numEntries;
+    }
+
+    if ( _resizeSlotsLeft < 1 )
+    {
+        freeTable ( _oldTable );
+    }
+}
 
-    assert ( index < _mapSize );
+bool IpFlowMap::flowInsert ( IpFlow * flow, const FlowDesc & flowDesc )
+{
+    if ( !flow || !flowDesc.isValid() )
+    {
+        return false;
+    }
 
-    IpFlow * prev = 0;
-    IpFlow * ptr = _flows[ index ];
+    const uint32_t tag = getTag ( flowDesc );
+    const Table * const tables[ 2 ] = { &_table, &_oldTable };
 
-    while ( ptr != 0 )
+    for ( size_t t = 0; t < 2; ++t )
     {
-        if ( ptr != flow )
+        const Table & table = *tables[ t ];
+
+        if ( table.numEntries < 1 )
         {
-            prev = ptr;
-            ptr = ptr->getNext();
             continue;
         }
 
-        IpFlow * const next = ptr->stealNext();
-
-        if ( !prev )
+        for ( uint32_t idx = getIndex ( table, tag ); table.tags[ idx ] != 0; idx = ( idx + 1 ) & table.mask )
         {
-            assert ( _flows[ index ] == ptr );
+            if ( table.tags[ idx ] != tag )
+            {
+                continue;
+            }
 
-            _flows[ index ] = next;
+            IpFlow * const ptr = table.flows[ idx ];
 
-            if ( !next )
+            if ( ptr == flow )
             {
-                // This bucket was non-empty. Now it is empty.
-                assert ( _usedBuckets > 0 );
+                // This object is already in the map...
+                return true;
+            }
 
-                --_usedBuckets;
+            if ( ptr->conflictsWith ( flow ) || flow->conflictsWith ( ptr ) )
+            {
+                // These two flows conflict with each other.
+                // They cannot be in the map at the same time.
+                return false;
             }
         }
-        else
-        {
-            // We need to unset 'next' in the previous object, to be able to update it.
-            IpFlow * const tmp = prev->stealNext();
+    }
 
-            ( void ) tmp;
-            assert ( tmp == ptr );
+    resizeStep ( RESIZE_SLOTS_PER_STEP );
+    checkSize ( 1 );
 
-            const bool ret = prev->setNext ( next );
+    if ( _table.numEntries + 1 >= _table.size || flow->_mapEntries >= 0xFF )
+    {
+        // The map is full (at its max size), or the flow uses too many entries.
+        return false;
+    }
 
-            ( void ) ret;
-            assert ( ret );
-        }
+    tableInsert ( _table, tag, flow );
 
-        return;
-    }
+    ++flow->_mapEntries;
+
+    return true;
 }
 
-IpFlow * IpFlowMap::findFlow ( const FlowDesc & flowDesc, uint8_t descType, ExpiryMode expMode )
+void IpFlowMap::flowRemove ( IpFlow * flow, const FlowDesc & flowDesc )
 {
-    if ( !flowDesc.isValid() )
+    if ( !flow || !flowDesc.isValid() )
     {
-        return 0;
+        return;
     }
 
-    const uint32_t index = getIndex ( flowDesc );
-
-    assert ( index < _mapSize );
+    const uint32_t tag = getTag ( flowDesc );
+    Table * const tables[ 2 ] = { &_table, &_oldTable };
 
-    for ( IpFlow * ptr = _flows[ index ]; ptr != 0; )
+    for ( size_t t = 0; t < 2; ++t )
     {
-        if ( expMode == ExpireFlows && ptr->isExpired() )
+        Table & table = *tables[ t ];
+        const uint32_t idx = tableFind ( table, tag, flow );
+
+        if ( idx < table.size )
         {
-            // There is a flow in the list that is now expired.
-            // Let's clear this bucket, and start over.
-            // Also, we only want to do this once, so we switch to "don't expire" mode.
+            tableRemove ( table, idx );
 
-            expMode = DontExpireFlows;
-            cleanupFlows ( index );
-            ptr = _flows[ index ];
+            assert ( flow->_mapEntries > 0 );
 
-            continue;
+            --flow->_mapEntries;
+            break;
         }
-
-        if ( ptr->matchFlow ( flowDesc, descType ) )
-        {
-            return ptr;
-        }
-
-        ptr = ptr->getNext();
     }
 
-    return 0;
+    resizeStep ( RESIZE_SLOTS_PER_STEP );
+    checkSize ( 0 );
 }
 
-const IpFlow * IpFlowMap::findFlow ( const FlowDesc & flowDesc, uint8_t descType ) const
+IpFlow * IpFlowMap::findFlow ( const FlowDesc & flowDesc, uint8_t descType, ExpiryMode expMode )
 {
     if ( !flowDesc.isValid() )
     {
         return 0;
     }
 
-    const uint32_t index = getIndex ( flowDesc );
+    resizeStep ( RESIZE_SLOTS_PER_STEP );
 
-    assert ( index < _mapSize );
+    if ( expMode == ExpireFlows )
+    {
+        cleanupFlows ( CLEANUP_SLOTS_PER_LOOKUP );
+    }
+
+    const uint32_t tag = getTag ( flowDesc );
 
-    for ( const IpFlow * ptr = _flows[ index ]; ptr != 0; ptr = ptr->getNext() )
+    ++_numLookups;
+
+    IpFlow * flow = tableLookup ( _table, tag, flowDesc, descType, _numSlotsChecked, _numFlowsChecked );
+
+    if ( !flow )
     {
-        if ( ptr->matchFlow ( flowDesc, descType ) )
-        {
-            return ptr;
-        }
+        flow = tableLookup ( _oldTable, tag, flowDesc, descType, _numSlotsChecked, _numFlowsChecked );
     }
 
-    return 0;
+    if ( flow != 0 && expMode == ExpireFlows && flow->isExpired() )
+    {
+        // There may be other pointers to this flow:
+        flow->mapRemove ( *this );
+        flow->flowRemoved();
+
+        return 0;
+    }
+
+    return flow;
 }
 
-void IpFlowMap::cleanupFlows ( uint32_t index )
+const IpFlow * IpFlowMap::findFlow ( const FlowDesc & flowDesc, uint8_t descType ) const
 {
-    if ( index >= _mapSize )
+    if ( !flowDesc.isValid() )
     {
-        assert ( false );
-        return;
+        return 0;
     }
 
-    if ( !_flows[ index ] )
-    {
-        // Nothing to do...
-        return;
-    }
+    const uint32_t tag = getTag ( flowDesc );
 
-    // To perform flow cleanup, we remove the entire list from the map.
-    // Then we will inspect flows one by one, and re-insert them if needed.
+    // This version doesn't update the statistics:
+    uint64_t slotsChecked = 0;
+    uint64_t flowsChecked = 0;
 
-    IpFlow * ptr = _flows[ index ];
-    _flows[ index ] = 0;
+    const IpFlow * const flow = tableLookup ( _table, tag, flowDesc, descType, slotsChecked, flowsChecked );
 
-    assert ( _usedBuckets > 0 );
+    return ( flow != 0 )
+           ? flow : tableLookup ( _oldTable, tag, flowDesc, descType, slotsChecked, flowsChecked );
+}
 
-    // We just emptied one of the buckets.
-    --_usedBuckets;
+uint32_t IpFlowMap::cleanupFlows ( uint32_t numSlots )
+{
+    uint32_t numRemoved = 0;
 
-    while ( ptr != 0 )
+    for ( ; numSlots > 0 && _table.numEntries > 0; --numSlots )
     {
-        // We want to unset 'next' pointer.
-        // This way removing or re-inserting flows won't affect this list.
-        IpFlow * const next = ptr->stealNext();
+        _cleanupIdx &= _table.mask;
 
-        if ( ptr->isExpired() )
-        {
-            // There may be other pointers to this flow:
-            ptr->mapRemove ( *this );
-            ptr->flowRemoved();
-        }
-        else
+        IpFlow * const flow = _table.flows[ _cleanupIdx ];
+
+        if ( !flow || !flow->isExpired() )
         {
-            // Not expired yet, let's re-insert it:
-            ptr->mapInsert ( *this );
+            ++_cleanupIdx;
+            continue;
         }
 
-        ptr = next;
+        // This may move other entries back to this slot (which will be checked next),
+        // and it may also start resizing (which resets _cleanupIdx).
+        flow->mapRemove ( *this );
+        flow->flowRemoved();
+
+        ++numRemoved;
     }
+
+    return numRemoved;
 }
 
 void IpFlowMap::clearMap()
 {
-    if ( _usedBuckets < 1 )
-    {
-        return;
-    }
+    Table * const tables[ 2 ] = { &_oldTable, &_table };
 
-    for ( uint32_t index = 0; index < _mapSize; ++index )
+    for ( size_t t = 0; t < 2; ++t )
     {
-        IpFlow * ptr = _flows[ index ];
-        _flows[ index ] = 0;
+        Table & table = *tables[ t ];
 
-        if ( !ptr )
+        for ( uint32_t idx = 0; idx < table.size && table.numEntries > 0; ++idx )
         {
-            continue;
+            IpFlow * const flow = table.flows[ idx ];
+
+            if ( !flow )
+            {
+                continue;
+            }
+
+            table.tags[ idx ] = 0;
+            table.flows[ idx ] = 0;
+
+            --table.numEntries;
+
+            assert ( flow->_mapEntries > 0 );
+
+            // Flows with several descriptors are only removed once the last of their entries is removed:
+            if ( --flow->_mapEntries < 1 )
+            {
+                flow->flowRemoved();
+            }
         }
+    }
+
+    freeTable ( _oldTable );
+
+    if ( _table.bitSize != _minBitSize )
+    {
+        freeTable ( _table );
+        allocTable ( _table, _minBitSize );
+    }
+
+    _resizeSlotsLeft = 0;
+    _cleanupIdx = 0;
+}
+
+void IpFlowMap::getStats ( IpFlowMap::Stats & stats ) const
+{
+    memset ( &stats, 0, sizeof ( stats ) );
 
-        assert ( _usedBuckets > 0 );
+    stats.numSlots = _table.size + _oldTable.size;
+    stats.numEntries = getNumEntries();
+    stats.numLookups = _numLookups;
+    stats.numSlotsChecked = _numSlotsChecked;
+    stats.numFlowsChecked = _numFlowsChecked;
+    stats.numResizes = _numResizes;
+    stats.isResizing = ( _oldTable.size > 0 );
 
-        // We just emptied one of the buckets.
-        --_usedBuckets;
+    const Table * const tables[ 2 ] = { &_table, &_oldTable };
 
-        while ( ptr != 0 )
+    for ( size_t t = 0; t < 2; ++t )
+    {
+        const Table & table = *tables[ t ];
+
+        for ( uint32_t idx = 0; idx < table.size; ++idx )
         {
-            // We want to unset 'next' pointer.
-            // This way removing or re-inserting flows won't affect this list.
-            IpFlow * const next = ptr->stealNext();
+            if ( table.tags[ idx ] != 0 )
+            {
+                const uint32_t len = 1 + ( ( idx - getIndex ( table, table.tags[ idx ] ) ) & table.mask );
 
-            ptr->flowRemoved();
-            ptr = next;
+                stats.totalProbeLength += len;
+
+                if ( len > stats.maxProbeLength )
+                {
+                    stats.maxProbeLength = len;
+                }
+            }
         }
     }
 }
@@ -22,8 +22,14 @@
 namespace Pravala
 {
 /// @brief A hash map for storing IpFlow objects.
-/// @note This only allocates the memory for the first level of the hash map, and provides the getIndex() method.
-///       The second level is done by the IpFlow object and, at least for now, is implemented as a linked list.
+/// It uses open addressing with linear probing. Each slot has a 32 bit tag (the hash of the flow descriptor,
+/// or 0 if the slot is empty) and a pointer to the flow. Tags are stored in a separate, compact array,
+/// so most of the slots that don't match are rejected without touching the flow objects (or even the pointers).
+/// Flows that use more than one descriptor (like DualIpFlow) have one entry for each of them.
+///
+/// The map grows (and shrinks, down to its initial size) based on its load factor. Resizing is incremental:
+/// a new table is allocated, and entries are moved to it a few at a time, during subsequent operations.
+/// Until that is completed, look-ups check both tables.
 class IpFlowMap: public NoCopy
 {
     public:
@@ -33,30 +39,64 @@ class IpFlowMap: public NoCopy
             DontExpireFlows, ///< Flows will not be automatically expired while performing look-ups.
 
             /// @brief When performing look-ups, flows' expiration status is checked.
-            /// If any flow in the same bucket is expired, the entire bucket is cleaned up.
+            /// If the flow found is expired, it is removed (and the look-up fails).
+            /// Also, each look-up checks the next slot of the map (see cleanupFlows()), so idle flows
+            /// eventually get removed as well.
             ExpireFlows
         };
 
+        /// @brief Statistics of the map.
+        struct Stats
+        {
+            uint32_t numSlots; ///< The number of slots in the map (including the table being resized, if any).
+            uint32_t numEntries; ///< The number of entries. Flows with more than one descriptor use more entries.
+
+            /// @brief The longest probe sequence of all entries.
+            /// This is the max number of slots that need to be checked to find an existing entry.
+            uint32_t maxProbeLength;
+
+            /// @brief The sum of probe sequence lengths of all entries.
+            /// Dividing it by numEntries gives the average number of slots checked to find an existing entry.
+            uint64_t totalProbeLength;
+
+            uint64_t numLookups; ///< The number of look-ups performed (using the non-const findFlow()).
+            uint64_t numSlotsChecked; ///< The number of slots checked by those look-ups.
+
+            /// @brief The number of flow objects examined by those look-ups (only done when the tags match).
+            uint64_t numFlowsChecked;
+
+            uint32_t numResizes; ///< The number of times the map has been resized.
+            bool isResizing; ///< Whether the map is being resized right now.
+        };
+
         /// @brief Constructor.
-        /// @param [in] bitSize The size of the FlowMap in BITS.
-        ///                     Value '10' means 10 bits, and represents map with 1024 entries.
-        ///                     Allowed range: 8 - 30. On 64 bit value 24 will use 128MB of memory; 28 will use 2GB.
+        /// @param [in] bitSize The initial size of the FlowMap in BITS.
+        ///                     Value '10' means 10 bits, and represents map with 1024 slots.
+        ///                     Allowed range: 8 - 30. On 64 bit each slot uses 12 bytes.
+        ///                     The map will grow when needed, but it will never shrink below this size.
         IpFlowMap ( uint8_t bitSize );
 
         /// @brief Destructor.
-        /// It deallocates the map, which should have been emptied
-        /// (and filled with zeroes) by the time this gets called!
+        /// It clears the map, which should have been emptied by the time this gets called!
         ~IpFlowMap();
 
         /// @brief Checks if the flow map is empty.
         /// @return True if the flow map is empty; False otherwise.
         inline bool isEmpty() const
         {
-            return ( _usedBuckets < 1 );
+            return ( _table.numEntries < 1 && _oldTable.numEntries < 1 );
+        }
+
+        /// @brief Returns the number of entries in the map.
+        /// This is NOT the number of flow objects stored, since some flows use more than one entry.
+        /// @return The number of entries in the map.
+        inline uint32_t getNumEntries() const
+        {
+            return _table.numEntries + _oldTable.numEntries;
         }
 
         /// @brief Clears the flow map.
-        /// It will send 'SignalRemove' to all the flows.
+        /// It will call flowRemoved() in all the flows.
         void clearMap();
 
         /// @brief Returns a pointer to IP flow object matching given descriptor.
@@ -72,35 +112,18 @@ class IpFlowMap: public NoCopy
         /// @return IP flow object that represents given descriptor, or 0 if it was not found in the map
         const IpFlow * findFlow ( const FlowDesc & flowDesc, uint8_t descType ) const;
 
-    protected:
-        const uint8_t _bitSize; ///< The bit size of the map
-        const uint32_t _mapSize; ///< The size of the map
-        const uint32_t _bitMask; ///< The bitmask to apply to hash values for XOR-folding
-
-        IpFlow ** const _flows; ///< Content of the map.
+        /// @brief Generates statistics of the map.
+        /// It inspects every entry in the map, so it should not be called too often.
+        /// @param [out] stats The statistics to fill.
+        void getStats ( Stats & stats ) const;
 
-        /// @brief Returns the index of the hash bucket that should be used for particular FlowDesc.
-        /// @param [in] flowDesc The FlowDesc to find.
-        /// @return Index to the hash bucket to be used for this FlowDesc.
-        inline uint32_t getIndex ( const FlowDesc & flowDesc ) const
-        {
-            const uint32_t hash = flowDesc.getHash();
-
-            // 32 bits is too much for sure! Let's use XOR-folding:
-            return ( ( ( hash >> _bitSize ) ^ hash ) & _bitMask );
-        }
-
-        /// @brief Returns the number of used flow buckets.
-        /// This is NOT the number of flow objects stored.
-        /// @return The number of used flow buckets.
-        inline uint32_t getNumUsedBuckets() const
-        {
-            return _usedBuckets;
-        }
-
-        /// @brief Sends 'SignalCleanup' to each flow in the given bucket.
-        /// @param [in] index The index to check. MUST be < _mapSize.
-        void cleanupFlows ( uint32_t index );
+    protected:
+        /// @brief Checks up to the given number of slots for expired flows, and removes them.
+        /// Every call continues where the previous one finished, so calling it periodically
+        /// (or with the number of slots equal to the size of the map) removes all expired flows.
+        /// @param [in] numSlots The number of slots to check.
+        /// @return The number of flows removed.
+        uint32_t cleanupFlows ( uint32_t numSlots );
 
         /// @brief Inserts given IP flow into the map.
         /// Inserting flow for the second time will succeed.
@@ -124,9 +147,111 @@ class IpFlowMap: public NoCopy
         }
 
     private:
-        /// @brief The number of non-empty flow buckets.
-        /// This is NOT the number of flow objects, this is the number of buckets that have at least one flow in them.
-        uint32_t _usedBuckets;
+        /// @brief A single hash table.
+        struct Table
+        {
+            uint32_t * tags; ///< Tags of all slots; 0 means that the slot is empty.
+            IpFlow ** flows; ///< Flows in all slots.
+            uint32_t size; ///< The number of slots. Always a power of 2 (or 0 if the table is not allocated).
+            uint32_t mask; ///< The bitmask to apply to slot indexes.
+            uint8_t bitSize; ///< The size of the table in bits.
+            uint32_t numEntries; ///< The number of entries in the table.
+        };
+
+        const uint8_t _minBitSize; ///< The min (and initial) size of the map in bits.
+
+        /// @brief The table that is used for inserting new entries.
+        Table _table;
+
+        /// @brief The table that is being resized.
+        /// Its entries are moved to _table (a few during every operation), and once it is empty, it is released.
+        /// Its size is 0 if the map is not being resized.
+        Table _oldTable;
+
+        /// @brief The index of the slot in _oldTable that was moved most recently.
+        /// Slots are moved starting from an empty slot, going down. So when a slot is being moved,
+        /// the slot after it is always empty, and moving it doesn't break look-ups of other entries.
+        uint32_t _resizeIdx;
+
+        uint32_t _resizeSlotsLeft; ///< The number of _oldTable slots that still need to be moved.
+        uint32_t _cleanupIdx; ///< The index of the slot in _table to be checked by the next cleanupFlows() call.
+
+        uint64_t _numLookups; ///< The number of look-ups performed.
+        uint64_t _numSlotsChecked; ///< The number of slots checked during look-ups.
+        uint64_t _numFlowsChecked; ///< The number of flows examined during look-ups.
+        uint32_t _numResizes; ///< The number of times the map has been resized.
+
+        /// @brief Returns the tag to be used for particular FlowDesc.
+        /// @param [in] flowDesc The FlowDesc to use.
+        /// @return The tag to be used for this FlowDesc; Never 0.
+        static inline uint32_t getTag ( const FlowDesc & flowDesc )
+        {
+            const uint32_t hash = flowDesc.getHash();
+
+            // 0 means 'empty slot':
+            return ( hash != 0 ) ? hash : 1;
+        }
+
+        /// @brief Returns the index of the first slot that should be checked for the given tag.
+        /// @param [in] table The table to use.
+        /// @param [in] tag The tag to use.
+        /// @return The index of the first slot that should be checked for the given tag.
+        static inline uint32_t getIndex ( const Table & table, uint32_t tag )
+        {
+            // 32 bits is too much for sure! Let's use XOR-folding:
+            return ( ( ( tag >> table.bitSize ) ^ tag ) & table.mask );
+        }
+
+        /// @brief Allocates memory of a table.
+        /// @param [out] table The table to initialize.
+        /// @param [in] bitSize The size of the table in bits.
+        static void allocTable ( Table & table, uint8_t bitSize );
+
+        /// @brief Releases memory of a table.
+        /// The table should be empty.
+        /// @param [in,out] table The table to release. It will be cleared.
+        static void freeTable ( Table & table );
+
+        /// @brief Adds an entry to the table.
+        /// It does not check whether the entry exists already. The table must have at least one empty slot left.
+        /// @param [in] table The table to modify.
+        /// @param [in] tag The tag of the entry.
+        /// @param [in] flow The flow of the entry.
+        static void tableInsert ( Table & table, uint32_t tag, IpFlow * flow );
+
+        /// @brief Finds a specific entry in the table.
+        /// @param [in] table The table to search.
+        /// @param [in] tag The tag of the entry.
+        /// @param [in] flow The flow of the entry.
+        /// @return The index of the entry's slot, or table's size if it was not found.
+        static uint32_t tableFind ( const Table & table, uint32_t tag, const IpFlow * flow );
+
+        /// @brief Removes the entry from the given slot.
+        /// It moves entries that follow it back, so there are no gaps in probe sequences.
+        /// @param [in] table The table to modify.
+        /// @param [in] idx The index of the slot to clear. It must not be empty.
+        static void tableRemove ( Table & table, uint32_t idx );
+
+        /// @brief Looks up a flow in the table.
+        /// @param [in] table The table to search.
+        /// @param [in] tag The tag of the flow descriptor.
+        /// @param [in] flowDesc The flow descriptor to match against.
+        /// @param [in] descType The type of the descriptor to match against.
+        /// @param [out] slotsChecked Incremented by the number of slots checked.
+        /// @param [out] flowsChecked Incremented by the number of flows examined.
+        /// @return The flow found, or 0 if it was not found.
+        static IpFlow * tableLookup (
+            const Table & table, uint32_t tag, const FlowDesc & flowDesc, uint8_t descType,
+            uint64_t & slotsChecked, uint64_t & flowsChecked );
+
+        /// @brief Checks whether the table should be resized, and starts resizing if needed.
+        /// @param [in] numNewEntries The number of entries that are about to be added to the map.
+        void checkSize ( uint32_t numNewEntries );
+
+        /// @brief Moves up to the given number of slots from the table being resized to the current table.
+        /// It does nothing if the map is not being resized.
+        /// @param [in] numSlots The max number of slots to move.
+        void resizeStep ( uint32_t numSlots );
 
         /// @brief Internal function to insert flows into the map.
         /// It is safe to call this even if the flow is already a part of the map.
@@ -44,6 +44,12 @@ struct ip
     uint16_t ip_id;                     /* identification */
     uint16_t ip_off;                    /* fragment offset field */
 #define IP_OFFMASK    0x1fff            /* mask for fragmenting bits */
+#ifndef IP_DF
+#define IP_DF         0x4000            /* dont fragment flag */
+#endif
+#ifndef IP_MF
+#define IP_MF         0x2000            /* more fragments flag */
+#endif
     uint8_t ip_ttl;                     /* time to live */
     uint8_t ip_p;                       /* protocol */
     uint16_t ip_sum;                    /* checksum */
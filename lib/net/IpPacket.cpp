@@ -56,26 +56,80 @@ IpPacket::IpPacket ( const MemHandle & data )
     if ( data.isEmpty() )
         return;
 
+    const size_t packetSize = readPacketSize ( data.get(), data.size() );
+
+    if ( packetSize < 1 )
+        return;
+
+    if ( data.size() < packetSize )
+    {
+        LOG ( L_ERROR, "Incomplete IP packet received; Required " << packetSize
+              << "B; Received: " << data.size() << "B" );
+        return;
+    }
+
+    if ( data.size() > packetSize )
+    {
+        // This buffer contains something after the IP packet...
+        _buffer = data.getHandle ( 0, packetSize );
+    }
+    else
+    {
+        _buffer = data;
+    }
+}
+
+IpPacket::IpPacket ( const MemVector & data )
+{
+    if ( data.isEmpty() )
+        return;
+
+    assert ( data.getChunks() != 0 );
+
+    const size_t packetSize = readPacketSize (
+        static_cast<const char *> ( data.getChunks()[ 0 ].iov_base ), data.getChunks()[ 0 ].iov_len );
+
+    if ( packetSize < 1 )
+        return;
+
+    if ( data.getDataSize() < packetSize )
+    {
+        LOG ( L_ERROR, "Incomplete IP packet received; Required " << packetSize
+              << "B; Received: " << data.getDataSize() << "B" );
+        return;
+    }
+
+    _buffer = data;
+
+    if ( _buffer.getDataSize() > packetSize )
+    {
+        // This buffer contains something after the IP packet...
+        _buffer.truncate ( packetSize );
+    }
+}
+
+size_t IpPacket::readPacketSize ( const char * data, size_t dataSize )
+{
     // To make sure the alignment is correct.
-    if ( ( ( size_t ) data.get() ) % 4U != 0 )
+    if ( ( ( size_t ) data ) % 4U != 0 )
     {
         LOG ( L_FATAL_ERROR, "Unaligned IP memory received!" );
 
         assert ( false );
 
-        return;
+        return 0;
     }
 
     // We need at least base IPv4 header (w/o options) to determine anything about the packet,
     // including saying whether it's an IPv4 or IPv6 packet.
 
-    if ( data.size() < sizeof ( struct ip ) )
+    if ( dataSize < sizeof ( struct ip ) )
     {
-        LOG ( L_ERROR, "Packet is too small (" << data.size() << "B)" );
-        return;
+        LOG ( L_ERROR, "Packet is too small (" << dataSize << "B)" );
+        return 0;
     }
 
-    const DualIpHeader * ipHdrPtr = reinterpret_cast<const DualIpHeader *> ( data.get() );
+    const DualIpHeader * ipHdrPtr = reinterpret_cast<const DualIpHeader *> ( data );
 
     size_t packetSize = 0;
 
@@ -86,7 +140,13 @@ IpPacket::IpPacket ( const MemHandle & data )
         if ( ipHdrPtr->v4.ip_hl < 5 )
         {
             LOG ( L_ERROR, "IPv4 header length (" << ipHdrPtr->v4.ip_hl << ") < 5 words" );
-            return;
+            return 0;
+        }
+
+        if ( dataSize < 4U * ipHdrPtr->v4.ip_hl )
+        {
+            LOG ( L_ERROR, "IPv4 header is incomplete (" << dataSize << "B)" );
+            return 0;
         }
 
         packetSize = ntohs ( ipHdrPtr->v4.ip_len );
@@ -94,21 +154,21 @@ IpPacket::IpPacket ( const MemHandle & data )
         if ( packetSize < sizeof ( struct ip ) )
         {
             LOG ( L_ERROR, "Packet with invalid IP header size set (" << packetSize << "B)" );
-            return;
+            return 0;
         }
     }
     else if ( ipHdrPtr->v4.ip_v == 6 )
     {
-        if ( data.size() < sizeof ( struct ip6_hdr ) )
+        if ( dataSize < sizeof ( struct ip6_hdr ) )
         {
-            LOG ( L_ERROR, "IPv6 packet is too small (" << data.size() << "B)" );
-            return;
+            LOG ( L_ERROR, "IPv6 packet is too small (" << dataSize << "B)" );
+            return 0;
         }
 
         if ( ipHdrPtr->v6.ip6_plen == 0 )
         {
             LOG ( L_ERROR, "Unsupported IPv6 Jumbo packet received" );
-            return;
+            return 0;
         }
 
         packetSize = ntohs ( ipHdrPtr->v6.ip6_plen ) + sizeof ( struct ip6_hdr );
@@ -116,25 +176,10 @@ IpPacket::IpPacket ( const MemHandle & data )
     else
     {
         LOG ( L_ERROR, "Unsupported IPv? packet received: " << ipHdrPtr->v4.ip_v );
-        return;
-    }
-
-    if ( data.size() < packetSize )
-    {
-        LOG ( L_ERROR, "Incomplete IP packet received; Required " << packetSize
-              << "B; Received: " << data.size() << "B" );
-        return;
+        return 0;
     }
 
-    if ( data.size() > packetSize )
-    {
-        // This buffer contains something after the IP packet...
-        _buffer = data.getHandle ( 0, packetSize );
-    }
-    else
-    {
-        _buffer = data;
-    }
+    return packetSize;
 }
 
 char * IpPacket::initProtoPacket (
@@ -394,29 +439,15 @@ bool IpPacket::getAddr ( IpAddress & srcAddr, IpAddress & dstAddr ) const
     return false;
 }
 
-uint16_t IpPacket::calcPseudoHeaderPayloadChecksum() const
+/// @brief Adds the "pseudo header" used by TCP and UDP checksums to the checksum.
+/// @param [in,out] ipChecksum The checksum to add the pseudo header to.
+/// @param [in] ipHdrPtr The IP header of the packet. It has to be an IPv4 or IPv6 header.
+/// @param [in] dataSize Total IP data size (internal protocol header and payload, w/o IP header).
+static void addPseudoHeader ( IpChecksum & ipChecksum, const DualIpHeader * ipHdrPtr, uint32_t dataSize )
 {
-    if ( _buffer.isEmpty() )
-        return 0;
-
-    const struct iovec * const chunks = _buffer.getChunks();
-
-    assert ( chunks != 0 );
-    assert ( chunks[ 0 ].iov_len >= sizeof ( struct ip ) );
-
-    const DualIpHeader * ipHdrPtr = static_cast<const DualIpHeader *> ( chunks[ 0 ].iov_base );
-
-    assert ( ipHdrPtr != 0 );
-    assert ( ( ( size_t ) ipHdrPtr ) % 4U == 0 );
-
-    // Let's calculate the checksum.
-    IpChecksum ipChecksum;
-
-    size_t ipHdrSize = 0;
-
     if ( ipHdrPtr->v4.ip_v == 4 )
     {
-        // We start with IPv4 "pseudo header". It contains following fields, in order:
+        // IPv4 "pseudo header" contains following fields, in order:
         //  srcAddr (4 bytes)
         //  destAddr (4 bytes)
         //  null (1 byte)
@@ -435,17 +466,15 @@ uint16_t IpPacket::calcPseudoHeaderPayloadChecksum() const
         ipChecksum.addMemory ( &v, 1 );
         ipChecksum.addMemory ( &ipHdrPtr->v4.ip_p, 1 );
 
-        ipHdrSize = 4 * ipHdrPtr->v4.ip_hl;
-
-        v = htons ( _buffer.getDataSize() - ipHdrSize );
+        v = htons ( ( uint16_t ) dataSize );
 
         ipChecksum.addMemory ( &v, 2 );
     }
-    else if ( ipHdrPtr->v4.ip_v == 6 )
+    else
     {
-        assert ( chunks[ 0 ].iov_len >= sizeof ( struct ip6_hdr ) );
+        assert ( ipHdrPtr->v4.ip_v == 6 );
 
-        // We start with IPv6 "pseudo header". It contains following fields, in order:
+        // IPv6 "pseudo header" contains following fields, in order:
         //  srcAddr (16 bytes)
         //  dstAddr (16 bytes)
         //  dataSize (4 bytes), data size (internal protocol header and payload, w/o IP header)
@@ -456,10 +485,8 @@ uint16_t IpPacket::calcPseudoHeaderPayloadChecksum() const
         ipChecksum.addMemory (
             &ipHdrPtr->v6.ip6_src, sizeof ( ipHdrPtr->v6.ip6_src ) + sizeof ( ipHdrPtr->v6.ip6_dst ) );
 
-        ipHdrSize = sizeof ( struct ip6_hdr );
-
         // This is stored in 4 bytes in the pseudo-header (so we use htonl):
-        uint32_t v = htonl ( _buffer.getDataSize() - ipHdrSize );
+        uint32_t v = htonl ( dataSize );
 
         ipChecksum.addMemory ( &v, 4 );
 
@@ -468,6 +495,35 @@ uint16_t IpPacket::calcPseudoHeaderPayloadChecksum() const
         ipChecksum.addMemory ( &v, 3 );
         ipChecksum.addMemory ( &ipHdrPtr->v6.ip6_nxt, 1 );
     }
+}
+
+uint16_t IpPacket::calcPseudoHeaderPayloadChecksum() const
+{
+    if ( _buffer.isEmpty() )
+        return 0;
+
+    const struct iovec * const chunks = _buffer.getChunks();
+
+    assert ( chunks != 0 );
+    assert ( chunks[ 0 ].iov_len >= sizeof ( struct ip ) );
+
+    const DualIpHeader * ipHdrPtr = static_cast<const DualIpHeader *> ( chunks[ 0 ].iov_base );
+
+    assert ( ipHdrPtr != 0 );
+    assert ( ( ( size_t ) ipHdrPtr ) % 4U == 0 );
+
+    size_t ipHdrSize = 0;
+
+    if ( ipHdrPtr->v4.ip_v == 4 )
+    {
+        ipHdrSize = 4 * ipHdrPtr->v4.ip_hl;
+    }
+    else if ( ipHdrPtr->v4.ip_v == 6 )
+    {
+        assert ( chunks[ 0 ].iov_len >= sizeof ( struct ip6_hdr ) );
+
+        ipHdrSize = sizeof ( struct ip6_hdr );
+    }
     else
     {
         // Neither IPv4 nor IPv6
@@ -477,6 +533,11 @@ uint16_t IpPacket::calcPseudoHeaderPayloadChecksum() const
 
     assert ( ipHdrSize <= chunks[ 0 ].iov_len );
 
+    // Let's calculate the checksum.
+    IpChecksum ipChecksum;
+
+    addPseudoHeader ( ipChecksum, ipHdrPtr, _buffer.getDataSize() - ipHdrSize );
+
     ipChecksum.addMemory (
         static_cast<const char *> ( chunks[ 0 ].iov_base ) + ipHdrSize, chunks[ 0 ].iov_len - ipHdrSize );
 
@@ -488,6 +549,413 @@ uint16_t IpPacket::calcPseudoHeaderPayloadChecksum() const
     return ipChecksum.getChecksum();
 }
 
+bool IpPacket::splitSegments ( uint16_t segmentSize, List<IpPacket> & segments ) const
+{
+    PacketDesc pDesc;
+
+    if ( segmentSize < 1 || !examinePacket ( pDesc ) )
+    {
+        return false;
+    }
+
+    uint16_t protoHdrSize = 0;
+
+    if ( pDesc.protoType == Proto::TCP && pDesc.protoHeaderSize >= sizeof ( TcpPacket::Header ) )
+    {
+        protoHdrSize = reinterpret_cast<const TcpPacket::Header *> ( pDesc.protoHeader )->getHeaderSize();
+    }
+    else if ( pDesc.protoType == Proto::UDP && pDesc.protoHeaderSize >= sizeof ( UdpPacket::Header ) )
+    {
+        protoHdrSize = sizeof ( UdpPacket::Header );
+    }
+
+    if ( protoHdrSize < 1 || pDesc.protoHeaderSize < protoHdrSize )
+    {
+        return false;
+    }
+
+    const uint16_t hdrSize = pDesc.ipHeaderSize + protoHdrSize;
+
+    if ( _buffer.getDataSize() < hdrSize )
+    {
+        return false;
+    }
+
+    // All the payload that still needs to be split. Segments reference the same memory.
+    MemVector payload;
+
+    if ( !payload.append ( _buffer, hdrSize ) )
+    {
+        return false;
+    }
+
+    const DualIpHeader * const ipHdrPtr = static_cast<const DualIpHeader *> ( _buffer.getChunks()[ 0 ].iov_base );
+    const bool isV4 = ( ipHdrPtr->v4.ip_v == 4 );
+    const uint16_t ipId = isV4 ? ntohs ( ipHdrPtr->v4.ip_id ) : 0;
+    const uint32_t seqNum = ( pDesc.protoType == Proto::TCP )
+                            ? reinterpret_cast<const TcpPacket::Header *> ( pDesc.protoHeader )->getSeqNum()
+                            : 0;
+
+    uint32_t offset = 0;
+    uint16_t index = 0;
+
+    do
+    {
+        const uint16_t segPayloadSize = ( payload.getDataSize() > segmentSize )
+                                        ? segmentSize
+                                        : ( uint16_t ) payload.getDataSize();
+
+        MemHandle hdrData ( PacketDataStore::getPacket ( hdrSize ) );
+
+        hdrData.truncate ( hdrSize );
+
+        char * const hdrMem = hdrData.getWritable();
+
+        if ( !hdrMem || hdrData.size() < hdrSize || ( ( ( size_t ) hdrMem ) % 4U ) != 0 )
+        {
+            LOG ( L_ERROR, "Error allocating memory for the headers of a segment" );
+            return false;
+        }
+
+        memcpy ( hdrMem, ipHdrPtr, pDesc.ipHeaderSize );
+        memcpy ( hdrMem + pDesc.ipHeaderSize, pDesc.protoHeader, protoHdrSize );
+
+        DualIpHeader * const segIpHdr = reinterpret_cast<DualIpHeader *> ( hdrMem );
+        const uint16_t segSize = hdrSize + segPayloadSize;
+
+        if ( isV4 )
+        {
+            segIpHdr->v4.ip_len = htons ( segSize );
+            segIpHdr->v4.ip_id = htons ( ( uint16_t ) ( ipId + index ) );
+            segIpHdr->v4.ip_sum = 0;
+            segIpHdr->v4.ip_sum = IpChecksum::getChecksum ( hdrMem, pDesc.ipHeaderSize );
+        }
+        else
+        {
+            segIpHdr->v6.ip6_plen = htons ( segSize - sizeof ( struct ip6_hdr ) );
+        }
+
+        const bool isLast = ( payload.getDataSize() <= segPayloadSize );
+        uint16_t * checksum = 0;
+
+        if ( pDesc.protoType == Proto::TCP )
+        {
+            TcpPacket::Header * const tcpHdr = reinterpret_cast<TcpPacket::Header *> ( hdrMem + pDesc.ipHeaderSize );
+
+            // We set the fields manually, to avoid having set*() functions recalculate the checksum.
+
+            tcpHdr->seq_num = htonl ( seqNum + offset );
+
+            if ( !isLast )
+            {
+                tcpHdr->flags &= ~( TcpPacket::FlagFin | TcpPacket::FlagPsh );
+            }
+
+            if ( index > 0 )
+            {
+                tcpHdr->flags &= ~TcpPacket::FlagCwr;
+            }
+
+            checksum = &tcpHdr->checksum;
+        }
+        else
+        {
+            UdpPacket::Header * const udpHdr = reinterpret_cast<UdpPacket::Header *> ( hdrMem + pDesc.ipHeaderSize );
+
+            udpHdr->length = htons ( protoHdrSize + segPayloadSize );
+
+            checksum = &udpHdr->checksum;
+        }
+
+        IpPacket segment;
+
+        segment._buffer = MemVector ( 1 + payload.getNumChunks() );
+
+        MemVector segPayload ( payload );
+
+        segPayload.truncate ( segPayloadSize );
+
+        if ( !segment._buffer.append ( hdrData ) || !segment._buffer.append ( segPayload ) )
+        {
+            LOG ( L_ERROR, "Error appending data to the buffer of a segment" );
+            return false;
+        }
+
+        // For correct payload checksum calculation, this has to be set to 0.
+        // The segment uses the same memory as hdrMem, so we can still modify it.
+        *checksum = 0;
+        *checksum = segment.calcPseudoHeaderPayloadChecksum();
+
+        if ( *checksum == 0 && pDesc.protoType == Proto::UDP )
+        {
+            // In UDP 0 means "no checksum", and a calculated 0 is sent as 0xFFFF.
+            *checksum = 0xFFFF;
+        }
+
+        segments.append ( segment );
+
+        payload.consume ( segPayloadSize );
+        offset += segPayloadSize;
+        ++index;
+    }
+    while ( !payload.isEmpty() );
+
+    return true;
+}
+
+bool IpPacket::examineSegment ( PacketDesc & pDesc, uint16_t & tcpHdrSize, uint16_t & payloadSize ) const
+{
+    if ( !examinePacket ( pDesc )
+         || pDesc.protoType != Proto::TCP
+         || pDesc.protoHeaderSize < sizeof ( TcpPacket::Header ) )
+    {
+        return false;
+    }
+
+    const DualIpHeader * const ipHdrPtr = static_cast<const DualIpHeader *> ( _buffer.getChunks()[ 0 ].iov_base );
+    const TcpPacket::Header * const tcpHdr = reinterpret_cast<const TcpPacket::Header *> ( pDesc.protoHeader );
+
+    tcpHdrSize = tcpHdr->getHeaderSize();
+
+    if ( pDesc.protoHeaderSize < tcpHdrSize
+         || _buffer.getDataSize() <= ( size_t ) pDesc.ipHeaderSize + tcpHdrSize
+         || _buffer.getDataSize() > 0xFFFF )
+    {
+        return false;
+    }
+
+    // No IPv4 options or fragments (IPv6 extension headers are never TCP):
+    if ( ipHdrPtr->v4.ip_v == 4
+         && ( pDesc.ipHeaderSize != sizeof ( struct ip )
+              || ( ntohs ( ipHdrPtr->v4.ip_off ) & ( IP_MF | IP_OFFMASK ) ) != 0 ) )
+    {
+        return false;
+    }
+
+    if ( ( tcpHdr->flags & TcpPacket::FlagAck ) == 0
+         || ( tcpHdr->flags & ~( TcpPacket::FlagAck | TcpPacket::FlagPsh ) ) != 0 )
+    {
+        return false;
+    }
+
+    payloadSize = ( uint16_t ) ( _buffer.getDataSize() - pDesc.ipHeaderSize - tcpHdrSize );
+
+    return true;
+}
+
+/// @brief Checks whether the headers of two TCP segments allow coalescing them.
+/// Lengths, IPv4 IDs, sequence numbers, checksums and PSH flags are not compared.
+/// @param [in] ipA The IP header of the first segment.
+/// @param [in] tcpA The TCP header of the first segment.
+/// @param [in] ipB The IP header of the second segment.
+/// @param [in] tcpB The TCP header of the second segment.
+/// @param [in] tcpHdrSize The size of the TCP header of the first segment (including options).
+/// @return True if the headers match; False otherwise.
+static bool segmentHeadersMatch (
+        const DualIpHeader * ipA, const TcpPacket::Header * tcpA,
+        const DualIpHeader * ipB, const TcpPacket::Header * tcpB, uint16_t tcpHdrSize )
+{
+    if ( ipA->v4.ip_v != ipB->v4.ip_v )
+    {
+        return false;
+    }
+
+    if ( ipA->v4.ip_v == 4 )
+    {
+        if ( ipA->v4.ip_tos != ipB->v4.ip_tos
+             || ipA->v4.ip_off != ipB->v4.ip_off
+             || ipA->v4.ip_ttl != ipB->v4.ip_ttl
+             || ipA->v4.ip_p != ipB->v4.ip_p
+             || memcmp ( &ipA->v4.ip_src, &ipB->v4.ip_src, sizeof ( ipA->v4.ip_src ) ) != 0
+             || memcmp ( &ipA->v4.ip_dst, &ipB->v4.ip_dst, sizeof ( ipA->v4.ip_dst ) ) != 0 )
+        {
+            return false;
+        }
+    }
+    else if ( ipA->v6.ip6_flow != ipB->v6.ip6_flow
+              || ipA->v6.ip6_nxt != ipB->v6.ip6_nxt
+              || ipA->v6.ip6_hlim != ipB->v6.ip6_hlim
+              || memcmp ( &ipA->v6.ip6_src, &ipB->v6.ip6_src, sizeof ( ipA->v6.ip6_src ) ) != 0
+              || memcmp ( &ipA->v6.ip6_dst, &ipB->v6.ip6_dst, sizeof ( ipA->v6.ip6_dst ) ) != 0 )
+    {
+        return false;
+    }
+
+    // The options follow the basic header.
+    return ( tcpA->source_port == tcpB->source_port
+             && tcpA->dest_port == tcpB->dest_port
+             && tcpA->ack_num == tcpB->ack_num
+             && ( tcpA->flags & ~TcpPacket::FlagPsh ) == ( tcpB->flags & ~TcpPacket::FlagPsh )
+             && tcpA->window == tcpB->window
+             && tcpA->urgent_ptr == tcpB->urgent_ptr
+             && memcmp ( tcpA + 1, tcpB + 1, tcpHdrSize - sizeof ( TcpPacket::Header ) ) == 0 );
+}
+
+size_t IpPacket::coalesceSegments (
+        const List<IpPacket> & packets, size_t index, IpPacket & superPacket, uint16_t & segmentSize )
+{
+    if ( index + 1 >= packets.size() )
+    {
+        return 0;
+    }
+
+    const IpPacket & first = packets.at ( index );
+
+    PacketDesc pDesc;
+    uint16_t tcpHdrSize = 0;
+    uint16_t segSize = 0;
+
+    if ( !first.examineSegment ( pDesc, tcpHdrSize, segSize ) )
+    {
+        return 0;
+    }
+
+    const DualIpHeader * const ipHdrPtr
+        = static_cast<const DualIpHeader *> ( first._buffer.getChunks()[ 0 ].iov_base );
+    const TcpPacket::Header * const tcpHdrPtr = reinterpret_cast<const TcpPacket::Header *> ( pDesc.protoHeader );
+
+    // With DF set, IPv4 IDs don't matter (and segmentation offload may not generate consecutive ones).
+    const bool checkIpId = ( ipHdrPtr->v4.ip_v == 4 && ( ntohs ( ipHdrPtr->v4.ip_off ) & IP_DF ) == 0 );
+
+    size_t count = 1;
+    size_t totalSize = first.getPacketSize();
+    uint32_t nextSeqNum = tcpHdrPtr->getSeqNum() + segSize;
+    uint8_t pshFlag = ( tcpHdrPtr->flags & TcpPacket::FlagPsh );
+
+    // PSH can only be set in the last packet.
+    while ( pshFlag == 0 && index + count < packets.size() )
+    {
+        const IpPacket & packet = packets.at ( index + count );
+
+        PacketDesc segDesc;
+        uint16_t segTcpHdrSize = 0;
+        uint16_t segPayloadSize = 0;
+
+        if ( !packet.examineSegment ( segDesc, segTcpHdrSize, segPayloadSize )
+             || segTcpHdrSize != tcpHdrSize
+             || segPayloadSize > segSize
+             || totalSize + segPayloadSize > 0xFFFF )
+        {
+            break;
+        }
+
+        const DualIpHeader * const segIpHdr
+            = static_cast<const DualIpHeader *> ( packet._buffer.getChunks()[ 0 ].iov_base );
+        const TcpPacket::Header * const segTcpHdr = reinterpret_cast<const TcpPacket::Header *> ( segDesc.protoHeader );
+
+        if ( !segmentHeadersMatch ( ipHdrPtr, tcpHdrPtr, segIpHdr, segTcpHdr, tcpHdrSize )
+             || segTcpHdr->getSeqNum() != nextSeqNum
+             || ( checkIpId && ntohs ( segIpHdr->v4.ip_id ) != ( uint16_t ) ( ntohs ( ipHdrPtr->v4.ip_id ) + count ) ) )
+        {
+            break;
+        }
+
+        ++count;
+        totalSize += segPayloadSize;
+        nextSeqNum += segPayloadSize;
+        pshFlag = ( segTcpHdr->flags & TcpPacket::FlagPsh );
+
+        if ( segPayloadSize < segSize )
+        {
+            // Only the last packet can be smaller.
+            break;
+        }
+    }
+
+    if ( count < 2 )
+    {
+        return 0;
+    }
+
+    const uint16_t hdrSize = pDesc.ipHeaderSize + tcpHdrSize;
+
+    MemHandle hdrData ( PacketDataStore::getPacket ( hdrSize ) );
+
+    hdrData.truncate ( hdrSize );
+
+    char * const hdrMem = hdrData.getWritable();
+
+    if ( !hdrMem || hdrData.size() < hdrSize || ( ( ( size_t ) hdrMem ) % 4U ) != 0 )
+    {
+        LOG ( L_ERROR, "Error allocating memory for the headers of a super-packet" );
+        return 0;
+    }
+
+    memcpy ( hdrMem, ipHdrPtr, pDesc.ipHeaderSize );
+    memcpy ( hdrMem + pDesc.ipHeaderSize, tcpHdrPtr, tcpHdrSize );
+
+    DualIpHeader * const newIpHdr = reinterpret_cast<DualIpHeader *> ( hdrMem );
+
+    if ( newIpHdr->v4.ip_v == 4 )
+    {
+        newIpHdr->v4.ip_len = htons ( ( uint16_t ) totalSize );
+        newIpHdr->v4.ip_sum = 0;
+        newIpHdr->v4.ip_sum = IpChecksum::getChecksum ( hdrMem, pDesc.ipHeaderSize );
+    }
+    else
+    {
+        newIpHdr->v6.ip6_plen = htons ( ( uint16_t ) ( totalSize - sizeof ( struct ip6_hdr ) ) );
+    }
+
+    TcpPacket::Header * const newTcpHdr = reinterpret_cast<TcpPacket::Header *> ( hdrMem + pDesc.ipHeaderSize );
+
+    newTcpHdr->flags |= pshFlag;
+
+    // Only the pseudo header is checksummed, the rest is up to checksum offload.
+    IpChecksum ipChecksum;
+
+    addPseudoHeader ( ipChecksum, newIpHdr, totalSize - pDesc.ipHeaderSize );
+
+    newTcpHdr->checksum = ( uint16_t ) ~ipChecksum.getChecksum();
+
+    MemVector buffer ( 1 + count );
+
+    if ( !buffer.append ( hdrData ) )
+    {
+        LOG ( L_ERROR, "Error appending data to the buffer of a super-packet" );
+        return 0;
+    }
+
+    for ( size_t i = 0; i < count; ++i )
+    {
+        if ( !packets.at ( index + i ).getProtoPayload<TcpPacket> ( buffer ) )
+        {
+            LOG ( L_ERROR, "Error appending data to the buffer of a super-packet" );
+            return 0;
+        }
+    }
+
+    assert ( buffer.getDataSize() == totalSize );
+
+    superPacket._buffer = buffer;
+    segmentSize = segSize;
+
+    return count;
+}
+
+bool IpPacket::completePartialChecksum ( MemHandle & data, uint16_t csumStart, uint16_t csumOffset )
+{
+    const size_t csumPos = ( size_t ) csumStart + csumOffset;
+    char * const w = data.getWritable();
+
+    if ( !w || csumPos + 2 > data.size() || ( csumStart % 2 ) != 0 )
+    {
+        return false;
+    }
+
+    uint16_t cSum = IpChecksum::getChecksum ( w + csumStart, data.size() - csumStart );
+
+    // 0 means 'no checksum' in UDP, and in TCP 0 and 0xFFFF are equivalent.
+    if ( cSum == 0 )
+    {
+        cSum = 0xFFFF;
+    }
+
+    memcpy ( w + csumPos, &cSum, 2 );
+
+    return true;
+}
+
 bool IpPacket::setupFlowDesc ( FlowDesc & flowDesc, PacketDirection direction ) const
 {
     if ( _buffer.isEmpty() )
@@ -18,6 +18,7 @@
 
 #include <cassert>
 
+#include "basic/List.hpp"
 #include "basic/MemVector.hpp"
 #include "log/TextLog.hpp"
 
@@ -109,6 +110,13 @@ class IpPacket
         ///                  The memory in this buffer must be aligned properly ( data.get() % 4 should be equal to 0 ).
         IpPacket ( const MemHandle & data );
 
+        /// @brief Constructor.
+        /// If the data passed is invalid, the packet will also be invalid.
+        /// @param [in] data The data of the IP packet.
+        ///                  Its first chunk must contain the entire IP header, and the header of the internal
+        ///                  protocol must not be split between chunks. Otherwise it is the same as IpPacket(MemHandle).
+        IpPacket ( const MemVector & data );
+
         /// @brief Checks if the packet is valid (contains any data).
         /// @return True if the packet is valid, false otherwise.
         inline bool isValid() const
@@ -200,6 +208,55 @@ class IpPacket
         /// @return Calculated checksum.
         uint16_t calcPseudoHeaderPayloadChecksum() const;
 
+        /// @brief Splits a large TCP or UDP packet into smaller segments.
+        /// This is meant for "super-packets" generated by segmentation offload (GSO/TSO/USO).
+        /// Each segment gets a copy of IP and TCP/UDP headers, which are adjusted for the segment
+        /// (lengths, IPv4 ID, TCP sequence number and flags) and have their checksums calculated from scratch.
+        /// The payload of each segment references this packet's memory, it is not copied.
+        /// For TCP, FIN and PSH flags are only kept in the last segment, and CWR only in the first one.
+        /// For UDP, each segment is a separate datagram.
+        /// @param [in] segmentSize The max size of the payload (not including any headers) in each segment.
+        /// @param [out] segments The list to append generated segments to (it is NOT cleared in advance).
+        ///                       If this packet is not larger than a single segment, only one segment will be
+        ///                       appended (with headers updated the same way as if there were more of them).
+        /// @return True if the packet was split; False if it is not a TCP or UDP packet, or if it is invalid.
+        bool splitSegments ( uint16_t segmentSize, List<IpPacket> & segments ) const;
+
+        /// @brief Coalesces consecutive TCP segments into a single "super-packet".
+        /// This is the reverse of splitSegments(), meant for devices that support segmentation offload (GSO/TSO).
+        /// Starting with the packet at 'index', it takes consecutive packets of the same TCP flow, with consecutive
+        /// sequence numbers, and otherwise the same IP and TCP headers (including TCP options).
+        /// All their payloads have to be of the same size, only the last one may be smaller.
+        /// Only ACK and (in the last packet) PSH flags may be set. IPv4 packets with options or fragments,
+        /// and IPv6 packets with extension headers are never coalesced.
+        /// The super-packet gets a copy of the headers of the first packet, with lengths (and the IPv4 checksum)
+        /// updated and the PSH flag of the last packet. Its TCP checksum field contains the (not inverted) checksum
+        /// of the pseudo-header, so it is ready for checksum offload (the same way completePartialChecksum() works).
+        /// The payloads reference the memory of the original packets, they are not copied.
+        /// @note The checksums of the packets are not verified. The checksum of each segment generated
+        ///       from the super-packet will be valid for the data it carries.
+        /// @param [in] packets The list of packets.
+        /// @param [in] index The index of the first packet to coalesce.
+        /// @param [out] superPacket The super-packet generated. Only modified if the packets were coalesced.
+        /// @param [out] segmentSize The size of the payload of each packet coalesced (the last one may be smaller).
+        ///                          Only modified if the packets were coalesced.
+        /// @return The number of packets coalesced (at least 2), or 0 if the packet at 'index' could not be
+        ///         coalesced with the next one.
+        static size_t coalesceSegments (
+            const List<IpPacket> & packets, size_t index, IpPacket & superPacket, uint16_t & segmentSize );
+
+        /// @brief Completes a partial TCP or UDP checksum.
+        /// This is meant for packets with partial checksums, as generated by checksum offload
+        /// (like packets read from a tunnel device with VIRTIO_NET_HDR_F_NEEDS_CSUM flag set).
+        /// In those packets the checksum field contains the (not inverted) checksum of the pseudo-header,
+        /// and checksumming everything starting at csumStart generates the final value.
+        /// @param [in,out] data The data of the entire IP packet. The checksum is updated in place.
+        /// @param [in] csumStart The offset (from the beginning of the packet) at which checksumming starts.
+        ///                       It has to be an even number.
+        /// @param [in] csumOffset The offset of the checksum field (from csumStart).
+        /// @return True if the checksum was completed; False if the offsets are invalid (or the memory is empty).
+        static bool completePartialChecksum ( MemHandle & data, uint16_t csumStart, uint16_t csumOffset );
+
         /// @brief Returns a pointer to internal protocol's header.
         /// @tparam ProtoType The type of the protocol to use.
         /// @return Pointer to internal protocol's header, or 0 if the packet is invalid,
@@ -385,6 +442,19 @@ class IpPacket
         /// @return True if the packet makes sense; False otherwise (also if there is no payload protocol's header).
         bool examinePacket ( PacketDesc & pDesc ) const;
 
+        /// @brief Examines a TCP segment that could be coalesced with others (see coalesceSegments()).
+        /// @param [out] pDesc Decoded packet's parameters. May be modified on error.
+        /// @param [out] tcpHdrSize The size of the TCP header (including options). May be modified on error.
+        /// @param [out] payloadSize The size of the TCP payload. May be modified on error.
+        /// @return True if the packet is a TCP segment that could be coalesced; False otherwise.
+        bool examineSegment ( PacketDesc & pDesc, uint16_t & tcpHdrSize, uint16_t & payloadSize ) const;
+
+        /// @brief Reads the size of the IP packet from its header.
+        /// @param [in] data Pointer to the memory with the IP header. It must be aligned properly.
+        /// @param [in] dataSize The number of bytes available at the 'data' pointer.
+        /// @return The size of the entire IP packet (according to its header), or 0 if the header is invalid.
+        static size_t readPacketSize ( const char * data, size_t dataSize );
+
     private:
         /// @brief The internal buffer that contains the data
         /// If it's not empty, it means that it contains data that has been verified to contain a correct IP packet.
@@ -0,0 +1,107 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include "basic/Math.hpp"
+
+#include "TcpCongestionControl.hpp"
+#include "TcpNewReno.hpp"
+#include "TcpCubic.hpp"
+
+// The max number of segments in the initial window (RFC 6928).
+#define INITIAL_WINDOW_SEGMENTS    10
+
+using namespace Pravala;
+
+TcpCongestionControl * TcpCongestionControl::create ( const String & name, uint16_t mss )
+{
+    const String lName = name.toLower();
+
+    if ( lName == "newreno" )
+    {
+        return new TcpNewReno ( mss );
+    }
+    else if ( lName == "cubic" )
+    {
+        return new TcpCubic ( mss );
+    }
+
+    return 0;
+}
+
+TcpCongestionControl::TcpCongestionControl ( uint16_t mss ):
+    Mss ( max<uint16_t> ( mss, 1 ) ),
+    _cwnd ( INITIAL_WINDOW_SEGMENTS * Mss ),
+    _ssThresh ( 0xFFFFFFFFU ),
+    _bytesAcked ( 0 )
+{
+}
+
+TcpCongestionControl::~TcpCongestionControl()
+{
+}
+
+bool TcpCongestionControl::isCwndLimited ( uint32_t flightSize ) const
+{
+    // During slow start we allow the window to grow up to twice the amount of data in flight.
+    // Otherwise we only grow it if the data in flight (almost) fills the window.
+
+    if ( isInSlowStart() )
+    {
+        return ( _cwnd < 2 * flightSize );
+    }
+
+    return ( flightSize + Mss >= _cwnd );
+}
+
+uint32_t TcpCongestionControl::slowStart ( uint32_t numBytes )
+{
+    assert ( _cwnd < _ssThresh );
+
+    const uint32_t inc = min<uint32_t> ( numBytes, 2 * Mss );
+
+    if ( inc < _ssThresh - _cwnd )
+    {
+        _cwnd += inc;
+        return 0;
+    }
+
+    // We reached the slow start threshold; The remaining bytes should be used by congestion avoidance.
+    const uint32_t remaining = inc - ( _ssThresh - _cwnd );
+
+    _cwnd = _ssThresh;
+
+    return remaining;
+}
+
+void TcpCongestionControl::lossDetected ( uint32_t flightSize, const Time & /*now*/ )
+{
+    _ssThresh = max<uint32_t> ( flightSize / 2, 2 * Mss );
+    _cwnd = _ssThresh;
+    _bytesAcked = 0;
+}
+
+void TcpCongestionControl::recoveryCompleted()
+{
+    _cwnd = _ssThresh;
+    _bytesAcked = 0;
+}
+
+void TcpCongestionControl::retransmitTimeout ( uint32_t flightSize, const Time & /*now*/ )
+{
+    _ssThresh = max<uint32_t> ( flightSize / 2, 2 * Mss );
+    _cwnd = Mss;
+    _bytesAcked = 0;
+}
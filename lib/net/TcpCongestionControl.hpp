@@ -0,0 +1,129 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#pragma once
+
+extern "C"
+{
+#include <stdint.h>
+}
+
+#include "basic/NoCopy.hpp"
+#include "basic/String.hpp"
+
+namespace Pravala
+{
+class RttStat;
+class Time;
+
+/// @brief A base class for TCP congestion controllers used by TcpTerminator.
+/// It maintains the congestion window (cwnd) and the slow start threshold (ssthresh), both in bytes.
+/// The terminator reports events (data being acknowledged, losses, timeouts), and limits the amount
+/// of data in flight to the congestion window.
+/// The default behaviour follows RFC 5681; Implementations override dataAcked() (and possibly other
+/// event handlers) to provide different congestion avoidance algorithms.
+class TcpCongestionControl: public NoCopy
+{
+    public:
+        /// @brief Maximum Segment Size (in bytes).
+        const uint16_t Mss;
+
+        /// @brief Creates a congestion controller.
+        /// @param [in] name The name of the algorithm to use ("newreno" or "cubic"); Case insensitive.
+        /// @param [in] mss Maximum Segment Size (in bytes).
+        /// @return A new congestion controller, that should be deallocated by the caller;
+        ///         0 if the name was not recognized.
+        static TcpCongestionControl * create ( const String & name, uint16_t mss );
+
+        /// @brief Destructor.
+        virtual ~TcpCongestionControl();
+
+        /// @brief Returns the name of the algorithm.
+        /// @return The name of the algorithm.
+        virtual const char * getName() const = 0;
+
+        /// @brief Returns the current congestion window.
+        /// @return The current congestion window (in bytes).
+        inline uint32_t getCwnd() const
+        {
+            return _cwnd;
+        }
+
+        /// @brief Returns the current slow start threshold.
+        /// @return The current slow start threshold (in bytes).
+        inline uint32_t getSsThresh() const
+        {
+            return _ssThresh;
+        }
+
+        /// @brief Checks whether the controller is in the slow start phase.
+        /// @return True if the controller is in the slow start phase; False otherwise.
+        inline bool isInSlowStart() const
+        {
+            return ( _cwnd < _ssThresh );
+        }
+
+        /// @brief Called when new data is acknowledged, outside of fast recovery.
+        /// @param [in] numBytes The number of bytes acknowledged.
+        /// @param [in] flightSize The number of bytes in flight before this acknowledgement.
+        /// @param [in] rtt The RTT statistics of the connection.
+        /// @param [in] now The current time.
+        virtual void dataAcked ( uint32_t numBytes, uint32_t flightSize, const RttStat & rtt, const Time & now ) = 0;
+
+        /// @brief Called when a loss is detected using duplicate ACKs (or SACK), and fast recovery starts.
+        /// The default implementation halves the window (RFC 5681).
+        /// @param [in] flightSize The number of bytes in flight.
+        /// @param [in] now The current time.
+        virtual void lossDetected ( uint32_t flightSize, const Time & now );
+
+        /// @brief Called when fast recovery completes (all the data outstanding when it started is acknowledged).
+        /// The default implementation sets the congestion window to the slow start threshold.
+        virtual void recoveryCompleted();
+
+        /// @brief Called when the retransmission timer expires.
+        /// The default implementation halves the slow start threshold and sets the window to a single segment.
+        /// @param [in] flightSize The number of bytes in flight.
+        /// @param [in] now The current time.
+        virtual void retransmitTimeout ( uint32_t flightSize, const Time & now );
+
+    protected:
+        uint32_t _cwnd; ///< Congestion window (in bytes).
+        uint32_t _ssThresh; ///< Slow start threshold (in bytes).
+
+        /// @brief The number of bytes acknowledged since the congestion window was last increased
+        /// during congestion avoidance.
+        uint32_t _bytesAcked;
+
+        /// @brief Constructor.
+        /// It configures the initial congestion window (RFC 6928) and unlimited slow start threshold.
+        /// @param [in] mss Maximum Segment Size (in bytes).
+        TcpCongestionControl ( uint16_t mss );
+
+        /// @brief Checks whether the congestion window is actually limiting the sender.
+        /// If it's not (because the sender doesn't have enough data), the window should not grow.
+        /// @param [in] flightSize The number of bytes in flight.
+        /// @return True if the congestion window is limiting the sender; False otherwise.
+        bool isCwndLimited ( uint32_t flightSize ) const;
+
+        /// @brief Performs slow start.
+        /// It increases the congestion window by the number of bytes acknowledged (RFC 3465, with L = 2*MSS),
+        /// but not above the slow start threshold.
+        /// @param [in] numBytes The number of bytes acknowledged.
+        /// @return The number of acknowledged bytes that were not "used" by slow start
+        ///         (that should be used for congestion avoidance).
+        uint32_t slowStart ( uint32_t numBytes );
+};
+}
@@ -0,0 +1,136 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <cmath>
+
+#include "basic/Math.hpp"
+#include "net/RttStat.hpp"
+
+#include "TcpCubic.hpp"
+
+// The constant that determines the aggressiveness of the window growth.
+#define CUBIC_C        0.4
+
+// The multiplicative window decrease factor.
+#define CUBIC_BETA     0.7
+
+// The additive increase factor used by the Reno-friendly estimate, to achieve the same average window size
+// as NewReno (that uses beta = 0.5) with CUBIC_BETA: 3 * ( 1 - beta ) / ( 1 + beta ).
+#define CUBIC_ALPHA    ( 3.0 * ( 1.0 - CUBIC_BETA ) / ( 1.0 + CUBIC_BETA ) )
+
+using namespace Pravala;
+
+TcpCubic::TcpCubic ( uint16_t mss ):
+    TcpCongestionControl ( mss ),
+    _wMax ( 0 ),
+    _origin ( 0 ),
+    _k ( 0 ),
+    _wEst ( 0 ),
+    _cwndInc ( 0 )
+{
+}
+
+const char * TcpCubic::getName() const
+{
+    return "cubic";
+}
+
+void TcpCubic::dataAcked ( uint32_t numBytes, uint32_t flightSize, const RttStat & rtt, const Time & now )
+{
+    if ( !isCwndLimited ( flightSize ) )
+    {
+        return;
+    }
+
+    if ( isInSlowStart() && ( numBytes = slowStart ( numBytes ) ) < 1 )
+    {
+        return;
+    }
+
+    if ( _epochStart.isZero() )
+    {
+        // A new congestion avoidance epoch.
+
+        _epochStart = now;
+        _cwndInc = 0;
+        _wEst = _cwnd;
+
+        if ( _cwnd < _wMax )
+        {
+            // K = cubic_root ( ( W_max - cwnd ) / C ), using the window sizes in segments.
+            _k = pow ( ( _wMax - _cwnd ) / ( CUBIC_C * Mss ), 1.0 / 3.0 );
+            _origin = _wMax;
+        }
+        else
+        {
+            _k = 0;
+            _origin = _cwnd;
+        }
+    }
+
+    // We calculate the window that the cubic function will reach in one RTT.
+    // W_cubic ( t ) = C * ( t - K ) ^ 3 + W_origin, using the window sizes in segments.
+
+    const double t = ( max<long> ( now.getDiffInMilliSeconds ( _epochStart ), 0 ) + rtt.getSRtt() ) / 1000.0;
+    const double cwnd = _cwnd;
+
+    double target = CUBIC_C * pow ( t - _k, 3.0 ) * Mss + _origin;
+
+    // The target should be between the current window and 1.5 times the window.
+    target = max ( cwnd, min ( target, 1.5 * cwnd ) );
+
+    // The window NewReno would use (with CUBIC's beta), grows by alpha segments per window of acknowledged data:
+    _wEst += CUBIC_ALPHA * Mss * numBytes / cwnd;
+
+    if ( target < _wEst )
+    {
+        // "Reno-friendly" region; We don't want to be slower than NewReno.
+        _cwndInc += _wEst - cwnd;
+    }
+    else
+    {
+        // Concave or convex region; We want to reach the target in one RTT.
+        _cwndInc += ( target - cwnd ) * numBytes / cwnd;
+    }
+
+    if ( _cwndInc >= 1 )
+    {
+        const uint32_t inc = ( uint32_t ) _cwndInc;
+
+        _cwnd += inc;
+        _cwndInc -= inc;
+    }
+}
+
+void TcpCubic::lossDetected ( uint32_t /*flightSize*/, const Time & /*now*/ )
+{
+    _epochStart.clear();
+
+    // Fast convergence: If the window didn't reach the previous maximum, we release some bandwidth
+    // for new flows by lowering the maximum further.
+    _wMax = ( _cwnd < _wMax ) ? ( _cwnd * ( 1.0 + CUBIC_BETA ) / 2.0 ) : _cwnd;
+
+    _ssThresh = max<uint32_t> ( ( uint32_t ) ( _cwnd * CUBIC_BETA ), 2 * Mss );
+    _cwnd = _ssThresh;
+    _bytesAcked = 0;
+}
+
+void TcpCubic::retransmitTimeout ( uint32_t flightSize, const Time & now )
+{
+    lossDetected ( flightSize, now );
+
+    _cwnd = Mss;
+}
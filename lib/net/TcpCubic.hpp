@@ -0,0 +1,62 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#pragma once
+
+#include "sys/Time.hpp"
+
+#include "TcpCongestionControl.hpp"
+
+namespace Pravala
+{
+/// @brief CUBIC congestion controller (RFC 9438).
+/// During congestion avoidance the window grows as a cubic function of the time since the last congestion event,
+/// with the inflection point at the window size at which that event happened. This makes the growth independent
+/// of the RTT, and much faster than NewReno's on paths with large bandwidth-delay products.
+/// It also tracks the window that NewReno would use, and never grows slower than that ("Reno-friendly" region).
+class TcpCubic: public TcpCongestionControl
+{
+    public:
+        /// @brief Constructor.
+        /// @param [in] mss Maximum Segment Size (in bytes).
+        TcpCubic ( uint16_t mss );
+
+        virtual const char * getName() const;
+        virtual void dataAcked ( uint32_t numBytes, uint32_t flightSize, const RttStat & rtt, const Time & now );
+        virtual void lossDetected ( uint32_t flightSize, const Time & now );
+        virtual void retransmitTimeout ( uint32_t flightSize, const Time & now );
+
+    private:
+        /// @brief The start of the current congestion avoidance epoch. Zero if it hasn't started yet.
+        Time _epochStart;
+
+        /// @brief The window size (in bytes) just before the last reduction.
+        double _wMax;
+
+        /// @brief The window size (in bytes) at the origin (plateau) of the cubic function.
+        /// It's _wMax, unless the epoch started with the window already above it.
+        double _origin;
+
+        /// @brief The time (in seconds) it takes the cubic function to reach _origin, since the epoch start.
+        double _k;
+
+        /// @brief The estimate of the window size (in bytes) that NewReno would use.
+        double _wEst;
+
+        /// @brief The part of the window increase that has not been applied yet (since it's less than 1 byte).
+        double _cwndInc;
+};
+}
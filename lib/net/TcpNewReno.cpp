@@ -0,0 +1,51 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include "TcpNewReno.hpp"
+
+using namespace Pravala;
+
+TcpNewReno::TcpNewReno ( uint16_t mss ): TcpCongestionControl ( mss )
+{
+}
+
+const char * TcpNewReno::getName() const
+{
+    return "newreno";
+}
+
+void TcpNewReno::dataAcked ( uint32_t numBytes, uint32_t flightSize, const RttStat & /*rtt*/, const Time & /*now*/ )
+{
+    if ( !isCwndLimited ( flightSize ) )
+    {
+        return;
+    }
+
+    if ( isInSlowStart() )
+    {
+        numBytes = slowStart ( numBytes );
+    }
+
+    // Congestion avoidance: One segment per window worth of acknowledged data.
+
+    _bytesAcked += numBytes;
+
+    if ( _bytesAcked >= _cwnd )
+    {
+        _bytesAcked -= _cwnd;
+        _cwnd += Mss;
+    }
+}
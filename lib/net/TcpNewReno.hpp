@@ -0,0 +1,38 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#pragma once
+
+#include "TcpCongestionControl.hpp"
+
+namespace Pravala
+{
+/// @brief NewReno congestion controller.
+/// It uses slow start and the standard congestion avoidance (RFC 5681), which increases the congestion window
+/// by one segment for every window worth of data acknowledged (using appropriate byte counting, RFC 3465).
+/// Fast recovery is driven by the terminator (RFC 6582 and RFC 6675), so the controller uses the default
+/// loss handlers.
+class TcpNewReno: public TcpCongestionControl
+{
+    public:
+        /// @brief Constructor.
+        /// @param [in] mss Maximum Segment Size (in bytes).
+        TcpNewReno ( uint16_t mss );
+
+        virtual const char * getName() const;
+        virtual void dataAcked ( uint32_t numBytes, uint32_t flightSize, const RttStat & rtt, const Time & now );
+};
+}
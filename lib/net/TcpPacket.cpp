@@ -14,6 +14,7 @@
  *  limitations under the License.
  */
 
+#include "basic/Math.hpp"
 #include "basic/IpAddress.hpp"
 #include "TcpPacket.hpp"
 
@@ -289,6 +290,39 @@ bool TcpPacket::Header::getOptWindowScale ( uint8_t & value ) const
     return true;
 }
 
+bool TcpPacket::Header::getOptSAckPermitted() const
+{
+    const char * optVal = 0;
+    uint8_t optLen = 0;
+
+    return ( isSYN() && getOptData ( OptSAckPerm, optVal, optLen ) && optLen == 0 );
+}
+
+uint8_t TcpPacket::Header::getOptSAck ( uint32_t * edges, uint8_t maxBlocks ) const
+{
+    const char * optVal = 0;
+    uint8_t optLen = 0;
+
+    // Each block is described by two 32 bit sequence numbers.
+    if ( !edges || !getOptData ( OptSAck, optVal, optLen ) || !optVal || optLen < 8 || ( optLen % 8 ) != 0 )
+    {
+        return 0;
+    }
+
+    const uint8_t numBlocks = min<uint8_t> ( maxBlocks, optLen / 8 );
+
+    for ( uint8_t i = 0; i < 2 * numBlocks; ++i )
+    {
+        uint32_t edge;
+
+        // There should be no issues with alignment, but just in case:
+        memcpy ( &edge, optVal + 4 * i, sizeof ( edge ) );
+        edges[ i ] = ntohl ( edge );
+    }
+
+    return numBlocks;
+}
+
 uint8_t TcpPacket::getOptLen ( const Option * options, uint8_t optCount )
 {
     if ( !options || optCount < 1 )
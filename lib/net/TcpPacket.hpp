@@ -222,6 +222,25 @@ class TcpPacket: public IpPacket
                 ///         False if the option value could not be extracted.
                 bool getOptWindowScale ( uint8_t & value ) const;
 
+                /// @brief Checks whether the packet carries the "SACK permitted" option.
+                /// It only works if the packet has SYN flag set. It will also assume that the memory immediately
+                /// after the header contains TCP options (up to payload offset), so it should not be called
+                /// if it's not the case!
+                /// @return True if the header has the SYN flag set and the (valid) option was present;
+                ///         False otherwise.
+                bool getOptSAckPermitted() const;
+
+                /// @brief Gets the blocks of the SACK option from the packet.
+                /// It will assume that the memory immediately after the header contains TCP options
+                /// (up to payload offset), so it should not be called if it's not the case!
+                /// @param [out] edges The array to store the edges of the blocks in (using host endianness).
+                ///                    It has to be able to hold 2 * maxBlocks values. Each block is stored
+                ///                    as two values: the left edge (the first sequence number of the block),
+                ///                    followed by the right edge (the sequence number right after the block).
+                /// @param [in] maxBlocks The max number of blocks to read.
+                /// @return The number of blocks stored in 'edges'; 0 if the option was not present or was invalid.
+                uint8_t getOptSAck ( uint32_t * edges, uint8_t maxBlocks ) const;
+
                 /// @brief Reads the content of TCP option.
                 /// It assumes that the memory immediately after the header contains TCP options (up to payload offset),
                 /// so it should not be called if it's not the case!
@@ -20,6 +20,8 @@
 #include "socket/PacketDataStore.hpp"
 
 #include "TcpTerminator.hpp"
+#include "TcpCongestionControl.hpp"
+#include "TcpNewReno.hpp"
 
 // The time failed TCP flows stick around to respond to any IP packets (in milliseconds).
 #define LINGER_TIME    30000
@@ -30,8 +32,28 @@
 // to the exact same destination, we should remove this very quickly.
 #define ACKED_FIN_LINGER_TIME    1000
 
-// The time to use for TCP retransmissions (in milliseconds).
-#define RETRANS_TIME             500
+// The retransmission timeout to use before the RTT is measured (in milliseconds; RFC 6298).
+#define INITIAL_RTO              1000
+
+// The max retransmission timeout (in milliseconds).
+#define MAX_RTO                  60000
+
+// The max number of times the retransmission timeout is doubled.
+// It is enough to reach MAX_RTO even with RTO at its minimum (500 ms).
+#define MAX_RTO_BACKOFF          7
+
+// The max window-scale value (RFC 7323).
+#define MAX_WSCALE               14
+
+// The number of duplicate ACKs (or segments selectively acknowledged) that triggers fast recovery.
+#define DUP_ACK_THRESHOLD        3
+
+// The max number of blocks in the SACK scoreboard.
+// New blocks that would not fit are ignored (they will be retransmitted, unless they get acknowledged normally).
+#define MAX_SACK_BLOCKS          64
+
+// The max number of SACK blocks in a single TCP packet.
+#define MAX_SACK_OPT_BLOCKS      4
 
 // The MSS to use if not provided
 #define DEFAULT_MSS              1300
@@ -50,6 +72,34 @@
 
 using namespace Pravala;
 
+ConfigLimitedNumber<uint32_t> TcpTerminator::optRcvBufSize (
+        0,
+        "mas.tcp_terminator.rcv_buf_size",
+        "The max size of the receive buffer (and the receive window) of each TCP terminator (in bytes)",
+        4096, 64 * 1024 * 1024, 256 * 1024
+);
+
+ConfigLimitedNumber<uint32_t> TcpTerminator::optSendBufSize (
+        0,
+        "mas.tcp_terminator.send_buf_size",
+        "The max size of the send buffer of each TCP terminator (in bytes)",
+        4096, 64 * 1024 * 1024, 256 * 1024
+);
+
+ConfigString TcpTerminator::optCongestionControl (
+        0,
+        "mas.tcp_terminator.congestion_control",
+        "The congestion control algorithm used by TCP terminators ('newreno' or 'cubic')",
+        "cubic"
+);
+
+ConfigNumber<bool> TcpTerminator::optUseSAck (
+        0,
+        "mas.tcp_terminator.sack",
+        "Set to true to use selective acknowledgements in TCP terminators (if supported by the client)",
+        true
+);
+
 TextLogLimited TcpTerminator::_log ( "tcp_terminator" );
 
 TcpTerminator::TcpTerminator ( const FlowDesc & flowDesc, uint16_t mtu ):
@@ -64,15 +114,24 @@ TcpTerminator::TcpTerminator ( const FlowDesc & flowDesc, uint16_t mtu ):
     ServerPort ( ntohs ( flowDesc.common.u.port.server ) ),
     _tcpTimer ( *this ),
     _tcpState ( TcpInit ),
+    _cc ( 0 ),
     _unsentBufSize ( 0 ),
     _rcvBufSize ( 0 ),
     _maxSendBufSize ( 0 ),
+    _maxRcvBufSize ( 0 ),
     _nextRcvSeq ( 0 ),
     _sendDataSeq ( ( uint32_t ) Random::rand() ),
+    _rttSeq ( 0 ),
+    _recoverySeq ( _sendDataSeq ),
+    _rexmitSeq ( _sendDataSeq ),
+    _sackedBytes ( 0 ),
+    _dupAcks ( 0 ),
     _mtu ( mtu ),
     _mss ( 0 ),
+    _tcpFlags ( 0 ),
     _clientWScale ( 0 ),
-    _tcpFlags ( 0 )
+    _rcvWScale ( 0 ),
+    _rtoBackoff ( 0 )
 {
     assert ( flowDesc.common.type == 4 || flowDesc.common.type == 6 );
     assert ( flowDesc.common.heProto == TcpPacket::ProtoNumber );
@@ -82,6 +141,8 @@ TcpTerminator::TcpTerminator ( const FlowDesc & flowDesc, uint16_t mtu ):
 
 TcpTerminator::~TcpTerminator()
 {
+    delete _cc;
+    _cc = 0;
 }
 
 String TcpTerminator::getLogId() const
@@ -122,7 +183,7 @@ void TcpTerminator::timerExpired ( Timer * timer )
         {
             LOG ( L_DEBUG2, getLogId() << ": TCP Timer expired; Re-transmitting first packet from the queue" );
 
-            resendFirst();
+            handleRetransmitTimeout();
             return;
         }
         else if ( shouldSendFin() )
@@ -132,6 +193,14 @@ void TcpTerminator::timerExpired ( Timer * timer )
             sendAck();
             return;
         }
+        else if ( !_unsentBuffer.isEmpty() )
+        {
+            // Nothing is in flight, but there is unsent data; The tunnel didn't accept it before.
+            LOG ( L_DEBUG2, getLogId() << ": TCP Timer expired; Sending unsent data" );
+
+            sendUnsent();
+            return;
+        }
     }
 
     // TODO - Anything else?
@@ -152,6 +221,8 @@ void TcpTerminator::setBroken()
     _unsentBuffer.clear();
     _sentBuffer.clear();
 
+    clearSAckBlocks();
+
     _tcpState = TcpBroken;
     _tcpTimer.start ( LINGER_TIME );
 }
@@ -247,10 +318,8 @@ void TcpTerminator::appendData ( MemHandle & data )
 
     if ( !hasTcpFlag ( TcpFlagEoLSubscribed ) )
     {
-        // TODO: Maybe we need to do something differently if we are in 'retransmit' mode?
-        //       We may want to postpone sending until the retransmission succeeds...
-        //       On the other hand this is the data that is still within receiver's advertised receive window,
-        //       so it is a fair game! And we don't do congestion control anyway...
+        // The data will be sent at the end of the loop, as long as the congestion window allows it.
+        // Otherwise it will be sent once more data is acknowledged.
 
         setTcpFlag ( TcpFlagEoLSubscribed );
         EventManager::loopEndSubscribe ( this );
@@ -267,32 +336,58 @@ void TcpTerminator::receiveLoopEndEvent()
 
 void TcpTerminator::resendFirst()
 {
-    // Let's send a single packet using the data at the beginning of the buffer.
-    // We can send up to _mss bytes, even if they span over multiple chunks.
+    const size_t sent = resendData ( _sendDataSeq, _mss );
 
-    MemVector payload;
+    if ( sent > 0 && compareSeq ( _sendDataSeq + sent, _rexmitSeq ) > 0 )
+    {
+        _rexmitSeq = _sendDataSeq + sent;
+    }
+}
+
+size_t TcpTerminator::resendData ( uint32_t seq, size_t maxSize )
+{
+    // Let's send a single packet using the data in the buffer, starting at the given sequence number.
+    // We can send up to _mss bytes, even if they span over multiple chunks.
 
     assert ( _mss > 0 );
 
-    for ( size_t i = 0; i < _sentBuffer.getNumChunks() && payload.getDataSize() < _mss; ++i )
+    const int32_t offset = compareSeq ( seq, _sendDataSeq );
+
+    if ( offset < 0 || ( size_t ) offset >= _sentBuffer.getDataSize() )
     {
-        payload.append ( _sentBuffer.getChunk ( i ) );
+        return 0;
     }
 
-    payload.truncate ( _mss );
+    const size_t maxSend = min<size_t> ( maxSize, _mss );
+    const struct iovec * const chunks = _sentBuffer.getChunks();
+    size_t skip = offset;
 
-    if ( payload.isEmpty() )
+    MemVector payload;
+
+    for ( size_t i = 0; i < _sentBuffer.getNumChunks() && payload.getDataSize() < maxSend; ++i )
     {
-        return;
+        if ( skip >= chunks[ i ].iov_len )
+        {
+            skip -= chunks[ i ].iov_len;
+            continue;
+        }
+
+        payload.append ( _sentBuffer.getChunk ( i ), skip );
+        skip = 0;
     }
 
-    // This is the first packet in the buffer, so we use _sendDataSeq as the sequence number.
+    payload.truncate ( maxSend );
+
+    if ( payload.isEmpty() )
+    {
+        return 0;
+    }
 
     const TcpPacket dataPacket (
             ServerAddr, ServerPort,
             ClientAddr, ClientPort,
             TcpPacket::FlagAck,
-            _sendDataSeq,
+            seq,
             getAckToSend(),
             getWinSizeToAdvertise(),
             payload );
@@ -303,16 +398,77 @@ void TcpTerminator::resendFirst()
     {
         LOG_ERR ( L_ERROR, eCode, getLogId()
                   << ": Error sending TCP packet [" << dataPacket << "] over the tunnel interface" );
+
+        return 0;
     }
-    else
-    {
-        // We just sent a data packet. If there was a pending ACK needed, it no longer needs to be sent:
-        clearTcpFlag ( TcpFlagNeedsAck );
 
-        LOG ( L_DEBUG2, getLogId() << ": Re-transmitted TCP packet: " << dataPacket );
+    // We just sent a data packet. If there was a pending ACK needed, it no longer needs to be sent:
+    clearTcpFlag ( TcpFlagNeedsAck );
+
+    // We can't use RTT measurement if the data was re-transmitted (Karn's algorithm).
+    clearTcpFlag ( TcpFlagRttTimed );
+
+    LOG ( L_DEBUG2, getLogId() << ": Re-transmitted TCP packet: " << dataPacket );
+
+    return payload.getDataSize();
+}
+
+void TcpTerminator::sendRetransmissions()
+{
+    if ( !hasTcpFlag ( TcpFlagFastRecovery | TcpFlagRtoRecovery ) || !_cc )
+    {
+        return;
     }
 
-    _tcpTimer.start ( RETRANS_TIME );
+    const uint32_t lostEnd = getLostEndSeq();
+
+    while ( getPipe() < _cc->getCwnd() )
+    {
+        // We start at the first byte that hasn't been re-transmitted yet,
+        // skip the data that has been selectively acknowledged,
+        // and don't go past the next block of selectively acknowledged data.
+
+        uint32_t seq = ( compareSeq ( _rexmitSeq, _sendDataSeq ) > 0 ) ? _rexmitSeq : _sendDataSeq;
+        uint32_t end = lostEnd;
+
+        for ( size_t i = 0; i < _sackBlocks.size(); ++i )
+        {
+            const SAckBlock & block = _sackBlocks.at ( i );
+
+            if ( compareSeq ( block.end, seq ) <= 0 )
+            {
+                continue;
+            }
+
+            if ( compareSeq ( block.start, seq ) <= 0 )
+            {
+                seq = block.end;
+                continue;
+            }
+
+            if ( compareSeq ( block.start, end ) < 0 )
+            {
+                end = block.start;
+            }
+
+            break;
+        }
+
+        if ( compareSeq ( seq, end ) >= 0 )
+        {
+            // Nothing else is considered lost.
+            return;
+        }
+
+        const size_t sent = resendData ( seq, end - seq );
+
+        if ( sent < 1 )
+        {
+            return;
+        }
+
+        _rexmitSeq = seq + sent;
+    }
 }
 
 void TcpTerminator::sendUnsent()
@@ -327,6 +483,13 @@ void TcpTerminator::sendUnsent()
 
     while ( idx < _unsentBuffer.size() )
     {
+        if ( payload.isEmpty() && _cc != 0 && getPipe() >= _cc->getCwnd() )
+        {
+            // We are about to start a new packet, but the congestion window is full.
+            // We will send more once some data is acknowledged.
+            break;
+        }
+
         const MemHandle & mh ( _unsentBuffer.at ( idx ) );
 
         assert ( payload.getDataSize() < _mss );
@@ -361,11 +524,12 @@ void TcpTerminator::sendUnsent()
         // Let's try to send the packet!
         // This is the first packet AFTER current _sentBuffer, so we use _sendDataSeq + sent-buf-size as the SEQ number.
 
+        const uint32_t dataSeq = _sendDataSeq + _sentBuffer.getDataSize();
         const TcpPacket dataPacket (
                 ServerAddr, ServerPort,
                 ClientAddr, ClientPort,
                 TcpPacket::FlagAck,
-                _sendDataSeq + _sentBuffer.getDataSize(),
+                dataSeq,
                 getAckToSend(),
                 getWinSizeToAdvertise(),
                 payload );
@@ -383,6 +547,15 @@ void TcpTerminator::sendUnsent()
 
         LOG ( L_DEBUG2, getLogId() << ": Successfully sent TCP packet: " << dataPacket );
 
+        if ( !hasTcpFlag ( TcpFlagRttTimed ) )
+        {
+            // We measure the RTT of one data segment at a time.
+            setTcpFlag ( TcpFlagRttTimed );
+
+            _rttSeq = dataSeq + payload.getDataSize();
+            _rttTime = EventManager::getCurrentTime();
+        }
+
         // Move the data to 'sent' buffer:
         _sentBuffer.append ( payload );
 
@@ -433,13 +606,15 @@ void TcpTerminator::sendUnsent()
         clearTcpFlag ( TcpFlagNeedsAck );
     }
 
-    // We want to restart it even if it's running.
+    // We only start the timer if it's not running already (RFC 6298); It is restarted when data is acknowledged.
     // It will be used to resend the data once it stops flowing.
-    // Otherwise (if something gets lost) we should get a duplicate ACK that will trigger re-transmission.
-    // Also, if we didn't actually send anything, it would be because the tunnel didn't accept it.
-    // From the perspective of this object, it is similar behaviour to having the packet lost.
-    // So we still want to try re-transmit it after a delay.
-    _tcpTimer.start ( RETRANS_TIME );
+    // Otherwise (if something gets lost) we should get duplicate ACKs that will trigger re-transmission.
+    // Also, if we didn't actually send anything, it would be because the tunnel didn't accept it,
+    // or because of the congestion window. The timer makes sure we will try again.
+    if ( !_tcpTimer.isActive() )
+    {
+        _tcpTimer.start ( getRto() );
+    }
 }
 
 ERRCODE TcpTerminator::consumeReceivedData()
@@ -572,6 +747,8 @@ ERRCODE TcpTerminator::packetReceived ( IpPacket & ipPacket, int32_t userData, v
             LOG ( L_DEBUG2, getLogId() << ": Our SYN-ACK packet has been acknowledged by [" << ipPacket
                   << "]; Switching to '" << getTcpStateName ( TcpConnected ) << "' state" );
 
+            // This is the first window that is scaled; The one in the SYN packet was not.
+            _maxSendBufSize = adjustedMaxSendBufSize ( tcpHdr->getWindow() << _clientWScale );
             _tcpState = TcpConnected;
             return Error::Success;
         }
@@ -886,14 +1063,18 @@ void TcpTerminator::handleAckPacket ( IpPacket & ipPacket )
             _sentBuffer.clear();
         }
 
+        clearSAckBlocks();
+        clearTcpFlag ( TcpFlagFastRecovery | TcpFlagRtoRecovery );
+
         return;
     }
 
     // This is a valid ACK.
     // First, let's update the max buffer size:
     const uint32_t newBufSize = adjustedMaxSendBufSize ( tcpHdr->getWindow() << _clientWScale );
+    const bool windowChanged = ( newBufSize != _maxSendBufSize );
 
-    if ( newBufSize != _maxSendBufSize )
+    if ( windowChanged )
     {
         // It changed!
         // TODO: In case it's a zero window, we may need to handle this better and start probing...
@@ -904,6 +1085,9 @@ void TcpTerminator::handleAckPacket ( IpPacket & ipPacket )
         _maxSendBufSize = newBufSize;
     }
 
+    // Let's see if the client selectively acknowledged anything (only if we use SACK).
+    updateSAckBlocks ( ipPacket );
+
     if ( _sentBuffer.isEmpty() )
     {
         // If the send buffer is empty, this is a keep-alive, or a zero window probe.
@@ -932,18 +1116,38 @@ void TcpTerminator::handleAckPacket ( IpPacket & ipPacket )
             return;
         }
 
-        // This is probably a duplicate ACK, meaning that the first packet was lost.
-        // Let's send it again!
+        if ( windowChanged )
+        {
+            // This is a window update, not a duplicate ACK (RFC 5681).
+            // More data may fit in the window now:
+            sendUnsent();
+            return;
+        }
 
-        // TODO: This may need to be improved.
-        //       For instance, we could count duplicate ACKs and only react when that counter reaches
-        //       specific value... This could affect the re-transmit timer.
+        // This is a duplicate ACK, meaning that something got lost (or reordered).
+
+        ++_dupAcks;
 
         LOG ( L_DEBUG2, getLogId() << ": Duplicate ACK received: [" << ipPacket
-              << "]; Re-transmitting the first packet from the buffer (with sequence number "
-              << _sendDataSeq << ")" );
+              << "]; Duplicate ACKs: " << _dupAcks << "; Selectively acknowledged bytes: " << _sackedBytes );
+
+        if ( !hasTcpFlag ( TcpFlagFastRecovery | TcpFlagRtoRecovery )
+             && ( _dupAcks >= DUP_ACK_THRESHOLD || _sackedBytes >= DUP_ACK_THRESHOLD * ( uint32_t ) _mss )
+             && compareSeq ( _sendDataSeq, _recoverySeq ) >= 0 )
+        {
+            // We don't start a new recovery until everything that was in flight when the previous recovery
+            // started is acknowledged (RFC 6582). Otherwise we could reduce the window multiple times
+            // for the same loss event.
+
+            startFastRecovery();
+        }
+
+        // Every duplicate ACK means that some data left the network.
+        // We may be able to re-transmit more data (if we are in recovery), or to send new data
+        // (otherwise it's "limited transmit", RFC 3042).
 
-        resendFirst();
+        sendRetransmissions();
+        sendUnsent();
         return;
     }
 
@@ -955,9 +1159,51 @@ void TcpTerminator::handleAckPacket ( IpPacket & ipPacket )
     LOG ( L_DEBUG4, getLogId()
           << ": Removing " << seqDiff << " acknowledged bytes from send buffer; ACK packet: " << ipPacket );
 
+    const uint32_t flightSize = _sentBuffer.getDataSize();
+    const Time & now = EventManager::getCurrentTime();
+
     _sendDataSeq += seqDiff;
     _sentBuffer.consume ( seqDiff );
 
+    pruneSAckBlocks();
+
+    _dupAcks = 0;
+    _rtoBackoff = 0;
+
+    if ( hasTcpFlag ( TcpFlagRttTimed ) && compareSeq ( ackNum, _rttSeq ) >= 0 )
+    {
+        clearTcpFlag ( TcpFlagRttTimed );
+
+        _rttStat.addRtt ( ( uint32_t ) max<long> ( now.getDiffInMilliSeconds ( _rttTime ), 0 ) );
+    }
+
+    if ( hasTcpFlag ( TcpFlagFastRecovery | TcpFlagRtoRecovery ) && compareSeq ( ackNum, _recoverySeq ) >= 0 )
+    {
+        LOG ( L_DEBUG2, getLogId() << ": Loss recovery completed" );
+
+        if ( hasTcpFlag ( TcpFlagFastRecovery ) && _cc != 0 )
+        {
+            _cc->recoveryCompleted();
+        }
+
+        clearTcpFlag ( TcpFlagFastRecovery | TcpFlagRtoRecovery );
+    }
+    else if ( hasTcpFlag ( TcpFlagFastRecovery ) )
+    {
+        // A partial ACK during fast recovery. It means that the next segment was lost as well (RFC 6582).
+        // We re-transmit it right away (unless it has been re-transmitted already).
+
+        if ( compareSeq ( _rexmitSeq, _sendDataSeq ) <= 0 )
+        {
+            resendFirst();
+        }
+    }
+    else if ( _cc != 0 )
+    {
+        // Outside of fast recovery (including recovery after timeout) the window grows.
+        _cc->dataAcked ( seqDiff, flightSize, _rttStat, now );
+    }
+
     if ( _tcpState != TcpConnected )
     {
         // We only touch the timer in 'connected' state.
@@ -966,20 +1212,18 @@ void TcpTerminator::handleAckPacket ( IpPacket & ipPacket )
         return;
     }
 
+    // The window (or the pipe) may allow us to send more data now.
+    // This may also start the timer.
+    sendRetransmissions();
+    sendUnsent();
+
     if ( !_sentBuffer.isEmpty() )
     {
         // We still have some data in _sentBuffer, but since something got acknowledged,
         // we want to give the receiver more time to react to other packets.
-        _tcpTimer.start ( RETRANS_TIME );
+        _tcpTimer.start ( getRto() );
     }
-    else if ( !_unsentBuffer.isEmpty() )
-    {
-        // 'sent' buffer is empty, but there is something in 'unsent' one.
-        // This could mean the tunnel didn't accept it earlier and we should try to send it now.
-        // This should also start the timer.
-        sendUnsent();
-    }
-    else
+    else if ( _unsentBuffer.isEmpty() )
     {
         // There is nothing in unsent and nothing in sent buffers, no need to have re-transmit timer running.
         _tcpTimer.stop();
@@ -991,6 +1235,294 @@ uint16_t TcpTerminator::adjustMss ( uint16_t mss ) const
     return mss;
 }
 
+TcpCongestionControl * TcpTerminator::createCongestionControl()
+{
+    TcpCongestionControl * cc = TcpCongestionControl::create ( optCongestionControl.value(), _mss );
+
+    if ( !cc )
+    {
+        LOG ( L_WARN, getLogId() << ": Unknown congestion control algorithm: '"
+              << optCongestionControl.value() << "'; Using NewReno" );
+
+        cc = new TcpNewReno ( _mss );
+    }
+
+    return cc;
+}
+
+uint32_t TcpTerminator::getRto() const
+{
+    // Until we have an RTT measurement we use the initial value.
+    const uint32_t rto = ( _rttStat.getMinRtt() > 0 ) ? _rttStat.getRto() : INITIAL_RTO;
+
+    return min<uint32_t> ( rto << _rtoBackoff, MAX_RTO );
+}
+
+uint32_t TcpTerminator::getLostEndSeq() const
+{
+    if ( hasTcpFlag ( TcpFlagRtoRecovery ) )
+    {
+        // After a timeout, everything that was in flight is considered lost.
+        return _recoverySeq;
+    }
+
+    if ( !hasTcpFlag ( TcpFlagFastRecovery ) )
+    {
+        return _sendDataSeq;
+    }
+
+    // During fast recovery the first segment is considered lost (that's what duplicate ACKs tell us),
+    // as well as everything before the last block of selectively acknowledged data that hasn't been
+    // acknowledged (the client received later data, so this is most likely lost).
+
+    uint32_t lostEnd = _sendDataSeq + min<uint32_t> ( _mss, _sentBuffer.getDataSize() );
+
+    if ( !_sackBlocks.isEmpty() && compareSeq ( _sackBlocks.last().start, lostEnd ) > 0 )
+    {
+        lostEnd = _sackBlocks.last().start;
+    }
+
+    return lostEnd;
+}
+
+uint32_t TcpTerminator::getPipe() const
+{
+    const uint32_t flightSize = _sentBuffer.getDataSize();
+
+    // Without SACK, we assume that every duplicate ACK means that one segment has left the network.
+    const uint32_t sacked = hasTcpFlag ( TcpFlagSAckUsed )
+                            ? _sackedBytes
+                            : min<uint32_t> ( flightSize, min<uint32_t> ( _dupAcks, 0xFFFF ) * _mss );
+
+    uint32_t lost = 0;
+
+    if ( hasTcpFlag ( TcpFlagFastRecovery | TcpFlagRtoRecovery ) )
+    {
+        // The data considered lost, that hasn't been re-transmitted yet, is not in the network.
+
+        const uint32_t lostStart = ( compareSeq ( _rexmitSeq, _sendDataSeq ) > 0 ) ? _rexmitSeq : _sendDataSeq;
+        const uint32_t lostEnd = getLostEndSeq();
+
+        if ( compareSeq ( lostEnd, lostStart ) > 0 )
+        {
+            lost = ( lostEnd - lostStart ) - getSAckedBytes ( lostStart, lostEnd );
+        }
+    }
+
+    return ( flightSize > sacked + lost ) ? ( flightSize - sacked - lost ) : 0;
+}
+
+void TcpTerminator::startFastRecovery()
+{
+    const uint32_t flightSize = _sentBuffer.getDataSize();
+
+    LOG ( L_DEBUG2, getLogId() << ": Loss detected; Starting fast recovery; Bytes in flight: " << flightSize
+          << "; Duplicate ACKs: " << _dupAcks << "; Selectively acknowledged bytes: " << _sackedBytes );
+
+    if ( _cc != 0 )
+    {
+        _cc->lossDetected ( flightSize, EventManager::getCurrentTime() );
+    }
+
+    setTcpFlag ( TcpFlagFastRecovery );
+
+    _recoverySeq = _sendDataSeq + flightSize;
+    _rexmitSeq = _sendDataSeq;
+
+    // The first segment is re-transmitted right away, regardless of the congestion window (RFC 6675).
+    resendFirst();
+    sendRetransmissions();
+}
+
+void TcpTerminator::handleRetransmitTimeout()
+{
+    const uint32_t flightSize = _sentBuffer.getDataSize();
+
+    if ( _cc != 0 )
+    {
+        _cc->retransmitTimeout ( flightSize, EventManager::getCurrentTime() );
+    }
+
+    if ( _rtoBackoff < MAX_RTO_BACKOFF )
+    {
+        ++_rtoBackoff;
+    }
+
+    // Everything that was in flight is now considered lost, and will be re-transmitted as the window allows.
+    // We also forget the SACK information, the client is allowed to discard the data it selectively acknowledged.
+
+    clearSAckBlocks();
+    clearTcpFlag ( TcpFlagFastRecovery );
+    setTcpFlag ( TcpFlagRtoRecovery );
+
+    _dupAcks = 0;
+    _recoverySeq = _sendDataSeq + flightSize;
+    _rexmitSeq = _sendDataSeq;
+
+    resendFirst();
+    sendRetransmissions();
+
+    _tcpTimer.start ( getRto() );
+}
+
+bool TcpTerminator::updateSAckBlocks ( const IpPacket & ipPacket )
+{
+    if ( !hasTcpFlag ( TcpFlagSAckUsed ) )
+    {
+        return false;
+    }
+
+    const TcpPacket::Header * const tcpHdr = ipPacket.getProtoHeader<TcpPacket>();
+
+    if ( !tcpHdr )
+    {
+        return false;
+    }
+
+    uint32_t edges[ 2 * MAX_SACK_OPT_BLOCKS ];
+    const uint8_t numBlocks = tcpHdr->getOptSAck ( edges, MAX_SACK_OPT_BLOCKS );
+    bool updated = false;
+
+    for ( uint8_t i = 0; i < numBlocks; ++i )
+    {
+        if ( addSAckBlock ( edges[ 2 * i ], edges[ 2 * i + 1 ] ) )
+        {
+            updated = true;
+        }
+    }
+
+    return updated;
+}
+
+bool TcpTerminator::addSAckBlock ( uint32_t start, uint32_t end )
+{
+    const uint32_t sendEnd = _sendDataSeq + _sentBuffer.getDataSize();
+
+    // We ignore blocks that are invalid, or describe data that is not in flight
+    // (these could be "duplicate" SACK blocks, RFC 2883).
+    // Otherwise we only use the part of the block that describes the data in flight.
+
+    if ( compareSeq ( start, end ) >= 0
+         || compareSeq ( end, _sendDataSeq ) <= 0
+         || compareSeq ( start, sendEnd ) >= 0 )
+    {
+        return false;
+    }
+
+    SAckBlock newBlock;
+
+    newBlock.start = ( compareSeq ( start, _sendDataSeq ) > 0 ) ? start : _sendDataSeq;
+    newBlock.end = ( compareSeq ( end, sendEnd ) < 0 ) ? end : sendEnd;
+
+    List<SAckBlock> blocks;
+    uint32_t sackedBytes = 0;
+    bool added = false;
+
+    for ( size_t i = 0; i < _sackBlocks.size(); ++i )
+    {
+        const SAckBlock & block = _sackBlocks.at ( i );
+
+        if ( compareSeq ( block.end, newBlock.start ) < 0 )
+        {
+            // Existing block is before the new one.
+            blocks.append ( block );
+            sackedBytes += block.end - block.start;
+        }
+        else if ( compareSeq ( block.start, newBlock.end ) > 0 )
+        {
+            // Existing block is after the new one.
+            if ( !added )
+            {
+                blocks.append ( newBlock );
+                sackedBytes += newBlock.end - newBlock.start;
+                added = true;
+            }
+
+            blocks.append ( block );
+            sackedBytes += block.end - block.start;
+        }
+        else
+        {
+            // The blocks overlap (or are adjacent); We merge the existing one into the new one.
+
+            if ( compareSeq ( block.start, newBlock.start ) < 0 )
+            {
+                newBlock.start = block.start;
+            }
+
+            if ( compareSeq ( block.end, newBlock.end ) > 0 )
+            {
+                newBlock.end = block.end;
+            }
+        }
+    }
+
+    if ( !added )
+    {
+        blocks.append ( newBlock );
+        sackedBytes += newBlock.end - newBlock.start;
+    }
+
+    if ( blocks.size() > MAX_SACK_BLOCKS || sackedBytes <= _sackedBytes )
+    {
+        // Too many blocks, or nothing new.
+        return false;
+    }
+
+    _sackBlocks = blocks;
+    _sackedBytes = sackedBytes;
+
+    return true;
+}
+
+void TcpTerminator::pruneSAckBlocks()
+{
+    // Blocks are sorted, so we only need to look at the beginning of the list.
+
+    while ( !_sackBlocks.isEmpty() && compareSeq ( _sackBlocks.first().start, _sendDataSeq ) < 0 )
+    {
+        SAckBlock & block = _sackBlocks.first();
+
+        if ( compareSeq ( block.end, _sendDataSeq ) <= 0 )
+        {
+            // The entire block is now acknowledged.
+            _sackedBytes -= block.end - block.start;
+            _sackBlocks.removeFirst();
+            continue;
+        }
+
+        // Only the beginning of the block is acknowledged.
+        _sackedBytes -= _sendDataSeq - block.start;
+        block.start = _sendDataSeq;
+        break;
+    }
+}
+
+uint32_t TcpTerminator::getSAckedBytes ( uint32_t start, uint32_t end ) const
+{
+    uint32_t sacked = 0;
+
+    for ( size_t i = 0; i < _sackBlocks.size(); ++i )
+    {
+        const SAckBlock & block = _sackBlocks.at ( i );
+
+        if ( compareSeq ( block.start, end ) >= 0 )
+        {
+            break;
+        }
+
+        const uint32_t bStart = ( compareSeq ( block.start, start ) > 0 ) ? block.start : start;
+        const uint32_t bEnd = ( compareSeq ( block.end, end ) < 0 ) ? block.end : end;
+
+        if ( compareSeq ( bEnd, bStart ) > 0 )
+        {
+            sacked += bEnd - bStart;
+        }
+    }
+
+    return sacked;
+}
+
 ERRCODE TcpTerminator::handleSynPacket ( IpPacket & ipPacket )
 {
     const TcpPacket::Header * const tcpHdr = ipPacket.getProtoHeader<TcpPacket>();
@@ -1047,7 +1579,28 @@ ERRCODE TcpTerminator::handleSynPacket ( IpPacket & ipPacket )
     uint16_t clientMss = 0;
 
     tcpHdr->getOptMss ( clientMss );
-    tcpHdr->getOptWindowScale ( _clientWScale );
+
+    _clientWScale = 0;
+    clearTcpFlag ( TcpFlagWScaleUsed | TcpFlagSAckUsed );
+
+    if ( tcpHdr->getOptWindowScale ( _clientWScale ) )
+    {
+        // The client offered window scaling, which means that we can use it in both directions.
+        setTcpFlag ( TcpFlagWScaleUsed );
+
+        if ( _clientWScale > MAX_WSCALE )
+        {
+            LOG ( L_WARN, getLogId() << ": Window-scale received (" << _clientWScale
+                  << ") is too large; Using " << MAX_WSCALE );
+
+            _clientWScale = MAX_WSCALE;
+        }
+    }
+
+    if ( optUseSAck.value() && tcpHdr->getOptSAckPermitted() )
+    {
+        setTcpFlag ( TcpFlagSAckUsed );
+    }
 
     assert ( getSendBufSize() == 0 );
     assert ( _rcvBufSize == 0 );
@@ -1110,8 +1663,35 @@ ERRCODE TcpTerminator::handleSynPacket ( IpPacket & ipPacket )
 
     assert ( _mss > 0 );
 
+    _maxRcvBufSize = max<uint32_t> ( optRcvBufSize.value(), _mss * 2 );
+    _rcvWScale = 0;
+
+    if ( hasTcpFlag ( TcpFlagWScaleUsed ) )
+    {
+        // We use the smallest window-scale value that allows us to advertise the entire receive buffer.
+        while ( _rcvWScale < MAX_WSCALE && ( _maxRcvBufSize >> _rcvWScale ) > 0xFFFF )
+        {
+            ++_rcvWScale;
+        }
+    }
+    else if ( _maxRcvBufSize > 0xFFFF )
+    {
+        // Without window scaling we can't advertise larger windows.
+        _maxRcvBufSize = 0xFFFF;
+    }
+
+    if ( !_cc )
+    {
+        _cc = createCongestionControl();
+
+        LOG ( L_DEBUG2, getLogId() << ": Using congestion control: " << ( _cc != 0 ? _cc->getName() : "none" )
+              << "; Receive buffer: " << _maxRcvBufSize << " (window-scale: " << _rcvWScale << ")" );
+    }
+
     _nextRcvSeq = tcpHdr->getSeqNum() + 1;
-    _maxSendBufSize = adjustedMaxSendBufSize ( tcpHdr->getWindow() << _clientWScale );
+
+    // The window in SYN packets is never scaled (RFC 7323).
+    _maxSendBufSize = adjustedMaxSendBufSize ( tcpHdr->getWindow() );
 
     if ( initializeReceiver ( ipPacket ) )
     {
@@ -1135,22 +1715,33 @@ void TcpTerminator::sendSynAck()
     }
 
     // We need to send our MSS value.
-    // We also want to use receiver's window scaling - if the receiver offered (_clientWScale > 0).
-    // At the moment we don't scale our window (for simplicity),
-    // but we still need to include that option (with no scaling: = 0).
-    // If we didn't include this option at all, scaling would be disabled in both directions.
+    // If the client offered window scaling, we need to include our own window-scale value
+    // (even if it's 0). If we didn't include this option at all, scaling would be disabled in both directions.
+    // If the client offered selective acknowledgements (and we want to use them), we need to tell them that too.
+
+    TcpPacket::Option opts[ 3 ];
+    uint8_t numOpts = 0;
 
-    TcpPacket::Option opts[ 2 ];
     const uint16_t oMss = htons ( _mss );
-    const uint8_t oWScale = 0;
 
-    opts[ 0 ].type = TcpPacket::OptMss;
-    opts[ 0 ].data = &oMss;
-    opts[ 0 ].dataLength = sizeof ( oMss );
+    opts[ numOpts ].type = TcpPacket::OptMss;
+    opts[ numOpts ].data = &oMss;
+    opts[ numOpts ].dataLength = sizeof ( oMss );
+    ++numOpts;
 
-    opts[ 1 ].type = TcpPacket::OptWScale;
-    opts[ 1 ].data = &oWScale;
-    opts[ 1 ].dataLength = 1;
+    if ( hasTcpFlag ( TcpFlagWScaleUsed ) )
+    {
+        opts[ numOpts ].type = TcpPacket::OptWScale;
+        opts[ numOpts ].data = &_rcvWScale;
+        opts[ numOpts ].dataLength = 1;
+        ++numOpts;
+    }
+
+    if ( hasTcpFlag ( TcpFlagSAckUsed ) )
+    {
+        opts[ numOpts ].type = TcpPacket::OptSAckPerm;
+        ++numOpts;
+    }
 
     // NOTE: We send _sendDataSeq-1 as the sequence number, because it's a SYN-ACK packet.
     //       _sendDataSeq will be used for the first data byte.
@@ -1161,10 +1752,10 @@ void TcpTerminator::sendSynAck()
             TcpPacket::FlagSyn | TcpPacket::FlagAck,
             _sendDataSeq - 1,
             _nextRcvSeq,
-            getWinSizeToAdvertise(),
+            min<uint32_t> ( 0xFFFF, getRcvWindow() ), // The window in SYN packets is never scaled (RFC 7323).
             MemVector::EmptyVector,
             opts,
-            ( _clientWScale > 0 ) ? 2 : 1 );
+            numOpts );
 
     LOG ( L_DEBUG2, getLogId() << ": Sending SYN-ACK packet: " << respPacket );
 
@@ -1187,7 +1778,7 @@ void TcpTerminator::sendAck()
         assert ( _tcpState != TcpClosed );
 
         flagsToSend |= TcpPacket::FlagFin;
-        _tcpTimer.start ( RETRANS_TIME );
+        _tcpTimer.start ( getRto() );
     }
 
     uint32_t dataSeq;
@@ -19,23 +19,45 @@
 #include "basic/Math.hpp"
 #include "basic/IpAddress.hpp"
 #include "basic/MemVector.hpp"
+#include "config/ConfigNumber.hpp"
+#include "config/ConfigString.hpp"
 #include "net/IpFlow.hpp"
+#include "net/RttStat.hpp"
 #include "log/TextLog.hpp"
+#include "sys/Time.hpp"
 #include "event/Timer.hpp"
 #include "event/EventManager.hpp"
 
 namespace Pravala
 {
 class IpPacket;
+class TcpCongestionControl;
 
 /// @brief A TCP terminator that allows for handling TCP connections incoming as IP packets over the tunnel interface.
 /// It makes it possible to create TCP servers that operate using IP packets sent/received over the tunnel interface,
 /// instead of using regular socket FDs.
 /// @note When using IpFlow::packetReceived() call, it expects packets 'DefaultDescType' passed as the 'user data'.
 ///       Otherwise packets will be dropped. User pointer is always ignored.
+/// The terminator uses window scaling (RFC 7323) with configurable send and receive buffer sizes.
+/// The amount of data in flight is limited by a congestion controller (see TcpCongestionControl).
+/// Losses are detected using duplicate ACKs and SACK information (if the client supports it), and recovered
+/// from using SACK-based loss recovery (RFC 6675), or NewReno (RFC 6582) if SACK is not used.
+/// The retransmission timeout is based on measured RTT (RFC 6298).
 class TcpTerminator: protected IpFlow, protected Timer::Receiver, protected EventManager::LoopEndEventHandler
 {
     public:
+        /// @brief The max size of the receive buffer (and the max receive window advertised).
+        static ConfigLimitedNumber<uint32_t> optRcvBufSize;
+
+        /// @brief The max size of the send buffer.
+        static ConfigLimitedNumber<uint32_t> optSendBufSize;
+
+        /// @brief The name of the congestion control algorithm to use.
+        static ConfigString optCongestionControl;
+
+        /// @brief Whether to use selective acknowledgements (if the client supports them).
+        static ConfigNumber<bool> optUseSAck;
+
         /// @brief IP address of this flow's client (the client sending the IP packets).
         const IpAddress ClientAddr;
 
@@ -111,33 +133,55 @@ class TcpTerminator: protected IpFlow, protected Timer::Receiver, protected Even
         /// @brief Set to true whenever we fail to send all the data we're given.
         /// This could happen, for example, due to client receive window restrictions.
         /// It will trigger a callback once we can read data again.
-        static const uint8_t TcpFlagSendBlocked = ( 1 << 0 );
+        static const uint16_t TcpFlagSendBlocked = ( 1 << 0 );
 
         /// @brief A helper flag set to 'true' whenever we need to send a packet with an ACK in it.
         /// It is used to avoid sending empty ACK packets when we are sending data packets anyway.
-        static const uint8_t TcpFlagNeedsAck = ( 1 << 1 );
+        static const uint16_t TcpFlagNeedsAck = ( 1 << 1 );
 
         /// @brief Set to true when the SYN packet from the client is accepted.
         /// It causes future SYN packets to be ignored.
-        static const uint8_t TcpFlagSynAccepted = ( 1 << 2 );
+        static const uint16_t TcpFlagSynAccepted = ( 1 << 2 );
 
         /// @brief Set to true when we send SYN-ACK packet to TCP client.
-        static const uint8_t TcpFlagSentSynAck = ( 1 << 3 );
+        static const uint16_t TcpFlagSentSynAck = ( 1 << 3 );
 
         /// @brief Set to true when we send FIN packet to TCP client.
         /// It means that the data stream in client's direction has ended.
-        static const uint8_t TcpFlagSentFin = ( 1 << 4 );
+        static const uint16_t TcpFlagSentFin = ( 1 << 4 );
 
         /// @brief Set to true when the FIN packet sent to TCP client is acknowledged.
         /// It means that the client acknowledged our FIN request.
-        static const uint8_t TcpFlagRcvdFinAck = ( 1 << 5 );
+        static const uint16_t TcpFlagRcvdFinAck = ( 1 << 5 );
 
         /// @brief Set to true when we receive in-order FIN packet from TCP client.
         /// It means that the data stream from client's direction has ended.
-        static const uint8_t TcpFlagRcvdFin = ( 1 << 6 );
+        static const uint16_t TcpFlagRcvdFin = ( 1 << 6 );
 
         /// @brief Set to true when we subscribe to end-of-loop events.
-        static const uint8_t TcpFlagEoLSubscribed = ( 1 << 7 );
+        static const uint16_t TcpFlagEoLSubscribed = ( 1 << 7 );
+
+        /// @brief Set when the client offered window scaling (which means it's used in both directions).
+        static const uint16_t TcpFlagWScaleUsed = ( 1 << 8 );
+
+        /// @brief Set when the client offered selective acknowledgements, and we use them.
+        static const uint16_t TcpFlagSAckUsed = ( 1 << 9 );
+
+        /// @brief Set when the RTT of a data segment is being measured.
+        static const uint16_t TcpFlagRttTimed = ( 1 << 10 );
+
+        /// @brief Set while we are in fast recovery (after detecting a loss using duplicate ACKs or SACK).
+        static const uint16_t TcpFlagFastRecovery = ( 1 << 11 );
+
+        /// @brief Set while we are recovering from a retransmission timeout.
+        static const uint16_t TcpFlagRtoRecovery = ( 1 << 12 );
+
+        /// @brief Describes a block of selectively acknowledged data.
+        struct SAckBlock
+        {
+            uint32_t start; ///< The sequence number of the first byte in the block.
+            uint32_t end; ///< The sequence number right after the last byte in the block.
+        };
 
         SimpleTimer _tcpTimer; ///< Timer for TCP operations.
 
@@ -148,7 +192,16 @@ class TcpTerminator: protected IpFlow, protected Timer::Receiver, protected Even
 
         List<MemHandle> _rcvBuffer;  ///< Data received over the TCP connection. It only includes in-order data.
 
-        // TODO: Could these use uint16_t?
+        /// @brief The blocks of data, past the first unacknowledged byte, that the client has selectively
+        /// acknowledged (the "SACK scoreboard"). They are sorted, and they don't overlap.
+        List<SAckBlock> _sackBlocks;
+
+        RttStat _rttStat; ///< RTT statistics, used for calculating the retransmission timeout.
+        Time _rttTime; ///< The time at which the data segment whose RTT is being measured was sent.
+
+        /// @brief The congestion controller.
+        /// It is created once the MSS is known (when the SYN packet is accepted).
+        TcpCongestionControl * _cc;
 
         uint32_t _unsentBufSize; ///< The size of the data in _unsentBuffer (in bytes).
         uint32_t _rcvBufSize;  ///< The size of the data in _rcvBuffer (in bytes).
@@ -157,6 +210,10 @@ class TcpTerminator: protected IpFlow, protected Timer::Receiver, protected Even
         /// This is based on client's receive window.
         uint32_t _maxSendBufSize;
 
+        /// @brief The max size of the receive buffer.
+        /// It is set when the SYN packet is received.
+        uint32_t _maxRcvBufSize;
+
         /// @brief The next sequence number expected from the client.
         /// This is the sequence number of the last data byte in _rcvBuffer + 1.
         /// This value will be sent as an ACK in outgoing TCP packets.
@@ -168,6 +225,23 @@ class TcpTerminator: protected IpFlow, protected Timer::Receiver, protected Even
         /// not been acknowledged by the client yet.
         uint32_t _sendDataSeq;
 
+        /// @brief The sequence number that ends the data segment whose RTT is being measured.
+        uint32_t _rttSeq;
+
+        /// @brief The sequence number right after the last data byte sent when the loss recovery started.
+        /// The recovery ends once all the data up to that point is acknowledged. We also don't start a new
+        /// fast recovery until the client acknowledges this point.
+        uint32_t _recoverySeq;
+
+        /// @brief The sequence number of the first byte that has not been retransmitted during current recovery.
+        uint32_t _rexmitSeq;
+
+        /// @brief The number of bytes in _sackBlocks.
+        uint32_t _sackedBytes;
+
+        /// @brief The number of duplicate ACKs received in a row.
+        uint32_t _dupAcks;
+
         /// @brief The MTU to be used by the terminator to adjust the MSS.
         /// If 0, the MSS will not be adjusted.
         const uint16_t _mtu;
@@ -176,8 +250,12 @@ class TcpTerminator: protected IpFlow, protected Timer::Receiver, protected Even
         /// It is based on the MSS received from the TCP client, potentially lowered to fit in tunnel iface's MTU.
         uint16_t _mss;
 
+        uint16_t _tcpFlags; ///< Helper flags.
+
         uint8_t _clientWScale; ///< Window-scale value received from the TCP client.
-        uint8_t _tcpFlags; ///< Helper flags.
+        uint8_t _rcvWScale; ///< Window-scale value that we use for our receive window.
+
+        uint8_t _rtoBackoff; ///< The number of times the retransmission timeout has been doubled.
 
         /// @brief Constructor.
         /// @param [in] flowDesc FlowDesc object describing this flow. It MUST describe a TCPv4 or TCPv6 packet!
@@ -187,14 +265,14 @@ class TcpTerminator: protected IpFlow, protected Timer::Receiver, protected Even
 
         /// @brief Sets specified TCP flag.
         /// @param [in] flag The flag to set.
-        inline void setTcpFlag ( uint8_t flag )
+        inline void setTcpFlag ( uint16_t flag )
         {
             _tcpFlags |= flag;
         }
 
         /// @brief Clears specified TCP flag.
         /// @param [in] flag The flag to clear.
-        inline void clearTcpFlag ( uint8_t flag )
+        inline void clearTcpFlag ( uint16_t flag )
         {
             _tcpFlags &= ~flag;
         }
@@ -203,7 +281,7 @@ class TcpTerminator: protected IpFlow, protected Timer::Receiver, protected Even
         /// @param [in] flag The flag to check.
         /// @return True if the flag is set (if multiple flags are passed, it checks if any of them is set);
         ///         False if the flag (or none of multiple flags) is set.
-        inline bool hasTcpFlag ( uint8_t flag ) const
+        inline bool hasTcpFlag ( uint16_t flag ) const
         {
             return ( _tcpFlags & flag ) != 0;
         }
@@ -235,37 +313,46 @@ class TcpTerminator: protected IpFlow, protected Timer::Receiver, protected Even
         }
 
         /// @brief Calculates adjusted max send buffer size.
-        /// We clamp the max buffer size for sending data to at most 2*MSS.
-        /// This is to limit the amount of memory used for buffering data.
-        /// We want to allow at least 1*MSS to take advantage of tunnel's MTU.
-        /// However, 1*MSS results in poor performance (most likely due to delayed ACKs).
-        /// 2*MSS is sufficient to achieve good speeds, and that's the limit we use.
+        /// We clamp the max buffer size for sending data to the configured send buffer size,
+        /// to limit the amount of memory used for buffering data.
+        /// We always allow at least 2*MSS; 1*MSS results in poor performance (most likely due to delayed ACKs).
         /// @param [in] maxSendBufSize The max send buffer size to adjust.
         /// @return The adjusted value to be used as the max send buffer size.
         inline uint32_t adjustedMaxSendBufSize ( uint32_t maxSendBufSize ) const
         {
             assert ( _mss > 0 );
 
-            return min<uint32_t> ( maxSendBufSize, _mss * 2 );
+            return min<uint32_t> ( maxSendBufSize, max<uint32_t> ( optSendBufSize.value(), _mss * 2 ) );
         }
 
-        /// @brief Calculates the size of the receive windows to advertise.
+        /// @brief Calculates the size of the receive window (in bytes).
         /// It takes into account the amount of data remaining in the receive buffer.
-        /// It will also clamp the window to 2*MSS, to limit the amount of buffered data.
-        /// Using 1*MSS results in poor throughput, 2*MSS makes the throughput much better.
-        /// @return The size of the receive window to advertise.
-        inline uint16_t getWinSizeToAdvertise() const
+        /// @return The size of the receive window (in bytes).
+        inline uint32_t getRcvWindow() const
         {
-            assert ( _mss > 0 );
-
-            const uint32_t doubleMss = _mss * 2;
-
             // If _rcvBufSize is too large (for whatever reason) we advertise 0 window.
-            // We also can't go beyond 0xFFFF.
+            return ( _rcvBufSize < _maxRcvBufSize ) ? ( _maxRcvBufSize - _rcvBufSize ) : 0;
+        }
 
-            return min<uint32_t> ( 0xFFFF, ( _rcvBufSize < doubleMss ) ? ( doubleMss - _rcvBufSize ) : 0 );
+        /// @brief Calculates the size of the receive windows to advertise.
+        /// It is the receive window, scaled using our window-scale value.
+        /// @return The size of the receive window to advertise (the value to put in the TCP header).
+        inline uint16_t getWinSizeToAdvertise() const
+        {
+            return min<uint32_t> ( 0xFFFF, getRcvWindow() >> _rcvWScale );
         }
 
+        /// @brief Returns the current retransmission timeout.
+        /// It is based on the RTT measurements, and doubled for each timeout in a row.
+        /// @return The current retransmission timeout (in milliseconds).
+        uint32_t getRto() const;
+
+        /// @brief Calculates the number of bytes that are still in the network ("pipe", RFC 6675).
+        /// It excludes the bytes that were acknowledged selectively (or estimated to have left the network
+        /// based on duplicate ACKs), and the bytes that are considered lost and were not retransmitted yet.
+        /// @return The number of bytes that are still in the network.
+        uint32_t getPipe() const;
+
         /// @brief Appends data to be sent by the TCP terminator over the TCP connection.
         /// @param [in,out] data The data to be sent. It is consumed to reflect the data accepted.
         void appendData ( MemHandle & data );
@@ -299,6 +386,14 @@ class TcpTerminator: protected IpFlow, protected Timer::Receiver, protected Even
         /// @return The MSS to use.
         virtual uint16_t adjustMss ( uint16_t mss ) const;
 
+        /// @brief Creates the congestion controller.
+        /// It is called once the MSS is known (when the SYN packet is received).
+        /// The default implementation creates the controller configured using optCongestionControl
+        /// (or NewReno, if that option is invalid).
+        /// @return A new congestion controller, that will be deallocated by the terminator;
+        ///         0 to disable congestion control (which is not recommended).
+        virtual TcpCongestionControl * createCongestionControl();
+
         /// @brief Receives (and consumes) data received over the TCP connection.
         /// @param [in,out] data The data to receive.
         ///                      It should be consumed to reflect the amount of data consumed.
@@ -358,11 +453,63 @@ class TcpTerminator: protected IpFlow, protected Timer::Receiver, protected Even
         void sendResetResponse ( const IpPacket & toPacket );
 
         /// @brief Re-transmits a single packet from the beginning of 'sent' buffer.
-        /// It also restarts the timer.
+        /// It also updates the point up to which the data has been re-transmitted during current recovery.
         void resendFirst();
 
-        /// @brief Sends all data in _unsentBuffer.
-        /// It also moves the data to _sentBuffer and restarts the timer.
+        /// @brief Re-transmits a single packet using the data from 'sent' buffer.
+        /// @param [in] seq The sequence number of the first byte to re-transmit.
+        ///                 It must be within the 'sent' buffer.
+        /// @param [in] maxSize The max number of bytes to re-transmit. At most MSS bytes are sent.
+        /// @return The number of bytes re-transmitted; 0 if the packet could not be sent.
+        size_t resendData ( uint32_t seq, size_t maxSize );
+
+        /// @brief Re-transmits the data considered lost during loss recovery.
+        /// It sends as much as the congestion window allows, and only re-transmits each segment once
+        /// (during a single recovery).
+        void sendRetransmissions();
+
+        /// @brief Sends data from _unsentBuffer.
+        /// It sends as much data as the congestion window allows, and moves it to _sentBuffer.
+        /// It also starts the timer (if it's not running already).
         void sendUnsent();
+
+        /// @brief Starts fast recovery.
+        /// It informs the congestion controller and re-transmits the data considered lost.
+        void startFastRecovery();
+
+        /// @brief Handles the retransmission timeout.
+        /// It informs the congestion controller, starts the recovery and re-transmits the first segment.
+        void handleRetransmitTimeout();
+
+        /// @brief Updates the SACK scoreboard using SACK option in the packet.
+        /// @param [in] packet The packet received.
+        /// @return True if any new data was selectively acknowledged; False otherwise.
+        bool updateSAckBlocks ( const IpPacket & packet );
+
+        /// @brief Adds a block of data to the SACK scoreboard, merging it with existing blocks.
+        /// @param [in] start The sequence number of the first byte in the block.
+        /// @param [in] end The sequence number right after the last byte in the block.
+        /// @return True if any new data was selectively acknowledged; False otherwise.
+        bool addSAckBlock ( uint32_t start, uint32_t end );
+
+        /// @brief Removes (or trims) the blocks in the SACK scoreboard that are no longer past _sendDataSeq.
+        void pruneSAckBlocks();
+
+        /// @brief Removes all the blocks from the SACK scoreboard.
+        inline void clearSAckBlocks()
+        {
+            _sackBlocks.clear();
+            _sackedBytes = 0;
+        }
+
+        /// @brief Calculates the number of bytes in a range that were selectively acknowledged.
+        /// @param [in] start The sequence number of the first byte in the range.
+        /// @param [in] end The sequence number right after the last byte in the range.
+        /// @return The number of bytes in the range that were selectively acknowledged.
+        uint32_t getSAckedBytes ( uint32_t start, uint32_t end ) const;
+
+        /// @brief Returns the sequence number right after the data that is considered lost during recovery.
+        /// @return The sequence number right after the data that is considered lost during recovery.
+        uint32_t getLostEndSeq() const;
 };
 }
@@ -69,6 +69,18 @@ void TunIface::packetReceived ( MemHandle & mh, const TunIpPacketData & tunData
 {
     TunIpPacket ipPacket ( mh, tunData );
 
+    // We clear the original buffer.
+    // The IP packet should have its own reference. If the owner wants to modify the IP packet inside
+    // the callback, it would result in copying all the data. Since we don't care about
+    // our own reference to that memory (stored in mh), we clear() it. This way the IP packet
+    // contains the only reference to that data and can be modified without copying the data!
+    mh.clear();
+
+    packetReceived ( ipPacket );
+}
+
+void TunIface::packetReceived ( TunIpPacket & ipPacket )
+{
     if ( !ipPacket.isValid() )
     {
         LOG_LIM ( L_ERROR, "The IP packet read from the tunnel interface is invalid. Dropping" );
@@ -88,16 +100,9 @@ void TunIface::packetReceived ( MemHandle & mh, const TunIpPacketData & tunData
         if ( EventManager::getCurrentTime().isGreaterEqualThan ( _lastRateUpdate, _rateMonitoringInterval ) )
             doRateUpdate();
 
-        _rcvDataCount += mh.size();
+        _rcvDataCount += ipPacket.getPacketSize();
     }
 
-    // We clear the original buffer.
-    // The IP packet should have its own reference. If the owner wants to modify the IP packet inside
-    // the callback, it would result in copying all the data. Since we don't care about
-    // our own reference to that memory (stored in mh), we clear() it. This way the IP packet
-    // contains the only reference to that data and can be modified without copying the data!
-    mh.clear();
-
     TunIfaceOwner * const owner = getOwner();
 
     if ( owner != 0 )
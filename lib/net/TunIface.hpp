@@ -172,6 +172,11 @@ class TunIface: public OwnedObject<TunIfaceOwner>
         /// @param [in] tunData TunIface-specific data to set on the generated TunIpPacket.
         void packetReceived ( MemHandle & mh, const TunIpPacketData & tunData = _emptyTunData );
 
+        /// @brief Called when a packet is received by the tunnel.
+        /// @note Our owner may have deferenced us after this function has been called!
+        /// @param [in] ipPacket The IP packet that was received. If it is invalid, it will be dropped.
+        void packetReceived ( TunIpPacket & ipPacket );
+
         /// @brief Notify our owner that the tunnel interface has been closed.
         /// @note Our owner may have deferenced us after this function has been called!
         void notifyTunIfaceClosed();
@@ -20,17 +20,20 @@
 using namespace Pravala;
 
 BasicPrometheusCounter::BasicPrometheusCounter (
-        PrometheusMetric::TimeMode timestampType, const String & name, const String & help ):
+        PrometheusMetric::TimeMode timestampType, const String & name, const String & help, bool sharded ):
     PrometheusCounter ( timestampType, name, help ),
-    _value ( 0 ),
-    _timestamp ( 0 )
+    _value ( 1, sharded ),
+    _timestamp ( 0 ),
+    _needsTimestamp ( needsTimestamps() )
 {
 }
 
-BasicPrometheusCounter::BasicPrometheusCounter ( PrometheusCounterMetric & parent, const String & labelValues ):
+BasicPrometheusCounter::BasicPrometheusCounter (
+        PrometheusCounterMetric & parent, const String & labelValues, bool sharded ):
     PrometheusCounter ( parent, labelValues ),
-    _value ( 0 ),
-    _timestamp ( 0 )
+    _value ( 1, sharded ),
+    _timestamp ( 0 ),
+    _needsTimestamp ( needsTimestamps() )
 {
 }
 
@@ -40,21 +43,36 @@ BasicPrometheusCounter::~BasicPrometheusCounter()
 
 void BasicPrometheusCounter::increment ( uint64_t value )
 {
-    _value += value;
+    _value.add ( 0, value );
     updateTimestamp();
 }
 
 uint64_t BasicPrometheusCounter::getValue()
 {
-    return _value;
+    return _value.get ( 0 );
 }
 
 uint64_t BasicPrometheusCounter::getTimestamp()
 {
-    return _timestamp;
+    // Atomic read (which also works on 32 bit platforms).
+    return __sync_add_and_fetch ( &_timestamp, 0 );
 }
 
-void BasicPrometheusCounter::updateTimestamp()
+void BasicPrometheusCounter::setTimestamp()
 {
-    _timestamp = CalendarTime::getUTCEpochTimeMs();
+    const uint64_t now = CalendarTime::getUTCEpochTimeMs();
+    uint64_t prev = _timestamp;
+
+    // The initial read may be torn (on 32 bit platforms), but then the swap fails and we get the real value.
+    while ( prev < now )
+    {
+        const uint64_t cur = __sync_val_compare_and_swap ( &_timestamp, prev, now );
+
+        if ( cur == prev )
+        {
+            break;
+        }
+
+        prev = cur;
+    }
 }
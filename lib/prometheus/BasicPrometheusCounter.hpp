@@ -16,12 +16,16 @@
 
 #pragma once
 
+#include "internal/PrometheusShardedValues.hpp"
 #include "PrometheusCounter.hpp"
 
 namespace Pravala
 {
 /// @brief A basic Prometheus counter.
 /// A counter has a monotonically increasing value.
+/// It can be incremented from any thread (see PrometheusShardedValues). Its value can optionally be sharded
+/// to avoid contention between threads. The timestamp is only updated if the metric uses
+/// PrometheusMetric::TimeSet mode.
 class BasicPrometheusCounter: public PrometheusCounter
 {
     public:
@@ -30,13 +34,18 @@ class BasicPrometheusCounter: public PrometheusCounter
         /// @param [in] timestampMode The timestamp mode the internal metric should use.
         /// @param [in] name The name of the metric.
         /// @param [in] help A description of the metric.
+        /// @param [in] sharded Whether the value should be sharded (see PrometheusShardedValues).
+        ///                     It should only be used for counters updated very often by multiple threads.
         BasicPrometheusCounter (
-            PrometheusMetric::TimeMode timestampMode, const String & name, const String & help = String::EmptyString );
+            PrometheusMetric::TimeMode timestampMode, const String & name,
+            const String & help = String::EmptyString, bool sharded = false );
 
         /// @brief A constructor for a counter with labels
         /// @param [in] parent The parent counter metric to which to add this counter
         /// @param [in] labelValues A comma separated list of label values
-        BasicPrometheusCounter ( PrometheusCounterMetric & parent, const String & labelValues );
+        /// @param [in] sharded Whether the value should be sharded (see PrometheusShardedValues).
+        ///                     It should only be used for counters updated very often by multiple threads.
+        BasicPrometheusCounter ( PrometheusCounterMetric & parent, const String & labelValues, bool sharded = false );
 
         /// @brief Destructor
         ~BasicPrometheusCounter();
@@ -46,9 +55,10 @@ class BasicPrometheusCounter: public PrometheusCounter
         void increment ( uint64_t value = 1 );
 
         /// @brief Resets the counter to zero and updates the timestamp.
+        /// Increments performed by other threads at the same time may or may not be lost.
         inline void reset()
         {
-            _value = 0;
+            _value.reset();
             updateTimestamp();
         }
 
@@ -61,11 +71,25 @@ class BasicPrometheusCounter: public PrometheusCounter
         /// @note The Prometheus specifications use non-integral (double) values which is a bit weird for a counter.
         /// As we don't (currently) have floating-point use-cases, we are using integral counters to improve
         /// performance
-        uint64_t _value;
+        PrometheusShardedValues _value;
 
-        uint64_t _timestamp; ///< The timestamp in milliseconds from the UTC epoch
+        /// @brief The timestamp in milliseconds from the UTC epoch.
+        /// It is accessed atomically, since the counter can be updated by multiple threads.
+        volatile uint64_t _timestamp;
 
-        /// @brief Updates the timestamp
-        void updateTimestamp();
+        const bool _needsTimestamp; ///< Whether the timestamp should be updated (see needsTimestamps()).
+
+        /// @brief Updates the timestamp (if it is needed)
+        inline void updateTimestamp()
+        {
+            if ( _needsTimestamp )
+            {
+                setTimestamp();
+            }
+        }
+
+        /// @brief Sets the timestamp to the current time
+        /// It never moves the timestamp back (if another thread set it to a later time).
+        void setTimestamp();
 };
 }
@@ -20,17 +20,21 @@
 using namespace Pravala;
 
 BasicPrometheusGauge::BasicPrometheusGauge (
-        PrometheusMetric::TimeMode timestampMode, const String & name, const String & help ):
+        PrometheusMetric::TimeMode timestampMode, const String & name, const String & help, bool sharded ):
     PrometheusGauge ( timestampMode, name, help ),
-    _value ( 0 ),
-    _timestamp ( 0 )
+    _value ( 1, sharded ),
+    _timestamp ( 0 ),
+    _needsTimestamp ( needsTimestamps() ),
+    _numSetters ( 0 )
 {
 }
 
-BasicPrometheusGauge::BasicPrometheusGauge ( PrometheusGaugeMetric & parent, const String & labelValues ):
+BasicPrometheusGauge::BasicPrometheusGauge ( PrometheusGaugeMetric & parent, const String & labelValues, bool sharded ):
     PrometheusGauge ( parent, labelValues ),
-    _value ( 0 ),
-    _timestamp ( 0 )
+    _value ( 1, sharded ),
+    _timestamp ( 0 ),
+    _needsTimestamp ( needsTimestamps() ),
+    _numSetters ( 0 )
 {
 }
 
@@ -50,21 +54,59 @@ void BasicPrometheusGauge::decrement ( uint64_t value )
 
 void BasicPrometheusGauge::adjust ( int64_t value )
 {
-    _value += value;
+    _value.add ( 0, ( uint64_t ) value );
     updateTimestamp();
 }
 
+void BasicPrometheusGauge::set ( int64_t value )
+{
+    if ( _value.getNumShards() < 2 )
+    {
+        _value.set ( 0, ( uint64_t ) value );
+        updateTimestamp();
+        return;
+    }
+
+#ifndef NDEBUG
+    const uint32_t numSetters = __sync_add_and_fetch ( &_numSetters, 1 );
+
+    // Two threads setting a sharded gauge at the same time could leave it with neither of their values.
+    assert ( numSetters == 1 );
+#endif
+
+    adjust ( value - getValue() );
+
+#ifndef NDEBUG
+    __sync_sub_and_fetch ( &_numSetters, 1 );
+#endif
+}
+
 int64_t BasicPrometheusGauge::getValue()
 {
-    return _value;
+    return ( int64_t ) _value.get ( 0 );
 }
 
 uint64_t BasicPrometheusGauge::getTimestamp()
 {
-    return _timestamp;
+    // Atomic read (which also works on 32 bit platforms).
+    return __sync_add_and_fetch ( &_timestamp, 0 );
 }
 
-void BasicPrometheusGauge::updateTimestamp()
+void BasicPrometheusGauge::setTimestamp()
 {
-    _timestamp = CalendarTime::getUTCEpochTimeMs();
+    const uint64_t now = CalendarTime::getUTCEpochTimeMs();
+    uint64_t prev = _timestamp;
+
+    // The initial read may be torn (on 32 bit platforms), but then the swap fails and we get the real value.
+    while ( prev < now )
+    {
+        const uint64_t cur = __sync_val_compare_and_swap ( &_timestamp, prev, now );
+
+        if ( cur == prev )
+        {
+            break;
+        }
+
+        prev = cur;
+    }
 }
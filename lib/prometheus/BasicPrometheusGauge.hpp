@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include "internal/PrometheusShardedValues.hpp"
 #include "PrometheusGauge.hpp"
 
 namespace Pravala
@@ -24,6 +25,9 @@ class PrometheusGaugeMetric;
 
 /// @brief A basic Prometheus gauge.
 /// A gauge is a counter that can go up and down.
+/// It can be modified from any thread (see PrometheusShardedValues). Its value can optionally be sharded
+/// to avoid contention between threads, in which case only one thread at a time may set() (or reset()) it.
+/// The timestamp is only updated if the metric uses PrometheusMetric::TimeSet mode.
 class BasicPrometheusGauge: public PrometheusGauge
 {
     public:
@@ -32,13 +36,18 @@ class BasicPrometheusGauge: public PrometheusGauge
         /// @param [in] timestampMode The timestamp mode the internal metric should use.
         /// @param [in] name The name of the metric.
         /// @param [in] help A description of the metric.
+        /// @param [in] sharded Whether the value should be sharded (see PrometheusShardedValues).
+        ///                     It should only be used for gauges updated very often by multiple threads.
         BasicPrometheusGauge (
-            PrometheusMetric::TimeMode timestampMode, const String & name, const String & help = String::EmptyString );
+            PrometheusMetric::TimeMode timestampMode, const String & name,
+            const String & help = String::EmptyString, bool sharded = false );
 
         /// @brief A constructor for a gauge with labels
         /// @param [in] parent The parent gauge metric to which to add this gauge
         /// @param [in] labelValues A comma separated list of label values
-        BasicPrometheusGauge ( PrometheusGaugeMetric & parent, const String & labelValues );
+        /// @param [in] sharded Whether the value should be sharded (see PrometheusShardedValues).
+        ///                     It should only be used for gauges updated very often by multiple threads.
+        BasicPrometheusGauge ( PrometheusGaugeMetric & parent, const String & labelValues, bool sharded = false );
 
         /// @brief Destructor
         virtual ~BasicPrometheusGauge();
@@ -56,18 +65,20 @@ class BasicPrometheusGauge: public PrometheusGauge
         void adjust ( int64_t value );
 
         /// @brief Resets the gauge to zero and updates the timestamp.
+        /// @note The same rules as for set() apply.
         inline void reset()
         {
             set ( 0 );
         }
 
-        /// @brief Sets the gauge to the specified value
+        /// @brief Sets the gauge to the specified value and updates the timestamp.
+        /// If the gauge is not sharded, the value is replaced atomically, so it can be called by any thread.
+        /// @warning Sharded gauges cannot be replaced atomically. Instead, they are adjusted by the difference
+        ///          between the new and the current value. Modifications made by other threads at the same time
+        ///          are preserved (on top of the value set), but only one thread at a time may call this function
+        ///          (which is asserted in debug builds).
         /// @param [in] value The value to set the gauge to
-        inline void set ( int64_t value )
-        {
-            _value = value;
-            updateTimestamp();
-        }
+        void set ( int64_t value );
 
     protected:
         virtual int64_t getValue();
@@ -78,11 +89,30 @@ class BasicPrometheusGauge: public PrometheusGauge
         /// @note The Prometheus specifications use non-integral (double) values which is a bit weird for a counter.
         /// As we don't (currently) have floating-point use-cases, we are using integral counters to improve
         /// performance
-        int64_t _value;
+        /// The value is stored as unsigned, but it uses two's complement arithmetic.
+        PrometheusShardedValues _value;
+
+        /// @brief The timestamp in milliseconds from the UTC epoch.
+        /// It is accessed atomically, since the gauge can be updated by multiple threads.
+        volatile uint64_t _timestamp;
+
+        const bool _needsTimestamp; ///< Whether the timestamp should be updated (see needsTimestamps()).
 
-        uint64_t _timestamp; ///< The timestamp in milliseconds from the UTC epoch
+        /// @brief The number of threads setting the value of a sharded gauge right now.
+        /// It is only used in debug builds, to detect concurrent set() calls. Modified atomically.
+        volatile uint32_t _numSetters;
+
+        /// @brief Updates the timestamp (if it is needed)
+        inline void updateTimestamp()
+        {
+            if ( _needsTimestamp )
+            {
+                setTimestamp();
+            }
+        }
 
-        /// @brief Updates the timestamp
-        void updateTimestamp();
+        /// @brief Sets the timestamp to the current time
+        /// It never moves the timestamp back (if another thread set it to a later time).
+        void setTimestamp();
 };
 }
@@ -31,22 +31,13 @@ PrometheusCounter::PrometheusCounter ( PrometheusCounterMetric & parent, const S
 
 void PrometheusCounter::appendData ( Buffer & buf, const String & name, uint64_t timestamp )
 {
-    buf.append ( name );
-
-    if ( !LabelStr.isEmpty() )
-    {
-        buf.append ( "{" );
-        buf.append ( LabelStr );
-        buf.append ( "}" );
-    }
-
-    buf.append ( " " );
-    buf.append ( String::number ( getValue() ) );
+    buf.append ( getSamplePrefix ( name ) );
+    buf.appendNumber ( getValue() );
 
     if ( timestamp > 0 )
     {
         buf.append ( " " );
-        buf.append ( String::number ( timestamp ) );
+        buf.appendNumber ( timestamp );
     }
 
     buf.append ( "\n" );
@@ -19,82 +19,133 @@
 using namespace Pravala;
 
 PrometheusHistogram::PrometheusHistogram (
-        const String & name, size_t numBuckets, const int64_t bucketUpperBounds[], const String & help ):
+        const String & name, size_t numBuckets, const int64_t bucketUpperBounds[], const String & help,
+        bool sharded ):
     PrometheusChild ( new PrometheusHistogramMetric ( name, "", numBuckets, bucketUpperBounds, help ), "" ),
     _numBuckets ( numBuckets ),
-    _buckets ( new Bucket[ numBuckets ] ),
-    _totalCount ( 0 ),
-    _sum ( 0 )
+    _upperBounds ( new int64_t[ numBuckets ] ),
+    _values ( numBuckets + 2, sharded )
 {
-    for ( size_t i = 0; i < _numBuckets; ++i )
-    {
-        _buckets[ i ].upperBound = bucketUpperBounds[ i ];
-        _buckets[ i ].count = 0;
-    }
+    initBuckets ( bucketUpperBounds );
 }
 
-PrometheusHistogram::PrometheusHistogram ( PrometheusHistogramMetric & parent, const String & labelValues ):
+PrometheusHistogram::PrometheusHistogram (
+        PrometheusHistogramMetric & parent, const String & labelValues, bool sharded ):
     PrometheusChild ( parent, labelValues ),
     _numBuckets ( parent.getNumBuckets() ),
-    _buckets ( new Bucket[ _numBuckets ] ),
-    _totalCount ( 0 ),
-    _sum ( 0 )
+    _upperBounds ( new int64_t[ _numBuckets ] ),
+    _values ( _numBuckets + 2, sharded )
 {
     assert ( parent.getBucketUpperBoundsArray() != 0 );
-    assert ( _numBuckets > 0 );
 
-    const int64_t * bucketArray = parent.getBucketUpperBoundsArray();
-
-    for ( size_t i = 0; i < _numBuckets; ++i )
-    {
-        _buckets[ i ].upperBound = bucketArray[ i ];
-        _buckets[ i ].count = 0;
-    }
+    initBuckets ( parent.getBucketUpperBoundsArray() );
 }
 
 PrometheusHistogram::~PrometheusHistogram()
 {
-    delete[] _buckets;
+    delete[] _upperBounds;
 }
 
-void PrometheusHistogram::observe ( int64_t value )
+void PrometheusHistogram::initBuckets ( const int64_t bucketUpperBounds[] )
 {
+    assert ( _numBuckets > 0 );
+
     for ( size_t i = 0; i < _numBuckets; ++i )
     {
-        if ( value <= _buckets[ i ].upperBound )
+        _upperBounds[ i ] = bucketUpperBounds[ i ];
+
+        // Binary search needs them to be sorted:
+        assert ( i < 1 || _upperBounds[ i - 1 ] < _upperBounds[ i ] );
+    }
+}
+
+void PrometheusHistogram::observe ( int64_t value )
+{
+    // We are looking for the first bucket with upper bound >= value.
+    // If there is no such bucket, we will use the extra one (at _numBuckets).
+
+    size_t low = 0;
+    size_t high = _numBuckets;
+
+    while ( low < high )
+    {
+        const size_t mid = low + ( high - low ) / 2;
+
+        if ( value <= _upperBounds[ mid ] )
         {
-            _buckets[ i ].count++;
+            high = mid;
+        }
+        else
+        {
+            low = mid + 1;
         }
     }
 
-    ++_totalCount;
+    _values.add ( low, 1 );
+    _values.add ( _numBuckets + 1, ( uint64_t ) value );
+}
+
+uint64_t PrometheusHistogram::getTotalCount() const
+{
+    uint64_t count = 0;
+
+    for ( size_t i = 0; i <= _numBuckets; ++i )
+    {
+        count += _values.get ( i );
+    }
 
-    _sum += value;
+    return count;
 }
 
 void PrometheusHistogram::appendData ( Buffer & buf, const String & name, uint64_t )
 {
     // Histograms always skip the timestamp.
 
-    const String labelStr = LabelStr.isEmpty() ? "" : String ( "{%1}" ).arg ( LabelStr );
-    const String labelsBucketPrefix = LabelStr.isEmpty() ? "" : String ( "%1," ).arg ( LabelStr );
+    if ( _linePrefixes.isEmpty() )
+    {
+        const String labelStr = LabelStr.isEmpty() ? "" : String ( "{%1}" ).arg ( LabelStr );
+        const String labelsBucketPrefix = LabelStr.isEmpty() ? "" : String ( "%1," ).arg ( LabelStr );
+
+        for ( size_t i = 0; i < _numBuckets; ++i )
+        {
+            _linePrefixes.append ( String ( "%1_bucket{%2le=\"%3\"} " )
+                                   .arg ( name, labelsBucketPrefix )
+                                   .arg ( _upperBounds[ i ] ) );
+        }
+
+        _linePrefixes.append ( String ( "%1_bucket{%2le=\"+Inf\"} " ).arg ( name, labelsBucketPrefix ) );
+        _linePrefixes.append ( String ( "%1_sum%2 " ).arg ( name, labelStr ) );
+        _linePrefixes.append ( String ( "%1_count%2 " ).arg ( name, labelStr ) );
+    }
+
+    assert ( _linePrefixes.size() == _numBuckets + 3 );
+
+    // Buckets store non-cumulative counts, Prometheus wants cumulative ones:
+    uint64_t count = 0;
 
     for ( size_t i = 0; i < _numBuckets; ++i )
     {
-        buf.append ( String ( "%1_bucket{%2le=\"%3\"} %4\n" )
-                     .arg ( name, labelsBucketPrefix )
-                     .arg ( _buckets[ i ].upperBound )
-                     .arg ( _buckets[ i ].count ) );
+        count += _values.get ( i );
+
+        buf.append ( _linePrefixes[ i ] );
+        buf.appendNumber ( count );
+        buf.append ( "\n" );
     }
 
-    // +Inf bucket
-    buf.append ( String ( "%1_bucket{%2le=\"+Inf\"} %3\n" )
-                 .arg ( name, labelsBucketPrefix )
-                 .arg ( _totalCount ) );
+    // +Inf bucket (the total count). We don't use getTotalCount(), so that all the counts are consistent.
+    count += _values.get ( _numBuckets );
+
+    buf.append ( _linePrefixes[ _numBuckets ] );
+    buf.appendNumber ( count );
+    buf.append ( "\n" );
 
     // sum
-    buf.append ( String ( "%1_sum%2 %3\n" ).arg ( name, labelStr ).arg ( _sum ) );
+    buf.append ( _linePrefixes[ _numBuckets + 1 ] );
+    buf.appendNumber ( getSum() );
+    buf.append ( "\n" );
 
     // totalCount
-    buf.append ( String ( "%1_count%2 %3\n" ).arg ( name, labelStr ).arg ( _totalCount ) );
+    buf.append ( _linePrefixes[ _numBuckets + 2 ] );
+    buf.appendNumber ( count );
+    buf.append ( "\n" );
 }
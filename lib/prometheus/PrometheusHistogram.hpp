@@ -17,6 +17,7 @@
 #pragma once
 
 #include "internal/PrometheusChild.hpp"
+#include "internal/PrometheusShardedValues.hpp"
 #include "PrometheusHistogramMetric.hpp"
 
 namespace Pravala
@@ -25,6 +26,10 @@ namespace Pravala
 /// The histogram is cumulative. A histogram has a distribution of values across specified buckets where each bucket
 /// is a counter. The total sum and total count of observances are also recorded. The number of buckets and their upper
 /// bounds have the same configuration as the parent histogram metric.
+/// Internally, each bucket only counts the observances that fall into it (and not into any of the lower buckets),
+/// so each observation only updates a single bucket (found using binary search), and the cumulative counts
+/// are calculated when the data is exported. Observations can be made from any thread
+/// (see PrometheusShardedValues), and the values can optionally be sharded to avoid contention between threads.
 class PrometheusHistogram: public PrometheusChild
 {
     public:
@@ -34,22 +39,28 @@ class PrometheusHistogram: public PrometheusChild
         /// @param [in] bucketUpperBounds An array of upper bounds of the buckets of length numBuckets
         ///             The bucket upper bounds must be listed in increasing order.
         /// @param [in] help A description of the metric
+        /// @param [in] sharded Whether the values should be sharded (see PrometheusShardedValues).
+        ///                     It should only be used for histograms updated very often by multiple threads.
         PrometheusHistogram (
             const String & name,
             size_t numBuckets,
             const int64_t bucketUpperBounds[],
-            const String & help = String::EmptyString );
+            const String & help = String::EmptyString,
+            bool sharded = false );
 
         /// @brief A constructor for a histogram with labels
         /// @param [in] parent The parent histogram metric to which to add this histogram
         /// @param [in] labelValues A comma separated list of label values
-        PrometheusHistogram ( PrometheusHistogramMetric & parent, const String & labelValues );
+        /// @param [in] sharded Whether the values should be sharded (see PrometheusShardedValues).
+        ///                     It should only be used for histograms updated very often by multiple threads.
+        PrometheusHistogram ( PrometheusHistogramMetric & parent, const String & labelValues, bool sharded = false );
 
         /// @brief Destructor
         virtual ~PrometheusHistogram();
 
         /// @brief Observes a value for the histogram
-        /// Each bucket count where v is <= the bucket upper bound will be incremented.
+        /// The count of the lowest bucket whose upper bound is >= v will be incremented
+        /// (which makes all cumulative counts of buckets with upper bound >= v to go up).
         /// The total count will be incremented, along with the sum of the observances.
         /// @param [in] v The value to observe
         void observe ( int64_t v );
@@ -58,15 +69,12 @@ class PrometheusHistogram: public PrometheusChild
         /// @return The sum of all the observances
         inline int64_t getSum() const
         {
-            return _sum;
+            return ( int64_t ) _values.get ( _numBuckets + 1 );
         }
 
         /// @brief Gets the total count of the observances
         /// @return The count of all the observances
-        inline uint64_t getTotalCount() const
-        {
-            return _totalCount;
-        }
+        uint64_t getTotalCount() const;
 
     protected:
         /// @brief Appends the Prometheus text exposition of the histogram to a buffer
@@ -83,19 +91,24 @@ class PrometheusHistogram: public PrometheusChild
         virtual void appendData ( Buffer & buf, const String & name, uint64_t timestamp );
 
     private:
-        /// @brief Struct to define each bucket of the histogram
-        struct Bucket
-        {
-            int64_t upperBound;     ///< The upper bound of the bucket
-            uint64_t count;         ///< The total number of observances for this bucket
-        };
-
         const size_t _numBuckets;   ///< The number of buckets in the histogram
 
-        Bucket * _buckets;          ///< The array of buckets
+        int64_t * _upperBounds;     ///< The array of upper bounds of the buckets
+
+        /// @brief The (non-cumulative) counts of observances in each bucket, and their sum.
+        /// The first _numBuckets values are the counts of the regular buckets, then there is the count
+        /// of observances greater than all the upper bounds, followed by the sum of all observances
+        /// (which is signed, but uses two's complement arithmetic).
+        PrometheusShardedValues _values;
 
-        uint64_t _totalCount;       ///< The total number of observances for all buckets
+        /// @brief The cached prefixes of all the lines of the exposition of this histogram.
+        /// The first _numBuckets entries are prefixes of regular bucket lines (name_bucket{labels,le="bound"} ),
+        /// followed by the prefix of the +Inf bucket line, the _sum line and the _count line.
+        /// They are generated the first time they are needed, and then reused.
+        StringList _linePrefixes;
 
-        int64_t _sum;               ///< The total sum of all the observances
+        /// @brief Initializes the array of bucket upper bounds.
+        /// @param [in] bucketUpperBounds The array of upper bounds to copy (of length _numBuckets).
+        void initBuckets ( const int64_t bucketUpperBounds[] );
 };
 }
@@ -14,6 +14,7 @@
  *  limitations under the License.
  */
 
+#include "sys/CalendarTime.hpp"
 #include "internal/PrometheusManager.hpp"
 #include "PrometheusServer.hpp"
 
@@ -21,8 +22,19 @@ using namespace Pravala;
 
 TextLog PrometheusServer::_log ( "prometheus_server" );
 
+ConfigLimitedNumber<uint32_t> PrometheusServer::optRenderBatchSize (
+        0,
+        "prometheus.render_batch_size",
+        "The number of metrics to generate the exposition of in a single event loop iteration. "
+        "If 0, the entire exposition is generated when requested. Otherwise it is generated incrementally, "
+        "and requests are answered using the most recent complete exposition.",
+        0, 1000000, 0 );
+
 PrometheusServer::PrometheusServer():
-    _httpServer ( *this )
+    _httpServer ( *this ),
+    _renderIdx ( 0 ),
+    _renderTime ( 0 ),
+    _isRendering ( false )
 {
 }
 
@@ -61,7 +73,73 @@ int PrometheusServer::httpHandleGetRequest (
     }
 
     respContentType = "text/plain; version=0.0.4";
-    respPayload = PrometheusManager::get().getData();
+
+    if ( optRenderBatchSize.value() < 1 )
+    {
+        respPayload = PrometheusManager::get().getData();
+
+        return HttpServer::StatusOK;
+    }
+
+    if ( _lastData.isEmpty() )
+    {
+        // There is no complete exposition yet (this is the first request), we have to generate it now.
+        _lastData = PrometheusManager::get().getData();
+    }
+
+    respPayload = _lastData;
+
+    if ( !_isRendering )
+    {
+        startRendering();
+    }
 
     return HttpServer::StatusOK;
 }
+
+void PrometheusServer::startRendering()
+{
+    assert ( !_isRendering );
+
+    // The size of the last exposition should be a good estimate:
+    _renderBuf = Buffer ( _lastData.size() );
+    _renderMetrics = PrometheusManager::get().getMetricNames();
+    _renderIdx = 0;
+    _renderTime = CalendarTime::getUTCEpochTimeMs();
+    _isRendering = true;
+
+    LOG ( L_DEBUG3, "Starting incremental exposition of " << _renderMetrics.size() << " metric(s)" );
+
+    EventManager::loopEndSubscribe ( this );
+}
+
+void PrometheusServer::receiveLoopEndEvent()
+{
+    if ( !_isRendering )
+        return;
+
+    PrometheusManager & mgr = PrometheusManager::get();
+    const size_t batchEnd = _renderIdx + optRenderBatchSize.value();
+
+    for ( ; _renderIdx < _renderMetrics.size() && _renderIdx < batchEnd; ++_renderIdx )
+    {
+        // Metrics may have been unregistered in the meantime; We just skip those.
+        mgr.appendMetricData ( _renderMetrics.at ( _renderIdx ), _renderBuf, _renderTime );
+    }
+
+    if ( _renderIdx < _renderMetrics.size() )
+    {
+        // Continue in the next loop iteration.
+        EventManager::loopEndSubscribe ( this );
+        return;
+    }
+
+    LOG ( L_DEBUG3, "Incremental exposition completed; Size: " << _renderBuf.size() );
+
+    _lastData = _renderBuf.getHandle();
+
+    _renderBuf.clear();
+    _renderMetrics.clear();
+    _renderIdx = 0;
+    _isRendering = false;
+}
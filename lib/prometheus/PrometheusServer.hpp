@@ -17,6 +17,9 @@
 #pragma once
 
 #include "basic/HashMap.hpp"
+#include "basic/Buffer.hpp"
+#include "config/ConfigNumber.hpp"
+#include "event/EventManager.hpp"
 #include "log/TextLog.hpp"
 #include "http/HttpServer.hpp"
 
@@ -24,10 +27,18 @@ namespace Pravala
 {
 /// @brief The Prometheus server.
 /// Provides HTTP endpoint for remote Prometheus Server to connect to.
-/// Provides the Prometheus text exposition of the registered metrics to the remote Prometheus server
-class PrometheusServer: protected HttpServer::Owner
+/// Provides the Prometheus text exposition of the registered metrics to the remote Prometheus server.
+/// By default the exposition is generated when it is requested, all at once. With a large number of metrics
+/// this can block the event loop for a long time. If optRenderBatchSize is set, the exposition is instead generated
+/// incrementally, a few metrics in each event loop iteration. In that mode each request is answered using
+/// the most recently completed exposition, and a new one is started right after, to be used by the next request.
+class PrometheusServer: protected HttpServer::Owner, protected EventManager::LoopEndEventHandler
 {
     public:
+        /// @brief The number of metrics to generate the exposition of in a single event loop iteration.
+        /// If 0, the entire exposition is generated when it is requested.
+        static ConfigLimitedNumber<uint32_t> optRenderBatchSize;
+
         /// @brief Default constructor.
         PrometheusServer();
 
@@ -47,9 +58,22 @@ class PrometheusServer: protected HttpServer::Owner
             HttpServer * server, const SockAddr & remoteAddr, HttpParser & request,
             HashMap<String, String> & respHeaders, String & respContentType, MemHandle & respPayload );
 
+        virtual void receiveLoopEndEvent();
+
     private:
         static TextLog _log; ///< Log stream.
 
         HttpServer _httpServer; ///< HTTP server that we use to handle incoming requests.
+
+        MemHandle _lastData; ///< The most recently completed exposition (only used in incremental mode).
+
+        Buffer _renderBuf; ///< The exposition that is being generated incrementally.
+        StringList _renderMetrics; ///< The names of the metrics to include in the exposition being generated.
+        size_t _renderIdx; ///< The index (in _renderMetrics) of the next metric to generate the exposition of.
+        uint64_t _renderTime; ///< The "current" timestamp to use in the exposition being generated.
+        bool _isRendering; ///< Whether the exposition is being generated incrementally.
+
+        /// @brief Starts generating a new exposition incrementally.
+        void startRendering();
 };
 }
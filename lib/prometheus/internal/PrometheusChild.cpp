@@ -44,6 +44,23 @@ uint64_t PrometheusChild::getTimestamp()
     return 0;
 }
 
+bool PrometheusChild::needsTimestamps() const
+{
+    return ( _metric->TimestampMode == PrometheusMetric::TimeSet );
+}
+
+const String & PrometheusChild::getSamplePrefix ( const String & name )
+{
+    if ( _samplePrefix.isEmpty() )
+    {
+        _samplePrefix = LabelStr.isEmpty()
+                        ? String ( "%1 " ).arg ( name )
+                        : String ( "%1{%2} " ).arg ( name, LabelStr );
+    }
+
+    return _samplePrefix;
+}
+
 PrometheusChild::~PrometheusChild()
 {
     _metric->removeChild ( *this );
@@ -57,6 +57,12 @@ class PrometheusChild
         /// @return The timestamp in milliseconds from the UTC epoch.
         virtual uint64_t getTimestamp();
 
+        /// @brief Checks whether the metric this child belongs to uses timestamps provided by its children.
+        /// Children that don't provide their own getTimestamp() can ignore this.
+        /// @return True if the metric uses PrometheusMetric::TimeSet mode, and the timestamps need to be updated;
+        ///         False otherwise.
+        bool needsTimestamps() const;
+
         /// @brief Appends the Prometheus text exposition of the child to a buffer
         /// @note The child metric string should be terminated with a '\n'.
         ///       For more information, refer to:
@@ -66,10 +72,19 @@ class PrometheusChild
         /// @param [in] timestamp The timestamp to use. 0 if the timestamp should NOT be included.
         virtual void appendData ( Buffer & buf, const String & name, uint64_t timestamp ) = 0;
 
+        /// @brief Returns the prefix of the sample line of this child.
+        /// It contains the metric name, followed by the labels (if any) and a space: name{labels} .
+        /// It is generated the first time it is needed, and then reused.
+        /// @param [in] name The metric name to use.
+        /// @return The prefix of the sample line.
+        const String & getSamplePrefix ( const String & name );
+
         friend class PrometheusMetric;
 
     private:
         PrometheusMetric * const _metric; ///< Internal metric.
         const bool _autoDeleteMetric; ///< If true, the metric will be deleted when this object is destructed.
+
+        String _samplePrefix; ///< The cached prefix of the sample line (see getSamplePrefix()).
 };
 }
@@ -93,3 +93,28 @@ MemHandle PrometheusManager::getData()
 
     return buf.getHandle();
 }
+
+StringList PrometheusManager::getMetricNames() const
+{
+    StringList names;
+
+    for ( HashMap<String, PrometheusMetric *>::Iterator it ( _metrics ); it.isValid(); it.next() )
+    {
+        names.append ( it.key() );
+    }
+
+    return names;
+}
+
+bool PrometheusManager::appendMetricData ( const String & name, Buffer & buf, uint64_t currentTimestamp )
+{
+    PrometheusMetric * metric = 0;
+
+    if ( !_metrics.find ( name, metric ) || !metric )
+    {
+        return false;
+    }
+
+    metric->appendData ( buf, currentTimestamp );
+    return true;
+}
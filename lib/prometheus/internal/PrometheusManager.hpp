@@ -37,6 +37,18 @@ class PrometheusManager: public NoCopy
         /// @return The text exposition of all collected metrics as per the Prometheus text format
         MemHandle getData();
 
+        /// @brief Returns the names of all registered metrics.
+        /// @return The names of all registered metrics.
+        StringList getMetricNames() const;
+
+        /// @brief Appends the text exposition of a single metric to a buffer.
+        /// It allows the exposition to be generated incrementally, a few metrics at a time.
+        /// @param [in] name The name of the metric.
+        /// @param [out] buf The buffer to append the data to.
+        /// @param [in] currentTimestamp The value to be used as the "current" timestamp.
+        /// @return True if the metric was appended; False if it is (no longer) registered.
+        bool appendMetricData ( const String & name, Buffer & buf, uint64_t currentTimestamp );
+
     protected:
         /// @brief Registers the specified metric for data collection
         /// All registered metrics must have unique names. Metrics must not be registered with names that are
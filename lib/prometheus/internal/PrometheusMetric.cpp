@@ -163,15 +163,12 @@ void PrometheusMetric::appendData ( Buffer & buf, uint64_t timestamp )
     // Depending on TimestampMode we may use it, or use something else.
 
     // help and type headers
-    buf.append ( "# HELP " );
-    buf.append ( Name );
-    buf.append ( " " );
-    buf.append ( Help );
-    buf.append ( "\n# TYPE " );
-    buf.append ( Name );
-    buf.append ( " " );
-    buf.append ( getTypeStr() );
-    buf.append ( "\n" );
+    if ( _headerStr.isEmpty() )
+    {
+        _headerStr = String ( "# HELP %1 %2\n# TYPE %1 %3\n" ).arg ( Name, Help, getTypeStr() );
+    }
+
+    buf.append ( _headerStr );
 
     if ( TimestampMode != TimeCurrent )
     {
@@ -115,6 +115,10 @@ class PrometheusMetric
     private:
         List<PrometheusChild *> _children;  ///< List of child metrics
 
+        /// @brief The cached HELP and TYPE lines of the exposition of this metric.
+        /// They are generated the first time they are needed, and then reused.
+        String _headerStr;
+
         /// @brief Gets the string representation of the type of the metric
         /// @return The string with the Prometheus metric type
         const char * getTypeStr() const;
@@ -0,0 +1,81 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#include <cstring>
+
+#include "PrometheusShardedValues.hpp"
+
+/// @brief The size of the cache line that shards are aligned to.
+#define CACHE_LINE_SIZE    64
+
+using namespace Pravala;
+
+// MSVC doesn't like static const integrals defined in implementation files.
+// It doesn't follow C++ spec (9.4.2/4), but there is not much we can do about it...
+#ifndef _MSC_VER
+const size_t PrometheusShardedValues::MaxShards;
+#endif
+
+THREAD_LOCAL size_t PrometheusShardedValues::_threadShard ( 0 );
+size_t PrometheusShardedValues::_nextShard ( 0 );
+
+PrometheusShardedValues::PrometheusShardedValues ( size_t numValues, bool sharded ):
+    _numValues ( numValues ),
+    _numShards ( sharded ? MaxShards : 1 ),
+    _shardSize ( sharded
+                 ? ( ( ( numValues * sizeof ( uint64_t ) + CACHE_LINE_SIZE - 1 ) / CACHE_LINE_SIZE )
+                     * CACHE_LINE_SIZE / sizeof ( uint64_t ) )
+                 : numValues ),
+    _values ( new uint64_t[ _numShards * _shardSize ] )
+{
+    memset ( _values, 0, _numShards * _shardSize * sizeof ( uint64_t ) );
+}
+
+PrometheusShardedValues::~PrometheusShardedValues()
+{
+    delete[] _values;
+}
+
+uint64_t PrometheusShardedValues::get ( size_t index ) const
+{
+    assert ( index < _numValues );
+
+    uint64_t value = 0;
+
+    for ( size_t i = 0; i < _numShards; ++i )
+    {
+        // This is not a hot path, so we can afford atomic reads (which also work on 32 bit platforms).
+        value += __sync_add_and_fetch ( &_values[ i * _shardSize + index ], 0 );
+    }
+
+    return value;
+}
+
+void PrometheusShardedValues::reset()
+{
+    for ( size_t i = 0; i < _numShards * _shardSize; ++i )
+    {
+        __sync_fetch_and_and ( &_values[ i ], 0 );
+    }
+}
+
+size_t PrometheusShardedValues::assignShard()
+{
+    _threadShard = 1 + ( __sync_fetch_and_add ( &_nextShard, 1 ) % MaxShards );
+
+    return _threadShard;
+}
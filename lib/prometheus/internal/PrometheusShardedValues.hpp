@@ -0,0 +1,154 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+
+extern "C"
+{
+#include <stdint.h>
+}
+
+#include "basic/Thread.hpp"
+#include "basic/NoCopy.hpp"
+
+namespace Pravala
+{
+/// @brief A set of integer values that can be updated concurrently from multiple threads.
+/// All updates are atomic. By default all threads update the same copy of the values.
+/// Values that are updated very often by many threads can be split into several shards,
+/// each of which lives in different cache lines. Each thread then updates the shard assigned to it,
+/// so threads don't compete for the same cache lines, and the actual values are calculated
+/// (by summing all the shards) only when they are read. This uses MaxShards times more memory
+/// (at least a cache line per shard), so it should only be used for hot values.
+/// Values are unsigned, but signed values can be stored as well (using two's complement arithmetic).
+class PrometheusShardedValues: public NoCopy
+{
+    public:
+        /// @brief The max number of shards each value can be split into.
+        /// Threads are assigned shards in a round-robin fashion, so there is no contention
+        /// unless there are more updating threads than shards.
+        static const size_t MaxShards = 8;
+
+        /// @brief Constructor.
+        /// @param [in] numValues The number of values to store. All of them start as 0.
+        /// @param [in] sharded If set, values are split into MaxShards cache line separated shards.
+        ///                     Otherwise there is a single copy of the values (without any padding).
+        PrometheusShardedValues ( size_t numValues, bool sharded = false );
+
+        /// @brief Destructor.
+        ~PrometheusShardedValues();
+
+        /// @brief Returns the number of values stored.
+        /// @return The number of values stored.
+        inline size_t getNumValues() const
+        {
+            return _numValues;
+        }
+
+        /// @brief Returns the number of shards the values are split into.
+        /// @return The number of shards the values are split into (1 if they are not sharded).
+        inline size_t getNumShards() const
+        {
+            return _numShards;
+        }
+
+        /// @brief Adds to one of the values.
+        /// It is safe to call from any thread.
+        /// @param [in] index The index of the value to modify. Must be valid.
+        /// @param [in] value The value to add.
+        inline void add ( size_t index, uint64_t value )
+        {
+            assert ( index < _numValues );
+
+            __sync_add_and_fetch ( &_values[ getShardOffset() + index ], value );
+        }
+
+        /// @brief Sets one of the values.
+        /// It is safe to call from any thread, but only if the values are not sharded
+        /// (the shards of a value cannot be replaced atomically).
+        /// @param [in] index The index of the value to set. Must be valid.
+        /// @param [in] value The value to set.
+        inline void set ( size_t index, uint64_t value )
+        {
+            assert ( index < _numValues );
+            assert ( _numShards == 1 );
+
+            uint64_t prev = _values[ index ];
+
+            // The initial read may be torn (on 32 bit platforms), but then the swap fails and we get the real value.
+            while ( true )
+            {
+                const uint64_t cur = __sync_val_compare_and_swap ( &_values[ index ], prev, value );
+
+                if ( cur == prev )
+                {
+                    return;
+                }
+
+                prev = cur;
+            }
+        }
+
+        /// @brief Returns one of the values.
+        /// If the value is being updated by other threads at the same time,
+        /// the result may or may not include those updates.
+        /// @param [in] index The index of the value to read. Must be valid.
+        /// @return The sum of all shards of the value.
+        uint64_t get ( size_t index ) const;
+
+        /// @brief Sets all values to 0.
+        /// Updates performed by other threads at the same time may or may not be lost.
+        void reset();
+
+    private:
+        /// @brief The index of the shard used by the current thread, incremented by 1 (0 means it is not assigned).
+        static THREAD_LOCAL size_t _threadShard;
+
+        static size_t _nextShard; ///< The index of the next shard to be assigned to a thread.
+
+        const size_t _numValues; ///< The number of values stored.
+        const size_t _numShards; ///< The number of shards (1 or MaxShards).
+
+        /// @brief The number of uint64_t entries in each shard.
+        /// When sharded, it is the number of values rounded up to fill entire cache lines.
+        const size_t _shardSize;
+
+        /// @brief All the shards (_numShards * _shardSize entries).
+        uint64_t * const _values;
+
+        /// @brief Returns the offset (in _values) of the shard used by the current thread.
+        /// @return The offset of the shard to use.
+        inline size_t getShardOffset() const
+        {
+            if ( _numShards < 2 )
+            {
+                return 0;
+            }
+
+            const size_t shard = ( _threadShard > 0 ) ? _threadShard : assignShard();
+
+            return ( shard - 1 ) * _shardSize;
+        }
+
+        /// @brief Assigns a shard to the current thread.
+        /// @return The index of the shard assigned, incremented by 1.
+        static size_t assignShard();
+};
+}
@@ -0,0 +1,313 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#pragma once
+
+#include "basic/NoCopy.hpp"
+#include "basic/MemHandle.hpp"
+
+#include "ProtoError.hpp"
+#include "ExtProtoError.hpp"
+#include "Serializable.hpp"
+
+namespace Pravala
+{
+/// @brief Creates objects of the most specific message type that can be deserialized from the data.
+///
+/// Messages that inherit a base message register themselves (using Entry objects, generated by protoGen)
+/// in the registry of their base message type.
+/// To select the message type, the registry only decodes the fields of the base message that can be used
+/// by 'defines' (see isDefinableField() of the base message), skipping all the other fields.
+/// Then it deserializes the data once, as the most specific registered type whose 'defines' match
+/// (deeper in the inheritance tree first). Less specific types (and, eventually, the base message)
+/// are only tried if that fails.
+/// Once that object is deserialized, it can be passed around as the base message type,
+/// and deserializing it as the same (or less specific) type copies the object instead of parsing the data again.
+///
+/// @tparam B The type of the base message.
+template<typename B> class MessageTypeRegistry
+{
+    public:
+        /// @brief The type of the function that creates new message objects.
+        typedef B * (* CreateFunc)();
+
+        /// @brief The type of the function that checks whether the base message matches 'defines' of a message type.
+        typedef bool (* MatchFunc)( const B & baseMsg );
+
+        /// @brief A single registered message type.
+        /// They should be static objects; They add themselves to the registry when they are constructed.
+        class Entry: public NoCopy
+        {
+            public:
+                /// @brief Constructor.
+                /// @param [in] depth The depth of the message type in the inheritance tree (base message is at 0).
+                /// @param [in] createFunc The function that creates new objects of this message type.
+                /// @param [in] matchFunc The function that checks whether the base message matches the 'defines'
+                ///                       of this message type.
+                Entry ( uint16_t depth, CreateFunc createFunc, MatchFunc matchFunc );
+
+            private:
+                const CreateFunc _createFunc; ///< The function that creates new objects of this message type.
+                const MatchFunc _matchFunc; ///< The function that checks 'defines' of this message type.
+                const uint16_t _depth; ///< The depth of the message type in the inheritance tree.
+                Entry * _next; ///< The next entry in the registry.
+
+                friend class MessageTypeRegistry<B>;
+        };
+
+        /// @brief Creates a new object of the given message type.
+        /// @tparam T The type of the message to create.
+        /// @return A new object of the given message type.
+        template<typename T> static B * create()
+        {
+            return new T();
+        }
+
+        /// @brief Deserializes the data as the most specific registered message type, or as the base message.
+        ///
+        /// If none of the registered message types can be deserialized, the data is deserialized
+        /// into the base message object provided, so nothing is allocated.
+        ///
+        /// @param [in] buf The buffer to deserialize the data from.
+        /// @param [in] offset Offset in the buffer.
+        /// @param [in] dataSize The size of data (starting at given offset).
+        /// @param [out] baseMsg The base message object. It is only deserialized if none of the registered
+        ///                      message types can be deserialized; Otherwise it is not modified.
+        /// @param [out] specificMsg Set to a new object of the most specific registered message type
+        ///                          (that should be deleted by the caller), or to 0 if baseMsg has been used.
+        /// @param [out] extError Pointer to extended error code if it should be used (only modified on error).
+        /// @return The error code
+        static ProtoError deserialize (
+            const MemHandle & buf, size_t offset, size_t dataSize, B & baseMsg, B * & specificMsg,
+            ExtProtoError * extError = 0 );
+
+        /// @brief Deserializes the data as the most specific registered message type, or as the base message.
+        ///
+        /// It detects the length of the message by reading the 'length field' that should be included in the buffer.
+        /// If none of the registered message types can be deserialized, the data is deserialized
+        /// into the base message object provided, so nothing is allocated.
+        ///
+        /// @param [in] buf The buffer to deserialize the data from
+        /// @param [in,out] offset Offset in the buffer to start from.
+        ///                         It is modified (only if the message is deserialized properly).
+        /// @param [out] baseMsg The base message object. It is only deserialized if none of the registered
+        ///                      message types can be deserialized; Otherwise it is not modified.
+        /// @param [out] specificMsg Set to a new object of the most specific registered message type
+        ///                          (that should be deleted by the caller), or to 0 if baseMsg has been used.
+        /// @param [out] missingBytes If used, the number of missing bytes is placed there.
+        ///                            It is only set when 'Error::IncompleteData' is returned.
+        /// @param [out] extError Pointer to extended error code if it should be used (only modified on error).
+        /// @return The error code
+        static ProtoError deserializeWithLength (
+            const MemHandle & buf, size_t & offset, B & baseMsg, B * & specificMsg, size_t * missingBytes = 0,
+            ExtProtoError * extError = 0 );
+
+        /// @brief Creates a new object of the most specific message type that can be deserialized from the data.
+        ///
+        /// @param [in] buf The buffer to deserialize the data from.
+        /// @param [in] offset Offset in the buffer.
+        /// @param [in] dataSize The size of data (starting at given offset).
+        /// @param [out] msg The message created. It is set to 0 on error; Otherwise it should be deleted by the caller.
+        ///                  If none of the registered message types can be deserialized, it will be
+        ///                  an object of the base message type.
+        /// @param [out] extError Pointer to extended error code if it should be used (only modified on error).
+        /// @return The error code
+        static ProtoError deserialize (
+            const MemHandle & buf, size_t offset, size_t dataSize, B * & msg,
+            ExtProtoError * extError = 0 );
+
+        /// @brief Creates a new object of the most specific message type that can be deserialized from the data.
+        ///
+        /// It detects the length of the message by reading the 'length field' that should be included in the buffer.
+        ///
+        /// @param [in] buf The buffer to deserialize the data from
+        /// @param [in,out] offset Offset in the buffer to start from.
+        ///                         It is modified (only if the message is deserialized properly).
+        /// @param [out] msg The message created. It is set to 0 on error; Otherwise it should be deleted by the caller.
+        ///                  If none of the registered message types can be deserialized, it will be
+        ///                  an object of the base message type.
+        /// @param [out] missingBytes If used, the number of missing bytes is placed there.
+        ///                            It is only set when 'Error::IncompleteData' is returned.
+        /// @param [out] extError Pointer to extended error code if it should be used (only modified on error).
+        /// @return The error code
+        static ProtoError deserializeWithLength (
+            const MemHandle & buf, size_t & offset, B * & msg, size_t * missingBytes = 0,
+            ExtProtoError * extError = 0 );
+
+        /// @brief Creates a new object of the most specific message type that can be deserialized from a base message.
+        ///
+        /// For this to work, the base message has to still contain the original buffer.
+        /// The base message has already been deserialized, so its fields are used for selecting the message type.
+        ///
+        /// @param [in] baseMsg The base message to use.
+        /// @param [out] msg The message created. It is set to 0 on error; Otherwise it should be deleted by the caller.
+        ///                  If none of the registered message types can be deserialized, it will be
+        ///                  a clone of the base message.
+        /// @return The error code
+        static ProtoError deserialize ( const B & baseMsg, B * & msg );
+
+    private:
+        /// @brief The first registered entry.
+        /// Entries are ordered by their depth in the inheritance tree (from the deepest one).
+        static Entry * _first;
+
+        /// @brief Creates a new object of the most specific registered message type that matches the message.
+        /// @param [in] peekMsg The base message with (at least) the fields used by 'defines' deserialized.
+        /// @param [in] buf The buffer to deserialize the data from.
+        /// @param [in] offset Offset in the buffer.
+        /// @param [in] dataSize The size of data (starting at given offset).
+        /// @param [out] eCode The result of deserializing the object returned. Only set if an object is returned.
+        /// @return A new object of the most specific registered message type (that should be deleted by the caller),
+        ///         or 0 if none of the registered message types can be deserialized.
+        static B * deserializeSpecific (
+            const B & peekMsg, const MemHandle & buf, size_t offset, size_t dataSize, ProtoError & eCode );
+};
+
+template<typename B> typename MessageTypeRegistry<B>::Entry * MessageTypeRegistry<B>::_first = 0;
+
+template<typename B> MessageTypeRegistry<B>::Entry::Entry (
+        uint16_t depth, CreateFunc createFunc, MatchFunc matchFunc ):
+    _createFunc ( createFunc ),
+    _matchFunc ( matchFunc ),
+    _depth ( depth ),
+    _next ( 0 )
+{
+    Entry ** ptr = &MessageTypeRegistry<B>::_first;
+
+    // Entries with the same depth are kept in the registration order:
+    while ( *ptr != 0 && ( *ptr )->_depth >= _depth )
+    {
+        ptr = &( *ptr )->_next;
+    }
+
+    _next = *ptr;
+    *ptr = this;
+}
+
+template<typename B> ProtoError MessageTypeRegistry<B>::deserialize (
+        const MemHandle & buf, size_t offset, size_t dataSize, B & baseMsg, B * & specificMsg,
+        ExtProtoError * extError )
+{
+    specificMsg = 0;
+
+    B peekMsg;
+
+    // This only decodes the fields needed for checking 'defines', and skips everything else.
+    // If it fails, the data is malformed, and deserializing it as the base message will report that.
+    if ( IS_OK ( peekMsg.deserializeFields ( buf, offset, dataSize, &B::isDefinableField ) ) )
+    {
+        ProtoError eCode;
+
+        specificMsg = deserializeSpecific ( peekMsg, buf, offset, dataSize, eCode );
+
+        if ( specificMsg != 0 )
+            return eCode;
+    }
+
+    return baseMsg.deserialize ( buf, offset, dataSize, extError );
+}
+
+template<typename B> ProtoError MessageTypeRegistry<B>::deserializeWithLength (
+        const MemHandle & buf, size_t & offset, B & baseMsg, B * & specificMsg, size_t * missingBytes,
+        ExtProtoError * extError )
+{
+    specificMsg = 0;
+
+    size_t intOffset = offset;
+    size_t payloadSize = 0;
+
+    ProtoError eCode = Serializable::readLengthHeader ( buf, intOffset, payloadSize, missingBytes );
+
+    if ( NOT_OK ( eCode ) )
+        return eCode;
+
+    eCode = deserialize ( buf, intOffset, payloadSize, baseMsg, specificMsg, extError );
+
+    if ( IS_OK ( eCode ) )
+        offset = intOffset + payloadSize;
+
+    return eCode;
+}
+
+template<typename B> ProtoError MessageTypeRegistry<B>::deserialize (
+        const MemHandle & buf, size_t offset, size_t dataSize, B * & msg, ExtProtoError * extError )
+{
+    B baseMsg;
+
+    const ProtoError eCode = deserialize ( buf, offset, dataSize, baseMsg, msg, extError );
+
+    if ( IS_OK ( eCode ) && !msg )
+        msg = baseMsg.clone();
+
+    return eCode;
+}
+
+template<typename B> ProtoError MessageTypeRegistry<B>::deserializeWithLength (
+        const MemHandle & buf, size_t & offset, B * & msg, size_t * missingBytes, ExtProtoError * extError )
+{
+    B baseMsg;
+
+    const ProtoError eCode = deserializeWithLength ( buf, offset, baseMsg, msg, missingBytes, extError );
+
+    if ( IS_OK ( eCode ) && !msg )
+        msg = baseMsg.clone();
+
+    return eCode;
+}
+
+template<typename B> ProtoError MessageTypeRegistry<B>::deserialize ( const B & baseMsg, B * & msg )
+{
+    msg = 0;
+
+    const MemHandle & buf = baseMsg.getOrgBuffer();
+
+    if ( buf.isEmpty() )
+        return ProtoError::IncompleteData;
+
+    ProtoError eCode;
+
+    msg = deserializeSpecific ( baseMsg, buf, 0, buf.size(), eCode );
+
+    if ( !msg )
+        msg = baseMsg.clone();
+
+    return ProtoError::Success;
+}
+
+template<typename B> B * MessageTypeRegistry<B>::deserializeSpecific (
+        const B & peekMsg, const MemHandle & buf, size_t offset, size_t dataSize, ProtoError & eCode )
+{
+    for ( Entry * entry = _first; entry != 0; entry = entry->_next )
+    {
+        if ( !entry->_matchFunc ( peekMsg ) )
+            continue;
+
+        B * const msg = entry->_createFunc();
+
+        // The data matches 'defines' of this type, but it may still not be valid as this type.
+        // Any error here means that it is not this type - there is no need to report it.
+        eCode = msg->deserialize ( buf, offset, dataSize );
+
+        if ( IS_OK ( eCode ) )
+            return msg;
+
+        delete msg;
+    }
+
+    return 0;
+}
+}
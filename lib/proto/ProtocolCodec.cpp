@@ -366,12 +366,10 @@ ProtoError ProtocolCodec::encodeFieldHeader (
 
     assert ( ( wireType & 0x07 ) == wireType );
 
-    // Max amount of memory:
-    // 1 byte for wire type
-    // up to 5 bytes for field ID
-    // up to dataSize bytes for the value
-    // up to 5 bytes for the length (if wireType = WireTypeLengthDelim)
-    const size_t bufSize = 1 + 5 + dataSize + ( ( wireType == WireTypeLengthDelim ) ? 5 : 0 );
+    // The exact amount of memory needed for the header, plus the value that follows it.
+    // This way, when the buffer has been pre-allocated using the exact size of the entire message,
+    // we never need to reallocate it.
+    const size_t bufSize = getFieldHeaderSize ( fieldId, wireType, dataSize ) + dataSize;
 
     uint8_t * bufMem = ( uint8_t * ) buffer.getAppendable ( bufSize );
 
@@ -440,6 +438,31 @@ ProtoError ProtocolCodec::encodeFieldHeader (
     return ProtoError::Success;
 }
 
+size_t ProtocolCodec::getFieldHeaderSize ( uint32_t fieldId, uint8_t wireType, size_t dataSize )
+{
+    // The first byte carries the wire type and the first 4 bits of the field ID.
+    size_t hdrSize = 1;
+
+    // Each additional byte carries next 7 bits of the field ID.
+    for ( fieldId >>= 4; fieldId > 0; fieldId >>= 7 )
+    {
+        ++hdrSize;
+    }
+
+    if ( wireType == WireTypeLengthDelim )
+    {
+        // The length value is encoded using 7 bits per byte (and always uses at least one byte).
+        do
+        {
+            ++hdrSize;
+            dataSize >>= 7;
+        }
+        while ( dataSize > 0 );
+    }
+
+    return hdrSize;
+}
+
 /// @brief Integer encoding modes.
 enum EncodingMode
 {
@@ -458,27 +481,30 @@ enum EncodingMode
 #pragma GCC diagnostic ignored "-Wshift-count-overflow"
 #endif
 
-template<typename TYPE> ProtoError tEncodeInt (
-        Buffer & buffer, TYPE value, uint32_t fieldId, EncodingMode encMode )
+/// @brief Determines how an integer value should be encoded.
+/// @param [in] value The value to encode. It should be positive (or 0), even in EncNegative mode.
+/// @param [in] encMode Encoding mode.
+/// @param [out] wireType The wire type to use.
+/// @param [out] dataSize The exact number of bytes needed to encode the value (without the field's header).
+/// @return Standard error code.
+template<typename TYPE> ProtoError tGetIntEncoding (
+        TYPE value, EncodingMode encMode, uint8_t & wireType, size_t & dataSize )
 {
+    dataSize = 0;
+    wireType = ProtocolCodec::WireTypeZero;
+
     if ( value == 0 )
     {
         // Zero!
-        return ProtocolCodec::encodeFieldHeader ( buffer, fieldId, ProtocolCodec::WireTypeZero, 0 );
+        return ProtoError::Success;
     }
 
     // We shouldn't be seeing negative numbers here!
     assert ( value > 0 );
 
-    size_t dataSize = 0;
-    uint8_t wireType = 0;
-
     if ( encMode == EncNegative )
     {
-        // Special case for negative numbers.
-        // We don't know the data size, so let's assume it's max possible.
-        // max uint64_t encoded using variable length encoding will use 10 bytes.
-        dataSize = 10;
+        // Special case for negative numbers, they always use variable length encoding.
         wireType = ProtocolCodec::WireTypeVariableLengthB;
     }
     else if ( ( value & ( ( TYPE ) 0xFF ) ) == value )
@@ -496,7 +522,6 @@ template<typename TYPE> ProtoError tEncodeInt (
     else if ( ( value & ( ( TYPE ) 0x1FFFFF ) ) == value )
     {
         // We can fit the value in 3 bytes using variable length encoding
-        dataSize = 3;
         wireType = ProtocolCodec::WireTypeVariableLengthA;
     }
     else if ( ( value & ( ( TYPE ) 0xFFFFFFFF ) ) == value )
@@ -508,7 +533,6 @@ template<typename TYPE> ProtoError tEncodeInt (
     else if ( ( value & ( ( TYPE ) 0x1FFFFFFFFFFFFULL ) ) == value )
     {
         // We can fit the value in 7 bytes (or less) using variable length encoding
-        dataSize = 7;
         wireType = ProtocolCodec::WireTypeVariableLengthA;
     }
     else if ( ( value & ( ( TYPE ) 0xFFFFFFFFFFFFFFFFULL ) ) == value )
@@ -522,9 +546,40 @@ template<typename TYPE> ProtoError tEncodeInt (
         return ProtoError::TooBigValue;
     }
 
+    if ( dataSize == 0 )
+    {
+        // Variable length encoding; each byte carries 7 bits of the value.
+        do
+        {
+            ++dataSize;
+            value >>= 7;
+        }
+        while ( value > 0 );
+    }
+
+    return ProtoError::Success;
+}
+
+template<typename TYPE> ProtoError tEncodeInt (
+        Buffer & buffer, TYPE value, uint32_t fieldId, EncodingMode encMode )
+{
+    size_t dataSize = 0;
+    uint8_t wireType = 0;
+
+    ProtoError ret = tGetIntEncoding<TYPE> ( value, encMode, wireType, dataSize );
+
+    if ( NOT_OK ( ret ) )
+        return ret;
+
+    if ( wireType == ProtocolCodec::WireTypeZero )
+    {
+        // Zero!
+        return ProtocolCodec::encodeFieldHeader ( buffer, fieldId, ProtocolCodec::WireTypeZero, 0 );
+    }
+
     // Since we don't use WireTypeLengthDelim wire type, encodeFieldHeader will only use the dataSize
     // for preallocating the correct buffer size - this is a good thing, so let's pass the correct value here!
-    ProtoError ret = ProtocolCodec::encodeFieldHeader ( buffer, fieldId, wireType, dataSize );
+    ret = ProtocolCodec::encodeFieldHeader ( buffer, fieldId, wireType, dataSize );
 
     if ( NOT_OK ( ret ) )
         return ret;
@@ -577,11 +632,25 @@ template<typename TYPE> ProtoError tEncodeInt (
         }
     }
 
+    assert ( off == dataSize );
+
     buffer.markAppended ( off );
 
     return ProtoError::Success;
 }
 
+template<typename TYPE> size_t tGetIntEncodedSize ( TYPE value, uint32_t fieldId, EncodingMode encMode )
+{
+    size_t dataSize = 0;
+    uint8_t wireType = 0;
+
+    // If the value cannot be encoded, encoding will fail anyway. We just return the size of the header.
+    if ( NOT_OK ( tGetIntEncoding<TYPE> ( value, encMode, wireType, dataSize ) ) )
+        dataSize = 0;
+
+    return ProtocolCodec::getFieldHeaderSize ( fieldId, wireType, dataSize ) + dataSize;
+}
+
 #ifdef __clang__
 #pragma GCC diagnostic pop
 #endif
@@ -740,3 +809,103 @@ ProtoError ProtocolCodec::encode ( Buffer & buffer, const Buffer & fromBuffer, u
 {
     return encodeRaw ( buffer, fromBuffer.get(), fromBuffer.size(), fieldId );
 }
+
+size_t ProtocolCodec::getRawEncodedSize ( size_t dataSize, uint32_t fieldId )
+{
+    return getFieldHeaderSize ( fieldId, getWireTypeForSize ( dataSize ), dataSize ) + dataSize;
+}
+
+size_t ProtocolCodec::getEncodedSize ( const String & value, uint32_t fieldId )
+{
+    return getRawEncodedSize ( value.length(), fieldId );
+}
+
+size_t ProtocolCodec::getEncodedSize ( bool value, uint32_t fieldId )
+{
+    return tGetIntEncodedSize<uint8_t> ( value ? 1 : 0, fieldId, EncNormal );
+}
+
+size_t ProtocolCodec::getEncodedSize ( uint8_t value, uint32_t fieldId )
+{
+    return tGetIntEncodedSize<uint8_t> ( value, fieldId, EncNormal );
+}
+
+size_t ProtocolCodec::getEncodedSize ( uint16_t value, uint32_t fieldId )
+{
+    return tGetIntEncodedSize<uint16_t> ( value, fieldId, EncNormal );
+}
+
+size_t ProtocolCodec::getEncodedSize ( uint32_t value, uint32_t fieldId )
+{
+    return tGetIntEncodedSize<uint32_t> ( value, fieldId, EncNormal );
+}
+
+size_t ProtocolCodec::getEncodedSize ( uint64_t value, uint32_t fieldId )
+{
+    return tGetIntEncodedSize<uint64_t> ( value, fieldId, EncNormal );
+}
+
+size_t ProtocolCodec::getEncodedSize ( int8_t value, uint32_t fieldId )
+{
+    if ( value < 0 )
+    {
+        return tGetIntEncodedSize<uint8_t> ( -( ( uint8_t ) value ), fieldId, EncNegative );
+    }
+
+    return tGetIntEncodedSize<uint8_t> ( value, fieldId, EncNormal );
+}
+
+size_t ProtocolCodec::getEncodedSize ( int16_t value, uint32_t fieldId )
+{
+    if ( value < 0 )
+    {
+        return tGetIntEncodedSize<uint16_t> ( -( ( uint16_t ) value ), fieldId, EncNegative );
+    }
+
+    return tGetIntEncodedSize<uint16_t> ( value, fieldId, EncNormal );
+}
+
+size_t ProtocolCodec::getEncodedSize ( int32_t value, uint32_t fieldId )
+{
+    if ( value < 0 )
+    {
+        return tGetIntEncodedSize<uint32_t> ( -( ( uint32_t ) value ), fieldId, EncNegative );
+    }
+
+    return tGetIntEncodedSize<uint32_t> ( value, fieldId, EncNormal );
+}
+
+size_t ProtocolCodec::getEncodedSize ( int64_t value, uint32_t fieldId )
+{
+    if ( value < 0 )
+    {
+        return tGetIntEncodedSize<uint64_t> ( -( ( uint64_t ) value ), fieldId, EncNegative );
+    }
+
+    return tGetIntEncodedSize<uint64_t> ( value, fieldId, EncNormal );
+}
+
+size_t ProtocolCodec::getEncodedSize ( float value, uint32_t fieldId )
+{
+    return tGetIntEncodedSize<uint32_t> ( FloatingPointUtils::pack754 ( value ), fieldId, EncNormal );
+}
+
+size_t ProtocolCodec::getEncodedSize ( double value, uint32_t fieldId )
+{
+    return tGetIntEncodedSize<uint64_t> ( FloatingPointUtils::pack754 ( value ), fieldId, EncNormal );
+}
+
+size_t ProtocolCodec::getEncodedSize ( const IpAddress & value, uint32_t fieldId )
+{
+    return getRawEncodedSize ( value.isIPv4() ? 4 : ( value.isIPv6() ? 16 : 0 ), fieldId );
+}
+
+size_t ProtocolCodec::getEncodedSize ( const Timestamp & value, uint32_t fieldId )
+{
+    return tGetIntEncodedSize<uint64_t> ( value.getBinValue(), fieldId, EncNormal );
+}
+
+size_t ProtocolCodec::getEncodedSize ( const Buffer & fromBuffer, uint32_t fieldId )
+{
+    return getRawEncodedSize ( fromBuffer.size(), fieldId );
+}
@@ -234,6 +234,7 @@ class ProtocolCodec
         ///                      If wireType is set to WireTypeLengthDelim then this function encodes the
         ///                      length value in the header as well, otherwise this parameter is only used
         ///                      for buffer preallocation, so it is a good idea to pass the correct value!
+        ///                      The memory reserved is exactly the size of the header plus dataSize.
         /// @return Standard error code
         static ProtoError encodeFieldHeader (
             Buffer & buffer, uint32_t fieldId,
@@ -383,6 +384,127 @@ class ProtocolCodec
         /// @return Standard error code
         static ProtoError encodeRaw ( Buffer & buffer, const char * data, size_t dataSize, uint32_t fieldId );
 
+        /// @brief Returns the size of the field's header
+        ///
+        /// @param [in] fieldId The ID of the field
+        /// @param [in] wireType The "wire type" of the field
+        /// @param [in] dataSize The size of the data stored in that field.
+        ///                      It is only used if wireType is set to WireTypeLengthDelim.
+        /// @return The number of bytes encodeFieldHeader() appends for the given field
+        static size_t getFieldHeaderSize ( uint32_t fieldId, uint8_t wireType, size_t dataSize );
+
+        /// @brief Returns the size of a field carrying 'bool' value (including its header)
+        ///
+        /// @param [in] value The value to be encoded
+        /// @param [in] fieldId The ID of the field
+        /// @return The number of bytes encode() appends for the given value
+        static size_t getEncodedSize ( bool value, uint32_t fieldId );
+
+        /// @brief Returns the size of a field carrying 'int8_t' value (including its header)
+        ///
+        /// @param [in] value The value to be encoded
+        /// @param [in] fieldId The ID of the field
+        /// @return The number of bytes encode() appends for the given value
+        static size_t getEncodedSize ( int8_t value, uint32_t fieldId );
+
+        /// @brief Returns the size of a field carrying 'uint8_t' value (including its header)
+        ///
+        /// @param [in] value The value to be encoded
+        /// @param [in] fieldId The ID of the field
+        /// @return The number of bytes encode() appends for the given value
+        static size_t getEncodedSize ( uint8_t value, uint32_t fieldId );
+
+        /// @brief Returns the size of a field carrying 'int16_t' value (including its header)
+        ///
+        /// @param [in] value The value to be encoded
+        /// @param [in] fieldId The ID of the field
+        /// @return The number of bytes encode() appends for the given value
+        static size_t getEncodedSize ( int16_t value, uint32_t fieldId );
+
+        /// @brief Returns the size of a field carrying 'uint16_t' value (including its header)
+        ///
+        /// @param [in] value The value to be encoded
+        /// @param [in] fieldId The ID of the field
+        /// @return The number of bytes encode() appends for the given value
+        static size_t getEncodedSize ( uint16_t value, uint32_t fieldId );
+
+        /// @brief Returns the size of a field carrying 'int32_t' value (including its header)
+        ///
+        /// @param [in] value The value to be encoded
+        /// @param [in] fieldId The ID of the field
+        /// @return The number of bytes encode() appends for the given value
+        static size_t getEncodedSize ( int32_t value, uint32_t fieldId );
+
+        /// @brief Returns the size of a field carrying 'uint32_t' value (including its header)
+        ///
+        /// @param [in] value The value to be encoded
+        /// @param [in] fieldId The ID of the field
+        /// @return The number of bytes encode() appends for the given value
+        static size_t getEncodedSize ( uint32_t value, uint32_t fieldId );
+
+        /// @brief Returns the size of a field carrying 'int64_t' value (including its header)
+        ///
+        /// @param [in] value The value to be encoded
+        /// @param [in] fieldId The ID of the field
+        /// @return The number of bytes encode() appends for the given value
+        static size_t getEncodedSize ( int64_t value, uint32_t fieldId );
+
+        /// @brief Returns the size of a field carrying 'uint64_t' value (including its header)
+        ///
+        /// @param [in] value The value to be encoded
+        /// @param [in] fieldId The ID of the field
+        /// @return The number of bytes encode() appends for the given value
+        static size_t getEncodedSize ( uint64_t value, uint32_t fieldId );
+
+        /// @brief Returns the size of a field carrying 'float' value (including its header)
+        ///
+        /// @param [in] value The value to be encoded
+        /// @param [in] fieldId The ID of the field
+        /// @return The number of bytes encode() appends for the given value
+        static size_t getEncodedSize ( float value, uint32_t fieldId );
+
+        /// @brief Returns the size of a field carrying 'double' value (including its header)
+        ///
+        /// @param [in] value The value to be encoded
+        /// @param [in] fieldId The ID of the field
+        /// @return The number of bytes encode() appends for the given value
+        static size_t getEncodedSize ( double value, uint32_t fieldId );
+
+        /// @brief Returns the size of a field carrying 'String' value (including its header)
+        ///
+        /// @param [in] value The value to be encoded
+        /// @param [in] fieldId The ID of the field
+        /// @return The number of bytes encode() appends for the given value
+        static size_t getEncodedSize ( const String & value, uint32_t fieldId );
+
+        /// @brief Returns the size of a field carrying data (including its header)
+        ///
+        /// @param [in] fromBuffer The buffer which content would be encoded.
+        /// @param [in] fieldId The ID of the field
+        /// @return The number of bytes encode() appends for the given value
+        static size_t getEncodedSize ( const Buffer & fromBuffer, uint32_t fieldId );
+
+        /// @brief Returns the size of a field carrying 'IpAddress' value (including its header)
+        ///
+        /// @param [in] value The value to be encoded
+        /// @param [in] fieldId The ID of the field
+        /// @return The number of bytes encode() appends for the given value
+        static size_t getEncodedSize ( const IpAddress & value, uint32_t fieldId );
+
+        /// @brief Returns the size of a field carrying 'Timestamp' value (including its header)
+        ///
+        /// @param [in] value The value to be encoded
+        /// @param [in] fieldId The ID of the field
+        /// @return The number of bytes encode() appends for the given value
+        static size_t getEncodedSize ( const Timestamp & value, uint32_t fieldId );
+
+        /// @brief Returns the size of a field carrying raw data (including its header)
+        ///
+        /// @param [in] dataSize The size of the data to encode
+        /// @param [in] fieldId The ID of the field
+        /// @return The number of bytes encodeRaw() appends for the data of the given size
+        static size_t getRawEncodedSize ( size_t dataSize, uint32_t fieldId );
+
         /// @brief Returns the appropriate wire type for the given data size
         /// @param [in] dataSize The size of data
         /// @return The wire type for that data size
@@ -27,22 +27,116 @@ using namespace Pravala;
 const size_t Serializable::MaxLengthHeaderSize = 5;
 const uint32_t Serializable::LengthVarFieldId = 0;
 
+const size_t Serializable::InvalidSerializedSize = ( size_t ) -1;
+
+Serializable::Serializable(): _serializedSize ( InvalidSerializedSize )
+{
+}
+
 Serializable::~Serializable()
 {
 }
 
-ProtoError Serializable::serialize ( Buffer & buf, ExtProtoError * extError )
+size_t Serializable::getSerializedSize()
+{
+    if ( _serializedSize == InvalidSerializedSize )
+    {
+        _serializedSize = calcSerializedSize();
+    }
+
+    return _serializedSize;
+}
+
+size_t Serializable::calcFieldSize ( uint32_t fieldId )
+{
+    _serializedSize = calcSerializedSize();
+
+    return ProtocolCodec::getRawEncodedSize ( _serializedSize, fieldId );
+}
+
+ProtoError Serializable::prepareSerialization ( ExtProtoError * extError )
 {
     setupDefines();
 
-    ProtoError ret = validate ( extError );
+    const ProtoError ret = validate ( extError );
+
+    if ( NOT_OK ( ret ) )
+    {
+        return ret;
+    }
+
+    // setupDefines() may have modified the object, so we always calculate the size again.
+    _serializedSize = calcSerializedSize();
+
+    return ProtoError::Success;
+}
+
+ProtoError Serializable::appendFields ( Buffer & buf, ExtProtoError * extError )
+{
+    assert ( _serializedSize != InvalidSerializedSize );
+
+    const size_t orgSize = buf.size();
+
+    // This is a no-op if the memory has already been reserved (for example, while writing the header).
+    if ( _serializedSize > 0 && !buf.getAppendable ( _serializedSize ) )
+    {
+        return ProtoError::MemoryError;
+    }
+
+    const ProtoError ret = serializeFields ( buf, extError );
 
     if ( NOT_OK ( ret ) )
     {
         return ret;
     }
 
-    return serializeFields ( buf, extError );
+    // If this happens, the header of the field (or the length) that was written before is incorrect!
+    assert ( buf.size() == orgSize + _serializedSize );
+
+    if ( buf.size() != orgSize + _serializedSize )
+    {
+        if ( extError != 0 )
+        {
+            extError->add ( ProtoError::InternalError,
+                            String ( "Calculated size of the object (%1) is different than the serialized size (%2)" )
+                            .arg ( _serializedSize ).arg ( buf.size() - orgSize ) );
+        }
+
+        return ProtoError::InternalError;
+    }
+
+    return ProtoError::Success;
+}
+
+ProtoError Serializable::serialize ( Buffer & buf, ExtProtoError * extError )
+{
+    const ProtoError ret = prepareSerialization ( extError );
+
+    if ( NOT_OK ( ret ) )
+    {
+        return ret;
+    }
+
+    return appendFields ( buf, extError );
+}
+
+ProtoError Serializable::serializeAsField ( Buffer & buf, uint32_t fieldId, ExtProtoError * extError )
+{
+    if ( _serializedSize == InvalidSerializedSize )
+    {
+        _serializedSize = calcSerializedSize();
+    }
+
+    // encodeFieldHeader() reserves the memory for the header and the entire object.
+    const ProtoError ret = ProtocolCodec::encodeFieldHeader (
+        buf, fieldId, ProtocolCodec::getWireTypeForSize ( _serializedSize ), _serializedSize );
+
+    if ( NOT_OK ( ret ) )
+    {
+        return ret;
+    }
+
+    return appendFields ( buf, extError );
 }
 
 ProtoError Serializable::serialize ( Json & json, ExtProtoError * extError )
@@ -73,6 +167,7 @@ ProtoError Serializable::deserialize (
         const MemHandle & buf, size_t offset, size_t dataSize, ExtProtoError * extError )
 {
     clear();
+    clearSerializedSize();
 
     bool wasWarning = false;
 
@@ -144,131 +239,32 @@ ProtoError Serializable::deserialize (
 
 ProtoError Serializable::serializeWithLength ( Buffer & buf, ExtProtoError * extError )
 {
-    ProtoError ret = ProtocolCodec::encodeFieldHeader ( buf, LengthVarFieldId,
-                                                        ProtocolCodec::getWireTypeForSize ( sizeof ( LengthVarType ) ),
-                                                        sizeof ( LengthVarType ) );
+    ProtoError ret = prepareSerialization ( extError );
 
     if ( NOT_OK ( ret ) )
     {
         return ret;
     }
 
-    size_t lenOffset = buf.size();
-    char * mem = buf.getAppendable ( sizeof ( LengthVarType ) );
-
-    if ( !mem )
-    {
-        return ProtoError::MemoryError;
-    }
-
-    buf.markAppended ( sizeof ( LengthVarType ) );
-
-    size_t payloadOffset = buf.size();
+    LengthVarType payloadSize = ( LengthVarType ) _serializedSize;
 
-    ret = serialize ( buf, extError );
-
-    if ( NOT_OK ( ret ) )
-    {
-        return ret;
-    }
-
-    LengthVarType payloadSize = ( LengthVarType ) ( buf.size() - payloadOffset );
-
-    if ( buf.size() < payloadOffset || payloadSize < 0 )
+    if ( payloadSize < 0 || ( size_t ) payloadSize != _serializedSize )
     {
         return ProtoError::TooMuchData;
     }
 
-    // This is somewhat ugly, since we're modifying the content of the append-only buffer.
-    // But we just appended this data, and nothing else should be using it...
-    // Alternatively we could pass an RwBuffer to this function, but we are really only appending
-    // to it - but we need to append the length before we actually know what it is!
-    // We could keep the pointer to the original memory, but it may be no longer valid - inside serialize()
-    // the buffer's memory may have been reallocated several times already!
-    mem = const_cast<char *> ( buf.get ( lenOffset ) );
-
-    if ( !mem )
-    {
-        return ProtoError::InvalidParameter;
-    }
-
-    memset ( mem, 0, sizeof ( LengthVarType ) );
-
-    lenOffset = 0;
-
-    while ( payloadSize > 0 )
-    {
-        assert ( lenOffset < sizeof ( LengthVarType ) );
-
-        if ( lenOffset >= sizeof ( LengthVarType ) )
-        {
-            return ProtoError::InternalError;
-        }
-
-        mem[ lenOffset++ ] = ( payloadSize & 0xFF );
-        payloadSize >>= 8;
-    }
-
-    return ret;
-}
-
-MemHandle Serializable::serializeWithLength ( ProtoError * errCode, ExtProtoError * extError )
-{
-    RwBuffer buf;
-
-    buf.getAppendable ( MaxLengthHeaderSize );
-    buf.markAppended ( MaxLengthHeaderSize );
-
-    if ( buf.size() < MaxLengthHeaderSize )
-    {
-        if ( errCode != 0 )
-            *errCode = ProtoError::MemoryError;
-
-        // An empty one!
-        return MemHandle();
-    }
-
-    assert ( MaxLengthHeaderSize == buf.size() );
-
-    ProtoError ret = serialize ( buf, extError );
-
-    if ( NOT_OK ( ret ) )
-    {
-        if ( errCode != 0 )
-            *errCode = ret;
-
-        // An empty one!
-        return MemHandle();
-    }
-
-    assert ( buf.size() >= MaxLengthHeaderSize );
-
-    LengthVarType payloadSize = ( LengthVarType ) ( buf.size() - MaxLengthHeaderSize );
-
-    if ( buf.size() < MaxLengthHeaderSize || payloadSize < 0 )
-    {
-        if ( errCode != 0 )
-            *errCode = ProtoError::TooMuchData;
-
-        // An empty one!
-        return Buffer();
-    }
-
-    size_t hdrOffset = 0;
+    // The length is encoded using 4 bytes, unless it fits in fewer.
+    size_t lenSize = 4;
     uint8_t wireType = ProtocolCodec::WireType4Bytes;
 
     if ( ( payloadSize & 0xFF ) == payloadSize )
     {
-        // We need just one byte (instead of 4)
-        // So we can skip first 3 bytes
-        hdrOffset = 3;
+        lenSize = 1;
         wireType = ProtocolCodec::WireType1Byte;
     }
     else if ( ( payloadSize & 0xFFFF ) == payloadSize )
     {
-        // We need just two bytes (instead of 4)
-        // So we can skip first 2 bytes
-        hdrOffset = 2;
+        lenSize = 2;
         wireType = ProtocolCodec::WireType2Bytes;
     }
 
@@ -280,41 +276,51 @@ MemHandle Serializable::serializeWithLength ( ProtoError * errCode, ExtProtoErro
     // as an overflow bit):
     assert ( ( LengthVarFieldId & 0x0F ) == LengthVarFieldId );
 
-    char * const mem = buf.getWritable();
+    assert ( 1 + lenSize <= MaxLengthHeaderSize );
 
-    assert ( mem != 0 );
+    // We reserve the memory for the header and the entire payload at once.
+    // appendFields() will not need to reallocate it.
+    char * const mem = buf.getAppendable ( 1 + lenSize + _serializedSize );
 
     if ( !mem )
     {
-        if ( errCode != 0 )
-            *errCode = ProtoError::MemoryError;
-
-        // An empty one!
-        return Buffer();
+        return ProtoError::MemoryError;
     }
 
-    size_t off = hdrOffset;
-
-    assert ( off < MaxLengthHeaderSize );
+    size_t off = 0;
 
     mem[ off++ ] = ( wireType & 0x07 ) | ( ( LengthVarFieldId & 0x0F ) << 3 );
 
-    assert ( off < MaxLengthHeaderSize );
-
-    while ( off < MaxLengthHeaderSize )
+    while ( off <= lenSize )
     {
         mem[ off++ ] = ( uint8_t ) ( payloadSize & 0xFF );
         payloadSize >>= 8;
     }
 
-    assert ( off == MaxLengthHeaderSize );
+    assert ( payloadSize == 0 );
+    assert ( off == 1 + lenSize );
+
+    buf.markAppended ( off );
+
+    return appendFields ( buf, extError );
+}
+
+MemHandle Serializable::serializeWithLength ( ProtoError * errCode, ExtProtoError * extError )
+{
+    Buffer buf;
+
+    const ProtoError ret = serializeWithLength ( buf, extError );
 
     if ( errCode != 0 )
-        *errCode = ProtoError::Success;
+        *errCode = ret;
+
+    if ( NOT_OK ( ret ) )
+    {
+        // An empty one!
+        return MemHandle();
+    }
 
-    // We need to skip some bytes from the beginning of the buffer.
-    // If hdrOffset > 0, then this means that some of the first bytes are not actually used by the header.
-    return buf.getHandle ( hdrOffset );
+    return buf.getHandle();
 }
 
 ProtoError Serializable::deserializeWithLength ( Buffer & buf, size_t * missingBytes, ExtProtoError * extError )
@@ -345,9 +351,8 @@ ProtoError Serializable::deserializeWithLength ( Buffer & buf, size_t * missingB
     return ret;
 }
 
-ProtoError Serializable::deserializeWithLength (
-        const MemHandle & buf, size_t & offset,
-        size_t * missingBytes, ExtProtoError * extError )
+ProtoError Serializable::readLengthHeader (
+        const MemHandle & buf, size_t & offset, size_t & payloadSize, size_t * missingBytes )
 {
     // Min message size = 2
     if ( offset + 2 > buf.size() )
@@ -416,21 +421,39 @@ ProtoError Serializable::deserializeWithLength (
         return ProtoError::ProtocolError;
     }
 
-    const size_t payloadSize = ( size_t ) intPayloadSize;
-
     // We don't have the entire message yet!
 
-    if ( intOffset + payloadSize > buf.size() )
+    if ( intOffset + ( size_t ) intPayloadSize > buf.size() )
     {
         if ( missingBytes != 0 )
         {
-            *missingBytes = intOffset + payloadSize - buf.size();
+            *missingBytes = intOffset + ( size_t ) intPayloadSize - buf.size();
         }
 
         return ProtoError::IncompleteData;
     }
 
-    const ProtoError ret = deserialize ( buf, intOffset, payloadSize, extError );
+    offset = intOffset;
+    payloadSize = ( size_t ) intPayloadSize;
+
+    return ProtoError::Success;
+}
+
+ProtoError Serializable::deserializeWithLength (
+        const MemHandle & buf, size_t & offset,
+        size_t * missingBytes, ExtProtoError * extError )
+{
+    size_t intOffset = offset;
+    size_t payloadSize = 0;
+
+    ProtoError ret = readLengthHeader ( buf, intOffset, payloadSize, missingBytes );
+
+    if ( NOT_OK ( ret ) )
+    {
+        return ret;
+    }
+
+    ret = deserialize ( buf, intOffset, payloadSize, extError );
 
     if ( IS_OK ( ret ) )
     {
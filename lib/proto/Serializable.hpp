@@ -43,10 +43,14 @@ class Serializable
         /// It uses signed type for compatibility with Java.
         typedef int32_t LengthVarType;
 
+        /// @brief Default constructor.
+        Serializable();
+
         /// @brief Serializes content of the object to the buffer
         ///
         /// First it calls setupDefines(). Next it verifies the validity of the object by calling validate().
-        /// Then it calls serializeFields().
+        /// Then it calculates the size of the serialized object, reserves that much memory in the buffer,
+        /// and calls serializeFields().
         ///
         /// It appends serialized data to the buffer. This function does not encode message's length.
         ///
@@ -61,6 +65,7 @@ class Serializable
         ///
         /// @param [out] data This MemHandle will be set to contain the serialized content of the object.
         /// @param [in] preAllocateMemory The number of bytes to pre-allocate in the buffer.
+        ///                               It is not needed, since serialize() reserves the exact size anyway.
         /// @param [out] extError Pointer to extended error code if it should be used (only modified on error).
         /// @return The error code
         inline ProtoError serialize (
@@ -91,9 +96,10 @@ class Serializable
 
         /// @brief Serializes content of the object to the buffer
         ///
-        /// It calls serialize() and also encodes the total payload's length.
-        /// This version appends to an existing buffer. The drawback is that the payload length
-        /// is always encoded using the maximum number of bytes.
+        /// It works like serialize(), but it also encodes the total payload's length.
+        /// This version appends to an existing buffer. Since the payload size is calculated up front,
+        /// the length is encoded using the number of bytes that depends on the actual length,
+        /// and the memory for the entire message is reserved only once.
         ///
         /// @param [in] buf The buffer to serialize the data to
         /// @param [out] extError Pointer to extended error code if it should be used (only modified on error).
@@ -102,12 +108,9 @@ class Serializable
 
         /// @brief Serializes content of the object to the buffer
         ///
-        /// It calls serialize() and also encodes the total payload's length.
+        /// It works like serialize(), but it also encodes the total payload's length.
         /// It returns new buffer with the serialized content of the object.
-        /// This version creates a new buffer instead of appending to an existing one.
-        /// The advantage over the other version is that the payload length is encoded in more
-        /// efficient method, and instead of always using the maximum number of bytes for that
-        /// field it encodes it using smaller number of bytes that depends on the actual length.
+        /// This version creates a new buffer (of the exact size needed) instead of appending to an existing one.
         ///
         /// @param [out] errCode The pointer to an error code. If it is non-zero the error code
         ///                      is placed there.
@@ -158,6 +161,22 @@ class Serializable
             const MemHandle & buf, size_t & offset, size_t * missingBytes = 0,
             ExtProtoError * extError = 0 );
 
+        /// @brief Reads the 'length field' that precedes the payload of a serialized object.
+        ///
+        /// It is used by deserializeWithLength(), but it can also be used to split a stream of messages
+        /// without deserializing them.
+        ///
+        /// @param [in] buf The buffer to read the data from.
+        /// @param [in,out] offset Offset in the buffer to start from.
+        ///                         On success it is set to the first byte of the payload.
+        /// @param [out] payloadSize The size of the payload. It is only set on success,
+        ///                          which means that the entire payload is in the buffer.
+        /// @param [out] missingBytes If used, the number of missing bytes is placed there.
+        ///                            It is only set when 'Error::IncompleteData' is returned.
+        /// @return The error code
+        static ProtoError readLengthHeader (
+            const MemHandle & buf, size_t & offset, size_t & payloadSize, size_t * missingBytes = 0 );
+
         /// @brief Deserializes data from the buffer and consumes that data in the buffer.
         ///
         /// It is a convenience wrapper around deserializeWithLength ( MemHandle, ... ) function.
@@ -187,6 +206,36 @@ class Serializable
         /// @return The error code.
         ProtoError deserializeWithLength ( Buffer & buf, size_t * missingBytes = 0, ExtProtoError * extError = 0 );
 
+        /// @brief Returns the number of bytes that serializing this object would append to a buffer.
+        ///
+        /// The size is calculated once, and then cached until the object is modified
+        /// (messageModified() is called for messages, or any of the fields of a structure is modified).
+        /// This function does not call setupDefines(), so it should be called first if 'defined' fields
+        /// may not be set up yet. Also, modifications of nested objects made using references obtained
+        /// before are not detected. serialize() always calculates the size again, so it is not affected by that.
+        /// @return The size of the serialized object (without the length header).
+        size_t getSerializedSize();
+
+        /// @brief Calculates the size of this object serialized as a field of another object.
+        ///
+        /// It is used by generated code, while calculating the size of the object that contains this one.
+        /// It always calculates (and caches) the size of this object again.
+        /// @param [in] fieldId The ID of the field.
+        /// @return The size of the entire field (the field's header and the serialized object).
+        size_t calcFieldSize ( uint32_t fieldId );
+
+        /// @brief Serializes this object as a field of another object.
+        ///
+        /// It is used by generated code. It writes the field's header followed directly by all the fields
+        /// of this object, without using a temporary buffer. The size of the object should be calculated by
+        /// calcFieldSize() first. Unlike serialize(), it does not call setupDefines() and validate(),
+        /// since they should have been called on the object that contains this one.
+        /// @param [in] buf The buffer to serialize the data to.
+        /// @param [in] fieldId The ID of the field.
+        /// @param [out] extError Pointer to extended error code if it should be used (only modified on error).
+        /// @return The error code
+        ProtoError serializeAsField ( Buffer & buf, uint32_t fieldId, ExtProtoError * extError = 0 );
+
         /// @brief Clears the content.
         ///
         /// All fields will either be set to their default values (or 0 if not set) or their clear()
@@ -210,6 +259,16 @@ class Serializable
         virtual ~Serializable();
 
     protected:
+        /// @brief Calculates the size of all fields, as they would be serialized by serializeFields().
+        /// @return The number of bytes serializeFields() would append to the buffer.
+        virtual size_t calcSerializedSize() = 0;
+
+        /// @brief Should be called whenever the object is modified, so the cached serialized size is not used.
+        inline void clearSerializedSize()
+        {
+            _serializedSize = InvalidSerializedSize;
+        }
+
         /// @brief Serializes all fields to the buffer
         /// @param [in] buf The buffer to serialize the data to
         /// @param [out] extError Pointer to extended error code if it should be used (only modified on error).
@@ -239,5 +298,23 @@ class Serializable
             uint32_t fieldId, uint8_t wireType, const MemHandle & buf,
             size_t offset, size_t fieldSize,
             ExtProtoError * extError ) = 0;
+
+    private:
+        /// @brief The value of _serializedSize that means that the size is not known.
+        static const size_t InvalidSerializedSize;
+
+        /// @brief The size of the serialized object; InvalidSerializedSize if it is not known.
+        size_t _serializedSize;
+
+        /// @brief Sets up defines, validates the object and calculates its serialized size.
+        /// @param [out] extError Pointer to extended error code if it should be used (only modified on error).
+        /// @return The error code
+        ProtoError prepareSerialization ( ExtProtoError * extError );
+
+        /// @brief Appends all fields to the buffer, using the serialized size calculated before.
+        /// @param [in] buf The buffer to serialize the data to.
+        /// @param [out] extError Pointer to extended error code if it should be used (only modified on error).
+        /// @return The error code
+        ProtoError appendFields ( Buffer & buf, ExtProtoError * extError );
 };
 }
@@ -191,6 +191,24 @@ template<typename T> class SerializableContainer
             return _ptr->serialize ( arg, extError );
         }
 
+        /// @brief Calculates the size of the internal object serialized as a field of another object.
+        /// @param [in] fieldId The ID of the field.
+        /// @return The size of the entire field (the field's header and the serialized object).
+        inline size_t calcFieldSize ( uint32_t fieldId )
+        {
+            return _ptr->calcFieldSize ( fieldId );
+        }
+
+        /// @brief Serializes the internal object as a field of another object.
+        /// @param [in] buf The buffer to serialize the data to.
+        /// @param [in] fieldId The ID of the field.
+        /// @param [out] extError Pointer to extended error code if it should be used (only modified on error).
+        /// @return The error code
+        inline ProtoError serializeAsField ( Buffer & buf, uint32_t fieldId, ExtProtoError * extError = 0 )
+        {
+            return _ptr->serializeAsField ( buf, fieldId, extError );
+        }
+
         /// @brief Deserializes the internal object using data from the buffer.
         /// @param [in] buf The buffer to deserialize the data from.
         /// @param [in] offset Offset in the buffer.
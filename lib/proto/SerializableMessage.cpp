@@ -27,6 +27,11 @@ void SerializableMessage::clearOrgBuffer()
     _orgBuf.clear();
 }
 
+bool SerializableMessage::isInstanceOf ( const uint8_t * /*typeTag*/ ) const
+{
+    return false;
+}
+
 ProtoError SerializableMessage::deserialize (
         const MemHandle & buf, size_t offset, size_t dataSize, ExtProtoError * extError )
 {
@@ -43,6 +48,46 @@ ProtoError SerializableMessage::deserialize (
     return ret;
 }
 
+ProtoError SerializableMessage::deserializeFields (
+        const MemHandle & buf, size_t offset, size_t dataSize, FieldFilter filter )
+{
+    assert ( filter != 0 );
+
+    clear();
+
+    const size_t bufSize = offset + dataSize;
+
+    if ( bufSize > buf.size() )
+        return ProtoError::IncompleteData;
+
+    while ( offset < bufSize )
+    {
+        uint8_t wireType = 0;
+        uint32_t fieldId = 0;
+        size_t fieldSize = 0;
+
+        ProtoError eCode = ProtocolCodec::readFieldHeader ( buf.get(), bufSize, offset, wireType, fieldId, fieldSize );
+
+        if ( NOT_OK ( eCode ) )
+            return eCode;
+
+        if ( filter ( fieldId ) )
+        {
+            eCode = deserializeField ( fieldId, wireType, buf, offset, fieldSize, 0 );
+
+            if ( NOT_OK ( eCode ) )
+                return eCode;
+        }
+
+        offset += fieldSize;
+
+        if ( offset > bufSize )
+            return ProtoError::InternalError;
+    }
+
+    return ProtoError::Success;
+}
+
 ProtoError SerializableMessage::deserializeFromBase ( const SerializableMessage & other, ExtProtoError * extError )
 {
     return deserialize ( other.getOrgBuffer(), 0, other.getOrgBuffer().size(), extError );
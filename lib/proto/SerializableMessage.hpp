@@ -28,6 +28,10 @@ namespace Pravala
 class SerializableMessage: public Serializable
 {
     public:
+        /// @brief The type of the function that selects the fields to deserialize (see deserializeFields()).
+        /// It takes the ID of the field, and returns true if that field should be deserialized.
+        typedef bool (* FieldFilter)( uint32_t fieldId );
+
         /// @brief Returns the original data buffer from which this object was deserialized
         /// @return the original data buffer from which this object was deserialized
         inline const MemHandle & getOrgBuffer() const
@@ -44,6 +48,47 @@ class SerializableMessage: public Serializable
 
         using Serializable::deserialize;
 
+        /// @brief Deserializes only the selected fields.
+        ///
+        /// Other fields are skipped (only their headers are read), so it is much cheaper than deserialize().
+        /// It is meant for peeking at the fields needed to decide how to deserialize the data
+        /// (like those checked by 'defines' of inheriting messages).
+        /// The object is NOT validated, and it doesn't keep a reference to the original buffer,
+        /// so it should not be used as a regular, deserialized message.
+        ///
+        /// @param [in] buf The buffer to deserialize the data from.
+        /// @param [in] offset Offset in the buffer.
+        /// @param [in] dataSize The size of data (starting at given offset).
+        /// @param [in] filter The function that selects the fields to deserialize.
+        /// @return The error code
+        ProtoError deserializeFields ( const MemHandle & buf, size_t offset, size_t dataSize, FieldFilter filter );
+
+        /// @brief Checks whether this object is an instance of the given message type (or a type that inherits it).
+        /// It is implemented by generated messages.
+        /// @param [in] typeTag The address of the TYPE_TAG member of the message type to check.
+        /// @return True if this object is an instance of the given message type; False otherwise.
+        virtual bool isInstanceOf ( const uint8_t * typeTag ) const;
+
+        /// @brief Returns this object cast to the given message type.
+        /// It doesn't deserialize anything, it only works if this object already is an instance of that type
+        /// (for example when it was created by MessageTypeRegistry).
+        /// @tparam T The message type to cast to.
+        /// @return This object cast to the given message type, or 0 if it is not an instance of that type.
+        template<typename T> inline T * castTo()
+        {
+            return isInstanceOf ( &T::TYPE_TAG ) ? static_cast<T *> ( this ) : 0;
+        }
+
+        /// @brief Returns this object cast to the given message type.
+        /// It doesn't deserialize anything, it only works if this object already is an instance of that type
+        /// (for example when it was created by MessageTypeRegistry).
+        /// @tparam T The message type to cast to.
+        /// @return This object cast to the given message type, or 0 if it is not an instance of that type.
+        template<typename T> inline const T * castTo() const
+        {
+            return isInstanceOf ( &T::TYPE_TAG ) ? static_cast<const T *> ( this ) : 0;
+        }
+
     protected:
         // @brief Deserializes using 'original buffer' stored in another object.
         ///
@@ -60,9 +105,11 @@ class SerializableMessage: public Serializable
         ProtoError deserializeFromBase ( const SerializableMessage & other, ExtProtoError * extError = 0 );
 
         /// @brief Should be called whenever the message object is modified.
+        /// It clears the original buffer and the cached serialized size.
         inline void messageModified()
         {
             clearOrgBuffer();
+            clearSerializedSize();
         }
 
     private:
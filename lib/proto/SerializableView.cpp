@@ -0,0 +1,173 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#include "Serializable.hpp"
+#include "SerializableView.hpp"
+
+using namespace Pravala;
+
+SerializableView::SerializableView(): _isIndexed ( false )
+{
+}
+
+SerializableView::SerializableView ( const MemHandle & data ): _data ( data ), _isIndexed ( false )
+{
+}
+
+void SerializableView::setData ( const MemHandle & data )
+{
+    _data = data;
+    _fields.clear();
+    _isIndexed = false;
+}
+
+void SerializableView::clear()
+{
+    setData ( MemHandle() );
+}
+
+ProtoError SerializableView::setDataWithLength ( const MemHandle & buf, size_t & offset, size_t * missingBytes )
+{
+    size_t intOffset = offset;
+    size_t payloadSize = 0;
+
+    const ProtoError ret = Serializable::readLengthHeader ( buf, intOffset, payloadSize, missingBytes );
+
+    if ( NOT_OK ( ret ) )
+    {
+        return ret;
+    }
+
+    setData ( buf.getHandle ( intOffset, payloadSize ) );
+
+    offset = intOffset + payloadSize;
+
+    return ProtoError::Success;
+}
+
+ProtoError SerializableView::indexFields()
+{
+    if ( _isIndexed )
+    {
+        return _indexResult;
+    }
+
+    _isIndexed = true;
+    _indexResult = ProtoError::Success;
+
+    const size_t dataSize = _data.size();
+    size_t offset = 0;
+
+    while ( offset < dataSize )
+    {
+        Field field;
+
+        const ProtoError eCode = ProtocolCodec::readFieldHeader (
+            _data.get(), dataSize, offset, field.wireType, field.fieldId, field.size );
+
+        if ( NOT_OK ( eCode ) )
+        {
+            // The data is malformed. We don't want to expose only some of the fields.
+            _fields.clear();
+            _indexResult = eCode;
+
+            return _indexResult;
+        }
+
+        field.offset = offset;
+        offset += field.size;
+
+        _fields.append ( field );
+    }
+
+    return _indexResult;
+}
+
+const SerializableView::Field * SerializableView::findField ( uint32_t fieldId, size_t index )
+{
+    indexFields();
+
+    for ( size_t i = 0; i < _fields.size(); ++i )
+    {
+        if ( _fields[ i ].fieldId == fieldId )
+        {
+            if ( index == 0 )
+                return &_fields[ i ];
+
+            --index;
+        }
+    }
+
+    return 0;
+}
+
+bool SerializableView::hasField ( uint32_t fieldId )
+{
+    return ( findField ( fieldId, 0 ) != 0 );
+}
+
+size_t SerializableView::getFieldCount ( uint32_t fieldId )
+{
+    indexFields();
+
+    size_t count = 0;
+
+    for ( size_t i = 0; i < _fields.size(); ++i )
+    {
+        if ( _fields[ i ].fieldId == fieldId )
+        {
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+MemHandle SerializableView::getFieldData ( uint32_t fieldId, size_t index )
+{
+    const Field * const field = findField ( fieldId, index );
+
+    if ( !field || field->size < 1 )
+        return MemHandle();
+
+    return _data.getHandle ( field->offset, field->size );
+}
+
+ProtoError SerializableView::getFieldView ( uint32_t fieldId, size_t index, SerializableView & view )
+{
+    const Field * const field = findField ( fieldId, index );
+
+    if ( !field )
+    {
+        view.clear();
+
+        return ProtoError::RequiredFieldNotSet;
+    }
+
+    // Nested objects cannot use variable length encoding (just like in deserializeField()).
+    if ( field->wireType == ProtocolCodec::WireTypeVariableLengthA
+         || field->wireType == ProtocolCodec::WireTypeVariableLengthB )
+    {
+        view.clear();
+
+        return ProtoError::ProtocolError;
+    }
+
+    view.setData ( ( field->size > 0 ) ? _data.getHandle ( field->offset, field->size ) : MemHandle() );
+
+    return ProtoError::Success;
+}
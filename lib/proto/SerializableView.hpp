@@ -0,0 +1,166 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#pragma once
+
+#include "basic/MemHandle.hpp"
+#include "basic/SimpleArray.hpp"
+
+#include "ProtoError.hpp"
+#include "ProtocolCodec.hpp"
+
+namespace Pravala
+{
+/// @brief A lazy, read-only view of a serialized object.
+///
+/// Unlike deserialize(), which decodes all the fields (and copies all the strings), a view only keeps a reference
+/// to the serialized data. That data is indexed the first time any of the fields is accessed,
+/// and each field is decoded only when it is accessed. String fields are exposed as MemHandle objects
+/// that point to the original data, and views of nested objects use the same memory as well.
+///
+/// Typed views (the 'View' class in each message and structure) are generated by protoGen
+/// when '--enable-lazy-view' option is used.
+///
+/// Views do not validate the data (required fields, defines, value ranges, etc.). They are meant for inspecting,
+/// routing and forwarding serialized objects. To actually use the object, it should be deserialized.
+class SerializableView
+{
+    public:
+        /// @brief Default constructor.
+        /// It creates an empty view.
+        SerializableView();
+
+        /// @brief Constructor.
+        /// @param [in] data The serialized object (without the length header).
+        explicit SerializableView ( const MemHandle & data );
+
+        /// @brief Sets the serialized data this view uses.
+        /// @param [in] data The serialized object (without the length header).
+        void setData ( const MemHandle & data );
+
+        /// @brief Sets the serialized data this view uses, based on the data that includes the length header.
+        ///
+        /// It only reads the length header, the payload itself is not parsed (or validated) at this point.
+        ///
+        /// @param [in] buf The buffer with the data.
+        /// @param [in,out] offset Offset in the buffer to start from.
+        ///                         It is modified (to point right after the payload) only on success.
+        /// @param [out] missingBytes If used, the number of missing bytes is placed there.
+        ///                            It is only set when 'Error::IncompleteData' is returned.
+        /// @return The error code
+        ProtoError setDataWithLength ( const MemHandle & buf, size_t & offset, size_t * missingBytes = 0 );
+
+        /// @brief Returns the serialized data this view uses.
+        /// It can be used for forwarding the object without deserializing it.
+        /// @return The serialized data this view uses (without the length header).
+        inline const MemHandle & getData() const
+        {
+            return _data;
+        }
+
+        /// @brief Clears the view.
+        void clear();
+
+        /// @brief Indexes all the fields in the data.
+        ///
+        /// It is called automatically the first time any of the fields is accessed.
+        /// It only reads the headers of the fields, and doesn't decode the values.
+        /// If the data is malformed, none of the fields will be accessible.
+        ///
+        /// @return The error code; It will be the same every time this function is called
+        ///         (until the data is changed).
+        ProtoError indexFields();
+
+        /// @brief Checks whether the given field is present in the data.
+        /// @param [in] fieldId The ID of the field.
+        /// @return True if the field is present (at least once); False otherwise.
+        bool hasField ( uint32_t fieldId );
+
+        /// @brief Returns the number of times the given field is present in the data.
+        /// This is useful for 'repeated' fields.
+        /// @param [in] fieldId The ID of the field.
+        /// @return The number of times the given field is present in the data.
+        size_t getFieldCount ( uint32_t fieldId );
+
+        /// @brief Returns the raw data of the given field.
+        /// @param [in] fieldId The ID of the field.
+        /// @param [in] index The index of the field (for repeated fields).
+        /// @return The raw data of the field (without its header), pointing to the original memory.
+        ///         It is empty if the field is not present (or if it is present but empty).
+        MemHandle getFieldData ( uint32_t fieldId, size_t index = 0 );
+
+    protected:
+        /// @brief Decodes the value of the given field.
+        /// @param [in] fieldId The ID of the field.
+        /// @param [in] index The index of the field (for repeated fields).
+        /// @param [out] value The value to decode the data into.
+        /// @return The error code; RequiredFieldNotSet if the field is not present.
+        template<typename T> ProtoError decodeField ( uint32_t fieldId, size_t index, T & value )
+        {
+            const Field * const field = findField ( fieldId, index );
+
+            if ( !field )
+                return ProtoError::RequiredFieldNotSet;
+
+            return ProtocolCodec::decode ( _data.get ( field->offset ), field->size, field->wireType, value );
+        }
+
+        /// @brief Decodes the value of the given enum field.
+        /// @param [in] fieldId The ID of the field.
+        /// @param [in] index The index of the field (for repeated fields).
+        /// @param [out] value The enum value to decode the data into.
+        /// @return The error code; RequiredFieldNotSet if the field is not present.
+        template<typename T> ProtoError decodeEnumField ( uint32_t fieldId, size_t index, T & value )
+        {
+            const Field * const field = findField ( fieldId, index );
+
+            if ( !field )
+                return ProtoError::RequiredFieldNotSet;
+
+            return value.deserializeEnum ( _data, field->offset, field->size, field->wireType );
+        }
+
+        /// @brief Sets up a view of the given field, which should be a nested message or structure.
+        /// @param [in] fieldId The ID of the field.
+        /// @param [in] index The index of the field (for repeated fields).
+        /// @param [out] view The view to set up. It will use the same memory as this one.
+        /// @return The error code; RequiredFieldNotSet if the field is not present.
+        ProtoError getFieldView ( uint32_t fieldId, size_t index, SerializableView & view );
+
+    private:
+        /// @brief A single field in the data.
+        struct Field
+        {
+            size_t offset; ///< The offset of the field's payload in the data.
+            size_t size; ///< The size of the field's payload.
+            uint32_t fieldId; ///< The ID of the field.
+            uint8_t wireType; ///< The wire type of the field.
+        };
+
+        MemHandle _data; ///< The serialized data.
+        SimpleArray<Field> _fields; ///< All the fields in the data, in the order they were serialized.
+        ProtoError _indexResult; ///< The result of indexing the data.
+        bool _isIndexed; ///< Whether the data has been indexed already.
+
+        /// @brief Finds the given field.
+        /// It indexes the data if needed.
+        /// @param [in] fieldId The ID of the field.
+        /// @param [in] index The index of the field (for repeated fields).
+        /// @return A pointer to the field, or 0 if it was not found.
+        const Field * findField ( uint32_t fieldId, size_t index );
+};
+}
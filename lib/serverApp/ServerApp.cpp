@@ -34,6 +34,15 @@ ConfigAddrSpec ServerApp::optPrometheusServer (
         "The address to listen on for Prometheus requests"
 );
 
+ConfigLimitedNumber<uint16_t> ServerApp::optReactors (
+        ConfigOpt::FlagInitializeOnly,
+        "reactors",
+        0,
+        "server.reactors",
+        "The number of additional event loop threads to run; Used only by servers that support them",
+        0, 1024, 0
+);
+
 ServerApp::ServerApp ( int argc, char * argv[], uint32_t features, const char * additionalHelpText ):
     StdApp ( argc, argv, features, additionalHelpText )
 {
@@ -41,6 +50,88 @@ ServerApp::ServerApp ( int argc, char * argv[], uint32_t features, const char *
 
 ServerApp::~ServerApp()
 {
+    if ( _reactors.size() > 0 )
+    {
+        // The subclass has already been destroyed, but its reactors could still be running its code.
+        fprintf ( stderr, "ServerApp is being destroyed with %u reactor(s) still running; "
+                  "stopReactors() should be called before destroying the subclass\n",
+                  ( unsigned ) _reactors.size() );
+
+        assert ( false );
+
+        stopReactors();
+    }
+}
+
+ERRCODE ServerApp::reactorStarted ( ServerReactor & )
+{
+    return Error::Success;
+}
+
+void ServerApp::reactorStopping ( ServerReactor & )
+{
+}
+
+ERRCODE ServerApp::startReactors ( uint16_t numReactors )
+{
+    if ( _reactors.size() > 0 )
+    {
+        return Error::AlreadyInitialized;
+    }
+
+    for ( uint16_t i = 0; i < numReactors; ++i )
+    {
+        ServerReactor * const reactor = new ServerReactor ( *this, i );
+
+        _reactors.append ( reactor );
+
+        const ERRCODE eCode = reactor->start();
+
+        if ( NOT_OK ( eCode ) )
+        {
+            fprintf ( stderr, "Could not start reactor %u: %s\n", i, eCode.toString() );
+
+            stopReactors();
+            return eCode;
+        }
+    }
+
+    return Error::Success;
+}
+
+void ServerApp::stopReactors()
+{
+    // First, let's tell all of them to stop, so they can do that at the same time.
+    // Destructors will then wait for their threads to exit.
+
+    for ( size_t i = 0; i < _reactors.size(); ++i )
+    {
+        _reactors[ i ]->requestStop();
+    }
+
+    for ( size_t i = 0; i < _reactors.size(); ++i )
+    {
+        delete _reactors[ i ];
+    }
+
+    _reactors.clear();
+}
+
+ERRCODE ServerApp::runReactorTask ( uint16_t index, AsyncQueue::Task * task, AsyncQueue::DeletePolicy deletePolicy )
+{
+    ServerReactor * const reactor = getReactor ( index );
+
+    if ( !reactor )
+    {
+        if ( task != 0 )
+        {
+            task->deleteOnError ( deletePolicy );
+        }
+
+        return Error::NotFound;
+    }
+
+    return reactor->runTask ( task, deletePolicy );
 }
 
 int ServerApp::initFeatures ( bool exitOnError )
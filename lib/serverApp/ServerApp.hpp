@@ -17,17 +17,29 @@
 #pragma once
 
 #include "app/StdApp.hpp"
+#include "basic/SimpleArray.hpp"
 #include "config/ConfigAddrSpec.hpp"
+#include "config/ConfigNumber.hpp"
 #include "http/SimpleHttpServer.hpp"
 #include "prometheus/PrometheusServer.hpp"
 
+#include "ServerReactor.hpp"
+
 namespace Pravala
 {
 /// @brief A wrapper around StdApp that adds server-specific features.
-/// At the moment it adds support for Prometheus and HTTP liveness probe (as used by Kubernetes) servers.
+/// It adds support for Prometheus and HTTP liveness probe (as used by Kubernetes) servers.
+/// It can also run additional event loops ("reactors"), each in its own thread (see ServerReactor).
+/// Applications that want to use them should inherit this class, create their per-reactor objects
+/// in reactorStarted() and destroy them in reactorStopping(), call startReactors() after init(),
+/// and stopReactors() before they are destroyed.
+/// Built-in servers, signal handling and config reloads stay on the main thread.
 class ServerApp: public StdApp
 {
     public:
+        /// @brief The number of reactors to run (in addition to the main thread's event loop).
+        static ConfigLimitedNumber<uint16_t> optReactors;
+
         /// @brief Configures built-in HTTP liveness probe server (used by Kubernetes).
         static ConfigAddrSpec optHttpLivenessServer;
 
@@ -61,10 +73,79 @@ class ServerApp: public StdApp
             return _prometheusServer;
         }
 
+        /// @brief Returns the number of reactors.
+        /// @return The number of reactors.
+        inline uint16_t getNumReactors() const
+        {
+            return ( uint16_t ) _reactors.size();
+        }
+
+        /// @brief Returns a reactor with given index.
+        /// @param [in] index The index of the reactor.
+        /// @return The reactor with given index; 0 if it doesn't exist.
+        inline ServerReactor * getReactor ( uint16_t index )
+        {
+            return ( index < _reactors.size() ) ? _reactors[ index ] : 0;
+        }
+
+        /// @brief Schedules the task to be run on a specific reactor's thread without blocking.
+        /// It can be called from any thread.
+        /// @param [in] index The index of the reactor.
+        /// @param [in] task A pointer to the task to run on the reactor's thread. It should be allocated on the heap.
+        /// @param [in] deletePolicy Policy for deleting tasks passed to the queue.
+        ///                          Tasks that are passed to the reactor successfully are always deleted.
+        /// @return Standard error code; NotFound if there is no reactor with that index,
+        ///         otherwise the result of ServerReactor::runTask().
+        ERRCODE runReactorTask (
+            uint16_t index, AsyncQueue::Task * task,
+            AsyncQueue::DeletePolicy deletePolicy = AsyncQueue::DeleteOnError );
+
+        /// @brief Starts the number of reactors configured using optReactors.
+        /// @return Standard error code.
+        inline ERRCODE startReactors()
+        {
+            return startReactors ( optReactors.value() );
+        }
+
+        /// @brief Starts reactors.
+        /// It blocks until all of them are running. If any of them fails to start, all of them are stopped.
+        /// It should be called on the main thread, after init().
+        /// @param [in] numReactors The number of reactors to start. 0 is allowed (and doesn't do anything).
+        /// @return Standard error code; AlreadyInitialized if the reactors have already been started.
+        ERRCODE startReactors ( uint16_t numReactors );
+
+        /// @brief Stops all reactors and waits for their threads to exit.
+        /// It should be called on the main thread.
+        /// @note Subclasses that start reactors MUST call it before they are destroyed (at the latest
+        ///       in their destructors). By the time ServerApp's destructor runs, the subclass is gone,
+        ///       so reactors still running at that point are a bug (and they are stopped without
+        ///       calling reactorStopping() of the subclass).
+        void stopReactors();
+
         virtual int initFeatures ( bool exitOnError = true );
 
     protected:
         SimpleHttpServer _httpLivenessServer; ///< Built-in HTTP liveness probe server (used by Kubernetes).
         PrometheusServer _prometheusServer;   ///< Built-in Prometheus server.
+
+        /// @brief Called on the reactor's thread, after it is initialized, but before it starts its event loop.
+        /// At this point the reactor's EventManager, AsyncQueue and PacketDataStore thread cache are initialized.
+        /// This is where the reactor's listeners (and other objects) should be created.
+        /// Default implementation doesn't do anything.
+        /// @param [in] reactor The reactor that is starting.
+        /// @return Standard error code; If an error is returned, the reactor (and all others) will be stopped.
+        virtual ERRCODE reactorStarted ( ServerReactor & reactor );
+
+        /// @brief Called on the reactor's thread, after its event loop ends (also if reactorStarted() failed).
+        /// This is where objects created by reactorStarted() should be destroyed.
+        /// At this point the reactor no longer accepts new tasks.
+        /// Default implementation doesn't do anything.
+        /// @param [in] reactor The reactor that is stopping.
+        virtual void reactorStopping ( ServerReactor & reactor );
+
+    private:
+        SimpleArray<ServerReactor *> _reactors; ///< The reactors.
+
+        friend class ServerReactor;
 };
 }
@@ -0,0 +1,307 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+extern "C"
+{
+#include <fcntl.h>
+#include <unistd.h>
+}
+
+#include "socket/PacketDataStore.hpp"
+
+#include "ServerApp.hpp"
+#include "ServerReactor.hpp"
+
+using namespace Pravala;
+
+ServerReactor::ServerReactor ( ServerApp & app, uint16_t index ):
+    _app ( app ),
+    _index ( index ),
+    _hasThread ( false ),
+    _queue ( 0 ),
+    _state ( StateStopped ),
+    _numPosters ( 0 )
+{
+    memset ( &_thread, 0, sizeof ( _thread ) );
+
+    _stopFds[ 0 ] = _stopFds[ 1 ] = -1;
+
+    pthread_mutex_init ( &_mutex, 0 );
+    pthread_cond_init ( &_cond, 0 );
+}
+
+ServerReactor::~ServerReactor()
+{
+    stop();
+
+    assert ( !_queue );
+
+    pthread_cond_destroy ( &_cond );
+    pthread_mutex_destroy ( &_mutex );
+}
+
+ERRCODE ServerReactor::start()
+{
+    if ( _hasThread )
+    {
+        return Error::AlreadyInitialized;
+    }
+
+    if ( pipe ( _stopFds ) != 0 )
+    {
+        fprintf ( stderr, "Error creating a stop pipe for reactor %u: %s\n", _index, strerror ( errno ) );
+
+        _stopFds[ 0 ] = _stopFds[ 1 ] = -1;
+        return Error::PipeFailed;
+    }
+
+    for ( int i = 0; i < 2; ++i )
+    {
+        fcntl ( _stopFds[ i ], F_SETFL, fcntl ( _stopFds[ i ], F_GETFL ) | O_NONBLOCK );
+        fcntl ( _stopFds[ i ], F_SETFD, FD_CLOEXEC );
+    }
+
+    _startResult = Error::Success;
+    _state = StateStarting;
+
+    const int ret = pthread_create ( &_thread, 0, threadMain, this );
+
+    if ( ret != 0 )
+    {
+        fprintf ( stderr, "Error creating a thread for reactor %u: %s\n", _index, strerror ( ret ) );
+
+        _state = StateStopped;
+        closeStopFds();
+
+        return Error::InternalError;
+    }
+
+    _hasThread = true;
+
+    pthread_mutex_lock ( &_mutex );
+
+    while ( _state == StateStarting )
+    {
+        pthread_cond_wait ( &_cond, &_mutex );
+    }
+
+    // The reactor's thread sets _startResult before leaving StateStarting (with the mutex locked).
+    const ERRCODE eCode = _startResult;
+
+    pthread_mutex_unlock ( &_mutex );
+
+    return eCode;
+}
+
+void ServerReactor::requestStop()
+{
+    // The write end is non-blocking. If the pipe is full, the reactor has plenty of reasons to stop already.
+    // If the reactor is not running, there is nobody to read it, which is fine.
+    if ( _stopFds[ 1 ] >= 0 )
+    {
+        const char c = 0;
+
+        if ( write ( _stopFds[ 1 ], &c, 1 ) < 0 && errno != EAGAIN && errno != EWOULDBLOCK )
+        {
+            fprintf ( stderr, "Error requesting reactor %u to stop: %s\n", _index, strerror ( errno ) );
+        }
+    }
+}
+
+void ServerReactor::stop()
+{
+    if ( !_hasThread )
+    {
+        return;
+    }
+
+    requestStop();
+
+    pthread_join ( _thread, 0 );
+
+    _hasThread = false;
+
+    assert ( _state == StateStopped );
+
+    closeStopFds();
+}
+
+void ServerReactor::closeStopFds()
+{
+    for ( int i = 0; i < 2; ++i )
+    {
+        if ( _stopFds[ i ] >= 0 )
+        {
+            ::close ( _stopFds[ i ] );
+            _stopFds[ i ] = -1;
+        }
+    }
+}
+
+void ServerReactor::setState ( State state )
+{
+    pthread_mutex_lock ( &_mutex );
+
+    _state = state;
+
+    pthread_cond_broadcast ( &_cond );
+    pthread_mutex_unlock ( &_mutex );
+}
+
+void ServerReactor::receiveFdEvent ( int fd, short /*events*/ )
+{
+    assert ( fd == _stopFds[ 0 ] );
+
+    char buf[ 16 ];
+
+    while ( read ( fd, buf, sizeof ( buf ) ) > 0 )
+    {
+    }
+
+    EventManager::stop();
+}
+
+ERRCODE ServerReactor::runTask ( AsyncQueue::Task * task, AsyncQueue::DeletePolicy deletePolicy )
+{
+    if ( !task )
+    {
+        return Error::InvalidParameter;
+    }
+
+    // The reactor's thread waits for all threads to leave this function before destroying its queue.
+    // The counter is updated before checking the state, and the reactor's thread updates the state
+    // before checking the counter, so at least one of us will notice the other.
+
+    __sync_add_and_fetch ( &_numPosters, 1 );
+
+    ERRCODE eCode;
+
+    if ( _state == StateRunning )
+    {
+        assert ( _queue != 0 );
+
+        eCode = _queue->runTask ( task, deletePolicy );
+    }
+    else
+    {
+        task->deleteOnError ( deletePolicy );
+
+        eCode = Error::Closed;
+    }
+
+    if ( __sync_sub_and_fetch ( &_numPosters, 1 ) == 0 && _state != StateRunning )
+    {
+        // The reactor's thread may be waiting for us.
+        pthread_mutex_lock ( &_mutex );
+        pthread_cond_broadcast ( &_cond );
+        pthread_mutex_unlock ( &_mutex );
+    }
+
+    return eCode;
+}
+
+void * ServerReactor::threadMain ( void * arg )
+{
+    assert ( arg != 0 );
+
+    ( ( ServerReactor * ) arg )->run();
+
+    return 0;
+}
+
+void ServerReactor::run()
+{
+    assert ( _state == StateStarting );
+    assert ( !_queue );
+
+    ERRCODE eCode = EventManager::init();
+
+    if ( NOT_OK ( eCode ) )
+    {
+        fprintf ( stderr, "Error initializing EventManager of reactor %u: %s\n", _index, eCode.toString() );
+
+        _startResult = eCode;
+        setState ( StateStopped );
+
+        return;
+    }
+
+    EventManager::setFdHandler ( _stopFds[ 0 ], this, EventManager::EventRead );
+
+    PacketDataStore::enableThreadCache();
+
+    _queue = new AsyncQueue();
+
+    eCode = _app.reactorStarted ( *this );
+
+    _startResult = eCode;
+
+    if ( IS_OK ( eCode ) )
+    {
+        setState ( StateRunning );
+
+        EventManager::run();
+    }
+    else
+    {
+        fprintf ( stderr, "Error starting reactor %u: %s\n", _index, eCode.toString() );
+    }
+
+    // Stop accepting tasks, and wait for the threads that could be adding them right now.
+    // If we failed to start, this also wakes up start().
+    setState ( StateStopping );
+
+    __sync_synchronize();
+
+    pthread_mutex_lock ( &_mutex );
+
+    while ( _numPosters > 0 )
+    {
+        pthread_cond_wait ( &_cond, &_mutex );
+    }
+
+    pthread_mutex_unlock ( &_mutex );
+
+    _app.reactorStopping ( *this );
+
+    delete _queue;
+    _queue = 0;
+
+    PacketDataStore::disableThreadCache();
+
+    // The descriptors are closed by stop(), on the thread that created them.
+    EventManager::removeFdHandler ( _stopFds[ 0 ] );
+
+#ifndef NDEBUG
+    eCode = EventManager::shutdown ( false );
+
+    if ( NOT_OK ( eCode ) )
+    {
+        fprintf ( stderr, "Error shutting down EventManager of reactor %u: %s; Forcing it...\n",
+                  _index, eCode.toString() );
+
+        EventManager::shutdown ( true );
+    }
+#else
+    EventManager::shutdown ( true );
+#endif
+
+    setState ( StateStopped );
+}
@@ -0,0 +1,169 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#pragma once
+
+extern "C"
+{
+#include <pthread.h>
+}
+
+#include "basic/NoCopy.hpp"
+#include "event/AsyncQueue.hpp"
+#include "event/EventManager.hpp"
+
+namespace Pravala
+{
+class ServerApp;
+
+/// @brief An event loop ("reactor") that runs in its own thread.
+/// Each reactor runs its own EventManager and AsyncQueue, and uses its own PacketDataStore thread cache.
+/// Reactors are created and controlled by the ServerApp (see ServerApp::startReactors()).
+/// Objects used by a reactor (sockets, timers, etc.) should be created, used and destroyed on that reactor's thread.
+/// To spread the load between reactors, each of them should create its own listeners, bound to the same address.
+/// TcpServer always sets SO_REUSEPORT, and UdpFdListener sets it when requested, in which case the kernel
+/// distributes new connections and packets between the reactors.
+/// @note Objects running on reactors can use text log streams. Their messages are passed to outputs that can only
+///       be used by the main thread (like CtrlLink) through the global AsyncQueue (see TextLog::send()).
+///       Every message logged takes a process-wide lock, so reactors should not log on their fast paths.
+///       Binary logs (BinLog) can only be used by the main thread.
+class ServerReactor: public NoCopy, protected EventManager::FdEventHandler
+{
+    public:
+        /// @brief Returns the index of this reactor.
+        /// @return The index of this reactor (0 to the number of reactors - 1).
+        inline uint16_t getIndex() const
+        {
+            return _index;
+        }
+
+        /// @brief Checks whether this reactor is running and accepting tasks.
+        /// @return True if this reactor is running and accepting tasks; False otherwise.
+        inline bool isRunning() const
+        {
+            return ( _state == StateRunning );
+        }
+
+        /// @brief Exposes this reactor's AsyncQueue.
+        /// It should only be used on this reactor's thread (for example to register task receivers).
+        /// Other threads should use runTask().
+        /// @return This reactor's AsyncQueue; 0 if this reactor is not running.
+        inline AsyncQueue * getQueue()
+        {
+            return _queue;
+        }
+
+        /// @brief Schedules the task to be run on this reactor's thread without blocking.
+        /// It can be called from any thread (including this reactor's thread).
+        /// @param [in] task A pointer to the task to run on the reactor's thread. It should be allocated on the heap.
+        /// @param [in] deletePolicy Policy for deleting tasks passed to the queue.
+        ///                          Tasks that are passed to the reactor successfully are always deleted.
+        /// @note It must not be called once the reactor is being destroyed (see ServerApp::stopReactors()).
+        /// @return Standard error code; Closed if the reactor is not running, otherwise the result
+        ///         of AsyncQueue::runTask().
+        ERRCODE runTask (
+            AsyncQueue::Task * task,
+            AsyncQueue::DeletePolicy deletePolicy = AsyncQueue::DeleteOnError );
+
+    protected:
+        virtual void receiveFdEvent ( int fd, short events );
+
+    private:
+        /// @brief The state of the reactor.
+        enum State
+        {
+            StateStopped,  ///< The reactor's thread is not running.
+            StateStarting, ///< The reactor's thread has been started, but it is not running the event loop yet.
+            StateRunning,  ///< The reactor is running the event loop and accepts tasks.
+            StateStopping  ///< The reactor's event loop has ended, and its thread is about to exit.
+        };
+
+        ServerApp & _app; ///< The application that owns this reactor.
+        const uint16_t _index; ///< The index of this reactor.
+
+        pthread_t _thread; ///< The reactor's thread.
+        bool _hasThread; ///< Whether the reactor's thread has been created (and not joined yet).
+
+        /// @brief The reactor's task queue.
+        /// It is created and destroyed by the reactor's thread, and only exists while the reactor is running.
+        AsyncQueue * _queue;
+
+        /// @brief The result of starting the reactor.
+        /// It is set by the reactor's thread, before it leaves StateStarting.
+        ERRCODE _startResult;
+
+        /// @brief The state of the reactor.
+        /// It is only modified with _mutex locked (and _cond is signalled every time it changes).
+        volatile State _state;
+
+        /// @brief The number of threads that are currently in runTask().
+        /// The reactor's thread waits for them to leave that function before destroying its queue.
+        /// Modified atomically.
+        volatile uint32_t _numPosters;
+
+        /// @brief Protects _state changes, and is used together with _cond.
+        pthread_mutex_t _mutex;
+
+        /// @brief Signalled when _state changes, and when the last thread leaves runTask() after the reactor
+        /// stopped accepting tasks.
+        pthread_cond_t _cond;
+
+        /// @brief The pipe used for stopping the reactor's event loop. [0] is read by the reactor's thread.
+        /// Both descriptors are created and closed by the thread that starts and stops the reactor.
+        int _stopFds[ 2 ];
+
+        /// @brief Constructor.
+        /// @param [in] app The application that owns this reactor.
+        /// @param [in] index The index of this reactor.
+        ServerReactor ( ServerApp & app, uint16_t index );
+
+        /// @brief Destructor.
+        /// It stops the reactor (if it is running).
+        ~ServerReactor();
+
+        /// @brief Starts the reactor's thread.
+        /// It blocks until the reactor is fully initialized (or it fails to initialize).
+        /// @return Standard error code. If the reactor failed to start, its thread still needs to be stopped.
+        ERRCODE start();
+
+        /// @brief Tells the reactor's event loop to stop, without waiting for it.
+        /// It is safe to call it if the reactor is not running (or is still starting).
+        /// It never blocks, and it doesn't depend on the reactor's task queue having room.
+        void requestStop();
+
+        /// @brief Stops the reactor's event loop, and waits for its thread to exit.
+        /// It is safe to call it if the reactor is not running.
+        /// It must not be called on the reactor's thread.
+        void stop();
+
+        /// @brief Closes both ends of the stop pipe.
+        void closeStopFds();
+
+        /// @brief Changes the state of the reactor, and wakes up the threads waiting for that.
+        /// @param [in] state The new state.
+        void setState ( State state );
+
+        /// @brief Runs the reactor. This is the body of the reactor's thread.
+        void run();
+
+        /// @brief The function that runs in the reactor's thread.
+        /// @param [in] arg A pointer to the ServerReactor to run.
+        /// @return Always 0.
+        static void * threadMain ( void * arg );
+
+        friend class ServerApp;
+};
+}
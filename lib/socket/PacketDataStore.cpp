@@ -14,9 +14,11 @@
  *  limitations under the License.
  */
 
+#include <cassert>
 #include <cstdlib>
 
 #include "basic/Math.hpp"
+#include "basic/Thread.hpp"
 
 #include "PacketMemPool.hpp"
 #include "PacketDataStore.hpp"
@@ -64,20 +66,40 @@ ConfigNumber<bool> PacketDataStore::optForcePacketOptimization
         false
 );
 
+ConfigLimitedNumber<uint16_t> PacketDataStore::optThreadCacheSize
+(
+        0,
+        "os.packet_store.thread_cache_size",
+        "The number of blocks moved between per-thread caches and the packet data store at once. "
+        "Each thread that uses caches holds up to twice as many blocks of each size. "
+        "If 0, per-thread caches will not be used.",
+        0, 4096, 32
+);
+
 Mutex PacketDataStore::_stMutex ( "PacketDataStore" );
 PacketMemPool * PacketDataStore::_mainPool ( 0 );
 PacketMemPool * PacketDataStore::_smallPool ( 0 );
 size_t PacketDataStore::_misses ( 0 );
+size_t PacketDataStore::_numThreadCaches ( 0 );
 
-MemHandle PacketDataStore::getPacket ( uint16_t reqSize )
-{
-    if ( reqSize < 1 )
-    {
-        reqSize = PacketSize;
-    }
+#ifndef THREAD_LOCAL_UNSUPPORTED
+/// @brief Set to true when the calling thread enabled its caches using PacketDataStore::enableThreadCache().
+static THREAD_LOCAL bool tlCacheEnabled ( false );
+#endif
 
-    _stMutex.lock();
+/// @brief Checks whether the calling thread enabled its caches using PacketDataStore::enableThreadCache().
+/// @return True if the calling thread uses data store's caches; False otherwise.
+static inline bool isThreadCacheEnabled()
+{
+#ifdef THREAD_LOCAL_UNSUPPORTED
+    return false;
+#else
+    return tlCacheEnabled;
+#endif
+}
 
+MemHandle PacketDataStore::getPooledPacket ( uint16_t reqSize )
+{
     if ( reqSize <= SmallPacketSize && _smallPool != 0 )
     {
         // 'false' to disable fallback, we still have the regular pool to try.
@@ -85,7 +107,6 @@ MemHandle PacketDataStore::getPacket ( uint16_t reqSize )
 
         if ( !ret.isEmpty() )
         {
-            _stMutex.unlock();
             return ret;
         }
     }
@@ -93,7 +114,40 @@ MemHandle PacketDataStore::getPacket ( uint16_t reqSize )
     if ( reqSize <= PacketSize && _mainPool != 0 )
     {
         // 'false' to disable fallback. We want to know when pool-ed allocation failed, to count it as a 'miss'.
-        MemHandle ret = _mainPool->getHandle ( false );
+        return _mainPool->getHandle ( false );
+    }
+
+    return MemHandle();
+}
+
+MemHandle PacketDataStore::getPacket ( uint16_t reqSize )
+{
+    if ( reqSize < 1 )
+    {
+        reqSize = PacketSize;
+    }
+
+    MemHandle ret;
+
+    if ( isThreadCacheEnabled() )
+    {
+        // The data store cannot be shut down while any thread uses its caches (shutdown() checks that).
+        // Pools themselves are thread-safe, so we don't need to lock anything here,
+        // which means that most of the time this thread will get its packet without any locking at all.
+        ret = getPooledPacket ( reqSize );
+
+        if ( !ret.isEmpty() )
+        {
+            return ret;
+        }
+
+        _stMutex.lock();
+    }
+    else
+    {
+        _stMutex.lock();
+
+        ret = getPooledPacket ( reqSize );
 
         if ( !ret.isEmpty() )
         {
@@ -203,6 +257,7 @@ void PacketDataStore::init()
         const uint32_t maxSlabs = min<uint32_t> ( optMaxMemorySize.value() * 4, PacketMaxSlabs );
 
         _mainPool = new PacketMemPool ( PacketSize, max ( 1U, numBlocks / maxSlabs ), maxSlabs );
+        _mainPool->setThreadCacheSize ( optThreadCacheSize.value() );
     }
 
     if ( !_smallPool && optMaxSmallMemorySize.value() > 0 )
@@ -226,6 +281,7 @@ void PacketDataStore::init()
         const uint32_t maxSlabs = min<uint32_t> ( 1 + optMaxSmallMemorySize.value() / 64, PacketMaxSlabs );
 
         _smallPool = new PacketMemPool ( SmallPacketSize, max ( 1U, numBlocks / maxSlabs ), maxSlabs );
+        _smallPool->setThreadCacheSize ( optThreadCacheSize.value() );
     }
 }
 
@@ -233,6 +289,10 @@ void PacketDataStore::shutdown()
 {
     MutexLock m ( _stMutex );
 
+    // Threads with caches enabled use the pools without locking the data store,
+    // so they all need to disable their caches before the data store can be shut down.
+    assert ( _numThreadCaches == 0 );
+
     if ( _mainPool != 0 )
     {
         _mainPool->shutdown();
@@ -278,3 +338,64 @@ size_t PacketDataStore::getMisses()
 
     return _misses;
 }
+
+void PacketDataStore::enableThreadCache()
+{
+#ifndef THREAD_LOCAL_UNSUPPORTED
+    if ( tlCacheEnabled )
+    {
+        return;
+    }
+
+    tlCacheEnabled = true;
+
+    MemPool::enableThreadCache();
+
+    MutexLock m ( _stMutex );
+
+    ++_numThreadCaches;
+#endif
+}
+
+void PacketDataStore::disableThreadCache()
+{
+#ifndef THREAD_LOCAL_UNSUPPORTED
+    if ( !tlCacheEnabled )
+    {
+        return;
+    }
+
+    tlCacheEnabled = false;
+
+    MemPool::disableThreadCache();
+
+    MutexLock m ( _stMutex );
+
+    assert ( _numThreadCaches > 0 );
+
+    --_numThreadCaches;
+#endif
+}
+
+size_t PacketDataStore::getNumThreadCaches()
+{
+    MutexLock m ( _stMutex );
+
+    return _numThreadCaches;
+}
+
+size_t PacketDataStore::getThreadCacheHits()
+{
+    MutexLock m ( _stMutex );
+
+    return ( ( _mainPool != 0 ) ? _mainPool->getThreadCacheHits() : 0 )
+           + ( ( _smallPool != 0 ) ? _smallPool->getThreadCacheHits() : 0 );
+}
+
+size_t PacketDataStore::getThreadCacheMisses()
+{
+    MutexLock m ( _stMutex );
+
+    return ( ( _mainPool != 0 ) ? _mainPool->getThreadCacheMisses() : 0 )
+           + ( ( _smallPool != 0 ) ? _smallPool->getThreadCacheMisses() : 0 );
+}
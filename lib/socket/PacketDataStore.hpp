@@ -60,6 +60,10 @@ class PacketDataStore
         /// while small memory pool is not available, regular memory will be allocated.
         static ConfigNumber<bool> optForcePacketOptimization;
 
+        /// @brief The number of blocks moved between per-thread caches and data store's pools at once.
+        /// If 0, per-thread caches will not be used.
+        static ConfigLimitedNumber<uint16_t> optThreadCacheSize;
+
         /// @brief Returns a new MemHandle for network packet data.
         /// If the data store has not been initialized, or the memory pool is empty,
         /// this function will still return a non-empty MemHandle, but it will use regular memory instead.
@@ -79,13 +83,29 @@ class PacketDataStore
         static bool optimizePacket ( MemHandle & packet );
 
         /// @brief Initializes PacketDataStore.
+        /// @note It should be called before any thread enables its caches.
         static void init();
 
         /// @brief Shuts down PacketDataStore.
+        /// @warning Threads that use per-thread caches access data store's pools without locking,
+        ///          so all of them MUST disable their caches before this is called.
         static void shutdown();
 
+        /// @brief Enables per-thread caches of data store's memory in the calling thread.
+        /// Threads that use a lot of packets should call this, to avoid locking the data store and its pools
+        /// every time a packet is generated or released. Caches are only used if optThreadCacheSize is not 0,
+        /// but threads that called this never lock the data store when getting packets from its pools.
+        /// @warning Each thread that calls this MUST call disableThreadCache() before it exits,
+        ///          and before the data store is shut down. Otherwise the memory stored in its caches will leak.
+        static void enableThreadCache();
+
+        /// @brief Disables per-thread caches of data store's memory in the calling thread.
+        /// All memory cached by the calling thread is returned to the data store.
+        static void disableThreadCache();
+
         /// @brief Returns the number of free blocks stored by PacketDataStore.
         /// @note This count only includes regular blocks, and NOT the small blocks!
+        ///       It also doesn't include blocks stored in per-thread caches.
         /// @return The number of free blocks stored by PacketDataStore.
         static size_t getFreeBlocksCount();
 
@@ -105,10 +125,31 @@ class PacketDataStore
         /// @return The number of times regular memory allocation was used instead of packet store.
         static size_t getMisses();
 
+        /// @brief Returns the number of times the calling thread got a packet from its cache.
+        /// This includes both regular AND small blocks.
+        /// @return The number of thread cache hits in the calling thread.
+        static size_t getThreadCacheHits();
+
+        /// @brief Returns the number of times the calling thread's cache had to be refilled from the data store.
+        /// This includes both regular AND small blocks.
+        /// @return The number of thread cache misses in the calling thread.
+        static size_t getThreadCacheMisses();
+
+        /// @brief Returns the number of threads that currently have their data store caches enabled.
+        /// @return The number of threads that currently have their data store caches enabled.
+        static size_t getNumThreadCaches();
+
     protected:
         static Mutex _stMutex; ///< Mutex for synchronizing operations.
         static PacketMemPool * _mainPool; ///< Pointer to the main packet memory pool.
         static PacketMemPool * _smallPool; ///< Pointer to the memory pool with small packets.
         static size_t _misses; ///< Counts "misses" (when memory was requested but pool was empty/unavailable).
+        static size_t _numThreadCaches; ///< The number of threads that have their caches enabled.
+
+        /// @brief Returns a new MemHandle that uses memory from one of the pools.
+        /// @note It doesn't lock anything. The caller must either hold _stMutex, or have its caches enabled.
+        /// @param [in] reqSize The requested size of the packet.
+        /// @return A new MemHandle, or an empty one if the memory could not be obtained from any of the pools.
+        static MemHandle getPooledPacket ( uint16_t reqSize );
 };
 }
@@ -22,7 +22,15 @@ extern "C"
 #ifndef HAVE_RECVMMSG
 #include "syscall/recvmmsg.h"
 #endif
+
+#ifdef SYSTEM_LINUX
+#include <netinet/udp.h>
+#endif
 }
+
+#if defined( USE_UDP_IMPL_MMSG ) && defined( SYSTEM_LINUX ) && defined( UDP_GRO ) && defined( SOL_UDP )
+#define USE_UDP_GRO    1
+#endif
 #elif !defined( HAVE_RECVMMSG ) && !defined( HAVE_SENDMMSG ) && !defined( HAVE_MMSGHDR )
 extern "C"
 {
@@ -39,31 +47,69 @@ struct mmsghdr
 
 #include "Socket.hpp"
 #include "PacketDataStore.hpp"
+#include "PacketMemPool.hpp"
 #include "PacketReader.hpp"
 
 using namespace Pravala;
 
 #define MAX_PACKETS    1000
 
+#ifdef USE_UDP_GRO
+// The max number of packets the kernel coalesces into a single message (UDP_GRO_CNT_MAX in the kernel).
+#define GRO_MAX_SEGMENTS    64
+
+// The size of the buffer for a single message. The kernel never coalesces more than that.
+#define GRO_BUFFER_SIZE     0xFFFF
+
+// The size of control data of a single message.
+#define GRO_CTRL_SIZE       CMSG_SPACE ( sizeof ( int ) )
+
+// The max number of slabs in the memory pool of GRO buffers. Each slab has one buffer for each message.
+// Packets hold on to the buffers they were split from, so we need more buffers than messages.
+// Once the pool runs out, regular memory is used.
+#define GRO_POOL_SLABS      4
+#else
+#define GRO_MAX_SEGMENTS    1
+#define GRO_BUFFER_SIZE     PacketDataStore::PacketSize
+#define GRO_CTRL_SIZE       1
+#define GRO_POOL_SLABS      1
+#endif
+
 TextLogLimited PacketReader::_log ( "packet_reader" );
 
-PacketReader::PacketReader ( uint16_t maxPackets ):
+PacketReader::PacketReader ( uint16_t maxPackets, bool useGro ):
 #ifdef USE_UDP_IMPL_MMSG
     MaxPackets ( limit<uint16_t> ( maxPackets, 1, MAX_PACKETS ) ),
+#ifdef USE_UDP_GRO
+    UseGro ( useGro ),
+#else
+    UseGro ( false ),
+#endif
     _recvMsgs ( new struct mmsghdr[ MaxPackets ] ),
     _recvIovecs ( new struct iovec[ MaxPackets ] ),
     _recvAddrs ( new SockAddr[ MaxPackets ] ),
     _recvData ( new MemHandle[ MaxPackets ] ),
+    _recvCtrl ( UseGro ? ( new char[ MaxPackets * GRO_CTRL_SIZE ] ) : 0 ),
+    _groData ( UseGro ? ( new MemHandle[ MaxPackets * GRO_MAX_SEGMENTS ] ) : 0 ),
+    _groMsgIdx ( UseGro ? ( new uint16_t[ MaxPackets * GRO_MAX_SEGMENTS ] ) : 0 ),
+    _groPool ( UseGro ? ( new PacketMemPool ( GRO_BUFFER_SIZE, MaxPackets, GRO_POOL_SLABS ) ) : 0 ),
 #else
     MaxPackets ( 1 ),
+    UseGro ( false ),
     _recvMsgs ( 0 ),
     _recvIovecs ( 0 ),
     _recvAddrs ( new SockAddr[ MaxPackets ] ),
     _recvData ( new MemHandle[ MaxPackets ] ),
+    _recvCtrl ( 0 ),
+    _groData ( 0 ),
+    _groMsgIdx ( 0 ),
+    _groPool ( 0 ),
 #endif
-    _lastReadCount ( 0 )
+    _lastReadCount ( 0 ),
+    _lastGroCount ( 0 )
 {
     ( void ) maxPackets;
+    ( void ) useGro;
 
     assert ( _recvData != 0 );
     assert ( _recvAddrs != 0 );
@@ -78,10 +124,7 @@ PacketReader::PacketReader ( uint16_t maxPackets ):
     // Set up receive parameters that don't change, and the initial receive buffers
     for ( uint16_t i = 0; i < MaxPackets; ++i )
     {
-        _recvData[ i ] = PacketDataStore::getPacket();
-
-        _recvIovecs[ i ].iov_base = _recvData[ i ].getWritable();
-        _recvIovecs[ i ].iov_len = _recvData[ i ].size();
+        setupRecvBuffer ( i );
 
         _recvMsgs[ i ].msg_hdr.msg_iov = &_recvIovecs[ i ];
         _recvMsgs[ i ].msg_hdr.msg_iovlen = 1;
@@ -90,13 +133,20 @@ PacketReader::PacketReader ( uint16_t maxPackets ):
         // SockAddr is our union around sockaddr with some nice functions, so we can directly point it to that!
         _recvMsgs[ i ].msg_hdr.msg_name = &_recvAddrs[ i ];
         _recvMsgs[ i ].msg_hdr.msg_namelen = sizeof ( SockAddr );
+
+        if ( UseGro )
+        {
+            // This is where the kernel tells us the size of individual packets in each message.
+            _recvMsgs[ i ].msg_hdr.msg_control = &_recvCtrl[ i * GRO_CTRL_SIZE ];
+            _recvMsgs[ i ].msg_hdr.msg_controllen = GRO_CTRL_SIZE;
+        }
     }
 #else
     assert ( !_recvMsgs );
     assert ( !_recvIovecs );
     assert ( MaxPackets == 1 );
 
-    _recvData[ 0 ] = PacketDataStore::getPacket();
+    setupRecvBuffer ( 0 );
 #endif
 }
 
@@ -106,10 +156,73 @@ PacketReader::~PacketReader()
     delete[] _recvIovecs;
     delete[] _recvAddrs;
     delete[] _recvData;
+    delete[] _recvCtrl;
+    delete[] _groData;
+    delete[] _groMsgIdx;
+
+    if ( _groPool != 0 )
+    {
+        // The pool is removed once all the packets that still use its memory are released.
+        _groPool->shutdown();
+    }
+}
+
+void PacketReader::setupFd ( int fd )
+{
+#ifdef USE_UDP_GRO
+    if ( UseGro && fd >= 0 && !SocketApi::setOption ( fd, SOL_UDP, UDP_GRO, ( int ) 1 ) )
+    {
+        // We can still read packets, they just won't be coalesced.
+        LOG_LIM ( L_WARN, "Could not enable UDP GRO in socket " << fd << ": " << SocketApi::getLastErrorDesc() );
+    }
+#else
+    ( void ) fd;
+#endif
+}
+
+void PacketReader::setupRecvBuffer ( uint16_t idx )
+{
+    assert ( idx < MaxPackets );
+
+    // With GRO a single message can carry many packets, so it needs a much bigger buffer.
+    _recvData[ idx ] = ( _groPool != 0 ) ? _groPool->getHandle() : PacketDataStore::getPacket();
+
+#ifdef USE_UDP_IMPL_MMSG
+    assert ( _recvIovecs != 0 );
+
+    _recvIovecs[ idx ].iov_base = _recvData[ idx ].getWritable();
+    _recvIovecs[ idx ].iov_len = _recvData[ idx ].size();
+#endif
 }
 
 bool PacketReader::getPacket ( uint16_t idx, MemHandle & data, SockAddr & addr )
 {
+    if ( UseGro )
+    {
+        assert ( _groData != 0 );
+        assert ( _groMsgIdx != 0 );
+
+        if ( idx >= _lastGroCount || _groData[ idx ].isEmpty() )
+        {
+            return false;
+        }
+
+        assert ( _groMsgIdx[ idx ] < _lastReadCount );
+
+        data = _groData[ idx ];
+
+        // The same address is used by all packets from the same message, so we don't clear it here.
+        addr = _recvAddrs[ _groMsgIdx[ idx ] ];
+
+        if ( addr.isIPv6MappedIPv4() )
+        {
+            addr.convertToV4();
+        }
+
+        _groData[ idx ].clear();
+        return true;
+    }
+
     if ( idx >= _lastReadCount || idx >= MaxPackets )
     {
         return false;
@@ -150,7 +263,12 @@ ERRCODE PacketReader::readPackets ( int fd, const LogId & logId, uint16_t & pack
     // Let's regenerate the entries that were previously used:
     for ( uint16_t i = 0; i < _lastReadCount; ++i )
     {
-        _recvData[ i ] = PacketDataStore::getPacket();
+        // With GRO we keep the buffers that were not passed to the user (we copy small packets out of them).
+        if ( !UseGro || _recvData[ i ].isEmpty() )
+        {
+            setupRecvBuffer ( i );
+        }
+
         _recvAddrs[ i ].clear();
 
 #ifdef USE_UDP_IMPL_MMSG
@@ -163,12 +281,21 @@ ERRCODE PacketReader::readPackets ( int fd, const LogId & logId, uint16_t & pack
         // It may have been set to something else in the previous read:
         _recvMsgs[ i ].msg_hdr.msg_namelen = sizeof ( SockAddr );
 
-        _recvIovecs[ i ].iov_base = _recvData[ i ].getWritable();
-        _recvIovecs[ i ].iov_len = _recvData[ i ].size();
+        if ( UseGro )
+        {
+            _recvMsgs[ i ].msg_hdr.msg_controllen = GRO_CTRL_SIZE;
+        }
 #endif
     }
 
+    // And drop packets that were not retrieved:
+    for ( uint16_t i = 0; i < _lastGroCount; ++i )
+    {
+        _groData[ i ].clear();
+    }
+
     _lastReadCount = 0;
+    _lastGroCount = 0;
 
     ssize_t ret = 0;
 
@@ -215,6 +342,19 @@ ERRCODE PacketReader::readPackets ( int fd, const LogId & logId, uint16_t & pack
             return Error::InternalError;
         }
 
+        if ( UseGro )
+        {
+            _lastReadCount = ( uint16_t ) ret;
+
+            for ( uint16_t i = 0; i < _lastReadCount; ++i )
+            {
+                splitGroMessage ( i, logId );
+            }
+
+            packetsRead = _lastGroCount;
+            return Error::Success;
+        }
+
         for ( int i = 0; i < ret; ++i )
         {
             if ( _recvMsgs[ i ].msg_len >= _recvIovecs[ i ].iov_len )
@@ -263,3 +403,103 @@ ERRCODE PacketReader::readPackets ( int fd, const LogId & logId, uint16_t & pack
 
     return Error::Closed;
 }
+
+void PacketReader::splitGroMessage ( uint16_t idx, const LogId & logId )
+{
+#ifdef USE_UDP_GRO
+    assert ( UseGro );
+    assert ( idx < _lastReadCount );
+    assert ( _groData != 0 );
+    assert ( _groMsgIdx != 0 );
+
+    struct msghdr & mHdr = _recvMsgs[ idx ].msg_hdr;
+    MemHandle & data = _recvData[ idx ];
+    const size_t len = _recvMsgs[ idx ].msg_len;
+
+    if ( ( mHdr.msg_flags & MSG_TRUNC ) != 0 || len > data.size() )
+    {
+        LOG_LIM ( L_WARN, logId.getLogId() << ": recvmmsg() truncated the message (" << len
+                  << " bytes were generated); Discarding it" );
+
+        return;
+    }
+
+    if ( len < 1 )
+    {
+        return;
+    }
+
+    size_t segSize = 0;
+
+    for ( struct cmsghdr * cMsg = CMSG_FIRSTHDR ( &mHdr ); cMsg != 0; cMsg = CMSG_NXTHDR ( &mHdr, cMsg ) )
+    {
+        if ( cMsg->cmsg_level == SOL_UDP && cMsg->cmsg_type == UDP_GRO )
+        {
+            int gsoSize = 0;
+
+            memcpy ( &gsoSize, CMSG_DATA ( cMsg ), sizeof ( gsoSize ) );
+
+            if ( gsoSize > 0 )
+            {
+                segSize = ( size_t ) gsoSize;
+            }
+        }
+    }
+
+    const size_t maxCount = MaxPackets * GRO_MAX_SEGMENTS;
+
+    if ( segSize < 1 || len <= segSize )
+    {
+        // A single packet.
+
+        if ( _lastGroCount >= maxCount )
+        {
+            return;
+        }
+
+        if ( len <= PacketDataStore::PacketSize )
+        {
+            // It's small enough, so we copy it. This way the (big) receive buffer can be reused.
+
+            MemHandle pkt = PacketDataStore::getPacket ( ( uint16_t ) len );
+            char * const w = pkt.getWritable();
+
+            if ( w != 0 && pkt.size() >= len )
+            {
+                memcpy ( w, data.get(), len );
+                pkt.truncate ( len );
+
+                _groData[ _lastGroCount ] = pkt;
+                _groMsgIdx[ _lastGroCount++ ] = idx;
+                return;
+            }
+        }
+
+        _groData[ _lastGroCount ] = data.getHandle ( 0, len );
+        _groMsgIdx[ _lastGroCount++ ] = idx;
+
+        // The buffer is now used by the packet, we will need a new one.
+        data.clear();
+        return;
+    }
+
+    for ( size_t offset = 0; offset < len; offset += segSize )
+    {
+        if ( _lastGroCount >= maxCount )
+        {
+            LOG_LIM ( L_WARN, logId.getLogId() << ": Too many packets in a GRO message (" << len
+                      << " bytes, " << segSize << " bytes per packet); Discarding the rest" );
+            break;
+        }
+
+        _groData[ _lastGroCount ] = data.getHandle ( offset, min ( segSize, len - offset ) );
+        _groMsgIdx[ _lastGroCount++ ] = idx;
+    }
+
+    // The buffer is now shared by all the packets, we will need a new one.
+    data.clear();
+#else
+    ( void ) idx;
+    ( void ) logId;
+#endif
+}
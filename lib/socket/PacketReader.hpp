@@ -27,9 +27,13 @@ struct iovec;
 namespace Pravala
 {
 class LogId;
+class PacketMemPool;
 
 /// @brief Used for reading multiple packets at a time.
 /// It uses recvmmsg or recvfrom, depending on the platform and build configuration.
+/// It can also use UDP GRO (if supported by the platform), in which case the kernel coalesces
+/// multiple packets of the same flow into a single message. Those messages are split back into
+/// individual packets (without copying the data).
 /// @note Unlike PacketWriter it can only be used with sockets!
 class PacketReader
 {
@@ -37,17 +41,32 @@ class PacketReader
         /// @brief Maximum number of packets to read at a time.
         const uint16_t MaxPackets;
 
+        /// @brief Set if this reader uses UDP GRO.
+        const bool UseGro;
+
         /// @brief Constructor.
         /// @param [in] maxPackets Maximum number of packets to read at a time.
-        PacketReader ( uint16_t maxPackets );
+        ///                        When GRO is used, this is the max number of messages (each of them could
+        ///                        carry multiple packets) to read at a time.
+        /// @param [in] useGro Whether UDP GRO should be used (if supported by the platform).
+        ///                    Each message read with GRO needs a large buffer (64KB),
+        ///                    so this uses much more memory. Those buffers come from reader's own memory pool.
+        PacketReader ( uint16_t maxPackets, bool useGro = false );
 
         /// @brief Destructor.
         ~PacketReader();
 
+        /// @brief Configures the socket to be used with this reader.
+        /// If this reader uses GRO, it enables it in the socket.
+        /// It should be called whenever a new socket FD is created.
+        /// @param [in] fd The socket FD that will be used for reading.
+        void setupFd ( int fd );
+
         /// @brief Reads packets from the socket.
         /// @param [in] fd The socket FD to read packets from.
         /// @param [in] logId The object performing the read (for logging).
         /// @param [out] packetsRead The number of packets received.
+        ///                          When GRO is used, it can be greater than MaxPackets.
         /// @return Standard error code.
         ERRCODE readPackets ( int fd, const LogId & logId, uint16_t & packetsRead );
 
@@ -75,8 +94,27 @@ class PacketReader
         SockAddr * const _recvAddrs;      ///< The remote address of each packet received
         MemHandle * const _recvData;      ///< Handles to data received
 
+        char * const _recvCtrl;      ///< Control data for each received message. Only used with GRO.
+        MemHandle * const _groData;  ///< Packets split from received messages. Only used with GRO.
+        uint16_t * const _groMsgIdx; ///< The index of the message each packet came from. Only used with GRO.
+        PacketMemPool * const _groPool; ///< The memory pool of receive buffers. Only used with GRO.
+
         /// @brief The last number of packets received.
         /// It is used for re-initializing the state before the next read.
+        /// When GRO is used, this is the number of messages received.
         uint16_t _lastReadCount;
+
+        /// @brief The last number of packets split from received messages. Only used with GRO.
+        uint16_t _lastGroCount;
+
+        /// @brief Sets up the receive buffer for a single message.
+        /// @param [in] idx The index of the message.
+        void setupRecvBuffer ( uint16_t idx );
+
+        /// @brief Splits a message received using GRO into individual packets.
+        /// Packets are appended to _groData.
+        /// @param [in] idx The index of the message.
+        /// @param [in] logId The object performing the read (for logging).
+        void splitGroMessage ( uint16_t idx, const LogId & logId );
 };
 }
@@ -23,16 +23,35 @@ extern "C"
 // but does not include sys/cdefs.h itself on 64-bit platforms.
 #include <sys/cdefs.h>
 #include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <limits.h>
+#endif
+
+#ifdef SYSTEM_LINUX
+#include <linux/errqueue.h>
 #endif
 }
 
 #include <cerrno>
+#include <cstring>
 
 #include "basic/Math.hpp"
+#include "event/ExponentialTimer.hpp"
 
 #include "PacketDataStore.hpp"
 #include "TcpFdSocket.hpp"
 
+#if defined( SO_ZEROCOPY ) && defined( MSG_ZEROCOPY ) && defined( SO_EE_ORIGIN_ZEROCOPY )
+#define USE_TCP_ZERO_COPY    1
+#endif
+
+#ifdef IOV_MAX
+#define MAX_SEND_CHUNKS    IOV_MAX
+#else
+#define MAX_SEND_CHUNKS    1024
+#endif
+
 using namespace Pravala;
 
 /// @brief Sets the maximum segment size in outgoing TCP connections.
@@ -48,17 +67,164 @@ static ConfigLimitedNumber<uint16_t> optSetMss (
         0xFFFF
 );
 
+/// @brief The minimum size of a single send operation for it to use MSG_ZEROCOPY.
+/// Zero-copy sends avoid copying the data into the kernel, but they need to pin the memory
+/// and require additional completion notifications. They are only worth it for larger writes.
+static ConfigLimitedNumber<uint32_t> optZeroCopyMinSize (
+        0,
+        "os.tcp.zero_copy_min_size",
+        "The minimum size of a single TCP send to use zero-copy mode (if supported); 0 disables zero-copy sends",
+        0, 0xFFFFFFFFU, 0
+);
+
+/// @brief The default max number of bytes read from a TCP socket in a single read event.
+/// Bigger values let bulk transfers drain the socket faster, smaller values improve fairness between sockets.
+static ConfigLimitedNumber<uint32_t> optReadBudget (
+        0,
+        "os.tcp.read_budget",
+        "The max number of bytes to read from a TCP socket in a single read event",
+        0, 16 * 1024 * 1024, 64 * 1024
+);
+
+#ifdef USE_TCP_ZERO_COPY
+/// @brief Reads zero-copy completions from the socket's error queue and releases the memory of completed sends.
+/// @param [in] sockFd The socket descriptor to read the completions from.
+/// @param [in,out] pending The memory used by zero-copy sends that have not been completed yet.
+///                         The first element belongs to the send with sequence number ( nextSeq - pending.size() ).
+/// @param [in] nextSeq The sequence number of the next zero-copy send.
+/// @param [out] copied Set to true if the kernel reported that it copied the data of any of the completed sends.
+///                     Not modified otherwise.
+/// @return True if anything was read from the error queue; False otherwise.
+static bool readZeroCopyErrQueue ( int sockFd, List<MemHandle> & pending, uint32_t nextSeq, bool & copied )
+{
+    bool readSomething = false;
+
+    while ( sockFd >= 0 && !pending.isEmpty() )
+    {
+        char control[ 128 ];
+        struct msghdr msg;
+
+        memset ( &msg, 0, sizeof ( msg ) );
+
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof ( control );
+
+        if ( ::recvmsg ( sockFd, &msg, MSG_ERRQUEUE ) < 0 )
+        {
+            // Nothing more in the error queue.
+            break;
+        }
+
+        readSomething = true;
+
+        for ( struct cmsghdr * cmsg = CMSG_FIRSTHDR ( &msg ); cmsg != 0; cmsg = CMSG_NXTHDR ( &msg, cmsg ) )
+        {
+            if ( !( cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR )
+                 && !( cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR ) )
+            {
+                continue;
+            }
+
+            struct sock_extended_err err;
+
+            memcpy ( &err, CMSG_DATA ( cmsg ), sizeof ( err ) );
+
+            if ( err.ee_errno != 0 || err.ee_origin != SO_EE_ORIGIN_ZEROCOPY )
+            {
+                continue;
+            }
+
+            if ( ( err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED ) != 0 )
+            {
+                copied = true;
+            }
+
+            // [ee_info, ee_data] is the range of completed sends. TCP completes them in order,
+            // so we just need to release everything up to (and including) ee_data.
+
+            while ( !pending.isEmpty() && ( int32_t ) ( err.ee_data - ( nextSeq - pending.size() ) ) >= 0 )
+            {
+                pending.removeFirst();
+            }
+        }
+    }
+
+    return readSomething;
+}
+
+/// @brief Keeps the memory used by zero-copy sends of a closed TCP socket until the kernel is done with it.
+/// Zero-copy completions can only be read from the socket's error queue, so its descriptor cannot be closed
+/// until all of them have been received. Otherwise the memory could be reused while the kernel is still sending it.
+/// The releaser shuts down the sending side of the socket (the data already sent is still delivered),
+/// and keeps checking for the remaining completions. Once there are none left, it closes the descriptor
+/// and removes itself.
+class TcpZeroCopyReleaser: public Timer::Receiver
+{
+    public:
+        /// @brief Constructor.
+        /// @param [in] sockFd The socket descriptor. It should not be used by anything else anymore.
+        /// @param [in] pending The memory used by zero-copy sends that have not been completed yet.
+        /// @param [in] nextSeq The sequence number of the next zero-copy send.
+        TcpZeroCopyReleaser ( int sockFd, const List<MemHandle> & pending, uint32_t nextSeq ):
+            _timer ( *this, 10, 2.0, 1000 ),
+            _sockFd ( sockFd ),
+            _pending ( pending ),
+            _nextSeq ( nextSeq )
+        {
+            assert ( _sockFd >= 0 );
+            assert ( !_pending.isEmpty() );
+
+            ::shutdown ( _sockFd, SHUT_WR );
+
+            _timer.start();
+        }
+
+    protected:
+        virtual void timerExpired ( Timer * timer )
+        {
+            ( void ) timer;
+            assert ( timer == &_timer );
+
+            bool copied = false;
+
+            readZeroCopyErrQueue ( _sockFd, _pending, _nextSeq, copied );
+
+            if ( !_pending.isEmpty() )
+            {
+                // If the connection breaks, the kernel drops the remaining data and completes all the sends,
+                // so we will get all the completions eventually.
+                _timer.start();
+                return;
+            }
+
+            EventManager::closeFd ( _sockFd );
+
+            delete this;
+        }
+
+    private:
+        ExponentialTimer _timer; ///< The timer used for checking the completions.
+        const int _sockFd; ///< The socket descriptor.
+        List<MemHandle> _pending; ///< The memory used by zero-copy sends that have not been completed yet.
+        const uint32_t _nextSeq; ///< The sequence number of the next zero-copy send.
+};
+#endif
+
 TcpFdSocket::TcpFdSocket ( SocketOwner * owner ):
     TcpSocket ( owner ),
     _sockFd ( -1 ),
-    _maxReadSize ( PacketDataStore::PacketSize )
+    _maxReadSize ( PacketDataStore::PacketSize ),
+    _readBudget ( optReadBudget.value() ),
+    _zeroCopyNextSeq ( 0 )
 {
 }
 
 TcpFdSocket::TcpFdSocket ( SocketOwner * owner, int sockFd, const SockAddr & localAddr, const SockAddr & remoteAddr ):
     TcpSocket ( owner, localAddr, remoteAddr ),
     _sockFd ( sockFd ),
-    _maxReadSize ( PacketDataStore::PacketSize )
+    _maxReadSize ( PacketDataStore::PacketSize ),
+    _readBudget ( optReadBudget.value() ),
+    _zeroCopyNextSeq ( 0 )
 {
     if ( _sockFd >= 0 )
     {
@@ -73,7 +239,9 @@ TcpFdSocket::TcpFdSocket ( SocketOwner * owner, TcpSocket * sock ):
             ( sock != 0 ) ? sock->getLocalSockAddr() : EmptySockAddress,
             ( sock != 0 ) ? sock->getRemoteSockAddr() : EmptySockAddress ),
     _sockFd ( ( sock != 0 ) ? sock->stealSockFd() : -1 ),
-    _maxReadSize ( PacketDataStore::PacketSize )
+    _maxReadSize ( PacketDataStore::PacketSize ),
+    _readBudget ( optReadBudget.value() ),
+    _zeroCopyNextSeq ( 0 )
 {
     if ( !sock || _sockFd < 0 )
         return;
@@ -111,11 +279,37 @@ void TcpFdSocket::close()
     {
         LOG ( L_DEBUG2, getLogId() << ": Closing socket; Size of data in read buffer: " << _readBuf.size() );
 
-        EventManager::closeFd ( _sockFd );
+        if ( !_zeroCopyPending.isEmpty() )
+        {
+            readZeroCopyCompletions();
+        }
+
+#ifdef USE_TCP_ZERO_COPY
+        if ( !_zeroCopyPending.isEmpty() )
+        {
+            LOG ( L_DEBUG2, getLogId() << ": " << _zeroCopyPending.size()
+                  << " zero-copy send(s) still in progress; The socket will be closed once they complete" );
+
+            EventManager::removeFdHandler ( _sockFd );
+
+            // It removes itself once it's done:
+            new TcpZeroCopyReleaser ( _sockFd, _zeroCopyPending, _zeroCopyNextSeq );
+        }
+        else
+#endif
+        {
+            EventManager::closeFd ( _sockFd );
+        }
+
         _sockFd = -1;
     }
 
+    // Any sends that are still in progress are now taken care of by the releaser.
+    _zeroCopyPending.clear();
+    _zeroCopyNextSeq = 0;
+
     _readBuf.clear();
+    _budgetBuf.clear();
 
     IpSocket::close();
 }
@@ -133,6 +327,11 @@ void TcpFdSocket::setMaxReadSize ( uint16_t maxReadSize )
     }
 }
 
+void TcpFdSocket::setReadBudget ( uint32_t readBudget )
+{
+    _readBudget = readBudget;
+}
+
 TcpFdSocket * TcpFdSocket::generateTcpFdSock ( SocketOwner * owner )
 {
     if ( _sockFd < 0 )
@@ -141,17 +340,40 @@ TcpFdSocket * TcpFdSocket::generateTcpFdSock ( SocketOwner * owner )
         return 0;
     }
 
+    // Zero-copy sends that are still in progress are taken over by the new socket,
+    // which will receive their completions:
+    const List<MemHandle> zeroCopyPending = _zeroCopyPending;
+    const uint32_t zeroCopyNextSeq = _zeroCopyNextSeq;
+    const bool zeroCopy = hasFlag ( SockTcpFdFlagZeroCopy );
+
+    _zeroCopyPending.clear();
+
     TcpFdSocket * newSock = new TcpFdSocket ( owner, this );
 
     if ( !newSock )
+    {
+        _zeroCopyPending = zeroCopyPending;
         return 0;
+    }
 
     if ( !newSock->isValid() )
     {
         LOG ( L_ERROR, getLogId() << ": Could not generate a valid basic TCP socket" );
 
+        _zeroCopyPending = zeroCopyPending;
+
         newSock->unrefOwner ( owner );
         newSock = 0;
+
+        return 0;
+    }
+
+    newSock->_zeroCopyPending = zeroCopyPending;
+    newSock->_zeroCopyNextSeq = zeroCopyNextSeq;
+
+    if ( zeroCopy )
+    {
+        newSock->setFlags ( SockTcpFdFlagZeroCopy );
     }
 
     return newSock;
@@ -175,6 +397,21 @@ void TcpFdSocket::doSockConnectFailed ( ERRCODE reason )
 
 int TcpFdSocket::stealSockFd()
 {
+    if ( !_zeroCopyPending.isEmpty() && _sockFd >= 0 )
+    {
+        readZeroCopyCompletions();
+
+        if ( !_zeroCopyPending.isEmpty() )
+        {
+            // Whoever takes over the descriptor would not know about the completions of these sends,
+            // and we would not know when the memory they use can be released.
+            LOG ( L_ERROR, getLogId() << ": Could not release the socket descriptor; "
+                  << _zeroCopyPending.size() << " zero-copy send(s) still in progress" );
+
+            return -1;
+        }
+    }
+
     const int sockFd = _sockFd;
 
     _sockFd = -1;
@@ -263,6 +500,16 @@ ERRCODE TcpFdSocket::send ( MemHandle & data )
         return Error::Success;
     }
 
+    if ( optZeroCopyMinSize.value() > 0 && data.size() >= optZeroCopyMinSize.value() )
+    {
+        const ERRCODE eCode = zeroCopySend ( data );
+
+        if ( eCode != Error::Unsupported )
+        {
+            return eCode;
+        }
+    }
+
     const char * mem = data.get();
     size_t size = data.size();
 
@@ -278,7 +525,64 @@ ERRCODE TcpFdSocket::send ( MemHandle & data )
 
 ERRCODE TcpFdSocket::send ( MemVector & data )
 {
+#ifdef SYSTEM_WINDOWS
     return streamSend ( data );
+#else
+    if ( _sockFd < 0 || !hasFlag ( SockTcpFlagConnected ) )
+    {
+        LOG ( L_ERROR, getLogId() << ": Can't send data; Socket is not connected" );
+        return Error::NotConnected;
+    }
+
+    bool sentSomething = false;
+
+    while ( !data.isEmpty() )
+    {
+        struct msghdr msg;
+
+        memset ( &msg, 0, sizeof ( msg ) );
+
+        // It's not actually modified...
+        msg.msg_iov = const_cast<struct iovec *> ( data.getChunks() );
+        msg.msg_iovlen = min<size_t> ( data.getNumChunks(), MAX_SEND_CHUNKS );
+
+        size_t size = 0;
+
+        if ( ( size_t ) msg.msg_iovlen == data.getNumChunks() )
+        {
+            size = data.getDataSize();
+        }
+        else
+        {
+            for ( size_t i = 0; i < ( size_t ) msg.msg_iovlen; ++i )
+            {
+                size += msg.msg_iov[ i ].iov_len;
+            }
+        }
+
+        const size_t reqSize = size;
+        const ERRCODE eCode = processSendResult ( ::sendmsg ( _sockFd, &msg, 0 ), size );
+
+        if ( NOT_OK ( eCode ) )
+        {
+            // If we managed to write something, let's say it went fine.
+            // If this is a serious error, it will be reported next time someone tries to write,
+            // or a callback (socket closed) will be generated anyway.
+            return ( sentSomething ? Error::Success : eCode );
+        }
+
+        data.consume ( size );
+        sentSomething = true;
+
+        if ( size < reqSize )
+        {
+            // Partial write.
+            break;
+        }
+    }
+
+    return Error::Success;
+#endif
 }
 
 ERRCODE TcpFdSocket::send ( const char * data, size_t & dataSize )
@@ -300,8 +604,11 @@ ERRCODE TcpFdSocket::send ( const char * data, size_t & dataSize )
         return Error::InvalidParameter;
     }
 
-    const ssize_t ret = ::send ( _sockFd, data, dataSize, 0 );
+    return processSendResult ( ::send ( _sockFd, data, dataSize, 0 ), dataSize );
+}
 
+ERRCODE TcpFdSocket::processSendResult ( ssize_t ret, size_t & dataSize )
+{
     if ( ret > 0 )
     {
         LOG ( L_DEBUG4, getLogId() << ": Successfully sent " << ret << " out of " << dataSize << " bytes" );
@@ -342,6 +649,92 @@ ERRCODE TcpFdSocket::send ( const char * data, size_t & dataSize )
     return Error::Closed;
 }
 
+ERRCODE TcpFdSocket::zeroCopySend ( MemHandle & data )
+{
+#ifdef USE_TCP_ZERO_COPY
+    if ( _sockFd < 0 || !hasFlag ( SockTcpFlagConnected ) || hasFlag ( SockTcpFdFlagNoZeroCopy ) )
+    {
+        return Error::Unsupported;
+    }
+
+    if ( !hasFlag ( SockTcpFdFlagZeroCopy ) )
+    {
+        int enabled = 0;
+
+        // If this FD was taken over from another socket object, it may already have zero-copy mode enabled.
+        // We don't know how many zero-copy sends have been performed using it,
+        // so we would not be able to match completions to our sends.
+
+        if ( !SocketApi::getOption ( _sockFd, SOL_SOCKET, SO_ZEROCOPY, enabled )
+             || enabled != 0
+             || !SocketApi::setOption ( _sockFd, SOL_SOCKET, SO_ZEROCOPY, ( int ) 1 ) )
+        {
+            LOG ( L_DEBUG2, getLogId() << ": Zero-copy mode cannot be used with this socket" );
+
+            setFlags ( SockTcpFdFlagNoZeroCopy );
+            return Error::Unsupported;
+        }
+
+        LOG ( L_DEBUG2, getLogId() << ": Enabled zero-copy mode" );
+
+        setFlags ( SockTcpFdFlagZeroCopy );
+        _zeroCopyNextSeq = 0;
+    }
+
+    const ssize_t ret = ::send ( _sockFd, data.get(), data.size(), MSG_ZEROCOPY );
+
+    if ( ret < 0 && errno == ENOBUFS )
+    {
+        // We have too much memory pinned already.
+        return Error::Unsupported;
+    }
+
+    size_t size = data.size();
+    const ERRCODE eCode = processSendResult ( ret, size );
+
+    if ( IS_OK ( eCode ) )
+    {
+        // We keep the reference to the original memory until the kernel tells us it is done with it.
+        _zeroCopyPending.append ( data );
+        ++_zeroCopyNextSeq;
+
+        data.consume ( size );
+    }
+
+    return eCode;
+#else
+    ( void ) data;
+
+    return Error::Unsupported;
+#endif
+}
+
+bool TcpFdSocket::readZeroCopyCompletions()
+{
+#ifdef USE_TCP_ZERO_COPY
+    bool copied = false;
+
+    if ( !readZeroCopyErrQueue ( _sockFd, _zeroCopyPending, _zeroCopyNextSeq, copied ) )
+    {
+        return false;
+    }
+
+    if ( copied && !hasFlag ( SockTcpFdFlagNoZeroCopy ) )
+    {
+        // The kernel copied the data anyway (for example the route doesn't support it),
+        // so we only pay the completion overhead. Let's stop using zero-copy mode with this socket.
+
+        LOG ( L_DEBUG2, getLogId() << ": Zero-copy send was not used by the kernel; Disabling zero-copy mode" );
+
+        setFlags ( SockTcpFdFlagNoZeroCopy );
+    }
+
+    return true;
+#else
+    return false;
+#endif
+}
+
 void TcpFdSocket::consumeReadBuffer ( size_t size )
 {
     _readBuf.consume ( size );
@@ -359,6 +752,27 @@ void TcpFdSocket::receiveFdEvent ( int fd, short int events )
     assert ( fd >= 0 );
     assert ( fd == _sockFd );
 
+    if ( !_zeroCopyPending.isEmpty() && readZeroCopyCompletions() )
+    {
+        // Zero-copy completions are reported as errors on the socket,
+        // and EventManager disables all events of file descriptors that report errors.
+        // If there is a real error, the read below will catch it.
+
+        int fdEvents = 0;
+
+        if ( _readBuf.isEmpty() )
+        {
+            fdEvents |= EventManager::EventRead;
+        }
+
+        if ( hasFlag ( SockFlagSendBlocked ) )
+        {
+            fdEvents |= EventManager::EventWrite;
+        }
+
+        EventManager::setFdEvents ( fd, fdEvents );
+    }
+
     if ( ( events & EventManager::EventWrite ) == EventManager::EventWrite )
     {
         // The first write event tells us the TCP connection is complete
@@ -413,7 +827,71 @@ void TcpFdSocket::receiveFdEvent ( int fd, short int events )
                 return;
             }
 
-            const ssize_t ret = ::recv ( fd, w, min<size_t> ( mh.size(), _maxReadSize ), 0 );
+            const size_t readSize = min<size_t> ( mh.size(), _maxReadSize );
+
+            // If the read budget allows it, the data that doesn't fit in the packet is read into a larger buffer
+            // (at the same offset it would have in it), using the same read operation.
+            // That buffer is kept and reused by the following reads, until it is handed over to the owner.
+            char * bigW = 0;
+
+            if ( _readBudget > readSize )
+            {
+                if ( _budgetBuf.size() != _readBudget || _budgetBuf.getRefCount() > 1 )
+                {
+                    _budgetBuf = MemHandle ( _readBudget );
+                }
+
+                if ( _budgetBuf.size() == _readBudget )
+                {
+                    bigW = _budgetBuf.getWritable();
+                }
+            }
+
+#ifdef SYSTEM_WINDOWS
+            WSABUF bufs[ 2 ];
+
+            bufs[ 0 ].buf = w;
+            bufs[ 0 ].len = ( ULONG ) readSize;
+
+            if ( bigW != 0 )
+            {
+                bufs[ 1 ].buf = bigW + readSize;
+                bufs[ 1 ].len = ( ULONG ) ( _readBudget - readSize );
+            }
+
+            DWORD received = 0;
+            DWORD rcvFlags = 0;
+
+            const ssize_t ret
+                = ( WSARecv ( fd, bufs, ( bigW != 0 ) ? 2 : 1, &received, &rcvFlags, 0, 0 ) == 0 )
+                  ? ( ssize_t ) received : -1;
+#else
+            struct iovec iov[ 2 ];
+
+            iov[ 0 ].iov_base = w;
+            iov[ 0 ].iov_len = readSize;
+
+            if ( bigW != 0 )
+            {
+                iov[ 1 ].iov_base = bigW + readSize;
+                iov[ 1 ].iov_len = _readBudget - readSize;
+            }
+
+            struct msghdr msg;
+
+            memset ( &msg, 0, sizeof ( msg ) );
+
+            msg.msg_iov = iov;
+            msg.msg_iovlen = ( bigW != 0 ) ? 2 : 1;
+
+            const ssize_t ret = ::recvmsg ( fd, &msg, 0 );
+#endif
+
+            if ( ret < 0 && SocketApi::isErrnoSoft() )
+            {
+                // Nothing to read (the event could have been caused by zero-copy completions).
+                return;
+            }
 
             if ( ret < 0 )
             {
@@ -426,9 +904,46 @@ void TcpFdSocket::receiveFdEvent ( int fd, short int events )
 
             if ( ret > 0 )
             {
-                assert ( ( size_t ) ret <= mh.size() );
-
-                mh.truncate ( ret );
+                if ( ( size_t ) ret <= readSize )
+                {
+                    mh.truncate ( ret );
+                }
+                else
+                {
+                    // The data didn't fit in the packet, the rest of it is in the budget buffer.
+
+                    assert ( bigW != 0 );
+                    assert ( ( size_t ) ret <= _budgetBuf.size() );
+
+                    MemHandle newMh;
+
+                    if ( ( size_t ) ret <= _readBudget / 4 )
+                    {
+                        // There wasn't much more data. Let's not hand over (and pin) the entire big buffer,
+                        // and copy the data into a buffer of the right size instead.
+                        newMh = MemHandle ( ret );
+                    }
+
+                    char * const newW = newMh.getWritable();
+
+                    if ( newW != 0 && newMh.size() == ( size_t ) ret )
+                    {
+                        memcpy ( newW, w, readSize );
+                        memcpy ( newW + readSize, bigW + readSize, ret - readSize );
+
+                        mh = newMh;
+                    }
+                    else
+                    {
+                        memcpy ( bigW, w, readSize );
+
+                        mh = _budgetBuf;
+                        mh.truncate ( ret );
+
+                        // It now belongs to the owner, we will need a new one next time:
+                        _budgetBuf.clear();
+                    }
+                }
 
                 _readBuf = mh;
 
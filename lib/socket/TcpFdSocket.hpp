@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include "basic/List.hpp"
 #include "TcpSocket.hpp"
 
 namespace Pravala
@@ -48,6 +49,16 @@ class TcpFdSocket: public TcpSocket, protected EventManager::FdEventHandler
         /// @param [in] maxReadSize The new max read size to set. This functions does nothing if it's < 1.
         void setMaxReadSize ( uint16_t maxReadSize );
 
+        /// @brief Sets the new read budget.
+        /// This is the maximum number of bytes that will be read from the file descriptor in a single read event.
+        /// If the first read (of up to max read size bytes) fills the buffer entirely, more data is read
+        /// (into a single, larger buffer), until the total reaches this limit.
+        /// This lets bulk transfers drain the socket with fewer read events and system calls,
+        /// while still letting other sockets be handled in between.
+        /// @param [in] readBudget The new read budget to set. If it's not greater than the max read size,
+        ///                        only a single read will be performed for each read event.
+        void setReadBudget ( uint32_t readBudget );
+
         virtual uint16_t getDetectedMtu() const;
 
         virtual void consumeReadBuffer ( size_t size );
@@ -61,7 +72,19 @@ class TcpFdSocket: public TcpSocket, protected EventManager::FdEventHandler
         virtual ERRCODE connect ( const SockAddr & addr );
 
         virtual ERRCODE send ( const char * data, size_t & dataSize );
+
+        /// @brief Sends the data over the socket.
+        /// If 'os.tcp.zero_copy_min_size' is set and the platform supports it, sends of at least that size
+        /// will use MSG_ZEROCOPY. In that case the memory is not copied into the kernel,
+        /// and a reference to it is kept until the kernel reports that it is no longer used.
+        /// @param [in,out] data The data to send. It is consumed by the number of bytes sent.
+        /// @return Standard error code.
         virtual ERRCODE send ( MemHandle & data );
+
+        /// @brief Sends the data over the socket.
+        /// All the chunks are sent using a single system call (if possible).
+        /// @param [in,out] data The data to send. It is consumed by the number of bytes sent.
+        /// @return Standard error code.
         virtual ERRCODE send ( MemVector & data );
 
         virtual String getLogId ( bool extended = false ) const;
@@ -79,12 +102,33 @@ class TcpFdSocket: public TcpSocket, protected EventManager::FdEventHandler
 
         /// @brief The lowest flag bit that can be used by the class inheriting this one.
         /// Classes that inherit it should use ( 1 << next_shift + 0), ( 1 << next_shift + 1), etc. values.
-        static const uint8_t SockTcpFdNextFlagShift = SockTcpNextFlagShift;
+        static const uint8_t SockTcpFdNextFlagShift = SockTcpNextFlagShift + 2;
+
+        /// @brief Set when SO_ZEROCOPY has been enabled in the underlying socket.
+        static const uint16_t SockTcpFdFlagZeroCopy = ( 1 << ( SockTcpNextFlagShift + 0 ) );
+
+        /// @brief Set when zero-copy sends should not be used with this socket.
+        /// This happens when the socket does not support them, or the kernel had to copy the data anyway.
+        static const uint16_t SockTcpFdFlagNoZeroCopy = ( 1 << ( SockTcpNextFlagShift + 1 ) );
 
         int _sockFd; ///< Underlying socket file descriptor.
 
         uint16_t _maxReadSize; ///< The max size of a single read operation.
 
+        uint32_t _readBudget; ///< The max number of bytes to read in a single read event.
+
+        /// @brief The buffer used for reading more data than the max read size in a single read event.
+        /// It is reused by subsequent read events, until it is handed over to the owner.
+        MemHandle _budgetBuf;
+
+        /// @brief The sequence number of the next zero-copy send.
+        /// The kernel numbers all successful MSG_ZEROCOPY sends, starting from 0.
+        uint32_t _zeroCopyNextSeq;
+
+        /// @brief The memory used by zero-copy sends that have not been completed yet.
+        /// The first element belongs to the send with sequence number ( _zeroCopyNextSeq - _zeroCopyPending.size() ).
+        List<MemHandle> _zeroCopyPending;
+
         /// @brief Constructor.
         /// Initializes the socket using given parameters.
         /// If the socket FD is valid, it will set 'valid', 'connected' and 'tcp connected' flags.
@@ -117,6 +161,27 @@ class TcpFdSocket: public TcpSocket, protected EventManager::FdEventHandler
         virtual void doSockConnectFailed ( ERRCODE reason );
         virtual void receiveFdEvent ( int fd, short int events );
 
+    private:
+        /// @brief Handles the result of a send operation.
+        /// It marks the socket as blocked on partial writes, and deals with send errors.
+        /// @param [in] ret The value returned by the send call.
+        /// @param [in,out] dataSize The number of bytes that were supposed to be sent.
+        ///                          On success it is set to the number of bytes actually sent.
+        /// @return Standard error code.
+        ERRCODE processSendResult ( ssize_t ret, size_t & dataSize );
+
+        /// @brief Tries to send the data using MSG_ZEROCOPY.
+        /// @param [in,out] data The data to send. It is consumed by the number of bytes sent.
+        ///                      If it was sent, a reference to it is kept until the send is completed.
+        /// @return Standard error code; Error::Unsupported if zero-copy send could not be used,
+        ///         in which case the data should be sent the regular way.
+        ERRCODE zeroCopySend ( MemHandle & data );
+
+        /// @brief Reads zero-copy completions from the socket's error queue.
+        /// It releases the memory of all completed sends.
+        /// @return True if any completions were read; False otherwise.
+        bool readZeroCopyCompletions();
+
         friend class TcpServer;
 };
 }
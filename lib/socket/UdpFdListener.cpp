@@ -69,14 +69,30 @@ ConfigLimitedNumber<int> UdpFdListener::optSendBufSize (
         "UDP listener's socket send buffer size (in bytes) to try to use (if it is smaller than that)",
         1, SocketApi::MaxBufferSize );
 
-UdpFdListener::UdpFdListener():
+ConfigNumber<bool> UdpFdListener::optUseGso (
+        0,
+        "os.udp_listener.gso",
+        "Set to true to send multiple same-size UDP packets as a single buffer segmented by the kernel (if possible)",
+        false
+);
+
+ConfigNumber<bool> UdpFdListener::optUseGro (
+        0,
+        "os.udp_listener.gro",
+        "Set to true to let the kernel coalesce received UDP packets (if possible); It uses larger read buffers",
+        false
+);
+
+UdpFdListener::UdpFdListener ( bool reusePort ):
     _writer ( PacketWriter::SocketWriter,
             PacketWriter::FlagMultiWrite
-            | ( ( optMaxSendSpeed.value() > 0 ) ? ( PacketWriter::FlagThreaded ) : 0 ),
+            | ( ( optMaxSendSpeed.value() > 0 ) ? ( PacketWriter::FlagThreaded ) : 0 )
+            | ( optUseGso.value() ? ( PacketWriter::FlagGso ) : 0 ),
             optMaxSendPackets.value(),
             optMaxSendSpeed.value() ),
-    _reader ( optMaxRecvPackets.value() ),
-    _fd ( -1 )
+    _reader ( optMaxRecvPackets.value(), optUseGro.value() ),
+    _fd ( -1 ),
+    _reusePort ( reusePort )
 {
 }
 
@@ -97,9 +113,9 @@ String UdpFdListener::getLogId ( bool extended ) const
     return String ( "UDP_Listener[%1]" ).arg ( _localAddr );
 }
 
-UdpFdListener * UdpFdListener::generate ( const SockAddr & localAddr, ERRCODE * errCode )
+UdpFdListener * UdpFdListener::generate ( const SockAddr & localAddr, ERRCODE * errCode, bool reusePort )
 {
-    UdpFdListener * const ret = new UdpFdListener();
+    UdpFdListener * const ret = new UdpFdListener ( reusePort );
 
     if ( !ret )
     {
@@ -134,7 +150,7 @@ ERRCODE UdpFdListener::reinitializeImpl ( const SockAddr & localAddr )
 
     ERRCODE eCode;
 
-    const int fd = SocketApi::createUdpSocket ( localAddr, false, &eCode );
+    const int fd = SocketApi::createUdpSocket ( localAddr, _reusePort, &eCode );
 
     if ( fd < 0 )
     {
@@ -157,6 +173,7 @@ ERRCODE UdpFdListener::reinitializeImpl ( const SockAddr & localAddr )
 
     _fd = fd;
     _writer.setupFd ( fd );
+    _reader.setupFd ( fd );
 
     if ( optRecvBufSize.isSet() && optRecvBufSize.value() > 0 )
     {
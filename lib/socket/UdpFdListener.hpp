@@ -42,13 +42,22 @@ class UdpFdListener: public UdpListener, protected EventManager::FdEventHandler
         /// @brief UDP socket send buffer size (in bytes) to try to use.
         static ConfigLimitedNumber<int> optSendBufSize;
 
+        /// @brief Used for enabling/disabling UDP GSO (if possible).
+        static ConfigNumber<bool> optUseGso;
+
+        /// @brief Used for enabling/disabling UDP GRO (if possible).
+        static ConfigNumber<bool> optUseGro;
+
         /// @brief Generates a bound UdpFdListener.
         /// @param [in] localAddr The local address and port to bind to.
         ///                        A "zero" address means "any" address, zero port means dynamically allocated port.
         /// @param [out] errCode If used, the status of the operation will be stored there.
+        /// @param [in] reusePort If set to true, SO_REUSEADDR and SO_REUSEPORT will be set (if available).
+        ///                       This allows several listeners (for example, one in each thread) to bind to the same
+        ///                       address and port, with the kernel distributing incoming packets between them.
         /// @return A pointer to the newly created UDP listener, or 0 if it could not be created.
         ///         It is caller's responsibility to delete this socket.
-        static UdpFdListener * generate ( const SockAddr & localAddr, ERRCODE * errCode = 0 );
+        static UdpFdListener * generate ( const SockAddr & localAddr, ERRCODE * errCode = 0, bool reusePort = false );
 
         virtual String getLogId ( bool extended = false ) const;
 
@@ -66,8 +75,11 @@ class UdpFdListener: public UdpListener, protected EventManager::FdEventHandler
 
         int _fd; ///< Underlying file descriptor
 
+        const bool _reusePort; ///< Whether SO_REUSEADDR and SO_REUSEPORT should be set on the socket.
+
         /// @brief Constructor.
-        UdpFdListener();
+        /// @param [in] reusePort Whether SO_REUSEADDR and SO_REUSEPORT should be set on the socket.
+        UdpFdListener ( bool reusePort = false );
 
         /// @brief Destructor.
         ~UdpFdListener();
@@ -33,6 +33,21 @@ ConfigNumber<bool> UdpFdSocket::optUseMultiWrites (
         false
 );
 
+ConfigNumber<bool> UdpFdSocket::optUseGso (
+        0,
+        "os.udp.fd.gso",
+        "Set to true to send multiple same-size UDP packets as a single buffer segmented by the kernel "
+        "(if possible); It requires multi-writes",
+        false
+);
+
+ConfigNumber<bool> UdpFdSocket::optUseGro (
+        0,
+        "os.udp.fd.gro",
+        "Set to true to let the kernel coalesce received UDP packets (if possible); It uses larger read buffers",
+        false
+);
+
 ConfigLimitedNumber<uint16_t> UdpFdSocket::optQueueSize (
         0,
         "os.udp.fd.write_queue_size",
@@ -51,9 +66,10 @@ UdpFdSocket::UdpFdSocket ( SocketOwner * owner ):
     UdpSocket ( owner ),
     _writer ( PacketWriter::SocketWriter,
             ( optUseAsyncWrites.value() ? ( PacketWriter::FlagThreaded ) : 0 )
-            | ( optUseMultiWrites.value() ? ( PacketWriter::FlagMultiWrite ) : 0 ),
+            | ( optUseMultiWrites.value() ? ( PacketWriter::FlagMultiWrite ) : 0 )
+            | ( optUseGso.value() ? ( PacketWriter::FlagGso ) : 0 ),
             optQueueSize.value() ),
-    _reader ( optMultiReadSize.value() ),
+    _reader ( optMultiReadSize.value(), optUseGro.value() ),
     _sockFd ( -1 )
 {
 }
@@ -71,6 +87,7 @@ bool UdpFdSocket::sockInitFd ( SocketApi::SocketType sockType, int & sockFd )
     if ( sockFd >= 0 )
     {
         _writer.setupFd ( sockFd );
+        _reader.setupFd ( sockFd );
     }
     else
     {
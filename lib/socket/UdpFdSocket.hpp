@@ -39,6 +39,12 @@ class UdpFdSocket: public UdpSocket, protected EventManager::FdEventHandler
         /// @brief The number of messages to read at a time (if possible, using recvmmsg).
         static ConfigLimitedNumber<uint16_t> optMultiReadSize;
 
+        /// @brief Used for enabling/disabling UDP GSO for multi-writes (if possible).
+        static ConfigNumber<bool> optUseGso;
+
+        /// @brief Used for enabling/disabling UDP GRO when reading (if possible).
+        static ConfigNumber<bool> optUseGro;
+
         /// @brief Constructor.
         /// @param [in] owner The initial owner to set.
         UdpFdSocket ( SocketOwner * owner );
@@ -265,7 +265,7 @@ void UdpListener::notifyClosed()
         _listeningSock->notifyClosed();
     }
 
-    for ( HashMap<SockAddr, UdpListenerSocket *>::Iterator it ( _connectedSocks ); it.isValid(); it.next() )
+    for ( FlatHashMap<SockAddr, UdpListenerSocket *>::Iterator it ( _connectedSocks ); it.isValid(); it.next() )
     {
         assert ( it.isValid() );
         assert ( it.value() != 0 );
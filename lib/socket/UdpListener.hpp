@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include "basic/FlatHashMap.hpp"
 #include "object/SimpleObject.hpp"
 #include "UdpSocket.hpp"
 
@@ -119,7 +120,8 @@ class UdpListener: public SimpleObject, public LogId
         /// <remote IP/port, Socket object for this combination>
         /// References are not kept to objects in this map. UdpSockets are expected to unregister themself
         /// which will remove them from this map, before returning to pool.
-        HashMap<SockAddr, UdpListenerSocket *> _connectedSocks;
+        /// It is looked up for every packet received, so it uses FlatHashMap.
+        FlatHashMap<SockAddr, UdpListenerSocket *> _connectedSocks;
 
         /// @brief Constructor
         UdpListener();
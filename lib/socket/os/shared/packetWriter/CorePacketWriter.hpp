@@ -40,8 +40,13 @@ class CorePacketWriter: private NoCopy
         /// @brief Makes the writer try to send multiple packets at the same time (if supported by the platform).
         static const uint16_t FlagMultiWrite = ( 1 << 1 );
 
+        /// @brief Makes the writer send multiple same-size packets queued for the same destination
+        ///        as a single buffer, segmented by the kernel (UDP GSO), if supported by the platform.
+        /// It is only used in socket mode, together with FlagMultiWrite.
+        static const uint16_t FlagGso = ( 1 << 2 );
+
         /// @brief All core flags.
-        static const uint16_t CoreFlags = ( FlagThreaded | FlagMultiWrite );
+        static const uint16_t CoreFlags = ( FlagThreaded | FlagMultiWrite | FlagGso );
 
         const WriterType Type; ///< Configured type of this writer.
 
@@ -20,6 +20,7 @@
 #include "basic/Math.hpp"
 #include "basic/Random.hpp"
 #include "config/ConfigNumber.hpp"
+#include "socket/PacketDataStore.hpp"
 
 #include "PosixPacketWriter.hpp"
 
@@ -137,6 +138,9 @@ void PosixPacketWriter::configureFd ( int fDesc )
 
     _fd = fDesc;
 
+    // Not all sockets (and kernels) support GSO, let's check the new one:
+    dataSetupGso ( _fd );
+
     // If the thread was running, we stopped it first, at the beginning of this function.
     // If we get a valid FD we want to start a thread, even if it was previously running (using a different FD).
 
@@ -345,6 +349,10 @@ void * PosixPacketWriter::staticThreadFunc ( void * arg )
 
 void * PosixPacketWriter::threadFunc()
 {
+    // Packets written by this thread are released here, so it should use its own caches,
+    // instead of locking the data store for each of them.
+    PacketDataStore::enableThreadCache();
+
     _mutex.lock();
     uint16_t sendIndex = _sendIndex;
     _mutex.unlock();
@@ -469,6 +477,13 @@ void * PosixPacketWriter::threadFunc()
         uint32_t bWritten = 0;
         const ERRCODE eCode = dataWritePackets ( fd, sendIndex, qSize, bucketAllowedBytes, pWritten, bWritten );
 
+        // The main thread doesn't touch these entries until we update _sendIndex,
+        // so we can release the packets written now (the main thread only clears entries that are already empty).
+        for ( uint16_t i = 0; i < pWritten; ++i )
+        {
+            _data[ ( sendIndex + i ) % QueueSize ].clear();
+        }
+
         sendIndex = ( sendIndex + pWritten ) % QueueSize;
 
         if ( eCode == Error::Closed )
@@ -496,5 +511,7 @@ void * PosixPacketWriter::threadFunc()
         }
     }
 
+    PacketDataStore::disableThreadCache();
+
     return 0;
 }
@@ -25,7 +25,15 @@ extern "C"
 #ifndef HAVE_SENDMMSG
 #include "syscall/sendmmsg.h"
 #endif
+
+#ifdef SYSTEM_LINUX
+#include <netinet/udp.h>
+#endif
 }
+
+#if defined( USE_UDP_IMPL_MMSG ) && defined( SYSTEM_LINUX ) && defined( UDP_SEGMENT ) && defined( SOL_UDP )
+#define USE_UDP_GSO    1
+#endif
 #elif !defined( HAVE_RECVMMSG ) && !defined( HAVE_SENDMMSG ) && !defined( HAVE_MMSGHDR )
 // Unused
 struct mmsghdr
@@ -38,6 +46,24 @@ struct mmsghdr
 
 #define MAX_QUEUE_SIZE    1024
 
+#ifdef USE_UDP_GSO
+// The max number of packets in a single GSO message (UDP_MAX_SEGMENTS in the kernel).
+#define GSO_MAX_SEGMENTS    64
+
+// The max number of bytes in a single GSO message. It has to fit in a single IPv6 packet
+// (with IPv6 and UDP headers).
+#define GSO_MAX_BYTES       ( 0xFFFF - 40 - 8 )
+
+// The max number of IO vectors used by all GSO messages in a single sendmmsg() call.
+#define GSO_MAX_IOVECS      1024
+
+// The size of control data of a single GSO message.
+#define GSO_CTRL_SIZE       CMSG_SPACE ( sizeof ( uint16_t ) )
+#else
+#define GSO_MAX_IOVECS      1
+#define GSO_CTRL_SIZE       1
+#endif
+
 using namespace Pravala;
 
 #ifdef USE_UDP_IMPL_MMSG
@@ -52,6 +78,13 @@ using namespace Pravala;
 // We want _msgs only in socket mode when we use multi-write:
 #define WANT_MSGS    ( IsSocketWriter && ( flags & CorePacketWriter::FlagMultiWrite ) )
 
+#ifdef USE_UDP_GSO
+// We want GSO data only when we use _msgs and GSO was requested:
+#define WANT_GSO     ( WANT_MSGS && ( flags & CorePacketWriter::FlagGso ) )
+#else
+#define WANT_GSO     ( false )
+#endif
+
 #else
 // We want _data only in threaded mode:
 #define WANT_DATA    ( ( flags & CorePacketWriter::FlagThreaded ) )
@@ -61,6 +94,9 @@ using namespace Pravala;
 
 // We never want _msgs:
 #define WANT_MSGS    ( false )
+
+// We never want GSO data:
+#define WANT_GSO     ( false )
 #endif
 
 PosixPacketWriterData::PosixPacketWriterData ( CorePacketWriter::WriterType wType, uint16_t flags, uint16_t queueSize ):
@@ -68,7 +104,11 @@ PosixPacketWriterData::PosixPacketWriterData ( CorePacketWriter::WriterType wTyp
     QueueSize ( limit<uint16_t> ( queueSize, 1, MAX_QUEUE_SIZE ) ),
     _data ( WANT_DATA ? ( new MemVector[ QueueSize ] ) : 0 ),
     _dest ( WANT_DEST ? ( new SockAddr[ QueueSize ] ) : 0 ),
-    _msgs ( WANT_MSGS ? ( new struct mmsghdr[ QueueSize ] ) : 0 )
+    _msgs ( WANT_MSGS ? ( new struct mmsghdr[ QueueSize ] ) : 0 ),
+    _gsoIovecs ( WANT_GSO ? ( new struct iovec[ GSO_MAX_IOVECS ] ) : 0 ),
+    _gsoCtrl ( WANT_GSO ? ( new char[ QueueSize * GSO_CTRL_SIZE ] ) : 0 ),
+    _gsoPackets ( WANT_GSO ? ( new uint16_t[ QueueSize ] ) : 0 ),
+    _useGso ( false )
 {
 }
 
@@ -77,6 +117,146 @@ PosixPacketWriterData::~PosixPacketWriterData()
     delete[] _data;
     delete[] _dest;
     delete[] _msgs;
+    delete[] _gsoIovecs;
+    delete[] _gsoCtrl;
+    delete[] _gsoPackets;
+}
+
+void PosixPacketWriterData::dataSetupGso ( int fd )
+{
+    _useGso = false;
+
+#ifdef USE_UDP_GSO
+    int gsoSize = 0;
+
+    // Kernels that support UDP GSO also support UDP_SEGMENT socket option.
+    // Older kernels would ignore the control message and send all the packets as a single, big one.
+
+    _useGso = ( _gsoIovecs != 0 && fd >= 0 && SocketApi::getOption ( fd, SOL_UDP, UDP_SEGMENT, gsoSize ) );
+#else
+    ( void ) fd;
+#endif
+}
+
+uint16_t PosixPacketWriterData::dataPrepareGsoMsgs (
+        uint16_t index, uint16_t maxPackets, uint32_t maxBytes, uint16_t & numPackets, uint32_t & numBytes )
+{
+    numPackets = 0;
+    numBytes = 0;
+
+#ifdef USE_UDP_GSO
+    assert ( _msgs != 0 );
+    assert ( _dest != 0 );
+    assert ( _gsoIovecs != 0 );
+    assert ( _gsoCtrl != 0 );
+    assert ( _gsoPackets != 0 );
+
+    uint16_t numMsg = 0;
+    size_t numIovecs = 0;
+
+    uint16_t msgIndex = index; // The index of the first packet in the current message.
+    size_t segSize = 0;        // The segment size of the current message.
+    size_t msgBytes = 0;       // The number of bytes in the current message.
+    bool canExtend = false;    // Whether more packets can be added to the current message.
+
+    for ( uint16_t idx = index;
+          numPackets < maxPackets && numBytes < maxBytes;
+          idx = ( idx + 1 ) % QueueSize )
+    {
+        assert ( idx < QueueSize );
+
+        const MemVector & data = _data[ idx ];
+        const size_t size = data.getDataSize();
+        const bool fits = ( numIovecs + data.getNumChunks() <= GSO_MAX_IOVECS );
+
+        if ( canExtend && fits
+             && size <= segSize
+             && msgBytes + size <= GSO_MAX_BYTES
+             && _gsoPackets[ numMsg - 1 ] < GSO_MAX_SEGMENTS
+             && _dest[ idx ] == _dest[ msgIndex ] )
+        {
+            struct msghdr & mHdr = _msgs[ numMsg - 1 ].msg_hdr;
+
+            if ( _gsoPackets[ numMsg - 1 ] == 1 )
+            {
+                // This is the second packet in this message. We need to set the segment size.
+
+                mHdr.msg_control = &_gsoCtrl[ ( numMsg - 1 ) * GSO_CTRL_SIZE ];
+                mHdr.msg_controllen = GSO_CTRL_SIZE;
+
+                struct cmsghdr * const cMsg = CMSG_FIRSTHDR ( &mHdr );
+
+                assert ( cMsg != 0 );
+
+                cMsg->cmsg_level = SOL_UDP;
+                cMsg->cmsg_type = UDP_SEGMENT;
+                cMsg->cmsg_len = CMSG_LEN ( sizeof ( uint16_t ) );
+
+                const uint16_t gsoSize = ( uint16_t ) segSize;
+
+                memcpy ( CMSG_DATA ( cMsg ), &gsoSize, sizeof ( gsoSize ) );
+            }
+
+            // IO vectors of the current message are always at the end of _gsoIovecs.
+            memcpy ( &_gsoIovecs[ numIovecs ], data.getChunks(), data.getNumChunks() * sizeof ( struct iovec ) );
+
+            mHdr.msg_iovlen += data.getNumChunks();
+            numIovecs += data.getNumChunks();
+            msgBytes += size;
+
+            ++_gsoPackets[ numMsg - 1 ];
+
+            // Only the last packet can be shorter than the segment size:
+            canExtend = ( size == segSize );
+        }
+        else
+        {
+            memset ( &_msgs[ numMsg ], 0, sizeof ( _msgs[ 0 ] ) );
+
+            struct msghdr & mHdr = _msgs[ numMsg ].msg_hdr;
+
+            if ( fits )
+            {
+                memcpy ( &_gsoIovecs[ numIovecs ], data.getChunks(), data.getNumChunks() * sizeof ( struct iovec ) );
+
+                mHdr.msg_iov = &_gsoIovecs[ numIovecs ];
+                numIovecs += data.getNumChunks();
+            }
+            else
+            {
+                // No room for its IO vectors. We can still send it on its own.
+                mHdr.msg_iov = const_cast<struct iovec *> ( data.getChunks() );
+            }
+
+            mHdr.msg_iovlen = data.getNumChunks();
+
+            if ( _dest[ idx ].hasIpAddr() )
+            {
+                mHdr.msg_name = &_dest[ idx ];
+                mHdr.msg_namelen = _dest[ idx ].getSocklen();
+            }
+
+            _gsoPackets[ numMsg ] = 1;
+            ++numMsg;
+
+            msgIndex = idx;
+            segSize = size;
+            msgBytes = size;
+            canExtend = fits && size > 0;
+        }
+
+        ++numPackets;
+        numBytes += size;
+    }
+
+    return numMsg;
+#else
+    ( void ) index;
+    ( void ) maxPackets;
+    ( void ) maxBytes;
+
+    return 0;
+#endif
 }
 
 ERRCODE PosixPacketWriterData::dataWritePacket ( int fd, const SockAddr & addr, MemVector & data )
@@ -190,36 +370,60 @@ ERRCODE PosixPacketWriterData::dataWritePackets (
             assert ( _dest != 0 );
 
             uint16_t numMsg = 0;
+            uint16_t numPackets = 0;
             uint32_t numBytes = 0;
 
-            for ( uint16_t idx = index;
-                  packetsWritten + numMsg < maxPackets && bytesWritten + numBytes < maxBytes;
-                  idx = ( idx + 1 ) % QueueSize )
+            if ( _useGso )
+            {
+                numMsg = dataPrepareGsoMsgs (
+                    index, maxPackets - packetsWritten, maxBytes - bytesWritten, numPackets, numBytes );
+            }
+            else
             {
-                assert ( idx < QueueSize );
+                for ( uint16_t idx = index;
+                      packetsWritten + numMsg < maxPackets && bytesWritten + numBytes < maxBytes;
+                      idx = ( idx + 1 ) % QueueSize )
+                {
+                    assert ( idx < QueueSize );
 
-                memset ( &_msgs[ numMsg ], 0, sizeof ( _msgs[ 0 ] ) );
+                    memset ( &_msgs[ numMsg ], 0, sizeof ( _msgs[ 0 ] ) );
 
-                struct msghdr & mHdr = _msgs[ numMsg ].msg_hdr;
+                    struct msghdr & mHdr = _msgs[ numMsg ].msg_hdr;
 
-                mHdr.msg_iov = const_cast<struct iovec *> ( _data[ idx ].getChunks() );
-                mHdr.msg_iovlen = _data[ idx ].getNumChunks();
+                    mHdr.msg_iov = const_cast<struct iovec *> ( _data[ idx ].getChunks() );
+                    mHdr.msg_iovlen = _data[ idx ].getNumChunks();
 
-                if ( _dest[ idx ].hasIpAddr() )
-                {
-                    mHdr.msg_name = &_dest[ idx ];
-                    mHdr.msg_namelen = _dest[ idx ].getSocklen();
+                    if ( _dest[ idx ].hasIpAddr() )
+                    {
+                        mHdr.msg_name = &_dest[ idx ];
+                        mHdr.msg_namelen = _dest[ idx ].getSocklen();
+                    }
+
+                    ++numMsg;
+                    numBytes += _data[ idx ].getDataSize();
                 }
 
-                ++numMsg;
-                numBytes += _data[ idx ].getDataSize();
+                numPackets = numMsg;
             }
 
+            // When some messages carry multiple packets, _gsoPackets contains the number of packets in each one.
+            const bool multiPackets = ( numPackets > numMsg );
+
             const int ret = ::sendmmsg ( fd, _msgs, numMsg, 0 );
 
             // This should be consistent with dataWritePacket() codes:
             if ( ret < 0 )
             {
+                if ( multiPackets && ( errno == EINVAL || errno == EIO || errno == EMSGSIZE ) )
+                {
+                    // The segment size could be too big for the path's MTU,
+                    // or the network interface doesn't support checksum offload that GSO needs.
+                    // Let's stop using GSO and try again.
+
+                    _useGso = false;
+                    continue;
+                }
+
 #ifdef EINVAL
                 if ( errno == EINVAL )
                 {
@@ -239,8 +443,10 @@ ERRCODE PosixPacketWriterData::dataWritePackets (
                     // Otherwise we could get stuck...
                     // We still need to pretend it was written (but we don't include its size).
 
-                    ++packetsWritten;
-                    index = ( index + 1 ) % QueueSize;
+                    const uint16_t skipped = multiPackets ? _gsoPackets[ 0 ] : 1;
+
+                    packetsWritten += skipped;
+                    index = ( index + skipped ) % QueueSize;
                     continue;
                 }
 
@@ -254,18 +460,33 @@ ERRCODE PosixPacketWriterData::dataWritePackets (
 
             if ( ret < numMsg )
             {
-                for ( int i = 0; i < ret; ++i )
+                uint16_t sentPackets = ret;
+
+                if ( multiPackets )
+                {
+                    sentPackets = 0;
+
+                    for ( int i = 0; i < ret; ++i )
+                    {
+                        sentPackets += _gsoPackets[ i ];
+                    }
+                }
+
+                for ( uint16_t i = 0; i < sentPackets; ++i )
                 {
                     bytesWritten += _data[ ( index + i ) % QueueSize ].getDataSize();
                 }
+
+                packetsWritten += sentPackets;
+                index = ( index + sentPackets ) % QueueSize;
             }
             else
             {
                 bytesWritten += numBytes;
+                packetsWritten += numPackets;
+                index = ( index + numPackets ) % QueueSize;
             }
 
-            packetsWritten += ret;
-            index = ( index + ret ) % QueueSize;
             continue;
         }
 #endif
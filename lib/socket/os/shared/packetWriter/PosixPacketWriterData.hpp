@@ -37,6 +37,21 @@ class PosixPacketWriterData
         /// Only used in 'Socket' modes, and only on platforms that support sendmmsg().
         struct mmsghdr * const _msgs;
 
+        /// @brief Array with IO vectors of messages that carry multiple packets (using UDP GSO).
+        /// Only used in 'Socket' mode with multi-writes, when GSO is requested and supported by the platform.
+        struct iovec * const _gsoIovecs;
+
+        /// @brief Array with control data (the segment size) of each message. Used together with _gsoIovecs.
+        char * const _gsoCtrl;
+
+        /// @brief The number of queued packets carried by each message. Used together with _gsoIovecs.
+        uint16_t * const _gsoPackets;
+
+        /// @brief Set when GSO should be used.
+        /// It is set when a file descriptor is configured (if it supports GSO),
+        /// and cleared if a GSO write fails.
+        bool _useGso;
+
         /// @brief Constructor.
         /// @param [in] wType The type of the writer.
         /// @param [in] flags Additional flags.
@@ -71,5 +86,23 @@ class PosixPacketWriterData
         /// @param [in] data The data to send/write.
         /// @return Standard error code.
         ERRCODE dataWritePacket ( int fd, const SockAddr & addr, MemVector & data );
+
+        /// @brief Checks if UDP GSO can be used with the given file descriptor.
+        /// It sets _useGso accordingly.
+        /// @param [in] fd The file descriptor to check. Could be invalid.
+        void dataSetupGso ( int fd );
+
+        /// @brief An internal function that prepares messages for sendmmsg() using UDP GSO.
+        /// Consecutive packets to the same destination that have the same size are combined into a single message.
+        /// Only the last packet in each message can be shorter than the others.
+        /// @param [in] index The index in packet array to start from.
+        /// @param [in] maxPackets The max number of packets to prepare.
+        /// @param [in] maxBytes The max number of bytes to prepare. It is not strictly enforced (like in
+        ///                      dataWritePackets()).
+        /// @param [out] numPackets The number of packets included in all prepared messages.
+        /// @param [out] numBytes The number of bytes included in all prepared messages.
+        /// @return The number of messages prepared.
+        uint16_t dataPrepareGsoMsgs (
+            uint16_t index, uint16_t maxPackets, uint32_t maxBytes, uint16_t & numPackets, uint32_t & numBytes );
 };
 }
@@ -70,6 +70,11 @@ ERRCODE Socks5TcpBaseSocket::send ( const char * data, size_t & dataSize )
     return ( isSocks5Connected() ) ? ( TcpFdSocket::send ( data, dataSize ) ) : ( Error::NotConnected );
 }
 
+ERRCODE Socks5TcpBaseSocket::send ( MemVector & data )
+{
+    return ( isSocks5Connected() ) ? ( TcpFdSocket::send ( data ) ) : ( Error::NotConnected );
+}
+
 bool Socks5TcpBaseSocket::sendSocks5Data ( const MemHandle & data )
 {
     if ( isSocks5Connected() )
@@ -36,6 +36,7 @@ class Socks5TcpBaseSocket: public TcpFdSocket
 
         virtual ERRCODE send ( const char * data, size_t & dataSize );
         virtual ERRCODE send ( MemHandle & data );
+        virtual ERRCODE send ( MemVector & data );
 
         /// @brief A helper method that checks if SOCKS5 handshake has been finished.
         /// @return True if SOCKS5 handshake is done and we should behave like a regular TCP socket; False otherwise.
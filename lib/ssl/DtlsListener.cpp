@@ -28,18 +28,23 @@ using namespace Pravala;
 
 TextLog DtlsListener::_log ( "dtls_listener" );
 
+ConfigLimitedNumber<uint16_t> DtlsListener::optNumSockets (
+        0,
+        "ssl.dtls_listener.sockets",
+        "The number of UDP sockets (bound to the same port using SO_REUSEPORT) used by each DTLS listener",
+        1, 64, 1
+);
+
 DtlsListener::DtlsListener ( Owner & owner, DtlsServer & dtlsContext ):
     _owner ( owner ),
-    _dtlsContext ( dtlsContext ),
-    _listeningUdpSock ( 0 ),
-    _listeningDtlsSock ( 0 )
+    _dtlsContext ( dtlsContext )
 {
     assert ( _dtlsContext.getContext() != 0 );
 }
 
-ERRCODE DtlsListener::init ( const SockAddr & localAddr )
+ERRCODE DtlsListener::init ( const SockAddr & localAddr, uint16_t numSockets )
 {
-    if ( _listeningUdpSock != 0 || _listeningDtlsSock != 0 )
+    if ( !_listeningUdpSocks.isEmpty() || !_listeningDtlsSocks.isEmpty() )
     {
         return Error::AlreadyInitialized;
     }
@@ -49,64 +54,112 @@ ERRCODE DtlsListener::init ( const SockAddr & localAddr )
         return Error::InvalidParameter;
     }
 
-    ERRCODE eCode;
+    if ( numSockets < 1 )
+    {
+        numSockets = optNumSockets.value();
+    }
 
-    UdpListener * listener = UdpFdListener::generate ( localAddr, &eCode );
+    // With a single socket we don't need SO_REUSEPORT:
+    const bool reusePort = ( numSockets > 1 );
 
-    if ( !listener )
+    for ( uint16_t i = 0; i < numSockets; ++i )
     {
-        LOG ( L_ERROR, localAddr << ": Error creating a UDP listener" );
+        ERRCODE eCode;
 
-        return eCode;
-    }
+        UdpListener * listener = UdpFdListener::generate ( localAddr, &eCode, reusePort );
 
-    assert ( !_listeningUdpSock );
+        UdpSocket * udpSock = 0;
 
-    _listeningUdpSock = listener->generateListeningSock ( 0, &eCode );
+        if ( !listener )
+        {
+            LOG ( L_ERROR, localAddr << ": Error creating a UDP listener" );
+        }
+        else
+        {
+            udpSock = listener->generateListeningSock ( 0, &eCode );
 
-    // _listeningUdpSock now holds the reference to the listener, and we don't need it anymore, so we can unref it.
-    listener->unref();
-    listener = 0;
+            // udpSock now holds the reference to the listener, and we don't need it anymore, so we can unref it.
+            listener->unref();
+            listener = 0;
 
-    if ( !_listeningUdpSock )
-    {
-        LOG ( L_ERROR, localAddr << ": Error creating a listening UDP socket" );
+            if ( !udpSock )
+            {
+                LOG ( L_ERROR, localAddr << ": Error creating a listening UDP socket" );
+            }
+        }
 
-        return eCode;
+        if ( !udpSock )
+        {
+            for ( size_t j = 0; j < _listeningUdpSocks.size(); ++j )
+            {
+                _listeningUdpSocks.at ( j )->unrefOwner ( this );
+            }
+
+            _listeningUdpSocks.clear();
+
+            return eCode;
+        }
+
+        _listeningUdpSocks.append ( udpSock );
     }
 
-    LOG ( L_DEBUG, localAddr << ": Created a listening UDP socket" );
+    LOG ( L_DEBUG, localAddr << ": Created " << _listeningUdpSocks.size() << " listening UDP socket(s)" );
+
+    for ( size_t i = 0; i < _listeningUdpSocks.size(); ++i )
+    {
+        _listeningDtlsSocks.append ( 0 );
 
-    createDtlsListeningSock();
+        createDtlsListeningSock ( i );
+    }
 
     return Error::Success;
 }
 
 DtlsListener::~DtlsListener()
 {
-    if ( _listeningDtlsSock != 0 )
+    for ( size_t i = 0; i < _listeningDtlsSocks.size(); ++i )
     {
-        _listeningDtlsSock->unrefOwner ( this );
-        _listeningDtlsSock = 0;
+        if ( _listeningDtlsSocks.at ( i ) != 0 )
+        {
+            _listeningDtlsSocks.at ( i )->unrefOwner ( this );
+        }
     }
 
-    if ( _listeningUdpSock != 0 )
+    _listeningDtlsSocks.clear();
+
+    for ( size_t i = 0; i < _listeningUdpSocks.size(); ++i )
     {
-        _listeningUdpSock->unrefOwner ( this );
-        _listeningUdpSock = 0;
+        _listeningUdpSocks.at ( i )->unrefOwner ( this );
     }
+
+    _listeningUdpSocks.clear();
 }
 
-void DtlsListener::createDtlsListeningSock()
+void DtlsListener::createDtlsListeningSock ( size_t idx )
 {
-    if ( !_listeningUdpSock || _listeningDtlsSock != 0 )
+    if ( idx >= _listeningUdpSocks.size() || idx >= _listeningDtlsSocks.size() || _listeningDtlsSocks.at ( idx ) != 0 )
     {
         assert ( false );
 
         return;
     }
 
-    _listeningDtlsSock = new DtlsSocket ( this, _dtlsContext, _listeningUdpSock, SSL_OP_COOKIE_EXCHANGE );
+    _listeningDtlsSocks[ idx ] = new DtlsSocket (
+        this, _dtlsContext, _listeningUdpSocks.at ( idx ), SSL_OP_COOKIE_EXCHANGE );
+}
+
+int DtlsListener::findListeningSock ( const Socket * sock ) const
+{
+    for ( size_t i = 0; i < _listeningUdpSocks.size(); ++i )
+    {
+        if ( sock == _listeningUdpSocks.at ( i )
+             || ( i < _listeningDtlsSocks.size() && sock == _listeningDtlsSocks.at ( i ) ) )
+        {
+            return ( int ) i;
+        }
+    }
+
+    return -1;
 }
 
 void DtlsListener::socketConnected ( Socket * )
@@ -135,12 +188,19 @@ void DtlsListener::socketDataReceived ( Socket *, MemHandle & )
 
 void DtlsListener::socketClosed ( Socket * sock, ERRCODE reason )
 {
-    ( void ) sock;
     assert ( sock != 0 );
     assert ( sock->getIpSocket() != 0 );
-    assert ( sock == _listeningUdpSock || sock == _listeningDtlsSock );
 
-    if ( sock == _listeningUdpSock )
+    const int idx = findListeningSock ( sock );
+
+    assert ( idx >= 0 );
+
+    if ( idx < 0 )
+    {
+        return;
+    }
+
+    if ( sock == _listeningUdpSocks.at ( idx ) )
     {
         LOG_ERR ( L_FATAL_ERROR, reason,
                   "UDP socket listening on " << sock->getIpSocket()->getRemoteSockAddr() << " has been closed" );
@@ -149,34 +209,41 @@ void DtlsListener::socketClosed ( Socket * sock, ERRCODE reason )
         return;
     }
 
-    if ( sock == _listeningDtlsSock )
-    {
-        // This could happen if something goes wrong while generating connected UDP socket or configuring
-        // the DTLS socket.
+    assert ( sock == _listeningDtlsSocks.at ( idx ) );
 
-        LOG_ERR ( L_ERROR, reason,
-                  "Listening DTLS socket closed; Remote address: " << sock->getIpSocket()->getRemoteSockAddr() );
+    // This could happen if something goes wrong while generating connected UDP socket or configuring
+    // the DTLS socket.
 
-        _listeningDtlsSock = 0;
-        sock->unrefOwner ( this );
+    LOG_ERR ( L_ERROR, reason,
+              "Listening DTLS socket closed; Remote address: " << sock->getIpSocket()->getRemoteSockAddr() );
 
-        createDtlsListeningSock();
-        return;
-    }
+    _listeningDtlsSocks[ idx ] = 0;
+    sock->unrefOwner ( this );
+
+    createDtlsListeningSock ( idx );
 }
 
 void DtlsListener::dtlsSocketListenSucceeded ( DtlsSocket * sock )
 {
     assert ( sock != 0 );
-    assert ( sock == _listeningDtlsSock );
+
+    const int idx = findListeningSock ( sock );
+
+    assert ( idx >= 0 );
+    assert ( sock == _listeningDtlsSocks.at ( idx ) );
+
+    if ( idx < 0 )
+    {
+        return;
+    }
 
     // DTLS listen succeeded. The listening DTLS socket is now connecting to a specific remote host.
-    // It also uses a new, connected UDP socket.
+    // It also uses a new, connected UDP socket (which shares the listening UDP socket's FD).
     // We need to create a new listening DTLS socket.
 
-    _listeningDtlsSock = 0;
+    _listeningDtlsSocks[ idx ] = 0;
 
-    createDtlsListeningSock();
+    createDtlsListeningSock ( idx );
 
     _owner.incomingDtlsConnection ( this, sock );
 
@@ -189,9 +256,8 @@ void DtlsListener::dtlsSocketListenSucceeded ( DtlsSocket * sock )
 
 void DtlsListener::dtlsSocketUnexpectedDataReceived ( DtlsSocket * sock, const MemHandle & data )
 {
-    ( void ) sock;
     assert ( sock != 0 );
-    assert ( sock == _listeningDtlsSock );
+    assert ( findListeningSock ( sock ) >= 0 );
 
     LOG ( L_DEBUG, "Received unexpected data on DTLS socket while listening; Data (size: "
           << data.size() << "): " << String::hexDump ( data.get(), data.size() ) );
@@ -17,6 +17,8 @@
 #pragma once
 
 #include "basic/NoCopy.hpp"
+#include "basic/List.hpp"
+#include "config/ConfigNumber.hpp"
 
 #include "DtlsSocket.hpp"
 
@@ -29,9 +31,16 @@ class UdpSocket;
 
 /// @brief DTLS listener
 /// It opens a listening socket and waits for incoming DTLS "connections".
+/// All the peers share the same UDP socket (it uses UdpFdListener, which receives packets in batches and sends them
+/// using PacketWriter). Packets are passed to the DtlsSocket of each peer based on their source address.
+/// To spread the load, several UDP sockets (bound to the same address and port using SO_REUSEPORT) can be used.
+/// The kernel will then distribute peers between those sockets (based on their addresses).
 class DtlsListener: public NoCopy, protected DtlsSocket::Owner
 {
     public:
+        /// @brief The number of UDP sockets (bound to the same address and port) used by each DTLS listener.
+        static ConfigLimitedNumber<uint16_t> optNumSockets;
+
         /// @brief The owner of the DtlsListener
         class Owner
         {
@@ -68,16 +77,27 @@ class DtlsListener: public NoCopy, protected DtlsSocket::Owner
 
         /// @brief Initializes the listener
         /// @param [in] localAddr Local address and port to listen on
+        /// @param [in] numSockets The number of UDP sockets to use. If there is more than one,
+        ///                        they will all be bound to the same address and port, using SO_REUSEPORT.
+        ///                        0 means that the value of optNumSockets should be used.
         /// @return Standard error code.
-        ERRCODE init ( const SockAddr & localAddr );
+        ERRCODE init ( const SockAddr & localAddr, uint16_t numSockets = 0 );
 
         /// @brief Initializes the listener
         /// @param [in] localAddr Local address to listen on
         /// @param [in] localPort Local port to listen on
+        /// @param [in] numSockets The number of UDP sockets to use (0 means that optNumSockets should be used).
         /// @return Standard error code.
-        inline ERRCODE init ( const IpAddress & localAddr, uint16_t localPort )
+        inline ERRCODE init ( const IpAddress & localAddr, uint16_t localPort, uint16_t numSockets = 0 )
+        {
+            return DtlsListener::init ( SockAddr ( localAddr, localPort ), numSockets );
+        }
+
+        /// @brief Returns the number of UDP sockets used by this listener.
+        /// @return The number of UDP sockets used by this listener.
+        inline size_t getNumSockets() const
         {
-            return DtlsListener::init ( SockAddr ( localAddr, localPort ) );
+            return _listeningUdpSocks.size();
         }
 
         /// @brief Destructor
@@ -100,16 +120,24 @@ class DtlsListener: public NoCopy, protected DtlsSocket::Owner
         Owner & _owner; ///< Owner of the listener
         DtlsServer & _dtlsContext; ///< The DTLS context to use
 
-        UdpSocket * _listeningUdpSock; ///< The UDP socket that DTLS sockets are using for listening.
+        /// @brief The UDP sockets that DTLS sockets are using for listening (one for each UDP listener).
+        List<UdpSocket *> _listeningUdpSocks;
 
-        /// @brief DtlsSocket object used for listening.
-        /// Once DTLS listen succeeds, this object will be used as the new connection,
-        /// and a new 'listening' DtlsSocket will be created to replace this.
-        DtlsSocket * _listeningDtlsSock;
+        /// @brief DtlsSocket objects used for listening (one for each listening UDP socket, using the same index).
+        /// Once DTLS listen succeeds, such object will be used as the new connection,
+        /// and a new 'listening' DtlsSocket will be created to replace it.
+        List<DtlsSocket *> _listeningDtlsSocks;
 
         /// @brief Helper function that creates a new listening DTLS socket.
-        /// It doesn't do anything if _listeningUdpSock is not set, or _listeningDtlsSock is already set.
-        void createDtlsListeningSock();
+        /// It doesn't do anything if there is no listening UDP socket with that index,
+        /// or the listening DTLS socket for that index is already set.
+        /// @param [in] idx The index of the listening UDP socket to use.
+        void createDtlsListeningSock ( size_t idx );
+
+        /// @brief Finds the index of the listening socket.
+        /// @param [in] sock The socket to find. It can be either a listening UDP socket, or a listening DTLS socket.
+        /// @return The index of the socket, or -1 if it was not found.
+        int findListeningSock ( const Socket * sock ) const;
 };
 }
 #endif
@@ -207,6 +207,8 @@ void DtlsSocket::socketConnected ( Socket * sock )
     {
         LOG ( L_DEBUG2, getLogId() << ": Underlying UDP socket is now connected" );
 
+        setupSessionResumption ( _udpSocket->getRemoteSockAddr() );
+
         // DtlsSocket is still 'connecting'. But we want to perform the initial accept/connect.
         // We can't run this right away, because we may have been called synchronously!
         scheduleEvents ( SockDtlsEventInitialOp );
@@ -390,6 +392,8 @@ void DtlsSocket::doInitialOp()
 
     clearFlags ( SockSslFlagAcceptNeeded | SockSslFlagConnectNeeded );
 
+    handshakeCompleted();
+
     doSockConnected();
     return;
 }
@@ -103,6 +103,12 @@ size_t SSL_SESSION_get_master_key ( const SSL_SESSION * s, unsigned char * out,
     return outlen;
 }
 
+int SSL_SESSION_up_ref ( SSL_SESSION * s )
+{
+    CRYPTO_add ( &s->references, 1, CRYPTO_LOCK_SSL_SESSION );
+    return 1;
+}
+
 // Boring SSL doesn't support DTLS servers
 int Pravala::Prav_DTLSv1_listen ( SSL * s, SockAddr & remoteAddr )
 {
@@ -59,6 +59,8 @@ size_t SSL_SESSION_get_master_key ( const SSL_SESSION * ssl, unsigned char * out
 
 #if ( OPENSSL_VERSION_NUMBER < 0x10100000L ) && !defined( OPENSSL_IS_BORINGSSL )
 
+int SSL_SESSION_up_ref ( SSL_SESSION * s );
+
 #define DTLS_client_method    DTLSv1_client_method
 #define DTLS_server_method    DTLSv1_server_method
 #endif
@@ -18,6 +18,13 @@ extern "C"
 {
 #include <openssl/rand.h>
 #include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+#if ( OPENSSL_VERSION_NUMBER >= 0x30000000L ) && !defined( OPENSSL_IS_BORINGSSL )
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+#endif
 }
 
 #include "sys/SocketApi.hpp"
@@ -46,12 +53,47 @@ ConfigString SslContext::optSslCipherListTls (
         "(see openssl ciphers)"
 );
 
+ConfigLimitedNumber<uint32_t> SslContext::optSessionCacheSize (
+        ConfigOpt::FlagInitializeOnly,
+        "ssl.session_cache_size",
+        "The max number of sessions cached by each SSL context, for session resumption; 0 disables the cache",
+        0, 1024 * 1024, 0
+);
+
+ConfigLimitedNumber<uint32_t> SslContext::optSessionLifetime (
+        ConfigOpt::FlagInitializeOnly,
+        "ssl.session_lifetime",
+        "The lifetime of cached SSL sessions and session tickets (in seconds)",
+        1, 7 * 24 * 3600, 3600
+);
+
+ConfigNumber<bool> SslContext::optSessionTickets (
+        ConfigOpt::FlagInitializeOnly,
+        "ssl.session_tickets",
+        "Whether SSL servers should issue (and accept) stateless session tickets",
+        false
+);
+
+ConfigLimitedNumber<uint32_t> SslContext::optTicketKeyLifetime (
+        ConfigOpt::FlagInitializeOnly,
+        "ssl.session_ticket_key_lifetime",
+        "How often the key used for encrypting session tickets is replaced (in seconds); "
+        "Tickets encrypted using the previous key are still accepted (and renewed)",
+        60, 7 * 24 * 3600, 3600
+);
+
 SslContext::SslContext ( ContextType contextType ):
     _ctx ( 0 ),
     _verifyCallback ( 0 ),
     _verifyMode ( SSL_VERIFY_NONE ),
-    _type ( contextType )
+    _type ( contextType ),
+    _sessionMutex ( "SslContext" ),
+    _sessionUseCounter ( 0 ),
+    _numFullHandshakes ( 0 ),
+    _numResumedHandshakes ( 0 )
 {
+    memset ( _ticketKeys, 0, sizeof ( _ticketKeys ) );
+
     // Detect if we can run properly on this machine.
     // If the system has support for AES NI and the OpenSSL version is too old it will crash inside DTLS code.
     // OpenSSL 1.0.1 doesn't work, 1.0.1c is fine.
@@ -139,7 +181,9 @@ SslContext::SslContext ( ContextType contextType ):
         return;
     }
 
-    SSL_CTX_set_session_cache_mode ( _ctx, SSL_SESS_CACHE_OFF );
+    SSL_CTX_set_app_data ( _ctx, this );
+
+    setupSessionResumption();
 
     SSL_CTX_set_verify_depth ( _ctx, 2 );
     SSL_CTX_set_read_ahead ( _ctx, 1 );
@@ -201,8 +245,12 @@ TlsServer::TlsServer(): TlsContext ( ContextTlsServer )
 
 SslContext::~SslContext()
 {
+    clearCachedSessions();
+
     if ( _ctx != 0 )
     {
+        // SSL objects may still hold references to the SSL_CTX, so it may not be destroyed right away:
+        SSL_CTX_set_app_data ( _ctx, 0 );
         SSL_CTX_free ( _ctx );
         _ctx = 0;
     }
@@ -563,6 +611,350 @@ void SslContext::setSslVerify()
     SSL_CTX_set_verify ( _ctx, _verifyMode, _verifyCallback );
 }
 
+void SslContext::setupSessionResumption()
+{
+    assert ( _ctx != 0 );
+
+    const long lifetime = optSessionLifetime.value();
+
+    if ( isServer() )
+    {
+        if ( optSessionCacheSize.value() > 0 )
+        {
+            // Sessions can only be resumed using the context with the same session ID context.
+            // Without it, OpenSSL refuses to resume sessions when client certificates are verified.
+            const char * sidCtx = getContextTypeName();
+
+            SSL_CTX_set_session_id_context ( _ctx, ( const unsigned char * ) sidCtx, strlen ( sidCtx ) );
+            SSL_CTX_set_session_cache_mode ( _ctx, SSL_SESS_CACHE_SERVER );
+            SSL_CTX_sess_set_cache_size ( _ctx, optSessionCacheSize.value() );
+        }
+        else
+        {
+            SSL_CTX_set_session_cache_mode ( _ctx, SSL_SESS_CACHE_OFF );
+        }
+
+        SSL_CTX_set_timeout ( _ctx, lifetime );
+
+#if ( OPENSSL_VERSION_NUMBER >= 0x10101000L ) && !defined( OPENSSL_IS_BORINGSSL )
+        // TLS 1.3 servers send 2 tickets by default, but our clients only keep the most recent session.
+        // With the (stateful) session cache, each ticket would also use an entry in the cache.
+        SSL_CTX_set_num_tickets ( _ctx, 1 );
+#endif
+
+        bool useTickets = optSessionTickets.value();
+
+        if ( useTickets )
+        {
+            MutexLock m ( _sessionMutex );
+
+            useTickets = rotateTicketKey();
+        }
+
+        if ( useTickets )
+        {
+#if ( OPENSSL_VERSION_NUMBER >= 0x30000000L ) && !defined( OPENSSL_IS_BORINGSSL )
+            SSL_CTX_set_tlsext_ticket_key_evp_cb ( _ctx, ticketKeyCallback );
+#else
+            SSL_CTX_set_tlsext_ticket_key_cb ( _ctx, ticketKeyCallback );
+#endif
+            SSL_CTX_clear_options ( _ctx, SSL_OP_NO_TICKET );
+        }
+        else
+        {
+            SSL_CTX_set_options ( _ctx, SSL_OP_NO_TICKET );
+        }
+
+        LOG ( L_DEBUG, getContextTypeName() << ": Session cache size: " << optSessionCacheSize.value()
+              << "; Session tickets: " << ( useTickets ? "enabled" : "disabled" )
+              << "; Session lifetime: " << lifetime << "s" );
+        return;
+    }
+
+    if ( optSessionCacheSize.value() > 0 )
+    {
+        // Client sessions are stored by us (see storeClientSession()), not in OpenSSL's internal cache.
+        // OpenSSL's cache would not let us look them up by the remote address.
+        SSL_CTX_set_session_cache_mode ( _ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE );
+        SSL_CTX_sess_set_new_cb ( _ctx, newSessionCallback );
+        SSL_CTX_set_timeout ( _ctx, lifetime );
+    }
+    else
+    {
+        SSL_CTX_set_session_cache_mode ( _ctx, SSL_SESS_CACHE_OFF );
+    }
+}
+
+bool SslContext::rotateTicketKey()
+{
+    TicketKey newKey;
+
+    ERR_clear_error();
+
+    if ( RAND_bytes ( newKey.name, sizeof ( newKey.name ) ) != 1
+         || RAND_bytes ( newKey.aesKey, sizeof ( newKey.aesKey ) ) != 1
+         || RAND_bytes ( newKey.hmacKey, sizeof ( newKey.hmacKey ) ) != 1 )
+    {
+        LOG ( L_ERROR, getContextTypeName() << ": Could not generate a new session ticket key" );
+
+        logSslErrors ( "rotateTicketKey()" );
+
+        return false;
+    }
+
+    newKey.created = time ( 0 );
+
+    _ticketKeys[ 1 ] = _ticketKeys[ 0 ];
+    _ticketKeys[ 0 ] = newKey;
+
+    LOG ( L_DEBUG, getContextTypeName() << ": Generated a new session ticket key" );
+
+    return true;
+}
+
+SslContext * SslContext::getSslContext ( SSL * ssl )
+{
+    SSL_CTX * const ctx = ( ssl != 0 ) ? SSL_get_SSL_CTX ( ssl ) : 0;
+
+    return ( ctx != 0 ) ? ( ( SslContext * ) SSL_CTX_get_app_data ( ctx ) ) : 0;
+}
+
+String SslContext::getClientSessionKey ( const SockAddr & remoteAddr, const String & sniHostname )
+{
+    return String ( "%1/%2" ).arg ( remoteAddr.toString(), sniHostname );
+}
+
+size_t SslContext::getNumCachedSessions()
+{
+    MutexLock m ( _sessionMutex );
+
+    return _clientSessions.size();
+}
+
+void SslContext::clearCachedSessions()
+{
+    MutexLock m ( _sessionMutex );
+
+    for ( HashMap<String, CachedSession>::Iterator it ( _clientSessions ); it.isValid(); it.next() )
+    {
+        SSL_SESSION_free ( it.value().session );
+    }
+
+    _clientSessions.clear();
+}
+
+SSL_SESSION * SslContext::findClientSession ( const String & sessionKey )
+{
+    MutexLock m ( _sessionMutex );
+
+    CachedSession entry;
+
+    if ( !_clientSessions.find ( sessionKey, entry ) )
+    {
+        return 0;
+    }
+
+    assert ( entry.session != 0 );
+
+    if ( ( long ) SSL_SESSION_get_time ( entry.session ) + SSL_SESSION_get_timeout ( entry.session )
+         <= ( long ) time ( 0 ) )
+    {
+        LOG ( L_DEBUG2, getContextTypeName() << ": Cached session for " << sessionKey << " has expired" );
+
+        SSL_SESSION_free ( entry.session );
+        _clientSessions.remove ( sessionKey );
+
+        return 0;
+    }
+
+    _clientSessions[ sessionKey ].lastUsed = ++_sessionUseCounter;
+
+    SSL_SESSION_up_ref ( entry.session );
+
+    return entry.session;
+}
+
+bool SslContext::storeClientSession ( const String & sessionKey, SSL_SESSION * session )
+{
+    if ( !session || sessionKey.isEmpty() || optSessionCacheSize.value() < 1 )
+    {
+        return false;
+    }
+
+    MutexLock m ( _sessionMutex );
+
+    CachedSession & entry = _clientSessions[ sessionKey ];
+
+    if ( entry.session != 0 )
+    {
+        // We are replacing an older session:
+        SSL_SESSION_free ( entry.session );
+    }
+    else if ( _clientSessions.size() > optSessionCacheSize.value() )
+    {
+        // The new entry has already been added, so there is at least one other entry to remove.
+        // This is linear, but it only happens when the cache is full.
+
+        String lruKey;
+        uint64_t lruUsed = 0;
+
+        for ( HashMap<String, CachedSession>::Iterator it ( _clientSessions ); it.isValid(); it.next() )
+        {
+            if ( it.value().session != 0 && ( lruKey.isEmpty() || it.value().lastUsed < lruUsed ) )
+            {
+                lruKey = it.key();
+                lruUsed = it.value().lastUsed;
+            }
+        }
+
+        CachedSession lruEntry;
+
+        if ( _clientSessions.findAndRemove ( lruKey, lruEntry ) )
+        {
+            SSL_SESSION_free ( lruEntry.session );
+        }
+    }
+
+    // The reference to 'entry' may not be valid after removing other entries:
+    CachedSession & newEntry = _clientSessions[ sessionKey ];
+
+    newEntry.session = session;
+    newEntry.lastUsed = ++_sessionUseCounter;
+
+    return true;
+}
+
+void SslContext::removeClientSession ( const String & sessionKey, const SSL_SESSION * session )
+{
+    if ( !session || sessionKey.isEmpty() )
+    {
+        return;
+    }
+
+    MutexLock m ( _sessionMutex );
+
+    CachedSession entry;
+
+    if ( _clientSessions.find ( sessionKey, entry ) && entry.session == session )
+    {
+        LOG ( L_DEBUG2, getContextTypeName() << ": Removing cached session for " << sessionKey );
+
+        SSL_SESSION_free ( entry.session );
+        _clientSessions.remove ( sessionKey );
+    }
+}
+
+void SslContext::handshakeCompleted ( bool resumed )
+{
+    if ( resumed )
+    {
+        __sync_fetch_and_add ( &_numResumedHandshakes, 1 );
+    }
+    else
+    {
+        __sync_fetch_and_add ( &_numFullHandshakes, 1 );
+    }
+}
+
+int SslContext::newSessionCallback ( SSL * ssl, SSL_SESSION * session )
+{
+    SslContext * const ctx = getSslContext ( ssl );
+    const String * const sessionKey = ( ssl != 0 ) ? ( ( const String * ) SSL_get_app_data ( ssl ) ) : 0;
+
+    if ( !ctx || !sessionKey || !ctx->storeClientSession ( *sessionKey, session ) )
+    {
+        return 0;
+    }
+
+    LOG ( L_DEBUG2, ctx->getContextTypeName() << ": Stored a new session for " << *sessionKey );
+
+    return 1;
+}
+
+#if ( OPENSSL_VERSION_NUMBER >= 0x30000000L ) && !defined( OPENSSL_IS_BORINGSSL )
+int SslContext::ticketKeyCallback (
+        SSL * ssl, unsigned char * keyName, unsigned char * iv,
+        EVP_CIPHER_CTX * cCtx, EVP_MAC_CTX * hCtx, int enc )
+#else
+int SslContext::ticketKeyCallback (
+        SSL * ssl, unsigned char * keyName, unsigned char * iv,
+        EVP_CIPHER_CTX * cCtx, HMAC_CTX * hCtx, int enc )
+#endif
+{
+    SslContext * const ctx = getSslContext ( ssl );
+
+    if ( !ctx )
+    {
+        return -1;
+    }
+
+    TicketKey key;
+    int ret = 1;
+
+    {
+        MutexLock m ( ctx->_sessionMutex );
+
+        if ( enc != 0 )
+        {
+            if ( time ( 0 ) - ctx->_ticketKeys[ 0 ].created >= ( time_t ) optTicketKeyLifetime.value() )
+            {
+                // If this fails, we keep using the old key.
+                ctx->rotateTicketKey();
+            }
+
+            key = ctx->_ticketKeys[ 0 ];
+        }
+        else if ( memcmp ( keyName, ctx->_ticketKeys[ 0 ].name, sizeof ( key.name ) ) == 0 )
+        {
+            key = ctx->_ticketKeys[ 0 ];
+        }
+        else if ( ctx->_ticketKeys[ 1 ].created != 0
+                  && memcmp ( keyName, ctx->_ticketKeys[ 1 ].name, sizeof ( key.name ) ) == 0 )
+        {
+            // The ticket is still valid, but the client should get a new one, encrypted using the current key.
+            key = ctx->_ticketKeys[ 1 ];
+            ret = 2;
+        }
+        else
+        {
+            // Unknown (or too old) key - full handshake will be performed.
+            return 0;
+        }
+    }
+
+    if ( enc != 0 )
+    {
+        memcpy ( keyName, key.name, sizeof ( key.name ) );
+
+        if ( RAND_bytes ( iv, EVP_CIPHER_iv_length ( EVP_aes_256_cbc() ) ) != 1
+             || EVP_EncryptInit_ex ( cCtx, EVP_aes_256_cbc(), 0, key.aesKey, iv ) != 1 )
+        {
+            return -1;
+        }
+    }
+    else if ( EVP_DecryptInit_ex ( cCtx, EVP_aes_256_cbc(), 0, key.aesKey, iv ) != 1 )
+    {
+        return -1;
+    }
+
+#if ( OPENSSL_VERSION_NUMBER >= 0x30000000L ) && !defined( OPENSSL_IS_BORINGSSL )
+    OSSL_PARAM params[ 3 ];
+
+    params[ 0 ] = OSSL_PARAM_construct_octet_string ( OSSL_MAC_PARAM_KEY, key.hmacKey, sizeof ( key.hmacKey ) );
+    params[ 1 ] = OSSL_PARAM_construct_utf8_string ( OSSL_MAC_PARAM_DIGEST, const_cast<char *> ( "SHA256" ), 0 );
+    params[ 2 ] = OSSL_PARAM_construct_end();
+
+    if ( EVP_MAC_CTX_set_params ( hCtx, params ) != 1 )
+#else
+    if ( HMAC_Init_ex ( hCtx, key.hmacKey, sizeof ( key.hmacKey ), EVP_sha256(), 0 ) != 1 )
+#endif
+    {
+        return -1;
+    }
+
+    return ret;
+}
+
 void SslContext::logSslErrors ( const char * forMethod, const Log::LogLevel & logLevel )
 {
     ( void ) forMethod;
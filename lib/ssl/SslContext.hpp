@@ -16,9 +16,13 @@
 
 #pragma once
 
+#include "basic/HashMap.hpp"
+#include "basic/Mutex.hpp"
+#include "basic/SockAddr.hpp"
 #include "error/Error.hpp"
 #include "log/TextLog.hpp"
 #include "config/ConfigString.hpp"
+#include "config/ConfigNumber.hpp"
 
 // Compilers are not happy with OpenSSL code when 'pedantic' is enabled...
 
@@ -57,6 +61,13 @@ extern "C"
 #endif
 
 typedef struct evp_pkey_st EVP_PKEY;
+typedef struct evp_cipher_ctx_st EVP_CIPHER_CTX;
+
+#if ( OPENSSL_VERSION_NUMBER >= 0x30000000L ) && !defined( OPENSSL_IS_BORINGSSL )
+typedef struct evp_mac_ctx_st EVP_MAC_CTX;
+#else
+typedef struct hmac_ctx_st HMAC_CTX;
+#endif
 
 namespace Pravala
 {
@@ -68,6 +79,20 @@ class SslContext
         static ConfigString optSslCipherList; ///< the cipher list string passed to setCipherList()
         static ConfigString optSslCipherListTls; ///< the cipher list string passed to setCipherList() for TLS context
 
+        /// @brief The max number of sessions cached by each context (for session resumption).
+        /// Server contexts use OpenSSL's internal session cache, client contexts keep the most recently used
+        /// sessions for each remote address and SNI hostname. 0 disables session caching.
+        static ConfigLimitedNumber<uint32_t> optSessionCacheSize;
+
+        /// @brief The lifetime of cached sessions and session tickets (in seconds).
+        static ConfigLimitedNumber<uint32_t> optSessionLifetime;
+
+        /// @brief If set, server contexts issue (and accept) stateless session tickets.
+        static ConfigNumber<bool> optSessionTickets;
+
+        /// @brief How often the key used for encrypting session tickets is replaced (in seconds).
+        static ConfigLimitedNumber<uint32_t> optTicketKeyLifetime;
+
         /// @brief Returns internal SSL_CTX pointer
         /// @return Internal SSL_CTX pointer
         inline SSL_CTX * getContext()
@@ -185,6 +210,27 @@ class SslContext
         /// @param [in] sniHostname The new SNI hostname to use
         void setSniHostname ( const String & sniHostname );
 
+        /// @brief Returns the number of handshakes completed using this context that established a new session.
+        /// @return The number of full handshakes.
+        inline uint32_t getNumFullHandshakes() const
+        {
+            return _numFullHandshakes;
+        }
+
+        /// @brief Returns the number of handshakes completed using this context that resumed an existing session.
+        /// @return The number of abbreviated (resumed) handshakes.
+        inline uint32_t getNumResumedHandshakes() const
+        {
+            return _numResumedHandshakes;
+        }
+
+        /// @brief Returns the number of client sessions currently cached by this context.
+        /// @return The number of client sessions cached; Always 0 for server contexts.
+        size_t getNumCachedSessions();
+
+        /// @brief Removes all the client sessions cached by this context.
+        void clearCachedSessions();
+
         /// @brief Destructor
         virtual ~SslContext();
 
@@ -209,6 +255,27 @@ class SslContext
             ContextTlsServer ///< TLS server's context
         };
 
+        /// @brief A client session cached by the context.
+        struct CachedSession
+        {
+            SSL_SESSION * session; ///< The session (we hold a reference to it).
+            uint64_t lastUsed; ///< The value of the 'use counter' when this session was last stored or used.
+
+            /// @brief Default constructor.
+            CachedSession(): session ( 0 ), lastUsed ( 0 )
+            {
+            }
+        };
+
+        /// @brief The key used for encrypting session tickets.
+        struct TicketKey
+        {
+            unsigned char name[ 16 ]; ///< The name of the key (included in tickets).
+            unsigned char aesKey[ 32 ]; ///< The AES-256 key.
+            unsigned char hmacKey[ 32 ]; ///< The HMAC-SHA256 key.
+            time_t created; ///< When the key was generated (0 if it is not valid).
+        };
+
         static TextLog _log; ///< Log stream
 
         static bool _sslIsInitialized; ///< A flag used for initializing SSL library
@@ -222,6 +289,21 @@ class SslContext
 
         const ContextType _type; ///< The context type (client/server)
 
+        /// @brief Protects the session cache and ticket keys (the context can be shared by several threads).
+        Mutex _sessionMutex;
+
+        /// @brief Client sessions cached, by session key (see getClientSessionKey()).
+        HashMap<String, CachedSession> _clientSessions;
+
+        /// @brief The counter used for tracking which cached session was used least recently.
+        uint64_t _sessionUseCounter;
+
+        /// @brief Ticket keys. [0] is the current key, [1] is the previous one (still accepted).
+        TicketKey _ticketKeys[ 2 ];
+
+        volatile uint32_t _numFullHandshakes; ///< The number of full handshakes. Modified atomically.
+        volatile uint32_t _numResumedHandshakes; ///< The number of resumed handshakes. Modified atomically.
+
         /// @brief Constructor
         /// The first time it is run (using _sslIsInitialized flag) it initialized the SSL library.
         /// @note By default the SSL context is in SSL_VERIFY_NONE mode, so CAs are not verified.
@@ -239,6 +321,85 @@ class SslContext
         /// @param [in] forMethod Method's name to be included in the log entries.
         /// @param [in] logLevel The log level of the message; L_ERROR by default.
         static void logSslErrors ( const char * forMethod, const Log::LogLevel & logLevel = L_ERROR );
+
+    private:
+        /// @brief Configures session caching and session tickets, based on config options.
+        void setupSessionResumption();
+
+        /// @brief Generates a new ticket key, and moves the current one to the 'previous' position.
+        /// @note It should be called with _sessionMutex locked.
+        /// @return True if the new key has been generated; False otherwise.
+        bool rotateTicketKey();
+
+        /// @brief Returns the SslContext object that a SSL object belongs to.
+        /// @param [in] ssl The SSL object.
+        /// @return The SslContext object, or 0 if it could not be found.
+        static SslContext * getSslContext ( SSL * ssl );
+
+        /// @brief Returns the key used for caching client sessions.
+        /// @param [in] remoteAddr The address of the remote host.
+        /// @param [in] sniHostname The SNI hostname used (may be empty).
+        /// @return The key for the client session cache.
+        static String getClientSessionKey ( const SockAddr & remoteAddr, const String & sniHostname );
+
+        /// @brief Finds a cached client session.
+        /// @param [in] sessionKey The key of the session.
+        /// @return The session found (with an extra reference that the caller has to release),
+        ///         or 0 if there is no valid session for this key.
+        SSL_SESSION * findClientSession ( const String & sessionKey );
+
+        /// @brief Stores a new client session in the cache.
+        /// If the cache is full, the session that was used least recently is removed.
+        /// @param [in] sessionKey The key of the session.
+        /// @param [in] session The session to store. It is stored without adding a new reference.
+        /// @return True if the session has been stored; False if it was not (and it should be released by the caller).
+        bool storeClientSession ( const String & sessionKey, SSL_SESSION * session );
+
+        /// @brief Removes a client session from the cache.
+        /// @param [in] sessionKey The key of the session.
+        /// @param [in] session The session to remove. The cached session is only removed if it is the same one
+        ///                     (it could have been replaced by a session of a different connection).
+        void removeClientSession ( const String & sessionKey, const SSL_SESSION * session );
+
+        /// @brief Called by SslSocket when a handshake is completed.
+        /// @param [in] resumed Whether the handshake resumed an existing session.
+        void handshakeCompleted ( bool resumed );
+
+        /// @brief Called by OpenSSL when a new client session is established.
+        /// @param [in] ssl The SSL object the session belongs to.
+        /// @param [in] session The new session.
+        /// @return 1 if the session has been stored (and the reference taken over); 0 otherwise.
+        static int newSessionCallback ( SSL * ssl, SSL_SESSION * session );
+
+#if ( OPENSSL_VERSION_NUMBER >= 0x30000000L ) && !defined( OPENSSL_IS_BORINGSSL )
+        /// @brief Called by OpenSSL to set up the encryption of a session ticket (or decryption of a received one).
+        /// @param [in] ssl The SSL object.
+        /// @param [in,out] keyName The name of the key (set if enc is 1, read otherwise).
+        /// @param [in,out] iv The IV (set if enc is 1, read otherwise).
+        /// @param [in] cCtx The cipher context to initialize.
+        /// @param [in] hCtx The HMAC context to initialize.
+        /// @param [in] enc 1 if a ticket is being encrypted, 0 if it is being decrypted.
+        /// @return -1 on error; 0 if the key is not known; 1 if the key is the current one;
+        ///         2 if the key is valid, but the ticket should be renewed.
+        static int ticketKeyCallback (
+            SSL * ssl, unsigned char * keyName, unsigned char * iv,
+            EVP_CIPHER_CTX * cCtx, EVP_MAC_CTX * hCtx, int enc );
+#else
+        /// @brief Called by OpenSSL to set up the encryption of a session ticket (or decryption of a received one).
+        /// @param [in] ssl The SSL object.
+        /// @param [in,out] keyName The name of the key (set if enc is 1, read otherwise).
+        /// @param [in,out] iv The IV (set if enc is 1, read otherwise).
+        /// @param [in] cCtx The cipher context to initialize.
+        /// @param [in] hCtx The HMAC context to initialize.
+        /// @param [in] enc 1 if a ticket is being encrypted, 0 if it is being decrypted.
+        /// @return -1 on error; 0 if the key is not known; 1 if the key is the current one;
+        ///         2 if the key is valid, but the ticket should be renewed.
+        static int ticketKeyCallback (
+            SSL * ssl, unsigned char * keyName, unsigned char * iv,
+            EVP_CIPHER_CTX * cCtx, HMAC_CTX * hCtx, int enc );
+#endif
+
+        friend class SslSocket;
 };
 
 /// @brief DTLS version of the SslContext object
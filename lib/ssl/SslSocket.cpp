@@ -75,6 +75,32 @@ SslSocket::~SslSocket()
     }
 }
 
+void SslSocket::close()
+{
+    if ( _ssl != 0 && isConnected() )
+    {
+        if ( !hasFlag ( SockSslFlagUncleanClose ) )
+        {
+            // The connection is being closed cleanly, but we don't wait for the complete SSL shutdown.
+            // The session can still be resumed. Without this OpenSSL would consider the session "bad"
+            // when the SSL object is freed, and remove it from the session cache.
+            SSL_set_shutdown ( _ssl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN );
+        }
+        else if ( !_sessionKey.isEmpty() )
+        {
+            // The session should not be resumed, but OpenSSL only removes bad sessions from its own cache.
+            SslContext * const ctx = SslContext::getSslContext ( _ssl );
+
+            if ( ctx != 0 )
+            {
+                ctx->removeClientSession ( _sessionKey, SSL_get_session ( _ssl ) );
+            }
+        }
+    }
+
+    IpSocket::close();
+}
+
 TlsSocket * SslSocket::getTlsSocket()
 {
     return 0;
@@ -132,6 +158,64 @@ const char * SslSocket::callTypeName ( SslSocket::CallType callType )
     return "SSL_unknown()";
 }
 
+bool SslSocket::isSessionReused() const
+{
+    return ( _ssl != 0 && SSL_session_reused ( _ssl ) != 0 );
+}
+
+void SslSocket::setupSessionResumption ( const SockAddr & remoteAddr )
+{
+    SslContext * const ctx = SslContext::getSslContext ( _ssl );
+
+    if ( !ctx || !ctx->isClient() || SslContext::optSessionCacheSize.value() < 1 || !remoteAddr.hasIpAddr() )
+    {
+        return;
+    }
+
+    const char * sniHostname = SSL_get_servername ( _ssl, TLSEXT_NAMETYPE_host_name );
+
+    _sessionKey = SslContext::getClientSessionKey (
+        remoteAddr, ( sniHostname != 0 ) ? String ( sniHostname ) : String() );
+
+    // This is used by SslContext::newSessionCallback() to store new sessions:
+    SSL_set_app_data ( _ssl, &_sessionKey );
+
+    SSL_SESSION * const session = ctx->findClientSession ( _sessionKey );
+
+    if ( !session )
+    {
+        LOG ( L_DEBUG2, getLogId() << ": No cached session for " << _sessionKey );
+        return;
+    }
+
+    if ( SSL_set_session ( _ssl, session ) != 1 )
+    {
+        LOG ( L_WARN, getLogId() << ": Could not set the cached session for " << _sessionKey );
+
+        ERR_clear_error();
+    }
+    else
+    {
+        LOG ( L_DEBUG2, getLogId() << ": Trying to resume the cached session for " << _sessionKey );
+    }
+
+    // SSL_set_session() takes its own reference:
+    SSL_SESSION_free ( session );
+}
+
+void SslSocket::handshakeCompleted()
+{
+    SslContext * const ctx = SslContext::getSslContext ( _ssl );
+    const bool resumed = isSessionReused();
+
+    if ( ctx != 0 )
+    {
+        ctx->handshakeCompleted ( resumed );
+    }
+
+    LOG ( L_DEBUG2, getLogId() << ": Handshake completed; Session resumed: " << ( resumed ? "yes" : "no" ) );
+}
+
 String SslSocket::getSessionSniHostname() const
 {
     SSL_SESSION * const s = ( _ssl != 0 ) ? ( SSL_get_session ( _ssl ) ) : 0;
@@ -285,8 +369,18 @@ String SslSocket::getSessionMasterKeyHash ( bool printableHex ) const
     return String ( ( const char * ) md, MD5_DIGEST_LENGTH );
 }
 
+void SslSocket::markUncleanClose()
+{
+    if ( _ssl != 0 && ( SSL_get_shutdown ( _ssl ) & SSL_RECEIVED_SHUTDOWN ) == 0 )
+    {
+        setFlags ( SockSslFlagUncleanClose );
+    }
+}
+
 void SslSocket::scheduleClosedEvent ( ERRCODE reason )
 {
+    markUncleanClose();
+
     _closedReason = reason;
 
     scheduleEvents ( SockEventClosed );
@@ -303,6 +397,13 @@ bool SslSocket::runEvents ( uint16_t events )
     return IpSocket::runEvents ( events );
 }
 
+void SslSocket::doSockClosed ( ERRCODE reason )
+{
+    markUncleanClose();
+
+    IpSocket::doSockClosed ( reason );
+}
+
 void SslSocket::socketClosed ( Socket *, ERRCODE reason )
 {
     LOG_ERR ( L_ERROR, reason, "Underlying data socket has been closed" );
@@ -66,6 +66,11 @@ class SslSocket: public IpSocket, protected SocketOwner
         /// @return the MD5 hash of the SSL session's master key, or an empty string if it cannot be obtained
         String getSessionMasterKeyHash ( bool printableHex = true ) const;
 
+        /// @brief Checks whether the handshake resumed an existing session.
+        /// @return True if the session has been resumed; False if a full handshake was performed
+        ///         (or the handshake has not been completed yet).
+        bool isSessionReused() const;
+
         /// @brief Returns this object as a TlsSocket.
         /// @return This object as a TlsSocket pointer, or 0 if it is not a TlsSocket.
         virtual TlsSocket * getTlsSocket();
@@ -74,6 +79,12 @@ class SslSocket: public IpSocket, protected SocketOwner
         /// @return This object as a TlsSocket pointer, or 0 if it is not a TlsSocket.
         virtual DtlsSocket * getDtlsSocket();
 
+        /// @brief Closes the socket.
+        /// If the connection has been established and is closed cleanly (not because of an error,
+        /// and not without the peer's SSL shutdown), its session can still be resumed.
+        /// Otherwise the session is removed from the session caches.
+        virtual void close();
+
         virtual String getLogId ( bool extended = false ) const;
 
     protected:
@@ -89,13 +100,17 @@ class SslSocket: public IpSocket, protected SocketOwner
         /// @brief When set, the respective socket should only perform 'SSL_connect' operation until it succeeds.
         static const uint16_t SockSslFlagConnectNeeded = ( 1 << ( SockIpNextFlagShift + 3 ) );
 
+        /// @brief Set when the socket is being closed because of an error (or the connection was closed
+        ///        without the peer's SSL shutdown). When set, the session is not kept for resumption.
+        static const uint16_t SockSslFlagUncleanClose = ( 1 << ( SockIpNextFlagShift + 4 ) );
+
         /// @brief The lowest event bit that can be used by the class inheriting this one.
         /// Classes that inherit it should use ( 1 << next_shift + 0), ( 1 << next_shift + 1), etc. values.
         static const uint8_t SockSslNextEventShift = SockIpNextEventShift;
 
         /// @brief The lowest flag bit that can be used by the class inheriting this one.
         /// Classes that inherit it should use ( 1 << next_shift + 0), ( 1 << next_shift + 1), etc. values.
-        static const uint8_t SockSslNextFlagShift = SockIpNextFlagShift + 4;
+        static const uint8_t SockSslNextFlagShift = SockIpNextFlagShift + 5;
 
         static TextLog _log; ///< Log stream
 
@@ -114,6 +129,10 @@ class SslSocket: public IpSocket, protected SocketOwner
 
         ERRCODE _closedReason; ///< The reason to pass in 'closed' event.
 
+        /// @brief The key under which the client session is cached (by the SSL context).
+        /// Empty if the session is not cached.
+        String _sessionKey;
+
         /// @brief Constructor.
         /// It initializes internal SSL state using provided SSL context.
         /// It will also set either 'accept needed' or 'connect needed' flag, depending on the context type.
@@ -139,16 +158,34 @@ class SslSocket: public IpSocket, protected SocketOwner
         /// @return Standard error code that can be returned by read/write methods.
         ERRCODE handleSslError ( CallType callType, int callRet, int fd, bool delayCallbacks );
 
+        /// @brief Prepares a client socket for resuming a session.
+        /// If the SSL context caches client sessions, it sets up the key under which the new session will be stored,
+        /// and resumes the session cached under that key (if there is one).
+        /// It has to be called before the handshake is started. It does nothing for server sockets.
+        /// @param [in] remoteAddr The address of the remote host.
+        void setupSessionResumption ( const SockAddr & remoteAddr );
+
+        /// @brief Should be called when the handshake has been completed.
+        /// It updates handshake counters of the SSL context.
+        void handshakeCompleted();
+
         /// @brief Schedules a specific 'closed' event.
+        /// It marks the close as unclean (see markUncleanClose()).
         /// @param [in] reason The reason to pass in the callback.
         void scheduleClosedEvent ( ERRCODE reason );
 
+        /// @brief Sets SockSslFlagUncleanClose flag, unless the peer has performed the SSL shutdown.
+        /// It should be called whenever the socket is about to be closed for reasons other than
+        /// a local close() call.
+        void markUncleanClose();
+
         /// @brief Helper function for printing the description of SSL call type (for debugging)
         /// @param [in] callType The type of the call
         /// @return The name of the SSL call type
         static const char * callTypeName ( CallType callType );
 
         virtual bool runEvents ( uint16_t events );
+        virtual void doSockClosed ( ERRCODE reason );
 
         virtual void socketClosed ( Socket * sock, ERRCODE reason );
         virtual void socketConnectFailed ( Socket * sock, ERRCODE reason );
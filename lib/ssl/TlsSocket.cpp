@@ -139,11 +139,12 @@ void TlsSocket::socketConnected ( Socket * sock )
 
         if ( fd >= 0 )
         {
-            setSslSockFd ( fd );
-
+            // Addresses have to be set first, setSslSockFd() uses the remote address.
             _localAddr = _tcpSocket->getLocalSockAddr();
             _remoteAddr = _tcpSocket->getRemoteSockAddr();
 
+            setSslSockFd ( fd );
+
             LOG ( L_DEBUG2, getLogId() << ": Underlying TCP socket ["
                   << _localAddr << "-" << _remoteAddr << "] is now connected" );
 
@@ -170,6 +171,8 @@ void TlsSocket::setSslSockFd ( int sockFd )
 
     SSL_set_fd ( _ssl, sockFd );
 
+    setupSessionResumption ( _remoteAddr );
+
     EventManager::setFdHandler ( sockFd, this, EventManager::EventRead | EventManager::EventWrite );
 }
 
@@ -177,6 +180,16 @@ void TlsSocket::close()
 {
     const int sockFd = SSL_get_fd ( _ssl );
 
+    if ( sockFd >= 0 && isConnected() && !hasFlag ( SockSslFlagUncleanClose ) )
+    {
+        // This is a clean close, so we let the peer know (without waiting for its response).
+        // Otherwise the peer would consider the connection truncated, and would not resume the session.
+        if ( SSL_shutdown ( _ssl ) < 0 )
+        {
+            ERR_clear_error();
+        }
+    }
+
     SSL_set_fd ( _ssl, -1 );
 
     SslSocket::close();
@@ -334,6 +347,8 @@ void TlsSocket::receiveFdEvent ( int fd, short int events )
         clearFlags ( SockSslFlagAcceptNeeded | SockSslFlagConnectNeeded );
         EventManager::setFdEvents ( fd, EventManager::EventRead | EventManager::EventWrite );
 
+        handshakeCompleted();
+
         doSockConnected();
         return;
     }
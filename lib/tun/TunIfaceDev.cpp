@@ -16,6 +16,7 @@
 
 #include <cassert>
 #include <cerrno>
+#include <cstring>
 
 extern "C"
 {
@@ -64,6 +65,34 @@ ConfigLimitedNumber<uint32_t> TunIfaceDev::optMaxMemorySize
         1, 1024, 16
 );
 
+ConfigNumber<bool> TunIfaceDev::optUseOffloads (
+        0,
+        "os.tun.offloads",
+        "Set to true to create tunnel devices with offloads (segmentation and checksum) enabled. "
+        "Only supported on Linux. Each packet read requires 64 KB of memory (see os.tun.max_memory). "
+        "Packets written are delayed until the end of the event loop, to coalesce TCP segments",
+        false
+);
+
+TunIfaceDev::Stats::Stats()
+{
+    clear();
+}
+
+void TunIfaceDev::Stats::clear()
+{
+    rxPackets = rxBytes = txPackets = txBytes = 0;
+}
+
+void TunIfaceDev::Stats::load ( const Stats & other )
+{
+    // Atomic reads; __sync_add_and_fetch doesn't accept pointers to const.
+    rxPackets = __sync_add_and_fetch ( const_cast<uint64_t *> ( &other.rxPackets ), 0 );
+    rxBytes = __sync_add_and_fetch ( const_cast<uint64_t *> ( &other.rxBytes ), 0 );
+    txPackets = __sync_add_and_fetch ( const_cast<uint64_t *> ( &other.txPackets ), 0 );
+    txBytes = __sync_add_and_fetch ( const_cast<uint64_t *> ( &other.txBytes ), 0 );
+}
+
 TunIfaceDev::TunIfaceDev ( TunIfaceOwner * owner ):
     TunIface ( owner ),
     _writer ( PacketWriter::BasicWriter,
@@ -72,7 +101,8 @@ TunIfaceDev::TunIfaceDev ( TunIfaceOwner * owner ):
     _memPool ( 0 ),
     _ifaceId ( -1 ),
     _fd ( -1 ),
-    _ifaceMtu ( 0 )
+    _ifaceMtu ( 0 ),
+    _offloadHdrSize ( 0 )
 {
 }
 
@@ -96,6 +126,11 @@ uint16_t TunIfaceDev::getMtu() const
 
 void TunIfaceDev::stop()
 {
+    // Let's write whatever is still queued, before we lose the FD.
+    flushWrites();
+
+    EventManager::loopEndUnsubscribe ( this );
+
     _writer.clearFd();
 
     TunIface::stop();
@@ -113,6 +148,8 @@ void TunIfaceDev::stop()
     }
 
     _ifaceName.clear();
+    _offloadHdrSize = 0;
+    _offloadWriteHdr.clear();
 
     if ( _fd >= 0 )
     {
@@ -150,7 +187,9 @@ void TunIfaceDev::receiveFdEvent ( int fd, short events )
                 break;
             }
 
-            if ( !osRead ( buf ) )
+            uint16_t segmentSize = 0;
+
+            if ( !osRead ( buf, segmentSize ) )
             {
                 stop();
                 break;
@@ -162,7 +201,29 @@ void TunIfaceDev::receiveFdEvent ( int fd, short events )
                 break;
             }
 
-            packetReceived ( buf );
+            Stats::add ( _stats.rxBytes, buf.size() );
+
+            MemHandle packet;
+
+            if ( _offloadHdrSize > 0 && copyToPacket ( buf, packet ) )
+            {
+                // With offloads, each read uses a block large enough for the biggest super-packet.
+                // Most reads are regular packets (or small super-packets) and we don't want them
+                // (or segments that reference them) to hold on to those blocks. We only keep them for
+                // super-packets that don't fit in a regular packet anyway.
+                buf = packet;
+            }
+
+            if ( segmentSize > 0 )
+            {
+                superPacketReceived ( buf, segmentSize );
+            }
+            else
+            {
+                Stats::add ( _stats.rxPackets, 1 );
+
+                packetReceived ( buf );
+            }
         }
 
         if ( _fd < 0 )
@@ -176,6 +237,78 @@ void TunIfaceDev::receiveFdEvent ( int fd, short events )
     }
 }
 
+bool TunIfaceDev::copyToPacket ( const MemVector & data, MemHandle & packet )
+{
+    const size_t size = data.getDataSize();
+
+    if ( size > PacketDataStore::PacketSize )
+    {
+        return false;
+    }
+
+    packet = PacketDataStore::getPacket ( ( uint16_t ) size );
+
+    char * w = packet.getWritable();
+
+    if ( !w || packet.size() < size )
+    {
+        packet.clear();
+        return false;
+    }
+
+    const struct iovec * const chunks = data.getChunks();
+
+    for ( size_t i = 0; i < data.getNumChunks(); ++i )
+    {
+        memcpy ( w, chunks[ i ].iov_base, chunks[ i ].iov_len );
+        w += chunks[ i ].iov_len;
+    }
+
+    packet.truncate ( size );
+    return true;
+}
+
+void TunIfaceDev::superPacketReceived ( MemHandle & buffer, uint16_t segmentSize )
+{
+    List<IpPacket> segments;
+
+    {
+        const IpPacket ipPacket ( buffer );
+
+        buffer.clear();
+
+        if ( !ipPacket.splitSegments ( segmentSize, segments ) )
+        {
+            LOG_LIM ( L_ERROR, "Could not split a packet read from the tunnel interface: " << ipPacket
+                      << "; Segment size: " << segmentSize << "; Dropping" );
+
+            return;
+        }
+    }
+
+    LOG ( L_DEBUG4, "Split a packet from tunnel iface into " << segments.size() << " packets" );
+
+    Stats::add ( _stats.rxPackets, segments.size() );
+
+    for ( size_t i = 0; i < segments.size() && _fd >= 0; ++i )
+    {
+        MemHandle packet;
+
+        if ( i > 0 && i + 1 == segments.size()
+             && segments.at ( i ).getPacketSize() < segments.at ( 0 ).getPacketSize()
+             && copyToPacket ( segments.at ( i ).getPacketData(), packet ) )
+        {
+            // The last segment is often much shorter than the others.
+            // It is copied, so it doesn't keep the entire super-packet's block alive on its own.
+            segments[ i ] = IpPacket ( packet );
+        }
+
+        TunIpPacket tunPacket ( segments.at ( i ) );
+
+        packetReceived ( tunPacket );
+    }
+}
+
 ERRCODE TunIfaceDev::sendPacket ( const IpPacket & ipPacket )
 {
     if ( !ipPacket.isValid() )
@@ -196,6 +329,27 @@ ERRCODE TunIfaceDev::sendPacket ( const IpPacket & ipPacket )
         return Error::NotInitialized;
     }
 
+    if ( _offloadHdrSize > 0 )
+    {
+        // With offloads enabled, packets are written at the end of the event loop,
+        // so that consecutive TCP segments can be coalesced.
+        // Any write errors are only logged.
+
+        if ( _pendingWrites.isEmpty() )
+        {
+            EventManager::loopEndSubscribe ( this );
+        }
+
+        _pendingWrites.append ( ipPacket );
+
+        if ( _pendingWrites.size() >= MaxPendingWrites )
+        {
+            flushWrites();
+        }
+
+        return Error::Success;
+    }
+
     // We reserve 3 slots, 2 for the packet (and extPayload), one for prefix (if needed by the OS).
     MemVector vec ( 3 );
 
@@ -208,12 +362,81 @@ ERRCODE TunIfaceDev::sendPacket ( const IpPacket & ipPacket )
 
     if ( IS_OK ( eCode ) )
     {
+        Stats::add ( _stats.txPackets, 1 );
+        Stats::add ( _stats.txBytes, ipPacket.getPacketSize() );
+
         updateSendDataCount ( ipPacket.getPacketSize() );
     }
 
     return eCode;
 }
 
+void TunIfaceDev::receiveLoopEndEvent()
+{
+    flushWrites();
+}
+
+void TunIfaceDev::flushWrites()
+{
+    if ( _pendingWrites.isEmpty() )
+    {
+        return;
+    }
+
+    const List<IpPacket> packets ( _pendingWrites );
+
+    _pendingWrites.clear();
+
+    for ( size_t i = 0; i < packets.size(); )
+    {
+        IpPacket superPacket;
+        uint16_t segmentSize = 0;
+        size_t count = IpPacket::coalesceSegments ( packets, i, superPacket, segmentSize );
+
+        // One slot for the OS header, and (at least) one for the payload of each packet.
+        MemVector vec ( ( MemVector::IndexType ) ( 2 + count ) );
+
+        if ( count < 2 || !osGetSuperPacketWriteData ( superPacket, segmentSize, vec ) )
+        {
+            vec.clear();
+            count = 1;
+
+            if ( !osGetWriteData ( packets.at ( i ), vec ) )
+            {
+                LOG_LIM ( L_ERROR, "Error generating the data to write to the tunnel; Packet: " << packets.at ( i ) );
+
+                ++i;
+                continue;
+            }
+        }
+
+        size_t dataSize = 0;
+
+        for ( size_t j = i; j < i + count; ++j )
+        {
+            dataSize += packets.at ( j ).getPacketSize();
+        }
+
+        const ERRCODE eCode = _writer.write ( vec );
+
+        if ( IS_OK ( eCode ) )
+        {
+            LOG ( L_DEBUG4, "Wrote " << count << " packet(s) to the tunnel; Size: " << dataSize );
+
+            Stats::add ( _stats.txPackets, count );
+            Stats::add ( _stats.txBytes, dataSize );
+
+            updateSendDataCount ( dataSize );
+        }
+        else
+        {
+            LOG_ERR_LIM ( L_ERROR, eCode, "Error writing " << count << " packet(s) to the tunnel; FD: " << _fd );
+        }
+
+        i += count;
+    }
+}
+
 ERRCODE TunIfaceDev::configureIface (
         int fd, const String & ifaceName,
         int ifaceMtu, int & ifaceId )
@@ -264,6 +487,11 @@ ERRCODE TunIfaceDev::configureIface (
     return eCode;
 }
 
+ERRCODE TunIfaceDev::createTunDevice ( int & ifaceFd, String & ifaceName )
+{
+    return osCreateTunDevice ( ifaceFd, ifaceName );
+}
+
 ERRCODE TunIfaceDev::setupFd ( int fd )
 {
     if ( fd < 0 )
@@ -281,6 +509,15 @@ ERRCODE TunIfaceDev::setupFd ( int fd )
     assert ( getAddresses().isEmpty() );
 
     _fd = fd;
+    _offloadHdrSize = osGetOffloadHdrSize ( _fd );
+
+    if ( _offloadHdrSize > 0 )
+    {
+        _offloadWriteHdr = MemHandle ( _offloadHdrSize );
+        _offloadWriteHdr.setZero();
+
+        LOG ( L_DEBUG, "Tunnel device uses offloads; Header size: " << _offloadHdrSize );
+    }
 
     EventManager::setFdHandler ( _fd, this, EventManager::EventRead );
 
@@ -325,7 +562,7 @@ ERRCODE TunIfaceDev::startManaged ( int ifaceMtu )
     int ifaceId = -1;
     String ifaceName;
 
-    ERRCODE eCode = osCreateTunDevice ( tunFd, ifaceName );
+    ERRCODE eCode = createTunDevice ( tunFd, ifaceName );
 
     UNTIL_ERROR ( eCode, configureIface ( tunFd, ifaceName, ifaceMtu, ifaceId ) );
     UNTIL_ERROR ( eCode, setupFd ( tunFd ) );
@@ -437,7 +674,10 @@ void TunIfaceDev::configureMemPool ( int ifaceMtu )
         _ifaceMtu = ( uint16_t ) ifaceMtu;
     }
 
-    if ( _ifaceMtu <= PacketDataStore::PacketSize )
+    // With offloads, we may receive packets larger than the MTU (up to the max IP packet size):
+    const uint32_t readSize = ( _offloadHdrSize > 0 ) ? ( 0xFFFF + _offloadHdrSize ) : _ifaceMtu;
+
+    if ( readSize <= PacketDataStore::PacketSize )
     {
         // "default" MTU, or smaller than PacketDataStore's packet size - no need for a custom memory pool.
 
@@ -450,11 +690,11 @@ void TunIfaceDev::configureMemPool ( int ifaceMtu )
         return;
     }
 
-    assert ( _ifaceMtu > 0 );
+    assert ( readSize > 0 );
 
     if ( _memPool != 0 )
     {
-        if ( _ifaceMtu <= _memPool->PayloadSize )
+        if ( readSize <= _memPool->PayloadSize )
         {
             // We currently have a custom memory pool that uses large enough packets.
             return;
@@ -471,7 +711,7 @@ void TunIfaceDev::configureMemPool ( int ifaceMtu )
     const uint32_t blocksPerSlab
         = optMaxMemorySize.value() * 1024 * 1024
           / PacketMaxSlabs
-          / ( _ifaceMtu + MemPool::DefaultPayloadOffset );
+          / ( readSize + MemPool::DefaultPayloadOffset );
 
-    _memPool = new PacketMemPool ( _ifaceMtu, blocksPerSlab, PacketMaxSlabs );
+    _memPool = new PacketMemPool ( readSize, blocksPerSlab, PacketMaxSlabs );
 }
@@ -25,7 +25,7 @@ namespace Pravala
 class PacketMemPool;
 
 /// @brief Base implementation of the tun interface that uses a system device (e.g. /dev/tun)
-class TunIfaceDev: public TunIface, protected EventManager::FdEventHandler
+class TunIfaceDev: public TunIface, protected EventManager::FdEventHandler, protected EventManager::LoopEndEventHandler
 {
     public:
         /// @brief Max number of slabs (each slab is a collection of blocks) per TunIface.
@@ -34,6 +34,9 @@ class TunIfaceDev: public TunIface, protected EventManager::FdEventHandler
         /// @brief Min MTU allowed. This is based on policy restrictions, for IPv6 it should be at least 1280.
         static const uint16_t MinMTU = 512;
 
+        /// @brief Max number of packets queued for coalescing before they are written (if offloads are enabled).
+        static const uint8_t MaxPendingWrites = 64;
+
         /// @brief Max number of packets to read per read event
         static ConfigLimitedNumber<uint8_t> optMaxReadsPerEvent;
 
@@ -46,6 +49,46 @@ class TunIfaceDev: public TunIface, protected EventManager::FdEventHandler
         /// @brief The max amount of memory that can be used by a TunIface (in megabytes).
         static ConfigLimitedNumber<uint32_t> optMaxMemorySize;
 
+        /// @brief Whether tunnel devices should be created with offloads enabled.
+        /// When enabled, the device may deliver large (up to 64 KB) TCP and UDP "super-packets",
+        /// and packets with partial checksums, which are then split and completed by TunIfaceDev.
+        /// This way many packets can be read using a single system call.
+        /// Packets sent to such device are queued until the end of the event loop, and consecutive TCP segments
+        /// are coalesced and written as "super-packets" (to be segmented by the OS, with checksums completed).
+        /// It is only supported on Linux (using IFF_VNET_HDR), and only in "managed" mode
+        /// (or if an unmanaged tunnel device has been created with the same settings).
+        static ConfigNumber<bool> optUseOffloads;
+
+        /// @brief Packet and byte counters of a tunnel device (or of a single queue of a multi-queue device).
+        /// Counters are only modified using add(), so they can be read (using load()) by other threads.
+        struct Stats
+        {
+            uint64_t rxPackets; ///< The number of packets read (after splitting "super-packets").
+            uint64_t rxBytes; ///< The number of bytes read (not including any OS-specific headers).
+            uint64_t txPackets; ///< The number of packets written.
+            uint64_t txBytes; ///< The number of bytes written (not including any OS-specific headers).
+
+            /// @brief Default constructor.
+            Stats();
+
+            /// @brief Clears all the counters.
+            void clear();
+
+            /// @brief Copies the counters of another object.
+            /// Each counter is read atomically, so it can be used while the other object is being modified
+            /// (using add()) by a different thread.
+            /// @param [in] other The object to copy the counters of.
+            void load ( const Stats & other );
+
+            /// @brief Atomically adds a value to a counter.
+            /// @param [in,out] counter The counter to modify.
+            /// @param [in] value The value to add.
+            static inline void add ( uint64_t & counter, uint64_t value )
+            {
+                __sync_add_and_fetch ( &counter, value );
+            }
+        };
+
         /// @brief Generates a new, reference-counted instance of the TunIfaceDev.
         /// @param [in] owner The initial owner to set.
         static TunIfaceDev * generate ( TunIfaceOwner * owner );
@@ -66,12 +109,20 @@ class TunIfaceDev: public TunIface, protected EventManager::FdEventHandler
         virtual const String & getIfaceName() const;
         virtual uint16_t getMtu() const;
 
+        /// @brief Exposes packet and byte counters of this tunnel device.
+        /// @return Packet and byte counters of this tunnel device.
+        inline const Stats & getStats() const
+        {
+            return _stats;
+        }
+
     protected:
         PacketWriter _writer; ///< Packet writer used by this object.
 
         /// @brief Memory pool used by the tunnel interface.
         /// It may be unset, in which case the standard PacketDataStore will be used.
-        /// It is used if the tunnel's MTU is large and requires non-standard data segments.
+        /// It is used if the tunnel's MTU is large and requires non-standard data segments,
+        /// or if offloads are used (in which case reads that fit in regular packets are copied out of it).
         PacketMemPool * _memPool;
 
         String _ifaceName; ///< Interface name
@@ -85,6 +136,20 @@ class TunIfaceDev: public TunIface, protected EventManager::FdEventHandler
 
         uint16_t _ifaceMtu; ///< The MTU configured, 0 means OS default is used (typically 1500).
 
+        /// @brief The size of the OS-specific header that precedes each packet read from (and written to) the device.
+        /// It is only used when offloads are enabled (see optUseOffloads), otherwise it is 0.
+        uint16_t _offloadHdrSize;
+
+        /// @brief The header to be written before each packet, if offloads are enabled.
+        /// It is zeroed (no offloads requested for packets we write).
+        MemHandle _offloadWriteHdr;
+
+        /// @brief Packets waiting to be written at the end of the event loop.
+        /// It is only used when offloads are enabled.
+        List<IpPacket> _pendingWrites;
+
+        Stats _stats; ///< Packet and byte counters.
+
         /// @brief Constructor.
         /// @param [in] owner The initial owner to set.
         TunIfaceDev ( TunIfaceOwner * owner );
@@ -93,6 +158,11 @@ class TunIfaceDev: public TunIface, protected EventManager::FdEventHandler
         virtual ~TunIfaceDev();
 
         virtual void receiveFdEvent ( int fd, short events );
+        virtual void receiveLoopEndEvent();
+
+        /// @brief Writes all the packets queued in _pendingWrites.
+        /// Consecutive TCP segments are coalesced into "super-packets" (if the OS supports writing them).
+        void flushWrites();
 
         /// @brief Configures the tun interface
         /// It reads this interface's ID (and exposes it through the ifaceId parameter),
@@ -111,14 +181,31 @@ class TunIfaceDev: public TunIface, protected EventManager::FdEventHandler
         /// @return Standard error code
         static ERRCODE osCreateTunDevice ( int & ifaceFd, String & ifaceName );
 
+        /// @brief Creates a multi-queue tunnel device, or opens another queue of an existing one.
+        /// It is OS-specific function
+        /// @param [out] queueFd The FD of the queue opened; Not modified if there is an error
+        /// @param [in,out] ifaceName The name of the multi-queue device to open another queue of.
+        ///                           If it is empty, a new device is created, and its name is stored here.
+        /// @return Standard error code; Unsupported if multi-queue devices are not supported.
+        static ERRCODE osCreateTunQueue ( int & queueFd, String & ifaceName );
+
+        /// @brief Checks whether the tunnel device uses offloads, and returns the size of the offload header.
+        /// It is OS-specific function
+        /// @param [in] fd The FD of the tunnel device.
+        /// @return The size of the header that precedes each packet read from (and written to) the device
+        ///         if the device uses offloads; 0 otherwise.
+        static uint16_t osGetOffloadHdrSize ( int fd );
+
         /// @brief Reads a packet from the tunnel interface.
         /// It is OS-specific function
         /// @param [in,out] buffer Buffer to put the data in. Memory should already be allocated!
+        /// @param [out] segmentSize Set to the size of payload segments, if the packet read is a "super-packet"
+        ///                          that needs to be split (see IpPacket::splitSegments()); 0 otherwise.
         /// @return True if it succeeded; False if it failed and the tunnel should be closed.
         ///         True doesn't mean that there is any data in the buffer.
         ///         If there was a non-critical error (like EAGAIN), it will still report success (since there is
         ///         no need to close the tunnel), but the buffer will be empty.
-        bool osRead ( MemHandle & buffer );
+        bool osRead ( MemHandle & buffer, uint16_t & segmentSize );
 
         /// @brief Generates the data to write to the tunnel device.
         /// @param [in] ipPacket The IP packet to generate the data for.
@@ -126,6 +213,38 @@ class TunIfaceDev: public TunIface, protected EventManager::FdEventHandler
         /// @return True if the data was successfully generated; False otherwise.
         bool osGetWriteData ( const IpPacket & ipPacket, MemVector & vec );
 
+        /// @brief Generates the data to write to the tunnel device for a TCP "super-packet".
+        /// It is OS-specific function
+        /// @param [in] superPacket The super-packet to generate the data for (see IpPacket::coalesceSegments()).
+        ///                         Its TCP checksum field should contain the checksum of the pseudo-header only.
+        /// @param [in] segmentSize The max size of the payload in each segment the OS should generate.
+        /// @param [in,out] vec The memory vector to append the data to.
+        /// @return True if the data was successfully generated; False if it failed,
+        ///         or if writing super-packets is not supported.
+        bool osGetSuperPacketWriteData ( const IpPacket & superPacket, uint16_t segmentSize, MemVector & vec );
+
+        /// @brief Called when a "super-packet" is received by the tunnel.
+        /// It splits it into regular packets, and passes each of them to packetReceived().
+        /// @note Our owner may have deferenced us after this function has been called!
+        /// @param [in,out] buffer The data of the packet. This buffer will be cleared by this function.
+        /// @param [in] segmentSize The max size of the payload in each of the packets.
+        void superPacketReceived ( MemHandle & buffer, uint16_t segmentSize );
+
+        /// @brief Copies the data to a regular PacketDataStore packet.
+        /// It is used for releasing (large) blocks of the custom memory pool as soon as possible.
+        /// @param [in] data The data to copy.
+        /// @param [out] packet The packet with a copy of the data. Cleared on error.
+        /// @return True if the data was copied; False if it doesn't fit in a regular packet,
+        ///         or if the packet could not be allocated.
+        static bool copyToPacket ( const MemVector & data, MemHandle & packet );
+
+        /// @brief Creates the tunnel device in "managed" mode.
+        /// The default implementation simply calls osCreateTunDevice().
+        /// @param [out] ifaceFd The FD of the created device; Not modified if there is an error
+        /// @param [out] ifaceName The name of the the created device; Not modified if there is an error
+        /// @return Standard error code
+        virtual ERRCODE createTunDevice ( int & ifaceFd, String & ifaceName );
+
         /// @brief Helper function to set up an FD for use by the tunnel interface
         /// @param [in] fd FD to set up for use by the tunnel interface
         /// @return Standard Error Code
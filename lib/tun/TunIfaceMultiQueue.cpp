@@ -0,0 +1,555 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+
+extern "C"
+{
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+}
+
+#include "basic/Mutex.hpp"
+#include "socket/PacketDataStore.hpp"
+
+#include "TunIfaceMultiQueue.hpp"
+
+using namespace Pravala;
+
+ConfigLimitedNumber<uint16_t> TunIfaceMultiQueue::optNumQueues (
+        0,
+        "os.tun.queues",
+        "The number of queues to use with multi-queue tunnel devices (each additional queue uses its own thread)",
+        1, 256, 4
+);
+
+namespace Pravala
+{
+/// @brief A single, additional queue of a multi-queue tunnel device.
+/// It is a regular TunIfaceDev, that uses an FD opened by TunIfaceMultiQueue.
+class TunIfaceQueue: public TunIfaceDev
+{
+    public:
+        /// @brief Constructor.
+        TunIfaceQueue(): TunIfaceDev ( 0 )
+        {
+        }
+
+        /// @brief Starts using the queue.
+        /// @param [in] fd The FD of the queue. On success it is owned by this object.
+        /// @param [in] ifaceMtu The MTU configured on the device.
+        /// @return Standard error code.
+        ERRCODE start ( int fd, int ifaceMtu )
+        {
+            const ERRCODE eCode = setupFd ( fd );
+
+            if ( IS_OK ( eCode ) )
+            {
+                configureMemPool ( ifaceMtu );
+            }
+
+            return eCode;
+        }
+};
+
+/// @brief The thread that handles a single, additional queue of a multi-queue tunnel device.
+class TunIfaceMultiQueue::QueueThread: public NoCopy, protected EventManager::FdEventHandler
+{
+    public:
+        const uint16_t Index; ///< The index of the queue.
+
+        /// @brief Constructor.
+        /// @param [in] iface The multi-queue interface this queue belongs to.
+        /// @param [in] index The index of the queue.
+        /// @param [in] fd The FD of the queue. It is owned (and closed) by this object.
+        QueueThread ( TunIfaceMultiQueue & iface, uint16_t index, int fd );
+
+        /// @brief Destructor.
+        /// It stops the thread (if it is running).
+        ~QueueThread();
+
+        /// @brief Starts the queue's thread.
+        /// It blocks until the queue is fully initialized (or it fails to initialize).
+        /// @param [in] ifaceMtu The MTU configured on the device.
+        /// @return Standard error code. If the queue failed to start, its thread still needs to be stopped.
+        ERRCODE start ( int ifaceMtu );
+
+        /// @brief Stops the queue's event loop, and waits for its thread to exit.
+        /// It is safe to call it if the thread is not running.
+        void stop();
+
+        /// @brief Returns packet and byte counters of the queue.
+        /// @param [out] stats The counters of the queue.
+        void getStats ( Stats & stats );
+
+    protected:
+        virtual void receiveFdEvent ( int fd, short events );
+
+    private:
+        TunIfaceMultiQueue & _iface; ///< The multi-queue interface this queue belongs to.
+
+        /// @brief Protects _queue and _finalStats.
+        /// Other fields are only modified before the thread is started, or after it exits.
+        Mutex _mutex;
+
+        pthread_t _thread; ///< The queue's thread.
+        bool _hasThread; ///< Whether the queue's thread has been created (and not joined yet).
+
+        int _fd; ///< The FD of the queue. Set to -1 once the thread takes it over.
+        int _ifaceMtu; ///< The MTU configured on the device.
+
+        /// @brief The pipe used for stopping the queue's thread (read end, write end).
+        /// Writing to it never blocks, and a stop request written before the thread's event loop
+        /// starts is not lost. It only exists while the thread is running.
+        int _stopFds[ 2 ];
+
+        /// @brief The queue itself.
+        /// It is created, used and destroyed on the queue's thread.
+        TunIfaceQueue * _queue;
+
+        /// @brief The counters of the queue, after it was destroyed.
+        Stats _finalStats;
+
+        /// @brief The result of starting the queue.
+        /// It is set by the queue's thread, before it clears _isStarting.
+        ERRCODE _startResult;
+
+        /// @brief Set while the queue's thread is starting.
+        /// It is only modified with _startMutex locked (and _startCond is signalled when it is cleared).
+        bool _isStarting;
+
+        /// @brief Protects _isStarting and _startResult, and is used together with _startCond.
+        pthread_mutex_t _startMutex;
+
+        /// @brief Signalled when the queue's thread finishes starting (successfully or not).
+        pthread_cond_t _startCond;
+
+        /// @brief Called by the queue's thread when it finishes starting.
+        /// It sets the result and wakes up start().
+        /// @param [in] eCode The result of starting the queue.
+        void finishStarting ( ERRCODE eCode );
+
+        /// @brief Runs the queue. This is the body of the queue's thread.
+        void run();
+
+        /// @brief Closes both ends of the stop pipe.
+        void closeStopFds();
+
+        /// @brief The function that runs in the queue's thread.
+        /// @param [in] arg A pointer to the QueueThread to run.
+        /// @return Always 0.
+        static void * threadMain ( void * arg );
+};
+}
+
+TunIfaceMultiQueue::QueueThread::QueueThread ( TunIfaceMultiQueue & iface, uint16_t index, int fd ):
+    Index ( index ),
+    _iface ( iface ),
+    _mutex ( "TunIfaceMultiQueue::QueueThread" ),
+    _hasThread ( false ),
+    _fd ( fd ),
+    _ifaceMtu ( 0 ),
+    _queue ( 0 ),
+    _isStarting ( false )
+{
+    memset ( &_thread, 0, sizeof ( _thread ) );
+
+    _stopFds[ 0 ] = _stopFds[ 1 ] = -1;
+
+    pthread_mutex_init ( &_startMutex, 0 );
+    pthread_cond_init ( &_startCond, 0 );
+}
+
+TunIfaceMultiQueue::QueueThread::~QueueThread()
+{
+    stop();
+
+    assert ( !_queue );
+    assert ( _stopFds[ 0 ] < 0 );
+    assert ( _stopFds[ 1 ] < 0 );
+
+    if ( _fd >= 0 )
+    {
+        ::close ( _fd );
+        _fd = -1;
+    }
+
+    pthread_cond_destroy ( &_startCond );
+    pthread_mutex_destroy ( &_startMutex );
+}
+
+ERRCODE TunIfaceMultiQueue::QueueThread::start ( int ifaceMtu )
+{
+    if ( _hasThread )
+    {
+        return Error::AlreadyInitialized;
+    }
+
+    if ( _fd < 0 )
+    {
+        return Error::NotInitialized;
+    }
+
+    if ( pipe ( _stopFds ) != 0 )
+    {
+        LOG ( L_ERROR, "Error creating a stop pipe for tunnel queue " << Index << ": " << strerror ( errno ) );
+
+        _stopFds[ 0 ] = _stopFds[ 1 ] = -1;
+        return Error::PipeFailed;
+    }
+
+    for ( int i = 0; i < 2; ++i )
+    {
+        fcntl ( _stopFds[ i ], F_SETFL, fcntl ( _stopFds[ i ], F_GETFL ) | O_NONBLOCK );
+        fcntl ( _stopFds[ i ], F_SETFD, FD_CLOEXEC );
+    }
+
+    _ifaceMtu = ifaceMtu;
+    _startResult = Error::Success;
+    _isStarting = true;
+
+    const int ret = pthread_create ( &_thread, 0, threadMain, this );
+
+    if ( ret != 0 )
+    {
+        LOG ( L_ERROR, "Error creating a thread for tunnel queue " << Index << ": " << strerror ( ret ) );
+
+        _isStarting = false;
+        closeStopFds();
+
+        return Error::InternalError;
+    }
+
+    _hasThread = true;
+
+    pthread_mutex_lock ( &_startMutex );
+
+    while ( _isStarting )
+    {
+        pthread_cond_wait ( &_startCond, &_startMutex );
+    }
+
+    // The queue's thread sets _startResult before clearing _isStarting (with the mutex locked).
+    const ERRCODE eCode = _startResult;
+
+    pthread_mutex_unlock ( &_startMutex );
+
+    return eCode;
+}
+
+void TunIfaceMultiQueue::QueueThread::finishStarting ( ERRCODE eCode )
+{
+    pthread_mutex_lock ( &_startMutex );
+
+    _startResult = eCode;
+    _isStarting = false;
+
+    pthread_cond_broadcast ( &_startCond );
+    pthread_mutex_unlock ( &_startMutex );
+}
+
+void TunIfaceMultiQueue::QueueThread::stop()
+{
+    if ( !_hasThread )
+    {
+        return;
+    }
+
+    // The write end is non-blocking. If the pipe is full, there already are stop requests in it.
+    // If the thread failed to start its event loop, it exits (and we can join it) without reading it.
+    const char c = 0;
+
+    if ( write ( _stopFds[ 1 ], &c, 1 ) < 0 && errno != EAGAIN && errno != EWOULDBLOCK )
+    {
+        LOG ( L_ERROR, "Error requesting tunnel queue " << Index << " to stop: " << strerror ( errno ) );
+    }
+
+    pthread_join ( _thread, 0 );
+
+    _hasThread = false;
+
+    closeStopFds();
+}
+
+void TunIfaceMultiQueue::QueueThread::closeStopFds()
+{
+    for ( int i = 0; i < 2; ++i )
+    {
+        if ( _stopFds[ i ] >= 0 )
+        {
+            ::close ( _stopFds[ i ] );
+            _stopFds[ i ] = -1;
+        }
+    }
+}
+
+void TunIfaceMultiQueue::QueueThread::receiveFdEvent ( int fd, short /*events*/ )
+{
+    assert ( fd == _stopFds[ 0 ] );
+
+    char buf[ 16 ];
+
+    while ( read ( fd, buf, sizeof ( buf ) ) > 0 )
+    {
+    }
+
+    EventManager::stop();
+}
+
+void TunIfaceMultiQueue::QueueThread::getStats ( Stats & stats )
+{
+    MutexLock lock ( _mutex );
+
+    // The counters are modified by the queue's thread, but each of them is read atomically.
+    stats.load ( ( _queue != 0 ) ? _queue->getStats() : _finalStats );
+}
+
+void * TunIfaceMultiQueue::QueueThread::threadMain ( void * arg )
+{
+    assert ( arg != 0 );
+
+    ( ( QueueThread * ) arg )->run();
+
+    return 0;
+}
+
+void TunIfaceMultiQueue::QueueThread::run()
+{
+    assert ( _isStarting );
+    assert ( !_queue );
+    assert ( _fd >= 0 );
+
+    ERRCODE eCode = EventManager::init();
+
+    if ( NOT_OK ( eCode ) )
+    {
+        LOG_ERR ( L_ERROR, eCode, "Error initializing EventManager of tunnel queue " << Index );
+
+        finishStarting ( eCode );
+
+        return;
+    }
+
+    PacketDataStore::enableThreadCache();
+
+    TunIfaceQueue * const queue = new TunIfaceQueue();
+
+    eCode = queue->start ( _fd, _ifaceMtu );
+
+    if ( IS_OK ( eCode ) )
+    {
+        // The queue owns the FD now.
+        _fd = -1;
+
+        MutexLock lock ( _mutex );
+
+        _queue = queue;
+    }
+    else
+    {
+        LOG_ERR ( L_ERROR, eCode, "Error starting tunnel queue " << Index );
+    }
+
+    if ( IS_OK ( eCode ) && _iface._handler != 0 )
+    {
+        queue->setOwner ( _iface._handler->tunQueueStarted ( &_iface, Index, queue ) );
+    }
+
+    finishStarting ( eCode );
+
+    if ( IS_OK ( eCode ) )
+    {
+        LOG ( L_DEBUG, "Tunnel queue " << Index << " started" );
+
+        EventManager::setFdHandler ( _stopFds[ 0 ], this, EventManager::EventRead );
+        EventManager::run();
+        EventManager::removeFdHandler ( _stopFds[ 0 ] );
+
+        if ( _iface._handler != 0 )
+        {
+            _iface._handler->tunQueueStopping ( &_iface, Index, queue );
+        }
+    }
+
+    queue->stop();
+    queue->setOwner ( 0 );
+
+    {
+        MutexLock lock ( _mutex );
+
+        _finalStats = queue->getStats();
+        _queue = 0;
+    }
+
+    queue->simpleUnref();
+
+    PacketDataStore::disableThreadCache();
+
+#ifndef NDEBUG
+    eCode = EventManager::shutdown ( false );
+
+    if ( NOT_OK ( eCode ) )
+    {
+        LOG_ERR ( L_ERROR, eCode, "Error shutting down EventManager of tunnel queue " << Index << "; Forcing it..." );
+
+        EventManager::shutdown ( true );
+    }
+#else
+    EventManager::shutdown ( true );
+#endif
+}
+
+TunIfaceMultiQueue * TunIfaceMultiQueue::generate ( TunIfaceOwner * owner, TunIfaceQueueHandler * handler )
+{
+    return new TunIfaceMultiQueue ( owner, handler );
+}
+
+TunIfaceMultiQueue::TunIfaceMultiQueue ( TunIfaceOwner * owner, TunIfaceQueueHandler * handler ):
+    TunIfaceDev ( owner ),
+    _handler ( handler ),
+    _isMultiQueue ( false )
+{
+}
+
+TunIfaceMultiQueue::~TunIfaceMultiQueue()
+{
+    // We HAVE to call it here.
+    // TunIfaceDev's destructor would call only its own version!
+    stop();
+}
+
+void TunIfaceMultiQueue::stop()
+{
+    // We stop additional queues first.
+    // Otherwise our owner could start a new device before they are closed.
+
+    for ( size_t i = 0; i < _queues.size(); ++i )
+    {
+        _queues.at ( i )->stop();
+    }
+
+    for ( size_t i = 0; i < _queues.size(); ++i )
+    {
+        delete _queues.at ( i );
+    }
+
+    _queues.clear();
+    _isMultiQueue = false;
+
+    TunIfaceDev::stop();
+}
+
+ERRCODE TunIfaceMultiQueue::createTunDevice ( int & ifaceFd, String & ifaceName )
+{
+    assert ( _queues.isEmpty() );
+
+    if ( !_handler || optNumQueues.value() < 2 )
+    {
+        return TunIfaceDev::createTunDevice ( ifaceFd, ifaceName );
+    }
+
+    String name;
+    const ERRCODE eCode = osCreateTunQueue ( ifaceFd, name );
+
+    if ( eCode == Error::Unsupported )
+    {
+        LOG ( L_WARN, "Multi-queue tunnel devices are not supported; Using a single-queue device" );
+
+        return TunIfaceDev::createTunDevice ( ifaceFd, ifaceName );
+    }
+
+    if ( IS_OK ( eCode ) )
+    {
+        ifaceName = name;
+        _isMultiQueue = true;
+    }
+
+    return eCode;
+}
+
+ERRCODE TunIfaceMultiQueue::startManaged ( int ifaceMtu )
+{
+    // This calls our createTunDevice():
+    ERRCODE eCode = TunIfaceDev::startManaged ( ifaceMtu );
+
+    if ( NOT_OK ( eCode ) || !_isMultiQueue )
+    {
+        return eCode;
+    }
+
+    assert ( _queues.isEmpty() );
+
+    for ( uint16_t idx = 1; idx < optNumQueues.value(); ++idx )
+    {
+        int queueFd = -1;
+        String name ( _ifaceName );
+
+        eCode = osCreateTunQueue ( queueFd, name );
+
+        if ( NOT_OK ( eCode ) )
+        {
+            LOG_ERR ( L_ERROR, eCode, "Error opening tunnel queue " << idx << " of device '" << _ifaceName
+                      << "'; Using " << idx << " queue(s)" );
+            break;
+        }
+
+        QueueThread * const qThread = new QueueThread ( *this, idx, queueFd );
+
+        eCode = qThread->start ( _ifaceMtu );
+
+        if ( NOT_OK ( eCode ) )
+        {
+            LOG_ERR ( L_ERROR, eCode, "Error starting tunnel queue " << idx << " of device '" << _ifaceName
+                      << "'; Using " << idx << " queue(s)" );
+
+            // This stops the thread and closes the FD.
+            delete qThread;
+            break;
+        }
+
+        _queues.append ( qThread );
+    }
+
+    LOG ( L_INFO, "Started multi-queue tunnel device '" << _ifaceName << "' with " << getNumQueues() << " queue(s)" );
+
+    // Even if some of the additional queues failed, we can still use the device.
+    return Error::Success;
+}
+
+uint16_t TunIfaceMultiQueue::getNumQueues() const
+{
+    return isInitialized() ? ( 1 + _queues.size() ) : 0;
+}
+
+bool TunIfaceMultiQueue::getQueueStats ( uint16_t queueIndex, Stats & stats ) const
+{
+    if ( queueIndex == 0 )
+    {
+        stats = _stats;
+        return true;
+    }
+
+    if ( queueIndex > _queues.size() )
+    {
+        return false;
+    }
+
+    _queues.at ( queueIndex - 1 )->getStats ( stats );
+    return true;
+}
@@ -0,0 +1,121 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#pragma once
+
+#include "basic/List.hpp"
+
+#include "TunIfaceDev.hpp"
+
+namespace Pravala
+{
+class TunIfaceMultiQueue;
+
+/// @brief The handler of additional queues of a TunIfaceMultiQueue.
+/// All of its callbacks are called on the threads of those queues, so it has to be thread-safe.
+class TunIfaceQueueHandler
+{
+    protected:
+        /// @brief Called on the queue's thread after an additional queue has been started.
+        /// @param [in] iface The multi-queue interface the queue belongs to.
+        ///                   It should not be used on the queue's thread, other than to identify the interface.
+        /// @param [in] queueIndex The index of the queue (queue 0 is handled by the TunIfaceMultiQueue itself).
+        /// @param [in] queue The queue started. It can be used (only on the queue's thread) to send packets.
+        ///                   If the owner wants to keep a pointer to it, it needs to reference it.
+        /// @return The owner of the queue, which will receive packets read from that queue (on the queue's thread).
+        ///         If it is 0, packets read from that queue will be dropped.
+        virtual TunIfaceOwner * tunQueueStarted (
+            TunIfaceMultiQueue * iface, uint16_t queueIndex, TunIface * queue ) = 0;
+
+        /// @brief Called on the queue's thread when an additional queue is about to be stopped.
+        /// The queue's owner should unreference the queue (if it has been referenced) and stop using it.
+        /// @param [in] iface The multi-queue interface the queue belongs to.
+        /// @param [in] queueIndex The index of the queue.
+        /// @param [in] queue The queue that is being stopped.
+        virtual void tunQueueStopping ( TunIfaceMultiQueue * iface, uint16_t queueIndex, TunIface * queue ) = 0;
+
+        /// @brief Destructor.
+        virtual ~TunIfaceQueueHandler()
+        {
+        }
+
+        friend class TunIfaceMultiQueue;
+};
+
+/// @brief A tunnel interface that uses a multi-queue tunnel device.
+/// Each queue of the device has its own FD, and the kernel keeps packets that belong to a single flow on the same
+/// queue (using flow hashing). The first queue (queue 0) is handled by this object, on the thread that created it,
+/// just like a regular TunIfaceDev. Each of the additional queues is handled by its own thread, with its own
+/// EventManager, PacketDataStore thread cache and PacketMemPool (if the MTU requires one).
+/// Packets read from the additional queues are passed to owners provided by the TunIfaceQueueHandler,
+/// on the threads of those queues.
+/// Queues log using regular TextLog streams, which pass messages logged by other threads to outputs that can only
+/// be used by the main thread through the global AsyncQueue (see TextLog::send()).
+/// Their counters are updated atomically, so they can be read by getQueueStats() on the owner's thread.
+/// Multi-queue devices are only supported on Linux, and only in "managed" mode.
+/// In other cases this interface behaves like a regular TunIfaceDev.
+class TunIfaceMultiQueue: public TunIfaceDev
+{
+    public:
+        /// @brief The number of queues to use (including the first queue, handled by the main thread).
+        static ConfigLimitedNumber<uint16_t> optNumQueues;
+
+        /// @brief Generates a new, reference-counted instance of the TunIfaceMultiQueue.
+        /// @param [in] owner The initial owner to set.
+        /// @param [in] handler The handler of additional queues. If it is 0, only a single queue will be used.
+        ///                     It has to remain valid until this interface is stopped.
+        /// @return A new TunIfaceMultiQueue object.
+        static TunIfaceMultiQueue * generate ( TunIfaceOwner * owner, TunIfaceQueueHandler * handler );
+
+        virtual ERRCODE startManaged ( int ifaceMtu = -1 );
+        virtual void stop();
+
+        /// @brief Returns the number of queues that are running.
+        /// @return The number of queues that are running (including the first queue), or 0 if not initialized.
+        uint16_t getNumQueues() const;
+
+        /// @brief Returns packet and byte counters of a single queue.
+        /// It can be used to verify how the traffic is spread across the queues.
+        /// @param [in] queueIndex The index of the queue (0 to getNumQueues() - 1).
+        /// @param [out] stats The counters of the queue. Not modified if the queue does not exist.
+        /// @return True if the counters were returned; False if the queue does not exist.
+        bool getQueueStats ( uint16_t queueIndex, Stats & stats ) const;
+
+    protected:
+        /// @brief Constructor.
+        /// @param [in] owner The initial owner to set.
+        /// @param [in] handler The handler of additional queues.
+        TunIfaceMultiQueue ( TunIfaceOwner * owner, TunIfaceQueueHandler * handler );
+
+        /// @brief Destructor.
+        virtual ~TunIfaceMultiQueue();
+
+        virtual ERRCODE createTunDevice ( int & ifaceFd, String & ifaceName );
+
+    private:
+        class QueueThread;
+
+        TunIfaceQueueHandler * const _handler; ///< The handler of additional queues.
+
+        /// @brief The threads of additional queues.
+        /// It is only modified on the thread that owns this object.
+        List<QueueThread *> _queues;
+
+        bool _isMultiQueue; ///< Whether the device has been created as a multi-queue device.
+
+        friend class QueueThread;
+};
+}
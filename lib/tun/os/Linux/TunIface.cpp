@@ -30,6 +30,8 @@ extern "C"
 #include "event/SimpleSocket.hpp"
 #include "config/ConfigString.hpp"
 #include "config/ConfigNumber.hpp"
+#include "net/IpPacket.hpp"
+#include "net/TcpPacket.hpp"
 
 #include "../../TunIfaceDev.hpp"
 
@@ -38,6 +40,41 @@ extern "C"
 #define TUN_DEV    "/dev/net/tun"
 #endif
 
+// Older headers may not define UDP segmentation offload flags:
+#ifndef TUN_F_USO4
+#define TUN_F_USO4    0x20
+#endif
+
+#ifndef TUN_F_USO6
+#define TUN_F_USO6    0x40
+#endif
+
+// linux/virtio_net.h cannot be included in C++ code (it uses 'class' as a field name),
+// so we define the parts of it that we need:
+
+#define VNET_HDR_F_NEEDS_CSUM    1
+#define VNET_HDR_GSO_NONE        0
+#define VNET_HDR_GSO_TCPV4       1
+#define VNET_HDR_GSO_TCPV6       4
+#define VNET_HDR_GSO_ECN         0x80
+
+/// @brief The header that precedes each packet when IFF_VNET_HDR is used (same as virtio_net_hdr).
+/// All the fields use the native byte order.
+struct VnetHdr
+{
+    uint8_t flags; ///< Flags (VNET_HDR_F_*).
+    uint8_t gsoType; ///< GSO type (VNET_HDR_GSO_*).
+    uint16_t hdrLen; ///< The length of IP and TCP/UDP headers.
+    uint16_t gsoSize; ///< The size of the payload in each segment.
+    uint16_t csumStart; ///< The position to start checksumming from.
+    uint16_t csumOffset; ///< The offset (after csumStart) to place the checksum at.
+};
+
+/// @brief The size of the virtio header to use with offloads.
+/// This is the size of virtio_net_hdr_mrg_rxbuf, which is 12 bytes long, unlike virtio_net_hdr (10 bytes).
+/// Using it keeps IP headers read from the tunnel 4-byte aligned.
+#define TUN_VNET_HDR_SIZE    12
+
 extern "C"
 {
 // 1st argument - pointer to the memory containing the uncompress module data
@@ -108,8 +145,17 @@ TunIfaceDev * TunIfaceDev::generate ( TunIfaceOwner * owner )
 }
 #endif
 
-ERRCODE TunIfaceDev::osCreateTunDevice ( int & ifaceFd, String & ifaceName )
+/// @brief Creates a tunnel device, or opens another queue of an existing multi-queue device.
+/// @param [in] log Reference to the TextLog instance (so that the LOG macros work)
+/// @param [out] ifaceFd The FD of the created device (or queue); Not modified if there is an error
+/// @param [in,out] ifaceName The name of the device. If it is empty, a new device is created,
+///                           and its name is stored here. Otherwise another queue of that device is opened.
+/// @param [in] multiQueue Whether the device should be (or is) a multi-queue device.
+/// @return Standard error code
+static ERRCODE openTunDevice ( TextLog & log, int & ifaceFd, String & ifaceName, bool multiQueue )
 {
+    const bool isNewDevice = ifaceName.isEmpty();
+
     int tunFd = open ( TUN_DEV, O_RDWR );
 
     if ( tunFd < 0 )
@@ -170,12 +216,28 @@ ERRCODE TunIfaceDev::osCreateTunDevice ( int & ifaceFd, String & ifaceName )
     // Always TUN device, don't use protocol+flags padding.
     tunIfReq.ifr_flags = IFF_TUN | IFF_NO_PI;
 
-    // Don't force a device name - it will be returned by the ioctl.
+    if ( TunIfaceDev::optUseOffloads.value() )
+    {
+        tunIfReq.ifr_flags |= IFF_VNET_HDR;
+    }
+
+    if ( multiQueue )
+    {
+        tunIfReq.ifr_flags |= IFF_MULTI_QUEUE;
+    }
+
+    if ( !isNewDevice )
+    {
+        // We want another queue of an existing device:
+        strncpy ( tunIfReq.ifr_name, ifaceName.c_str(), sizeof ( tunIfReq.ifr_name ) - 1 );
+    }
+
+    // Unless we are opening another queue, don't force a device name - it will be returned by the ioctl.
     int ret = ioctl ( tunFd, ( unsigned int ) TUNSETIFF, ( void * ) &tunIfReq );
 
     if ( ret < 0 )
     {
-        LOG ( L_ERROR, "Error setting interface flags with ioctl: " << strerror ( errno ) );
+        SLOG ( log, L_ERROR, "Error setting interface flags with ioctl: " << strerror ( errno ) );
 
         ::close ( tunFd );
         tunFd = -1;
@@ -183,7 +245,42 @@ ERRCODE TunIfaceDev::osCreateTunDevice ( int & ifaceFd, String & ifaceName )
         return Error::IoctlFailed;
     }
 
-    if ( optTxQueueLength.isSet() && optTxQueueLength.value() > 0 )
+    if ( TunIfaceDev::optUseOffloads.value() )
+    {
+        int hdrSize = TUN_VNET_HDR_SIZE;
+
+        if ( ioctl ( tunFd, ( unsigned int ) TUNSETVNETHDRSZ, ( void * ) &hdrSize ) < 0 )
+        {
+            SLOG ( log, L_ERROR, "Error setting the size of the tunnel device's virtio header: "
+                   << strerror ( errno ) );
+
+            ::close ( tunFd );
+            tunFd = -1;
+
+            return Error::IoctlFailed;
+        }
+
+        // UDP segmentation offload is only supported by newer kernels (6.2+).
+        // If it's not available, we try without it, and without any offloads after that.
+        // Without offloads the kernel will simply deliver regular packets (with virtio headers).
+
+        unsigned int offloads = TUN_F_CSUM | TUN_F_TSO4 | TUN_F_TSO6 | TUN_F_USO4 | TUN_F_USO6;
+
+        if ( ioctl ( tunFd, ( unsigned int ) TUNSETOFFLOAD, offloads ) < 0 )
+        {
+            SLOG ( log, L_WARN, "Error enabling UDP segmentation offload on the tunnel device: "
+                   << strerror ( errno ) );
+
+            offloads = TUN_F_CSUM | TUN_F_TSO4 | TUN_F_TSO6;
+
+            if ( ioctl ( tunFd, ( unsigned int ) TUNSETOFFLOAD, offloads ) < 0 )
+            {
+                SLOG ( log, L_WARN, "Error enabling offloads on the tunnel device: " << strerror ( errno ) );
+            }
+        }
+    }
+
+    if ( isNewDevice && optTxQueueLength.isSet() && optTxQueueLength.value() > 0 )
     {
         // We need a socket to perform ioctl on the tunnel interface.
         // We cannot use the tunnel FD itself (ioctl doesn't like that).
@@ -193,7 +290,7 @@ ERRCODE TunIfaceDev::osCreateTunDevice ( int & ifaceFd, String & ifaceName )
 
         if ( NOT_OK ( eCode ) )
         {
-            LOG_ERR ( L_ERROR, eCode, "Error creating a socket for ioctl operations" );
+            SLOG_ERR ( log, L_ERROR, eCode, "Error creating a socket for ioctl operations" );
 
             ::close ( tunFd );
             tunFd = -1;
@@ -214,8 +311,8 @@ ERRCODE TunIfaceDev::osCreateTunDevice ( int & ifaceFd, String & ifaceName )
 
         if ( ret < 0 )
         {
-            LOG ( L_ERROR, "Error setting tunnel device's transmit queue length to "
-                  << optTxQueueLength.value() << ": " << strerror ( errno ) );
+            SLOG ( log, L_ERROR, "Error setting tunnel device's transmit queue length to "
+                   << optTxQueueLength.value() << ": " << strerror ( errno ) );
 
             ::close ( tunFd );
             tunFd = -1;
@@ -230,13 +327,142 @@ ERRCODE TunIfaceDev::osCreateTunDevice ( int & ifaceFd, String & ifaceName )
     return Error::Success;
 }
 
+ERRCODE TunIfaceDev::osCreateTunDevice ( int & ifaceFd, String & ifaceName )
+{
+    String name;
+    const ERRCODE eCode = openTunDevice ( _log, ifaceFd, name, false );
+
+    if ( IS_OK ( eCode ) )
+    {
+        ifaceName = name;
+    }
+
+    return eCode;
+}
+
+ERRCODE TunIfaceDev::osCreateTunQueue ( int & queueFd, String & ifaceName )
+{
+    return openTunDevice ( _log, queueFd, ifaceName, true );
+}
+
+uint16_t TunIfaceDev::osGetOffloadHdrSize ( int fd )
+{
+    struct ifreq tunIfReq;
+
+    memset ( &tunIfReq, 0, sizeof ( tunIfReq ) );
+
+    if ( ioctl ( fd, ( unsigned int ) TUNGETIFF, ( void * ) &tunIfReq ) < 0
+         || ( tunIfReq.ifr_flags & IFF_VNET_HDR ) != IFF_VNET_HDR )
+    {
+        return 0;
+    }
+
+    int hdrSize = 0;
+
+    if ( ioctl ( fd, ( unsigned int ) TUNGETVNETHDRSZ, ( void * ) &hdrSize ) < 0
+         || hdrSize < ( int ) sizeof ( VnetHdr ) || hdrSize > 0xFF )
+    {
+        LOG ( L_ERROR, "Tunnel device uses virtio headers, but their size could not be determined: "
+              << hdrSize << "; Error: " << strerror ( errno ) );
+
+        return 0;
+    }
+
+    return ( uint16_t ) hdrSize;
+}
+
 bool TunIfaceDev::osGetWriteData ( const IpPacket & ipPacket, MemVector & vec )
 {
+    if ( _offloadHdrSize > 0 && !vec.append ( _offloadWriteHdr ) )
+    {
+        return false;
+    }
+
     return vec.append ( ipPacket.getPacketData() );
 }
 
-bool TunIfaceDev::osRead ( MemHandle & data )
+bool TunIfaceDev::osGetSuperPacketWriteData ( const IpPacket & superPacket, uint16_t segmentSize, MemVector & vec )
+{
+    const TcpPacket::Header * const tcpHdr = superPacket.getProtoHeader<TcpPacket>();
+    const size_t payloadSize = superPacket.getProtoPayloadSize<TcpPacket>();
+
+    if ( _offloadHdrSize < sizeof ( VnetHdr ) || !tcpHdr || payloadSize < 1 || segmentSize < 1 )
+    {
+        return false;
+    }
+
+    const size_t hdrLen = superPacket.getPacketSize() - payloadSize;
+
+    assert ( hdrLen > tcpHdr->getHeaderSize() );
+
+    VnetHdr hdr;
+
+    memset ( &hdr, 0, sizeof ( hdr ) );
+
+    // The OS splits the packet, and completes the checksum of each segment
+    // (the checksum field contains the checksum of the pseudo-header).
+    hdr.flags = VNET_HDR_F_NEEDS_CSUM;
+    hdr.gsoType = ( superPacket.getIpVersion() == 6 ) ? VNET_HDR_GSO_TCPV6 : VNET_HDR_GSO_TCPV4;
+    hdr.hdrLen = ( uint16_t ) hdrLen;
+    hdr.gsoSize = segmentSize;
+    hdr.csumStart = ( uint16_t ) ( hdrLen - tcpHdr->getHeaderSize() );
+    hdr.csumOffset = 16; // The offset of 'checksum' in TCP header.
+
+    MemHandle hdrData ( _offloadHdrSize );
+    char * const w = hdrData.getWritable();
+
+    if ( !w || hdrData.size() != _offloadHdrSize )
+    {
+        return false;
+    }
+
+    memset ( w, 0, hdrData.size() );
+    memcpy ( w, &hdr, sizeof ( hdr ) );
+
+    return ( vec.append ( hdrData ) && vec.append ( superPacket.getPacketData() ) );
+}
+
+/// @brief Processes the virtio header at the beginning of the data read from the tunnel device.
+/// It removes the header, completes the checksum of the packet (if needed),
+/// and determines the segment size for "super-packets".
+/// @param [in,out] data The data read from the tunnel device. The header will be consumed.
+/// @param [in] hdrSize The size of the virtio header.
+/// @param [out] segmentSize The size of payload segments, or 0 if the packet is not a "super-packet".
+/// @return True if the header was processed properly; False if it (or the packet) was invalid.
+static bool processVnetHeader ( MemHandle & data, uint16_t hdrSize, uint16_t & segmentSize )
+{
+    segmentSize = 0;
+
+    VnetHdr hdr;
+
+    if ( data.size() <= hdrSize || hdrSize < sizeof ( hdr ) )
+    {
+        return false;
+    }
+
+    memcpy ( &hdr, data.get(), sizeof ( hdr ) );
+
+    data.consume ( hdrSize );
+
+    if ( ( hdr.gsoType & ~VNET_HDR_GSO_ECN ) != VNET_HDR_GSO_NONE && hdr.gsoSize > 0 )
+    {
+        // The checksums will be generated for each segment separately.
+        segmentSize = hdr.gsoSize;
+        return true;
+    }
+
+    if ( ( hdr.flags & VNET_HDR_F_NEEDS_CSUM ) != VNET_HDR_F_NEEDS_CSUM )
+    {
+        return true;
+    }
+
+    return IpPacket::completePartialChecksum ( data, hdr.csumStart, hdr.csumOffset );
+}
+
+bool TunIfaceDev::osRead ( MemHandle & data, uint16_t & segmentSize )
 {
+    segmentSize = 0;
+
     char * const w = data.getWritable();
 
     if ( !w || data.isEmpty() )
@@ -261,6 +487,15 @@ bool TunIfaceDev::osRead ( MemHandle & data )
 
         data.truncate ( ret );
 
+        if ( _offloadHdrSize > 0 && !processVnetHeader ( data, _offloadHdrSize, segmentSize ) )
+        {
+            LOG_LIM ( L_ERROR, "Received invalid data from the tunnel device (" << ret
+                      << " bytes, including the virtio header); Dropping" );
+
+            // Not critical, the tunnel can still be used.
+            data.clear();
+        }
+
         return true;
     }
 
@@ -87,6 +87,13 @@ ERRCODE TunIfaceVhostNet::setupFd ( int fd )
         _vh = 0;
     }
 
+    if ( _offloadHdrSize > 0 )
+    {
+        LOG ( L_ERROR, "vhost-net tunnel cannot be used with tunnel offloads, falling back to normal tunnel" );
+
+        return Error::Success;
+    }
+
     _vh = VhostNet::generate ( this, fd, eCode );
 
     if ( !_vh )
@@ -166,3 +166,8 @@ ERRCODE TunIfaceDev::osCreateTunDevice ( int & ifaceFd, String & ifaceName )
 
     return Error::Success;
 }
+
+ERRCODE TunIfaceDev::osCreateTunQueue ( int &, String & )
+{
+    return Error::Unsupported;
+}
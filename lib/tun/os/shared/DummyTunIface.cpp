@@ -28,7 +28,17 @@ ERRCODE TunIfaceDev::osCreateTunDevice ( int &, String & )
     return Error::Unsupported;
 }
 
-bool TunIfaceDev::osRead ( MemHandle & )
+ERRCODE TunIfaceDev::osCreateTunQueue ( int &, String & )
+{
+    return Error::Unsupported;
+}
+
+uint16_t TunIfaceDev::osGetOffloadHdrSize ( int )
+{
+    return 0;
+}
+
+bool TunIfaceDev::osRead ( MemHandle &, uint16_t & )
 {
     return Error::Unsupported;
 }
@@ -37,3 +47,8 @@ bool TunIfaceDev::osGetWriteData ( const IpPacket &, MemVector & )
 {
     return false;
 }
+
+bool TunIfaceDev::osGetSuperPacketWriteData ( const IpPacket &, uint16_t, MemVector & )
+{
+    return false;
+}
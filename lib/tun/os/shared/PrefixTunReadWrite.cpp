@@ -66,10 +66,24 @@ bool TunIfaceDev::osGetWriteData ( const IpPacket & ipPacket, MemVector & vec )
     return false;
 }
 
-bool TunIfaceDev::osRead ( MemHandle & data )
+bool TunIfaceDev::osGetSuperPacketWriteData ( const IpPacket &, uint16_t, MemVector & )
+{
+    // Offloads are not supported.
+    return false;
+}
+
+uint16_t TunIfaceDev::osGetOffloadHdrSize ( int )
+{
+    // Offloads are not supported.
+    return 0;
+}
+
+bool TunIfaceDev::osRead ( MemHandle & data, uint16_t & segmentSize )
 {
     assert ( TUN_PREFIX_SIZE % 4 == 0 );
 
+    segmentSize = 0;
+
     char * const w = data.getWritable();
 
     if ( !w || data.size() <= TUN_PREFIX_SIZE )
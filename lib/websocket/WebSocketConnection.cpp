@@ -35,11 +35,13 @@ extern "C"
 #pragma GCC diagnostic pop
 #endif
 
+#include "basic/Math.hpp"
 #include "base64/Base64.hpp"
 #include "sys/SocketApi.hpp"
 
 #include "internal/WebSocketFrameHeader.hpp"
 #include "internal/WebSocketFrame.hpp"
+#include "internal/WebSocketMask.hpp"
 #include "WebSocketConnection.hpp"
 #include "WebSocketListener.hpp"
 
@@ -108,6 +110,8 @@ TextLog WebSocketConnection::_log ( "web_socket_connection" );
 
 WebSocketConnection::WebSocketConnection():
     _timer ( *this ),
+    _rxCompleteSize ( 0 ),
+    _rxUnmaskedSize ( 0 ),
     _state ( Disconnected ),
     _continueState ( ContinueNone ),
     _listener ( 0 ),
@@ -157,6 +161,8 @@ void WebSocketConnection::close()
 {
     _writeQueue.clear();
     _readBuf.clear();
+    _rxCompleteSize = 0;
+    _rxUnmaskedSize = 0;
     _parser.reset();
 
     _state = Disconnected;
@@ -259,6 +265,12 @@ void WebSocketConnection::receiveFdEvent ( int fd, short int events )
 
             case Established:
             case WsClosing:
+                if ( !unmaskReceived() )
+                {
+                    // We don't have a complete frame yet.
+                    return;
+                }
+
                 // This may call callbacks, i.e. we may no longer exist after this, so return after calling it.
                 processWebSocketFrame();
                 return;
@@ -614,17 +626,79 @@ void WebSocketConnection::sendWebSocketClose()
     _timer.start ( WS_CLOSING_TIMEOUT );
 }
 
+bool WebSocketConnection::unmaskReceived()
+{
+    const size_t bufSize = _readBuf.size();
+
+    // All the frames before _rxCompleteSize have been unmasked already.
+    // We only need to look at the frames after them, and continue unmasking the incomplete one (if any).
+    while ( _rxCompleteSize < bufSize )
+    {
+        WebSocketFrameHeader hdr;
+
+        if ( !hdr.parse ( _readBuf.get ( _rxCompleteSize ), bufSize - _rxCompleteSize ) )
+        {
+            // Not enough data for complete header
+            break;
+        }
+
+        const size_t hdrSize = hdr.getHdrSize();
+        const size_t payloadSize = hdr.getPayloadSize();
+        const size_t rcvdSize = min<size_t> ( bufSize - _rxCompleteSize - hdrSize, payloadSize );
+
+        assert ( _rxUnmaskedSize <= rcvdSize );
+
+        /// @todo support pre-mask extensions
+
+        if ( hdr.hasMask() && rcvdSize > _rxUnmaskedSize )
+        {
+            char * const payloadBuf = _readBuf.getWritable ( _rxCompleteSize + hdrSize + _rxUnmaskedSize );
+
+            if ( !payloadBuf )
+            {
+                // Not enough memory to unmask
+
+                LOG ( L_ERROR, "Not enough memory to unmask frame, closing socket" );
+
+                sendWebSocketClose();
+                return false;
+            }
+
+            // In place unmask of the bytes received since the last time.
+            // The mask offset depends on how many payload bytes have been unmasked before.
+            WebSocketMask::mask ( payloadBuf, rcvdSize - _rxUnmaskedSize, hdr.getMask(), _rxUnmaskedSize & 3 );
+        }
+
+        if ( rcvdSize < payloadSize )
+        {
+            // Incomplete frame, we will continue unmasking it when we receive more data.
+            _rxUnmaskedSize = rcvdSize;
+            break;
+        }
+
+        _rxCompleteSize += hdrSize + payloadSize;
+        _rxUnmaskedSize = 0;
+    }
+
+    return ( _rxCompleteSize > 0 );
+}
+
 void WebSocketConnection::processWebSocketFrame()
 {
     MemHandle data ( _readBuf );
 
     _readBuf.clear();
 
+    // Complete frames have already been unmasked by unmaskReceived().
+    size_t completeSize = _rxCompleteSize;
+
+    _rxCompleteSize = 0;
+
     // SELF REFERENCE until we unref ourselves after the switch block.
     // DO NOT RETURN!
     simpleRef();
 
-    while ( !data.isEmpty() )
+    while ( completeSize > 0 )
     {
         WebSocketConnectionOwner * owner = getOwner();
 
@@ -638,8 +712,10 @@ void WebSocketConnection::processWebSocketFrame()
 
         if ( !hdr.parseAndConsume ( data, payload ) )
         {
-            // Not enough data for complete header
-            LOG ( L_DEBUG4, "Incomplete frame. Instance: " << ( uint64_t ) this );
+            // This should not happen, unmaskReceived() has found a complete frame here.
+            assert ( false );
+
+            LOG ( L_ERROR, "Incomplete frame; Instance: " << ( uint64_t ) this );
             break;
         }
 
@@ -647,32 +723,14 @@ void WebSocketConnection::processWebSocketFrame()
 
         const size_t payloadSize = payload.size();
 
+        assert ( hdr.getHdrSize() + payloadSize <= completeSize );
+
+        completeSize -= hdr.getHdrSize() + payloadSize;
+
         LOG ( L_DEBUG4, "Got frame; Header size: " << hdr.getHdrSize() << "; Payload size: " << payloadSize
               << "; Opcode: 0x" << String::number ( hdr.getOpCode(), String::Int_HEX )
               << "; Instance: " << ( uint64_t ) this );
 
-        /// @todo support pre-mask extensions
-
-        if ( hdr.hasMask() )
-        {
-            LOG ( L_DEBUG4, "Unmasking using mask: 0x" << String::number ( hdr.getMask(), String::Int_Hex ) );
-
-            char * const payloadBuf = payload.getWritable();
-
-            if ( !payloadBuf )
-            {
-                // Not enough memory to unmask
-
-                LOG ( L_ERROR, "Not enough memory to unmask frame, closing socket" );
-
-                sendWebSocketClose();
-                break;
-            }
-
-            // In place unmask
-            hdr.mask ( payloadBuf, payloadSize );
-        }
-
         /// @todo support post-mask extensions
 
         switch ( hdr.getOpCode() )
@@ -804,6 +862,10 @@ void WebSocketConnection::processWebSocketFrame()
     if ( !data.isEmpty() )
     {
         _readBuf.append ( data );
+
+        // Complete frames that we didn't process (if any) are still at the beginning, and they are still unmasked.
+        // The number of unmasked bytes of the incomplete frame that follows them has not changed.
+        _rxCompleteSize = completeSize;
     }
 
     simpleUnref();
@@ -156,6 +156,14 @@ class WebSocketConnection:
         List<MemHandle> _writeQueue; ///< Queue of frames to write
         RwBuffer _readBuf; ///< Read buffer
 
+        /// @brief The number of bytes at the beginning of the read buffer that contain complete frames.
+        /// Payloads of those frames have already been unmasked.
+        size_t _rxCompleteSize;
+
+        /// @brief The number of payload bytes of the (incomplete) frame that follows complete frames
+        /// in the read buffer, that have already been unmasked.
+        size_t _rxUnmaskedSize;
+
         HttpParser _parser; ///< HTTP parser
 
         String _url; ///< URL this connection is handling
@@ -197,6 +205,15 @@ class WebSocketConnection:
         /// @brief Called to handle incoming data after the header has been parsed while we are in the ClientWait state
         void handleHttpClient();
 
+        /// @brief Unmasks payloads of frames in the read buffer that have not been unmasked yet.
+        ///
+        /// It is called every time new data is received. It unmasks all the payload bytes that have been received
+        /// (including the payload of the last frame, which may be incomplete), so frames are ready to be delivered
+        /// as soon as their last byte arrives.
+        ///
+        /// @return True if the read buffer contains at least one complete frame; False otherwise.
+        bool unmaskReceived();
+
         /// @brief Processes a WebSocket frame.
         ///
         /// This tries to parse a WebSocket frame and if possible delivers the data via a callback.
@@ -101,27 +101,42 @@ uint8_t WebSocketFrameHeader::setupWebSocketFrame ( OpCode opCode, bool finFlag,
     return getHdrSize();
 }
 
-bool WebSocketFrameHeader::parseAndConsume ( MemHandle & buf, MemHandle & payload )
+bool WebSocketFrameHeader::parse ( const char * data, size_t dataSize )
 {
-    if ( buf.size() < sizeof ( WebSocketHeader ) )
+    if ( !data || dataSize < sizeof ( WebSocketHeader ) )
     {
         // Not enough data for the minimum header
         return false;
     }
 
-    const WebSocketFrameHeader * hdr = reinterpret_cast<const WebSocketFrameHeader *> ( buf.get() );
-
-    assert ( hdr != 0 );
+    const WebSocketFrameHeader * hdr = reinterpret_cast<const WebSocketFrameHeader *> ( data );
 
     const uint8_t hdrSize = hdr->getHdrSize();
 
-    if ( buf.size() < hdrSize )
+    if ( dataSize < hdrSize )
+    {
+        // Not enough bytes for the full header
+        return false;
+    }
+
+    assert ( hdrSize <= sizeof ( *this ) );
+
+    // Copy the header from the buffer into this object
+    memcpy ( this, hdr, hdrSize );
+
+    return true;
+}
+
+bool WebSocketFrameHeader::parseAndConsume ( MemHandle & buf, MemHandle & payload )
+{
+    if ( !parse ( buf.get(), buf.size() ) )
     {
         // Not enough bytes for the full header
         return false;
     }
 
-    const size_t payloadSize = hdr->getPayloadSize();
+    const uint8_t hdrSize = getHdrSize();
+    const size_t payloadSize = getPayloadSize();
     const size_t frameSize = hdrSize + payloadSize;
 
     if ( buf.size() < frameSize )
@@ -130,11 +145,6 @@ bool WebSocketFrameHeader::parseAndConsume ( MemHandle & buf, MemHandle & payloa
         return false;
     }
 
-    assert ( hdrSize <= sizeof ( *this ) );
-
-    // Copy the header from the buffer into this object
-    memcpy ( this, hdr, hdrSize );
-
     // Get the handle for the payload
     payload = buf.getHandle ( hdrSize, payloadSize );
 
@@ -199,34 +209,3 @@ uint32_t WebSocketFrameHeader::getMask() const
             return 0;
     }
 }
-
-void WebSocketFrameHeader::maskAndCopy ( char * dst, const char * src, size_t len )
-{
-    const uint32_t maskVal = getMask();
-
-    // We can do the faster 4-byte XOR until there aren't 4 bytes left.
-    //
-    // Endianness doesn't matter, since each byte of the uint32_t mask value will be masked to the same
-    // byte of the src, and put back into the same place, regardless of endianness.
-    while ( len >= 4 )
-    {
-        *reinterpret_cast<uint32_t *> ( dst ) = *reinterpret_cast<const uint32_t *> ( src ) ^ maskVal;
-
-        dst += 4;
-        src += 4;
-        len -= 4;
-    }
-
-    // If there are bytes left over, do a slower byte-by-byte XOR
-    if ( len != 0 )
-    {
-        assert ( len < 4 );
-
-        const uint8_t * mask8 = ( const uint8_t * ) &maskVal;
-
-        for ( ; len != 0; ++src, ++dst, ++mask8, --len )
-        {
-            *dst = *src ^ *mask8;
-        }
-    }
-}
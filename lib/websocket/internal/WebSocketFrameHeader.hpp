@@ -24,6 +24,8 @@ extern "C"
 #include <basic/MemHandle.hpp>
 #include <basic/Buffer.hpp>
 
+#include "WebSocketMask.hpp"
+
 namespace Pravala
 {
 #pragma pack(push, 1)
@@ -135,6 +137,14 @@ union WebSocketFrameHeader
         /// @return Length of the WebSocket frame header
         uint8_t setupWebSocketFrame ( OpCode opCode, bool finFlag, uint64_t payloadLen, bool setMask );
 
+        /// @brief Parse a WebSocket frame header.
+        /// It only needs the header to be complete; The payload does not need to be present.
+        /// @param [in] data The memory that starts with a WebSocket frame header.
+        /// @param [in] dataSize The number of bytes available in data.
+        /// @return True if the parse succeeded and this object is now in a valid state;
+        ///         False if there is not enough data for the full header.
+        bool parse ( const char * data, size_t dataSize );
+
         /// @brief Parse a WebSocket frame and consume the data from the buffer if successful.
         ///
         /// @param [in] buf MemHandle that contains a WebSocket frame.
@@ -194,7 +204,10 @@ union WebSocketFrameHeader
         /// @param [in] dst Where to put the masked data.
         /// @param [in] src Pointer to the first byte of the source to mask
         /// @param [in] len Number of bytes to copy and mask
-        void maskAndCopy ( char * dst, const char * src, size_t len );
+        inline void maskAndCopy ( char * dst, const char * src, size_t len )
+        {
+            WebSocketMask::maskAndCopy ( dst, src, len, getMask(), 0 );
+        }
 
         /// @brief Returns true if this frame header has a mask
         /// @return True if this frame header has a mask
@@ -0,0 +1,291 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <cassert>
+#include <cstring>
+
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#define WEBSOCKET_MASK_X86     1
+#include <immintrin.h>
+#elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+#define WEBSOCKET_MASK_NEON    1
+#include <arm_neon.h>
+#endif
+
+#include "WebSocketMask.hpp"
+
+using namespace Pravala;
+
+/// @brief Portable mask function.
+/// It XORs 8 bytes at a time, and then the remaining bytes one at a time.
+/// @param [out] dst Where to put the masked data (can be the same as src).
+/// @param [in] src The data to mask. Does NOT need to be aligned in any specific way.
+/// @param [in] len The number of bytes to mask.
+/// @param [in] maskVal The mask to use, already rotated so that its first byte applies to the first byte of src.
+static void maskPortable ( char * dst, const char * src, size_t len, uint32_t maskVal )
+{
+    const uint32_t maskVals[ 2 ] = { maskVal, maskVal };
+    uint64_t mask64;
+
+    memcpy ( &mask64, maskVals, 8 );
+
+    // memcpy is used to perform unaligned loads and stores - compilers turn it into a single (unaligned) instruction.
+    while ( len >= 8 )
+    {
+        uint64_t v;
+
+        memcpy ( &v, src, 8 );
+
+        v ^= mask64;
+
+        memcpy ( dst, &v, 8 );
+
+        dst += 8;
+        src += 8;
+        len -= 8;
+    }
+
+    // We processed a multiple of 4 bytes, so the remaining data still starts at the first byte of the mask.
+    const uint8_t * const mask8 = ( const uint8_t * ) &maskVal;
+
+    for ( size_t i = 0; i < len; ++i )
+    {
+        dst[ i ] = src[ i ] ^ mask8[ i & 3 ];
+    }
+}
+
+#ifdef WEBSOCKET_MASK_X86
+
+/// @brief SSE2 mask function.
+/// @param [out] dst Where to put the masked data (can be the same as src).
+/// @param [in] src The data to mask. Does NOT need to be aligned in any specific way.
+/// @param [in] len The number of bytes to mask.
+/// @param [in] maskVal The mask to use, already rotated so that its first byte applies to the first byte of src.
+__attribute__ ( ( target ( "sse2" ) ) ) static void maskSse2 (
+    char * dst, const char * src, size_t len, uint32_t maskVal )
+{
+    const __m128i mask128 = _mm_set1_epi32 ( ( int ) maskVal );
+
+    while ( len >= 32 )
+    {
+        const __m128i vA = _mm_loadu_si128 ( ( const __m128i * ) src );
+        const __m128i vB = _mm_loadu_si128 ( ( const __m128i * ) ( src + 16 ) );
+
+        _mm_storeu_si128 ( ( __m128i * ) dst, _mm_xor_si128 ( vA, mask128 ) );
+        _mm_storeu_si128 ( ( __m128i * ) ( dst + 16 ), _mm_xor_si128 ( vB, mask128 ) );
+
+        dst += 32;
+        src += 32;
+        len -= 32;
+    }
+
+    // There are at most 31 bytes left, and they still start at the first byte of the mask:
+    maskPortable ( dst, src, len, maskVal );
+}
+
+/// @brief AVX2 mask function.
+/// @param [out] dst Where to put the masked data (can be the same as src).
+/// @param [in] src The data to mask. Does NOT need to be aligned in any specific way.
+/// @param [in] len The number of bytes to mask.
+/// @param [in] maskVal The mask to use, already rotated so that its first byte applies to the first byte of src.
+__attribute__ ( ( target ( "avx2" ) ) ) static void maskAvx2 (
+    char * dst, const char * src, size_t len, uint32_t maskVal )
+{
+    const __m256i mask256 = _mm256_set1_epi32 ( ( int ) maskVal );
+
+    while ( len >= 64 )
+    {
+        const __m256i vA = _mm256_loadu_si256 ( ( const __m256i * ) src );
+        const __m256i vB = _mm256_loadu_si256 ( ( const __m256i * ) ( src + 32 ) );
+
+        _mm256_storeu_si256 ( ( __m256i * ) dst, _mm256_xor_si256 ( vA, mask256 ) );
+        _mm256_storeu_si256 ( ( __m256i * ) ( dst + 32 ), _mm256_xor_si256 ( vB, mask256 ) );
+
+        dst += 64;
+        src += 64;
+        len -= 64;
+    }
+
+    // There are at most 63 bytes left, and they still start at the first byte of the mask:
+    maskPortable ( dst, src, len, maskVal );
+}
+
+#endif
+
+#ifdef WEBSOCKET_MASK_NEON
+
+/// @brief NEON mask function.
+/// @param [out] dst Where to put the masked data (can be the same as src).
+/// @param [in] src The data to mask. Does NOT need to be aligned in any specific way.
+/// @param [in] len The number of bytes to mask.
+/// @param [in] maskVal The mask to use, already rotated so that its first byte applies to the first byte of src.
+static void maskNeon ( char * dst, const char * src, size_t len, uint32_t maskVal )
+{
+    const uint8x16_t mask128 = vreinterpretq_u8_u32 ( vdupq_n_u32 ( maskVal ) );
+
+    while ( len >= 32 )
+    {
+        const uint8x16_t vA = vld1q_u8 ( ( const uint8_t * ) src );
+        const uint8x16_t vB = vld1q_u8 ( ( const uint8_t * ) ( src + 16 ) );
+
+        vst1q_u8 ( ( uint8_t * ) dst, veorq_u8 ( vA, mask128 ) );
+        vst1q_u8 ( ( uint8_t * ) ( dst + 16 ), veorq_u8 ( vB, mask128 ) );
+
+        dst += 32;
+        src += 32;
+        len -= 32;
+    }
+
+    // There are at most 31 bytes left, and they still start at the first byte of the mask:
+    maskPortable ( dst, src, len, maskVal );
+}
+
+#endif
+
+WebSocketMask::MaskFunc WebSocketMask::_maskFunc ( 0 );
+WebSocketMask::Implementation WebSocketMask::_maskFuncImpl ( WebSocketMask::ImplAuto );
+
+bool WebSocketMask::setImplementation ( WebSocketMask::Implementation impl )
+{
+#ifdef WEBSOCKET_MASK_X86
+    __builtin_cpu_init();
+
+    const bool hasSse2 = __builtin_cpu_supports ( "sse2" );
+    const bool hasAvx2 = __builtin_cpu_supports ( "avx2" );
+#endif
+
+    switch ( impl )
+    {
+        case ImplAuto:
+#ifdef WEBSOCKET_MASK_X86
+            if ( hasAvx2 )
+            {
+                return setImplementation ( ImplAvx2 );
+            }
+            else if ( hasSse2 )
+            {
+                return setImplementation ( ImplSse2 );
+            }
+#elif defined( WEBSOCKET_MASK_NEON )
+            return setImplementation ( ImplNeon );
+#endif
+            return setImplementation ( ImplPortable );
+
+        case ImplPortable:
+            _maskFunc = maskPortable;
+            _maskFuncImpl = impl;
+            return true;
+
+        case ImplSse2:
+#ifdef WEBSOCKET_MASK_X86
+            if ( hasSse2 )
+            {
+                _maskFunc = maskSse2;
+                _maskFuncImpl = impl;
+                return true;
+            }
+#endif
+            break;
+
+        case ImplAvx2:
+#ifdef WEBSOCKET_MASK_X86
+            if ( hasAvx2 )
+            {
+                _maskFunc = maskAvx2;
+                _maskFuncImpl = impl;
+                return true;
+            }
+#endif
+            break;
+
+        case ImplNeon:
+#ifdef WEBSOCKET_MASK_NEON
+            _maskFunc = maskNeon;
+            _maskFuncImpl = impl;
+            return true;
+#endif
+            break;
+    }
+
+    return false;
+}
+
+WebSocketMask::Implementation WebSocketMask::getImplementation()
+{
+    if ( !_maskFunc )
+    {
+        setImplementation ( ImplAuto );
+    }
+
+    return _maskFuncImpl;
+}
+
+uint8_t WebSocketMask::maskAndCopy ( char * dst, const char * src, size_t len, uint32_t maskVal, uint8_t maskOffset )
+{
+    maskOffset &= 3;
+
+    if ( len < 1 )
+    {
+        return maskOffset;
+    }
+
+    assert ( dst != 0 );
+    assert ( src != 0 );
+    assert ( dst == src || dst + len <= src || src + len <= dst );
+
+    if ( !_maskFunc )
+    {
+        setImplementation ( ImplAuto );
+    }
+
+    assert ( _maskFunc != 0 );
+
+    if ( maskOffset != 0 )
+    {
+        // Mask engines always start at the first byte of the mask, so we need to rotate it.
+        // This is done on bytes (and not using shifts), so that it doesn't depend on the endianness.
+        const uint8_t * const orgMask = ( const uint8_t * ) &maskVal;
+        uint8_t rotMask[ 4 ];
+
+        for ( uint8_t i = 0; i < 4; ++i )
+        {
+            rotMask[ i ] = orgMask[ ( maskOffset + i ) & 3 ];
+        }
+
+        memcpy ( &maskVal, rotMask, 4 );
+    }
+
+    _maskFunc ( dst, src, len, maskVal );
+
+    return ( uint8_t ) ( ( maskOffset + len ) & 3 );
+}
+
+uint8_t WebSocketMask::maskAndCopy ( char * dst, const MemVector & src, uint32_t maskVal, uint8_t maskOffset )
+{
+    const struct iovec * chunks = src.getChunks();
+    const size_t numChunks = src.getNumChunks();
+
+    for ( size_t i = 0; i < numChunks; ++i )
+    {
+        const size_t chunkLen = chunks[ i ].iov_len;
+
+        maskOffset = maskAndCopy ( dst, ( const char * ) chunks[ i ].iov_base, chunkLen, maskVal, maskOffset );
+
+        dst += chunkLen;
+    }
+
+    return maskOffset;
+}
@@ -0,0 +1,103 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#pragma once
+
+extern "C"
+{
+#include <stdint.h>
+}
+
+#include "basic/MemVector.hpp"
+
+namespace Pravala
+{
+/// @brief A helper class that performs WebSocket masking (RFC 6455, section 5.3).
+/// Each byte of the payload is XORed with one of the 4 bytes of the mask; The byte at payload offset 'i'
+/// uses mask byte 'i % 4'. Since masking and unmasking is the same operation, this class is used for both.
+/// The mask is passed as a 32-bit value, exactly as it is stored in the frame header (so the first byte
+/// of the mask in memory is the first byte of the mask on the wire), which means that the endianness doesn't matter.
+/// Payloads can be processed in pieces (as they are received, or as they are stored in MemVector chunks).
+/// Each call takes the offset in the mask to start at (which is the payload offset of the first byte, modulo 4),
+/// and returns the offset to be used for the data that follows.
+/// The actual XOR is performed by one of the "mask engines" (see Implementation), which do not care about
+/// memory alignment.
+class WebSocketMask
+{
+    public:
+        /// @brief The implementations of the engine that masks the data.
+        enum Implementation
+        {
+            ImplAuto,     ///< The fastest implementation supported by the CPU.
+            ImplPortable, ///< Portable implementation that uses 64-bit words.
+            ImplSse2,     ///< Implementation that uses SSE2 instructions (x86 only).
+            ImplAvx2,     ///< Implementation that uses AVX2 instructions (x86 only).
+            ImplNeon      ///< Implementation that uses NEON instructions (ARM only).
+        };
+
+        /// @brief Masks the data and puts the result in dst.
+        /// @param [out] dst Where to put the masked data. It can be the same as src (to mask in place),
+        ///                  but the memory should not overlap otherwise.
+        /// @param [in] src The data to mask. Does NOT need to be aligned in any specific way.
+        /// @param [in] len The number of bytes to mask.
+        /// @param [in] maskVal The mask to use (as stored in the frame header).
+        /// @param [in] maskOffset The offset in the mask of the first byte (only the 2 lowest bits are used).
+        /// @return The offset in the mask of the byte that follows the data (to be used with the next piece).
+        static uint8_t maskAndCopy ( char * dst, const char * src, size_t len, uint32_t maskVal, uint8_t maskOffset );
+
+        /// @brief Masks the data in place.
+        /// @param [in,out] data The data to mask. Does NOT need to be aligned in any specific way.
+        /// @param [in] len The number of bytes to mask.
+        /// @param [in] maskVal The mask to use (as stored in the frame header).
+        /// @param [in] maskOffset The offset in the mask of the first byte (only the 2 lowest bits are used).
+        /// @return The offset in the mask of the byte that follows the data (to be used with the next piece).
+        static inline uint8_t mask ( char * data, size_t len, uint32_t maskVal, uint8_t maskOffset )
+        {
+            return maskAndCopy ( data, data, len, maskVal, maskOffset );
+        }
+
+        /// @brief Masks the content of the vector and puts the result in a single, continuous memory.
+        /// The mask offset is carried across the chunks, so they can be of any size.
+        /// @param [out] dst Where to put the masked data. It has to be at least src.getDataSize() bytes long.
+        /// @param [in] src The data to mask.
+        /// @param [in] maskVal The mask to use (as stored in the frame header).
+        /// @param [in] maskOffset The offset in the mask of the first byte (only the 2 lowest bits are used).
+        /// @return The offset in the mask of the byte that follows the data (to be used with the next piece).
+        static uint8_t maskAndCopy ( char * dst, const MemVector & src, uint32_t maskVal, uint8_t maskOffset = 0 );
+
+        /// @brief Selects the implementation of the mask engine to use.
+        /// It is used by all WebSocket code, and should only be changed for testing and benchmarking.
+        /// @param [in] impl The implementation to use. ImplAuto selects the best one available.
+        /// @return True if the implementation was selected; False if it is not supported by this CPU or build.
+        static bool setImplementation ( Implementation impl );
+
+        /// @brief Returns the implementation of the mask engine currently in use.
+        /// @return The implementation of the mask engine currently in use (never ImplAuto).
+        static Implementation getImplementation();
+
+    private:
+        /// @brief Type of the function that masks the memory.
+        /// @param [out] dst Where to put the masked data (can be the same as src).
+        /// @param [in] src The data to mask. Does NOT need to be aligned in any specific way.
+        /// @param [in] len The number of bytes to mask.
+        /// @param [in] maskVal The mask to use, already rotated so that its first byte applies to the first byte
+        ///                     of src.
+        typedef void (* MaskFunc)( char * dst, const char * src, size_t len, uint32_t maskVal );
+
+        static MaskFunc _maskFunc;            ///< The function used for masking the memory.
+        static Implementation _maskFuncImpl; ///< The implementation of _maskFunc.
+};
+}
@@ -0,0 +1,182 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+extern "C"
+{
+#include <pthread.h>
+}
+
+#include "basic/Math.hpp"
+#include "basic/String.hpp"
+#include "sys/CurrentTime.hpp"
+#include "event/AsyncQueue.hpp"
+
+using namespace Pravala;
+
+/// @brief The number of tasks each producer thread should run.
+static uint32_t numTasksPerThread = 0;
+
+/// @brief The number of tasks that still need to run during the current test.
+static uint32_t numTasksLeft = 0;
+
+/// @brief The number of times a producer had to retry, because the queue was full.
+static volatile uint32_t numRetries = 0;
+
+/// @brief A task that counts the tasks that were run.
+class CountingTask: public AsyncQueue::Task
+{
+    public:
+        CountingTask(): AsyncQueue::Task ( 0 )
+        {
+        }
+
+    protected:
+        virtual void runTask()
+        {
+            assert ( numTasksLeft > 0 );
+
+            if ( --numTasksLeft < 1 )
+            {
+                EventManager::stop();
+            }
+        }
+};
+
+static void * run ( void * )
+{
+    for ( uint32_t i = 0; i < numTasksPerThread; ++i )
+    {
+        CountingTask * const task = new CountingTask();
+
+        while ( true )
+        {
+            const ERRCODE eCode = AsyncQueue::get().runTask ( task, AsyncQueue::DontDeleteOnError );
+
+            if ( IS_OK ( eCode ) )
+            {
+                break;
+            }
+            else if ( eCode != Error::SoftFail )
+            {
+                fprintf ( stderr, "Error running a task: %s\n", eCode.toString() );
+                exit ( EXIT_FAILURE );
+            }
+
+            __sync_add_and_fetch ( &numRetries, 1 );
+            usleep ( 10 );
+        }
+    }
+
+    return 0;
+}
+
+/// @brief Returns the time difference (in microseconds) between two timestamps.
+/// @param [in] start The start time.
+/// @param [in] end The end time.
+/// @return The time difference (in microseconds).
+static uint64_t diffUs ( const struct timespec & start, const struct timespec & end )
+{
+    return ( ( uint64_t ) end.tv_sec - start.tv_sec ) * 1000 * 1000
+           + ( ( int64_t ) end.tv_nsec - start.tv_nsec ) / 1000;
+}
+
+int main ( int argc, char * argv[] )
+{
+    uint32_t maxThreads = 0;
+
+    if ( argc != 3
+         || !String ( argv[ 1 ] ).toNumber ( maxThreads )
+         || maxThreads < 1
+         || !String ( argv[ 2 ] ).toNumber ( numTasksPerThread )
+         || numTasksPerThread < 1 )
+    {
+        fprintf ( stderr, "Usage: %s max_number_of_threads number_of_tasks_per_thread\n", argv[ 0 ] );
+        fprintf ( stderr, "Runs the test with 1, 2, 4, ... up to max_number_of_threads producer threads, "
+                  "and reports the number of tasks per second run by the main thread.\n" );
+
+        return EXIT_FAILURE;
+    }
+
+    if ( NOT_OK ( EventManager::init() ) )
+    {
+        fprintf ( stderr, "Error initializing the EventManager\n" );
+        return EXIT_FAILURE;
+    }
+
+    // The first call initializes the queue, it must be done on the main thread:
+    AsyncQueue::get();
+
+    pthread_t * const threads = new pthread_t[ maxThreads ];
+    CurrentTime cTime;
+
+    printf ( "threads,tasks,time_us,tasks_per_sec,retries\n" );
+
+    uint32_t numThreads = 1;
+
+    while ( true )
+    {
+        struct timespec start;
+        struct timespec end;
+
+        numTasksLeft = numThreads * numTasksPerThread;
+        numRetries = 0;
+
+        cTime.readTime ( start );
+
+        for ( uint32_t i = 0; i < numThreads; ++i )
+        {
+            if ( pthread_create ( threads + i, 0, run, 0 ) != 0 )
+            {
+                fprintf ( stderr, "Error creating thread %u\n", i );
+                return EXIT_FAILURE;
+            }
+        }
+
+        EventManager::run();
+
+        cTime.readTime ( end );
+
+        for ( uint32_t i = 0; i < numThreads; ++i )
+        {
+            void * ret;
+            pthread_join ( threads[ i ], &ret );
+        }
+
+        const uint64_t timeUs = diffUs ( start, end );
+        const uint64_t numTasks = ( uint64_t ) numThreads * numTasksPerThread;
+
+        printf ( "%u,%llu,%llu,%llu,%u\n", numThreads, ( unsigned long long ) numTasks,
+                 ( unsigned long long ) timeUs,
+                 ( unsigned long long ) ( ( timeUs > 0 ) ? ( numTasks * 1000 * 1000 / timeUs ) : 0 ),
+                 numRetries );
+
+        if ( numThreads >= maxThreads )
+        {
+            break;
+        }
+
+        numThreads = min ( numThreads * 2, maxThreads );
+    }
+
+    delete[] threads;
+
+    return EXIT_SUCCESS;
+}
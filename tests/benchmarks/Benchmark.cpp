@@ -0,0 +1,368 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <cstring>
+
+extern "C"
+{
+#include <pthread.h>
+#include <sched.h>
+}
+
+#include "sys/CurrentTime.hpp"
+
+#include "Benchmark.hpp"
+
+using namespace Pravala;
+
+Benchmark * Benchmark::_first ( 0 );
+Benchmark * Benchmark::_last ( 0 );
+volatile size_t Benchmark::_sink ( 0 );
+
+/// @brief The state shared by the main thread and all worker threads of a multi-threaded benchmark.
+struct RunControl
+{
+    volatile uint32_t generation; ///< Incremented by the main thread to start each run.
+    volatile uint32_t numReady; ///< The number of worker threads that are ready to run.
+    volatile uint32_t numDone; ///< The number of worker threads that completed the current run.
+    volatile bool stop; ///< Set by the main thread (before incrementing the generation) to stop workers.
+
+    /// @brief Default constructor.
+    RunControl(): generation ( 0 ), numReady ( 0 ), numDone ( 0 ), stop ( false )
+    {
+    }
+};
+
+/// @brief A single worker thread of a multi-threaded benchmark.
+class Benchmark::Worker
+{
+    public:
+        Benchmark * bench; ///< The benchmark to run.
+        RunControl * ctrl; ///< The shared state.
+        uint32_t threadIdx; ///< The index of this thread.
+        pthread_t thread; ///< The thread.
+
+        /// @brief The function that runs in worker threads.
+        /// @param [in] arg A pointer to the Worker object.
+        /// @return Always 0.
+        static void * threadMain ( void * arg )
+        {
+            Worker * const w = static_cast<Worker *> ( arg );
+            RunControl & ctrl = *w->ctrl;
+            uint32_t generation = 0;
+
+            w->bench->threadStarted ( w->threadIdx );
+
+            __sync_add_and_fetch ( &ctrl.numReady, 1 );
+
+            while ( true )
+            {
+                while ( ctrl.generation == generation )
+                {
+                    sched_yield();
+                }
+
+                __sync_synchronize();
+
+                generation = ctrl.generation;
+
+                if ( ctrl.stop )
+                {
+                    break;
+                }
+
+                w->bench->run ( w->threadIdx );
+
+                __sync_add_and_fetch ( &ctrl.numDone, 1 );
+            }
+
+            w->bench->threadStopped ( w->threadIdx );
+            return 0;
+        }
+};
+
+/// @brief Returns the time difference (in nanoseconds) between two timestamps.
+/// @param [in] start The start time.
+/// @param [in] end The end time.
+/// @return The time difference (in nanoseconds).
+static uint64_t diffNs ( const struct timespec & start, const struct timespec & end )
+{
+    return ( ( uint64_t ) end.tv_sec - start.tv_sec ) * 1000 * 1000 * 1000
+           + ( ( int64_t ) end.tv_nsec - start.tv_nsec );
+}
+
+/// @brief Compares two samples; To be used with qsort().
+/// @param [in] a Pointer to the first sample.
+/// @param [in] b Pointer to the second sample.
+/// @return -1, 0 or 1 if the first sample is smaller, equal or greater than the second one.
+static int compareSamples ( const void * a, const void * b )
+{
+    const uint64_t sA = *static_cast<const uint64_t *> ( a );
+    const uint64_t sB = *static_cast<const uint64_t *> ( b );
+
+    return ( sA < sB ) ? -1 : ( ( sA > sB ) ? 1 : 0 );
+}
+
+/// @brief Returns a percentile of sorted samples, using the nearest-rank method.
+/// @param [in] samples Sorted samples.
+/// @param [in] numSamples The number of samples. Must be greater than 0.
+/// @param [in] percent The percentile to return (0-100).
+/// @return The percentile of the samples.
+static uint64_t getPercentile ( const uint64_t * samples, uint32_t numSamples, uint32_t percent )
+{
+    // Nearest rank is ceil(percent/100 * numSamples), 1-based:
+    const uint64_t rank = ( ( uint64_t ) percent * numSamples + 99 ) / 100;
+
+    return samples[ ( rank > 0 ) ? ( rank - 1 ) : 0 ];
+}
+
+Benchmark::Options::Options(): warmup ( 3 ), repetitions ( 20 ), maxThreads ( 4 ), json ( false )
+{
+}
+
+Benchmark::Benchmark ( const char * name, uint32_t numOps, bool isMultiThreaded ):
+    Name ( name ), NumOps ( numOps ), IsMultiThreaded ( isMultiThreaded ), _next ( 0 )
+{
+    if ( !_last )
+    {
+        _first = _last = this;
+    }
+    else
+    {
+        _last->_next = this;
+        _last = this;
+    }
+}
+
+Benchmark::~Benchmark()
+{
+}
+
+void Benchmark::setUp ( uint32_t /*numThreads*/ )
+{
+}
+
+void Benchmark::tearDown()
+{
+}
+
+void Benchmark::threadStarted ( uint32_t /*threadIdx*/ )
+{
+}
+
+void Benchmark::threadStopped ( uint32_t /*threadIdx*/ )
+{
+}
+
+bool Benchmark::measure ( const Options & opts, uint32_t numThreads, uint64_t * samples )
+{
+    CurrentTime cTime;
+    struct timespec start;
+    struct timespec end;
+
+    setUp ( numThreads );
+
+    if ( !IsMultiThreaded )
+    {
+        for ( uint32_t r = 0; r < opts.warmup + opts.repetitions; ++r )
+        {
+            cTime.readTime ( start );
+
+            run ( 0 );
+
+            cTime.readTime ( end );
+
+            if ( r >= opts.warmup )
+            {
+                samples[ r - opts.warmup ] = diffNs ( start, end );
+            }
+        }
+
+        tearDown();
+        return true;
+    }
+
+    RunControl ctrl;
+    Worker * const workers = new Worker[ numThreads ];
+    uint32_t numStarted = 0;
+
+    for ( ; numStarted < numThreads; ++numStarted )
+    {
+        workers[ numStarted ].bench = this;
+        workers[ numStarted ].ctrl = &ctrl;
+        workers[ numStarted ].threadIdx = numStarted;
+
+        if ( pthread_create ( &workers[ numStarted ].thread, 0, Worker::threadMain, &workers[ numStarted ] ) != 0 )
+        {
+            fprintf ( stderr, "Error creating thread %u: %s\n", numStarted, strerror ( errno ) );
+            break;
+        }
+    }
+
+    while ( ctrl.numReady < numStarted )
+    {
+        sched_yield();
+    }
+
+    if ( numStarted == numThreads )
+    {
+        for ( uint32_t r = 0; r < opts.warmup + opts.repetitions; ++r )
+        {
+            ctrl.numDone = 0;
+
+            __sync_synchronize();
+
+            cTime.readTime ( start );
+
+            __sync_add_and_fetch ( &ctrl.generation, 1 );
+
+            while ( ctrl.numDone < numThreads )
+            {
+                sched_yield();
+            }
+
+            cTime.readTime ( end );
+
+            if ( r >= opts.warmup )
+            {
+                samples[ r - opts.warmup ] = diffNs ( start, end );
+            }
+        }
+    }
+
+    ctrl.stop = true;
+
+    __sync_add_and_fetch ( &ctrl.generation, 1 );
+
+    for ( uint32_t i = 0; i < numStarted; ++i )
+    {
+        pthread_join ( workers[ i ].thread, 0 );
+    }
+
+    delete[] workers;
+
+    tearDown();
+
+    return ( numStarted == numThreads );
+}
+
+bool Benchmark::runAll ( const Options & opts )
+{
+    if ( opts.repetitions < 1 || opts.maxThreads < 1 )
+    {
+        fprintf ( stderr, "At least one repetition and one thread are required\n" );
+        return false;
+    }
+
+    FILE * out = stdout;
+
+    if ( !opts.output.isEmpty() && !( out = fopen ( opts.output.c_str(), "w" ) ) )
+    {
+        fprintf ( stderr, "Error opening '%s': %s\n", opts.output.c_str(), strerror ( errno ) );
+        return false;
+    }
+
+    if ( opts.json )
+    {
+        fprintf ( out, "{\n  \"warmup\": %u,\n  \"repetitions\": %u,\n  \"results\": [",
+                  opts.warmup, opts.repetitions );
+    }
+    else
+    {
+        fprintf ( out, "%-32s %7s %9s %12s %12s %12s %12s %12s %12s %10s %14s\n",
+                  "benchmark", "threads", "ops", "min_ns", "mean_ns", "p50_ns", "p90_ns", "p99_ns", "max_ns",
+                  "ns_per_op", "ops_per_sec" );
+    }
+
+    uint64_t * const samples = new uint64_t[ opts.repetitions ];
+    bool ok = true;
+    bool first = true;
+
+    for ( Benchmark * bench = _first; bench != 0 && ok; bench = bench->_next )
+    {
+        if ( !opts.filter.isEmpty() && bench->Name.find ( opts.filter ) < 0 )
+        {
+            continue;
+        }
+
+        // 1, 2, 4, ... threads, and then the max number of threads (if it's not a power of 2):
+        for ( uint32_t numThreads = 1; numThreads <= opts.maxThreads;
+              numThreads = ( numThreads < opts.maxThreads && numThreads * 2 > opts.maxThreads )
+                           ? opts.maxThreads : ( numThreads * 2 ) )
+        {
+            if ( !( ok = bench->measure ( opts, numThreads, samples ) ) )
+            {
+                break;
+            }
+
+            qsort ( samples, opts.repetitions, sizeof ( samples[ 0 ] ), compareSamples );
+
+            uint64_t total = 0;
+
+            for ( uint32_t i = 0; i < opts.repetitions; ++i )
+            {
+                total += samples[ i ];
+            }
+
+            const uint64_t p50 = getPercentile ( samples, opts.repetitions, 50 );
+            const uint64_t totalOps = ( uint64_t ) bench->NumOps * numThreads;
+            const double nsPerOp = ( bench->NumOps > 0 ) ? ( ( double ) p50 / bench->NumOps ) : 0;
+            const double opsPerSec = ( p50 > 0 ) ? ( totalOps * 1e9 / p50 ) : 0;
+
+            fprintf ( out, opts.json
+                      ? "%s\n    { \"name\": \"%s\", \"threads\": %u, \"ops\": %llu, \"min_ns\": %llu, "
+                      "\"mean_ns\": %llu, \"p50_ns\": %llu, \"p90_ns\": %llu, \"p99_ns\": %llu, \"max_ns\": %llu, "
+                      "\"ns_per_op\": %.3f, \"ops_per_sec\": %.0f }"
+                      : "%s%-32s %7u %9llu %12llu %12llu %12llu %12llu %12llu %12llu %10.3f %14.0f\n",
+                      ( opts.json && !first ) ? "," : "",
+                      bench->Name.c_str(), numThreads, ( unsigned long long ) totalOps,
+                      ( unsigned long long ) samples[ 0 ],
+                      ( unsigned long long ) ( total / opts.repetitions ),
+                      ( unsigned long long ) p50,
+                      ( unsigned long long ) getPercentile ( samples, opts.repetitions, 90 ),
+                      ( unsigned long long ) getPercentile ( samples, opts.repetitions, 99 ),
+                      ( unsigned long long ) samples[ opts.repetitions - 1 ],
+                      nsPerOp, opsPerSec );
+
+            fflush ( out );
+
+            first = false;
+
+            if ( !bench->IsMultiThreaded )
+            {
+                break;
+            }
+        }
+    }
+
+    delete[] samples;
+
+    if ( opts.json )
+    {
+        fprintf ( out, "\n  ]\n}\n" );
+    }
+
+    if ( out != stdout )
+    {
+        fclose ( out );
+    }
+
+    return ok;
+}
@@ -0,0 +1,118 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#pragma once
+
+#include "basic/NoCopy.hpp"
+#include "basic/String.hpp"
+
+namespace Pravala
+{
+/// @brief A single benchmark.
+/// Each benchmark should inherit this class, and be instantiated as a static object,
+/// which registers it with the list of benchmarks to run.
+/// Every benchmark is run a number of times (repetitions), after a number of warmup runs (which are not measured).
+/// Each run performs NumOps operations. Multi-threaded benchmarks are run using 1, 2, 4, ... up to the max
+/// number of threads, and each thread performs NumOps operations in every run.
+class Benchmark: public NoCopy
+{
+    public:
+        /// @brief Options that control running benchmarks.
+        struct Options
+        {
+            String filter; ///< Only benchmarks with names that contain this string are run.
+            String output; ///< The file to write the results to; If empty, they are written to the standard output.
+            uint32_t warmup; ///< The number of warmup runs.
+            uint32_t repetitions; ///< The number of measured runs.
+            uint32_t maxThreads; ///< The max number of threads to use in multi-threaded benchmarks.
+            bool json; ///< Whether the results should be generated in JSON format.
+
+            /// @brief Default constructor.
+            Options();
+        };
+
+        const String Name; ///< The name of the benchmark.
+        const uint32_t NumOps; ///< The number of operations performed in each run (by each thread).
+        const bool IsMultiThreaded; ///< Whether the benchmark should be run using multiple threads.
+
+        /// @brief Runs all registered benchmarks.
+        /// @param [in] opts The options to use.
+        /// @return True if all the benchmarks have been run and the results written; False otherwise.
+        static bool runAll ( const Options & opts );
+
+        /// @brief Consumes a value computed by a benchmark.
+        /// Benchmarks should pass results of their operations to this function,
+        /// to prevent the compiler from optimizing these operations away.
+        /// @param [in] value The value to consume.
+        static inline void consume ( size_t value )
+        {
+            _sink += value;
+        }
+
+    protected:
+        /// @brief Constructor.
+        /// It registers the benchmark.
+        /// @param [in] name The name of the benchmark.
+        /// @param [in] numOps The number of operations performed in each run (by each thread).
+        /// @param [in] isMultiThreaded Whether the benchmark should be run using multiple threads.
+        Benchmark ( const char * name, uint32_t numOps, bool isMultiThreaded = false );
+
+        /// @brief Destructor.
+        virtual ~Benchmark();
+
+        /// @brief Prepares the benchmark to be run using the given number of threads.
+        /// It is called (on the main thread) before the warmup runs. Default implementation does nothing.
+        /// @param [in] numThreads The number of threads that will run the benchmark.
+        virtual void setUp ( uint32_t numThreads );
+
+        /// @brief Cleans up after the benchmark has been run.
+        /// It is called (on the main thread) after the last run. Default implementation does nothing.
+        virtual void tearDown();
+
+        /// @brief Called in each thread of a multi-threaded benchmark, before the first run.
+        /// It is not measured. Default implementation does nothing.
+        /// @param [in] threadIdx The index of the thread.
+        virtual void threadStarted ( uint32_t threadIdx );
+
+        /// @brief Called in each thread of a multi-threaded benchmark, after the last run.
+        /// Default implementation does nothing.
+        /// @param [in] threadIdx The index of the thread.
+        virtual void threadStopped ( uint32_t threadIdx );
+
+        /// @brief Performs a single run of the benchmark.
+        /// It should perform NumOps operations.
+        /// In multi-threaded benchmarks it is called in each thread concurrently.
+        /// @param [in] threadIdx The index of the thread (0 in single-threaded benchmarks).
+        virtual void run ( uint32_t threadIdx ) = 0;
+
+    private:
+        class Worker;
+
+        static Benchmark * _first; ///< The first registered benchmark.
+        static Benchmark * _last; ///< The last registered benchmark.
+        static volatile size_t _sink; ///< The value updated by consume().
+
+        Benchmark * _next; ///< The next registered benchmark.
+
+        /// @brief Runs this benchmark using a given number of threads, and measures the duration of each run.
+        /// @param [in] opts The options to use.
+        /// @param [in] numThreads The number of threads to use.
+        /// @param [out] samples The duration of each run (in nanoseconds). It should have opts.repetitions elements.
+        /// @return True if the benchmark has been run; False otherwise.
+        bool measure ( const Options & opts, uint32_t numThreads, uint64_t * samples );
+};
+}
@@ -0,0 +1,368 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#include "basic/FlatHashMap.hpp"
+#include "basic/HashMap.hpp"
+#include "basic/HashSet.hpp"
+#include "basic/List.hpp"
+
+#include "Benchmark.hpp"
+
+using namespace Pravala;
+
+/// @brief The number of elements in containers used by lookup and iteration benchmarks.
+static const uint32_t NumElements = 10000;
+
+/// @brief Generates a key similar to the keys used by the toolkit (names, addresses, etc.).
+/// @param [in] idx The index of the key.
+/// @return The key.
+static String getKey ( uint32_t idx )
+{
+    return String ( "key.%1.value" ).arg ( idx );
+}
+
+/// @brief Appends elements to an empty list.
+class ListAppendBenchmark: public Benchmark
+{
+    public:
+        ListAppendBenchmark(): Benchmark ( "List.append", 100000 )
+        {
+        }
+
+    protected:
+        virtual void run ( uint32_t /*threadIdx*/ )
+        {
+            List<uint32_t> list;
+
+            for ( uint32_t i = 0; i < NumOps; ++i )
+            {
+                list.append ( i );
+            }
+
+            consume ( list.size() );
+        }
+};
+
+/// @brief Iterates over all elements of a list.
+class ListIterateBenchmark: public Benchmark
+{
+    public:
+        ListIterateBenchmark(): Benchmark ( "List.iterate", NumElements )
+        {
+        }
+
+    protected:
+        virtual void setUp ( uint32_t /*numThreads*/ )
+        {
+            for ( uint32_t i = 0; i < NumOps; ++i )
+            {
+                _list.append ( i );
+            }
+        }
+
+        virtual void tearDown()
+        {
+            _list.clear();
+        }
+
+        virtual void run ( uint32_t /*threadIdx*/ )
+        {
+            size_t sum = 0;
+
+            for ( size_t i = 0; i < _list.size(); ++i )
+            {
+                sum += _list.at ( i );
+            }
+
+            consume ( sum );
+        }
+
+    private:
+        List<uint32_t> _list; ///< The list to iterate over.
+};
+
+/// @brief Copies a list (which only shares the data) and modifies the copy (which copies the data).
+class ListCopyOnWriteBenchmark: public Benchmark
+{
+    public:
+        ListCopyOnWriteBenchmark(): Benchmark ( "List.copyOnWrite", 1000 )
+        {
+        }
+
+    protected:
+        virtual void setUp ( uint32_t /*numThreads*/ )
+        {
+            for ( uint32_t i = 0; i < 100; ++i )
+            {
+                _list.append ( getKey ( i ) );
+            }
+        }
+
+        virtual void tearDown()
+        {
+            _list.clear();
+        }
+
+        virtual void run ( uint32_t /*threadIdx*/ )
+        {
+            for ( uint32_t i = 0; i < NumOps; ++i )
+            {
+                StringList copy ( _list );
+
+                copy.append ( String::EmptyString );
+
+                consume ( copy.size() );
+            }
+        }
+
+    private:
+        StringList _list; ///< The list to copy.
+};
+
+/// @brief Inserts integer keys into an empty map.
+template<typename M> class MapInsertBenchmark: public Benchmark
+{
+    public:
+        /// @brief Constructor.
+        /// @param [in] name The name of the benchmark.
+        MapInsertBenchmark ( const char * name ): Benchmark ( name, 100000 )
+        {
+        }
+
+    protected:
+        virtual void run ( uint32_t /*threadIdx*/ )
+        {
+            M map;
+
+            for ( uint32_t i = 0; i < NumOps; ++i )
+            {
+                map.insert ( i * 2654435761U, i );
+            }
+
+            consume ( map.size() );
+        }
+};
+
+/// @brief Looks up string keys in a map; Half of the lookups are for keys that are not in the map.
+template<typename M> class MapLookupBenchmark: public Benchmark
+{
+    public:
+        /// @brief Constructor.
+        /// @param [in] name The name of the benchmark.
+        MapLookupBenchmark ( const char * name ): Benchmark ( name, 2 * NumElements )
+        {
+        }
+
+    protected:
+        virtual void setUp ( uint32_t /*numThreads*/ )
+        {
+            _keys.clear();
+
+            for ( uint32_t i = 0; i < NumOps; ++i )
+            {
+                _keys.append ( getKey ( i ) );
+
+                if ( i % 2 == 0 )
+                {
+                    _map.insert ( _keys.at ( i ), i );
+                }
+            }
+        }
+
+        virtual void tearDown()
+        {
+            _map.clear();
+            _keys.clear();
+        }
+
+        virtual void run ( uint32_t /*threadIdx*/ )
+        {
+            size_t found = 0;
+            uint32_t value = 0;
+
+            for ( size_t i = 0; i < _keys.size(); ++i )
+            {
+                if ( _map.find ( _keys.at ( i ), value ) )
+                {
+                    found += value;
+                }
+            }
+
+            consume ( found );
+        }
+
+    private:
+        StringList _keys; ///< The keys to look up.
+        M _map; ///< The map to look up keys in.
+};
+
+/// @brief Looks up integer keys in a set; Half of the lookups are for keys that are not in the set.
+class HashSetContainsBenchmark: public Benchmark
+{
+    public:
+        HashSetContainsBenchmark(): Benchmark ( "HashSet.contains", 2 * NumElements )
+        {
+        }
+
+    protected:
+        virtual void setUp ( uint32_t /*numThreads*/ )
+        {
+            for ( uint32_t i = 0; i < NumOps; i += 2 )
+            {
+                _set.insert ( i );
+            }
+        }
+
+        virtual void tearDown()
+        {
+            _set.clear();
+        }
+
+        virtual void run ( uint32_t /*threadIdx*/ )
+        {
+            size_t found = 0;
+
+            for ( uint32_t i = 0; i < NumOps; ++i )
+            {
+                if ( _set.contains ( i ) )
+                {
+                    ++found;
+                }
+            }
+
+            consume ( found );
+        }
+
+    private:
+        HashSet<uint32_t> _set; ///< The set to look up keys in.
+};
+
+/// @brief Inserts integer keys into an empty set.
+class HashSetInsertBenchmark: public Benchmark
+{
+    public:
+        HashSetInsertBenchmark(): Benchmark ( "HashSet.insert", 100000 )
+        {
+        }
+
+    protected:
+        virtual void run ( uint32_t /*threadIdx*/ )
+        {
+            HashSet<uint32_t> set;
+
+            for ( uint32_t i = 0; i < NumOps; ++i )
+            {
+                set.insert ( i * 2654435761U );
+            }
+
+            consume ( set.size() );
+        }
+};
+
+/// @brief Iterates over all elements of a map.
+class HashMapIterateBenchmark: public Benchmark
+{
+    public:
+        HashMapIterateBenchmark(): Benchmark ( "HashMap.iterate", NumElements )
+        {
+        }
+
+    protected:
+        virtual void setUp ( uint32_t /*numThreads*/ )
+        {
+            for ( uint32_t i = 0; i < NumOps; ++i )
+            {
+                _map.insert ( getKey ( i ), i );
+            }
+        }
+
+        virtual void tearDown()
+        {
+            _map.clear();
+        }
+
+        virtual void run ( uint32_t /*threadIdx*/ )
+        {
+            size_t sum = 0;
+
+            for ( HashMap<String, uint32_t>::Iterator it ( _map ); it.isValid(); it.next() )
+            {
+                sum += it.value();
+            }
+
+            consume ( sum );
+        }
+
+    private:
+        HashMap<String, uint32_t> _map; ///< The map to iterate over.
+};
+
+/// @brief Copies a map (which only shares the data) and modifies the copy (which copies the data).
+template<typename M> class MapCopyOnWriteBenchmark: public Benchmark
+{
+    public:
+        /// @brief Constructor.
+        /// @param [in] name The name of the benchmark.
+        MapCopyOnWriteBenchmark ( const char * name ): Benchmark ( name, 1000 )
+        {
+        }
+
+    protected:
+        virtual void setUp ( uint32_t /*numThreads*/ )
+        {
+            for ( uint32_t i = 0; i < 100; ++i )
+            {
+                _map.insert ( getKey ( i ), i );
+            }
+        }
+
+        virtual void tearDown()
+        {
+            _map.clear();
+        }
+
+        virtual void run ( uint32_t /*threadIdx*/ )
+        {
+            for ( uint32_t i = 0; i < NumOps; ++i )
+            {
+                M copy ( _map );
+
+                copy.insert ( String::EmptyString, i );
+
+                consume ( copy.size() );
+            }
+        }
+
+    private:
+        M _map; ///< The map to copy.
+};
+
+static ListAppendBenchmark listAppend;
+static ListIterateBenchmark listIterate;
+static ListCopyOnWriteBenchmark listCopyOnWrite;
+
+static MapInsertBenchmark<HashMap<uint32_t, uint32_t> > hashMapInsert ( "HashMap.insert" );
+static MapLookupBenchmark<HashMap<String, uint32_t> > hashMapLookup ( "HashMap.lookup" );
+static HashMapIterateBenchmark hashMapIterate;
+static MapCopyOnWriteBenchmark<HashMap<String, uint32_t> > hashMapCopyOnWrite ( "HashMap.copyOnWrite" );
+
+static MapInsertBenchmark<FlatHashMap<uint32_t, uint32_t> > flatHashMapInsert ( "FlatHashMap.insert" );
+static MapLookupBenchmark<FlatHashMap<String, uint32_t> > flatHashMapLookup ( "FlatHashMap.lookup" );
+static MapCopyOnWriteBenchmark<FlatHashMap<String, uint32_t> > flatHashMapCopyOnWrite ( "FlatHashMap.copyOnWrite" );
+
+static HashSetInsertBenchmark hashSetInsert;
+static HashSetContainsBenchmark hashSetContains;
@@ -0,0 +1,244 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#include "basic/Buffer.hpp"
+#include "basic/MemHandle.hpp"
+#include "basic/MemVector.hpp"
+#include "socket/PacketDataStore.hpp"
+
+#include "Benchmark.hpp"
+
+using namespace Pravala;
+
+/// @brief The number of packets each thread holds at once in allocation benchmarks.
+static const uint32_t PacketBatchSize = 64;
+
+/// @brief Appends small chunks of data to a buffer, growing it.
+class BufferAppendBenchmark: public Benchmark
+{
+    public:
+        BufferAppendBenchmark(): Benchmark ( "Buffer.append", 100000 )
+        {
+        }
+
+    protected:
+        virtual void run ( uint32_t /*threadIdx*/ )
+        {
+            const char data[] = "0123456789abcdef";
+            Buffer buf;
+
+            for ( uint32_t i = 0; i < NumOps; ++i )
+            {
+                buf.appendData ( data, sizeof ( data ) - 1 );
+            }
+
+            consume ( buf.size() );
+        }
+};
+
+/// @brief Appends numbers to a buffer, the way metrics are rendered.
+class BufferAppendNumberBenchmark: public Benchmark
+{
+    public:
+        BufferAppendNumberBenchmark(): Benchmark ( "Buffer.appendNumber", 100000 )
+        {
+        }
+
+    protected:
+        virtual void run ( uint32_t /*threadIdx*/ )
+        {
+            Buffer buf;
+
+            for ( uint32_t i = 0; i < NumOps; ++i )
+            {
+                buf.appendNumber ( ( uint64_t ) i * 2654435761U );
+                buf.appendData ( " ", 1 );
+            }
+
+            consume ( buf.size() );
+        }
+};
+
+/// @brief Allocates and releases regular memory using MemHandle.
+class MemHandleAllocBenchmark: public Benchmark
+{
+    public:
+        MemHandleAllocBenchmark(): Benchmark ( "MemHandle.alloc", 100000 )
+        {
+        }
+
+    protected:
+        virtual void run ( uint32_t /*threadIdx*/ )
+        {
+            for ( uint32_t i = 0; i < NumOps; ++i )
+            {
+                MemHandle mh ( PacketDataStore::PacketSize );
+
+                consume ( mh.size() );
+            }
+        }
+};
+
+/// @brief Creates handles to parts of a larger memory.
+class MemHandleSliceBenchmark: public Benchmark
+{
+    public:
+        MemHandleSliceBenchmark(): Benchmark ( "MemHandle.slice", 100000 ), _mem ( 65536 )
+        {
+        }
+
+    protected:
+        virtual void run ( uint32_t /*threadIdx*/ )
+        {
+            for ( uint32_t i = 0; i < NumOps; ++i )
+            {
+                consume ( _mem.getHandle ( i % 60000, 1500 ).size() );
+            }
+        }
+
+    private:
+        const MemHandle _mem; ///< The memory to create handles to.
+};
+
+/// @brief Copies a handle (which only shares the memory) and gets writable memory (which copies the memory).
+class MemHandleCopyOnWriteBenchmark: public Benchmark
+{
+    public:
+        MemHandleCopyOnWriteBenchmark():
+            Benchmark ( "MemHandle.copyOnWrite", 100000 ), _mem ( PacketDataStore::PacketSize )
+        {
+        }
+
+    protected:
+        virtual void run ( uint32_t /*threadIdx*/ )
+        {
+            for ( uint32_t i = 0; i < NumOps; ++i )
+            {
+                MemHandle copy ( _mem );
+
+                consume ( ( size_t ) copy.getWritable() );
+            }
+        }
+
+    private:
+        const MemHandle _mem; ///< The memory to copy.
+};
+
+/// @brief Builds vectors of 16 chunks, and stores them in continuous memory.
+class MemVectorBenchmark: public Benchmark
+{
+    public:
+        MemVectorBenchmark(): Benchmark ( "MemVector.appendAndStore", 10000 ), _mem ( 16 * 128 )
+        {
+        }
+
+    protected:
+        virtual void run ( uint32_t /*threadIdx*/ )
+        {
+            for ( uint32_t i = 0; i < NumOps; ++i )
+            {
+                MemVector vec;
+                MemHandle mem;
+
+                for ( size_t off = 0; off < _mem.size(); off += 128 )
+                {
+                    vec.append ( _mem.getHandle ( off, 128 ) );
+                }
+
+                vec.storeContinuous ( mem );
+
+                consume ( mem.size() );
+            }
+        }
+
+    private:
+        const MemHandle _mem; ///< The memory to append.
+};
+
+/// @brief Allocates and releases packets in batches, using multiple threads.
+/// @tparam UseDataStore Whether packets should be allocated using PacketDataStore (or regular memory).
+template<bool UseDataStore> class PacketAllocBenchmark: public Benchmark
+{
+    public:
+        /// @brief Constructor.
+        /// @param [in] name The name of the benchmark.
+        PacketAllocBenchmark ( const char * name ): Benchmark ( name, 100 * PacketBatchSize, true )
+        {
+        }
+
+    protected:
+        virtual void setUp ( uint32_t /*numThreads*/ )
+        {
+            if ( UseDataStore )
+            {
+                PacketDataStore::init();
+            }
+        }
+
+        virtual void tearDown()
+        {
+            if ( UseDataStore )
+            {
+                PacketDataStore::shutdown();
+            }
+        }
+
+        virtual void threadStarted ( uint32_t /*threadIdx*/ )
+        {
+            if ( UseDataStore )
+            {
+                PacketDataStore::enableThreadCache();
+            }
+        }
+
+        virtual void threadStopped ( uint32_t /*threadIdx*/ )
+        {
+            if ( UseDataStore )
+            {
+                PacketDataStore::disableThreadCache();
+            }
+        }
+
+        virtual void run ( uint32_t /*threadIdx*/ )
+        {
+            MemHandle packets[ PacketBatchSize ];
+
+            for ( uint32_t i = 0; i < NumOps; i += PacketBatchSize )
+            {
+                for ( uint32_t p = 0; p < PacketBatchSize; ++p )
+                {
+                    packets[ p ] = UseDataStore
+                                   ? PacketDataStore::getPacket()
+                                   : MemHandle ( PacketDataStore::PacketSize );
+                }
+
+                for ( uint32_t p = 0; p < PacketBatchSize; ++p )
+                {
+                    packets[ p ].clear();
+                }
+            }
+        }
+};
+
+static BufferAppendBenchmark bufferAppend;
+static BufferAppendNumberBenchmark bufferAppendNumber;
+static MemHandleAllocBenchmark memHandleAlloc;
+static MemHandleSliceBenchmark memHandleSlice;
+static MemHandleCopyOnWriteBenchmark memHandleCopyOnWrite;
+static MemVectorBenchmark memVector;
+static PacketAllocBenchmark<false> memHandleAllocThreads ( "MemHandle.allocThreads" );
+static PacketAllocBenchmark<true> packetDataStoreAllocThreads ( "PacketDataStore.allocThreads" );
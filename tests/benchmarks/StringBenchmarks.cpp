@@ -0,0 +1,200 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#include "basic/String.hpp"
+
+#include "Benchmark.hpp"
+
+using namespace Pravala;
+
+/// @brief Creates short strings, like interface names and metric labels.
+class StringCreateShortBenchmark: public Benchmark
+{
+    public:
+        StringCreateShortBenchmark(): Benchmark ( "String.createShort", 100000 )
+        {
+        }
+
+    protected:
+        virtual void run ( uint32_t /*threadIdx*/ )
+        {
+            for ( uint32_t i = 0; i < NumOps; ++i )
+            {
+                const String str ( "wlan0" );
+
+                consume ( str.length() );
+            }
+        }
+};
+
+/// @brief Creates longer strings, like log messages.
+class StringCreateLongBenchmark: public Benchmark
+{
+    public:
+        StringCreateLongBenchmark(): Benchmark ( "String.createLong", 100000 )
+        {
+        }
+
+    protected:
+        virtual void run ( uint32_t /*threadIdx*/ )
+        {
+            for ( uint32_t i = 0; i < NumOps; ++i )
+            {
+                const String str ( "Received a packet that is too long to be forwarded over the tunnel interface" );
+
+                consume ( str.length() );
+            }
+        }
+};
+
+/// @brief Copies a string (which only shares the data) and modifies the copy (which copies the data).
+class StringCopyOnWriteBenchmark: public Benchmark
+{
+    public:
+        StringCopyOnWriteBenchmark():
+            Benchmark ( "String.copyOnWrite", 100000 ),
+            _str ( "Received a packet that is too long to be forwarded over the tunnel interface" )
+        {
+        }
+
+    protected:
+        virtual void run ( uint32_t /*threadIdx*/ )
+        {
+            for ( uint32_t i = 0; i < NumOps; ++i )
+            {
+                String copy ( _str );
+
+                copy.append ( '.' );
+
+                consume ( copy.length() );
+            }
+        }
+
+    private:
+        const String _str; ///< The string to copy.
+};
+
+/// @brief Appends characters to a string, growing it.
+class StringAppendBenchmark: public Benchmark
+{
+    public:
+        StringAppendBenchmark(): Benchmark ( "String.append", 100000 )
+        {
+        }
+
+    protected:
+        virtual void run ( uint32_t /*threadIdx*/ )
+        {
+            String str;
+
+            for ( uint32_t i = 0; i < NumOps; ++i )
+            {
+                str.append ( 'a' );
+            }
+
+            consume ( str.length() );
+        }
+};
+
+/// @brief Formats strings using arg(), the way log messages are generated.
+class StringArgBenchmark: public Benchmark
+{
+    public:
+        StringArgBenchmark(): Benchmark ( "String.arg", 100000 )
+        {
+        }
+
+    protected:
+        virtual void run ( uint32_t /*threadIdx*/ )
+        {
+            for ( uint32_t i = 0; i < NumOps; ++i )
+            {
+                const String str = String ( "Link %1 [%2]: received %3 bytes" ).arg ( "wlan0" ).arg ( i ).arg ( 1.5 );
+
+                consume ( str.length() );
+            }
+        }
+};
+
+/// @brief Converts integers to strings.
+class StringNumberBenchmark: public Benchmark
+{
+    public:
+        StringNumberBenchmark(): Benchmark ( "String.number", 100000 )
+        {
+        }
+
+    protected:
+        virtual void run ( uint32_t /*threadIdx*/ )
+        {
+            for ( uint32_t i = 0; i < NumOps; ++i )
+            {
+                consume ( String::number ( i * 2654435761U ).length() );
+            }
+        }
+};
+
+/// @brief Converts floating point numbers to strings.
+class StringNumberDoubleBenchmark: public Benchmark
+{
+    public:
+        StringNumberDoubleBenchmark(): Benchmark ( "String.numberDouble", 100000 )
+        {
+        }
+
+    protected:
+        virtual void run ( uint32_t /*threadIdx*/ )
+        {
+            for ( uint32_t i = 0; i < NumOps; ++i )
+            {
+                consume ( String::number ( i * 0.37 ).length() );
+            }
+        }
+};
+
+/// @brief Splits strings into lists of strings.
+class StringToStringListBenchmark: public Benchmark
+{
+    public:
+        StringToStringListBenchmark():
+            Benchmark ( "String.toStringList", 10000 ),
+            _str ( "os.log.level=debug;os.packet_store.max_memory=16, os.packet_store.thread_cache_size=32;"
+                   "mas.tcp_terminator.sack=true, mas.tcp_terminator.congestion_control=cubic;;" )
+        {
+        }
+
+    protected:
+        virtual void run ( uint32_t /*threadIdx*/ )
+        {
+            for ( uint32_t i = 0; i < NumOps; ++i )
+            {
+                consume ( _str.split ( ";, " ).size() );
+            }
+        }
+
+    private:
+        const String _str; ///< The string to split.
+};
+
+static StringCreateShortBenchmark stringCreateShort;
+static StringCreateLongBenchmark stringCreateLong;
+static StringCopyOnWriteBenchmark stringCopyOnWrite;
+static StringAppendBenchmark stringAppend;
+static StringArgBenchmark stringArg;
+static StringNumberBenchmark stringNumber;
+static StringNumberDoubleBenchmark stringNumberDouble;
+static StringToStringListBenchmark stringToStringList;
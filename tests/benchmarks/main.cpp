@@ -0,0 +1,92 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "Benchmark.hpp"
+
+using namespace Pravala;
+
+/// @brief Parses a numeric command-line option.
+/// @param [in] arg The argument to parse.
+/// @param [in] prefix The prefix of the option (including '=').
+/// @param [out] value The value parsed. Only modified if the argument is the option with a valid value.
+/// @param [out] matched Set to true if the argument is the option, otherwise not modified.
+/// @return False if the argument is the option, but its value is invalid; True otherwise.
+static bool parseNumber ( const String & arg, const char * prefix, uint32_t & value, bool & matched )
+{
+    if ( !arg.startsWith ( prefix ) )
+    {
+        return true;
+    }
+
+    matched = true;
+
+    return arg.substr ( ( int ) strlen ( prefix ) ).toNumber ( value );
+}
+
+int main ( int argc, char * argv[] )
+{
+    Benchmark::Options opts;
+
+    for ( int i = 1; i < argc; ++i )
+    {
+        const String arg ( argv[ i ] );
+        bool matched = false;
+
+        if ( arg == "--json" )
+        {
+            opts.json = true;
+            continue;
+        }
+        else if ( arg.startsWith ( "--filter=" ) )
+        {
+            opts.filter = arg.substr ( 9 );
+            continue;
+        }
+        else if ( arg.startsWith ( "--output=" ) )
+        {
+            opts.output = arg.substr ( 9 );
+            continue;
+        }
+        else if ( parseNumber ( arg, "--warmup=", opts.warmup, matched )
+                  && parseNumber ( arg, "--repetitions=", opts.repetitions, matched )
+                  && parseNumber ( arg, "--threads=", opts.maxThreads, matched )
+                  && matched )
+        {
+            continue;
+        }
+
+        fprintf ( stderr, "Usage: %s [--warmup=N] [--repetitions=N] [--threads=N] [--filter=TEXT] [--json] "
+                  "[--output=FILE]\n\n", argv[ 0 ] );
+        fprintf ( stderr, "Runs microbenchmarks of basic containers and memory primitives.\n"
+                  "  --warmup=N       The number of (not measured) warmup runs of each benchmark (default: %u).\n"
+                  "  --repetitions=N  The number of measured runs of each benchmark (default: %u).\n"
+                  "  --threads=N      Multi-threaded benchmarks are run using 1, 2, 4, ... up to N threads "
+                  "(default: %u).\n"
+                  "  --filter=TEXT    Only runs benchmarks with names that contain TEXT.\n"
+                  "  --json           Generates the results in JSON format.\n"
+                  "  --output=FILE    Writes the results to FILE instead of the standard output.\n",
+                  Benchmark::Options().warmup, Benchmark::Options().repetitions, Benchmark::Options().maxThreads );
+
+        return EXIT_FAILURE;
+    }
+
+    return Benchmark::runAll ( opts ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,214 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "basic/MemHandle.hpp"
+#include "basic/Random.hpp"
+#include "basic/String.hpp"
+#include "sys/CurrentTime.hpp"
+#include "net/IpChecksum.hpp"
+
+using namespace Pravala;
+
+/// @brief The previous implementation of the IP checksum, to compare against.
+/// It is a byte-by-byte prologue until the memory is 4-byte aligned, followed by a 64-bit loop with carries.
+/// @param [in] data The data to checksum.
+/// @param [in] size The size of the data.
+/// @return The IP checksum of the data.
+static uint16_t legacyChecksum ( const char * data, size_t size )
+{
+    union
+    {
+        char s8[ 2 ];
+        uint16_t u16;
+    } sum, v;
+
+    uint8_t nextIdx = 0;
+
+    sum.u16 = 0;
+
+    for ( size_t i = 4U - ( ( ( size_t ) data ) % 4U ); i > 0 && size > 0; --i, --size )
+    {
+        v.s8[ nextIdx ] = *( data++ );
+        v.s8[ ( nextIdx = 1 - nextIdx ) ] = 0;
+
+        ( ( sum.u16 += v.u16 ) < v.u16 ) && ++sum.u16;
+    }
+
+    uint64_t sum64 = 0;
+
+    for ( ; size >= 8; data += 8, size -= 8 )
+    {
+        const uint64_t v64 = *( ( const uint64_t * ) data );
+
+        ( ( sum64 += v64 ) < v64 ) && ++sum64;
+    }
+
+    if ( size & 4 )
+    {
+        const uint32_t v32 = *( ( const uint32_t * ) data );
+
+        ( ( sum64 += v32 ) < v32 ) && ++sum64;
+
+        data += 4;
+    }
+
+    if ( size & 2 )
+    {
+        const uint16_t v16 = *( ( const uint16_t * ) data );
+
+        ( ( sum64 += v16 ) < v16 ) && ++sum64;
+
+        data += 2;
+    }
+
+    uint32_t sum32 = ( uint32_t ) ( sum64 & 0xFFFFFFFFUL );
+    const uint32_t tmp32 = ( uint32_t ) ( sum64 >> 32 );
+
+    ( ( sum32 += tmp32 ) < tmp32 ) && ++sum32;
+
+    uint16_t sum16 = ( uint16_t ) ( sum32 & 0xFFFFU );
+    const uint16_t tmp16 = ( uint16_t ) ( sum32 >> 16 );
+
+    ( ( sum16 += tmp16 ) < tmp16 ) && ++sum16;
+
+    if ( nextIdx != 0 )
+    {
+        sum16 = ( uint16_t ) ( ( sum16 << 8 ) | ( sum16 >> 8 ) );
+    }
+
+    ( ( sum.u16 += sum16 ) < sum16 ) && ++sum.u16;
+
+    if ( size & 1 )
+    {
+        v.s8[ nextIdx ] = *data;
+        v.s8[ 1 - nextIdx ] = 0;
+
+        ( ( sum.u16 += v.u16 ) < v.u16 ) && ++sum.u16;
+    }
+
+    return ~sum.u16;
+}
+
+/// @brief Returns the time difference (in microseconds) between two timestamps.
+/// @param [in] start The start time.
+/// @param [in] end The end time.
+/// @return The time difference (in microseconds).
+static uint64_t diffUs ( const struct timespec & start, const struct timespec & end )
+{
+    return ( ( uint64_t ) end.tv_sec - start.tv_sec ) * 1000 * 1000
+           + ( ( int64_t ) end.tv_nsec - start.tv_nsec ) / 1000;
+}
+
+/// @brief Runs a single benchmark and prints the results.
+/// @param [in] name The name of the implementation.
+/// @param [in] impl The IpChecksum implementation to use; Ignored if 'legacy' is set.
+/// @param [in] legacy Whether the legacy implementation should be used instead.
+/// @param [in] data The data to checksum.
+/// @param [in] totalSize The total number of bytes to checksum (approximately).
+/// @param [in] expected The expected checksum of the data.
+/// @return True if all the checksums were correct; False otherwise.
+static bool runTest (
+        const char * name, IpChecksum::Implementation impl, bool legacy,
+        const MemHandle & data, uint64_t totalSize, uint16_t expected )
+{
+    if ( !legacy && !IpChecksum::setImplementation ( impl ) )
+    {
+        printf ( "%s,%u,unsupported\n", name, ( unsigned ) data.size() );
+        return true;
+    }
+
+    const uint64_t iterations = ( totalSize + data.size() - 1 ) / data.size();
+    uint64_t errors = 0;
+    CurrentTime cTime;
+    struct timespec start;
+    struct timespec end;
+
+    // So the compiler doesn't move the checksum out of the loop:
+    const char * volatile mem = data.get();
+
+    cTime.readTime ( start );
+
+    for ( uint64_t i = 0; i < iterations; ++i )
+    {
+        const uint16_t cSum = legacy
+                              ? legacyChecksum ( mem, data.size() )
+                              : IpChecksum::getChecksum ( mem, data.size() );
+
+        if ( cSum != expected )
+        {
+            ++errors;
+        }
+    }
+
+    cTime.readTime ( end );
+
+    const uint64_t timeUs = diffUs ( start, end );
+
+    printf ( "%s,%u,%llu,%llu,%llu,%llu\n", name, ( unsigned ) data.size(), ( unsigned long long ) iterations,
+             ( unsigned long long ) timeUs,
+             ( unsigned long long ) ( ( timeUs > 0 ) ? ( iterations * data.size() / timeUs ) : 0 ),
+             ( unsigned long long ) errors );
+
+    return ( errors == 0 );
+}
+
+int main ( int argc, char * argv[] )
+{
+    uint32_t totalMBytes = 0;
+    uint8_t alignment = 0;
+
+    if ( argc < 2 || argc > 3
+         || !String ( argv[ 1 ] ).toNumber ( totalMBytes )
+         || totalMBytes < 1
+         || ( argc > 2 && ( !String ( argv[ 2 ] ).toNumber ( alignment ) || alignment > 7 ) ) )
+    {
+        fprintf ( stderr, "Usage: %s total_megabytes [alignment_offset]\n", argv[ 0 ] );
+        fprintf ( stderr, "Checksums about total_megabytes of data in 64, 576, 1500 and 65536 byte chunks, "
+                  "using the legacy and all the supported implementations.\n"
+                  "Data starts alignment_offset (0-7, default 0) bytes after an aligned address.\n" );
+
+        return EXIT_FAILURE;
+    }
+
+    const size_t sizes[] = { 64, 576, 1500, 65536 };
+    const uint64_t totalSize = ( uint64_t ) totalMBytes * 1024 * 1024;
+    bool ok = true;
+
+    printf ( "impl,size,iterations,time_us,bytes_per_us,errors\n" );
+
+    for ( size_t s = 0; s < sizeof ( sizes ) / sizeof ( sizes[ 0 ] ); ++s )
+    {
+        MemHandle mem ( sizes[ s ] + alignment );
+
+        for ( size_t i = 0; i < mem.size(); ++i )
+        {
+            mem.getWritable()[ i ] = ( char ) Random::rand();
+        }
+
+        const MemHandle data = mem.getHandle ( alignment );
+        const uint16_t expected = legacyChecksum ( data.get(), data.size() );
+
+        ok = runTest ( "legacy", IpChecksum::ImplAuto, true, data, totalSize, expected ) && ok;
+        ok = runTest ( "portable", IpChecksum::ImplPortable, false, data, totalSize, expected ) && ok;
+        ok = runTest ( "sse2", IpChecksum::ImplSse2, false, data, totalSize, expected ) && ok;
+        ok = runTest ( "avx2", IpChecksum::ImplAvx2, false, data, totalSize, expected ) && ok;
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
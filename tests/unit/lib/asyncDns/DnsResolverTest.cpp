@@ -0,0 +1,455 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+extern "C"
+{
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <unistd.h>
+}
+
+#include <gtest/gtest.h>
+
+#include "event/Timer.hpp"
+#include "asyncDns/DnsResolver.hpp"
+#include "asyncDns/internal/DnsResolverPool.hpp"
+
+using namespace Pravala;
+
+/// @brief The TTL used by the stub DNS server in all the answers.
+#define STUB_DNS_TTL    300
+
+/// @brief A stub DNS server, running on its own thread.
+/// It answers A queries for names 'hostN.test' (with a single 10.x.y.z address, based on N),
+/// and returns empty answers for all other queries.
+class StubDnsServer
+{
+    public:
+        /// @brief Constructor.
+        StubDnsServer(): _fd ( -1 ), _numQueries ( 0 ), _stop ( 0 ), _isRunning ( false )
+        {
+        }
+
+        /// @brief Destructor.
+        ~StubDnsServer()
+        {
+            stop();
+        }
+
+        /// @brief Starts the server on a random port on the loopback interface.
+        /// @return True on success; False otherwise.
+        bool start()
+        {
+            _fd = socket ( AF_INET, SOCK_DGRAM, 0 );
+
+            if ( _fd < 0 )
+            {
+                return false;
+            }
+
+            struct sockaddr_in addr;
+            socklen_t addrLen = sizeof ( addr );
+
+            memset ( &addr, 0, sizeof ( addr ) );
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl ( INADDR_LOOPBACK );
+
+            if ( bind ( _fd, ( struct sockaddr * ) &addr, sizeof ( addr ) ) != 0
+                 || getsockname ( _fd, ( struct sockaddr * ) &addr, &addrLen ) != 0 )
+            {
+                return false;
+            }
+
+            _addr = SockAddr ( addr );
+
+            _isRunning = ( pthread_create ( &_thread, 0, threadMain, this ) == 0 );
+
+            return _isRunning;
+        }
+
+        /// @brief Stops the server.
+        void stop()
+        {
+            if ( _isRunning )
+            {
+                __sync_lock_test_and_set ( &_stop, 1 );
+
+                pthread_join ( _thread, 0 );
+
+                _isRunning = false;
+            }
+
+            if ( _fd >= 0 )
+            {
+                close ( _fd );
+                _fd = -1;
+            }
+        }
+
+        /// @brief Returns the address of the server.
+        /// @return The address of the server.
+        inline const SockAddr & getAddr() const
+        {
+            return _addr;
+        }
+
+        /// @brief Returns the number of queries received.
+        /// @return The number of queries received.
+        inline uint32_t getNumQueries()
+        {
+            return __sync_fetch_and_add ( &_numQueries, 0 );
+        }
+
+        /// @brief Returns the address that is returned for the given host.
+        /// @param [in] hostNum The number of the host ('N' in 'hostN.test').
+        /// @return The address that is returned for the given host.
+        static IpAddress getHostAddr ( uint32_t hostNum )
+        {
+            return IpAddress ( String ( "10.%1.%2.%3" )
+                               .arg ( ( hostNum >> 16 ) & 0xFF )
+                               .arg ( ( hostNum >> 8 ) & 0xFF )
+                               .arg ( hostNum & 0xFF ) );
+        }
+
+    private:
+        SockAddr _addr; ///< The address of the server.
+        pthread_t _thread; ///< The server thread.
+        int _fd; ///< The server's socket.
+        volatile uint32_t _numQueries; ///< The number of queries received.
+        volatile uint32_t _stop; ///< Set to stop the server thread.
+        bool _isRunning; ///< Whether the server thread is running.
+
+        /// @brief Generates the answer to a query.
+        /// @param [in] query The query received.
+        /// @param [in] queryLen The size of the query.
+        /// @param [out] answer The buffer for the answer. It should be at least queryLen + 16 bytes long.
+        /// @return The size of the answer; 0 if the query is invalid.
+        static size_t generateAnswer ( const uint8_t * query, size_t queryLen, uint8_t * answer )
+        {
+            if ( queryLen < 12 )
+            {
+                return 0;
+            }
+
+            // We parse the first question only:
+            String name;
+            size_t off = 12;
+
+            while ( off < queryLen && query[ off ] != 0 )
+            {
+                const size_t labelLen = query[ off++ ];
+
+                if ( labelLen > 63 || off + labelLen > queryLen )
+                {
+                    return 0;
+                }
+
+                if ( !name.isEmpty() )
+                {
+                    name.append ( "." );
+                }
+
+                name.append ( ( const char * ) query + off, labelLen );
+                off += labelLen;
+            }
+
+            // The terminating 0, type and class:
+            off += 5;
+
+            if ( off > queryLen )
+            {
+                return 0;
+            }
+
+            const uint16_t qType = ( query[ off - 4 ] << 8 ) | query[ off - 3 ];
+
+            // The header and the question, without any additional records:
+            memcpy ( answer, query, off );
+
+            answer[ 2 ] = 0x80 | ( query[ 2 ] & 0x01 ); // QR, RD
+            answer[ 3 ] = 0x80;                         // RA
+            answer[ 4 ] = 0;
+            answer[ 5 ] = 1; // QDCOUNT
+            memset ( answer + 6, 0, 6 );
+
+            name = name.toLower();
+
+            if ( qType != 1 || !name.startsWith ( "host" ) || !name.endsWith ( ".test" ) )
+            {
+                return off;
+            }
+
+            bool ok = false;
+            const uint32_t hostNum = name.substr ( 4, name.length() - 9 ).toUInt32 ( &ok, 10 );
+
+            if ( !ok )
+            {
+                return off;
+            }
+
+            const uint8_t answerRecord[] =
+            {
+                0xC0, 0x0C, // Pointer to the name in the question
+                0x00, 0x01, // Type A
+                0x00, 0x01, // Class IN
+                ( STUB_DNS_TTL >> 24 ) & 0xFF, ( STUB_DNS_TTL >> 16 ) & 0xFF,
+                ( STUB_DNS_TTL >> 8 ) & 0xFF, STUB_DNS_TTL & 0xFF,
+                0x00, 0x04, // RDLENGTH
+                10, ( uint8_t ) ( hostNum >> 16 ), ( uint8_t ) ( hostNum >> 8 ), ( uint8_t ) hostNum
+            };
+
+            answer[ 7 ] = 1; // ANCOUNT
+
+            memcpy ( answer + off, answerRecord, sizeof ( answerRecord ) );
+
+            return off + sizeof ( answerRecord );
+        }
+
+        /// @brief Runs the server thread.
+        void run()
+        {
+            uint8_t query[ 512 ];
+            uint8_t answer[ 512 + 16 ];
+
+            while ( __sync_fetch_and_add ( &_stop, 0 ) == 0 )
+            {
+                struct pollfd pfd;
+
+                pfd.fd = _fd;
+                pfd.events = POLLIN;
+                pfd.revents = 0;
+
+                if ( poll ( &pfd, 1, 50 ) < 1 )
+                {
+                    continue;
+                }
+
+                struct sockaddr_storage from;
+                socklen_t fromLen = sizeof ( from );
+
+                const ssize_t ret = recvfrom ( _fd, query, sizeof ( query ), 0, ( struct sockaddr * ) &from, &fromLen );
+
+                if ( ret < 1 )
+                {
+                    continue;
+                }
+
+                __sync_fetch_and_add ( &_numQueries, 1 );
+
+                const size_t answerLen = generateAnswer ( query, ret, answer );
+
+                if ( answerLen > 0 )
+                {
+                    sendto ( _fd, answer, answerLen, 0, ( struct sockaddr * ) &from, fromLen );
+                }
+            }
+        }
+
+        /// @brief The function that runs in the server thread.
+        /// @param [in] arg A pointer to the StubDnsServer object.
+        /// @return Always 0.
+        static void * threadMain ( void * arg )
+        {
+            ( ( StubDnsServer * ) arg )->run();
+            return 0;
+        }
+};
+
+/// @brief DnsResolver tests
+class DnsResolverTest: public ::testing::Test, public DnsResolver::Owner, public Timer::Receiver
+{
+    public:
+        /// @brief Constructor.
+        DnsResolverTest(): _numCompleted ( 0 ), _numExpected ( 0 ), _numErrors ( 0 ), _timeoutTimer ( *this, 60000 )
+        {
+        }
+
+    protected:
+        /// @brief The number of different names looked up.
+        /// There are 1000 existing hosts, and 100 names without any addresses.
+        static const uint32_t NumNames = 1100;
+
+        /// @brief Resolvers used by the test.
+        /// Resolver at index 'i' looks up name 'i % NumNames'.
+        List<DnsResolver *> _resolvers;
+
+        /// @brief The indexes of resolvers in _resolvers list.
+        HashMap<DnsResolver *, uint32_t> _resolverIdx;
+
+        uint32_t _numCompleted; ///< The number of lookups completed.
+        uint32_t _numExpected; ///< The number of lookups after which the loop should be stopped.
+        uint32_t _numErrors; ///< The number of lookups that completed with unexpected results.
+
+        FixedTimer _timeoutTimer; ///< Stops the loop if the lookups take too long.
+
+        virtual void SetUp()
+        {
+            if ( !EventManager::isInitialized() )
+            {
+                ASSERT_TRUE ( IS_OK ( EventManager::init() ) );
+            }
+        }
+
+        virtual void TearDown()
+        {
+            for ( size_t i = 0; i < _resolvers.size(); ++i )
+            {
+                delete _resolvers.at ( i );
+            }
+
+            _resolvers.clear();
+            _resolverIdx.clear();
+        }
+
+        /// @brief Returns the name looked up by the resolver at the given index.
+        /// @param [in] idx The index of the resolver.
+        /// @return The name looked up by the resolver.
+        static String getName ( uint32_t idx )
+        {
+            const uint32_t nameIdx = idx % NumNames;
+
+            return String ( ( nameIdx < 1000 ) ? "host%1.test" : "nx%1.test" ).arg ( nameIdx );
+        }
+
+        /// @brief Starts the lookup of the resolver at the given index, creating the resolver if needed.
+        /// @param [in] idx The index of the resolver.
+        /// @param [in] servers The DNS servers to use.
+        /// @return True if the lookup has been started; False otherwise.
+        bool startLookup ( uint32_t idx, const HashSet<SockAddr> & servers )
+        {
+            while ( _resolvers.size() <= idx )
+            {
+                DnsResolver * const resolver = new DnsResolver ( *this );
+
+                _resolverIdx.insert ( resolver, _resolvers.size() );
+                _resolvers.append ( resolver );
+            }
+
+            return IS_OK ( _resolvers.at ( idx )->start ( servers, DnsResolver::ReqTypeA, getName ( idx ), 0, 0, 10 ) );
+        }
+
+        /// @brief Runs the event loop until the expected number of lookups complete (or it times out).
+        /// @param [in] numExpected The number of lookups to wait for.
+        void runLoop ( uint32_t numExpected )
+        {
+            _numExpected = numExpected;
+
+            if ( _numCompleted >= _numExpected )
+            {
+                return;
+            }
+
+            _timeoutTimer.start();
+
+            EventManager::run();
+
+            _timeoutTimer.stop();
+        }
+
+        virtual void timerExpired ( Timer * )
+        {
+            EventManager::stop();
+        }
+
+        virtual void dnsLookupComplete ( DnsResolver * resolver, const String & name, const List<IpAddress> & results )
+        {
+            uint32_t idx = 0;
+
+            if ( !_resolverIdx.find ( resolver, idx ) || name != getName ( idx ) )
+            {
+                ++_numErrors;
+            }
+            else if ( idx % NumNames < 1000 )
+            {
+                if ( results.size() != 1 || results.at ( 0 ) != StubDnsServer::getHostAddr ( idx % NumNames ) )
+                {
+                    ++_numErrors;
+                }
+            }
+            else if ( results.size() != 0 )
+            {
+                ++_numErrors;
+            }
+
+            if ( ++_numCompleted >= _numExpected )
+            {
+                EventManager::stop();
+            }
+        }
+
+        virtual void dnsLookupComplete ( DnsResolver *, const String &, const List<DnsResolver::SrvRecord> & )
+        {
+            ++_numErrors;
+            ++_numCompleted;
+        }
+};
+
+const uint32_t DnsResolverTest::NumNames;
+
+TEST_F ( DnsResolverTest, Stress )
+{
+    const uint32_t numLookups = 10000;
+
+    StubDnsServer server;
+
+    ASSERT_TRUE ( server.start() );
+
+    HashSet<SockAddr> servers;
+    servers.insert ( server.getAddr() );
+
+    // All the names should fit in the cache:
+    ASSERT_TRUE ( IS_OK ( DnsResolver::optCacheSize.setValue ( 2 * NumNames ) ) );
+
+    DnsResolverPool & pool = DnsResolverPool::get();
+
+    pool.clearCache();
+
+    const uint32_t orgRequests = pool.getNumRequests();
+
+    for ( uint32_t i = 0; i < numLookups; ++i )
+    {
+        ASSERT_TRUE ( startLookup ( i, servers ) );
+    }
+
+    runLoop ( numLookups );
+
+    EXPECT_EQ ( numLookups, _numCompleted );
+    EXPECT_EQ ( 0U, _numErrors );
+
+    // Concurrent lookups of the same names should have been coalesced:
+    EXPECT_EQ ( NumNames, pool.getNumRequests() - orgRequests );
+    EXPECT_EQ ( NumNames, server.getNumQueries() );
+    EXPECT_EQ ( NumNames, pool.getCacheSize() );
+    EXPECT_LE ( pool.getNumWorkers(), DnsResolver::optNumWorkers.value() );
+
+    // Now everything (including empty results) should be served from the cache:
+    for ( uint32_t i = 0; i < NumNames; ++i )
+    {
+        ASSERT_TRUE ( startLookup ( i, servers ) );
+    }
+
+    runLoop ( numLookups + NumNames );
+
+    EXPECT_EQ ( numLookups + NumNames, _numCompleted );
+    EXPECT_EQ ( 0U, _numErrors );
+    EXPECT_EQ ( NumNames, pool.getNumRequests() - orgRequests );
+    EXPECT_EQ ( NumNames, server.getNumQueries() );
+
+    server.stop();
+}
@@ -0,0 +1,237 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+
+#include "basic/BasicMemPool.hpp"
+#include "basic/MemHandle.hpp"
+
+using namespace Pravala;
+
+/// @brief The number of blocks each pool in these tests can allocate.
+#define TEST_POOL_BLOCKS    256
+
+class TestBasicMemPool: public ::testing::Test
+{
+    protected:
+        BasicMemPool * pool;
+
+        virtual void SetUp()
+        {
+            // A single slab, so we know exactly how many blocks are available.
+            pool = new BasicMemPool ( 64, TEST_POOL_BLOCKS, 1 );
+        }
+
+        virtual void TearDown()
+        {
+            MemPool::disableThreadCache();
+
+            if ( pool != 0 )
+            {
+                pool->shutdown();
+                pool = 0;
+            }
+        }
+
+        /// @brief Thread function that keeps getting and releasing blocks.
+        /// @param [in] arg Pointer to the pool to use.
+        /// @return 0 if all the blocks requested were pool-ed; Non-zero otherwise.
+        static void * threadFunc ( void * arg )
+        {
+            BasicMemPool * const p = static_cast<BasicMemPool *> ( arg );
+            MemHandle handles[ 16 ];
+            size_t errors = 0;
+
+            MemPool::enableThreadCache();
+
+            for ( size_t i = 0; i < 10000; ++i )
+            {
+                MemHandle & mh = handles[ i % 16 ];
+
+                mh = p->getHandle ( false );
+
+                if ( mh.isEmpty() )
+                {
+                    ++errors;
+                }
+            }
+
+            for ( size_t i = 0; i < 16; ++i )
+            {
+                handles[ i ].clear();
+            }
+
+            MemPool::disableThreadCache();
+
+            return ( errors > 0 ) ? arg : 0;
+        }
+};
+
+TEST_F ( TestBasicMemPool, NoThreadCache )
+{
+    EXPECT_EQ ( 0U, pool->getThreadCacheSize() );
+
+    MemHandle mh = pool->getHandle ( false );
+
+    EXPECT_FALSE ( mh.isEmpty() );
+    EXPECT_EQ ( TEST_POOL_BLOCKS, pool->getAllocatedBlocksCount() );
+    EXPECT_EQ ( TEST_POOL_BLOCKS - 1, pool->getFreeBlocksCount() );
+
+    mh.clear();
+
+    EXPECT_EQ ( TEST_POOL_BLOCKS, pool->getFreeBlocksCount() );
+    EXPECT_EQ ( 0U, pool->getThreadCacheHits() );
+    EXPECT_EQ ( 0U, pool->getThreadCacheMisses() );
+}
+
+TEST_F ( TestBasicMemPool, ThreadCacheDisabledInThread )
+{
+    pool->setThreadCacheSize ( 8 );
+
+    MemHandle mh = pool->getHandle ( false );
+
+    EXPECT_FALSE ( mh.isEmpty() );
+    EXPECT_EQ ( TEST_POOL_BLOCKS - 1, pool->getFreeBlocksCount() );
+
+    mh.clear();
+
+    EXPECT_EQ ( TEST_POOL_BLOCKS, pool->getFreeBlocksCount() );
+    EXPECT_EQ ( 0U, pool->getThreadCacheHits() );
+    EXPECT_EQ ( 0U, pool->getThreadCacheMisses() );
+}
+
+TEST_F ( TestBasicMemPool, ThreadCache )
+{
+    pool->setThreadCacheSize ( 8 );
+
+    MemPool::enableThreadCache();
+
+    MemHandle mh = pool->getHandle ( false );
+
+    EXPECT_FALSE ( mh.isEmpty() );
+
+    // The first request refills the cache with 8 blocks, and one of them is used:
+    EXPECT_EQ ( TEST_POOL_BLOCKS - 8, pool->getFreeBlocksCount() );
+    EXPECT_EQ ( 0U, pool->getThreadCacheHits() );
+    EXPECT_EQ ( 1U, pool->getThreadCacheMisses() );
+
+    MemHandle handles[ 7 ];
+
+    for ( size_t i = 0; i < 7; ++i )
+    {
+        handles[ i ] = pool->getHandle ( false );
+
+        EXPECT_FALSE ( handles[ i ].isEmpty() );
+    }
+
+    EXPECT_EQ ( TEST_POOL_BLOCKS - 8, pool->getFreeBlocksCount() );
+    EXPECT_EQ ( 7U, pool->getThreadCacheHits() );
+    EXPECT_EQ ( 1U, pool->getThreadCacheMisses() );
+
+    // The cache is empty now:
+    MemHandle mh2 = pool->getHandle ( false );
+
+    EXPECT_FALSE ( mh2.isEmpty() );
+    EXPECT_EQ ( TEST_POOL_BLOCKS - 16, pool->getFreeBlocksCount() );
+    EXPECT_EQ ( 2U, pool->getThreadCacheMisses() );
+
+    // Releasing blocks stores them in the cache:
+    for ( size_t i = 0; i < 7; ++i )
+    {
+        handles[ i ].clear();
+    }
+
+    mh.clear();
+
+    EXPECT_EQ ( TEST_POOL_BLOCKS - 16, pool->getFreeBlocksCount() );
+
+    // Now we have 15 blocks in the cache, one more should return 8 of them to the pool:
+    mh2.clear();
+
+    EXPECT_EQ ( TEST_POOL_BLOCKS - 8, pool->getFreeBlocksCount() );
+
+    MemPool::disableThreadCache();
+
+    EXPECT_EQ ( TEST_POOL_BLOCKS, pool->getFreeBlocksCount() );
+    EXPECT_EQ ( 0U, pool->getThreadCacheHits() );
+    EXPECT_EQ ( 0U, pool->getThreadCacheMisses() );
+}
+
+TEST_F ( TestBasicMemPool, ThreadCacheEmptyPool )
+{
+    pool->setThreadCacheSize ( 100 );
+
+    MemPool::enableThreadCache();
+
+    MemHandle handles[ TEST_POOL_BLOCKS ];
+
+    for ( size_t i = 0; i < TEST_POOL_BLOCKS; ++i )
+    {
+        handles[ i ] = pool->getHandle ( false );
+
+        EXPECT_FALSE ( handles[ i ].isEmpty() );
+    }
+
+    EXPECT_EQ ( 0U, pool->getFreeBlocksCount() );
+
+    // The last refill could only get 56 blocks:
+    EXPECT_EQ ( 3U, pool->getThreadCacheMisses() );
+
+    EXPECT_TRUE ( pool->getHandle ( false ).isEmpty() );
+    EXPECT_FALSE ( pool->getHandle ( true ).isEmpty() );
+}
+
+TEST_F ( TestBasicMemPool, ThreadCacheShutdown )
+{
+    pool->setThreadCacheSize ( 8 );
+
+    MemPool::enableThreadCache();
+
+    MemHandle mh = pool->getHandle ( false );
+
+    EXPECT_FALSE ( mh.isEmpty() );
+
+    // The pool has used blocks and blocks in our cache.
+    // Shutting it down should return the cached ones, but it will be destroyed once we release the last one.
+    pool->shutdown();
+    pool = 0;
+
+    mh.clear();
+}
+
+TEST_F ( TestBasicMemPool, ThreadCacheThreads )
+{
+    pool->setThreadCacheSize ( 8 );
+
+    pthread_t threads[ 4 ];
+
+    for ( size_t i = 0; i < 4; ++i )
+    {
+        ASSERT_EQ ( 0, pthread_create ( &threads[ i ], 0, threadFunc, pool ) );
+    }
+
+    for ( size_t i = 0; i < 4; ++i )
+    {
+        void * ret = 0;
+
+        EXPECT_EQ ( 0, pthread_join ( threads[ i ], &ret ) );
+        EXPECT_TRUE ( ret == 0 );
+    }
+
+    EXPECT_EQ ( TEST_POOL_BLOCKS, pool->getFreeBlocksCount() );
+}
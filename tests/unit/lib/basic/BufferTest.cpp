@@ -153,3 +153,41 @@ TEST_F ( BufferTest, StringListTest )
     EXPECT_STREQ ( "", strList[ 1 ].c_str() );
     EXPECT_STREQ ( "", strList[ 2 ].c_str() );
 }
+
+TEST_F ( BufferTest, AppendNumberTest )
+{
+    const uint64_t uValues[] =
+    {
+        0, 1, 9, 10, 11, 99, 100, 101, 999, 1000, 65535, 4294967295ULL, 4294967296ULL,
+        9999999999999999999ULL, 10000000000000000000ULL, 18446744073709551615ULL
+    };
+
+    const int64_t sValues[] =
+    {
+        0, 1, -1, 9, -9, 10, -10, 100, -100, 2147483647LL, -2147483648LL,
+        9223372036854775807LL, -9223372036854775807LL - 1
+    };
+
+    Buffer buf;
+    String expected;
+
+    for ( size_t i = 0; i < sizeof ( uValues ) / sizeof ( uValues[ 0 ] ); ++i )
+    {
+        buf.appendNumber ( uValues[ i ] );
+        buf.append ( "," );
+
+        expected.append ( String::number ( uValues[ i ] ) );
+        expected.append ( "," );
+    }
+
+    for ( size_t i = 0; i < sizeof ( sValues ) / sizeof ( sValues[ 0 ] ); ++i )
+    {
+        buf.appendNumber ( sValues[ i ] );
+        buf.append ( "," );
+
+        expected.append ( String::number ( sValues[ i ] ) );
+        expected.append ( "," );
+    }
+
+    EXPECT_STREQ ( expected.c_str(), buf.toString().c_str() );
+}
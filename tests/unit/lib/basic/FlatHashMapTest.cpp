@@ -0,0 +1,326 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "basic/String.hpp"
+#include "basic/IpAddress.hpp"
+#include "basic/SockAddr.hpp"
+#include "basic/FlatHashMap.hpp"
+#include "basic/FlatHashSet.hpp"
+
+using namespace Pravala;
+
+/// @brief FlatHashMap class test
+
+class FlatHashMapTest: public ::testing::Test
+{
+};
+
+TEST_F ( FlatHashMapTest, Basic )
+{
+    FlatHashMap<String, String> map;
+
+    EXPECT_EQ ( 0U, map.size() );
+    EXPECT_EQ ( 1U, map.getRefCount() );
+    EXPECT_FALSE ( map.contains ( "a" ) );
+    EXPECT_EQ ( 0U, map.remove ( "a" ) );
+
+    String a ( "abc" );
+    String b ( "def" );
+    String c ( "xyz" );
+
+    map.insert ( a, b );
+    EXPECT_EQ ( 1U, map.size() );
+    EXPECT_EQ ( 2, a.getRefCount() );
+    EXPECT_EQ ( 2, b.getRefCount() );
+
+    map.insert ( a, c );
+    EXPECT_EQ ( 1U, map.size() );
+    EXPECT_EQ ( 1, b.getRefCount() );
+    EXPECT_EQ ( 2, c.getRefCount() );
+    EXPECT_STREQ ( "xyz", map.value ( a ).c_str() );
+
+    map[ b ] = a;
+    EXPECT_EQ ( 2U, map.size() );
+    EXPECT_STREQ ( "abc", map.value ( "def" ).c_str() );
+    EXPECT_TRUE ( map.value ( "qwerty" ).isEmpty() );
+
+    String val;
+
+    EXPECT_TRUE ( map.find ( "abc", val ) );
+    EXPECT_STREQ ( "xyz", val.c_str() );
+    EXPECT_FALSE ( map.find ( "xyz", val ) );
+
+    EXPECT_TRUE ( map.findAndRemove ( "abc", val ) );
+    EXPECT_STREQ ( "xyz", val.c_str() );
+    EXPECT_EQ ( 1U, map.size() );
+    EXPECT_FALSE ( map.contains ( "abc" ) );
+    EXPECT_FALSE ( map.findAndRemove ( "abc", val ) );
+
+    map.clear();
+
+    EXPECT_EQ ( 0U, map.size() );
+    EXPECT_EQ ( 1, a.getRefCount() );
+    EXPECT_EQ ( 1, b.getRefCount() );
+}
+
+TEST_F ( FlatHashMapTest, ImplicitSharing )
+{
+    FlatHashMap<String, int> mapA;
+
+    mapA.insert ( "a", 1 );
+    mapA.insert ( "b", 2 );
+
+    FlatHashMap<String, int> mapB ( mapA );
+
+    EXPECT_EQ ( 2U, mapA.getRefCount() );
+    EXPECT_TRUE ( mapA == mapB );
+
+    {
+        FlatHashMap<String, int>::Iterator it ( mapA );
+
+        EXPECT_EQ ( 3U, mapA.getRefCount() );
+
+        // Modifying the map should not affect the iterator:
+        mapA.remove ( "a" );
+        mapA.insert ( "c", 3 );
+
+        EXPECT_EQ ( 1U, mapA.getRefCount() );
+
+        int sum = 0;
+
+        for ( ; it.isValid(); it.next() )
+        {
+            sum += it.value();
+        }
+
+        EXPECT_EQ ( 3, sum );
+    }
+
+    EXPECT_EQ ( 1U, mapB.getRefCount() );
+    EXPECT_TRUE ( mapA != mapB );
+    EXPECT_EQ ( 1, mapB.value ( "a" ) );
+    EXPECT_FALSE ( mapB.contains ( "c" ) );
+
+    mapB = mapA;
+
+    EXPECT_EQ ( 2U, mapA.getRefCount() );
+
+    // Modifying a value using an iterator should not affect the other map:
+    FlatHashMap<String, int>::MutableIterator it ( mapB );
+
+    ASSERT_TRUE ( it.isValid() );
+
+    const String key = it.key();
+
+    it.value() = 10;
+
+    EXPECT_EQ ( 1U, mapA.getRefCount() );
+    EXPECT_EQ ( 10, mapB.value ( key ) );
+    EXPECT_NE ( 10, mapA.value ( key ) );
+}
+
+TEST_F ( FlatHashMapTest, ManyElements )
+{
+    FlatHashMap<uint32_t, uint32_t> map;
+    HashMap<uint32_t, uint32_t> ref;
+
+    // Inserts and removals, to exercise rehashing and 'deleted' markers:
+    for ( uint32_t i = 0; i < 20000; ++i )
+    {
+        const uint32_t key = ( i * 7919U ) % 5000U;
+
+        if ( i % 3 == 2 )
+        {
+            EXPECT_EQ ( ref.remove ( key ), map.remove ( key ) );
+        }
+        else
+        {
+            map.insert ( key, i );
+            ref.insert ( key, i );
+        }
+    }
+
+    ASSERT_EQ ( ref.size(), map.size() );
+
+    for ( HashMap<uint32_t, uint32_t>::Iterator it ( ref ); it.isValid(); it.next() )
+    {
+        uint32_t val = 0;
+
+        EXPECT_TRUE ( map.find ( it.key(), val ) );
+        EXPECT_EQ ( it.value(), val );
+    }
+
+    size_t count = 0;
+
+    for ( FlatHashMap<uint32_t, uint32_t>::Iterator it ( map ); it.isValid(); it.next() )
+    {
+        EXPECT_EQ ( ref.value ( it.key() ), it.value() );
+        ++count;
+    }
+
+    EXPECT_EQ ( map.size(), count );
+}
+
+TEST_F ( FlatHashMapTest, MutableIteratorRemove )
+{
+    FlatHashMap<int, int> map;
+
+    for ( int i = 0; i < 1000; ++i )
+    {
+        map.insert ( i, i );
+    }
+
+    // Removing every odd element should not skip any element:
+    FlatHashMap<int, int>::MutableIterator it ( map );
+    size_t visited = 0;
+
+    while ( it.isValid() )
+    {
+        ++visited;
+
+        if ( it.key() % 2 != 0 )
+        {
+            it.remove();
+        }
+        else
+        {
+            it.next();
+        }
+    }
+
+    EXPECT_EQ ( 1000U, visited );
+    EXPECT_EQ ( 500U, map.size() );
+
+    for ( int i = 0; i < 1000; ++i )
+    {
+        EXPECT_EQ ( i % 2 == 0, map.contains ( i ) );
+    }
+
+    for ( it.reset(); it.isValid(); )
+    {
+        it.remove();
+    }
+
+    EXPECT_TRUE ( map.isEmpty() );
+    EXPECT_FALSE ( it.reset() );
+}
+
+TEST_F ( FlatHashMapTest, SockAddrKeys )
+{
+    FlatHashMap<SockAddr, int> map;
+
+    const SockAddr a ( IpAddress ( "10.0.0.1" ), 1000 );
+    const SockAddr b ( IpAddress ( "10.0.0.1" ), 1001 );
+    const SockAddr c ( IpAddress ( "2001:db8::1" ), 1000 );
+    const SockAddr d ( IpAddress ( "2001:db8::1" ), 1001 );
+
+    map.insert ( a, 1 );
+    map.insert ( b, 2 );
+    map.insert ( c, 3 );
+    map.insert ( d, 4 );
+
+    EXPECT_EQ ( 4U, map.size() );
+    EXPECT_EQ ( 1, map.value ( SockAddr ( IpAddress ( "10.0.0.1" ), 1000 ) ) );
+    EXPECT_EQ ( 2, map.value ( b ) );
+    EXPECT_EQ ( 3, map.value ( SockAddr ( IpAddress ( "2001:db8::1" ), 1000 ) ) );
+    EXPECT_EQ ( 4, map.value ( d ) );
+    EXPECT_FALSE ( map.contains ( SockAddr ( IpAddress ( "10.0.0.2" ), 1000 ) ) );
+}
+
+TEST_F ( FlatHashMapTest, Set )
+{
+    FlatHashSet<String> setA;
+
+    setA.insert ( "a" );
+    setA.insert ( "b" );
+    setA.insert ( "a" );
+
+    EXPECT_EQ ( 2U, setA.size() );
+    EXPECT_TRUE ( setA.contains ( "a" ) );
+    EXPECT_TRUE ( setA.contains ( "b" ) );
+    EXPECT_FALSE ( setA.contains ( "c" ) );
+
+    List<String> list;
+
+    list.append ( "b" );
+    list.append ( "c" );
+
+    FlatHashSet<String> setB ( list );
+
+    EXPECT_EQ ( 2U, setB.size() );
+
+    setA.insertAll ( setB );
+
+    EXPECT_EQ ( 3U, setA.size() );
+
+    EXPECT_EQ ( 2U, setA.removeAll ( list ) );
+    EXPECT_EQ ( 1U, setA.size() );
+    EXPECT_TRUE ( setA.contains ( "a" ) );
+
+    const List<String> res = setA;
+
+    ASSERT_EQ ( 1U, res.size() );
+    EXPECT_STREQ ( "a", res.at ( 0 ).c_str() );
+}
+
+TEST_F ( FlatHashMapTest, MemHash )
+{
+    char data[ 64 ];
+    char copy[ 65 ];
+
+    for ( size_t i = 0; i < sizeof ( data ); ++i )
+    {
+        data[ i ] = ( char ) ( i * 37 + 11 );
+    }
+
+    for ( size_t size = 0; size <= sizeof ( data ); ++size )
+    {
+        // The hash doesn't depend on the alignment:
+        memcpy ( copy + 1, data, size );
+
+        EXPECT_EQ ( getMemHash ( data, size ), getMemHash ( copy + 1, size ) );
+
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+        __builtin_cpu_init();
+
+        if ( __builtin_cpu_supports ( "sse4.2" ) )
+        {
+            // SSE 4.2 is detected at runtime (even if the code is not built for it),
+            // in which case the hash is CRC32C seeded with the size.
+            uint32_t crc = ( uint32_t ) size;
+
+            for ( size_t i = 0; i < size; ++i )
+            {
+                crc ^= ( uint8_t ) data[ i ];
+
+                for ( int b = 0; b < 8; ++b )
+                {
+                    crc = ( crc >> 1 ) ^ ( 0x82F63B78U & ( 0U - ( crc & 1 ) ) );
+                }
+            }
+
+            EXPECT_EQ ( ( size_t ) crc, getMemHash ( data, size ) );
+        }
+#endif
+    }
+
+    // Different sizes of the same (zero) memory give different hashes:
+    memset ( copy, 0, sizeof ( copy ) );
+
+    EXPECT_NE ( getMemHash ( copy, 8 ), getMemHash ( copy, 16 ) );
+}
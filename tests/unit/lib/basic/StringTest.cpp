@@ -14,6 +14,9 @@
  *  limitations under the License.
  */
 
+#include <climits>
+#include <cmath>
+
 #include <gtest/gtest.h>
 
 #include "basic/WString.hpp"
@@ -524,6 +527,51 @@ TEST_F ( StringTest, Mem )
     EXPECT_EQ ( 0, ts2.getReservedSize() );
 }
 
+TEST_F ( StringTest, InlineStorage )
+{
+    // Short strings are stored inside of the shared data, but they are still shared:
+    String a ( "short" );
+    String b ( a );
+
+    EXPECT_EQ ( 2, a.getRefCount() );
+    EXPECT_EQ ( a.c_str(), b.c_str() );
+
+    b.append ( "er" );
+
+    EXPECT_EQ ( 1, a.getRefCount() );
+    EXPECT_STREQ ( "short", a.c_str() );
+    EXPECT_STREQ ( "shorter", b.c_str() );
+
+    // Appending a string to itself, without and with moving the data out of the inline storage:
+    a.append ( a );
+
+    EXPECT_STREQ ( "shortshort", a.c_str() );
+
+    a.append ( a ).append ( a );
+
+    EXPECT_STREQ ( "shortshortshortshortshortshortshortshort", a.c_str() );
+    EXPECT_EQ ( 40, a.length() );
+
+    // And back to the inline storage:
+    TestString ts;
+
+    ts.append ( a );
+    ts.reserve ( 100 );
+
+    EXPECT_LE ( 140, ts.getReservedSize() );
+
+    ts.clear();
+    ts.append ( "sho" );
+    ts.squeeze();
+
+    EXPECT_EQ ( 3, ts.getReservedSize() );
+    EXPECT_STREQ ( "sho", ts.c_str() );
+
+    ts.append ( "rt" );
+
+    EXPECT_STREQ ( "short", ts.c_str() );
+}
+
 TEST_F ( StringTest, Manipulation )
 {
     // append()
@@ -814,6 +862,37 @@ TEST_F ( StringTest, NumToString )
     EXPECT_STREQ ( "0000000001234.567800", String::number ( 1234.5678, String::Double_f, 20, true ).c_str() );
     EXPECT_STREQ ( "123.456780", String::number ( 123.45678, String::Double_F ).c_str() );
 
+    // Rounding, and switching between 'f' and 'e' style in 'g' conversions:
+    EXPECT_STREQ ( "1e+06", String::number ( 999999.5 ).c_str() );
+    EXPECT_STREQ ( "999999", String::number ( 999999.4 ).c_str() );
+    EXPECT_STREQ ( "0.0001", String::number ( 0.0001 ).c_str() );
+    EXPECT_STREQ ( "1e-05", String::number ( 0.00001 ).c_str() );
+    EXPECT_STREQ ( "0.1", String::number ( 0.1 ).c_str() );
+    EXPECT_STREQ ( "0.3", String::number ( 0.1 + 0.2 ).c_str() );
+    EXPECT_STREQ ( "0.30000000000000004", String::number ( 0.1 + 0.2, String::Double_g, 0, false, 17 ).c_str() );
+    EXPECT_STREQ ( "1.5", String::number ( 1.5 ).c_str() );
+    EXPECT_STREQ ( "0", String::number ( 0.0 ).c_str() );
+    EXPECT_STREQ ( "-0", String::number ( -0.0 ).c_str() );
+    EXPECT_STREQ ( "  -2.5", String::number ( -2.5, String::Double_g, 6 ).c_str() );
+    EXPECT_STREQ ( "-002.5", String::number ( -2.5, String::Double_g, 6, true ).c_str() );
+    EXPECT_STREQ ( "1.23457E-20", String::number ( 1.234567e-20, String::Double_G ).c_str() );
+    EXPECT_STREQ ( "0.12", String::number ( 0.125, String::Double_f, 0, false, 2 ).c_str() );
+    EXPECT_STREQ ( "0.38", String::number ( 0.375, String::Double_f, 0, false, 2 ).c_str() );
+    EXPECT_STREQ ( "-0.000000", String::number ( -0.0000001, String::Double_f ).c_str() );
+    EXPECT_STREQ ( "inf", String::number ( HUGE_VAL ).c_str() );
+    EXPECT_STREQ ( "-INF", String::number ( -HUGE_VAL, String::Double_G ).c_str() );
+
+    // Limits of integer types, and negative numbers in octal and hexadecimal conversions:
+    EXPECT_STREQ ( "-2147483648", String::number ( ( int ) INT_MIN ).c_str() );
+    EXPECT_STREQ ( "-9223372036854775808", String::number ( ( long long int ) LLONG_MIN ).c_str() );
+    EXPECT_STREQ ( "18446744073709551615", String::number ( ( unsigned long long int ) ULLONG_MAX ).c_str() );
+    EXPECT_STREQ ( "ffffffff", String::number ( ( char ) -1, String::Int_Hex ).c_str() );
+    EXPECT_STREQ ( "FFFFFFFFFFFFFFFF", String::number ( ( long long int ) -1, String::Int_HEX ).c_str() );
+    EXPECT_STREQ ( "37777777777", String::number ( -1, String::Int_Oct ).c_str() );
+    EXPECT_STREQ ( "-0042", String::number ( -42, String::Int_Dec, 5, true ).c_str() );
+    EXPECT_STREQ ( "  -42", String::number ( -42, String::Int_Dec, 5 ).c_str() );
+    EXPECT_STREQ ( "0", String::number ( 0U ).c_str() );
+
     // FIXME, the result isn't Hex, what is it? 10.0=0x1.4p+3  with Double_a
     // EXPECT_STREQ ( "0000000001234.567800", String::number ( 1234.5678, String::Double_a,20,true ) );
     // EXPECT_STREQ ( "10", String::number ( 10.0, String::Double_a) );
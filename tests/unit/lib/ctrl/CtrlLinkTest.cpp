@@ -0,0 +1,694 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+extern "C"
+{
+#include <sys/socket.h>
+#include <unistd.h>
+}
+
+#include "basic/Buffer.hpp"
+#include "basic/List.hpp"
+#include "event/Timer.hpp"
+#include "sys/SocketApi.hpp"
+#include "ctrl/CtrlLink.hpp"
+
+#include "auto/ctrl/Ctrl/LoadConfigResponse.hpp"
+#include "auto/ctrl/Ctrl/LogMessage.hpp"
+#include "auto/ctrl/Ctrl/SetConfig.hpp"
+#include "auto/ctrl/Ctrl/SimpleResponse.hpp"
+#include "auto/log/Log/TextMessage.hpp"
+
+using namespace Pravala;
+
+/// @brief A message type that is not registered in Ctrl::Message::TypeRegistry.
+#define UNKNOWN_TYPE         1000
+
+/// @brief An update message type that is not registered in Ctrl::Message::TypeRegistry.
+#define UNKNOWN_UPDATE_TYPE  1001
+
+/// @brief A base control message of any type.
+class TestMessage: public Ctrl::Message
+{
+    public:
+        /// @brief Constructor.
+        /// @param [in] type The type of the message.
+        TestMessage ( uint32_t type )
+        {
+            setType ( type );
+        }
+};
+
+/// @brief An update message of any type.
+class TestUpdate: public Ctrl::Update
+{
+    public:
+        /// @brief Constructor.
+        /// @param [in] type The type of the message.
+        TestUpdate ( uint32_t type )
+        {
+            setType ( type );
+        }
+};
+
+/// @brief Exposes the write path of CtrlLink.
+class TestCtrlLink: public CtrlLink
+{
+    public:
+        /// @brief Constructor.
+        /// @param [in] owner The owner of the link.
+        TestCtrlLink ( Owner & owner ): CtrlLink ( owner, 1 )
+        {
+        }
+
+        /// @brief Returns the FD used by the link.
+        /// @return The FD used by the link.
+        inline int getFd() const
+        {
+            return _linkFd;
+        }
+
+        /// @brief Handles a write event, without running the event loop.
+        inline void writeEvent()
+        {
+            receiveFdEvent ( _linkFd, EventManager::EventWrite );
+        }
+
+        /// @brief Sends a text log message over the link (the same way a log subscription does).
+        /// @param [in] content The content of the log message.
+        void sendLog ( const String & content )
+        {
+            Log::TextMessage msg;
+
+            msg.setName ( "ctrl_test" );
+            msg.setTime ( 1 );
+            msg.setLevel ( Log::LogLevel::Info );
+            msg.setFuncName ( "sendLog" );
+            msg.setContent ( content );
+
+            sendBinLog ( msg );
+        }
+};
+
+/// @brief A message passed to ctrlPacketReceived().
+struct ReceivedMessage
+{
+    uint32_t type; ///< The type of the message.
+    bool isUpdate; ///< Whether the message object was an instance of Ctrl::Update.
+    bool isLoadConfigResponse; ///< Whether the message object was an instance of Ctrl::LoadConfigResponse.
+    String errorMessage; ///< The error message (if the message could be deserialized as LoadConfigResponse).
+
+    /// @brief Default constructor.
+    ReceivedMessage(): type ( 0 ), isUpdate ( false ), isLoadConfigResponse ( false )
+    {
+    }
+};
+
+/// @brief Tests CtrlLink over one end of a socket pair; The test uses the other end as the peer of the link.
+class CtrlLinkTest:
+    public ::testing::Test,
+    public CtrlLink::Owner,
+    public Timer::Receiver
+{
+    public:
+        CtrlLinkTest():
+            _link ( 0 ),
+            _peerFd ( -1 ),
+            _numClosed ( 0 ),
+            _timer ( *this, 20 ),
+            _maxWriteBatch ( CtrlLink::optMaxWriteBatch.value() ),
+            _maxLogQueueSize ( CtrlLink::optMaxLogQueueSize.value() ),
+            _logOverflowDisconnect ( CtrlLink::optLogOverflowDisconnect.value() )
+        {
+        }
+
+    protected:
+        TestCtrlLink * _link; ///< The link being tested.
+        int _peerFd; ///< The other end of the link's socket pair.
+
+        List<ReceivedMessage> _received; ///< The messages passed to ctrlPacketReceived().
+        uint32_t _numClosed; ///< The number of ctrlLinkClosed() calls.
+
+        FixedTimer _timer; ///< Stops the event loop.
+
+        const uint16_t _maxWriteBatch; ///< The original value of CtrlLink::optMaxWriteBatch.
+        const uint32_t _maxLogQueueSize; ///< The original value of CtrlLink::optMaxLogQueueSize.
+        const bool _logOverflowDisconnect; ///< The original value of CtrlLink::optLogOverflowDisconnect.
+
+        virtual void SetUp()
+        {
+            if ( !EventManager::isInitialized() )
+            {
+                ASSERT_TRUE ( IS_OK ( EventManager::init() ) );
+            }
+
+            int fds[ 2 ];
+
+            ASSERT_EQ ( 0, socketpair ( AF_UNIX, SOCK_STREAM, 0, fds ) );
+            ASSERT_TRUE ( SocketApi::setNonBlocking ( fds[ 0 ] ) );
+
+            _peerFd = fds[ 1 ];
+
+            _link = new TestCtrlLink ( *this );
+            _link->setup ( fds[ 0 ] );
+        }
+
+        virtual void TearDown()
+        {
+            CtrlLink::optMaxWriteBatch.setValue ( _maxWriteBatch );
+            CtrlLink::optMaxLogQueueSize.setValue ( _maxLogQueueSize );
+            CtrlLink::optLogOverflowDisconnect.setValue ( _logOverflowDisconnect );
+
+            // This closes the link's FD:
+            delete _link;
+            _link = 0;
+
+            if ( _peerFd >= 0 )
+            {
+                ::close ( _peerFd );
+                _peerFd = -1;
+            }
+        }
+
+        /// @brief Runs the event loop for a short while.
+        void runLoop()
+        {
+            _timer.start();
+
+            EventManager::run();
+
+            _timer.stop();
+        }
+
+        /// @brief Writes data to the peer end of the link.
+        /// @param [in] data The data to write.
+        /// @param [in] size The number of bytes to write.
+        void writeData ( const char * data, size_t size )
+        {
+            while ( size > 0 )
+            {
+                const ssize_t ret = ::write ( _peerFd, data, size );
+
+                ASSERT_GT ( ret, 0 );
+
+                data += ret;
+                size -= ret;
+            }
+        }
+
+        /// @brief Serializes a message and appends it to the buffer.
+        /// @param [in] msg The message to serialize.
+        /// @param [in,out] buf The buffer to append the message to.
+        static void appendMessage ( Ctrl::Message & msg, Buffer & buf )
+        {
+            MemHandle data;
+
+            ASSERT_TRUE ( IS_OK ( CtrlLink::serializePacket ( msg, data ) ) );
+
+            buf.appendData ( data.get(), data.size() );
+        }
+
+        /// @brief Serializes a message and writes it to the peer end of the link.
+        /// @param [in] msg The message to write.
+        void writeMessage ( Ctrl::Message & msg )
+        {
+            Buffer buf;
+
+            appendMessage ( msg, buf );
+            writeData ( buf.get(), buf.size() );
+        }
+
+        /// @brief Reads everything the link has written to the peer so far.
+        /// @param [in,out] buf The buffer to append the data to.
+        void readData ( Buffer & buf )
+        {
+            char data[ 4096 ];
+            ssize_t ret;
+
+            while ( ( ret = ::recv ( _peerFd, data, sizeof ( data ), MSG_DONTWAIT ) ) > 0 )
+            {
+                buf.appendData ( data, ret );
+            }
+        }
+
+        /// @brief Deserializes messages written by the link.
+        /// @param [in] buf The data written by the link. It should only contain complete messages.
+        /// @param [out] messages The messages deserialized (as base messages).
+        static void parseMessages ( const Buffer & buf, List<Ctrl::Message> & messages )
+        {
+            const MemHandle mem = buf.getHandle();
+            size_t offset = 0;
+
+            while ( offset < mem.size() )
+            {
+                Ctrl::Message msg;
+
+                ASSERT_TRUE ( IS_OK ( msg.deserializeWithLength ( mem, offset ) ) );
+
+                messages.append ( msg );
+            }
+        }
+
+        /// @brief Reads and deserializes everything the link has written to the peer so far.
+        /// @param [out] messages The messages read (as base messages).
+        void readMessages ( List<Ctrl::Message> & messages )
+        {
+            Buffer buf;
+
+            readData ( buf );
+            parseMessages ( buf, messages );
+        }
+
+        /// @brief Checks that the messages are LoadConfigResponse messages queued by queueResponses().
+        /// @param [in] messages The messages to check.
+        /// @param [in] count The number of messages expected.
+        /// @param [in] padding The padding used by queueResponses().
+        static void checkResponses ( const List<Ctrl::Message> & messages, size_t count, size_t padding )
+        {
+            ASSERT_EQ ( count, messages.size() );
+
+            for ( size_t i = 0; i < count; ++i )
+            {
+                Ctrl::LoadConfigResponse resp;
+
+                ASSERT_TRUE ( IS_OK ( resp.deserialize ( messages.at ( i ) ) ) );
+                EXPECT_STREQ ( responseContent ( i, padding ).c_str(), resp.getErrorMessage().c_str() );
+            }
+        }
+
+        /// @brief Generates the content of a response queued by queueResponses().
+        /// @param [in] index The index of the response.
+        /// @param [in] padding The number of padding characters.
+        /// @return The content of the response.
+        static String responseContent ( size_t index, size_t padding )
+        {
+            String str = String::number ( index );
+
+            str.append ( ":" );
+
+            for ( size_t i = 0; i < padding; ++i )
+            {
+                str.append ( 'x' );
+            }
+
+            return str;
+        }
+
+        /// @brief Queues LoadConfigResponse messages in the link's write queue.
+        /// @param [in] count The number of messages to queue.
+        /// @param [in] padding The number of padding characters to include in each message.
+        /// @return The total number of bytes queued.
+        size_t queueResponses ( size_t count, size_t padding )
+        {
+            size_t size = 0;
+
+            for ( size_t i = 0; i < count; ++i )
+            {
+                Ctrl::LoadConfigResponse resp;
+                MemHandle data;
+
+                resp.setErrorMessage ( responseContent ( i, padding ) );
+
+                EXPECT_TRUE ( IS_OK ( CtrlLink::serializePacket ( resp, data ) ) );
+                EXPECT_TRUE ( IS_OK ( _link->sendPacket ( resp ) ) );
+
+                size += data.size();
+            }
+
+            return size;
+        }
+
+        virtual ERRCODE ctrlPacketReceived ( int linkId, Ctrl::Message & msg, List<int> & /*receivedFds*/ )
+        {
+            EXPECT_EQ ( 1, linkId );
+
+            ReceivedMessage rcvd;
+            Ctrl::LoadConfigResponse resp;
+
+            rcvd.type = msg.getType();
+            rcvd.isUpdate = ( msg.castTo<Ctrl::Update>() != 0 );
+            rcvd.isLoadConfigResponse = ( msg.castTo<Ctrl::LoadConfigResponse>() != 0 );
+
+            if ( IS_OK ( resp.deserialize ( msg ) ) )
+            {
+                rcvd.errorMessage = resp.getErrorMessage();
+            }
+
+            _received.append ( rcvd );
+
+            return Error::Success;
+        }
+
+        virtual void ctrlLinkClosed ( int linkId )
+        {
+            EXPECT_EQ ( 1, linkId );
+
+            ++_numClosed;
+        }
+
+        virtual void timerExpired ( Timer * )
+        {
+            EventManager::stop();
+        }
+};
+
+TEST_F ( CtrlLinkTest, SpecificType )
+{
+    Ctrl::LoadConfigResponse msg;
+
+    msg.setErrorMessage ( "test error" );
+
+    writeMessage ( msg );
+    runLoop();
+
+    ASSERT_EQ ( 1U, _received.size() );
+
+    const ReceivedMessage & rcvd = _received.at ( 0 );
+
+    EXPECT_EQ ( ( uint32_t ) Ctrl::LoadConfigResponse::DEF_TYPE, rcvd.type );
+    EXPECT_TRUE ( rcvd.isUpdate );
+    EXPECT_TRUE ( rcvd.isLoadConfigResponse );
+    EXPECT_STREQ ( "test error", rcvd.errorMessage.c_str() );
+    EXPECT_EQ ( 0U, _numClosed );
+}
+
+TEST_F ( CtrlLinkTest, UnknownTypes )
+{
+    TestMessage msg ( UNKNOWN_TYPE );
+    TestUpdate update ( UNKNOWN_UPDATE_TYPE );
+
+    writeMessage ( msg );
+    writeMessage ( update );
+    runLoop();
+
+    ASSERT_EQ ( 2U, _received.size() );
+
+    // No registered type matches it, so the base message is passed:
+    EXPECT_EQ ( ( uint32_t ) UNKNOWN_TYPE, _received.at ( 0 ).type );
+    EXPECT_FALSE ( _received.at ( 0 ).isUpdate );
+    EXPECT_FALSE ( _received.at ( 0 ).isLoadConfigResponse );
+
+    // The type is not known, but it still is an update:
+    EXPECT_EQ ( ( uint32_t ) UNKNOWN_UPDATE_TYPE, _received.at ( 1 ).type );
+    EXPECT_TRUE ( _received.at ( 1 ).isUpdate );
+    EXPECT_FALSE ( _received.at ( 1 ).isLoadConfigResponse );
+
+    EXPECT_EQ ( 0U, _numClosed );
+}
+
+TEST_F ( CtrlLinkTest, MultipleMessages )
+{
+    Buffer buf;
+    TestMessage msg ( UNKNOWN_TYPE );
+    Ctrl::LoadConfigResponse resp;
+    TestUpdate update ( UNKNOWN_UPDATE_TYPE );
+
+    resp.setErrorMessage ( "second" );
+
+    appendMessage ( msg, buf );
+    appendMessage ( resp, buf );
+    appendMessage ( update, buf );
+
+    // All of them are received with a single read:
+    writeData ( buf.get(), buf.size() );
+    runLoop();
+
+    ASSERT_EQ ( 3U, _received.size() );
+
+    EXPECT_EQ ( ( uint32_t ) UNKNOWN_TYPE, _received.at ( 0 ).type );
+    EXPECT_FALSE ( _received.at ( 0 ).isUpdate );
+
+    EXPECT_TRUE ( _received.at ( 1 ).isLoadConfigResponse );
+    EXPECT_STREQ ( "second", _received.at ( 1 ).errorMessage.c_str() );
+
+    EXPECT_EQ ( ( uint32_t ) UNKNOWN_UPDATE_TYPE, _received.at ( 2 ).type );
+    EXPECT_TRUE ( _received.at ( 2 ).isUpdate );
+    EXPECT_FALSE ( _received.at ( 2 ).isLoadConfigResponse );
+}
+
+TEST_F ( CtrlLinkTest, SplitMessage )
+{
+    Buffer buf;
+    Ctrl::LoadConfigResponse msg;
+
+    msg.setErrorMessage ( "an error message that is long enough to be split" );
+
+    appendMessage ( msg, buf );
+
+    ASSERT_GT ( buf.size(), 10U );
+
+    writeData ( buf.get(), 10 );
+    runLoop();
+
+    // The message is not complete yet:
+    EXPECT_EQ ( 0U, _received.size() );
+
+    writeData ( buf.get() + 10, buf.size() - 10 );
+    runLoop();
+
+    ASSERT_EQ ( 1U, _received.size() );
+    EXPECT_TRUE ( _received.at ( 0 ).isLoadConfigResponse );
+    EXPECT_STREQ ( "an error message that is long enough to be split", _received.at ( 0 ).errorMessage.c_str() );
+    EXPECT_EQ ( 0U, _numClosed );
+}
+
+TEST_F ( CtrlLinkTest, RequestResponse )
+{
+    Ctrl::SetConfig req;
+
+    req.setRequestResponse ( true );
+    req.setRequestId ( 7 );
+
+    writeMessage ( req );
+    runLoop();
+
+    ASSERT_EQ ( 1U, _received.size() );
+    EXPECT_EQ ( ( uint32_t ) Ctrl::SetConfig::DEF_TYPE, _received.at ( 0 ).type );
+    EXPECT_FALSE ( _received.at ( 0 ).isUpdate );
+
+    // The request is handled successfully, but it asks for a response:
+    List<Ctrl::Message> messages;
+
+    readMessages ( messages );
+
+    ASSERT_EQ ( 1U, messages.size() );
+
+    Ctrl::SimpleResponse resp;
+
+    ASSERT_TRUE ( IS_OK ( resp.deserialize ( messages.at ( 0 ) ) ) );
+
+    EXPECT_EQ ( ( uint32_t ) Ctrl::SetConfig::DEF_TYPE, resp.getRequestType() );
+    EXPECT_EQ ( 7U, resp.getRequestId() );
+    EXPECT_TRUE ( resp.getCode() == Error::Success );
+}
+
+TEST_F ( CtrlLinkTest, PeerClosed )
+{
+    Buffer buf;
+    TestMessage msg ( UNKNOWN_TYPE );
+
+    appendMessage ( msg, buf );
+
+    // A complete message, followed by a part of the next one:
+    writeData ( buf.get(), buf.size() );
+    writeData ( buf.get(), 1 );
+
+    runLoop();
+
+    EXPECT_EQ ( 1U, _received.size() );
+    EXPECT_EQ ( 0U, _numClosed );
+
+    ::close ( _peerFd );
+    _peerFd = -1;
+
+    runLoop();
+
+    EXPECT_EQ ( 1U, _received.size() );
+    EXPECT_EQ ( 1U, _numClosed );
+    EXPECT_FALSE ( _link->isConnected() );
+}
+
+TEST_F ( CtrlLinkTest, WriteBatch )
+{
+    ASSERT_TRUE ( IS_OK ( CtrlLink::optMaxWriteBatch.setValue ( 4 ) ) );
+
+    const size_t size = queueResponses ( 10, 10 );
+
+    EXPECT_EQ ( 10U, _link->getWriteQueueSize() );
+    EXPECT_EQ ( size, _link->getWriteQueueBytes() );
+    EXPECT_EQ ( size, _link->getWriteStats().peakQueueBytes );
+
+    // Each write operation writes (at most) 4 packets:
+    _link->writeEvent();
+
+    EXPECT_EQ ( 1U, _link->getWriteStats().writeCalls );
+    EXPECT_EQ ( 4U, _link->getWriteStats().writtenPackets );
+    EXPECT_EQ ( 6U, _link->getWriteQueueSize() );
+
+    _link->writeEvent();
+
+    EXPECT_EQ ( 2U, _link->getWriteStats().writeCalls );
+    EXPECT_EQ ( 8U, _link->getWriteStats().writtenPackets );
+    EXPECT_EQ ( 2U, _link->getWriteQueueSize() );
+
+    _link->writeEvent();
+
+    EXPECT_EQ ( 3U, _link->getWriteStats().writeCalls );
+    EXPECT_EQ ( 10U, _link->getWriteStats().writtenPackets );
+    EXPECT_EQ ( 0U, _link->getWriteQueueSize() );
+
+    // The queue is empty, so nothing is written:
+    _link->writeEvent();
+
+    EXPECT_EQ ( 3U, _link->getWriteStats().writeCalls );
+    EXPECT_EQ ( ( uint64_t ) size, _link->getWriteStats().writtenBytes );
+    EXPECT_EQ ( 0U, _link->getWriteQueueBytes() );
+    EXPECT_EQ ( size, _link->getWriteStats().peakQueueBytes );
+
+    List<Ctrl::Message> messages;
+
+    readMessages ( messages );
+    checkResponses ( messages, 10, 10 );
+}
+
+TEST_F ( CtrlLinkTest, PartialWrite )
+{
+    // The socket buffer is smaller than the data queued, so it is only written partially:
+    ASSERT_TRUE ( SocketApi::setOption ( _link->getFd(), SOL_SOCKET, SO_SNDBUF, 8192 ) );
+
+    const size_t size = queueResponses ( 20, 10000 );
+
+    _link->writeEvent();
+
+    const CtrlLink::WriteStats & stats = _link->getWriteStats();
+    const uint64_t written = stats.writtenBytes;
+
+    EXPECT_EQ ( 1U, stats.writeCalls );
+    EXPECT_GT ( written, 0U );
+    EXPECT_LT ( written, ( uint64_t ) size );
+    EXPECT_LT ( stats.writtenPackets, 20U );
+
+    // The packets written are removed from the queue, and the last one is trimmed:
+    EXPECT_EQ ( 20U - stats.writtenPackets, _link->getWriteQueueSize() );
+    EXPECT_EQ ( size - written, _link->getWriteQueueBytes() );
+
+    // The socket buffer is full, so the next write fails with EAGAIN, which doesn't close the link:
+    _link->writeEvent();
+
+    EXPECT_EQ ( 2U, stats.writeCalls );
+    EXPECT_EQ ( written, stats.writtenBytes );
+    EXPECT_EQ ( size - written, _link->getWriteQueueBytes() );
+    EXPECT_TRUE ( _link->isConnected() );
+    EXPECT_EQ ( 0U, _numClosed );
+
+    // Now the rest of the data is written as the peer reads it:
+    Buffer buf;
+
+    for ( int i = 0; i < 100 && _link->getWriteQueueSize() > 0; ++i )
+    {
+        readData ( buf );
+        runLoop();
+    }
+
+    readData ( buf );
+
+    EXPECT_EQ ( 0U, _link->getWriteQueueSize() );
+    EXPECT_EQ ( 0U, _link->getWriteQueueBytes() );
+    EXPECT_EQ ( 20U, stats.writtenPackets );
+    EXPECT_EQ ( ( uint64_t ) size, stats.writtenBytes );
+    EXPECT_EQ ( size, buf.size() );
+
+    List<Ctrl::Message> messages;
+
+    parseMessages ( buf, messages );
+    checkResponses ( messages, 20, 10000 );
+}
+
+TEST_F ( CtrlLinkTest, LogOverflowDrop )
+{
+    ASSERT_TRUE ( IS_OK ( CtrlLink::optMaxLogQueueSize.setValue ( 1 ) ) );
+    ASSERT_TRUE ( IS_OK ( CtrlLink::optLogOverflowDisconnect.setValue ( false ) ) );
+
+    // Nothing is written until the event loop runs, so only some of them fit in the queue.
+    // They all have the same size:
+    for ( int i = 0; i < 30; ++i )
+    {
+        _link->sendLog ( responseContent ( 0, 100 ) );
+    }
+
+    const CtrlLink::WriteStats & stats = _link->getWriteStats();
+    const size_t queued = _link->getWriteQueueSize();
+
+    EXPECT_GT ( queued, 0U );
+    EXPECT_GT ( stats.droppedLogMessages, 0U );
+    EXPECT_EQ ( 30U, queued + stats.droppedLogMessages );
+    EXPECT_LE ( _link->getWriteQueueBytes(), 1024U );
+
+    EXPECT_EQ ( stats.droppedLogMessages * ( _link->getWriteQueueBytes() / queued ), stats.droppedLogBytes );
+
+    // Other messages are never dropped:
+    Ctrl::LoadConfigResponse resp;
+
+    EXPECT_TRUE ( IS_OK ( _link->sendPacket ( resp ) ) );
+    EXPECT_EQ ( queued + 1, _link->getWriteQueueSize() );
+
+    runLoop();
+
+    EXPECT_TRUE ( _link->isConnected() );
+    EXPECT_EQ ( 0U, _numClosed );
+    EXPECT_EQ ( 0U, _link->getWriteQueueSize() );
+
+    List<Ctrl::Message> messages;
+
+    readMessages ( messages );
+
+    ASSERT_EQ ( queued + 1, messages.size() );
+
+    for ( size_t i = 0; i < queued; ++i )
+    {
+        EXPECT_EQ ( ( uint32_t ) Ctrl::LogMessage::DEF_TYPE, messages.at ( i ).getType() );
+    }
+
+    EXPECT_EQ ( ( uint32_t ) Ctrl::LoadConfigResponse::DEF_TYPE, messages.at ( queued ).getType() );
+}
+
+TEST_F ( CtrlLinkTest, LogOverflowDisconnect )
+{
+    ASSERT_TRUE ( IS_OK ( CtrlLink::optMaxLogQueueSize.setValue ( 1 ) ) );
+    ASSERT_TRUE ( IS_OK ( CtrlLink::optLogOverflowDisconnect.setValue ( true ) ) );
+
+    for ( int i = 0; i < 30; ++i )
+    {
+        _link->sendLog ( responseContent ( i, 100 ) );
+    }
+
+    // Nothing is dropped, but the link stops accepting log messages:
+    EXPECT_EQ ( 0U, _link->getWriteStats().droppedLogMessages );
+    EXPECT_GT ( _link->getWriteQueueSize(), 0U );
+    EXPECT_LT ( _link->getWriteQueueSize(), 30U );
+    EXPECT_LE ( _link->getWriteQueueBytes(), 1024U );
+
+    // It is only closed at the end of the event loop:
+    EXPECT_TRUE ( _link->isConnected() );
+    EXPECT_EQ ( 0U, _numClosed );
+
+    runLoop();
+
+    EXPECT_FALSE ( _link->isConnected() );
+    EXPECT_EQ ( 1U, _numClosed );
+}
@@ -0,0 +1,387 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+extern "C"
+{
+#include <pthread.h>
+#include <unistd.h>
+}
+
+#include <cstdlib>
+
+#include "basic/Buffer.hpp"
+#include "basic/HashMap.hpp"
+#include "basic/List.hpp"
+#include "log/TextLogAsyncOutput.hpp"
+
+#include "auto/log/Log/TextMessage.hpp"
+
+using namespace Pravala;
+
+/// @brief The number of threads used by the multi-producer test.
+#define TEST_THREADS     8
+
+/// @brief The number of messages sent by each thread in the multi-producer test.
+#define TEST_MESSAGES    5000
+
+/// @brief The prefix of the content of test messages.
+#define MSG_PREFIX       "msg:"
+
+/// @brief The beginning of the message reporting dropped messages.
+#define DROPPED_PREFIX   "Asynchronous log output dropped "
+
+/// @brief Exposes sendTextLog() of TextLogAsyncOutput.
+class TestAsyncOutput: public TextLogAsyncOutput
+{
+    public:
+        /// @brief Constructor.
+        /// @param [in] fd File descriptor to use. It is not closed by this object.
+        TestAsyncOutput ( int fd ): TextLogAsyncOutput ( fd, false )
+        {
+        }
+
+        /// @brief Sends a test message.
+        /// Its content is MSG_PREFIX, followed by the sender ID, message index and padding (separated by ':').
+        /// @param [in] sender The ID of the sender.
+        /// @param [in] index The index of the message.
+        /// @param [in] padding The number of padding characters to append.
+        void send ( uint32_t sender, uint32_t index, size_t padding = 0 )
+        {
+            Log::TextMessage msg;
+            String str;
+            String pad;
+
+            for ( size_t i = 0; i < padding; ++i )
+            {
+                pad.append ( 'x' );
+            }
+
+            msg.setName ( "async_test" );
+            msg.setLevel ( Log::LogLevel::Info );
+            msg.setContent ( String ( MSG_PREFIX "%1:%2:%3" )
+                             .arg ( sender ).arg ( index ).arg ( pad ) );
+
+            sendTextLog ( msg, str );
+        }
+};
+
+/// @brief Messages parsed from the output.
+struct ParsedOutput
+{
+    /// @brief The indexes of messages received from each sender (in order).
+    HashMap<uint32_t, List<uint32_t> > messages;
+
+    size_t numMessages; ///< The total number of test messages.
+    size_t numDropped; ///< The total number of dropped messages reported.
+    size_t numReports; ///< The number of messages reporting dropped messages.
+    size_t numInvalid; ///< The number of lines that could not be parsed.
+
+    /// @brief Default constructor.
+    ParsedOutput(): numMessages ( 0 ), numDropped ( 0 ), numReports ( 0 ), numInvalid ( 0 )
+    {
+    }
+
+    /// @brief Parses the output.
+    /// @param [in] data The data written by the output.
+    void parse ( const String & data )
+    {
+        const StringList lines = data.split ( "\n" );
+
+        for ( size_t i = 0; i < lines.size(); ++i )
+        {
+            const String & line = lines.at ( i );
+            int pos = line.find ( MSG_PREFIX );
+
+            if ( pos >= 0 )
+            {
+                const StringList fields = line.substr ( pos + strlen ( MSG_PREFIX ) ).split ( ":", true );
+                uint32_t sender = 0;
+                uint32_t index = 0;
+
+                if ( fields.size() == 3 && fields.at ( 0 ).toNumber ( sender ) && fields.at ( 1 ).toNumber ( index ) )
+                {
+                    messages[ sender ].append ( index );
+                    ++numMessages;
+                    continue;
+                }
+            }
+            else if ( ( pos = line.find ( DROPPED_PREFIX ) ) >= 0 )
+            {
+                const StringList fields = line.substr ( pos + strlen ( DROPPED_PREFIX ) ).split ( " " );
+                uint32_t dropped = 0;
+
+                if ( fields.size() > 0 && fields.at ( 0 ).toNumber ( dropped ) )
+                {
+                    numDropped += dropped;
+                    ++numReports;
+                    continue;
+                }
+            }
+
+            ++numInvalid;
+        }
+    }
+};
+
+class TextLogAsyncOutputTest: public ::testing::Test
+{
+    public:
+        TextLogAsyncOutputTest(): _fd ( -1 ), _queueSize ( TextLogAsyncOutput::optQueueSize.value() )
+        {
+        }
+
+    protected:
+        int _fd; ///< The FD of the temporary file the output writes to.
+        const uint32_t _queueSize; ///< The original size of the queue.
+
+        virtual void SetUp()
+        {
+            char path[] = "/tmp/TextLogAsyncOutputTest.XXXXXX";
+
+            _fd = mkstemp ( path );
+
+            ASSERT_GE ( _fd, 0 );
+
+            unlink ( path );
+        }
+
+        virtual void TearDown()
+        {
+            TextLogAsyncOutput::optQueueSize.setValue ( _queueSize );
+
+            if ( _fd >= 0 )
+            {
+                ::close ( _fd );
+                _fd = -1;
+            }
+        }
+
+        /// @brief Reads everything that has been written to the file.
+        /// @return Everything that has been written to the file.
+        String readFile()
+        {
+            Buffer buf;
+            char data[ 4096 ];
+            ssize_t ret;
+
+            lseek ( _fd, 0, SEEK_SET );
+
+            while ( ( ret = ::read ( _fd, data, sizeof ( data ) ) ) > 0 )
+            {
+                buf.appendData ( data, ret );
+            }
+
+            return buf.toString();
+        }
+
+        /// @brief Reads everything from an FD until EOF.
+        /// It is used as a thread function.
+        /// @param [in] arg A pointer to a struct ReadArgs.
+        /// @return Always 0.
+        static void * readFd ( void * arg );
+
+        /// @brief Sends messages using TestAsyncOutput.
+        /// It is used as a thread function.
+        /// @param [in] arg A pointer to a struct SendArgs.
+        /// @return Always 0.
+        static void * sendMessages ( void * arg );
+};
+
+/// @brief Arguments of TextLogAsyncOutputTest::readFd.
+struct ReadArgs
+{
+    int fd; ///< The FD to read from.
+    Buffer data; ///< The data read.
+};
+
+/// @brief Arguments of TextLogAsyncOutputTest::sendMessages.
+struct SendArgs
+{
+    TestAsyncOutput * output; ///< The output to use.
+    uint32_t sender; ///< The ID of the sender.
+};
+
+void * TextLogAsyncOutputTest::readFd ( void * arg )
+{
+    ReadArgs * const args = ( ReadArgs * ) arg;
+    char data[ 4096 ];
+    ssize_t ret;
+
+    while ( ( ret = ::read ( args->fd, data, sizeof ( data ) ) ) > 0 )
+    {
+        args->data.appendData ( data, ret );
+    }
+
+    return 0;
+}
+
+void * TextLogAsyncOutputTest::sendMessages ( void * arg )
+{
+    SendArgs * const args = ( SendArgs * ) arg;
+
+    for ( uint32_t i = 0; i < TEST_MESSAGES; ++i )
+    {
+        // Every 10th message doesn't fit in a slot:
+        args->output->send ( args->sender, i, ( i % 10 == 0 ) ? 1000 : 0 );
+    }
+
+    return 0;
+}
+
+TEST_F ( TextLogAsyncOutputTest, FlushOnShutdown )
+{
+    TestAsyncOutput * output = new TestAsyncOutput ( _fd );
+
+    // Some of them don't fit in a slot:
+    for ( uint32_t i = 0; i < 100; ++i )
+    {
+        output->send ( 0, i, i * 10 );
+    }
+
+    EXPECT_EQ ( 0U, output->getNumDropped() );
+
+    // All the messages are written before the output is destroyed:
+    delete output;
+    output = 0;
+
+    ParsedOutput parsed;
+
+    parsed.parse ( readFile() );
+
+    EXPECT_EQ ( 0U, parsed.numInvalid );
+    EXPECT_EQ ( 0U, parsed.numReports );
+    ASSERT_EQ ( 100U, parsed.numMessages );
+    ASSERT_EQ ( 100U, parsed.messages[ 0 ].size() );
+
+    for ( uint32_t i = 0; i < 100; ++i )
+    {
+        EXPECT_EQ ( i, parsed.messages[ 0 ].at ( i ) );
+    }
+}
+
+TEST_F ( TextLogAsyncOutputTest, MultipleProducers )
+{
+    // Large enough for all the messages, so nothing is dropped:
+    ASSERT_TRUE ( IS_OK ( TextLogAsyncOutput::optQueueSize.setValue ( TEST_THREADS * TEST_MESSAGES ) ) );
+
+    TestAsyncOutput * output = new TestAsyncOutput ( _fd );
+    pthread_t threads[ TEST_THREADS ];
+    SendArgs args[ TEST_THREADS ];
+
+    for ( uint32_t i = 0; i < TEST_THREADS; ++i )
+    {
+        args[ i ].output = output;
+        args[ i ].sender = i;
+
+        ASSERT_EQ ( 0, pthread_create ( &threads[ i ], 0, sendMessages, &args[ i ] ) );
+    }
+
+    for ( size_t i = 0; i < TEST_THREADS; ++i )
+    {
+        ASSERT_EQ ( 0, pthread_join ( threads[ i ], 0 ) );
+    }
+
+    EXPECT_EQ ( 0U, output->getNumDropped() );
+
+    delete output;
+    output = 0;
+
+    ParsedOutput parsed;
+
+    parsed.parse ( readFile() );
+
+    EXPECT_EQ ( 0U, parsed.numInvalid );
+    EXPECT_EQ ( 0U, parsed.numReports );
+    EXPECT_EQ ( ( size_t ) TEST_THREADS * TEST_MESSAGES, parsed.numMessages );
+    EXPECT_EQ ( ( size_t ) TEST_THREADS, parsed.messages.size() );
+
+    // Each message was written exactly once, and messages of each sender are in order:
+    for ( uint32_t t = 0; t < TEST_THREADS; ++t )
+    {
+        const List<uint32_t> & indexes = parsed.messages[ t ];
+
+        ASSERT_EQ ( ( size_t ) TEST_MESSAGES, indexes.size() );
+
+        for ( uint32_t i = 0; i < TEST_MESSAGES; ++i )
+        {
+            ASSERT_EQ ( i, indexes.at ( i ) );
+        }
+    }
+}
+
+TEST_F ( TextLogAsyncOutputTest, Overflow )
+{
+    ASSERT_TRUE ( IS_OK ( TextLogAsyncOutput::optQueueSize.setValue ( 16 ) ) );
+
+    // We write to a pipe that nobody reads (for now), so the writing thread will block,
+    // and the queue will become full.
+    int fds[ 2 ];
+
+    ASSERT_EQ ( 0, pipe ( fds ) );
+
+    TestAsyncOutput * output = new TestAsyncOutput ( fds[ 1 ] );
+
+    // Much more than fits in the pipe and in the queue:
+    const uint32_t numSent = 500;
+
+    for ( uint32_t i = 0; i < numSent; ++i )
+    {
+        output->send ( 0, i, 1000 );
+    }
+
+    const uint32_t numDropped = output->getNumDropped();
+
+    EXPECT_GT ( numDropped, 0U );
+    EXPECT_LT ( numDropped, numSent );
+
+    // Now we can start reading the data, and destroy the output (which writes everything that was queued).
+    ReadArgs readArgs;
+    pthread_t reader;
+
+    readArgs.fd = fds[ 0 ];
+
+    ASSERT_EQ ( 0, pthread_create ( &reader, 0, readFd, &readArgs ) );
+
+    delete output;
+    output = 0;
+
+    ::close ( fds[ 1 ] );
+
+    ASSERT_EQ ( 0, pthread_join ( reader, 0 ) );
+
+    ::close ( fds[ 0 ] );
+
+    ParsedOutput parsed;
+
+    parsed.parse ( readArgs.data.toString() );
+
+    EXPECT_EQ ( 0U, parsed.numInvalid );
+    EXPECT_GT ( parsed.numReports, 0U );
+
+    // All the dropped messages are reported, and everything else has been written:
+    EXPECT_EQ ( ( size_t ) numDropped, parsed.numDropped );
+    EXPECT_EQ ( ( size_t ) numSent - numDropped, parsed.numMessages );
+
+    // Messages are still in order (with gaps):
+    const List<uint32_t> & indexes = parsed.messages[ 0 ];
+
+    for ( size_t i = 1; i < indexes.size(); ++i )
+    {
+        EXPECT_LT ( indexes.at ( i - 1 ), indexes.at ( i ) );
+    }
+}
@@ -0,0 +1,181 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+extern "C"
+{
+#include <pthread.h>
+}
+
+#include "event/EventManager.hpp"
+#include "event/Timer.hpp"
+#include "log/TextLog.hpp"
+
+#include "auto/log/Log/LogMessage.hpp"
+
+using namespace Pravala;
+
+/// @brief The number of messages logged by the other thread.
+#define LOG_MESSAGES    100
+
+/// @brief A text log output that counts messages.
+class TestTextOutput: public TextLogOutput
+{
+    public:
+        size_t numMessages; ///< The number of messages received.
+
+        /// @brief Default constructor.
+        TestTextOutput(): numMessages ( 0 )
+        {
+        }
+
+    protected:
+        virtual void sendTextLog ( Log::TextMessage &, String & )
+        {
+            ++numMessages;
+        }
+};
+
+/// @brief A binary log output that counts messages, and the messages received outside of the main thread.
+class TestBinOutput: public BinLogOutput
+{
+    public:
+        size_t numMessages; ///< The number of messages received.
+        size_t numOffMainThread; ///< The number of messages received by threads other than the main one.
+
+        /// @brief Default constructor.
+        TestBinOutput(): numMessages ( 0 ), numOffMainThread ( 0 )
+        {
+        }
+
+    protected:
+        virtual void sendBinLog ( Log::LogMessage & )
+        {
+            ++numMessages;
+
+            if ( !EventManager::isPrimaryManager() )
+            {
+                ++numOffMainThread;
+            }
+        }
+};
+
+/// @brief Logs LOG_MESSAGES messages to the log passed.
+/// @param [in] arg A pointer to the TextLog to use.
+/// @return Always 0.
+static void * logThreadMain ( void * arg )
+{
+    TextLog & log = *( TextLog * ) arg;
+
+    for ( int i = 0; i < LOG_MESSAGES; ++i )
+    {
+        SLOG ( log, L_INFO, "Message " << i );
+    }
+
+    return 0;
+}
+
+class TextLogTest: public ::testing::Test, public Timer::Receiver
+{
+    protected:
+        FixedTimer _timer; ///< The timer that ends each loop run.
+
+        TextLogTest(): _timer ( *this, 20 )
+        {
+        }
+
+        virtual void SetUp()
+        {
+            if ( !EventManager::isInitialized() )
+            {
+                ASSERT_TRUE ( IS_OK ( EventManager::init() ) );
+            }
+        }
+
+        /// @brief Logs LOG_MESSAGES messages on another thread, and waits for it to finish.
+        /// @param [in] log The log to use.
+        void logOnOtherThread ( TextLog & log )
+        {
+            pthread_t thread;
+
+            ASSERT_EQ ( 0, pthread_create ( &thread, 0, logThreadMain, &log ) );
+            ASSERT_EQ ( 0, pthread_join ( thread, 0 ) );
+        }
+
+        /// @brief Runs the event loop until the timer expires.
+        void runLoop()
+        {
+            _timer.start();
+            EventManager::run();
+            _timer.stop();
+        }
+
+        virtual void timerExpired ( Timer * )
+        {
+            EventManager::stop();
+        }
+};
+
+/// @brief Messages logged by other threads are passed to main-thread-only outputs on the main thread.
+TEST_F ( TextLogTest, MainThreadOutputs )
+{
+    TextLog log ( "text_log_test" );
+    TestTextOutput textOutput;
+    TestBinOutput binOutput;
+
+    log.subscribeOutput ( &textOutput, Log::LogLevel::Debug );
+    log.subscribeOutput ( &binOutput, Log::LogLevel::Debug );
+
+    logOnOtherThread ( log );
+
+    // Outputs that can be used by any thread get messages right away.
+    EXPECT_EQ ( ( size_t ) LOG_MESSAGES, textOutput.numMessages );
+    EXPECT_EQ ( 0U, binOutput.numMessages );
+
+    runLoop();
+
+    EXPECT_EQ ( ( size_t ) LOG_MESSAGES, textOutput.numMessages );
+    EXPECT_EQ ( ( size_t ) LOG_MESSAGES, binOutput.numMessages );
+    EXPECT_EQ ( 0U, binOutput.numOffMainThread );
+
+    // Messages logged by the main thread are not delayed.
+    SLOG ( log, L_INFO, "Main thread message" );
+
+    EXPECT_EQ ( ( size_t ) LOG_MESSAGES + 1, textOutput.numMessages );
+    EXPECT_EQ ( ( size_t ) LOG_MESSAGES + 1, binOutput.numMessages );
+
+    log.unsubscribeOutput ( &textOutput );
+    log.unsubscribeOutput ( &binOutput );
+}
+
+/// @brief Messages passed to the main thread are dropped if their log no longer exists.
+TEST_F ( TextLogTest, MainThreadOutputsLogRemoved )
+{
+    TestBinOutput binOutput;
+    TextLog * log = new TextLog ( "text_log_test_removed" );
+
+    log->subscribeOutput ( &binOutput, Log::LogLevel::Debug );
+
+    logOnOtherThread ( *log );
+
+    delete log;
+    log = 0;
+
+    runLoop();
+
+    EXPECT_EQ ( 0U, binOutput.numMessages );
+}
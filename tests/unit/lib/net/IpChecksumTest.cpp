@@ -122,6 +122,7 @@ class TestIpChecksum: public ::testing::TestWithParam<int>
             return data;
         }
 
+    protected:
         /// @brief Calculates the IP checksum using the safe, traditional method - using 2 bytes at a time.
         /// It also needs the memory to be aligned properly.
         /// @param [in] data The data to calculate the checksum for.
@@ -381,6 +382,50 @@ TEST_P ( TestIpChecksum, MultipleRealignedChunks )
     }
 }
 
+TEST_P ( TestIpChecksum, Implementations )
+{
+    const IpChecksum::Implementation impls[] = { IpChecksum::ImplPortable, IpChecksum::ImplSse2, IpChecksum::ImplAvx2 };
+
+    // The data with the size that is a multiple of the test data size, big enough for wide loops of all implementations.
+    MemHandle bigData ( _data.size() * 37 );
+
+    for ( size_t off = 0; off < bigData.size(); off += _data.size() )
+    {
+        memcpy ( bigData.getWritable ( off ), _data.get(), _data.size() );
+    }
+
+    const uint16_t bigChecksum = getBaseChecksum ( bigData );
+
+    for ( size_t i = 0; i < sizeof ( impls ) / sizeof ( impls[ 0 ] ); ++i )
+    {
+        if ( !IpChecksum::setImplementation ( impls[ i ] ) )
+        {
+            // Not supported by this CPU.
+            continue;
+        }
+
+        EXPECT_EQ ( impls[ i ], IpChecksum::getImplementation() );
+
+        for ( uint8_t alignment = 0; alignment < 4; ++alignment )
+        {
+            const MemHandle data = aligned ( _data, alignment );
+
+            EXPECT_EQ ( _dataChecksum, IpChecksum::getChecksum ( data.get(), data.size() ) );
+            EXPECT_EQ ( _dataChecksum, rangeChecksum ( data, "1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18,19,20" ) );
+            EXPECT_EQ ( _dataChecksum, rangeChecksum ( data, "1,2,4,200,20", "1,0,1,3,0" ) );
+            EXPECT_EQ ( _dataChecksum, rangeChecksum ( data, "33,65,31,63", "3,2,1,0" ) );
+
+            const MemHandle big = aligned ( bigData, alignment );
+
+            EXPECT_EQ ( bigChecksum, IpChecksum::getChecksum ( big.get(), big.size() ) );
+            EXPECT_EQ ( bigChecksum, rangeChecksum ( big, "1,127,1023,4095", "1,2,3,0" ) );
+        }
+    }
+
+    EXPECT_TRUE ( IpChecksum::setImplementation ( IpChecksum::ImplAuto ) );
+    EXPECT_NE ( IpChecksum::ImplAuto, IpChecksum::getImplementation() );
+}
+
 // Parameter for the test is the size of the test memory (255-280).
 // We want to use differently sized memory ranges.
 INSTANTIATE_TEST_CASE_P ( TestSizes, TestIpChecksum, ::testing::Range ( 255, 280 ) );
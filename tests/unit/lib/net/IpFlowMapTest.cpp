@@ -0,0 +1,281 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "net/IpFlowMap.hpp"
+#include "net/DualIpFlow.hpp"
+
+using namespace Pravala;
+
+/// @brief A flow used by the tests.
+class TestFlow: public DualIpFlow
+{
+    public:
+        bool expired; ///< Whether this flow should be reported as expired.
+        uint32_t numRemoved; ///< The number of flowRemoved() calls.
+
+        /// @brief Constructor.
+        /// @param [in] flowDesc The default flow descriptor to use.
+        TestFlow ( const FlowDesc & flowDesc ): DualIpFlow ( flowDesc ), expired ( false ), numRemoved ( 0 )
+        {
+        }
+
+        /// @brief Constructor.
+        /// @param [in] flowDesc The default flow descriptor to use.
+        /// @param [in] secFlowDesc The secondary flow descriptor to use.
+        TestFlow ( const FlowDesc & flowDesc, const FlowDesc & secFlowDesc ):
+            DualIpFlow ( flowDesc, secFlowDesc ), expired ( false ), numRemoved ( 0 )
+        {
+        }
+
+        virtual String getLogId() const
+        {
+            return "TestFlow";
+        }
+
+        virtual ERRCODE packetReceived ( IpPacket &, int32_t, void * )
+        {
+            return Error::Success;
+        }
+
+        using IpFlow::isInMap;
+
+    protected:
+        virtual void flowRemoved()
+        {
+            ++numRemoved;
+        }
+
+        virtual bool isExpired()
+        {
+            return expired;
+        }
+};
+
+/// @brief A flow map used by the tests.
+class TestFlowMap: public IpFlowMap
+{
+    public:
+        /// @brief Constructor.
+        /// @param [in] bitSize The initial size of the map in bits.
+        TestFlowMap ( uint8_t bitSize ): IpFlowMap ( bitSize )
+        {
+        }
+
+        using IpFlowMap::insertFlow;
+        using IpFlowMap::removeFlow;
+        using IpFlowMap::cleanupFlows;
+};
+
+/// @brief IpFlowMap tests
+class IpFlowMapTest: public ::testing::Test
+{
+    public:
+        /// @brief Generates an IPv4 UDP flow descriptor.
+        /// @param [in] id The ID of the flow; Different IDs generate different descriptors.
+        /// @return The flow descriptor.
+        static FlowDesc genDesc ( uint32_t id )
+        {
+            FlowDesc desc;
+
+            desc.clear();
+            desc.common.type = 4;
+            desc.common.heProto = 17;
+            desc.common.u.port.client = htons ( ( uint16_t ) ( 1024 + ( id & 0x7FFF ) ) );
+            desc.common.u.port.server = htons ( 443 );
+            desc.v4.clientAddr.s_addr = htonl ( 0x0A000000U + ( id >> 15 ) );
+            desc.v4.serverAddr.s_addr = htonl ( 0xC0A80001U );
+
+            return desc;
+        }
+};
+
+TEST_F ( IpFlowMapTest, GrowAndShrink )
+{
+    const uint32_t numFlows = 5000;
+
+    TestFlowMap map ( 8 );
+    TestFlow ** flows = new TestFlow *[ numFlows ];
+
+    IpFlowMap::Stats stats;
+
+    map.getStats ( stats );
+
+    EXPECT_EQ ( 256U, stats.numSlots );
+    EXPECT_EQ ( 0U, stats.numEntries );
+
+    for ( uint32_t i = 0; i < numFlows; ++i )
+    {
+        flows[ i ] = new TestFlow ( genDesc ( i ) );
+
+        ASSERT_TRUE ( map.insertFlow ( flows[ i ] ) );
+        EXPECT_TRUE ( flows[ i ]->isInMap() );
+
+        // Inserting it again should succeed, without adding it twice:
+        EXPECT_TRUE ( map.insertFlow ( flows[ i ] ) );
+
+        // But not a different object with the same descriptor:
+        TestFlow dup ( genDesc ( i ) );
+
+        EXPECT_FALSE ( map.insertFlow ( &dup ) );
+        EXPECT_FALSE ( dup.isInMap() );
+    }
+
+    EXPECT_EQ ( numFlows, map.getNumEntries() );
+
+    for ( uint32_t i = 0; i < numFlows; ++i )
+    {
+        EXPECT_EQ ( flows[ i ], map.findFlow ( genDesc ( i ), IpFlow::DefaultDescType ) );
+    }
+
+    EXPECT_TRUE ( !map.findFlow ( genDesc ( numFlows ), IpFlow::DefaultDescType ) );
+
+    map.getStats ( stats );
+
+    EXPECT_EQ ( numFlows, stats.numEntries );
+    EXPECT_GE ( stats.numSlots, numFlows * 4 / 3 );
+    EXPECT_GT ( stats.numResizes, 0U );
+    EXPECT_GE ( stats.totalProbeLength, ( uint64_t ) numFlows );
+    EXPECT_GE ( stats.numLookups, ( uint64_t ) numFlows );
+
+    // Each successful look-up should (almost always) only examine the flow it finds:
+    EXPECT_LT ( stats.numFlowsChecked, stats.numLookups + stats.numLookups / 100 );
+
+    for ( uint32_t i = 0; i < numFlows; ++i )
+    {
+        if ( i % 10 != 0 )
+        {
+            map.removeFlow ( flows[ i ] );
+            EXPECT_FALSE ( flows[ i ]->isInMap() );
+            EXPECT_EQ ( 0U, flows[ i ]->numRemoved );
+        }
+    }
+
+    EXPECT_EQ ( numFlows / 10, map.getNumEntries() );
+
+    for ( uint32_t i = 0; i < numFlows; ++i )
+    {
+        EXPECT_EQ ( ( i % 10 == 0 ) ? flows[ i ] : 0, map.findFlow ( genDesc ( i ), IpFlow::DefaultDescType ) );
+    }
+
+    const uint32_t maxSlots = stats.numSlots;
+
+    map.getStats ( stats );
+
+    EXPECT_LT ( stats.numSlots, maxSlots );
+
+    map.clearMap();
+
+    EXPECT_TRUE ( map.isEmpty() );
+
+    map.getStats ( stats );
+
+    EXPECT_EQ ( 256U, stats.numSlots );
+
+    for ( uint32_t i = 0; i < numFlows; ++i )
+    {
+        EXPECT_FALSE ( flows[ i ]->isInMap() );
+        EXPECT_EQ ( ( i % 10 == 0 ) ? 1U : 0U, flows[ i ]->numRemoved );
+
+        delete flows[ i ];
+    }
+
+    delete[] flows;
+}
+
+TEST_F ( IpFlowMapTest, DualFlow )
+{
+    TestFlowMap map ( 8 );
+    TestFlow a ( genDesc ( 1 ), genDesc ( 2 ) );
+    TestFlow b ( genDesc ( 2 ) );
+
+    ASSERT_TRUE ( map.insertFlow ( &a ) );
+    EXPECT_EQ ( 2U, map.getNumEntries() );
+
+    // The secondary descriptor of 'a' conflicts with 'b':
+    EXPECT_FALSE ( map.insertFlow ( &b ) );
+
+    EXPECT_EQ ( &a, map.findFlow ( genDesc ( 1 ), IpFlow::DefaultDescType ) );
+    EXPECT_EQ ( &a, map.findFlow ( genDesc ( 2 ), DualIpFlow::SecondaryDescType ) );
+    EXPECT_TRUE ( !map.findFlow ( genDesc ( 2 ), IpFlow::DefaultDescType ) );
+
+    map.removeFlow ( &a );
+
+    EXPECT_TRUE ( map.isEmpty() );
+    EXPECT_FALSE ( a.isInMap() );
+
+    ASSERT_TRUE ( map.insertFlow ( &b ) );
+    EXPECT_FALSE ( map.insertFlow ( &a ) );
+    EXPECT_FALSE ( a.isInMap() );
+    EXPECT_EQ ( 1U, map.getNumEntries() );
+
+    map.removeFlow ( &b );
+
+    ASSERT_TRUE ( map.insertFlow ( &a ) );
+
+    map.clearMap();
+
+    // flowRemoved() should be called once, even though the flow used two entries:
+    EXPECT_EQ ( 1U, a.numRemoved );
+    EXPECT_FALSE ( a.isInMap() );
+}
+
+TEST_F ( IpFlowMapTest, Expiry )
+{
+    const uint32_t numFlows = 100;
+
+    TestFlowMap map ( 8 );
+    TestFlow * flows[ numFlows ];
+
+    for ( uint32_t i = 0; i < numFlows; ++i )
+    {
+        flows[ i ] = new TestFlow ( genDesc ( i ) );
+
+        ASSERT_TRUE ( map.insertFlow ( flows[ i ] ) );
+    }
+
+    flows[ 0 ]->expired = true;
+
+    // Expired flows are not returned (and are removed), unless we ask to keep them:
+    EXPECT_EQ ( flows[ 0 ], map.findFlow ( genDesc ( 0 ), IpFlow::DefaultDescType, IpFlowMap::DontExpireFlows ) );
+    EXPECT_TRUE ( !map.findFlow ( genDesc ( 0 ), IpFlow::DefaultDescType ) );
+    EXPECT_FALSE ( flows[ 0 ]->isInMap() );
+    EXPECT_EQ ( 1U, flows[ 0 ]->numRemoved );
+
+    for ( uint32_t i = 1; i < numFlows; i += 2 )
+    {
+        flows[ i ]->expired = true;
+    }
+
+    // A cleanup of the entire map should remove all the other expired flows:
+    EXPECT_EQ ( numFlows / 2, map.cleanupFlows ( 2 * 256 ) );
+    EXPECT_EQ ( numFlows / 2 - 1, map.getNumEntries() );
+
+    for ( uint32_t i = 0; i < numFlows; ++i )
+    {
+        EXPECT_EQ ( !flows[ i ]->expired, flows[ i ]->isInMap() );
+    }
+
+    map.clearMap();
+
+    for ( uint32_t i = 0; i < numFlows; ++i )
+    {
+        EXPECT_EQ ( 1U, flows[ i ]->numRemoved );
+
+        delete flows[ i ];
+    }
+}
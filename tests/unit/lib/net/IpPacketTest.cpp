@@ -380,3 +380,453 @@ TEST_F ( IpPacketTest, IpPacketParseV6Icmp )
     EXPECT_EQ ( sizeof ( data ), m.size() );
     EXPECT_EQ ( 0, memcmp ( m.get(), data, sizeof ( data ) ) );
 }
+
+/// @brief Tests of splitting super-packets and completing partial checksums.
+class IpPacketSegmentsTest: public ::testing::Test, public ::testing::WithParamInterface<bool>
+{
+    public:
+        const bool UseV6; ///< True if we should use IPv6 for the addresses generated in each test.
+
+        /// @brief Default constructor.
+        inline IpPacketSegmentsTest(): UseV6 ( GetParam() )
+        {
+        }
+
+    protected:
+        /// @brief The offset of the checksum in the TCP header.
+        static const size_t TcpCsumOffset = 16;
+
+        /// @brief The offset of the checksum in the UDP header.
+        static const size_t UdpCsumOffset = 6;
+
+        /// @brief Generates a payload.
+        /// @param [in] size The size of the payload.
+        /// @return Generated payload.
+        static MemHandle genPayload ( size_t size )
+        {
+            MemHandle payload ( size );
+
+            for ( size_t i = 0; i < payload.size(); ++i )
+            {
+                payload.getWritable()[ i ] = ( char ) ( i * 7 + 3 );
+            }
+
+            return payload;
+        }
+
+        /// @brief Returns the size of the IP header.
+        /// @return The size of the IP header (without any extension headers).
+        inline size_t getIpHdrSize() const
+        {
+            return UseV6 ? 40 : 20;
+        }
+
+        /// @brief Generates a UDP packet.
+        /// @param [in] payload The payload to use.
+        /// @return Generated packet.
+        inline UdpPacket genUdp ( const MemHandle & payload ) const
+        {
+            return UdpPacket ( UseV6 ? "::1" : "127.0.0.1", 1, UseV6 ? "::2" : "127.0.0.2", 2, payload );
+        }
+
+        /// @brief Generates a TCP packet.
+        /// @param [in] payload The payload to use.
+        /// @return Generated packet.
+        inline TcpPacket genTcp ( const MemHandle & payload ) const
+        {
+            return TcpPacket ( UseV6 ? "::1" : "127.0.0.1", 1, UseV6 ? "::2" : "127.0.0.2", 2,
+                               TcpPacket::FlagAck, 1000, 1, 1024, payload );
+        }
+
+        /// @brief Replaces the TCP or UDP checksum with a partial one (of the pseudo-header only).
+        /// This is what the packets with VIRTIO_NET_HDR_F_NEEDS_CSUM flag contain.
+        /// @param [in,out] data The data of the entire IP packet.
+        /// @param [in] csumOffset The offset of the checksum in TCP or UDP header.
+        void setPartialChecksum ( MemHandle & data, size_t csumOffset ) const
+        {
+            const size_t ipHdrSize = getIpHdrSize();
+            const uint16_t protoLen = ( uint16_t ) ( data.size() - ipHdrSize );
+            char pseudo[ 40 ];
+            size_t pseudoSize = 0;
+
+            memset ( pseudo, 0, sizeof ( pseudo ) );
+
+            if ( UseV6 )
+            {
+                // Addresses, 32 bit length, 3 zero bytes and the next header.
+                memcpy ( pseudo, data.get ( 8 ), 32 );
+                pseudo[ 34 ] = ( char ) ( protoLen >> 8 );
+                pseudo[ 35 ] = ( char ) ( protoLen & 0xFF );
+                pseudo[ 39 ] = data.get()[ 6 ];
+                pseudoSize = 40;
+            }
+            else
+            {
+                // Addresses, a zero byte, the protocol and 16 bit length.
+                memcpy ( pseudo, data.get ( 12 ), 8 );
+                pseudo[ 9 ] = data.get()[ 9 ];
+                pseudo[ 10 ] = ( char ) ( protoLen >> 8 );
+                pseudo[ 11 ] = ( char ) ( protoLen & 0xFF );
+                pseudoSize = 12;
+            }
+
+            const uint16_t partial = ~IpChecksum::getChecksum ( pseudo, pseudoSize );
+
+            memcpy ( data.getWritable() + ipHdrSize + csumOffset, &partial, 2 );
+        }
+
+        /// @brief Splits the packet and verifies the segments.
+        /// @param [in] packet The packet to split.
+        /// @param [in] payload The payload of the packet.
+        /// @param [in] segSize The size of the segments.
+        /// @tparam PacketType The type of the packet (TcpPacket or UdpPacket).
+        template<typename PacketType> void testSplit (
+            const IpPacket & packet, const MemHandle & payload, uint16_t segSize ) const
+        {
+            List<IpPacket> segments;
+
+            ASSERT_TRUE ( packet.splitSegments ( segSize, segments ) );
+            ASSERT_EQ ( ( payload.size() + segSize - 1 ) / segSize, segments.size() );
+
+            MemVector allPayload;
+
+            for ( size_t i = 0; i < segments.size(); ++i )
+            {
+                const IpPacket & seg = segments.at ( i );
+                const size_t segPayloadSize = ( i + 1 < segments.size() ) ? segSize : ( payload.size() - i * segSize );
+
+                ASSERT_TRUE ( seg.isValid() );
+                ASSERT_NE ( ( const typename PacketType::Header * ) 0, seg.getProtoHeader<PacketType>() );
+
+                MemHandle data;
+
+                ASSERT_TRUE ( seg.getPacketData().storeContinuous ( data ) );
+
+                EXPECT_EQ ( UseV6 ? 6 : 4, seg.getIpVersion() );
+                EXPECT_EQ ( getIpHdrSize() + sizeof ( typename PacketType::Header ) + segPayloadSize, data.size() );
+
+                if ( !UseV6 )
+                {
+                    // The IPv4 header checksum (including the checksum field) should be 0:
+                    EXPECT_EQ ( 0, IpChecksum::getChecksum ( data.get(), getIpHdrSize() ) );
+                }
+
+                // The checksum over the entire segment (including the checksum field) should be 0:
+                EXPECT_EQ ( 0, seg.calcPseudoHeaderPayloadChecksum() );
+
+                MemVector segPayload;
+
+                ASSERT_TRUE ( seg.getProtoPayload<PacketType> ( segPayload ) );
+                EXPECT_EQ ( segPayloadSize, segPayload.getDataSize() );
+                EXPECT_TRUE ( allPayload.append ( segPayload ) );
+            }
+
+            MemHandle mh;
+
+            ASSERT_TRUE ( allPayload.storeContinuous ( mh ) );
+            ASSERT_EQ ( payload.size(), mh.size() );
+            EXPECT_EQ ( 0, memcmp ( payload.get(), mh.get(), mh.size() ) );
+        }
+
+        /// @brief Splits a TCP packet into segments, each of them using a separate memory.
+        /// @param [in] payload The payload of the packet to split.
+        /// @param [in] segSize The size of the segments.
+        /// @param [out] segments The list to append segments to.
+        void genSegments ( const MemHandle & payload, uint16_t segSize, List<IpPacket> & segments ) const
+        {
+            List<IpPacket> split;
+
+            ASSERT_TRUE ( genTcp ( payload ).splitSegments ( segSize, split ) );
+
+            for ( size_t i = 0; i < split.size(); ++i )
+            {
+                MemHandle data;
+
+                ASSERT_TRUE ( split.at ( i ).getPacketData().storeContinuous ( data ) );
+
+                segments.append ( IpPacket ( data ) );
+            }
+        }
+
+        /// @brief Modifies a single byte in the TCP header of a segment.
+        /// The checksums are not updated.
+        /// @param [in,out] segments The list of segments.
+        /// @param [in] index The index of the segment to modify.
+        /// @param [in] offset The offset of the byte to modify in the TCP header.
+        /// @param [in] value The value to XOR the byte with.
+        void modifyTcpHeader ( List<IpPacket> & segments, size_t index, size_t offset, uint8_t value ) const
+        {
+            MemHandle data;
+
+            ASSERT_TRUE ( segments.at ( index ).getPacketData().storeContinuous ( data ) );
+
+            char * const w = data.getWritable();
+
+            ASSERT_TRUE ( w != 0 );
+
+            w[ getIpHdrSize() + offset ] ^= ( char ) value;
+
+            segments[ index ] = IpPacket ( data );
+        }
+
+        /// @brief Replaces the checksum of the packet with a partial one, completes it, and compares the result.
+        /// @param [in] packet The packet to test.
+        /// @param [in] csumOffset The offset of the checksum in TCP or UDP header.
+        void testPartialChecksum ( const IpPacket & packet, size_t csumOffset ) const
+        {
+            MemHandle orig;
+
+            ASSERT_TRUE ( packet.getPacketData().storeContinuous ( orig ) );
+
+            // A copy, so we don't modify the original:
+            MemHandle data ( orig.size() );
+
+            memcpy ( data.getWritable(), orig.get(), orig.size() );
+
+            setPartialChecksum ( data, csumOffset );
+
+            EXPECT_NE ( 0, memcmp ( orig.get(), data.get(), data.size() ) );
+
+            ASSERT_TRUE ( IpPacket::completePartialChecksum (
+                              data, ( uint16_t ) getIpHdrSize(), ( uint16_t ) csumOffset ) );
+
+            ASSERT_EQ ( orig.size(), data.size() );
+            EXPECT_EQ ( 0, memcmp ( orig.get(), data.get(), data.size() ) );
+        }
+};
+
+// MSVC doesn't like static const integrals defined in implementation files.
+#ifndef _MSC_VER
+const size_t IpPacketSegmentsTest::TcpCsumOffset;
+const size_t IpPacketSegmentsTest::UdpCsumOffset;
+#endif
+
+TEST_P ( IpPacketSegmentsTest, UdpSplit )
+{
+    const MemHandle payload = genPayload ( 4 * 1000 + 1 );
+    const UdpPacket p = genUdp ( payload );
+
+    ASSERT_TRUE ( p.isValid() );
+
+    testSplit<UdpPacket> ( p, payload, 1000 );
+
+    // Each segment is a separate datagram, with its own length:
+    List<IpPacket> segments;
+
+    ASSERT_TRUE ( p.splitSegments ( 1000, segments ) );
+    ASSERT_EQ ( 5U, segments.size() );
+
+    EXPECT_EQ ( 1008, ntohs ( segments.at ( 0 ).getProtoHeader<UdpPacket>()->length ) );
+    EXPECT_EQ ( 9, ntohs ( segments.at ( 4 ).getProtoHeader<UdpPacket>()->length ) );
+}
+
+TEST_P ( IpPacketSegmentsTest, UdpSplitSingle )
+{
+    // Not larger than a single segment:
+    const MemHandle payload = genPayload ( 500 );
+    const UdpPacket p = genUdp ( payload );
+
+    ASSERT_TRUE ( p.isValid() );
+
+    testSplit<UdpPacket> ( p, payload, 1000 );
+}
+
+TEST_P ( IpPacketSegmentsTest, TcpSplit )
+{
+    const MemHandle payload = genPayload ( 3 * 1200 + 17 );
+    const TcpPacket p = genTcp ( payload );
+
+    ASSERT_TRUE ( p.isValid() );
+
+    testSplit<TcpPacket> ( p, payload, 1200 );
+}
+
+TEST_P ( IpPacketSegmentsTest, SplitPartialChecksum )
+{
+    // Super-packets generated with offloads only have partial (pseudo-header) checksums.
+    // Segments get their checksums calculated from scratch, so that should not matter:
+
+    const MemHandle payload = genPayload ( 2 * 1000 + 100 );
+
+    MemHandle data;
+
+    ASSERT_TRUE ( genTcp ( payload ).getPacketData().storeContinuous ( data ) );
+
+    setPartialChecksum ( data, TcpCsumOffset );
+
+    testSplit<TcpPacket> ( IpPacket ( data ), payload, 1000 );
+
+    ASSERT_TRUE ( genUdp ( payload ).getPacketData().storeContinuous ( data ) );
+
+    setPartialChecksum ( data, UdpCsumOffset );
+
+    testSplit<UdpPacket> ( IpPacket ( data ), payload, 1000 );
+}
+
+TEST_P ( IpPacketSegmentsTest, PartialChecksum )
+{
+    for ( size_t size = 0; size < 300; size += 37 )
+    {
+        const MemHandle payload = genPayload ( size );
+
+        testPartialChecksum ( genTcp ( payload ), TcpCsumOffset );
+        testPartialChecksum ( genUdp ( payload ), UdpCsumOffset );
+    }
+}
+
+TEST_P ( IpPacketSegmentsTest, PartialChecksumInvalid )
+{
+    MemHandle data;
+
+    ASSERT_TRUE ( genTcp ( genPayload ( 10 ) ).getPacketData().storeContinuous ( data ) );
+
+    // Odd start:
+    EXPECT_FALSE ( IpPacket::completePartialChecksum ( data, ( uint16_t ) getIpHdrSize() + 1, TcpCsumOffset ) );
+
+    // Past the end:
+    EXPECT_FALSE ( IpPacket::completePartialChecksum ( data, ( uint16_t ) getIpHdrSize(), data.size() ) );
+
+    MemHandle empty;
+
+    EXPECT_FALSE ( IpPacket::completePartialChecksum ( empty, 0, 0 ) );
+}
+
+TEST_P ( IpPacketSegmentsTest, TcpCoalesce )
+{
+    const MemHandle payload = genPayload ( 4 * 1000 + 17 );
+    const TcpPacket p = genTcp ( payload );
+
+    ASSERT_TRUE ( p.isValid() );
+
+    List<IpPacket> segments;
+
+    genSegments ( payload, 1000, segments );
+
+    ASSERT_EQ ( 5U, segments.size() );
+
+    IpPacket superPacket;
+    uint16_t segSize = 0;
+
+    ASSERT_EQ ( 5U, IpPacket::coalesceSegments ( segments, 0, superPacket, segSize ) );
+    EXPECT_EQ ( 1000, segSize );
+
+    // The super-packet only has the partial checksum. Once it is completed, it should be the same as the original:
+    MemHandle orig;
+    MemHandle data;
+
+    ASSERT_TRUE ( p.getPacketData().storeContinuous ( orig ) );
+    ASSERT_TRUE ( superPacket.getPacketData().storeContinuous ( data ) );
+    ASSERT_EQ ( orig.size(), data.size() );
+
+    EXPECT_NE ( 0, memcmp ( orig.get(), data.get(), data.size() ) );
+
+    ASSERT_TRUE ( IpPacket::completePartialChecksum ( data, ( uint16_t ) getIpHdrSize(), TcpCsumOffset ) );
+
+    EXPECT_EQ ( 0, memcmp ( orig.get(), data.get(), data.size() ) );
+
+    // Splitting it again should generate the same segments:
+    testSplit<TcpPacket> ( IpPacket ( data ), payload, segSize );
+
+    // Starting in the middle:
+    ASSERT_EQ ( 3U, IpPacket::coalesceSegments ( segments, 2, superPacket, segSize ) );
+    EXPECT_EQ ( ( size_t ) getIpHdrSize() + 20 + 2 * 1000 + 17, superPacket.getPacketSize() );
+
+    // Nothing to coalesce the last packet with:
+    EXPECT_EQ ( 0U, IpPacket::coalesceSegments ( segments, 4, superPacket, segSize ) );
+    EXPECT_EQ ( 0U, IpPacket::coalesceSegments ( segments, 5, superPacket, segSize ) );
+}
+
+TEST_P ( IpPacketSegmentsTest, TcpCoalescePartial )
+{
+    const MemHandle payload = genPayload ( 5 * 1000 );
+
+    IpPacket superPacket;
+    uint16_t segSize = 0;
+
+    {
+        // PSH can only be set in the last packet:
+        List<IpPacket> segments;
+
+        genSegments ( payload, 1000, segments );
+        modifyTcpHeader ( segments, 2, 13, TcpPacket::FlagPsh );
+
+        EXPECT_EQ ( 3U, IpPacket::coalesceSegments ( segments, 0, superPacket, segSize ) );
+        EXPECT_TRUE ( ( superPacket.getProtoHeader<TcpPacket>()->flags & TcpPacket::FlagPsh ) != 0 );
+
+        EXPECT_EQ ( 0U, IpPacket::coalesceSegments ( segments, 2, superPacket, segSize ) );
+    }
+
+    {
+        // A gap in sequence numbers:
+        List<IpPacket> segments;
+
+        genSegments ( payload, 1000, segments );
+        modifyTcpHeader ( segments, 3, 7, 1 );
+
+        EXPECT_EQ ( 3U, IpPacket::coalesceSegments ( segments, 0, superPacket, segSize ) );
+    }
+
+    {
+        // A different flow:
+        List<IpPacket> segments;
+
+        genSegments ( payload, 1000, segments );
+        modifyTcpHeader ( segments, 1, 1, 1 );
+
+        EXPECT_EQ ( 0U, IpPacket::coalesceSegments ( segments, 0, superPacket, segSize ) );
+        EXPECT_EQ ( 0U, IpPacket::coalesceSegments ( segments, 1, superPacket, segSize ) );
+        EXPECT_EQ ( 3U, IpPacket::coalesceSegments ( segments, 2, superPacket, segSize ) );
+    }
+
+    {
+        // Other flags:
+        List<IpPacket> segments;
+
+        genSegments ( payload, 1000, segments );
+        modifyTcpHeader ( segments, 1, 13, TcpPacket::FlagFin );
+
+        EXPECT_EQ ( 0U, IpPacket::coalesceSegments ( segments, 0, superPacket, segSize ) );
+    }
+
+    {
+        // Only the last payload can be smaller:
+        List<IpPacket> segments;
+
+        genSegments ( genPayload ( 1000 + 500 ), 1000, segments );
+        genSegments ( genPayload ( 1000 ), 1000, segments );
+
+        ASSERT_EQ ( 3U, segments.size() );
+
+        EXPECT_EQ ( 2U, IpPacket::coalesceSegments ( segments, 0, superPacket, segSize ) );
+        EXPECT_EQ ( ( size_t ) getIpHdrSize() + 20 + 1000 + 500, superPacket.getPacketSize() );
+    }
+
+    if ( !UseV6 )
+    {
+        // Without DF flag, IPv4 IDs have to be consecutive:
+        List<IpPacket> segments;
+
+        genSegments ( payload, 1000, segments );
+
+        MemHandle data;
+
+        ASSERT_TRUE ( segments.at ( 1 ).getPacketData().storeContinuous ( data ) );
+
+        data.getWritable()[ 5 ] ^= 1;
+        segments[ 1 ] = IpPacket ( data );
+
+        EXPECT_EQ ( 0U, IpPacket::coalesceSegments ( segments, 0, superPacket, segSize ) );
+    }
+
+    {
+        // UDP is not coalesced:
+        List<IpPacket> split;
+
+        ASSERT_TRUE ( genUdp ( payload ).splitSegments ( 1000, split ) );
+
+        EXPECT_EQ ( 0U, IpPacket::coalesceSegments ( split, 0, superPacket, segSize ) );
+    }
+}
+
+INSTANTIATE_TEST_CASE_P ( IPv4, IpPacketSegmentsTest, ::testing::Values ( false ) );
+INSTANTIATE_TEST_CASE_P ( IPv6, IpPacketSegmentsTest, ::testing::Values ( true ) );
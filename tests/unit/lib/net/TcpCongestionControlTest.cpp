@@ -0,0 +1,184 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "net/RttStat.hpp"
+#include "net/TcpCongestionControl.hpp"
+#include "net/TcpNewReno.hpp"
+#include "net/TcpCubic.hpp"
+
+using namespace Pravala;
+
+/// @brief TcpCongestionControl tests
+class TcpCongestionControlTest: public ::testing::Test
+{
+    protected:
+        static const uint16_t Mss = 1000; ///< The MSS used by the tests.
+
+        /// @brief Simulates a number of round trips, each acknowledging the entire window.
+        /// The window is acknowledged using one ACK for every segment, and we assume that the sender
+        /// always fills the window.
+        /// @param [in] cc The congestion controller to use.
+        /// @param [in] rtt The RTT stats to use. A new 100 ms sample is added in every round trip.
+        /// @param [in,out] now The current time. It is advanced by 100 ms in every round trip.
+        /// @param [in] numRounds The number of round trips to simulate.
+        static void runRounds ( TcpCongestionControl & cc, RttStat & rtt, Time & now, int numRounds )
+        {
+            for ( int r = 0; r < numRounds; ++r )
+            {
+                const uint32_t numAcks = cc.getCwnd() / Mss;
+
+                for ( uint32_t i = 0; i < numAcks; ++i )
+                {
+                    cc.dataAcked ( Mss, cc.getCwnd(), rtt, now );
+                }
+
+                rtt.addRtt ( 100 );
+                now.increaseMilliseconds ( 100 );
+            }
+        }
+};
+
+const uint16_t TcpCongestionControlTest::Mss;
+
+TEST_F ( TcpCongestionControlTest, Create )
+{
+    TcpCongestionControl * cc = TcpCongestionControl::create ( "NewReno", Mss );
+
+    ASSERT_TRUE ( cc != 0 );
+    EXPECT_STREQ ( "newreno", cc->getName() );
+    EXPECT_EQ ( Mss, cc->Mss );
+
+    // RFC 6928 initial window:
+    EXPECT_EQ ( 10U * Mss, cc->getCwnd() );
+    EXPECT_TRUE ( cc->isInSlowStart() );
+
+    delete cc;
+
+    cc = TcpCongestionControl::create ( "cubic", Mss );
+
+    ASSERT_TRUE ( cc != 0 );
+    EXPECT_STREQ ( "cubic", cc->getName() );
+
+    delete cc;
+
+    EXPECT_TRUE ( TcpCongestionControl::create ( "foo", Mss ) == 0 );
+}
+
+TEST_F ( TcpCongestionControlTest, NewReno )
+{
+    TcpNewReno cc ( Mss );
+    RttStat rtt;
+    Time now;
+
+    // Slow start doubles the window every round trip:
+    runRounds ( cc, rtt, now, 3 );
+
+    EXPECT_EQ ( 80U * Mss, cc.getCwnd() );
+
+    // Fast recovery halves it:
+    cc.lossDetected ( cc.getCwnd(), now );
+
+    EXPECT_EQ ( 40U * Mss, cc.getSsThresh() );
+    EXPECT_EQ ( 40U * Mss, cc.getCwnd() );
+    EXPECT_FALSE ( cc.isInSlowStart() );
+
+    cc.recoveryCompleted();
+
+    EXPECT_EQ ( 40U * Mss, cc.getCwnd() );
+
+    // Congestion avoidance grows it by one segment every round trip:
+    runRounds ( cc, rtt, now, 5 );
+
+    EXPECT_EQ ( 45U * Mss, cc.getCwnd() );
+
+    // The window should not grow if the sender doesn't use it:
+    for ( int i = 0; i < 100; ++i )
+    {
+        cc.dataAcked ( Mss, Mss, rtt, now );
+    }
+
+    EXPECT_EQ ( 45U * Mss, cc.getCwnd() );
+
+    // The timeout resets it to a single segment:
+    cc.retransmitTimeout ( cc.getCwnd(), now );
+
+    EXPECT_EQ ( Mss, cc.getCwnd() );
+    EXPECT_EQ ( 22U * Mss + Mss / 2, cc.getSsThresh() );
+    EXPECT_TRUE ( cc.isInSlowStart() );
+}
+
+TEST_F ( TcpCongestionControlTest, Cubic )
+{
+    TcpCubic cubic ( Mss );
+    TcpNewReno reno ( Mss );
+    RttStat rtt;
+    Time now;
+
+    now.setSeconds ( 1 );
+
+    runRounds ( cubic, rtt, now, 5 );
+    runRounds ( reno, rtt, now, 5 );
+
+    ASSERT_EQ ( 320U * Mss, cubic.getCwnd() );
+    ASSERT_EQ ( 320U * Mss, reno.getCwnd() );
+
+    // CUBIC uses beta = 0.7:
+    cubic.lossDetected ( cubic.getCwnd(), now );
+    reno.lossDetected ( reno.getCwnd(), now );
+
+    EXPECT_EQ ( 224U * Mss, cubic.getCwnd() );
+    EXPECT_EQ ( 160U * Mss, reno.getCwnd() );
+
+    cubic.recoveryCompleted();
+    reno.recoveryCompleted();
+
+    // CUBIC should quickly grow back towards the window at which the loss happened, and then stay around it
+    // for a while. K = cubic_root ( 96 / 0.4 ) = 6.2 seconds.
+
+    runRounds ( cubic, rtt, now, 30 );
+
+    EXPECT_GT ( cubic.getCwnd(), 280U * Mss );
+    EXPECT_LT ( cubic.getCwnd(), 320U * Mss );
+
+    runRounds ( cubic, rtt, now, 30 );
+
+    EXPECT_GT ( cubic.getCwnd(), 310U * Mss );
+    EXPECT_LE ( cubic.getCwnd(), 322U * Mss );
+
+    // Then it should start probing for more bandwidth, much faster than NewReno.
+
+    runRounds ( cubic, rtt, now, 80 );
+    runRounds ( reno, rtt, now, 120 );
+
+    EXPECT_GT ( cubic.getCwnd(), 450U * Mss );
+    EXPECT_EQ ( 280U * Mss, reno.getCwnd() );
+
+    // Every loss reduces the window:
+
+    const uint32_t cwnd = cubic.getCwnd();
+
+    cubic.lossDetected ( cwnd, now );
+    cubic.recoveryCompleted();
+    cubic.lossDetected ( cubic.getCwnd(), now );
+
+    EXPECT_EQ ( ( uint32_t ) ( ( uint32_t ) ( cwnd * 0.7 ) * 0.7 ), cubic.getCwnd() );
+
+    cubic.retransmitTimeout ( cubic.getCwnd(), now );
+
+    EXPECT_EQ ( Mss, cubic.getCwnd() );
+}
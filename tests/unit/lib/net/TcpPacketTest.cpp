@@ -110,5 +110,109 @@ TEST_P ( TcpPacketTest, TcpPacketCreation )
     }
 }
 
+TEST_P ( TcpPacketTest, TcpPacketSplit )
+{
+    const uint16_t segSize = 100;
+    const uint32_t seqNum = 1000;
+
+    MemHandle payload ( 3 * segSize + 10 );
+
+    for ( size_t i = 0; i < payload.size(); ++i )
+    {
+        payload.getWritable()[ i ] = ( char ) i;
+    }
+
+    TcpPacket p ( UseV6 ? "::1" : "127.0.0.1", 1, UseV6 ? "::2" : "127.0.0.2", 2,
+                  TcpPacket::FlagAck | TcpPacket::FlagPsh | TcpPacket::FlagFin, seqNum, 1, 1024, payload );
+
+    ASSERT_TRUE ( p.isValid() );
+
+    List<IpPacket> segments;
+
+    ASSERT_TRUE ( p.splitSegments ( segSize, segments ) );
+    ASSERT_EQ ( 4U, segments.size() );
+
+    MemVector allPayload;
+
+    for ( size_t i = 0; i < segments.size(); ++i )
+    {
+        const IpPacket & seg = segments.at ( i );
+        const bool isLast = ( i + 1 == segments.size() );
+
+        ASSERT_TRUE ( seg.isValid() );
+
+        const TcpPacket::Header * const tcpHdr = seg.getProtoHeader<TcpPacket>();
+
+        ASSERT_NE ( ( const TcpPacket::Header * ) 0, tcpHdr );
+
+        EXPECT_EQ ( seqNum + i * segSize, tcpHdr->getSeqNum() );
+        EXPECT_EQ ( isLast, ( tcpHdr->flags & TcpPacket::FlagFin ) != 0 );
+        EXPECT_EQ ( isLast, ( tcpHdr->flags & TcpPacket::FlagPsh ) != 0 );
+        EXPECT_TRUE ( ( tcpHdr->flags & TcpPacket::FlagAck ) != 0 );
+
+        // The checksum over the entire segment (including the checksum field) should be 0:
+        EXPECT_EQ ( 0, seg.calcPseudoHeaderPayloadChecksum() );
+
+        MemVector segPayload;
+
+        ASSERT_TRUE ( seg.getProtoPayload<TcpPacket> ( segPayload ) );
+        EXPECT_EQ ( isLast ? 10U : segSize, segPayload.getDataSize() );
+        EXPECT_TRUE ( allPayload.append ( segPayload ) );
+    }
+
+    MemHandle mh;
+
+    ASSERT_TRUE ( allPayload.storeContinuous ( mh ) );
+    ASSERT_EQ ( payload.size(), mh.size() );
+    EXPECT_EQ ( 0, memcmp ( payload.get(), mh.get(), mh.size() ) );
+}
+
+TEST_P ( TcpPacketTest, TcpPacketSAckOptions )
+{
+    const uint32_t edges[ 4 ] = { htonl ( 1000 ), htonl ( 2000 ), htonl ( 3000 ), htonl ( 0xFFFFFF00U ) };
+
+    TcpPacket::Option opts[ 2 ];
+
+    opts[ 0 ].type = TcpPacket::OptSAckPerm;
+    opts[ 1 ].type = TcpPacket::OptSAck;
+    opts[ 1 ].data = edges;
+    opts[ 1 ].dataLength = sizeof ( edges );
+
+    // SACK permitted option is only valid in SYN packets:
+
+    TcpPacket syn ( UseV6 ? "::1" : "127.0.0.1", 1, UseV6 ? "::2" : "127.0.0.2", 2,
+                    TcpPacket::FlagSyn, 1, 0, 1024, MemVector::EmptyVector, opts, 1 );
+
+    TcpPacket ack ( UseV6 ? "::1" : "127.0.0.1", 1, UseV6 ? "::2" : "127.0.0.2", 2,
+                    TcpPacket::FlagAck, 1, 1, 1024, MemVector::EmptyVector, opts, 2 );
+
+    ASSERT_TRUE ( syn.isValid() );
+    ASSERT_TRUE ( ack.isValid() );
+
+    const TcpPacket::Header * const synHdr = syn.getProtoHeader<TcpPacket>();
+    const TcpPacket::Header * const ackHdr = ack.getProtoHeader<TcpPacket>();
+
+    ASSERT_NE ( ( const TcpPacket::Header * ) 0, synHdr );
+    ASSERT_NE ( ( const TcpPacket::Header * ) 0, ackHdr );
+
+    EXPECT_TRUE ( synHdr->getOptSAckPermitted() );
+    EXPECT_FALSE ( ackHdr->getOptSAckPermitted() );
+
+    uint32_t blocks[ 8 ];
+
+    EXPECT_EQ ( 0, synHdr->getOptSAck ( blocks, 4 ) );
+
+    ASSERT_EQ ( 2, ackHdr->getOptSAck ( blocks, 4 ) );
+    EXPECT_EQ ( 1000U, blocks[ 0 ] );
+    EXPECT_EQ ( 2000U, blocks[ 1 ] );
+    EXPECT_EQ ( 3000U, blocks[ 2 ] );
+    EXPECT_EQ ( 0xFFFFFF00U, blocks[ 3 ] );
+
+    // Only the number of blocks requested should be read:
+    ASSERT_EQ ( 1, ackHdr->getOptSAck ( blocks, 1 ) );
+    EXPECT_EQ ( 1000U, blocks[ 0 ] );
+    EXPECT_EQ ( 2000U, blocks[ 1 ] );
+}
+
 INSTANTIATE_TEST_CASE_P ( IPv4, TcpPacketTest, ::testing::Values ( false ) );
 INSTANTIATE_TEST_CASE_P ( IPv6, TcpPacketTest, ::testing::Values ( true ) );
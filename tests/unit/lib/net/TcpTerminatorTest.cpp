@@ -0,0 +1,490 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "net/TcpCongestionControl.hpp"
+#include "net/TcpPacket.hpp"
+#include "net/TcpTerminator.hpp"
+
+using namespace Pravala;
+
+/// @brief A TCP terminator that stores all the packets it sends.
+class TestTcpTerminator: public TcpTerminator
+{
+    public:
+        List<IpPacket> sentPackets; ///< Packets sent by the terminator.
+
+        /// @brief Constructor.
+        /// @param [in] flowDesc FlowDesc object describing this flow.
+        TestTcpTerminator ( const FlowDesc & flowDesc ): TcpTerminator ( flowDesc )
+        {
+        }
+
+        using TcpTerminator::appendData;
+        using TcpTerminator::sendSynAck;
+        using TcpTerminator::receiveLoopEndEvent;
+        using TcpTerminator::getRto;
+
+        /// @brief Returns the state of the terminator.
+        /// @return The state of the terminator.
+        inline TcpState getTcpState() const
+        {
+            return _tcpState;
+        }
+
+        /// @brief Returns the congestion controller.
+        /// @return The congestion controller.
+        inline const TcpCongestionControl * getCongestionControl() const
+        {
+            return _cc;
+        }
+
+        /// @brief Simulates the expiration of the retransmission timer.
+        inline void expireTimer()
+        {
+            timerExpired ( &_tcpTimer );
+        }
+
+    protected:
+        virtual ERRCODE receiveData ( MemHandle & data )
+        {
+            data.clear();
+            return Error::Success;
+        }
+
+        virtual ERRCODE sendPacket ( const IpPacket & packet )
+        {
+            sentPackets.append ( packet );
+            return Error::Success;
+        }
+
+        virtual bool initializeReceiver ( const IpPacket & )
+        {
+            return true;
+        }
+
+        virtual void sendingUnblocked()
+        {
+        }
+
+        virtual void receivingCompleted()
+        {
+        }
+};
+
+/// @brief TcpTerminator tests
+class TcpTerminatorTest: public ::testing::Test
+{
+    protected:
+        static const uint16_t Mss = 1000; ///< The MSS used by the client.
+        static const uint32_t ClientSeq = 5000; ///< The initial sequence number of the client.
+
+        const IpAddress ClientAddr; ///< The address of the client.
+        const IpAddress ServerAddr; ///< The address of the server.
+
+        TestTcpTerminator * term; ///< The terminator tested.
+        uint32_t serverSeq; ///< The sequence number of the first data byte sent by the terminator.
+
+        /// @brief Default constructor.
+        TcpTerminatorTest(): ClientAddr ( "10.0.0.1" ), ServerAddr ( "10.0.0.2" ), term ( 0 ), serverSeq ( 0 )
+        {
+        }
+
+        virtual void SetUp()
+        {
+            if ( !EventManager::isInitialized() )
+            {
+                ASSERT_TRUE ( IS_OK ( EventManager::init() ) );
+            }
+        }
+
+        virtual void TearDown()
+        {
+            delete term;
+            term = 0;
+        }
+
+        /// @brief Sends a packet from the client to the terminator.
+        /// @param [in] flags TCP flags to set.
+        /// @param [in] ackNum The ACK number to set.
+        /// @param [in] window The (scaled) window to advertise.
+        /// @param [in] options Pointer to the array of Option values.
+        /// @param [in] optCount The number of entries in options array.
+        void clientSend (
+            uint8_t flags, uint32_t ackNum, uint16_t window,
+            TcpPacket::Option * options = 0, uint8_t optCount = 0 )
+        {
+            // The SYN packet uses one sequence number.
+            const uint32_t seqNum = ( ( flags & TcpPacket::FlagSyn ) != 0 ) ? ClientSeq : ( ClientSeq + 1 );
+
+            TcpPacket packet ( ClientAddr, 1234, ServerAddr, 80, flags, seqNum, ackNum, window,
+                               MemVector::EmptyVector, options, optCount );
+
+            ASSERT_TRUE ( packet.isValid() );
+
+            if ( !term )
+            {
+                FlowDesc flowDesc;
+
+                ASSERT_TRUE ( packet.setupFlowDesc ( flowDesc, IpPacket::PacketFromClient ) );
+
+                term = new TestTcpTerminator ( flowDesc );
+            }
+
+            EXPECT_TRUE ( IS_OK ( term->packetReceived ( packet, IpFlow::DefaultDescType, 0 ) ) );
+        }
+
+        /// @brief Sends an ACK from the client, with SACK blocks.
+        /// @param [in] ackNum The ACK number to set.
+        /// @param [in] sackStart The sequence number of the first byte selectively acknowledged.
+        /// @param [in] sackEnd The sequence number right after the last byte selectively acknowledged.
+        void clientSAck ( uint32_t ackNum, uint32_t sackStart, uint32_t sackEnd )
+        {
+            const uint32_t edges[ 2 ] = { htonl ( sackStart ), htonl ( sackEnd ) };
+            TcpPacket::Option opt;
+
+            opt.type = TcpPacket::OptSAck;
+            opt.data = edges;
+            opt.dataLength = sizeof ( edges );
+
+            clientSend ( TcpPacket::FlagAck, ackNum, 0xFFFF, &opt, 1 );
+        }
+
+        /// @brief Performs the handshake.
+        /// @param [in] useWScale Whether the client should offer window scaling.
+        /// @param [in] useSAck Whether the client should offer selective acknowledgements.
+        void connect ( bool useWScale, bool useSAck )
+        {
+            const uint16_t oMss = htons ( Mss );
+            const uint8_t oWScale = 7;
+
+            TcpPacket::Option opts[ 3 ];
+            uint8_t numOpts = 0;
+
+            opts[ numOpts ].type = TcpPacket::OptMss;
+            opts[ numOpts ].data = &oMss;
+            opts[ numOpts ].dataLength = sizeof ( oMss );
+            ++numOpts;
+
+            if ( useWScale )
+            {
+                opts[ numOpts ].type = TcpPacket::OptWScale;
+                opts[ numOpts ].data = &oWScale;
+                opts[ numOpts ].dataLength = 1;
+                ++numOpts;
+            }
+
+            if ( useSAck )
+            {
+                opts[ numOpts ].type = TcpPacket::OptSAckPerm;
+                ++numOpts;
+            }
+
+            clientSend ( TcpPacket::FlagSyn, 0, 0xFFFF, opts, numOpts );
+
+            ASSERT_TRUE ( term != 0 );
+
+            term->sendSynAck();
+
+            ASSERT_EQ ( 1U, term->sentPackets.size() );
+
+            const TcpPacket::Header * const hdr = term->sentPackets.first().getProtoHeader<TcpPacket>();
+
+            ASSERT_TRUE ( hdr != 0 );
+            ASSERT_TRUE ( hdr->isSYN() );
+
+            serverSeq = hdr->getSeqNum() + 1;
+
+            clientSend ( TcpPacket::FlagAck, serverSeq, 0xFFFF );
+
+            ASSERT_EQ ( TcpTerminator::TcpConnected, term->getTcpState() );
+
+            term->sentPackets.clear();
+        }
+
+        /// @brief Gives the terminator data to send, and lets it send it.
+        /// @param [in] size The number of bytes to send.
+        void sendData ( size_t size )
+        {
+            MemHandle data ( size );
+
+            memset ( data.getWritable(), 'x', size );
+
+            term->appendData ( data );
+
+            EXPECT_TRUE ( data.isEmpty() );
+
+            term->receiveLoopEndEvent();
+        }
+
+        /// @brief Returns the sequence number of a packet sent by the terminator.
+        /// @param [in] idx The index of the packet.
+        /// @return The sequence number of the packet, relative to serverSeq.
+        uint32_t getSentSeq ( size_t idx ) const
+        {
+            const TcpPacket::Header * const hdr = term->sentPackets.at ( idx ).getProtoHeader<TcpPacket>();
+
+            return ( hdr != 0 ) ? ( hdr->getSeqNum() - serverSeq ) : 0xFFFFFFFFU;
+        }
+};
+
+const uint16_t TcpTerminatorTest::Mss;
+const uint32_t TcpTerminatorTest::ClientSeq;
+
+TEST_F ( TcpTerminatorTest, SynAckOptions )
+{
+    const uint16_t oMss = htons ( Mss );
+    const uint8_t oWScale = 7;
+
+    TcpPacket::Option opts[ 3 ];
+
+    opts[ 0 ].type = TcpPacket::OptMss;
+    opts[ 0 ].data = &oMss;
+    opts[ 0 ].dataLength = sizeof ( oMss );
+
+    opts[ 1 ].type = TcpPacket::OptWScale;
+    opts[ 1 ].data = &oWScale;
+    opts[ 1 ].dataLength = 1;
+
+    opts[ 2 ].type = TcpPacket::OptSAckPerm;
+
+    clientSend ( TcpPacket::FlagSyn, 0, 0xFFFF, opts, 3 );
+
+    ASSERT_TRUE ( term != 0 );
+
+    term->sendSynAck();
+
+    ASSERT_EQ ( 1U, term->sentPackets.size() );
+
+    const TcpPacket::Header * const hdr = term->sentPackets.first().getProtoHeader<TcpPacket>();
+
+    ASSERT_TRUE ( hdr != 0 );
+
+    uint16_t mss = 0;
+    uint8_t wScale = 0;
+
+    EXPECT_TRUE ( hdr->getOptMss ( mss ) );
+    EXPECT_EQ ( Mss, mss );
+
+    // The window-scale should allow advertising the entire (default) receive buffer,
+    // and the window in the SYN-ACK itself is not scaled.
+
+    EXPECT_TRUE ( hdr->getOptWindowScale ( wScale ) );
+    EXPECT_GE ( ( 0xFFFFU << wScale ), TcpTerminator::optRcvBufSize.value() );
+    EXPECT_LT ( ( 0xFFFFU << wScale ) / 2, TcpTerminator::optRcvBufSize.value() );
+    EXPECT_EQ ( 0xFFFF, hdr->getWindow() );
+
+    EXPECT_TRUE ( hdr->getOptSAckPermitted() );
+
+    // Once connected, the window should be scaled:
+
+    clientSend ( TcpPacket::FlagAck, hdr->getSeqNum() + 1, 0xFFFF );
+    term->sentPackets.clear();
+
+    sendData ( 100 );
+
+    ASSERT_EQ ( 1U, term->sentPackets.size() );
+
+    const TcpPacket::Header * const dataHdr = term->sentPackets.first().getProtoHeader<TcpPacket>();
+
+    ASSERT_TRUE ( dataHdr != 0 );
+    EXPECT_EQ ( TcpTerminator::optRcvBufSize.value() >> wScale, dataHdr->getWindow() );
+}
+
+TEST_F ( TcpTerminatorTest, SynAckNoOptions )
+{
+    clientSend ( TcpPacket::FlagSyn, 0, 0xFFFF );
+
+    ASSERT_TRUE ( term != 0 );
+
+    term->sendSynAck();
+
+    ASSERT_EQ ( 1U, term->sentPackets.size() );
+
+    const TcpPacket::Header * const hdr = term->sentPackets.first().getProtoHeader<TcpPacket>();
+
+    ASSERT_TRUE ( hdr != 0 );
+
+    uint8_t wScale = 0;
+
+    EXPECT_FALSE ( hdr->getOptWindowScale ( wScale ) );
+    EXPECT_FALSE ( hdr->getOptSAckPermitted() );
+    EXPECT_EQ ( 0xFFFF, hdr->getWindow() );
+}
+
+TEST_F ( TcpTerminatorTest, CongestionWindow )
+{
+    connect ( true, true );
+
+    ASSERT_TRUE ( term->getCongestionControl() != 0 );
+
+    const uint32_t cwnd = term->getCongestionControl()->getCwnd();
+
+    // Without window scaling this would be limited to 64K.
+    sendData ( 100 * 1000 );
+
+    // Only the initial window should be sent:
+    EXPECT_EQ ( cwnd / Mss, term->sentPackets.size() );
+
+    // Every ACK should allow more data to be sent (slow start):
+
+    const size_t numSent = term->sentPackets.size();
+
+    term->sentPackets.clear();
+
+    clientSend ( TcpPacket::FlagAck, serverSeq + numSent * Mss, 0xFFFF );
+
+    EXPECT_GT ( term->getCongestionControl()->getCwnd(), cwnd );
+    EXPECT_EQ ( term->getCongestionControl()->getCwnd() / Mss, term->sentPackets.size() );
+    EXPECT_EQ ( numSent * Mss, getSentSeq ( 0 ) );
+}
+
+TEST_F ( TcpTerminatorTest, Rto )
+{
+    connect ( true, true );
+
+    // Before measuring the RTT, the initial RTO should be used.
+    EXPECT_EQ ( 1000U, term->getRto() );
+
+    sendData ( 5 * Mss );
+
+    ASSERT_EQ ( 5U, term->sentPackets.size() );
+
+    const uint32_t cwnd = term->getCongestionControl()->getCwnd();
+
+    term->sentPackets.clear();
+
+    // The timer expires - only the first segment should be re-transmitted, and the timeout should be doubled:
+    term->expireTimer();
+
+    ASSERT_EQ ( 1U, term->sentPackets.size() );
+    EXPECT_EQ ( 0U, getSentSeq ( 0 ) );
+    EXPECT_EQ ( 2000U, term->getRto() );
+    EXPECT_EQ ( Mss, term->getCongestionControl()->getCwnd() );
+    EXPECT_LT ( term->getCongestionControl()->getSsThresh(), cwnd );
+
+    term->sentPackets.clear();
+
+    // The first segment is acknowledged; Slow start lets us re-transmit two more segments.
+
+    clientSend ( TcpPacket::FlagAck, serverSeq + Mss, 0xFFFF );
+
+    ASSERT_EQ ( 2U, term->sentPackets.size() );
+    EXPECT_EQ ( Mss, getSentSeq ( 0 ) );
+    EXPECT_EQ ( 2U * Mss, getSentSeq ( 1 ) );
+
+    // The backoff is cleared, but the re-transmitted segment was not used for RTT measurement.
+    EXPECT_EQ ( 1000U, term->getRto() );
+}
+
+TEST_F ( TcpTerminatorTest, RttMeasurement )
+{
+    connect ( true, true );
+
+    sendData ( Mss );
+
+    ASSERT_EQ ( 1U, term->sentPackets.size() );
+
+    clientSend ( TcpPacket::FlagAck, serverSeq + Mss, 0xFFFF );
+
+    // We have an RTT measurement now (which is almost 0), so we should be using the min RTO.
+    EXPECT_EQ ( 500U, term->getRto() );
+}
+
+TEST_F ( TcpTerminatorTest, SAckRecovery )
+{
+    connect ( true, true );
+
+    sendData ( 10 * Mss );
+
+    ASSERT_EQ ( 10U, term->sentPackets.size() );
+
+    const uint32_t cwnd = term->getCongestionControl()->getCwnd();
+
+    term->sentPackets.clear();
+
+    // Segments 1 and 3 are lost; The client selectively acknowledges segment 2, and then 4-6.
+    // Nothing should be re-transmitted until 3 segments are selectively acknowledged.
+
+    clientSAck ( serverSeq + Mss, serverSeq + 2 * Mss, serverSeq + 3 * Mss );
+
+    EXPECT_EQ ( 0U, term->sentPackets.size() );
+
+    clientSAck ( serverSeq + Mss, serverSeq + 4 * Mss, serverSeq + 7 * Mss );
+
+    // Now the fast recovery should start.
+    // The window is reduced, and both holes are re-transmitted.
+
+    EXPECT_LT ( term->getCongestionControl()->getCwnd(), cwnd );
+
+    ASSERT_EQ ( 2U, term->sentPackets.size() );
+    EXPECT_EQ ( Mss, getSentSeq ( 0 ) );
+    EXPECT_EQ ( 3U * Mss, getSentSeq ( 1 ) );
+
+    term->sentPackets.clear();
+
+    // More duplicate ACKs should not cause the same data to be re-transmitted.
+
+    clientSAck ( serverSeq + Mss, serverSeq + 4 * Mss, serverSeq + 8 * Mss );
+
+    for ( size_t i = 0; i < term->sentPackets.size(); ++i )
+    {
+        EXPECT_NE ( Mss, getSentSeq ( i ) );
+        EXPECT_NE ( 3U * Mss, getSentSeq ( i ) );
+    }
+
+    // Everything is acknowledged; Recovery should complete.
+
+    const uint32_t ssThresh = term->getCongestionControl()->getSsThresh();
+
+    clientSend ( TcpPacket::FlagAck, serverSeq + 10 * Mss, 0xFFFF );
+
+    EXPECT_EQ ( ssThresh, term->getCongestionControl()->getCwnd() );
+}
+
+TEST_F ( TcpTerminatorTest, NewRenoRecovery )
+{
+    connect ( true, false );
+
+    sendData ( 10 * Mss );
+
+    ASSERT_EQ ( 10U, term->sentPackets.size() );
+
+    term->sentPackets.clear();
+
+    // Segments 1 and 3 are lost. Without SACK, we should re-transmit segment 1 after 3 duplicate ACKs.
+
+    clientSend ( TcpPacket::FlagAck, serverSeq + Mss, 0xFFFF );
+    clientSend ( TcpPacket::FlagAck, serverSeq + Mss, 0xFFFF );
+    clientSend ( TcpPacket::FlagAck, serverSeq + Mss, 0xFFFF );
+
+    EXPECT_EQ ( 0U, term->sentPackets.size() );
+
+    clientSend ( TcpPacket::FlagAck, serverSeq + Mss, 0xFFFF );
+
+    ASSERT_LE ( 1U, term->sentPackets.size() );
+    EXPECT_EQ ( Mss, getSentSeq ( 0 ) );
+
+    term->sentPackets.clear();
+
+    // Partial ACK - the next hole should be re-transmitted right away.
+
+    clientSend ( TcpPacket::FlagAck, serverSeq + 3 * Mss, 0xFFFF );
+
+    ASSERT_LE ( 1U, term->sentPackets.size() );
+    EXPECT_EQ ( 3U * Mss, getSentSeq ( 0 ) );
+}
@@ -0,0 +1,356 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+
+#include "basic/Buffer.hpp"
+#include "prometheus/BasicPrometheusCounter.hpp"
+#include "prometheus/BasicPrometheusGauge.hpp"
+#include "prometheus/PrometheusHistogram.hpp"
+#include "prometheus/internal/PrometheusShardedValues.hpp"
+
+using namespace Pravala;
+
+/// @brief The number of threads used by the tests.
+/// It is greater than the number of shards, so some of the threads share them.
+#define TEST_THREADS       12
+
+/// @brief The number of updates performed by each thread.
+#define TEST_UPDATES       20000
+
+/// @brief The number of values used by the tests.
+/// It is greater than the number of values that fit in a single cache line.
+#define TEST_VALUES        11
+
+/// @brief Exposes the value of BasicPrometheusCounter.
+class TestCounter: public BasicPrometheusCounter
+{
+    public:
+        /// @brief Constructor.
+        /// @param [in] name The name of the metric.
+        /// @param [in] sharded Whether the value should be sharded.
+        TestCounter ( const char * name, bool sharded ):
+            BasicPrometheusCounter ( PrometheusMetric::TimeSet, name, "", sharded )
+        {
+        }
+
+        /// @brief Returns the value of the counter.
+        /// @return The value of the counter.
+        inline uint64_t get()
+        {
+            return getValue();
+        }
+
+        /// @brief Returns the timestamp of the counter.
+        /// @return The timestamp of the counter.
+        inline uint64_t getTime()
+        {
+            return getTimestamp();
+        }
+};
+
+/// @brief Exposes the value of BasicPrometheusGauge.
+class TestGauge: public BasicPrometheusGauge
+{
+    public:
+        /// @brief Constructor.
+        /// @param [in] name The name of the metric.
+        /// @param [in] sharded Whether the value should be sharded.
+        TestGauge ( const char * name, bool sharded ):
+            BasicPrometheusGauge ( PrometheusMetric::TimeCurrent, name, "", sharded )
+        {
+        }
+
+        /// @brief Returns the value of the gauge.
+        /// @return The value of the gauge.
+        inline int64_t get()
+        {
+            return getValue();
+        }
+};
+
+/// @brief Exposes the data of PrometheusHistogram.
+class TestHistogram: public PrometheusHistogram
+{
+    public:
+        /// @brief Constructor.
+        /// @param [in] name The name of the metric.
+        /// @param [in] numBuckets The number of buckets.
+        /// @param [in] upperBounds The upper bounds of the buckets.
+        /// @param [in] sharded Whether the values should be sharded.
+        TestHistogram ( const char * name, size_t numBuckets, const int64_t upperBounds[], bool sharded ):
+            PrometheusHistogram ( name, numBuckets, upperBounds, "", sharded )
+        {
+        }
+
+        /// @brief Returns the text exposition of the histogram.
+        /// @return The text exposition of the histogram.
+        inline String getData()
+        {
+            Buffer buf;
+
+            appendData ( buf, "h", 0 );
+
+            return buf.toString();
+        }
+};
+
+/// @brief The upper bounds of the histogram buckets used by the tests.
+static const int64_t upperBounds[] = { 0, 10, 100 };
+
+/// @brief The number of histogram buckets used by the tests.
+#define TEST_BUCKETS       ( sizeof ( upperBounds ) / sizeof ( upperBounds[ 0 ] ) )
+
+class PrometheusShardedValuesTest: public ::testing::TestWithParam<bool>
+{
+    protected:
+        /// @brief Runs the function in TEST_THREADS threads (at the same time), and waits for them to finish.
+        /// @param [in] func The function to run.
+        /// @param [in] arg The argument to pass to the function.
+        static void runThreads ( void * ( *func )( void * ), void * arg )
+        {
+            pthread_t threads[ TEST_THREADS ];
+
+            for ( size_t i = 0; i < TEST_THREADS; ++i )
+            {
+                ASSERT_EQ ( 0, pthread_create ( &threads[ i ], 0, func, arg ) );
+            }
+
+            for ( size_t i = 0; i < TEST_THREADS; ++i )
+            {
+                ASSERT_EQ ( 0, pthread_join ( threads[ i ], 0 ) );
+            }
+        }
+
+        /// @brief Thread function that updates all the values.
+        /// Each value 'i' is incremented by 'i + 1', and then decremented by 1, TEST_UPDATES times.
+        /// @param [in] arg A pointer to PrometheusShardedValues.
+        /// @return Always 0.
+        static void * updateValues ( void * arg )
+        {
+            PrometheusShardedValues * const values = ( PrometheusShardedValues * ) arg;
+
+            for ( size_t i = 0; i < TEST_UPDATES; ++i )
+            {
+                for ( size_t v = 0; v < TEST_VALUES; ++v )
+                {
+                    values->add ( v, v + 1 );
+                    values->add ( v, ( uint64_t ) -1 );
+                }
+            }
+
+            return 0;
+        }
+
+        /// @brief Thread function that increments a counter.
+        /// @param [in] arg A pointer to TestCounter.
+        /// @return Always 0.
+        static void * incrementCounter ( void * arg )
+        {
+            for ( size_t i = 0; i < TEST_UPDATES; ++i )
+            {
+                ( ( TestCounter * ) arg )->increment ( 2 );
+            }
+
+            return 0;
+        }
+
+        /// @brief Thread function that modifies a gauge.
+        /// @param [in] arg A pointer to TestGauge.
+        /// @return Always 0.
+        static void * modifyGauge ( void * arg )
+        {
+            for ( size_t i = 0; i < TEST_UPDATES; ++i )
+            {
+                ( ( TestGauge * ) arg )->increment ( 3 );
+                ( ( TestGauge * ) arg )->decrement ( 5 );
+            }
+
+            return 0;
+        }
+
+        /// @brief The state shared by threads that set a gauge.
+        struct SetGaugeState
+        {
+            TestGauge & gauge; ///< The gauge to set.
+            volatile uint32_t nextThread; ///< The index of the next thread (starting at 1). Modified atomically.
+            volatile uint32_t numInvalid; ///< The number of invalid values read. Modified atomically.
+
+            /// @brief Constructor.
+            /// @param [in] g The gauge to set.
+            SetGaugeState ( TestGauge & g ): gauge ( g ), nextThread ( 0 ), numInvalid ( 0 )
+            {
+            }
+        };
+
+        /// @brief Checks whether the value could have been set by one of the threads running setGauge().
+        /// @param [in] value The value to check.
+        /// @return True if the value is 0, or a value set by one of the threads; False otherwise.
+        static bool isValidSetValue ( int64_t value )
+        {
+            return ( value >= 0 && value <= TEST_THREADS * 1000 && value % 1000 == 0 );
+        }
+
+        /// @brief Thread function that sets a gauge to a value specific to the thread (1000 times its index),
+        /// and verifies that the gauge only ever has values set by one of the threads.
+        /// @param [in] arg A pointer to SetGaugeState.
+        /// @return Always 0.
+        static void * setGauge ( void * arg )
+        {
+            SetGaugeState * const state = ( SetGaugeState * ) arg;
+            const int64_t value = __sync_add_and_fetch ( &state->nextThread, 1 ) * 1000;
+
+            for ( size_t i = 0; i < TEST_UPDATES; ++i )
+            {
+                state->gauge.set ( value );
+
+                if ( !isValidSetValue ( state->gauge.get() ) )
+                {
+                    __sync_add_and_fetch ( &state->numInvalid, 1 );
+                }
+            }
+
+            return 0;
+        }
+
+        /// @brief Thread function that observes values using a histogram.
+        /// Values from -1 to 998 are observed (in that order), so each thread puts 2 values in the first bucket,
+        /// 10, 90 and 898 values in the remaining ones. The sum of all values observed is 498500.
+        /// @param [in] arg A pointer to TestHistogram.
+        /// @return Always 0.
+        static void * observeHistogram ( void * arg )
+        {
+            for ( int64_t i = 0; i < 1000; ++i )
+            {
+                ( ( TestHistogram * ) arg )->observe ( i - 1 );
+            }
+
+            return 0;
+        }
+};
+
+TEST_P ( PrometheusShardedValuesTest, Values )
+{
+    PrometheusShardedValues values ( TEST_VALUES, GetParam() );
+
+    EXPECT_EQ ( ( size_t ) TEST_VALUES, values.getNumValues() );
+    EXPECT_EQ ( GetParam() ? PrometheusShardedValues::MaxShards : 1U, values.getNumShards() );
+
+    for ( size_t v = 0; v < TEST_VALUES; ++v )
+    {
+        EXPECT_EQ ( 0U, values.get ( v ) );
+    }
+
+    runThreads ( updateValues, &values );
+
+    for ( size_t v = 0; v < TEST_VALUES; ++v )
+    {
+        EXPECT_EQ ( ( uint64_t ) TEST_THREADS * TEST_UPDATES * v, values.get ( v ) );
+    }
+
+    // Signed values (two's complement):
+    values.add ( 0, ( uint64_t ) -5 );
+
+    EXPECT_EQ ( -5, ( int64_t ) values.get ( 0 ) );
+
+    values.reset();
+
+    for ( size_t v = 0; v < TEST_VALUES; ++v )
+    {
+        EXPECT_EQ ( 0U, values.get ( v ) );
+    }
+}
+
+TEST_P ( PrometheusShardedValuesTest, Counter )
+{
+    TestCounter counter ( GetParam() ? "test_sharded_counter" : "test_counter", GetParam() );
+
+    EXPECT_EQ ( 0U, counter.get() );
+    EXPECT_EQ ( 0U, counter.getTime() );
+
+    runThreads ( incrementCounter, &counter );
+
+    EXPECT_EQ ( ( uint64_t ) TEST_THREADS * TEST_UPDATES * 2, counter.get() );
+
+    // The counter uses TimeSet mode, so it sets the timestamp:
+    const uint64_t timestamp = counter.getTime();
+
+    EXPECT_GT ( timestamp, 0U );
+
+    counter.reset();
+
+    EXPECT_EQ ( 0U, counter.get() );
+    EXPECT_GE ( counter.getTime(), timestamp );
+}
+
+TEST_P ( PrometheusShardedValuesTest, Gauge )
+{
+    TestGauge gauge ( GetParam() ? "test_sharded_gauge" : "test_gauge", GetParam() );
+
+    EXPECT_EQ ( 0, gauge.get() );
+
+    runThreads ( modifyGauge, &gauge );
+
+    EXPECT_EQ ( -2 * TEST_THREADS * TEST_UPDATES, gauge.get() );
+
+    gauge.set ( 7 );
+
+    EXPECT_EQ ( 7, gauge.get() );
+}
+
+TEST_P ( PrometheusShardedValuesTest, GaugeConcurrentSet )
+{
+    if ( GetParam() )
+    {
+        // Only one thread at a time may set a sharded gauge.
+        return;
+    }
+
+    TestGauge gauge ( "test_gauge_set", false );
+    SetGaugeState state ( gauge );
+
+    runThreads ( setGauge, &state );
+
+    EXPECT_EQ ( 0U, state.numInvalid );
+    EXPECT_NE ( 0, gauge.get() );
+    EXPECT_TRUE ( isValidSetValue ( gauge.get() ) );
+}
+
+TEST_P ( PrometheusShardedValuesTest, Histogram )
+{
+    TestHistogram histogram (
+        GetParam() ? "test_sharded_histogram" : "test_histogram", TEST_BUCKETS, upperBounds, GetParam() );
+
+    runThreads ( observeHistogram, &histogram );
+
+    EXPECT_EQ ( ( uint64_t ) TEST_THREADS * 1000, histogram.getTotalCount() );
+    EXPECT_EQ ( ( int64_t ) TEST_THREADS * 498500, histogram.getSum() );
+
+    String expected;
+
+    expected.append ( String ( "h_bucket{le=\"0\"} %1\n" ).arg ( TEST_THREADS * 2 ) );
+    expected.append ( String ( "h_bucket{le=\"10\"} %1\n" ).arg ( TEST_THREADS * 12 ) );
+    expected.append ( String ( "h_bucket{le=\"100\"} %1\n" ).arg ( TEST_THREADS * 102 ) );
+    expected.append ( String ( "h_bucket{le=\"+Inf\"} %1\n" ).arg ( TEST_THREADS * 1000 ) );
+    expected.append ( String ( "h_sum %1\n" ).arg ( TEST_THREADS * 498500 ) );
+    expected.append ( String ( "h_count %1\n" ).arg ( TEST_THREADS * 1000 ) );
+
+    EXPECT_STREQ ( expected.c_str(), histogram.getData().c_str() );
+}
+
+INSTANTIATE_TEST_CASE_P ( Sharding, PrometheusShardedValuesTest, ::testing::Bool() );
@@ -0,0 +1,285 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+extern "C"
+{
+#include <pthread.h>
+#include <unistd.h>
+}
+
+#include "log/LogManager.hpp"
+#include "log/TextLog.hpp"
+#include "serverApp/ServerApp.hpp"
+
+using namespace Pravala;
+
+/// @brief The max number of reactors used by the tests.
+#define MAX_REACTORS     4
+
+/// @brief The number of messages logged by each thread in the logging test.
+#define LOG_MESSAGES     500
+
+/// @brief The log stream used by the tests.
+static TextLog _log ( "server_app_test" );
+
+/// @brief A ServerApp that records reactor callbacks.
+class TestServerApp: public ServerApp
+{
+    public:
+        /// @brief The index of the reactor whose reactorStarted() should fail; -1 to never fail.
+        int failIndex;
+
+        volatile uint32_t numStarted; ///< The number of reactorStarted() calls.
+        volatile uint32_t numStopping; ///< The number of reactorStopping() calls.
+        volatile uint32_t numValid; ///< The number of reactorStarted() calls with a valid reactor environment.
+
+        pthread_t threads[ MAX_REACTORS ]; ///< Threads on which reactors were started.
+
+        /// @brief Constructor.
+        /// @param [in] argc The number of elements in argv array.
+        /// @param [in] argv Command line arguments.
+        TestServerApp ( int argc, char * argv[] ):
+            ServerApp ( argc, argv, 0 ), failIndex ( -1 ), numStarted ( 0 ), numStopping ( 0 ), numValid ( 0 )
+        {
+            memset ( threads, 0, sizeof ( threads ) );
+        }
+
+        /// @brief Destructor.
+        ~TestServerApp()
+        {
+            stopReactors();
+        }
+
+    protected:
+        virtual ERRCODE reactorStarted ( ServerReactor & reactor )
+        {
+            __sync_add_and_fetch ( &numStarted, 1 );
+
+            if ( reactor.getIndex() < MAX_REACTORS )
+            {
+                threads[ reactor.getIndex() ] = pthread_self();
+            }
+
+            if ( EventManager::isInitialized() && reactor.getQueue() != 0 && !reactor.isRunning() )
+            {
+                __sync_add_and_fetch ( &numValid, 1 );
+            }
+
+            return ( reactor.getIndex() == failIndex ) ? Error::InvalidData : Error::Success;
+        }
+
+        virtual void reactorStopping ( ServerReactor & reactor )
+        {
+            if ( !reactor.isRunning() )
+            {
+                __sync_add_and_fetch ( &numStopping, 1 );
+            }
+        }
+};
+
+/// @brief A task that increments a counter, optionally logging some messages first.
+class CountTask: public AsyncQueue::Task
+{
+    public:
+        /// @brief Constructor.
+        /// @param [in] counter The counter to increment.
+        /// @param [in] numLogs The number of messages to log.
+        CountTask ( volatile uint32_t & counter, uint32_t numLogs = 0 ):
+            AsyncQueue::Task ( 0 ), _counter ( counter ), _numLogs ( numLogs )
+        {
+        }
+
+    protected:
+        virtual void runTask()
+        {
+            for ( uint32_t i = 0; i < _numLogs; ++i )
+            {
+                LOG ( L_DEBUG, "Reactor message " << i );
+            }
+
+            if ( EventManager::isInitialized() )
+            {
+                __sync_add_and_fetch ( &_counter, 1 );
+            }
+        }
+
+    private:
+        volatile uint32_t & _counter; ///< The counter to increment.
+        const uint32_t _numLogs; ///< The number of messages to log.
+};
+
+/// @brief A text log output that is not thread-safe on its own.
+class TestLogOutput: public TextLogOutput
+{
+    public:
+        StringList messages; ///< The content of messages received.
+
+    protected:
+        virtual void sendTextLog ( Log::TextMessage & logMessage, String & )
+        {
+            messages.append ( logMessage.getContent() );
+        }
+};
+
+class ServerReactorTest: public ::testing::Test
+{
+    protected:
+        /// @brief Waits for the value to reach the expected value.
+        /// @param [in] value The value to check.
+        /// @param [in] expected The expected value.
+        /// @return True if the value reached the expected value; False if it didn't happen within 10 seconds.
+        static bool waitFor ( volatile uint32_t & value, uint32_t expected )
+        {
+            for ( int i = 0; i < 10000 && value < expected; ++i )
+            {
+                usleep ( 1000 );
+            }
+
+            return ( value == expected );
+        }
+
+        /// @brief Program arguments.
+        /// @return Program arguments.
+        static char ** getArgv()
+        {
+            static char progName[] = "ServerReactorTest";
+            static char * argv[] = { progName, 0 };
+
+            return argv;
+        }
+};
+
+TEST_F ( ServerReactorTest, StartStop )
+{
+    TestServerApp app ( 1, getArgv() );
+
+    ASSERT_TRUE ( IS_OK ( app.startReactors ( MAX_REACTORS ) ) );
+
+    EXPECT_EQ ( MAX_REACTORS, app.getNumReactors() );
+    EXPECT_EQ ( ( uint32_t ) MAX_REACTORS, app.numStarted );
+    EXPECT_EQ ( ( uint32_t ) MAX_REACTORS, app.numValid );
+    EXPECT_TRUE ( app.startReactors ( 1 ) == Error::AlreadyInitialized );
+
+    for ( uint16_t i = 0; i < MAX_REACTORS; ++i )
+    {
+        ASSERT_TRUE ( app.getReactor ( i ) != 0 );
+        EXPECT_TRUE ( app.getReactor ( i )->isRunning() );
+        EXPECT_EQ ( i, app.getReactor ( i )->getIndex() );
+        EXPECT_FALSE ( pthread_equal ( app.threads[ i ], pthread_self() ) );
+
+        for ( uint16_t j = 0; j < i; ++j )
+        {
+            EXPECT_FALSE ( pthread_equal ( app.threads[ i ], app.threads[ j ] ) );
+        }
+    }
+
+    EXPECT_TRUE ( app.getReactor ( MAX_REACTORS ) == 0 );
+
+    volatile uint32_t counter = 0;
+
+    for ( uint16_t i = 0; i < MAX_REACTORS; ++i )
+    {
+        for ( int j = 0; j < 100; ++j )
+        {
+            ASSERT_TRUE ( IS_OK ( app.runReactorTask ( i, new CountTask ( counter ) ) ) );
+        }
+    }
+
+    EXPECT_TRUE ( waitFor ( counter, MAX_REACTORS * 100 ) );
+
+    app.stopReactors();
+
+    EXPECT_EQ ( 0, app.getNumReactors() );
+    EXPECT_EQ ( ( uint32_t ) MAX_REACTORS, app.numStopping );
+    EXPECT_TRUE ( app.runReactorTask ( 0, new CountTask ( counter ) ) == Error::NotFound );
+
+    // Stopping again doesn't do anything:
+    app.stopReactors();
+
+    EXPECT_EQ ( ( uint32_t ) MAX_REACTORS, app.numStopping );
+}
+
+TEST_F ( ServerReactorTest, Restart )
+{
+    TestServerApp app ( 1, getArgv() );
+
+    // Stop requests sent right after the start have to be noticed too:
+    for ( uint32_t i = 1; i <= 20; ++i )
+    {
+        ASSERT_TRUE ( IS_OK ( app.startReactors ( 2 ) ) );
+
+        app.stopReactors();
+
+        EXPECT_EQ ( 2 * i, app.numStarted );
+        EXPECT_EQ ( 2 * i, app.numStopping );
+    }
+
+    EXPECT_TRUE ( IS_OK ( app.startReactors ( 0 ) ) );
+    EXPECT_EQ ( 0, app.getNumReactors() );
+}
+
+TEST_F ( ServerReactorTest, StartFailure )
+{
+    TestServerApp app ( 1, getArgv() );
+
+    app.failIndex = 2;
+
+    EXPECT_TRUE ( app.startReactors ( MAX_REACTORS ) == Error::InvalidData );
+
+    EXPECT_EQ ( 0, app.getNumReactors() );
+
+    // Reactors are started one at a time, so the last one was never started.
+    // All the ones that were started (including the one that failed) are stopped.
+    EXPECT_EQ ( 3U, app.numStarted );
+    EXPECT_EQ ( 3U, app.numStopping );
+
+    // They can be started again:
+    app.failIndex = -1;
+
+    EXPECT_TRUE ( IS_OK ( app.startReactors ( MAX_REACTORS ) ) );
+    EXPECT_EQ ( MAX_REACTORS, app.getNumReactors() );
+}
+
+TEST_F ( ServerReactorTest, Logging )
+{
+    TestServerApp app ( 1, getArgv() );
+    TestLogOutput output;
+
+    ASSERT_TRUE ( LogManager::get().subscribe ( "server_app_test", L_DEBUG, &output ) );
+    ASSERT_TRUE ( IS_OK ( app.startReactors ( MAX_REACTORS ) ) );
+
+    volatile uint32_t counter = 0;
+
+    for ( uint16_t i = 0; i < MAX_REACTORS; ++i )
+    {
+        ASSERT_TRUE ( IS_OK ( app.runReactorTask ( i, new CountTask ( counter, LOG_MESSAGES ) ) ) );
+    }
+
+    for ( uint32_t i = 0; i < LOG_MESSAGES; ++i )
+    {
+        LOG ( L_DEBUG, "Main thread message " << i );
+    }
+
+    EXPECT_TRUE ( waitFor ( counter, MAX_REACTORS ) );
+
+    app.stopReactors();
+
+    LogManager::get().unsubscribe ( &output );
+
+    EXPECT_EQ ( ( size_t ) ( MAX_REACTORS + 1 ) * LOG_MESSAGES, output.messages.size() );
+}
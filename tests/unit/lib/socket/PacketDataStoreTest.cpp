@@ -0,0 +1,277 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+extern "C"
+{
+#include <pthread.h>
+#include <sys/socket.h>
+#include <unistd.h>
+}
+
+#include "basic/Thread.hpp"
+#include "event/Timer.hpp"
+#include "socket/PacketDataStore.hpp"
+#include "socket/PacketWriter.hpp"
+
+using namespace Pravala;
+
+/// @brief The number of threads used by the thread cache tests.
+#define TEST_THREADS    4
+
+/// @brief The number of packets each thread gets in the thread cache tests.
+#define TEST_PACKETS    2000
+
+class PacketDataStoreTest: public ::testing::Test, public Timer::Receiver
+{
+    public:
+        PacketDataStoreTest(): _timer ( *this, 20 )
+        {
+        }
+
+    protected:
+        FixedTimer _timer; ///< Stops the event loop.
+
+        /// @brief Runs the event loop for a short while.
+        void runLoop()
+        {
+            _timer.start();
+
+            EventManager::run();
+
+            _timer.stop();
+        }
+
+        virtual void timerExpired ( Timer * )
+        {
+            EventManager::stop();
+        }
+
+        virtual void SetUp()
+        {
+            PacketDataStore::init();
+        }
+
+        virtual void TearDown()
+        {
+            PacketDataStore::disableThreadCache();
+            PacketDataStore::shutdown();
+        }
+
+        /// @brief Thread function that keeps getting and releasing packets using its cache.
+        /// @param [in] arg Unused.
+        /// @return 0 if all the packets were pool-ed and the cache was used; Non-zero otherwise.
+        static void * threadFunc ( void * /*arg*/ )
+        {
+            MemHandle packets[ 16 ];
+            size_t errors = 0;
+
+            PacketDataStore::enableThreadCache();
+
+            for ( size_t i = 0; i < TEST_PACKETS; ++i )
+            {
+                MemHandle & pkt = packets[ i % 16 ];
+
+                pkt = PacketDataStore::getPacket();
+
+                if ( pkt.size() != PacketDataStore::PacketSize || pkt.getMemorySize() < 1 )
+                {
+                    ++errors;
+                }
+            }
+
+#ifndef THREAD_LOCAL_UNSUPPORTED
+            if ( PacketDataStore::optThreadCacheSize.value() > 0 && PacketDataStore::getThreadCacheHits() < 1 )
+            {
+                ++errors;
+            }
+#endif
+
+            for ( size_t i = 0; i < 16; ++i )
+            {
+                packets[ i ].clear();
+            }
+
+            PacketDataStore::disableThreadCache();
+
+            return reinterpret_cast<void *> ( errors );
+        }
+};
+
+TEST_F ( PacketDataStoreTest, NoThreadCache )
+{
+    EXPECT_EQ ( 0U, PacketDataStore::getNumThreadCaches() );
+
+    const size_t misses = PacketDataStore::getMisses();
+
+    MemHandle pkt = PacketDataStore::getPacket();
+
+    EXPECT_EQ ( PacketDataStore::PacketSize, pkt.size() );
+    EXPECT_EQ ( misses, PacketDataStore::getMisses() );
+    EXPECT_EQ ( 0U, PacketDataStore::getThreadCacheHits() );
+    EXPECT_EQ ( 0U, PacketDataStore::getThreadCacheMisses() );
+}
+
+TEST_F ( PacketDataStoreTest, ThreadCache )
+{
+    if ( PacketDataStore::optThreadCacheSize.value() < 1 )
+    {
+        return;
+    }
+
+    PacketDataStore::enableThreadCache();
+
+#ifndef THREAD_LOCAL_UNSUPPORTED
+    EXPECT_EQ ( 1U, PacketDataStore::getNumThreadCaches() );
+
+    // Enabling it again doesn't change anything:
+    PacketDataStore::enableThreadCache();
+
+    EXPECT_EQ ( 1U, PacketDataStore::getNumThreadCaches() );
+
+    const size_t misses = PacketDataStore::getMisses();
+
+    MemHandle pkt = PacketDataStore::getPacket();
+
+    EXPECT_EQ ( PacketDataStore::PacketSize, pkt.size() );
+    EXPECT_EQ ( misses, PacketDataStore::getMisses() );
+    EXPECT_EQ ( 1U, PacketDataStore::getThreadCacheMisses() );
+
+    pkt = PacketDataStore::getPacket();
+
+    EXPECT_EQ ( PacketDataStore::PacketSize, pkt.size() );
+    EXPECT_EQ ( 1U, PacketDataStore::getThreadCacheHits() );
+    EXPECT_EQ ( 1U, PacketDataStore::getThreadCacheMisses() );
+
+    // Small packets use their own cache:
+    MemHandle smallPkt = PacketDataStore::getPacket ( PacketDataStore::SmallPacketSize );
+
+    EXPECT_EQ ( ( size_t ) PacketDataStore::SmallPacketSize, smallPkt.size() );
+    EXPECT_EQ ( misses, PacketDataStore::getMisses() );
+    EXPECT_EQ ( 2U, PacketDataStore::getThreadCacheMisses() );
+
+    pkt.clear();
+    smallPkt.clear();
+#endif
+
+    PacketDataStore::disableThreadCache();
+
+    EXPECT_EQ ( 0U, PacketDataStore::getNumThreadCaches() );
+    EXPECT_EQ ( 0U, PacketDataStore::getThreadCacheHits() );
+    EXPECT_EQ ( 0U, PacketDataStore::getThreadCacheMisses() );
+
+    // Disabling it again doesn't change anything:
+    PacketDataStore::disableThreadCache();
+
+    EXPECT_EQ ( 0U, PacketDataStore::getNumThreadCaches() );
+}
+
+TEST_F ( PacketDataStoreTest, ThreadCacheThreads )
+{
+    const size_t freeBlocks = PacketDataStore::getFreeBlocksCount();
+    const size_t misses = PacketDataStore::getMisses();
+    pthread_t threads[ TEST_THREADS ];
+
+    for ( size_t i = 0; i < TEST_THREADS; ++i )
+    {
+        ASSERT_EQ ( 0, pthread_create ( &threads[ i ], 0, threadFunc, 0 ) );
+    }
+
+    for ( size_t i = 0; i < TEST_THREADS; ++i )
+    {
+        void * ret = 0;
+
+        ASSERT_EQ ( 0, pthread_join ( threads[ i ], &ret ) );
+
+        EXPECT_EQ ( 0U, reinterpret_cast<size_t> ( ret ) );
+    }
+
+    EXPECT_EQ ( 0U, PacketDataStore::getNumThreadCaches() );
+    EXPECT_EQ ( misses, PacketDataStore::getMisses() );
+
+    // All the blocks have been returned by the threads:
+    EXPECT_EQ ( PacketDataStore::getAllocatedBlocksCount(), PacketDataStore::getFreeBlocksCount() );
+    EXPECT_LE ( freeBlocks, PacketDataStore::getFreeBlocksCount() );
+}
+
+TEST_F ( PacketDataStoreTest, WriterThreadCache )
+{
+    if ( PacketDataStore::optThreadCacheSize.value() < 1 )
+    {
+        return;
+    }
+
+#ifndef THREAD_LOCAL_UNSUPPORTED
+    if ( !EventManager::isInitialized() )
+    {
+        ASSERT_TRUE ( IS_OK ( EventManager::init() ) );
+    }
+
+    int fds[ 2 ];
+
+    ASSERT_EQ ( 0, socketpair ( AF_UNIX, SOCK_DGRAM, 0, fds ) );
+
+    const size_t numCaches = PacketDataStore::getNumThreadCaches();
+    const size_t misses = PacketDataStore::getMisses();
+
+    PacketWriter * writer = new PacketWriter ( PacketWriter::SocketWriter, PacketWriter::FlagThreaded, 64 );
+
+    writer->setupFd ( fds[ 0 ] );
+
+    // The writing thread enables its own caches when it starts:
+    for ( int i = 0; i < 10000 && PacketDataStore::getNumThreadCaches() == numCaches; ++i )
+    {
+        usleep ( 1000 );
+    }
+
+    EXPECT_EQ ( numCaches + 1, PacketDataStore::getNumThreadCaches() );
+
+    for ( int i = 0; i < 32; ++i )
+    {
+        MemHandle pkt = PacketDataStore::getPacket ( 100 );
+
+        ASSERT_TRUE ( pkt.getWritable() != 0 );
+
+        memset ( pkt.getWritable(), i, pkt.size() );
+        pkt.truncate ( 100 );
+
+        EXPECT_TRUE ( IS_OK ( writer->write ( pkt ) ) );
+    }
+
+    // The writing thread is woken up at the end of the event loop:
+    runLoop();
+
+    for ( int i = 0; i < 32; ++i )
+    {
+        char data[ 200 ];
+
+        ASSERT_EQ ( 100, ::recv ( fds[ 1 ], data, sizeof ( data ), 0 ) );
+        EXPECT_EQ ( i, data[ 0 ] );
+        EXPECT_EQ ( i, data[ 99 ] );
+    }
+
+    // This stops the thread, which disables its caches (returning the packets it released):
+    delete writer;
+    writer = 0;
+
+    EXPECT_EQ ( numCaches, PacketDataStore::getNumThreadCaches() );
+    EXPECT_EQ ( misses, PacketDataStore::getMisses() );
+
+    ::close ( fds[ 0 ] );
+    ::close ( fds[ 1 ] );
+#endif
+}
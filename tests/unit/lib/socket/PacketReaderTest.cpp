@@ -0,0 +1,296 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+extern "C"
+{
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+}
+
+#include <cstring>
+
+#include "basic/List.hpp"
+#include "log/LogId.hpp"
+#include "socket/PacketMemPool.hpp"
+#include "socket/PacketReader.hpp"
+
+using namespace Pravala;
+
+/// @brief Exposes PacketReader's internals to the tests.
+class TestPacketReader: public PacketReader
+{
+    public:
+        /// @brief Constructor.
+        /// @param [in] maxPackets Maximum number of packets to read at a time.
+        /// @param [in] useGro Whether UDP GRO should be used.
+        TestPacketReader ( uint16_t maxPackets, bool useGro ): PacketReader ( maxPackets, useGro )
+        {
+        }
+
+        /// @brief Returns the number of blocks allocated by reader's memory pool.
+        /// @return The number of blocks allocated by reader's memory pool.
+        inline size_t getPoolBlocks() const
+        {
+            return ( _groPool != 0 ) ? _groPool->getAllocatedBlocksCount() : 0;
+        }
+};
+
+/// @brief A LogId used by the reader.
+class TestLogId: public LogId
+{
+    public:
+        virtual String getLogId ( bool = false ) const
+        {
+            return "PacketReaderTest";
+        }
+};
+
+class PacketReaderTest: public ::testing::Test
+{
+    public:
+        PacketReaderTest(): _recvFd ( -1 ), _sendFd ( -1 )
+        {
+        }
+
+    protected:
+        int _recvFd; ///< The socket the packets are read from.
+        int _sendFd; ///< The socket the packets are sent from.
+        TestLogId _logId; ///< The LogId passed to the reader.
+
+        virtual void SetUp()
+        {
+            struct sockaddr_in addr;
+            socklen_t addrLen = sizeof ( addr );
+
+            memset ( &addr, 0, sizeof ( addr ) );
+
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl ( INADDR_LOOPBACK );
+
+            _recvFd = ::socket ( AF_INET, SOCK_DGRAM, 0 );
+            _sendFd = ::socket ( AF_INET, SOCK_DGRAM, 0 );
+
+            ASSERT_GE ( _recvFd, 0 );
+            ASSERT_GE ( _sendFd, 0 );
+
+            ASSERT_EQ ( 0, ::bind ( _recvFd, ( struct sockaddr * ) &addr, sizeof ( addr ) ) );
+            ASSERT_EQ ( 0, ::getsockname ( _recvFd, ( struct sockaddr * ) &addr, &addrLen ) );
+            ASSERT_EQ ( 0, ::connect ( _sendFd, ( struct sockaddr * ) &addr, sizeof ( addr ) ) );
+            ASSERT_EQ ( 0, ::fcntl ( _recvFd, F_SETFL, ::fcntl ( _recvFd, F_GETFL ) | O_NONBLOCK ) );
+        }
+
+        virtual void TearDown()
+        {
+            ::close ( _recvFd );
+            ::close ( _sendFd );
+        }
+
+        /// @brief Generates test data.
+        /// @param [in] size The size of the data.
+        /// @param [in] seed The value used for generating the data.
+        /// @return Test data.
+        static MemHandle genData ( size_t size, size_t seed )
+        {
+            MemHandle data ( size );
+            char * const w = data.getWritable();
+
+            for ( size_t i = 0; w != 0 && i < size; ++i )
+            {
+                w[ i ] = ( char ) ( ( i * 13 + seed ) % 253 );
+            }
+
+            return data;
+        }
+
+        /// @brief Sends the data as a single UDP message, using UDP GSO.
+        /// @param [in] data The data to send.
+        /// @param [in] segSize The size of individual packets.
+        /// @return True if the data was sent; False if GSO is not supported.
+        bool sendGso ( const MemHandle & data, int segSize )
+        {
+#ifdef UDP_SEGMENT
+            if ( ::setsockopt ( _sendFd, SOL_UDP, UDP_SEGMENT, &segSize, sizeof ( segSize ) ) != 0 )
+            {
+                return false;
+            }
+
+            return ( ::send ( _sendFd, data.get(), data.size(), 0 ) == ( ssize_t ) data.size() );
+#else
+            ( void ) data;
+            ( void ) segSize;
+
+            return false;
+#endif
+        }
+
+        /// @brief Reads all the packets waiting in the socket.
+        /// @param [in] reader The reader to use.
+        /// @param [out] packets The packets read (appended).
+        void readAll ( PacketReader & reader, List<MemHandle> & packets )
+        {
+            uint16_t packetsRead = 0;
+
+            while ( IS_OK ( reader.readPackets ( _recvFd, _logId, packetsRead ) ) )
+            {
+                for ( uint16_t i = 0; i < packetsRead; ++i )
+                {
+                    MemHandle data;
+                    SockAddr addr;
+
+                    if ( reader.getPacket ( i, data, addr ) )
+                    {
+                        EXPECT_TRUE ( addr.isIPv4() );
+
+                        packets.append ( data );
+                    }
+                }
+            }
+        }
+};
+
+TEST_F ( PacketReaderTest, NoGro )
+{
+    TestPacketReader reader ( 8, false );
+
+    reader.setupFd ( _recvFd );
+
+    for ( size_t i = 0; i < 20; ++i )
+    {
+        const MemHandle data = genData ( 100 + i, i );
+
+        ASSERT_EQ ( ( ssize_t ) data.size(), ::send ( _sendFd, data.get(), data.size(), 0 ) );
+    }
+
+    List<MemHandle> packets;
+
+    readAll ( reader, packets );
+
+    ASSERT_EQ ( 20U, packets.size() );
+
+    for ( size_t i = 0; i < packets.size(); ++i )
+    {
+        const MemHandle data = genData ( 100 + i, i );
+
+        ASSERT_EQ ( data.size(), packets.at ( i ).size() );
+        EXPECT_EQ ( 0, memcmp ( data.get(), packets.at ( i ).get(), data.size() ) );
+    }
+
+    EXPECT_EQ ( 0U, reader.getPoolBlocks() );
+}
+
+TEST_F ( PacketReaderTest, GroSplit )
+{
+    TestPacketReader reader ( 4, true );
+
+    reader.setupFd ( _recvFd );
+
+    // 9 full packets and a shorter one:
+    const MemHandle data = genData ( 9500, 1 );
+
+    if ( !sendGso ( data, 1000 ) )
+    {
+        // Not supported.
+        return;
+    }
+
+    List<MemHandle> packets;
+
+    readAll ( reader, packets );
+
+    ASSERT_EQ ( 10U, packets.size() );
+
+    for ( size_t i = 0; i < packets.size(); ++i )
+    {
+        const size_t size = ( i < 9 ) ? 1000 : 500;
+
+        ASSERT_EQ ( size, packets.at ( i ).size() );
+        EXPECT_EQ ( 0, memcmp ( data.get ( i * 1000 ), packets.at ( i ).get(), size ) );
+    }
+}
+
+TEST_F ( PacketReaderTest, GroBufferReuse )
+{
+    TestPacketReader reader ( 4, true );
+
+    if ( !reader.UseGro )
+    {
+        return;
+    }
+
+    reader.setupFd ( _recvFd );
+
+    EXPECT_GT ( reader.getPoolBlocks(), 0U );
+
+    size_t numPackets = 0;
+
+    for ( size_t round = 0; round < 200; ++round )
+    {
+        const MemHandle data = genData ( 8 * 1200, round );
+
+        if ( !sendGso ( data, 1200 ) )
+        {
+            // Not supported.
+            return;
+        }
+
+        List<MemHandle> packets;
+
+        readAll ( reader, packets );
+
+        numPackets += packets.size();
+
+        ASSERT_EQ ( 8U, packets.size() );
+
+        for ( size_t i = 0; i < packets.size(); ++i )
+        {
+            ASSERT_EQ ( 1200U, packets.at ( i ).size() );
+            EXPECT_EQ ( 0, memcmp ( data.get ( i * 1200 ), packets.at ( i ).get(), 1200 ) );
+        }
+    }
+
+    EXPECT_EQ ( 200U * 8U, numPackets );
+
+    // Released buffers go back to reader's pool, so it never needs more than a few of them:
+    EXPECT_LE ( reader.getPoolBlocks(), 4U * 4U );
+}
+
+TEST_F ( PacketReaderTest, GroSmallPacket )
+{
+    TestPacketReader reader ( 4, true );
+
+    reader.setupFd ( _recvFd );
+
+    const MemHandle data = genData ( 100, 2 );
+
+    ASSERT_EQ ( ( ssize_t ) data.size(), ::send ( _sendFd, data.get(), data.size(), 0 ) );
+
+    List<MemHandle> packets;
+
+    readAll ( reader, packets );
+
+    ASSERT_EQ ( 1U, packets.size() );
+    ASSERT_EQ ( data.size(), packets.at ( 0 ).size() );
+    EXPECT_EQ ( 0, memcmp ( data.get(), packets.at ( 0 ).get(), data.size() ) );
+
+    // Small packets are copied out of the (big) receive buffer:
+    EXPECT_LT ( packets.at ( 0 ).getMemorySize(), 0xFFFFU );
+}
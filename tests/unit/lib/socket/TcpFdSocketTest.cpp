@@ -0,0 +1,457 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+extern "C"
+{
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+}
+
+#include <cerrno>
+#include <cstring>
+
+#include "basic/Buffer.hpp"
+#include "basic/List.hpp"
+#include "basic/Math.hpp"
+#include "basic/MemVector.hpp"
+#include "config/ConfigCore.hpp"
+#include "event/EventManager.hpp"
+#include "event/Timer.hpp"
+#include "socket/TcpFdSocket.hpp"
+
+using namespace Pravala;
+
+/// @brief Exposes TcpFdSocket's internals to the tests.
+class TestTcpFdSocket: public TcpFdSocket
+{
+    public:
+        /// @brief Constructor.
+        /// @param [in] owner The initial owner to set.
+        /// @param [in] sockFd The already connected socket FD to use.
+        TestTcpFdSocket ( SocketOwner * owner, int sockFd ):
+            TcpFdSocket ( owner, sockFd, EmptySockAddress, EmptySockAddress )
+        {
+        }
+
+        /// @brief Returns the number of zero-copy sends that have not been completed yet.
+        /// @return The number of zero-copy sends that have not been completed yet.
+        inline size_t getZeroCopyPending() const
+        {
+            return _zeroCopyPending.size();
+        }
+
+        /// @brief Checks whether zero-copy mode has been enabled in this socket.
+        /// @return True if zero-copy mode has been enabled in this socket.
+        inline bool isZeroCopyEnabled() const
+        {
+            return hasFlag ( SockTcpFdFlagZeroCopy );
+        }
+};
+
+class TcpFdSocketTest: public ::testing::Test, public Timer::Receiver, public SocketOwner
+{
+    public:
+        TcpFdSocketTest(): _sock ( 0 ), _peerFd ( -1 ), _sockFd ( -1 ), _expectedSize ( 0 ), _timer ( *this, 20 )
+        {
+        }
+
+    protected:
+        TestTcpFdSocket * _sock; ///< The socket being tested.
+        int _peerFd; ///< The other end of the connection (a regular, blocking socket).
+        int _sockFd; ///< The file descriptor used by the socket being tested.
+        Buffer _received; ///< The data received by the socket being tested.
+        List<MemHandle> _receivedChunks; ///< The chunks of data in the order they were received.
+        size_t _expectedSize; ///< The amount of received data after which the event loop is stopped.
+        FixedTimer _timer; ///< Stops the event loop.
+
+        virtual void SetUp()
+        {
+            if ( !EventManager::isInitialized() )
+            {
+                ASSERT_TRUE ( IS_OK ( EventManager::init() ) );
+            }
+
+            const int listenFd = ::socket ( AF_INET, SOCK_STREAM, 0 );
+
+            ASSERT_GE ( listenFd, 0 );
+
+            struct sockaddr_in addr;
+            socklen_t addrLen = sizeof ( addr );
+
+            memset ( &addr, 0, sizeof ( addr ) );
+
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl ( INADDR_LOOPBACK );
+
+            ASSERT_EQ ( 0, ::bind ( listenFd, ( struct sockaddr * ) &addr, sizeof ( addr ) ) );
+            ASSERT_EQ ( 0, ::listen ( listenFd, 1 ) );
+            ASSERT_EQ ( 0, ::getsockname ( listenFd, ( struct sockaddr * ) &addr, &addrLen ) );
+
+            _sockFd = ::socket ( AF_INET, SOCK_STREAM, 0 );
+
+            ASSERT_GE ( _sockFd, 0 );
+            ASSERT_EQ ( 0, ::connect ( _sockFd, ( struct sockaddr * ) &addr, sizeof ( addr ) ) );
+
+            _peerFd = ::accept ( listenFd, 0, 0 );
+
+            ::close ( listenFd );
+
+            ASSERT_GE ( _peerFd, 0 );
+            ASSERT_EQ ( 0, ::fcntl ( _sockFd, F_SETFL, ::fcntl ( _sockFd, F_GETFL ) | O_NONBLOCK ) );
+
+            _sock = new TestTcpFdSocket ( this, _sockFd );
+
+            ASSERT_TRUE ( _sock->isValid() );
+        }
+
+        virtual void TearDown()
+        {
+            if ( _sock != 0 )
+            {
+                _sock->unrefOwner ( this );
+                _sock = 0;
+            }
+
+            if ( _peerFd >= 0 )
+            {
+                ::close ( _peerFd );
+                _peerFd = -1;
+            }
+
+            String errorMsg;
+
+            ConfigCore::get().loadConfigData ( "os.tcp.zero_copy_min_size = 0", 0, errorMsg );
+        }
+
+        virtual void timerExpired ( Timer * )
+        {
+            EventManager::stop();
+        }
+
+        virtual void socketDataReceived ( Socket *, MemHandle & data )
+        {
+            _received.appendData ( data.get(), data.size() );
+            _receivedChunks.append ( data );
+
+            data.clear();
+
+            if ( _received.size() >= _expectedSize )
+            {
+                EventManager::stop();
+            }
+        }
+
+        virtual void socketClosed ( Socket *, ERRCODE )
+        {
+        }
+
+        virtual void socketConnected ( Socket * )
+        {
+        }
+
+        virtual void socketConnectFailed ( Socket *, ERRCODE )
+        {
+        }
+
+        virtual void socketReadyToSend ( Socket * )
+        {
+        }
+
+        /// @brief Sends the data from the peer socket, and runs the event loop until it is all received.
+        /// @param [in] data The data to send.
+        void sendFromPeer ( const MemHandle & data )
+        {
+            ASSERT_EQ ( ( ssize_t ) data.size(), ::send ( _peerFd, data.get(), data.size(), 0 ) );
+
+            _expectedSize = _received.size() + data.size();
+
+            for ( int i = 0; i < 100 && _received.size() < _expectedSize; ++i )
+            {
+                runLoop();
+            }
+
+            ASSERT_EQ ( _expectedSize, _received.size() );
+        }
+
+        /// @brief Runs the event loop for a short while.
+        void runLoop()
+        {
+            _timer.start();
+
+            EventManager::run();
+
+            _timer.stop();
+        }
+
+        /// @brief Receives the data from the peer socket.
+        /// @param [in] size The number of bytes to receive.
+        /// @return The data received.
+        MemHandle recvFromPeer ( size_t size )
+        {
+            Buffer buf;
+
+            while ( buf.size() < size )
+            {
+                char * const w = buf.getAppendable ( size - buf.size() );
+
+                const ssize_t ret = ::recv ( _peerFd, w, size - buf.size(), 0 );
+
+                if ( ret <= 0 )
+                {
+                    break;
+                }
+
+                buf.markAppended ( ret );
+            }
+
+            return buf.getHandle();
+        }
+
+        /// @brief Generates test data.
+        /// @param [in] size The size of the data.
+        /// @param [in] seed The value used for generating the data.
+        /// @return Test data.
+        static MemHandle genData ( size_t size, size_t seed )
+        {
+            MemHandle data ( size );
+            char * const w = data.getWritable();
+
+            for ( size_t i = 0; w != 0 && i < size; ++i )
+            {
+                w[ i ] = ( char ) ( ( i * 7 + seed ) % 251 );
+            }
+
+            return data;
+        }
+};
+
+TEST_F ( TcpFdSocketTest, VectoredSend )
+{
+    Buffer expected;
+    MemVector vec;
+
+    // Lots of small chunks, more than a single sendmsg() call can take:
+    for ( size_t i = 0; i < 3000; ++i )
+    {
+        const MemHandle chunk = genData ( 1 + i % 37, i );
+
+        expected.appendData ( chunk.get(), chunk.size() );
+        ASSERT_TRUE ( vec.append ( chunk ) );
+    }
+
+    ASSERT_EQ ( expected.size(), vec.getDataSize() );
+
+    EXPECT_TRUE ( IS_OK ( _sock->send ( vec ) ) );
+
+    // It all should fit in the socket's buffer:
+    EXPECT_TRUE ( vec.isEmpty() );
+    EXPECT_EQ ( 0U, vec.getDataSize() );
+
+    const MemHandle received = recvFromPeer ( expected.size() );
+
+    ASSERT_EQ ( expected.size(), received.size() );
+    EXPECT_EQ ( 0, memcmp ( expected.get(), received.get(), expected.size() ) );
+}
+
+TEST_F ( TcpFdSocketTest, VectoredPartialSend )
+{
+    int sndBuf = 4096;
+
+    ASSERT_EQ ( 0, ::setsockopt ( _sockFd, SOL_SOCKET, SO_SNDBUF, &sndBuf, sizeof ( sndBuf ) ) );
+
+    Buffer expected;
+    MemVector vec;
+
+    for ( size_t i = 0; i < 64; ++i )
+    {
+        const MemHandle chunk = genData ( 16 * 1024, i );
+
+        expected.appendData ( chunk.get(), chunk.size() );
+        ASSERT_TRUE ( vec.append ( chunk ) );
+    }
+
+    ASSERT_TRUE ( IS_OK ( _sock->send ( vec ) ) );
+
+    // The socket's buffer is too small for all of it:
+    ASSERT_FALSE ( vec.isEmpty() );
+    EXPECT_LT ( vec.getDataSize(), expected.size() );
+
+    const size_t sent = expected.size() - vec.getDataSize();
+
+    MemHandle received = recvFromPeer ( sent );
+
+    ASSERT_EQ ( sent, received.size() );
+    EXPECT_EQ ( 0, memcmp ( expected.get(), received.get(), sent ) );
+
+    // The remaining data starts exactly where the sent data ended:
+    Buffer rest;
+
+    for ( size_t i = 0; i < vec.getNumChunks(); ++i )
+    {
+        rest.appendData ( ( const char * ) vec.getChunks()[ i ].iov_base, vec.getChunks()[ i ].iov_len );
+    }
+
+    ASSERT_EQ ( expected.size() - sent, rest.size() );
+    EXPECT_EQ ( 0, memcmp ( expected.get() + sent, rest.get(), rest.size() ) );
+}
+
+TEST_F ( TcpFdSocketTest, ZeroCopySend )
+{
+    String errorMsg;
+
+    ASSERT_TRUE ( IS_OK ( ConfigCore::get().loadConfigData ( "os.tcp.zero_copy_min_size = 4096", 0, errorMsg ) ) );
+
+    const MemHandle expected = genData ( 64 * 1024, 1 );
+    MemHandle data = expected;
+
+    EXPECT_TRUE ( IS_OK ( _sock->send ( data ) ) );
+
+    // It all should fit in the socket's buffer:
+    EXPECT_TRUE ( data.isEmpty() );
+
+    if ( !_sock->isZeroCopyEnabled() )
+    {
+        // Not supported - the data should still be sent the regular way.
+        EXPECT_EQ ( 0U, _sock->getZeroCopyPending() );
+    }
+    else
+    {
+        EXPECT_LE ( _sock->getZeroCopyPending(), 1U );
+    }
+
+    // Small sends never use zero-copy mode:
+    MemHandle small = genData ( 100, 2 );
+
+    EXPECT_TRUE ( IS_OK ( _sock->send ( small ) ) );
+    EXPECT_TRUE ( small.isEmpty() );
+    EXPECT_LE ( _sock->getZeroCopyPending(), 1U );
+
+    MemHandle received = recvFromPeer ( expected.size() );
+
+    ASSERT_EQ ( expected.size(), received.size() );
+    EXPECT_EQ ( 0, memcmp ( expected.get(), received.get(), expected.size() ) );
+
+    received = recvFromPeer ( 100 );
+
+    ASSERT_EQ ( 100U, received.size() );
+    EXPECT_EQ ( 0, memcmp ( genData ( 100, 2 ).get(), received.get(), 100 ) );
+
+    // Closing the socket releases the memory once the completions are received.
+    // This is done by a timer, after the socket itself is gone.
+
+    _sock->unrefOwner ( this );
+    _sock = 0;
+
+    for ( int i = 0; i < 100 && ::fcntl ( _sockFd, F_GETFD ) >= 0; ++i )
+    {
+        runLoop();
+    }
+
+    // The descriptor should be closed by now:
+    EXPECT_LT ( ::fcntl ( _sockFd, F_GETFD ), 0 );
+    EXPECT_EQ ( EBADF, errno );
+
+    // And the peer should see the end of the connection:
+    char buf[ 16 ];
+
+    EXPECT_EQ ( 0, ::recv ( _peerFd, buf, sizeof ( buf ), 0 ) );
+}
+
+TEST_F ( TcpFdSocketTest, ReadBudget )
+{
+    const size_t maxReadSize = 1000;
+    const size_t readBudget = 64 * 1024;
+
+    _sock->setMaxReadSize ( maxReadSize );
+    _sock->setReadBudget ( readBudget );
+
+    // The data is sent before the socket gets a chance to read anything, so it should be read in big chunks:
+    const MemHandle data = genData ( 2 * readBudget, 3 );
+
+    sendFromPeer ( data );
+
+    ASSERT_EQ ( data.size(), _received.size() );
+    EXPECT_EQ ( 0, memcmp ( data.get(), _received.get(), data.size() ) );
+
+    size_t maxChunk = 0;
+
+    for ( size_t i = 0; i < _receivedChunks.size(); ++i )
+    {
+        maxChunk = max ( maxChunk, _receivedChunks.at ( i ).size() );
+
+        EXPECT_LE ( _receivedChunks.at ( i ).size(), readBudget );
+    }
+
+    EXPECT_GT ( maxChunk, maxReadSize );
+}
+
+TEST_F ( TcpFdSocketTest, ReadBudgetSmallTail )
+{
+    const size_t maxReadSize = 1000;
+    const size_t readBudget = 64 * 1024;
+
+    _sock->setMaxReadSize ( maxReadSize );
+    _sock->setReadBudget ( readBudget );
+
+    // A little more than the max read size:
+    const MemHandle data = genData ( maxReadSize + 100, 4 );
+
+    sendFromPeer ( data );
+
+    ASSERT_EQ ( data.size(), _received.size() );
+    EXPECT_EQ ( 0, memcmp ( data.get(), _received.get(), data.size() ) );
+
+    // If the data was read in one event, it should not use the memory of the big buffer:
+    for ( size_t i = 0; i < _receivedChunks.size(); ++i )
+    {
+        EXPECT_LT ( _receivedChunks.at ( i ).getMemorySize(), readBudget );
+    }
+
+    // The socket keeps the big buffer, the next read uses it again (and hands it over this time):
+    const MemHandle bigData = genData ( readBudget, 5 );
+
+    _receivedChunks.clear();
+
+    sendFromPeer ( bigData );
+
+    ASSERT_EQ ( data.size() + bigData.size(), _received.size() );
+    EXPECT_EQ ( 0, memcmp ( bigData.get(), _received.get ( data.size() ), bigData.size() ) );
+}
+
+TEST_F ( TcpFdSocketTest, NoReadBudget )
+{
+    const size_t maxReadSize = 1000;
+
+    _sock->setMaxReadSize ( maxReadSize );
+    _sock->setReadBudget ( 0 );
+
+    const MemHandle data = genData ( 32 * 1024, 6 );
+
+    sendFromPeer ( data );
+
+    ASSERT_EQ ( data.size(), _received.size() );
+    EXPECT_EQ ( 0, memcmp ( data.get(), _received.get(), data.size() ) );
+
+    for ( size_t i = 0; i < _receivedChunks.size(); ++i )
+    {
+        EXPECT_LE ( _receivedChunks.at ( i ).size(), maxReadSize );
+    }
+}
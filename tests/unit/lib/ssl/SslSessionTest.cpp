@@ -0,0 +1,547 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+extern "C"
+{
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <openssl/bio.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+}
+
+#include <cstring>
+
+#include "event/EventManager.hpp"
+#include "event/Timer.hpp"
+#include "ssl/SslContext.hpp"
+#include "ssl/TlsSocket.hpp"
+
+using namespace Pravala;
+
+/// @brief The message the server sends to the client after the handshake.
+#define SERVER_MSG    "hello"
+
+/// @brief Exposes TlsServer's ticket keys to the tests.
+class TestTlsServer: public TlsServer
+{
+    public:
+        /// @brief Makes the current ticket key old enough to be replaced when the next ticket is issued.
+        void expireTicketKey()
+        {
+            MutexLock m ( _sessionMutex );
+
+            _ticketKeys[ 0 ].created -= optTicketKeyLifetime.value();
+        }
+
+        /// @brief Returns the number of sessions in the server's (OpenSSL's) session cache.
+        /// @return The number of sessions in the server's session cache.
+        inline long getNumServerSessions()
+        {
+            return SSL_CTX_sess_number ( getContext() );
+        }
+};
+
+/// @brief Exposes TlsSocket's FD to the tests.
+class TestTlsSocket: public TlsSocket
+{
+    public:
+        /// @brief Constructor.
+        /// @param [in] owner The initial owner to set.
+        /// @param [in] tlsContext The TlsContext to use.
+        /// @param [in] sockFd Socket descriptor of an established TCP connection.
+        TestTlsSocket ( SocketOwner * owner, TlsContext & tlsContext, int sockFd ):
+            TlsSocket ( owner, tlsContext, sockFd )
+        {
+        }
+
+        /// @brief Returns the FD of the underlying TCP connection.
+        /// @return The FD of the underlying TCP connection.
+        inline int getFd() const
+        {
+            return getSslSockFd();
+        }
+};
+
+/// @brief Tests session resumption over TLS connections on the loopback interface.
+/// Both ends of the connections are handled by the event loop of the test.
+class SslSessionTest: public ::testing::Test, public Timer::Receiver, public SocketOwner
+{
+    public:
+        SslSessionTest():
+            _server ( 0 ),
+            _clientSock ( 0 ),
+            _serverSock ( 0 ),
+            _listenFd ( -1 ),
+            _gotData ( false ),
+            _clientResumed ( false ),
+            _clientClosed ( false ),
+            _serverClosed ( false ),
+            _cacheSize ( SslContext::optSessionCacheSize.value() ),
+            _tickets ( SslContext::optSessionTickets.value() ),
+            _timer ( *this, 20 )
+        {
+            memset ( &_listenAddr, 0, sizeof ( _listenAddr ) );
+        }
+
+    protected:
+        TestTlsServer * _server; ///< The server context.
+        TestTlsSocket * _clientSock; ///< The client end of the current connection.
+        TestTlsSocket * _serverSock; ///< The server end of the current connection.
+
+        int _listenFd; ///< The listening socket.
+        struct sockaddr_in _listenAddr; ///< The address of the listening socket.
+
+        bool _gotData; ///< Set when the client receives the message from the server.
+        bool _clientResumed; ///< Whether the client resumed the session of the current connection.
+        bool _clientClosed; ///< Set when the client end of the connection is closed.
+        bool _serverClosed; ///< Set when the server end of the connection is closed.
+
+        const uint32_t _cacheSize; ///< The original size of the session cache.
+        const bool _tickets; ///< The original value of the 'session tickets' option.
+
+        FixedTimer _timer; ///< Stops the event loop.
+
+        virtual void SetUp()
+        {
+            if ( !EventManager::isInitialized() )
+            {
+                ASSERT_TRUE ( IS_OK ( EventManager::init() ) );
+            }
+
+            ASSERT_TRUE ( IS_OK ( SslContext::optSessionCacheSize.setValue ( 16 ) ) );
+
+            _listenFd = ::socket ( AF_INET, SOCK_STREAM, 0 );
+
+            ASSERT_GE ( _listenFd, 0 );
+
+            socklen_t addrLen = sizeof ( _listenAddr );
+
+            _listenAddr.sin_family = AF_INET;
+            _listenAddr.sin_addr.s_addr = htonl ( INADDR_LOOPBACK );
+
+            ASSERT_EQ ( 0, ::bind ( _listenFd, ( struct sockaddr * ) &_listenAddr, sizeof ( _listenAddr ) ) );
+            ASSERT_EQ ( 0, ::listen ( _listenFd, 4 ) );
+            ASSERT_EQ ( 0, ::getsockname ( _listenFd, ( struct sockaddr * ) &_listenAddr, &addrLen ) );
+        }
+
+        virtual void TearDown()
+        {
+            releaseSockets();
+
+            delete _server;
+            _server = 0;
+
+            if ( _listenFd >= 0 )
+            {
+                ::close ( _listenFd );
+                _listenFd = -1;
+            }
+
+            SslContext::optSessionCacheSize.setValue ( _cacheSize );
+            SslContext::optSessionTickets.setValue ( _tickets );
+        }
+
+        /// @brief Creates the server context, using a new self-signed certificate.
+        /// Session resumption options should be configured before calling it.
+        void createServer()
+        {
+            String keyData;
+            String certData;
+
+            ASSERT_TRUE ( genKeyPair ( keyData, certData ) );
+
+            _server = new TestTlsServer();
+
+            ASSERT_TRUE ( IS_OK ( _server->setKeyPairData ( keyData, certData ) ) );
+        }
+
+        /// @brief Generates a private key and a self-signed certificate.
+        /// @param [out] keyData The private key in PEM format.
+        /// @param [out] certData The certificate in PEM format.
+        /// @return True if the key pair has been generated; False otherwise.
+        static bool genKeyPair ( String & keyData, String & certData )
+        {
+            EVP_PKEY * key = 0;
+            EVP_PKEY_CTX * const keyCtx = EVP_PKEY_CTX_new_id ( EVP_PKEY_EC, 0 );
+
+            if ( !keyCtx
+                 || EVP_PKEY_keygen_init ( keyCtx ) != 1
+                 || EVP_PKEY_CTX_set_ec_paramgen_curve_nid ( keyCtx, NID_X9_62_prime256v1 ) != 1
+                 || EVP_PKEY_keygen ( keyCtx, &key ) != 1 )
+            {
+                EVP_PKEY_CTX_free ( keyCtx );
+                return false;
+            }
+
+            EVP_PKEY_CTX_free ( keyCtx );
+
+            X509 * const cert = X509_new();
+            X509_NAME * const name = ( cert != 0 ) ? X509_get_subject_name ( cert ) : 0;
+            BIO * const keyBio = BIO_new ( BIO_s_mem() );
+            BIO * const certBio = BIO_new ( BIO_s_mem() );
+
+            bool ret = ( name != 0 && keyBio != 0 && certBio != 0
+                         && X509_set_version ( cert, 2 ) == 1
+                         && ASN1_INTEGER_set ( X509_get_serialNumber ( cert ), 1 ) == 1
+                         && X509_gmtime_adj ( X509_getm_notBefore ( cert ), -3600 ) != 0
+                         && X509_gmtime_adj ( X509_getm_notAfter ( cert ), 24 * 3600 ) != 0
+                         && X509_set_pubkey ( cert, key ) == 1
+                         && X509_NAME_add_entry_by_txt (
+                             name, "CN", MBSTRING_ASC, ( const unsigned char * ) "localhost", -1, -1, 0 ) == 1
+                         && X509_set_issuer_name ( cert, name ) == 1
+                         && X509_sign ( cert, key, EVP_sha256() ) > 0
+                         && PEM_write_bio_PrivateKey ( keyBio, key, 0, 0, 0, 0, 0 ) == 1
+                         && PEM_write_bio_X509 ( certBio, cert ) == 1 );
+
+            if ( ret )
+            {
+                char * data = 0;
+                long size = BIO_get_mem_data ( keyBio, &data );
+
+                keyData = String ( data, ( int ) size );
+
+                size = BIO_get_mem_data ( certBio, &data );
+
+                certData = String ( data, ( int ) size );
+            }
+
+            BIO_free ( certBio );
+            BIO_free ( keyBio );
+            X509_free ( cert );
+            EVP_PKEY_free ( key );
+
+            return ret;
+        }
+
+        /// @brief Runs the event loop for a short while.
+        void runLoop()
+        {
+            _timer.start();
+
+            EventManager::run();
+
+            _timer.stop();
+        }
+
+        /// @brief Releases both ends of the current connection (if they still exist).
+        void releaseSockets()
+        {
+            if ( _clientSock != 0 )
+            {
+                _clientSock->unrefOwner ( this );
+                _clientSock = 0;
+            }
+
+            if ( _serverSock != 0 )
+            {
+                _serverSock->unrefOwner ( this );
+                _serverSock = 0;
+            }
+        }
+
+        /// @brief Establishes a new TLS connection with the server.
+        /// It waits until the client receives the message the server sends after the handshake,
+        /// so any session tickets sent by the server have been processed by the client too.
+        /// @param [in] client The client context to use.
+        /// @return True if the connection has been established; False otherwise.
+        bool openConnection ( TlsClient & client )
+        {
+            const int clientFd = ::socket ( AF_INET, SOCK_STREAM, 0 );
+
+            if ( clientFd < 0 )
+            {
+                return false;
+            }
+
+            if ( ::connect ( clientFd, ( struct sockaddr * ) &_listenAddr, sizeof ( _listenAddr ) ) != 0 )
+            {
+                ::close ( clientFd );
+                return false;
+            }
+
+            const int serverFd = ::accept ( _listenFd, 0, 0 );
+
+            if ( serverFd < 0 )
+            {
+                ::close ( clientFd );
+                return false;
+            }
+
+            ::fcntl ( clientFd, F_SETFL, ::fcntl ( clientFd, F_GETFL ) | O_NONBLOCK );
+            ::fcntl ( serverFd, F_SETFL, ::fcntl ( serverFd, F_GETFL ) | O_NONBLOCK );
+
+            _gotData = _clientResumed = _clientClosed = _serverClosed = false;
+
+            _clientSock = new TestTlsSocket ( this, client, clientFd );
+            _serverSock = new TestTlsSocket ( this, *_server, serverFd );
+
+            for ( int i = 0; i < 100 && !_gotData && !_clientClosed && !_serverClosed; ++i )
+            {
+                runLoop();
+            }
+
+            return _gotData;
+        }
+
+        /// @brief Closes one end of the current connection, and waits for the other end to notice.
+        /// @param [in] closeServer If true, the server closes the connection; Otherwise the client does.
+        void closeConnection ( bool closeServer )
+        {
+            ASSERT_TRUE ( _clientSock != 0 );
+            ASSERT_TRUE ( _serverSock != 0 );
+
+            if ( closeServer )
+            {
+                _serverSock->close();
+                _serverClosed = true;
+            }
+            else
+            {
+                _clientSock->close();
+                _clientClosed = true;
+            }
+
+            for ( int i = 0; i < 100 && !( _clientClosed && _serverClosed ); ++i )
+            {
+                runLoop();
+            }
+
+            EXPECT_TRUE ( _clientClosed );
+            EXPECT_TRUE ( _serverClosed );
+
+            releaseSockets();
+        }
+
+        /// @brief Truncates the current connection (by shutting down the TCP connection without SSL shutdown).
+        void truncateConnection()
+        {
+            ASSERT_TRUE ( _serverSock != 0 );
+            ASSERT_EQ ( 0, ::shutdown ( _serverSock->getFd(), SHUT_RDWR ) );
+
+            for ( int i = 0; i < 100 && !( _clientClosed && _serverClosed ); ++i )
+            {
+                runLoop();
+            }
+
+            EXPECT_TRUE ( _clientClosed );
+            EXPECT_TRUE ( _serverClosed );
+
+            releaseSockets();
+        }
+
+        virtual void timerExpired ( Timer * )
+        {
+            EventManager::stop();
+        }
+
+        virtual void socketConnected ( Socket * sock )
+        {
+            if ( sock == _clientSock )
+            {
+                _clientResumed = _clientSock->isSessionReused();
+            }
+            else if ( sock == _serverSock )
+            {
+                size_t size = strlen ( SERVER_MSG );
+
+                EXPECT_TRUE ( IS_OK ( _serverSock->send ( SERVER_MSG, size ) ) );
+            }
+        }
+
+        virtual void socketDataReceived ( Socket * sock, MemHandle & data )
+        {
+            if ( sock == _clientSock )
+            {
+                _gotData = true;
+
+                EventManager::stop();
+            }
+
+            data.clear();
+        }
+
+        virtual void socketClosed ( Socket * sock, ERRCODE )
+        {
+            if ( sock == _clientSock )
+            {
+                _clientClosed = true;
+            }
+            else if ( sock == _serverSock )
+            {
+                _serverClosed = true;
+            }
+
+            EventManager::stop();
+        }
+
+        virtual void socketConnectFailed ( Socket * sock, ERRCODE reason )
+        {
+            socketClosed ( sock, reason );
+        }
+
+        virtual void socketReadyToSend ( Socket * )
+        {
+        }
+};
+
+TEST_F ( SslSessionTest, SessionCache )
+{
+    ASSERT_TRUE ( IS_OK ( SslContext::optSessionTickets.setValue ( false ) ) );
+
+    createServer();
+
+    TlsClient client;
+
+    ASSERT_TRUE ( openConnection ( client ) );
+    EXPECT_FALSE ( _clientResumed );
+    EXPECT_EQ ( 1U, client.getNumCachedSessions() );
+    EXPECT_EQ ( 1, _server->getNumServerSessions() );
+
+    closeConnection ( false );
+
+    // The session is resumed, and the cached session is replaced by the new one:
+    ASSERT_TRUE ( openConnection ( client ) );
+    EXPECT_TRUE ( _clientResumed );
+    EXPECT_EQ ( 1U, client.getNumCachedSessions() );
+
+    closeConnection ( true );
+
+    // Closed cleanly by the server, so it can be resumed again:
+    ASSERT_TRUE ( openConnection ( client ) );
+    EXPECT_TRUE ( _clientResumed );
+
+    closeConnection ( false );
+
+    EXPECT_EQ ( 1U, client.getNumFullHandshakes() );
+    EXPECT_EQ ( 2U, client.getNumResumedHandshakes() );
+    EXPECT_EQ ( 1U, _server->getNumFullHandshakes() );
+    EXPECT_EQ ( 2U, _server->getNumResumedHandshakes() );
+
+    client.clearCachedSessions();
+
+    EXPECT_EQ ( 0U, client.getNumCachedSessions() );
+
+    ASSERT_TRUE ( openConnection ( client ) );
+    EXPECT_FALSE ( _clientResumed );
+
+    closeConnection ( false );
+}
+
+TEST_F ( SslSessionTest, TruncatedConnection )
+{
+    ASSERT_TRUE ( IS_OK ( SslContext::optSessionTickets.setValue ( false ) ) );
+
+    createServer();
+
+    TlsClient client;
+
+    ASSERT_TRUE ( openConnection ( client ) );
+    EXPECT_EQ ( 1U, client.getNumCachedSessions() );
+    EXPECT_EQ ( 1, _server->getNumServerSessions() );
+
+    // The connection is closed without SSL shutdown, so neither side should keep the session:
+    truncateConnection();
+
+    EXPECT_EQ ( 0U, client.getNumCachedSessions() );
+    EXPECT_EQ ( 0, _server->getNumServerSessions() );
+
+    ASSERT_TRUE ( openConnection ( client ) );
+    EXPECT_FALSE ( _clientResumed );
+
+    closeConnection ( false );
+
+    EXPECT_EQ ( 2U, _server->getNumFullHandshakes() );
+    EXPECT_EQ ( 0U, _server->getNumResumedHandshakes() );
+}
+
+TEST_F ( SslSessionTest, TicketKeyRotation )
+{
+    ASSERT_TRUE ( IS_OK ( SslContext::optSessionTickets.setValue ( true ) ) );
+
+    createServer();
+
+    // Each client keeps its own ticket:
+    TlsClient clientA;
+    TlsClient clientB;
+    TlsClient clientC;
+    TlsClient clientD;
+
+    // A and C get tickets encrypted using the first key:
+    ASSERT_TRUE ( openConnection ( clientA ) );
+    EXPECT_FALSE ( _clientResumed );
+
+    closeConnection ( false );
+
+    ASSERT_TRUE ( openConnection ( clientC ) );
+    EXPECT_FALSE ( _clientResumed );
+
+    closeConnection ( true );
+
+    // Stateless tickets don't use the server's cache:
+    EXPECT_EQ ( 0, _server->getNumServerSessions() );
+
+    // The ticket for B is encrypted using a new key; the first key is now the previous one:
+    _server->expireTicketKey();
+
+    ASSERT_TRUE ( openConnection ( clientB ) );
+    EXPECT_FALSE ( _clientResumed );
+
+    closeConnection ( false );
+
+    // A's ticket is still accepted (and renewed):
+    ASSERT_TRUE ( openConnection ( clientA ) );
+    EXPECT_TRUE ( _clientResumed );
+
+    closeConnection ( false );
+
+    // Tickets are only issued after resumed handshakes when they need to be renewed, so we need a new client.
+    // Its ticket is encrypted using another new key:
+    _server->expireTicketKey();
+
+    ASSERT_TRUE ( openConnection ( clientD ) );
+    EXPECT_FALSE ( _clientResumed );
+
+    closeConnection ( false );
+
+    // B's ticket is still accepted:
+    ASSERT_TRUE ( openConnection ( clientB ) );
+    EXPECT_TRUE ( _clientResumed );
+
+    closeConnection ( false );
+
+    // The first key is not accepted anymore:
+    ASSERT_TRUE ( openConnection ( clientC ) );
+    EXPECT_FALSE ( _clientResumed );
+
+    closeConnection ( false );
+
+    // A's renewed ticket is encrypted using the previous key, so it is still accepted:
+    ASSERT_TRUE ( openConnection ( clientA ) );
+    EXPECT_TRUE ( _clientResumed );
+
+    closeConnection ( false );
+
+    EXPECT_EQ ( 5U, _server->getNumFullHandshakes() );
+    EXPECT_EQ ( 3U, _server->getNumResumedHandshakes() );
+}
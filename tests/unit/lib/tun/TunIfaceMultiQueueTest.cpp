@@ -0,0 +1,328 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+extern "C"
+{
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <unistd.h>
+}
+
+#include <cstring>
+
+#include "event/Timer.hpp"
+#include "netmgr/NetManager.hpp"
+#include "tun/TunIfaceMultiQueue.hpp"
+
+using namespace Pravala;
+
+/// @brief The number of queues used by the tests.
+#define TEST_QUEUES     4
+
+/// @brief The number of UDP flows (each using a different socket) sent through the tunnel device.
+#define TEST_FLOWS      32
+
+/// @brief The number of packets sent in each flow.
+#define TEST_PACKETS    10
+
+/// @brief The subnet routed through the tunnel device.
+#define TEST_SUBNET     "10.213.7.0"
+
+/// @brief The address of the tunnel device.
+#define TEST_ADDR       "10.213.7.1"
+
+/// @brief The destination of the packets sent through the tunnel device.
+#define TEST_DEST       "10.213.7.2"
+
+/// @brief Tests TunIfaceMultiQueue.
+/// Creating tunnel devices requires privileges, so tests that can't create them don't do anything.
+/// The test object is the owner of all the queues (they only update its counters atomically).
+class TunIfaceMultiQueueTest:
+    public ::testing::Test,
+    public TunIfaceOwner,
+    public TunIfaceQueueHandler,
+    public Timer::Receiver
+{
+    public:
+        TunIfaceMultiQueueTest():
+            _iface ( 0 ),
+            _numStarted ( 0 ),
+            _numStopping ( 0 ),
+            _numOffThread ( 0 ),
+            _numRead ( 0 ),
+            _timer ( *this, 20 )
+        {
+            _mainThread = pthread_self();
+        }
+
+    protected:
+        TunIfaceMultiQueue * _iface; ///< The interface being tested.
+        pthread_t _mainThread; ///< The thread that runs the test.
+
+        volatile uint32_t _numStarted; ///< The number of tunQueueStarted() calls.
+        volatile uint32_t _numStopping; ///< The number of tunQueueStopping() calls.
+        volatile uint32_t _numOffThread; ///< The number of queue callbacks called on threads other than main.
+        volatile uint32_t _numRead; ///< The number of packets read from all the queues.
+
+        FixedTimer _timer; ///< Stops the event loop.
+
+        virtual void SetUp()
+        {
+            if ( !EventManager::isInitialized() )
+            {
+                ASSERT_TRUE ( IS_OK ( EventManager::init() ) );
+            }
+
+            ASSERT_TRUE ( IS_OK ( TunIfaceMultiQueue::optNumQueues.setValue ( TEST_QUEUES ) ) );
+
+            _iface = TunIfaceMultiQueue::generate ( this, this );
+
+            ASSERT_TRUE ( _iface != 0 );
+        }
+
+        virtual void TearDown()
+        {
+            if ( _iface != 0 )
+            {
+                _iface->stop();
+                _iface->unrefOwner ( this );
+                _iface = 0;
+            }
+        }
+
+        /// @brief Starts the interface.
+        /// @return True if the interface has been started; False if tunnel devices cannot be created here.
+        bool startIface()
+        {
+            const ERRCODE eCode = _iface->startManaged();
+
+            if ( NOT_OK ( eCode ) )
+            {
+                fprintf ( stderr, "Could not create a tunnel device (%s); Skipping the test\n", eCode.toString() );
+                return false;
+            }
+
+            return true;
+        }
+
+        /// @brief Runs the event loop for a short while.
+        void runLoop()
+        {
+            _timer.start();
+
+            EventManager::run();
+
+            _timer.stop();
+        }
+
+        /// @brief Sends UDP packets to TEST_DEST, using TEST_FLOWS sockets (and source ports).
+        /// @return The number of packets sent.
+        static uint32_t sendFlows()
+        {
+            struct sockaddr_in addr;
+
+            memset ( &addr, 0, sizeof ( addr ) );
+
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons ( 5000 );
+
+            if ( inet_pton ( AF_INET, TEST_DEST, &addr.sin_addr ) != 1 )
+            {
+                return 0;
+            }
+
+            uint32_t numSent = 0;
+
+            for ( int f = 0; f < TEST_FLOWS; ++f )
+            {
+                const int fd = ::socket ( AF_INET, SOCK_DGRAM, 0 );
+
+                if ( fd < 0 )
+                {
+                    continue;
+                }
+
+                for ( int p = 0; p < TEST_PACKETS; ++p )
+                {
+                    char data[ 100 ];
+
+                    memset ( data, f + p, sizeof ( data ) );
+
+                    if ( ::sendto ( fd, data, sizeof ( data ), 0,
+                                    ( struct sockaddr * ) &addr, sizeof ( addr ) ) == sizeof ( data ) )
+                    {
+                        ++numSent;
+                    }
+                }
+
+                ::close ( fd );
+            }
+
+            return numSent;
+        }
+
+        /// @brief Counts a queue callback, and whether it was called on a different thread.
+        inline void countThread()
+        {
+            if ( !pthread_equal ( pthread_self(), _mainThread ) )
+            {
+                __sync_add_and_fetch ( &_numOffThread, 1 );
+            }
+        }
+
+        virtual TunIfaceOwner * tunQueueStarted ( TunIfaceMultiQueue * iface, uint16_t queueIndex, TunIface * queue )
+        {
+            EXPECT_EQ ( _iface, iface );
+            EXPECT_GT ( queueIndex, 0 );
+            EXPECT_LT ( queueIndex, TEST_QUEUES );
+            EXPECT_TRUE ( queue != 0 );
+
+            __sync_add_and_fetch ( &_numStarted, 1 );
+
+            countThread();
+
+            return this;
+        }
+
+        virtual void tunQueueStopping ( TunIfaceMultiQueue * iface, uint16_t /*queueIndex*/, TunIface * /*queue*/ )
+        {
+            EXPECT_EQ ( _iface, iface );
+
+            __sync_add_and_fetch ( &_numStopping, 1 );
+
+            countThread();
+        }
+
+        virtual void tunIfaceRead ( TunIface * /*iface*/, TunIpPacket & /*packet*/ )
+        {
+            __sync_add_and_fetch ( &_numRead, 1 );
+        }
+
+        virtual void tunIfaceClosed ( TunIface * /*iface*/ )
+        {
+        }
+
+        virtual void timerExpired ( Timer * )
+        {
+            EventManager::stop();
+        }
+};
+
+TEST_F ( TunIfaceMultiQueueTest, StartStop )
+{
+    if ( !startIface() )
+    {
+        return;
+    }
+
+    ASSERT_EQ ( TEST_QUEUES, _iface->getNumQueues() );
+    EXPECT_EQ ( ( uint32_t ) TEST_QUEUES - 1, _numStarted );
+
+    TunIfaceDev::Stats stats;
+
+    for ( uint16_t i = 0; i < TEST_QUEUES; ++i )
+    {
+        EXPECT_TRUE ( _iface->getQueueStats ( i, stats ) );
+    }
+
+    EXPECT_FALSE ( _iface->getQueueStats ( TEST_QUEUES, stats ) );
+
+    _iface->stop();
+
+    EXPECT_EQ ( 0, _iface->getNumQueues() );
+    EXPECT_EQ ( ( uint32_t ) TEST_QUEUES - 1, _numStopping );
+
+    // All the queue callbacks were called on the threads of those queues:
+    EXPECT_EQ ( 2U * ( TEST_QUEUES - 1 ), _numOffThread );
+
+    // Stopping again doesn't do anything:
+    _iface->stop();
+
+    EXPECT_EQ ( ( uint32_t ) TEST_QUEUES - 1, _numStopping );
+}
+
+TEST_F ( TunIfaceMultiQueueTest, Restart )
+{
+    // Queues stopped right after they are started still have to notice the stop request:
+    for ( uint32_t i = 1; i <= 10; ++i )
+    {
+        if ( !startIface() )
+        {
+            return;
+        }
+
+        ASSERT_EQ ( TEST_QUEUES, _iface->getNumQueues() );
+
+        _iface->stop();
+
+        EXPECT_EQ ( i * ( TEST_QUEUES - 1 ), _numStarted );
+        EXPECT_EQ ( i * ( TEST_QUEUES - 1 ), _numStopping );
+    }
+}
+
+TEST_F ( TunIfaceMultiQueueTest, Traffic )
+{
+    if ( !startIface() )
+    {
+        return;
+    }
+
+    if ( NOT_OK ( _iface->addAddress ( TEST_ADDR ) )
+         || NOT_OK ( NetManager::get().addRoute ( TEST_SUBNET, 24, IpAddress(), _iface->getIfaceId() ) ) )
+    {
+        fprintf ( stderr, "Could not configure the tunnel device; Skipping the test\n" );
+        return;
+    }
+
+    const uint32_t numSent = sendFlows();
+
+    ASSERT_GT ( numSent, 0U );
+
+    // The first queue is handled by this thread, so we have to run the event loop:
+    for ( int i = 0; i < 100 && _numRead < numSent; ++i )
+    {
+        runLoop();
+    }
+
+    // Other packets (like IPv6 router solicitations) could be sent through the device too:
+    EXPECT_GE ( _numRead, numSent );
+
+    uint64_t rxPackets = 0;
+    uint16_t usedQueues = 0;
+
+    for ( uint16_t i = 0; i < TEST_QUEUES; ++i )
+    {
+        TunIfaceDev::Stats stats;
+
+        ASSERT_TRUE ( _iface->getQueueStats ( i, stats ) );
+
+        rxPackets += stats.rxPackets;
+
+        if ( stats.rxPackets > 0 )
+        {
+            ++usedQueues;
+        }
+    }
+
+    EXPECT_GE ( rxPackets, ( uint64_t ) numSent );
+
+    // The flows are spread across the queues:
+    EXPECT_GT ( usedQueues, 1 );
+}
@@ -0,0 +1,181 @@
+/*
+ *  Copyright 2019 Carnegie Technologies
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "basic/MemHandle.hpp"
+#include "basic/MemVector.hpp"
+#include "websocket/internal/WebSocketMask.hpp"
+
+using namespace Pravala;
+
+/// @brief WebSocketMask tests
+class WebSocketMaskTest: public ::testing::Test
+{
+    public:
+        /// @brief The mask used by the tests (bytes 0x11, 0x22, 0x33, 0x44 in memory order).
+        static uint32_t getTestMask()
+        {
+            const uint8_t maskBytes[ 4 ] = { 0x11, 0x22, 0x33, 0x44 };
+            uint32_t maskVal;
+
+            memcpy ( &maskVal, maskBytes, 4 );
+
+            return maskVal;
+        }
+
+        /// @brief Fills the memory with test data.
+        /// @param [out] data The memory to fill.
+        /// @param [in] size The number of bytes to fill.
+        static void fillData ( char * data, size_t size )
+        {
+            for ( size_t i = 0; i < size; ++i )
+            {
+                data[ i ] = ( char ) ( i * 7 + 3 );
+            }
+        }
+
+        /// @brief Checks whether the data has been masked correctly.
+        /// @param [in] data The masked data (generated by fillData() before it was masked).
+        /// @param [in] size The size of the data.
+        /// @param [in] maskOffset The mask offset that was used for the first byte.
+        /// @return True if all the bytes are correct; False otherwise.
+        static bool isMasked ( const char * data, size_t size, uint8_t maskOffset )
+        {
+            const uint8_t maskBytes[ 4 ] = { 0x11, 0x22, 0x33, 0x44 };
+
+            for ( size_t i = 0; i < size; ++i )
+            {
+                if ( data[ i ] != ( char ) ( ( char ) ( i * 7 + 3 ) ^ maskBytes[ ( maskOffset + i ) & 3 ] ) )
+                {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+};
+
+TEST_F ( WebSocketMaskTest, Implementations )
+{
+    const WebSocketMask::Implementation impls[] =
+    {
+        WebSocketMask::ImplPortable, WebSocketMask::ImplSse2, WebSocketMask::ImplAvx2, WebSocketMask::ImplNeon
+    };
+
+    const size_t maxSize = 300;
+
+    // Extra space for different alignments:
+    char src[ maxSize + 8 ];
+    char dst[ maxSize + 8 ];
+    char orig[ maxSize ];
+
+    fillData ( orig, maxSize );
+
+    for ( size_t i = 0; i < sizeof ( impls ) / sizeof ( impls[ 0 ] ); ++i )
+    {
+        if ( !WebSocketMask::setImplementation ( impls[ i ] ) )
+        {
+            // Not supported by this CPU or build.
+            continue;
+        }
+
+        EXPECT_EQ ( impls[ i ], WebSocketMask::getImplementation() );
+
+        for ( size_t size = 0; size <= maxSize; ++size )
+        {
+            for ( uint8_t maskOffset = 0; maskOffset < 4; ++maskOffset )
+            {
+                for ( uint8_t alignment = 0; alignment < 4; ++alignment )
+                {
+                    // Source and destination use different alignments:
+                    char * const s = src + alignment;
+                    char * const d = dst + 3 - alignment;
+
+                    fillData ( s, size );
+
+                    EXPECT_EQ ( ( maskOffset + size ) & 3,
+                                WebSocketMask::maskAndCopy ( d, s, size, getTestMask(), maskOffset ) );
+                    EXPECT_TRUE ( isMasked ( d, size, maskOffset ) );
+
+                    // In place:
+                    EXPECT_EQ ( ( maskOffset + size ) & 3, WebSocketMask::mask ( s, size, getTestMask(), maskOffset ) );
+                    EXPECT_TRUE ( isMasked ( s, size, maskOffset ) );
+
+                    // Masking again should restore the original data:
+                    WebSocketMask::mask ( s, size, getTestMask(), maskOffset );
+
+                    EXPECT_EQ ( 0, memcmp ( s, orig, size ) );
+                }
+            }
+        }
+    }
+
+    EXPECT_TRUE ( WebSocketMask::setImplementation ( WebSocketMask::ImplAuto ) );
+    EXPECT_NE ( WebSocketMask::ImplAuto, WebSocketMask::getImplementation() );
+}
+
+TEST_F ( WebSocketMaskTest, Pieces )
+{
+    const size_t size = 1000;
+    const size_t pieces[] = { 1, 2, 3, 5, 64, 7, 100, 33, 250, 1, 31 };
+
+    char data[ size ];
+
+    fillData ( data, size );
+
+    // Mask the data one piece at a time, carrying the mask offset over:
+    size_t offset = 0;
+    uint8_t maskOffset = 0;
+
+    for ( size_t i = 0; offset < size; i = ( i + 1 ) % ( sizeof ( pieces ) / sizeof ( pieces[ 0 ] ) ) )
+    {
+        const size_t len = ( pieces[ i ] < size - offset ) ? pieces[ i ] : ( size - offset );
+
+        maskOffset = WebSocketMask::mask ( data + offset, len, getTestMask(), maskOffset );
+        offset += len;
+
+        EXPECT_EQ ( offset & 3, maskOffset );
+    }
+
+    EXPECT_TRUE ( isMasked ( data, size, 0 ) );
+}
+
+TEST_F ( WebSocketMaskTest, MemVector )
+{
+    const size_t pieces[] = { 3, 1, 17, 64, 2, 129, 5 };
+
+    MemHandle data ( 1000 );
+    MemVector vec;
+    size_t offset = 0;
+
+    fillData ( data.getWritable(), data.size() );
+
+    for ( size_t i = 0; i < sizeof ( pieces ) / sizeof ( pieces[ 0 ] ); ++i )
+    {
+        EXPECT_TRUE ( vec.append ( data.getHandle ( offset, pieces[ i ] ) ) );
+
+        offset += pieces[ i ];
+    }
+
+    ASSERT_EQ ( offset, vec.getDataSize() );
+    ASSERT_EQ ( sizeof ( pieces ) / sizeof ( pieces[ 0 ] ), ( size_t ) vec.getNumChunks() );
+
+    char out[ 1000 ];
+
+    EXPECT_EQ ( ( 1 + offset ) & 3, WebSocketMask::maskAndCopy ( out, vec, getTestMask(), 1 ) );
+    EXPECT_TRUE ( isMasked ( out, offset, 1 ) );
+}
@@ -15,6 +15,7 @@
  */
 
 #include <cmath>
+#include <cstring>
 
 #include "basic/Random.hpp"
 #include "basic/FloatingPointUtils.hpp"
@@ -1118,6 +1119,95 @@ TEST_F ( ProtoTest, ValueTest )
     }
 }
 
+TEST_F ( ProtoTest, SerializedSizeTest )
+{
+    ValueMessage valMsg;
+
+    EXPECT_EQ ( ( size_t ) 0, valMsg.getSerializedSize() );
+
+    List<ValueStore> values = generateValues();
+
+    for ( size_t i = 0; i < values.size(); ++i )
+    {
+        valMsg.modValues().append ( values.at ( i ) );
+    }
+
+    const size_t valMsgSize = valMsg.getSerializedSize();
+
+    Buffer buf;
+
+    ASSERT_ERRCODE_EQ ( ProtoError::Success, valMsg.serialize ( buf ) );
+    EXPECT_EQ ( valMsgSize, buf.size() );
+
+    // The size is cached until the message is modified.
+    // A single ValueStore with -1 as signed_d uses 2 bytes, and one more for the header of 'values' field.
+
+    ValueStore vStore;
+
+    vStore.setSignedD ( -1 );
+    valMsg.modValues().append ( vStore );
+
+    EXPECT_EQ ( valMsgSize + 3, valMsg.getSerializedSize() );
+
+    ProtoError eCode;
+    MemHandle data = valMsg.serializeWithLength ( &eCode );
+
+    ASSERT_ERRCODE_EQ ( ProtoError::Success, eCode );
+
+    buf.clear();
+
+    // Both versions should generate the same data:
+    ASSERT_ERRCODE_EQ ( ProtoError::Success, valMsg.serializeWithLength ( buf ) );
+    ASSERT_EQ ( data.size(), buf.size() );
+    EXPECT_EQ ( 0, memcmp ( data.get(), buf.get(), buf.size() ) );
+
+    ValueMessage valMsg2;
+    size_t offset = 0;
+
+    ASSERT_ERRCODE_EQ ( ProtoError::Success, valMsg2.deserializeWithLength ( data, offset ) );
+    EXPECT_EQ ( data.size(), offset );
+    EXPECT_EQ ( valMsg.getValues().size(), valMsg2.getValues().size() );
+    EXPECT_EQ ( valMsgSize + 3, valMsg2.getSerializedSize() );
+
+    // The length of a short payload should be encoded using a single byte.
+
+    vStore.clear();
+    vStore.setUnsignedA ( 5 );
+
+    EXPECT_EQ ( ( size_t ) 2, vStore.getSerializedSize() );
+
+    buf.clear();
+
+    ASSERT_ERRCODE_EQ ( ProtoError::Success, vStore.serializeWithLength ( buf ) );
+    EXPECT_STREQ ( "0x01 0x02 0x59 0x05", String::hexDump ( buf.get(), buf.size() ).c_str() );
+
+    // Nested messages:
+
+    Container cnt;
+    PubSubRespIfaceState msg;
+    IfaceDesc ifDesc;
+
+    ifDesc.setIfaceId ( 1 );
+    ifDesc.setIfaceStatus ( IfaceDesc::IfaceStatus::IfaceUp );
+
+    msg.modIfaceDesc().append ( ifDesc );
+
+    cnt.setIfaceDesc ( ifDesc );
+    cnt.setBaseMsg ( msg );
+    cnt.modBaseMsg3().append ( msg );
+    cnt.modBaseMsg3().append ( msg );
+
+    buf.clear();
+
+    ASSERT_ERRCODE_EQ ( ProtoError::Success, cnt.serialize ( buf ) );
+    EXPECT_EQ ( buf.size(), cnt.getSerializedSize() );
+
+    Container cnt2;
+
+    ASSERT_ERRCODE_EQ ( ProtoError::Success, cnt2.deserialize ( buf ) );
+    EXPECT_TRUE ( cnt == cnt2 );
+}
+
 TEST_F ( ProtoTest, BaseMessageFieldTest )
 {
     Container cnt;
@@ -1377,6 +1467,294 @@ TEST_F ( ProtoTest, BaseMessageFieldTest )
     // EXPECT_EQ ( tStamp.getBinValue(), tmpHello.getTimestamp().getBinValue() );
 }
 
+TEST_F ( ProtoTest, TypeRegistryTest )
+{
+    PubSubReqIfaceState reqIfSt;
+
+    reqIfSt.setSubType ( 3 );
+    reqIfSt.setIfaceId ( 5 );
+
+    ClientHello cHello;
+
+    cHello.setCertId ( "qwertyuiop" );
+
+    Buffer buf;
+
+    EXPECT_ERRCODE_EQ ( ProtoError::Success, reqIfSt.serializeWithLength ( buf ) );
+    EXPECT_ERRCODE_EQ ( ProtoError::Success, cHello.serializeWithLength ( buf ) );
+
+    const MemHandle data = buf.getHandle();
+    size_t offset = 0;
+    BaseMsg * msg = 0;
+
+    // The first message should be created as the most specific type:
+    ASSERT_ERRCODE_EQ ( ProtoError::Success, BaseMsg::TypeRegistry::deserializeWithLength ( data, offset, msg ) );
+    ASSERT_TRUE ( msg != 0 );
+
+    EXPECT_TRUE ( msg->castTo<BaseMsg>() != 0 );
+    EXPECT_TRUE ( msg->castTo<CtrlMsg>() != 0 );
+    EXPECT_TRUE ( msg->castTo<PubSubReq>() != 0 );
+    EXPECT_TRUE ( msg->castTo<CtrlRespMsg>() == 0 );
+    EXPECT_TRUE ( msg->castTo<PubSubRespIfaceState>() == 0 );
+    EXPECT_TRUE ( msg->castTo<ClientHello>() == 0 );
+
+    ASSERT_TRUE ( msg->castTo<PubSubReqIfaceState>() != 0 );
+    EXPECT_EQ ( 5, msg->castTo<PubSubReqIfaceState>()->getIfaceId() );
+
+    // Deserializing it as the same (or less specific) type copies it:
+    PubSubReq psReq;
+
+    EXPECT_ERRCODE_EQ ( ProtoError::Success, psReq.deserialize ( *msg ) );
+    EXPECT_TRUE ( psReq.getIsPubSub() );
+    EXPECT_EQ ( 3, psReq.getSubType() );
+    EXPECT_EQ ( msg->getOrgBuffer().size(), psReq.getOrgBuffer().size() );
+
+    PubSubReqIfaceState reqIfSt2;
+
+    EXPECT_ERRCODE_EQ ( ProtoError::Success, reqIfSt2.deserialize ( *msg ) );
+    EXPECT_EQ ( 3, reqIfSt2.getSubType() );
+    EXPECT_EQ ( 5, reqIfSt2.getIfaceId() );
+
+    // Types that it is not an instance of are still checked against the data:
+    PubSubRespIfaceState respIfSt;
+
+    EXPECT_ERRCODE_EQ ( ProtoError::DefinedValueMismatch, respIfSt.deserialize ( *msg ) );
+
+    delete msg;
+    msg = 0;
+
+    // The second message:
+    ASSERT_ERRCODE_EQ ( ProtoError::Success, BaseMsg::TypeRegistry::deserializeWithLength ( data, offset, msg ) );
+    ASSERT_TRUE ( msg != 0 );
+    EXPECT_EQ ( data.size(), offset );
+
+    EXPECT_TRUE ( msg->castTo<CtrlMsg>() == 0 );
+    ASSERT_TRUE ( msg->castTo<ClientHello>() != 0 );
+    EXPECT_STREQ ( "qwertyuiop", msg->castTo<ClientHello>()->getCertId().c_str() );
+
+    // The object was created from the data, and it can be used to create another one:
+    BaseMsg * msg2 = 0;
+
+    ASSERT_ERRCODE_EQ ( ProtoError::Success, BaseMsg::TypeRegistry::deserialize ( *msg, msg2 ) );
+    ASSERT_TRUE ( msg2 != 0 );
+    ASSERT_TRUE ( msg2->castTo<ClientHello>() != 0 );
+    EXPECT_STREQ ( "qwertyuiop", msg2->castTo<ClientHello>()->getCertId().c_str() );
+
+    delete msg2;
+    msg2 = 0;
+
+    // Once it is modified, it has no original buffer:
+    cHello = *msg->castTo<ClientHello>();
+    cHello.setCertId ( "asdfghjkl" );
+
+    EXPECT_TRUE ( cHello.getOrgBuffer().isEmpty() );
+    EXPECT_ERRCODE_EQ ( ProtoError::IncompleteData, BaseMsg::TypeRegistry::deserialize ( cHello, msg2 ) );
+    EXPECT_TRUE ( msg2 == 0 );
+
+    delete msg;
+    msg = 0;
+
+    // A message with PubSubReqIfaceState type, but without iface_id.
+    // It should be created as the closest type that can be deserialized.
+    buf.clear();
+
+    EXPECT_ERRCODE_EQ ( ProtoError::Success,
+                        ProtocolCodec::encode ( buf, PubSubReqIfaceState::DEF_TYPE, BaseMsg::FIELD_ID_TYPE ) );
+    EXPECT_ERRCODE_EQ ( ProtoError::Success,
+                        ProtocolCodec::encode ( buf, ( uint32_t ) 0x06, BaseMsg::FIELD_ID_CONFIG ) );
+    EXPECT_ERRCODE_EQ ( ProtoError::Success,
+                        ProtocolCodec::encode ( buf, ( uint8_t ) 3, PubSubReq::FIELD_ID_SUBTYPE ) );
+
+    ASSERT_ERRCODE_EQ ( ProtoError::Success,
+                        BaseMsg::TypeRegistry::deserialize ( buf.getHandle(), 0, buf.size(), msg ) );
+    ASSERT_TRUE ( msg != 0 );
+
+    EXPECT_TRUE ( msg->castTo<PubSubReqIfaceState>() == 0 );
+    ASSERT_TRUE ( msg->castTo<PubSubReq>() != 0 );
+    EXPECT_EQ ( 3, msg->castTo<PubSubReq>()->getSubType() );
+
+    delete msg;
+    msg = 0;
+
+    // A message with an unknown type is created as the base message:
+    buf.clear();
+
+    EXPECT_ERRCODE_EQ ( ProtoError::Success,
+                        ProtocolCodec::encode ( buf, ( uint16_t ) 1000, BaseMsg::FIELD_ID_TYPE ) );
+
+    ASSERT_ERRCODE_EQ ( ProtoError::Success,
+                        BaseMsg::TypeRegistry::deserialize ( buf.getHandle(), 0, buf.size(), msg ) );
+    ASSERT_TRUE ( msg != 0 );
+
+    EXPECT_TRUE ( msg->castTo<BaseMsg>() != 0 );
+    EXPECT_TRUE ( msg->castTo<CtrlMsg>() == 0 );
+    EXPECT_TRUE ( msg->castTo<ClientHello>() == 0 );
+    EXPECT_EQ ( 1000, msg->getType() );
+
+    delete msg;
+    msg = 0;
+
+    // When nothing matches, the base message provided is used instead of allocating a new one:
+    BaseMsg baseMsg;
+
+    ASSERT_ERRCODE_EQ ( ProtoError::Success,
+                        BaseMsg::TypeRegistry::deserialize ( buf.getHandle(), 0, buf.size(), baseMsg, msg ) );
+    EXPECT_TRUE ( msg == 0 );
+    EXPECT_EQ ( 1000, baseMsg.getType() );
+
+    // Otherwise the base message is not modified:
+    offset = 0;
+
+    ASSERT_ERRCODE_EQ ( ProtoError::Success,
+                        BaseMsg::TypeRegistry::deserializeWithLength ( data, offset, baseMsg, msg ) );
+    ASSERT_TRUE ( msg != 0 );
+    ASSERT_TRUE ( msg->castTo<PubSubReqIfaceState>() != 0 );
+    EXPECT_EQ ( 5, msg->castTo<PubSubReqIfaceState>()->getIfaceId() );
+    EXPECT_EQ ( 1000, baseMsg.getType() );
+
+    // getFromBase() returns the object itself if it is of the right type:
+    PubSubReqIfaceState tmpReqIfSt;
+    ProtoError protoErr;
+
+    EXPECT_TRUE ( PubSubReqIfaceState::getFromBase ( *msg, tmpReqIfSt, protoErr ) == msg );
+    EXPECT_ERRCODE_EQ ( ProtoError::Success, protoErr );
+    EXPECT_FALSE ( tmpReqIfSt.hasIfaceId() );
+
+    delete msg;
+    msg = 0;
+
+    // Otherwise it deserializes the base message into the temporary object:
+    offset = 0;
+
+    ASSERT_ERRCODE_EQ ( ProtoError::ProtocolWarning, baseMsg.deserializeWithLength ( data, offset ) );
+
+    const PubSubReqIfaceState * const reqIfStPtr
+        = PubSubReqIfaceState::getFromBase ( ( const BaseMsg & ) baseMsg, tmpReqIfSt, protoErr );
+
+    EXPECT_ERRCODE_EQ ( ProtoError::Success, protoErr );
+    ASSERT_TRUE ( reqIfStPtr == &tmpReqIfSt );
+    EXPECT_EQ ( 5, tmpReqIfSt.getIfaceId() );
+
+    // ...as long as it matches:
+    EXPECT_TRUE ( ClientHello::getFromBase ( baseMsg, cHello, protoErr ) == 0 );
+    EXPECT_ERRCODE_EQ ( ProtoError::DefinedValueMismatch, protoErr );
+
+    // Only the fields that can be used by 'defines' are decoded before selecting the type:
+    EXPECT_TRUE ( BaseMsg::isDefinableField ( BaseMsg::FIELD_ID_TYPE ) );
+    EXPECT_TRUE ( BaseMsg::isDefinableField ( BaseMsg::FIELD_ID_CONFIG ) );
+    EXPECT_FALSE ( BaseMsg::isDefinableField ( ClientHello::FIELD_ID_CERT_ID ) );
+    EXPECT_FALSE ( BaseMsg::isDefinableField ( PubSubReqIfaceState::FIELD_ID_IFACE_ID ) );
+}
+
+TEST_F ( ProtoTest, LazyViewTest )
+{
+    ClientConfig cfg;
+
+    cfg.setMsgTypeName ( "client-config" );
+    cfg.modAddrToUse().append ( IpAddress ( "10.0.0.1" ) );
+    cfg.modAddrToUse().append ( IpAddress ( "::1" ) );
+    cfg.modDnsToUse().append ( "dns1.example.com" );
+    cfg.modDnsToUse().append ( "dns2.example.com" );
+
+    ProtoError eCode;
+    MemHandle data = cfg.serializeWithLength ( &eCode );
+
+    ASSERT_ERRCODE_EQ ( ProtoError::Success, eCode );
+
+    // Only the length is read here:
+
+    BaseMsg::View baseView;
+    size_t offset = 0;
+
+    ASSERT_ERRCODE_EQ ( ProtoError::Success, baseView.setDataWithLength ( data, offset ) );
+    EXPECT_EQ ( data.size(), offset );
+
+    uint16_t type = 0;
+
+    EXPECT_TRUE ( baseView.hasType() );
+    ASSERT_ERRCODE_EQ ( ProtoError::Success, baseView.getType ( type ) );
+    EXPECT_EQ ( ClientConfig::DEF_TYPE, type );
+
+    // Strings are not copied, they use the original memory:
+
+    const MemHandle name = baseView.getMsgTypeName();
+
+    EXPECT_STREQ ( "client-config", name.toString().c_str() );
+    EXPECT_TRUE ( name.get() > data.get() && name.get() + name.size() <= data.get() + data.size() );
+
+    Timestamp ts;
+
+    EXPECT_FALSE ( baseView.hasTimestamp() );
+    EXPECT_ERRCODE_EQ ( ProtoError::RequiredFieldNotSet, baseView.getTimestamp ( ts ) );
+
+    // The same data, viewed as a more specific message:
+
+    ClientConfig::View cfgView ( baseView.getData() );
+    IpAddress addr;
+
+    ASSERT_EQ ( ( size_t ) 2, cfgView.getAddrToUseCount() );
+    ASSERT_ERRCODE_EQ ( ProtoError::Success, cfgView.getAddrToUse ( 1, addr ) );
+    EXPECT_EQ ( IpAddress ( "::1" ), addr );
+    EXPECT_ERRCODE_EQ ( ProtoError::RequiredFieldNotSet, cfgView.getAddrToUse ( 2, addr ) );
+
+    ASSERT_EQ ( ( size_t ) 2, cfgView.getDnsToUseCount() );
+    EXPECT_STREQ ( "dns2.example.com", cfgView.getDnsToUse ( 1 ).toString().c_str() );
+    EXPECT_TRUE ( cfgView.getDnsToUse ( 2 ).isEmpty() );
+    EXPECT_STREQ ( "client-config", cfgView.getMsgTypeName().toString().c_str() );
+
+    // The view of a deserialized message uses its original buffer:
+
+    ClientConfig cfg2;
+
+    ASSERT_ERRCODE_EQ ( ProtoError::Success, cfg2.deserialize ( baseView.getData() ) );
+    EXPECT_EQ ( ( size_t ) 2, cfg2.getView().getDnsToUseCount() );
+
+    cfg2.setMsgTypeName ( "modified" );
+
+    EXPECT_TRUE ( cfg2.getView().getData().isEmpty() );
+
+    // Nested objects and enums:
+
+    Container cnt;
+    IfaceDesc ifDesc;
+
+    ifDesc.setIfaceId ( 5 );
+    ifDesc.setIfaceStatus ( IfaceDesc::IfaceStatus::IfaceUp );
+
+    cnt.setIfaceDesc ( ifDesc );
+    cnt.setBaseMsg ( cfg );
+
+    Buffer buf;
+
+    ASSERT_ERRCODE_EQ ( ProtoError::Success, cnt.serialize ( buf ) );
+
+    Container::View cntView ( buf );
+    IfaceDesc::View ifView;
+    IfaceDesc::IfaceStatus ifStatus;
+    int8_t ifaceId = 0;
+
+    ASSERT_ERRCODE_EQ ( ProtoError::Success, cntView.getIfaceDesc ( ifView ) );
+    ASSERT_ERRCODE_EQ ( ProtoError::Success, ifView.getIfaceStatus ( ifStatus ) );
+    ASSERT_ERRCODE_EQ ( ProtoError::Success, ifView.getIfaceId ( ifaceId ) );
+    EXPECT_EQ ( IfaceDesc::IfaceStatus::IfaceUp, ifStatus.value() );
+    EXPECT_EQ ( 5, ifaceId );
+
+    BaseMsg::View msgView;
+
+    EXPECT_EQ ( ( size_t ) 0, cntView.getBaseMsg3Count() );
+    EXPECT_ERRCODE_EQ ( ProtoError::RequiredFieldNotSet, cntView.getBaseMsg2 ( msgView ) );
+    ASSERT_ERRCODE_EQ ( ProtoError::Success, cntView.getBaseMsg ( msgView ) );
+    EXPECT_STREQ ( "dns1.example.com", ClientConfig::View ( msgView.getData() ).getDnsToUse ( 0 ).toString().c_str() );
+
+    // Malformed data - none of the fields should be available:
+
+    ClientConfig::View badView ( baseView.getData().getHandle ( 0, baseView.getData().size() - 1 ) );
+
+    EXPECT_ERRCODE_EQ ( ProtoError::IncompleteData, badView.indexFields() );
+    EXPECT_FALSE ( badView.hasType() );
+    EXPECT_EQ ( ( size_t ) 0, badView.getAddrToUseCount() );
+}
+
 TEST_F ( ProtoTest, FileIOTest )
 {
     List<ValueStore> values = generateValues ( true );
@@ -259,6 +259,15 @@ class CppGenerator: public LanguageGenerator
         /// @param [in] implFile The implementation file
         virtual void genMsgSerializeFieldsMethod ( Symbol * symbol, CppFile & hdrFile, CppFile & implFile );
 
+        /// @brief Generates the method that calculates the size of the serialized message
+        ///
+        /// It is run while the 'public' block is generated.
+        ///
+        /// @param [in] symbol The symbol object to generate the code for
+        /// @param [in] hdrFile The header file
+        /// @param [in] implFile The implementation file
+        virtual void genMsgSerializedSizeMethod ( Symbol * symbol, CppFile & hdrFile, CppFile & implFile );
+
         /// @brief Generates the actual fields for storing message's elements
         ///
         /// It is run while the 'private' block is generated.
@@ -430,6 +439,18 @@ class CppGenerator: public LanguageGenerator
             const String & bufVarName, const String & valueVarName,
             const String & valueCode ) = 0;
 
+        /// @brief Returns the expression for calculating the size of encoded data
+        /// @param [in] valueVarName The name of the variable to encode
+        /// @param [in] valueCode The value/variable name with the field code (ID)
+        /// @return The expression that calculates the number of bytes exprProtoEncode would append to the buffer
+        virtual String exprProtoEncodedSize ( const String & valueVarName, const String & valueCode ) = 0;
+
+        /// @brief Returns the expression for calculating the size of a message serialized as a field
+        /// @param [in] varName The name of the message variable
+        /// @param [in] valueCode The value/variable name with the field code (ID)
+        /// @return The expression that calculates the number of bytes genSerializeMessage would append to the buffer
+        virtual String exprMessageFieldSize ( const String & varName, const String & valueCode ) = 0;
+
         /// @brief Returns the expression for reading field's size from the buffer
         /// @param [in] bufVarName The name of the read buffer variable
         /// @param [in] offset The offset within the buffer
@@ -465,12 +486,13 @@ class CppGenerator: public LanguageGenerator
         /// @param [in] symbol The symbol of the message
         /// @param [in] varName The name of the variable to serialize
         /// @param [in] bufVarName The name of the write buffer variable
+        /// @param [in] fieldIdName The name of the field ID to serialize the message as
         /// @param [in] resultVarName The name of the variable in which the result error code should be put
         /// @param [in] extErrVarName The name of the variable with extended error
         virtual void genSerializeMessage (
             CppFile & file, int indent, Symbol * symbol, const String & varName,
-            const String & bufVarName, const String & resultVarName,
-            const String & extErrVarName ) = 0;
+            const String & bufVarName, const String & fieldIdName,
+            const String & resultVarName, const String & extErrVarName ) = 0;
 
         /// @brief Generates code for deserializing a message
         /// @param [in] file The file in which the code should be generated
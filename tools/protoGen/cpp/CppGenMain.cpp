@@ -1057,6 +1057,9 @@ void CppGenerator::genMsgStdMethods ( Symbol * s, CppFile & hdr, CppFile & impl
     }
 
     impl.ae ( 1, "localClear();" );
+
+    genObjectModified ( s, impl, 1 );
+
     impl.ae ( "}" ).e();
 
     // ***************************************************************************************************************
@@ -1501,6 +1504,7 @@ void CppGenerator::genMsgStdMethods ( Symbol * s, CppFile & hdr, CppFile & impl
 
     genMsgDeserializeFieldMethod ( s, hdr, impl );
     genMsgSerializeFieldsMethod ( s, hdr, impl );
+    genMsgSerializedSizeMethod ( s, hdr, impl );
 }
 
 void CppGenerator::genMsgStdPrivMethods ( Symbol * s, CppFile & hdr, CppFile & impl )
@@ -1842,21 +1846,7 @@ void CppGenerator::genMsgSerializeFieldsMethod ( Symbol * s, CppFile & hdr, CppF
 
         if ( e->typeSymbol->isMessageOrStruct() )
         {
-            impl.i ( 2 ).a ( getStdType ( TypeWriteBuffer ) ).ae ( " tmpBuf;" ).e();
-
-            genSerializeMessage ( impl, 2, e->typeSymbol, varName, "tmpBuf", "ret", "extError" );
-
-            impl.ae ( 2, String ( "if ( ret != %1 )" ).arg ( getErrorCode ( ErrOK ) ) );
-            impl.ae ( 2, "{" );
-
-            genSetupExtError ( impl, 3, "ret",
-                               String ( "\"Error serializing %1.%2 into temporary buffer\"" )
-                               .arg ( getClassPath ( s ), e->name ) );
-
-            impl.ae ( 3, "return ret;" );
-            impl.ae ( 2, "}" ).e();
-
-            impl.ae ( 2, String ( "ret = %1;" ).arg ( exprProtoEncode ( "buf", "tmpBuf", getFieldIdName ( e ) ) ) );
+            genSerializeMessage ( impl, 2, e->typeSymbol, varName, "buf", getFieldIdName ( e ), "ret", "extError" );
         }
         else
         {
@@ -1884,6 +1874,86 @@ void CppGenerator::genMsgSerializeFieldsMethod ( Symbol * s, CppFile & hdr, CppF
     impl.ae ( "}" ).e();
 }
 
+void CppGenerator::genMsgSerializedSizeMethod ( Symbol * s, CppFile & hdr, CppFile & impl )
+{
+    assert ( s != 0 );
+
+    hdr.ae ( "virtual size_t calcSerializedSize();" );
+    hdr.e();
+
+    const StringList & elems = s->getOrdElements();
+
+    impl.ae ( String ( "size_t %1::calcSerializedSize()" ).arg ( getClassPath ( s ) ) );
+    impl.ae ( "{" );
+
+    if ( s->getInheritance() != 0 )
+    {
+        impl.ae ( 1, String ( "size_t ret = %1::calcSerializedSize();" ).arg ( s->getInheritance()->getName() ) );
+    }
+    else
+    {
+        impl.ae ( 1, "size_t ret = 0;" );
+    }
+
+    impl.e();
+
+    for ( size_t i = 0; i < elems.size(); ++i )
+    {
+        Element * e = s->getElements().value ( elems[ i ] );
+
+        assert ( e != 0 );
+
+        // Alias fields are not serialized directly (see genMsgSerializeFieldsMethod),
+        // so they don't add anything to the size.
+        if ( e->aliasTarget != 0 )
+        {
+            continue;
+        }
+
+        assert ( e->typeSymbol != 0 );
+
+        String varName = getVarName ( e );
+
+        if ( !e->isRepeated() )
+        {
+            impl.ae ( 1, String ( "if ( %1() )" ).arg ( e->getCamelCaseName ( "has" ) ) );
+            impl.ae ( 1, "{" );
+        }
+        else
+        {
+            impl.ae ( 1, String ( "for ( size_t i = 0, lSize = %1; i < lSize; ++i )" )
+                      .arg ( exprListVarSize ( e->typeSymbol, getVarName ( e ) ) ) );
+            impl.ae ( 1, "{" );
+
+            varName = "varRef";
+
+            impl.ae ( 2, String ( "%1 & %2 = %3;" )
+                      .arg ( getRawVarType ( hdr, e->typeSymbol ),
+                             varName,
+                             exprListGetElemIdxRef ( e->typeSymbol, getVarName ( e ), "i" ) ) ).e();
+        }
+
+        if ( e->typeSymbol->isMessageOrStruct() )
+        {
+            impl.ae ( 2, String ( "ret += %1;" ).arg ( exprMessageFieldSize ( varName, getFieldIdName ( e ) ) ) );
+        }
+        else
+        {
+            if ( e->typeSymbol->isEnum() )
+            {
+                varName = String ( "( ( %1 ) %2.value() )" ).arg ( getStdType ( TypeEnum ), varName );
+            }
+
+            impl.ae ( 2, String ( "ret += %1;" ).arg ( exprProtoEncodedSize ( varName, getFieldIdName ( e ) ) ) );
+        }
+
+        impl.ae ( 1, "}" ).e();
+    }
+
+    impl.ae ( 1, "return ret;" );
+    impl.ae ( "}" ).e();
+}
+
 String CppGenerator::exprVarClear ( Element * e )
 {
     if ( !e->typeSymbol )
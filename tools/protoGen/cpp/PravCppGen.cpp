@@ -24,7 +24,8 @@ PravalaCppGenerator::PravalaCppGenerator ( ProtocolSpec & proto ):
     _symString ( _proto.getRoot()->createBasicRootType ( "string", Symbol::SpecTypeString ) ),
     _symIpAddr ( _proto.getRoot()->createBasicRootType ( "ip_addr" ) ),
     _symTimestamp ( _proto.getRoot()->createBasicRootType ( "timestamp" ) ),
-    _enableJson ( false )
+    _enableJson ( false ),
+    _enableLazyView ( false )
 {
 }
 
@@ -33,7 +34,11 @@ String PravalaCppGenerator::getHelpText()
     String text = CppGenerator::getHelpText();
 
     text.append ( "      --enable-json\n"
-                  "          If enabled, JSON serializer will be generated as well.\n\n" );
+                  "          If enabled, JSON serializer will be generated as well.\n\n"
+                  "      --enable-lazy-view\n"
+                  "          If enabled, each message and structure will also include a 'View' class,\n"
+                  "          that provides lazy, read-only access to the fields of a serialized object,\n"
+                  "          without deserializing it, and without copying strings.\n\n" );
 
     return text;
 }
@@ -47,6 +52,12 @@ LanguageGenerator::SetOptResult PravalaCppGenerator::setOption (
         return OptOkValueIgnored;
     }
 
+    if ( longName == "enable-lazy-view" )
+    {
+        _enableLazyView = true;
+        return OptOkValueIgnored;
+    }
+
     return CppGenerator::setOption ( shortName, longName, value );
 }
 
@@ -245,6 +256,16 @@ String PravalaCppGenerator::exprProtoEncode (
            .arg ( bufVarName, valueVarName, valueCode );
 }
 
+String PravalaCppGenerator::exprProtoEncodedSize ( const String & valueVarName, const String & valueCode )
+{
+    return String ( "Pravala::ProtocolCodec::getEncodedSize ( %1, %2 )" ).arg ( valueVarName, valueCode );
+}
+
+String PravalaCppGenerator::exprMessageFieldSize ( const String & varName, const String & valueCode )
+{
+    return String ( "%1.calcFieldSize ( %2 )" ).arg ( varName, valueCode );
+}
+
 String PravalaCppGenerator::exprProtoDecodeFieldValue (
         const String & bufVarName, const String & offset,
         const String & fieldSize, const String & wireType, const String & fieldVarName )
@@ -305,20 +326,30 @@ void PravalaCppGenerator::genDeserializeMessage (
 
 void PravalaCppGenerator::genSerializeMessage (
         CppFile & file, int ind, Symbol * /*s*/,
-        const String & varName, const String & bufVarName,
+        const String & varName, const String & bufVarName, const String & fieldIdName,
         const String & resultVarName, const String & extErrVarName )
 {
-    file.ae ( ind, String ( "%1 = %2.serialize ( %3, %4 );" )
-              .arg ( resultVarName, varName, bufVarName, extErrVarName ) );
+    // The size of the message has been calculated (and cached) by calcSerializedSize(),
+    // so it can be serialized directly into the buffer, without using a temporary one.
+    file.ae ( ind, String ( "%1 = %2.serializeAsField ( %3, %4, %5 );" )
+              .arg ( resultVarName, varName, bufVarName, fieldIdName, extErrVarName ) );
 }
 
 void PravalaCppGenerator::genObjectModified ( Symbol * s, CppFile & file, int indent )
 {
-    if ( !s || !s->isMessage() )
+    if ( !s || !s->isMessageOrStruct() )
         return;
 
     file.e();
-    file.i ( indent ).ae ( "messageModified();" ).e();
+
+    if ( s->isMessage() )
+    {
+        file.i ( indent ).ae ( "messageModified();" ).e();
+    }
+    else
+    {
+        file.i ( indent ).ae ( "clearSerializedSize();" ).e();
+    }
 }
 
 void PravalaCppGenerator::hookPosition (
@@ -329,6 +360,18 @@ void PravalaCppGenerator::hookPosition (
 
     assert ( s != 0 );
 
+    if ( position == PosProtectedEnd )
+    {
+        genCopyFromBaseFunc ( s, hdr, impl );
+        return;
+    }
+
+    if ( position == PosPrivateEnd )
+    {
+        genTypeRegEntry ( s, hdr, impl );
+        return;
+    }
+
     if ( position != PosPublicEnd )
         return;
 
@@ -341,6 +384,11 @@ void PravalaCppGenerator::hookPosition (
         genDumpFunc ( s, hdr, impl );
     }
 
+    if ( _enableLazyView )
+    {
+        genLazyViewClass ( s, hdr, impl );
+    }
+
     if ( !s || !s->isMessage() )
         return;
 
@@ -354,6 +402,8 @@ void PravalaCppGenerator::hookPosition (
     hdr.ae ( 1, String ( "return new %1 ( *this );" ).arg ( s->getName() ) );
     hdr.ae ( "}" ).e();
 
+    genTypeInfoFuncs ( s, hdr, impl );
+
     if ( !s->isBaseMessage() )
         return;
 
@@ -364,7 +414,9 @@ void PravalaCppGenerator::hookPosition (
     hdr.ce();
     hdr.ce ( "For this to work, the base message has to still contain the original buffer." );
     hdr.ce();
-    hdr.ce ( "Before deserializing this function performs sanity test using testDefines()." );
+    hdr.ce ( "If the base message already is an instance of this message's type (for example it was created" );
+    hdr.ce ( "by the TypeRegistry) and it has not been modified, it is simply copied." );
+    hdr.ce ( "Otherwise, before deserializing this function performs sanity test using testDefines()." );
     hdr.ce ( "If it succeeds, a reference to the original buffer from the baseMsg" );
     hdr.ce ( "will be stored in this object as well." );
     hdr.ce();
@@ -383,6 +435,11 @@ void PravalaCppGenerator::hookPosition (
     impl.ae ( "{" );
     impl.incBaseIndent ( 1 );
 
+    impl.ae ( "if ( copyFromBase ( baseMsg ) )" );
+    impl.ae ( "{" );
+    impl.ae ( 1, String ( "return %1;" ).arg ( getErrorCode ( ErrOK ) ) );
+    impl.ae ( "}" ).e();
+
     impl.ae ( "if ( !testDefines ( baseMsg, extError ) )" );
     impl.ae ( "{" );
 
@@ -534,6 +591,227 @@ void PravalaCppGenerator::genTestBaseDefsFunc ( Symbol * s, CppFile & hdr, CppFi
     impl.ae ( "}" ).e();
 }
 
+void PravalaCppGenerator::genTypeInfoFuncs ( Symbol * s, CppFile & hdr, CppFile & impl )
+{
+    assert ( s != 0 );
+    assert ( s->isMessage() );
+
+    Symbol * baseMsg = s->getBaseInheritance();
+
+    assert ( baseMsg != 0 );
+    assert ( baseMsg->isBaseMessage() );
+
+    if ( s->isBaseMessage() )
+    {
+        hdr.addCppInclude ( "proto/MessageTypeRegistry.hpp", CppFile::IncludeLocal );
+
+        hdr.ce ( "@brief The registry of message types that inherit this base message" );
+        hdr.ae ( String ( "typedef Pravala::MessageTypeRegistry<%1> TypeRegistry;" )
+                 .arg ( getClassPath ( s ) ) ).e();
+
+        hdr.ce ( "@brief Checks whether the field can be used by 'defines' of messages that inherit this one" );
+        hdr.ce ( "Those are the fields (and alias storage fields) with values that can be 'defined'." );
+        hdr.ce ( "The TypeRegistry only decodes those fields before selecting the message type to deserialize." );
+        hdr.ce ( "@param [in] fieldId The ID of the field to check" );
+        hdr.ce ( "@return True if the field can be used by 'defines'; False otherwise" );
+        hdr.ae ( "static bool isDefinableField ( uint32_t fieldId );" ).e();
+
+        impl.ae ( String ( "bool %1::isDefinableField ( uint32_t fieldId )" ).arg ( getClassPath ( s ) ) );
+        impl.ae ( "{" );
+
+        // Messages that inherit this one could be generated separately (from other files),
+        // so we include all the fields that could be defined, not only those that actually are.
+        StringList fieldIds;
+        const StringList & elems = s->getOrdElements();
+
+        for ( size_t i = 0; i < elems.size(); ++i )
+        {
+            Element * e = s->getElements().value ( elems[ i ] );
+
+            assert ( e != 0 );
+
+            if ( !e->isAlias() && !e->isRepeated() && e->typeSymbol != 0 && !e->typeSymbol->isMessageOrStruct() )
+            {
+                fieldIds.append ( getFieldIdName ( e ) );
+            }
+        }
+
+        if ( fieldIds.isEmpty() )
+        {
+            impl.ae ( 1, "( void ) fieldId;" );
+            impl.ae ( 1, "return false;" );
+        }
+        else
+        {
+            impl.ae ( 1, "switch ( fieldId )" );
+            impl.ae ( 1, "{" );
+
+            for ( size_t i = 0; i < fieldIds.size(); ++i )
+            {
+                impl.ae ( 2, String ( "case %1:" ).arg ( fieldIds[ i ] ) );
+            }
+
+            impl.ae ( 3, "return true;" );
+            impl.ae ( 3, "break;" );
+            impl.ae ( 1, "}" ).e();
+            impl.ae ( 1, "return false;" );
+        }
+
+        impl.ae ( "}" ).e();
+    }
+
+    hdr.ce ( "@brief The address of this member uniquely identifies this message type" );
+    hdr.ae ( "static const uint8_t TYPE_TAG;" ).e();
+
+    impl.ae ( String ( "const uint8_t %1::TYPE_TAG = 0;" ).arg ( getClassPath ( s ) ) ).e();
+
+    hdr.ce ( "@brief Checks whether this object is an instance of the given message type" );
+    hdr.ce ( "@param [in] typeTag The address of the TYPE_TAG member of the message type to check" );
+    hdr.ce ( "@return True if this object is an instance of the given message type (or a type that inherits it)" );
+    hdr.ae ( "virtual bool isInstanceOf ( const uint8_t * typeTag ) const" );
+    hdr.ae ( "{" );
+    hdr.ae ( 1, String ( "return ( typeTag == &TYPE_TAG || %1::isInstanceOf ( typeTag ) );" )
+             .arg ( ( s->getInheritance() != 0 ) ? s->getInheritance()->getName() : "SerializableMessage" ) );
+    hdr.ae ( "}" ).e();
+
+    hdr.ce ( "@brief Checks whether the base message matches 'defines' set by this message" );
+    hdr.ce ( "It works like testDefines(), but it doesn't need an object and doesn't report errors" );
+    hdr.ce ( "@param [in] baseMsg The base message to check" );
+    hdr.ce ( "@return True if it makes sense to try to deserialize from the buffer associated with the base message" );
+    hdr.ae ( String ( "static bool matchesDefines ( const %1 & baseMsg );" ).arg ( getClassPath ( baseMsg ) ) ).e();
+
+    impl.ae ( String ( "bool %1::matchesDefines ( const %2 & baseMsg )" )
+              .arg ( getClassPath ( s ), getClassPath ( baseMsg ) ) );
+    impl.ae ( "{" );
+    impl.ae ( 1, "( void ) baseMsg;" );
+    impl.e();
+
+    for ( HashMap<String, Element * >::Iterator defsIt ( s->getDefines() ); defsIt.isValid(); defsIt.next() )
+    {
+        Element * e = defsIt.value();
+
+        assert ( e != 0 );
+
+        // Just like in testDefines(), we can only check fields that are declared in the base message.
+        if ( !e->definedTarget || e->definedTarget->containerSymbol != baseMsg )
+            continue;
+
+        impl.ae ( 1, String ( "if ( !baseMsg.%1() || baseMsg.%2() != %3 )" )
+                  .arg ( e->getCamelCaseName ( "has" ),
+                         e->getCamelCaseName ( "get" ),
+                         getDefName ( e ) ) );
+        impl.ae ( 1, "{" );
+        impl.ae ( 2, "return false;" );
+        impl.ae ( 1, "}" ).e();
+    }
+
+    if ( s->getInheritance() != 0 )
+    {
+        impl.ae ( 1, String ( "return %1::matchesDefines ( baseMsg );" )
+                  .arg ( s->getInheritance()->getName() ) );
+    }
+    else
+    {
+        impl.ae ( 1, "return true;" );
+    }
+
+    impl.ae ( "}" ).e();
+
+    if ( s->isBaseMessage() )
+        return;
+
+    // Generates two versions of getFromBase() - for const and non-const base messages:
+    for ( int i = 0; i < 2; ++i )
+    {
+        const String constStr = ( i == 0 ) ? "const " : "";
+
+        hdr.ce ( "@brief Returns the base message as an object of this type, deserializing it only if needed" );
+        hdr.ce ( "It is meant for dispatching base messages to handlers of specific message types." );
+        hdr.ce ( "If the base message is an instance of this type (for example it was created by the TypeRegistry)" );
+        hdr.ce ( "it is returned as it is, without copying or parsing it again." );
+        hdr.ce ( "Otherwise it is deserialized as this type, into the temporary object provided." );
+        hdr.ce ( "@param [in] baseMsg The base message" );
+        hdr.ce ( "@param [out] tmpMsg The object to deserialize the base message into, if needed" );
+        hdr.ce ( "@param [out] eCode The error code (success if the base message is returned as it is)" );
+        hdr.ce ( "@param [out] extError Pointer to extended error code if it should be used (only modified on error)." );
+        hdr.ce ( "@return The message as this type (the base message itself, or tmpMsg), or 0 on error" );
+        hdr.ae ( String ( "static %1%2 * getFromBase ( %1%3 & baseMsg, %2 & tmpMsg, %4 & eCode, "
+                          "%5 * extError = 0 );" )
+                 .arg ( constStr, s->getName(), getClassPath ( baseMsg ),
+                        getStdType ( TypeErrorCode ), getStdType ( TypeExtError ) ) ).e();
+
+        impl.ae ( String ( "%1%2 * %2::getFromBase ( %1%3 & baseMsg, %2 & tmpMsg, %4 & eCode, %5 * extError )" )
+                  .arg ( constStr, getClassPath ( s ), getClassPath ( baseMsg ),
+                         getStdType ( TypeErrorCode ), getStdType ( TypeExtError ) ) );
+        impl.ae ( "{" );
+        impl.ae ( 1, String ( "%1%2 * const msg = baseMsg.castTo<%2>();" ).arg ( constStr, getClassPath ( s ) ) );
+        impl.e();
+        impl.ae ( 1, "if ( msg != 0 )" );
+        impl.ae ( 1, "{" );
+        impl.ae ( 2, String ( "eCode = %1;" ).arg ( getErrorCode ( ErrOK ) ) );
+        impl.ae ( 2, "return msg;" );
+        impl.ae ( 1, "}" ).e();
+        impl.ae ( 1, "eCode = tmpMsg.deserialize ( baseMsg, extError );" ).e();
+        impl.ae ( 1, "return IS_OK ( eCode ) ? ( &tmpMsg ) : 0;" );
+        impl.ae ( "}" ).e();
+    }
+}
+
+void PravalaCppGenerator::genCopyFromBaseFunc ( Symbol * s, CppFile & hdr, CppFile & impl )
+{
+    assert ( s != 0 );
+
+    if ( !s->isMessage() )
+        return;
+
+    Symbol * baseMsg = s->getBaseInheritance();
+
+    assert ( baseMsg != 0 );
+
+    hdr.e();
+    hdr.ce ( "@brief Copies the base message, if it is an unmodified instance of this message's type" );
+    hdr.ce ( "It is used by deserialize ( baseMsg ) to avoid deserializing the same data again." );
+    hdr.ce ( "@param [in] baseMsg The base message to copy" );
+    hdr.ce ( "@return True if the base message has been copied; False otherwise" );
+    hdr.ae ( String ( "virtual bool copyFromBase ( const %1 & baseMsg );" ).arg ( getClassPath ( baseMsg ) ) ).e();
+
+    impl.ae ( String ( "bool %1::copyFromBase ( const %2 & baseMsg )" )
+              .arg ( getClassPath ( s ), getClassPath ( baseMsg ) ) );
+    impl.ae ( "{" );
+    impl.ae ( 1, "if ( baseMsg.getOrgBuffer().isEmpty() || !baseMsg.isInstanceOf ( &TYPE_TAG ) )" );
+    impl.ae ( 1, "{" );
+    impl.ae ( 2, "return false;" );
+    impl.ae ( 1, "}" ).e();
+    impl.ae ( 1, String ( "*this = static_cast<const %1 &> ( baseMsg );" ).arg ( getClassPath ( s ) ) );
+    impl.ae ( 1, "return true;" );
+    impl.ae ( "}" ).e();
+}
+
+void PravalaCppGenerator::genTypeRegEntry ( Symbol * s, CppFile & hdr, CppFile & impl )
+{
+    assert ( s != 0 );
+
+    // Base messages are created by the registry when nothing else matches; They don't need to be registered.
+    if ( !s->isMessage() || s->isBaseMessage() )
+        return;
+
+    int depth = 0;
+
+    for ( Symbol * parent = s->getInheritance(); parent != 0; parent = parent->getInheritance() )
+    {
+        ++depth;
+    }
+
+    hdr.e();
+    hdr.ce ( "@brief Registers this message type in the TypeRegistry of the base message" );
+    hdr.ae ( "static TypeRegistry::Entry _typeRegEntry;" );
+
+    impl.ae ( String ( "%1::TypeRegistry::Entry %1::_typeRegEntry (" ).arg ( getClassPath ( s ) ) );
+    impl.ae ( 2, String ( "%1, &%2::TypeRegistry::create<%2>, &%2::matchesDefines );" )
+              .arg ( depth ).arg ( getClassPath ( s ) ) );
+    impl.e();
+}
+
 void addI ( CppFile & file )
 {
     file.a ( "buf.append ( indent );" ).e();
@@ -1036,3 +1314,168 @@ void PravalaCppGenerator::genDumpFunc ( Symbol * s, CppFile & hdr, CppFile & imp
     impl.decBaseIndent();
     impl.a ( "}" ).e().e();
 }
+
+void PravalaCppGenerator::genLazyViewClass ( Symbol * s, CppFile & hdr, CppFile & /*impl*/ )
+{
+    if ( !s || !s->isMessageOrStruct() )
+        return;
+
+    String baseView = "Pravala::SerializableView";
+
+    if ( s->getInheritance() != 0 )
+    {
+        baseView = String ( "%1::View" ).arg ( getClassPath ( s->getInheritance() ) );
+    }
+    else
+    {
+        hdr.addCppInclude ( "proto/SerializableView.hpp", CppFile::IncludeLocal );
+    }
+
+    hdr.e();
+    hdr.ce ( String ( "@brief A lazy, read-only view of serialized '%1'" ).arg ( s->getName() ) );
+    hdr.ce ( "The data is indexed when any of the fields is accessed for the first time," );
+    hdr.ce ( "and each field is decoded only when it is accessed. Strings are not copied." );
+    hdr.ce ( "It does not validate the data." );
+    hdr.ae ( String ( "class View: public %1" ).arg ( baseView ) );
+    hdr.ae ( "{" );
+    hdr.incBaseIndent ( 2 );
+    hdr.i ( -1 ).a ( "public:" ).e();
+
+    hdr.ce ( "@brief Default constructor" );
+    hdr.ae ( "inline View()" );
+    hdr.ae ( "{" );
+    hdr.ae ( "}" ).e();
+
+    hdr.ce ( "@brief Constructor" );
+    hdr.ce ( "@param [in] data The serialized object (without the length header)" );
+    hdr.ae ( String ( "inline explicit View ( const Pravala::MemHandle & data ): %1 ( data )" ).arg ( baseView ) );
+    hdr.ae ( "{" );
+    hdr.ae ( "}" );
+
+    const StringList & elems = s->getOrdElements();
+
+    for ( size_t i = 0; i < elems.size(); ++i )
+    {
+        Element * e = s->getElements().value ( elems[ i ] );
+
+        assert ( e != 0 );
+
+        // Aliases are stored in other fields, there is nothing to index.
+        if ( e->aliasTarget != 0 )
+        {
+            continue;
+        }
+
+        assert ( e->typeSymbol != 0 );
+
+        const String name = e->getCamelCaseName();
+        const String fieldId = getFieldIdName ( e );
+
+        // For repeated fields all the accessors take the index of the element.
+        String idxParam;
+        String idxArg = "0";
+
+        hdr.e();
+
+        if ( e->isRepeated() )
+        {
+            idxParam = "size_t index";
+            idxArg = "index";
+
+            hdr.ce ( String ( "@brief Returns the number of '%1' elements present" ).arg ( name ) );
+            hdr.ce ( String ( "@return The number of '%1' elements present" ).arg ( name ) );
+            hdr.ae ( String ( "inline size_t %1Count()" ).arg ( e->getCamelCaseName ( "get" ) ) );
+            hdr.ae ( "{" );
+            hdr.ae ( 1, String ( "return getFieldCount ( %1 );" ).arg ( fieldId ) );
+            hdr.ae ( "}" );
+        }
+        else
+        {
+            hdr.ce ( String ( "@brief Checks if '%1' is present" ).arg ( name ) );
+            hdr.ce ( String ( "@return True if '%1' is present, false otherwise" ).arg ( name ) );
+            hdr.ae ( String ( "inline bool %1()" ).arg ( e->getCamelCaseName ( "has" ) ) );
+            hdr.ae ( "{" );
+            hdr.ae ( 1, String ( "return hasField ( %1 );" ).arg ( fieldId ) );
+            hdr.ae ( "}" );
+        }
+
+        hdr.e();
+
+        if ( e->typeSymbol == _symString )
+        {
+            hdr.ce ( String ( "@brief Returns the data of '%1', without copying it" ).arg ( name ) );
+
+            if ( e->isRepeated() )
+            {
+                hdr.ce ( "@param [in] index The index of the element" );
+            }
+
+            hdr.ce ( String ( "@return The data of '%1'; Empty if it is not present" ).arg ( name ) );
+            hdr.ae ( String ( "inline Pravala::MemHandle %1%2" )
+                     .arg ( e->getCamelCaseName ( "get" ), e->isRepeated() ? " ( size_t index )" : "()" ) );
+            hdr.ae ( "{" );
+            hdr.ae ( 1, String ( "return getFieldData ( %1, %2 );" ).arg ( fieldId, idxArg ) );
+            hdr.ae ( "}" );
+
+            continue;
+        }
+
+        String valueType;
+        String decodeFunc = "decodeField";
+
+        if ( e->typeSymbol->isMessageOrStruct() )
+        {
+            valueType = String ( "%1::View" ).arg ( getClassPath ( e->typeSymbol ) );
+            decodeFunc = "getFieldView";
+
+            hdr.ce ( String ( "@brief Sets up a view of '%1', that uses the same memory" ).arg ( name ) );
+        }
+        else
+        {
+            valueType = getRawVarType ( hdr, e->typeSymbol, VarUseGetter );
+
+            if ( e->typeSymbol->isEnum() )
+            {
+                decodeFunc = "decodeEnumField";
+            }
+
+            hdr.ce ( String ( "@brief Decodes the value of '%1'" ).arg ( name ) );
+        }
+
+        if ( e->isRepeated() )
+        {
+            hdr.ce ( "@param [in] index The index of the element" );
+            idxParam.append ( ", " );
+        }
+
+        if ( e->typeSymbol->isMessageOrStruct() )
+        {
+            hdr.ce ( "@param [out] value The view to set up" );
+        }
+        else
+        {
+            hdr.ce ( "@param [out] value The value to decode the data into" );
+        }
+
+        hdr.ce ( "@return The error code; RequiredFieldNotSet if the field is not present" );
+        hdr.ae ( String ( "inline %1 %2 ( %3%4 & value )" )
+                 .arg ( getStdType ( TypeErrorCode ), e->getCamelCaseName ( "get" ), idxParam, valueType ) );
+        hdr.ae ( "{" );
+        hdr.ae ( 1, String ( "return %1 ( %2, %3, value );" ).arg ( decodeFunc, fieldId, idxArg ) );
+        hdr.ae ( "}" );
+    }
+
+    hdr.decBaseIndent ( 2 );
+    hdr.ae ( "};" ).e();
+
+    if ( !s->isMessage() )
+        return;
+
+    hdr.ce ( "@brief Returns a view of the original data buffer from which this object was deserialized" );
+    hdr.ce ( "@return A view of the original data buffer; It is empty if this object has not been deserialized" );
+    hdr.ce ( "        (or it has been modified since)" );
+    hdr.ae ( "inline View getView() const" );
+    hdr.ae ( "{" );
+    hdr.ae ( 1, "return View ( getOrgBuffer() );" );
+    hdr.ae ( "}" ).e();
+}
@@ -42,6 +42,7 @@ class PravalaCppGenerator: public CppGenerator
         const Symbol * const _symTimestamp; ///< The symbol that represents the 'timestamp' type
 
         bool _enableJson; ///< Whether JSON support should be enabled.
+        bool _enableLazyView; ///< Whether lazy views of messages should be generated.
 
         virtual void hookPosition (
             Symbol * symbol, CppFile & hdrFile, CppFile & implFile,
@@ -62,6 +63,9 @@ class PravalaCppGenerator: public CppGenerator
             const String & valueVarName,
             const String & valueCode );
 
+        virtual String exprProtoEncodedSize ( const String & valueVarName, const String & valueCode );
+        virtual String exprMessageFieldSize ( const String & varName, const String & valueCode );
+
         virtual String exprListAppend (
             Symbol * intSymbol, const String & listVarName,
             const String & appendVarName );
@@ -86,8 +90,8 @@ class PravalaCppGenerator: public CppGenerator
 
         virtual void genSerializeMessage (
             CppFile & file, int indent, Symbol * symbol, const String & varName,
-            const String & bufVarName, const String & resultVarName,
-            const String & extErrVarName );
+            const String & bufVarName, const String & fieldIdName,
+            const String & resultVarName, const String & extErrVarName );
 
         virtual void genDeserializeMessage (
             CppFile & file, int indent, Symbol * symbol, const String & varName,
@@ -100,6 +104,15 @@ class PravalaCppGenerator: public CppGenerator
         virtual void genClassHeader ( Symbol * symbol, CppFile & hdrFile, CppFile & implFile );
         virtual void genTestBaseDefsFunc ( Symbol * symbol, CppFile & hdrFile, CppFile & implFile );
         virtual void genDumpFunc ( Symbol * symbol, CppFile & hdrFile, CppFile & implFile );
+        virtual void genTypeInfoFuncs ( Symbol * symbol, CppFile & hdrFile, CppFile & implFile );
+        virtual void genCopyFromBaseFunc ( Symbol * symbol, CppFile & hdrFile, CppFile & implFile );
+        virtual void genTypeRegEntry ( Symbol * symbol, CppFile & hdrFile, CppFile & implFile );
+
+        /// @brief Generates the 'View' class, which is a lazy, read-only view of the serialized object
+        /// @param [in] symbol The symbol object to generate the code for
+        /// @param [in] hdrFile The header file
+        /// @param [in] implFile The implementation file
+        virtual void genLazyViewClass ( Symbol * symbol, CppFile & hdrFile, CppFile & implFile );
         virtual void genEnumHashGets ( CppFile & hdr );
 };
 }